@@ -43,6 +43,12 @@ Maintainer: Sylvain Miermont
 */
 void wait_ms(unsigned long t);
 
+/**
+@brief Wait for a certain time (microsecond accuracy, for short waits)
+@param t number of microseconds to wait.
+*/
+void wait_us(unsigned long t);
+
 #endif
 
 /* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,97 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Calibration cache: stores the results of the radios calibration in a file
+    so that a warm restart with the same hardware and configuration can reload
+    them instead of running the calibration firmware again.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+#ifndef _LORAGW_CALCACHE_H
+#define _LORAGW_CALCACHE_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_CALCACHE_SUCCESS    0
+#define LGW_CALCACHE_ERROR      -1
+
+#define CALCACHE_TEMP_BAND      10  /* width of the temperature bands, in degC */
+#define CALCACHE_IQ_NB          5   /* number of IQ mismatch compensation registers */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct calcache_key_s
+@brief Everything the calibration results depend on
+*/
+struct calcache_key_s {
+    uint8_t     cal_cmd;                    /*!> calibration command word (radios enabled, TX enabled, radio type) */
+    uint32_t    rf_freq[LGW_RF_CHAIN_NB];   /*!> RX frequency of each radio, in Hz */
+    uint8_t     chip_version;               /*!> SX1301 version register */
+    uint8_t     fpga_version;               /*!> FPGA version register, 0 if no FPGA */
+    int8_t      temp_band;                  /*!> board temperature band */
+};
+
+/**
+@struct calcache_data_s
+@brief Results of a calibration
+*/
+struct calcache_data_s {
+    uint8_t     cal_status;                 /*!> calibration status reported by the calibration firmware */
+    int8_t      offset_a_i[8];              /*!> TX I offset for radio A, for mixer gain = 8 to 15 */
+    int8_t      offset_a_q[8];              /*!> TX Q offset for radio A */
+    int8_t      offset_b_i[8];              /*!> TX I offset for radio B */
+    int8_t      offset_b_q[8];              /*!> TX Q offset for radio B */
+    int32_t     iq[CALCACHE_IQ_NB];         /*!> RX IQ mismatch compensation registers */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Load calibration results from a cache file
+@param path cache file path
+@param key hardware and configuration the results must have been obtained with
+@param max_age_s maximum age of the results in seconds, 0 for no limit
+@param data pointer to the structure that will receive the results
+@return LGW_CALCACHE_ERROR if there is no valid results for that key, LGW_CALCACHE_SUCCESS else
+*/
+int calcache_load(const char *path, const struct calcache_key_s *key, uint32_t max_age_s, struct calcache_data_s *data);
+
+/**
+@brief Store calibration results in a cache file (replaces previous content)
+@param path cache file path
+@param key hardware and configuration the results were obtained with
+@param data results of the calibration
+@return LGW_CALCACHE_ERROR id the operation failed, LGW_CALCACHE_SUCCESS else
+*/
+int calcache_save(const char *path, const struct calcache_key_s *key, const struct calcache_data_s *data);
+
+/**
+@brief Get the temperature band of a board temperature
+@param temperature board temperature in degC
+@return temperature band
+*/
+int8_t calcache_temp_band(int8_t temperature);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
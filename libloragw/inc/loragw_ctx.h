@@ -0,0 +1,230 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Concentrator contexts, to drive several concentrators from one process.
+    A context holds the SPI link and the whole state of the library for one
+    concentrator. Each thread works on the context bound to it, the default
+    context unless lgw_ctx_bind was called, so the original API keeps working
+    unchanged on the default context.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _LORAGW_CTX_H
+#define _LORAGW_CTX_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "config.h"     /* library configuration options (dynamically generated) */
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_CTX_SUCCESS     0
+#define LGW_CTX_ERROR       -1
+
+#define LGW_CTX_PATH_MAX    64  /* maximum length of a SPI device path, terminating null included */
+
+/* -------------------------------------------------------------------------- */
+/* --- INTERNAL SHARED TYPES ------------------------------------------------ */
+
+/* private state of each module, defined in the module */
+struct lgw_reg_state_s;
+struct lgw_hal_state_s;
+struct lgw_fpga_state_s;
+struct lgw_lbt_state_s;
+struct lgw_rxcorr_state_s;
+struct lgw_rxq_state_s;
+struct lgw_rxev_state_s;
+struct lgw_txq_state_s;
+
+/**
+@struct lgw_ctx_s
+@brief Concentrator context, the application must not access its fields
+*/
+struct lgw_ctx_s {
+    char                        spi_path[LGW_CTX_PATH_MAX]; /*!> SPI device, empty for the default one */
+    void                        *spi_target;    /*!> generic pointer to the SPI device, NULL when disconnected */
+    uint8_t                     spi_mux_mode;   /*!> current SPI mux mode used */
+    struct lgw_reg_state_s      *reg;
+    struct lgw_hal_state_s      *hal;
+    struct lgw_fpga_state_s     *fpga;
+    struct lgw_lbt_state_s      *lbt;
+    struct lgw_rxcorr_state_s   *rxcorr;
+    struct lgw_rxq_state_s      *rxq;
+    struct lgw_rxev_state_s     *rxev;
+    struct lgw_txq_state_s      *txq;
+};
+
+/* context bound to the calling thread, never NULL */
+extern __thread struct lgw_ctx_s *lgw_ctx_cur;
+
+/* -------------------------------------------------------------------------- */
+/* --- INTERNAL SHARED FUNCTIONS -------------------------------------------- */
+
+/* allocation of the state of each module for a new context, defined in the
+modules; NULL if the memory cannot be allocated */
+struct lgw_reg_state_s *lgw_reg_state_new(void);
+struct lgw_hal_state_s *lgw_hal_state_new(void);
+struct lgw_fpga_state_s *lgw_fpga_state_new(void);
+struct lgw_lbt_state_s *lgw_lbt_state_new(void);
+struct lgw_rxcorr_state_s *lgw_rxcorr_state_new(void);
+struct lgw_rxq_state_s *lgw_rxq_state_new(void);
+struct lgw_rxev_state_s *lgw_rxev_state_new(void);
+struct lgw_txq_state_s *lgw_txq_state_new(void);
+
+void lgw_reg_state_free(struct lgw_reg_state_s *state);
+void lgw_hal_state_free(struct lgw_hal_state_s *state);
+void lgw_fpga_state_free(struct lgw_fpga_state_s *state);
+void lgw_lbt_state_free(struct lgw_lbt_state_s *state);
+void lgw_rxcorr_state_free(struct lgw_rxcorr_state_s *state);
+void lgw_rxq_state_free(struct lgw_rxq_state_s *state);
+void lgw_rxev_state_free(struct lgw_rxev_state_s *state);
+void lgw_txq_state_free(struct lgw_txq_state_s *state);
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Create a concentrator context
+@param spi_path SPI device of the concentrator (eg. "/dev/spidev1.0"), NULL for the default one
+@return pointer to the new context, NULL if it could not be created
+
+The context starts with the default configuration, like the library at
+program start. It is not bound to any thread.
+*/
+struct lgw_ctx_s *lgw_ctx_create(const char *spi_path);
+
+/**
+@brief Destroy a concentrator context
+@param ctx pointer to the context
+@return LGW_CTX_ERROR if the context is the default one or its concentrator is still connected, LGW_CTX_SUCCESS else
+
+The concentrator must be stopped first (lgw_stop), and no thread must have the
+context bound anymore.
+*/
+int lgw_ctx_destroy(struct lgw_ctx_s *ctx);
+
+/**
+@brief Bind a context to the calling thread
+@param ctx pointer to the context, NULL for the default context
+@return LGW_CTX_SUCCESS
+
+All the library functions called afterwards by this thread (lgw_start,
+lgw_receive, lgw_reg_r, ...) work on that context. Threads created by the
+library (RX queue, RX event, TX queue) inherit the context of the thread that
+started them.
+*/
+int lgw_ctx_bind(struct lgw_ctx_s *ctx);
+
+/**
+@brief Get the context bound to the calling thread
+@return pointer to the context (the default context if none was bound)
+*/
+struct lgw_ctx_s *lgw_ctx_get(void);
+
+/**
+@brief Equivalent of lgw_board_setconf on a given context
+@param ctx pointer to the context
+@param conf structure containing the configuration parameters
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_ctx_board_setconf(struct lgw_ctx_s *ctx, struct lgw_conf_board_s conf);
+
+/**
+@brief Equivalent of lgw_rxrf_setconf on a given context
+@param ctx pointer to the context
+@param rf_chain number of the RF chain to configure [0, LGW_RF_CHAIN_NB - 1]
+@param conf structure containing the configuration parameters
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_ctx_rxrf_setconf(struct lgw_ctx_s *ctx, uint8_t rf_chain, struct lgw_conf_rxrf_s conf);
+
+/**
+@brief Equivalent of lgw_rxif_setconf on a given context
+@param ctx pointer to the context
+@param if_chain number of the IF chain + modem to configure [0, LGW_IF_CHAIN_NB - 1]
+@param conf structure containing the configuration parameters
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_ctx_rxif_setconf(struct lgw_ctx_s *ctx, uint8_t if_chain, struct lgw_conf_rxif_s conf);
+
+/**
+@brief Equivalent of lgw_txgain_setconf on a given context
+@param ctx pointer to the context
+@param conf pointer to structure defining the LUT
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_ctx_txgain_setconf(struct lgw_ctx_s *ctx, struct lgw_tx_gain_lut_s *conf);
+
+/**
+@brief Equivalent of lgw_start on a given context
+@param ctx pointer to the context
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_ctx_start(struct lgw_ctx_s *ctx);
+
+/**
+@brief Equivalent of lgw_stop on a given context
+@param ctx pointer to the context
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_ctx_stop(struct lgw_ctx_s *ctx);
+
+/**
+@brief Equivalent of lgw_receive on a given context
+@param ctx pointer to the context
+@param max_pkt maximum number of packets that will be returned
+@param pkt_data pointer to an array of struct that will receive the packet metadata and payload pointers
+@return LGW_HAL_ERROR id the operation failed, else the number of packets retrieved
+*/
+int lgw_ctx_receive(struct lgw_ctx_s *ctx, uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data);
+
+/**
+@brief Equivalent of lgw_send on a given context
+@param ctx pointer to the context
+@param pkt_data structure containing the data and metadata for the packet to send
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_ctx_send(struct lgw_ctx_s *ctx, struct lgw_pkt_tx_s pkt_data);
+
+/**
+@brief Equivalent of lgw_status on a given context
+@param ctx pointer to the context
+@param select is used to select what status we want to know
+@param code is used to return the status code
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_ctx_status(struct lgw_ctx_s *ctx, uint8_t select, uint8_t *code);
+
+/**
+@brief Equivalent of lgw_abort_tx on a given context
+@param ctx pointer to the context
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_ctx_abort_tx(struct lgw_ctx_s *ctx);
+
+/**
+@brief Equivalent of lgw_get_trigcnt on a given context
+@param ctx pointer to the context
+@param trig_cnt_us pointer to receive timestamp value
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_ctx_get_trigcnt(struct lgw_ctx_s *ctx, uint32_t *trig_cnt_us);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
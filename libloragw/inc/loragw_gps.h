@@ -24,15 +24,67 @@ Maintainer: Michael Coracin
 
 #define _GNU_SOURCE
 #include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
 #include <time.h>       /* time library */
 #include <termios.h>    /* speed_t */
 #include <unistd.h>     /* ssize_t */
 
 #include "config.h"     /* library configuration options (dynamically generated) */
 
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_GPS_SUCCESS 0
+#define LGW_GPS_ERROR   -1
+
+#define LGW_GPS_MIN_MSG_SIZE      (8)
+#define LGW_GPS_UBX_SYNC_CHAR     (0xB5)
+#define LGW_GPS_NMEA_SYNC_CHAR    (0x24)
+
+#define LGW_GPS_STREAM_SIZE       1024  /* ring buffer of a GPS stream, power of 2 */
+#define LGW_GPS_NMEA_MAX_SIZE     256   /* longer NMEA sentences are dropped */
+#define LGW_GPS_NMEA_FIELD_MAX    30    /* following fields of a NMEA sentence are ignored */
+#define LGW_GPS_UBX_MAX_PAYLOAD   1024  /* UBX frames announcing a longer payload are dropped */
+
+#define LGW_DRIFT_MEAS_STD_DEFAULT  0.5     /* us, counter quantization and time pulse jitter */
+#define LGW_DRIFT_WANDER_DEFAULT    0.004   /* ppm per square root of second */
+#define LGW_DRIFT_BW_DEFAULT        0.02    /* Hz */
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC TYPES --------------------------------------------------------- */
 
+/**
+@enum lgw_drift_filter
+@brief Estimators of the concentrator clock error used by lgw_gps_sync
+*/
+enum lgw_drift_filter {
+    LGW_DRIFT_SLOPE = 0,    /*!> slope between the last two sync points (default) */
+    LGW_DRIFT_KALMAN,       /*!> Kalman filter of the counter offset and clock error */
+    LGW_DRIFT_PLL           /*!> 2nd order phase-locked loop */
+};
+
+/**
+@struct lgw_conf_drift_s
+@brief Configuration of the clock error estimator of a time reference
+*/
+struct lgw_conf_drift_s {
+    enum lgw_drift_filter   filter;
+    double                  meas_std_us;    /*!> standard deviation of the counter value latched at a time pulse, in us (0 for default) */
+    double                  wander_ppm;     /*!> random walk of the clock error, in ppm per square root of second (0 for default), PLL: only widens the gate */
+    double                  bw_hz;          /*!> PLL: loop bandwidth, in Hz (0 for default) */
+};
+
+/**
+@struct lgw_drift_s
+@brief State of the clock error estimator of a time reference
+*/
+struct lgw_drift_s {
+    struct lgw_conf_drift_s conf;
+    uint32_t                nb_point;       /*!> sync points used since the last reset */
+    uint32_t                nb_aberrant;    /*!> successive sync points rejected */
+    double                  p[3];           /*!> Kalman: covariance of the counter offset and clock error; PLL: mean squares of the corrections */
+};
+
 /**
 @struct coord_s
 @brief Time solution required for timestamp to absolute time conversion
@@ -42,7 +94,24 @@ struct tref {
     uint32_t        count_us;   /*!> reference concentrator internal timestamp */
     struct timespec utc;        /*!> reference UTC time (from GPS/NMEA) */
     struct timespec gps;        /*!> reference GPS time (since 01.Jan.1980) */
-    double          xtal_err;   /*!> raw clock error (eg. <1 'slow' XTAL) */
+    double          xtal_err;   /*!> estimated clock error (eg. <1 'slow' XTAL) */
+    double          xtal_err_std; /*!> estimated standard deviation of xtal_err */
+    double          count_std;  /*!> estimated standard deviation of count_us at the reference time, in us */
+    uint64_t        cnt2ns;     /*!> fixed point nanoseconds per counter tick, cached for xtal_err_cached by lgw_gps_sync */
+    uint64_t        ns2cnt;     /*!> fixed point counter ticks per nanosecond, cached with cnt2ns */
+    double          xtal_err_cached; /*!> xtal_err the cached ratios were computed for, they are ignored if it changed */
+    struct lgw_drift_s drift;   /*!> clock error estimator, filled by lgw_gps_sync */
+};
+
+/**
+@struct lgw_tref_pub_s
+@brief Time reference published by one writer to any number of reader threads
+*/
+struct lgw_tref_pub_s {
+    uint32_t        seq;        /*!> sequence counter, odd while the reference is being updated */
+    struct tref     ref;        /*!> published reference, only accessed through the lgw_tref_* functions */
+    uint64_t        cnt2ns;     /*!> fixed point nanoseconds per counter tick of the reference, 0 if it is invalid */
+    uint64_t        ns2cnt;     /*!> fixed point counter ticks per nanosecond of the reference */
 };
 
 /**
@@ -83,15 +152,34 @@ enum gps_msg {
     UBX_NAV_TIMEUTC  /*!> UTC Time Solution */
 };
 
-/* -------------------------------------------------------------------------- */
-/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
-
-#define LGW_GPS_SUCCESS 0
-#define LGW_GPS_ERROR   -1
+/**
+@struct lgw_gps_stream_s
+@brief Incremental parser of the byte stream sent by a GPS module
 
-#define LGW_GPS_MIN_MSG_SIZE      (8)
-#define LGW_GPS_UBX_SYNC_CHAR     (0xB5)
-#define LGW_GPS_NMEA_SYNC_CHAR    (0x24)
+Bytes are buffered in a ring and examined once by a frame synchronization state
+machine that computes the UBX (Fletcher) and NMEA (XOR) checksums on the fly.
+Complete frames are decoded in place, in the ring. The fields are private, use
+the lgw_gps_stream_* functions.
+*/
+struct lgw_gps_stream_s {
+    uint8_t     buf[LGW_GPS_STREAM_SIZE];   /*!> ring buffer */
+    uint32_t    wr;             /*!> index of the next byte received (free running) */
+    uint32_t    rd;             /*!> index of the next byte to examine */
+    uint32_t    start;          /*!> index of the first byte of the frame being received */
+    uint8_t     state;          /*!> frame synchronization state */
+    bool        keep;           /*!> frame bytes kept in the ring to be decoded */
+    uint16_t    len;            /*!> UBX payload length */
+    uint16_t    cnt;            /*!> UBX header and payload bytes received */
+    uint8_t     ck_a;           /*!> UBX checksum, first byte */
+    uint8_t     ck_b;           /*!> UBX checksum, second byte */
+    uint8_t     ck_x;           /*!> NMEA checksum */
+    uint8_t     nb_field;       /*!> number of NMEA fields */
+    uint16_t    field[LGW_GPS_NMEA_FIELD_MAX];  /*!> offset of each NMEA field in the frame */
+    uint16_t    field_end;      /*!> offset of the '*' ending the NMEA fields */
+    uint32_t    nb_frame;       /*!> statistics: frames with a valid checksum */
+    uint32_t    nb_invalid;     /*!> statistics: frames dropped (checksum, size or characters) */
+    uint32_t    nb_skipped;     /*!> statistics: bytes outside of any frame */
+};
 
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
@@ -124,8 +212,10 @@ int lgw_gps_disable(int fd);
 
 The RAW NMEA sentences are parsed to a global set of variables shared with the
 lgw_gps_get function.
-If the lgw_parse_nmea and lgw_gps_get are used in different threads, a mutex
-lock must be acquired before calling either function.
+The buffer must contain a complete sentence; to parse the bytes read from the
+serial port without framing them, use lgw_gps_stream_next.
+The parsing and lgw_gps_get are serialized by an internal lock, so they can be
+called from different threads.
 */
 enum gps_msg lgw_parse_nmea(const char* serial_buff, int buff_size);
 
@@ -139,11 +229,58 @@ enum gps_msg lgw_parse_nmea(const char* serial_buff, int buff_size);
 
 The RAW UBX sentences are parsed to a global set of variables shared with the
 lgw_gps_get function.
-If the lgw_parse_ubx and lgw_gps_get are used in different threads, a mutex
-lock must be acquired before calling either function.
+To parse the bytes read from the serial port without framing them, use
+lgw_gps_stream_next.
+The parsing and lgw_gps_get are serialized by an internal lock, so they can be
+called from different threads.
 */
 enum gps_msg lgw_parse_ubx(const char* serial_buff, size_t buff_size, size_t *msg_size);
 
+/**
+@brief Initialize a GPS stream parser
+
+@param s pointer to the parser state, typically allocated by the GPS thread
+@return LGW_GPS_ERROR if s is NULL, LGW_GPS_SUCCESS else
+*/
+int lgw_gps_stream_init(struct lgw_gps_stream_s *s);
+
+/**
+@brief Read the bytes available on the GPS serial port into a stream
+
+@param s pointer to the parser state
+@param fd file descriptor on GPS tty
+@return number of bytes read, 0 at end of file or if the ring is full (call lgw_gps_stream_next first), -1 if read() failed
+
+A single read() call is made directly into the free space of the ring; with the
+serial port configured by lgw_gps_enable, it blocks until LGW_GPS_MIN_MSG_SIZE
+bytes are available.
+*/
+ssize_t lgw_gps_stream_read(struct lgw_gps_stream_s *s, int fd);
+
+/**
+@brief Append bytes received from a GPS module to a stream
+
+@param s pointer to the parser state
+@param data bytes to append
+@param size number of bytes
+@return number of bytes appended, less than size if the ring is full
+*/
+size_t lgw_gps_stream_write(struct lgw_gps_stream_s *s, const void *data, size_t size);
+
+/**
+@brief Parse the next frame of a stream
+
+@param s pointer to the parser state
+@return type of frame parsed, INVALID if a frame was dropped, UNKNOWN if more bytes are needed
+
+Call it until it returns UNKNOWN after each read. The sentences and messages
+supported by lgw_parse_nmea and lgw_parse_ubx are decoded to the same global
+variables, read by lgw_gps_get; the others return IGNORED. Bytes outside of any
+frame are skipped, and the parser resynchronizes on the byte following the
+start of a dropped frame.
+*/
+enum gps_msg lgw_gps_stream_next(struct lgw_gps_stream_s *s);
+
 /**
 @brief Get the GPS solution (space & time) for the concentrator
 
@@ -156,11 +293,35 @@ enum gps_msg lgw_parse_ubx(const char* serial_buff, size_t buff_size, size_t *ms
 This function read the global variables generated by the NMEA/UBX parsing
 functions lgw_parse_nmea/lgw_parse_ubx. It returns time and location data in a
 format that is exploitable by other functions in that library sub-module.
-If the lgw_parse_nmea/lgw_parse_ubx and lgw_gps_get are used in different
-threads, a mutex lock must be acquired before calling either function.
+Both times are computed from the GPS time of the last navigation epoch, so
+they always match: the date of a RMC sentence (see lgw_date2utc) plus the
+GPS-UTC leap seconds offset, or the week and time of week of a NAV-TIMEGPS
+message. The offset is the one of the last NAV-TIMEGPS message, 18 s (since
+01.Jan.2017) as long as none was received, so receivers that only output NMEA
+sentences also get GPS time. Both need a valid time.
+The parsing and lgw_gps_get are serialized by an internal lock, so they can be
+called from different threads.
 */
 int lgw_gps_get(struct timespec *utc, struct timespec *gps_time, struct coord_s *loc, struct coord_s *err);
 
+/**
+@brief Convert a UTC date and time to a number of seconds since the Unix epoch
+@param year year, 2 digits (20xx) or 4 digits
+@param mon month (1-12)
+@param day day of the month (1-31)
+@param hou hours (0-23)
+@param min minutes (0-59)
+@param sec seconds (0-60)
+@param utc pointer to store the number of seconds since 01.Jan.1970 00:00:00 UTC
+@return success if the date is valid and fits in a time_t
+
+Direct calendar computation, independent of the process time zone and without
+any libc lock (unlike mktime), used by lgw_gps_get.
+A leap second (sec 60) is counted as the first second of the next minute, as in
+POSIX time.
+*/
+int lgw_date2utc(int year, int mon, int day, int hou, int min, int sec, time_t *utc);
+
 /**
 @brief Get time and position information from the serial GPS last message received
 @param utc UTC time, with ns precision (leap seconds are ignored)
@@ -171,9 +332,26 @@ int lgw_gps_get(struct timespec *utc, struct timespec *gps_time, struct coord_s
 @return success if timestamp was read and time reference could be refreshed
 
 Set systime to 0 in ref to trigger initial synchronization.
+The clock error is estimated by the filter configured with lgw_gps_sync_setconf
+(by default the slope between the last two sync points), whose state is kept in
+ref: each time reference is filtered independently. Sync points that do not
+match the estimate are rejected, 3 successive rejections reset the reference.
+The time reference belongs to the caller: if it is shared between threads (eg.
+updated by a GPS thread and read by a packet forwarding thread), the caller
+protects it, or publishes it with lgw_tref_sync instead.
 */
 int lgw_gps_sync(struct tref *ref, uint32_t count_us, struct timespec utc, struct timespec gps_time);
 
+/**
+@brief Select the clock error estimator of a time reference
+@param ref time reference structure
+@param conf estimator configuration
+@return success if the configuration is valid
+
+The reference is reset: the next call to lgw_gps_sync starts a new estimation.
+*/
+int lgw_gps_sync_setconf(struct tref *ref, const struct lgw_conf_drift_s *conf);
+
 /**
 @brief Convert concentrator timestamp counter value to UTC time
 
@@ -185,6 +363,8 @@ int lgw_gps_sync(struct tref *ref, uint32_t count_us, struct timespec utc, struc
 This function is typically used when a packet is received to transform the
 internal counter-based timestamp in an absolute timestamp with an accuracy in
 the order of a couple microseconds (ns resolution).
+The result is rounded to the nearest nanosecond. count_us can be up to 2^31 us
+(35 minutes) before or after the reference counter value, across a counter wrap.
 */
 int lgw_cnt2utc(struct tref ref, uint32_t count_us, struct timespec* utc);
 
@@ -199,6 +379,7 @@ int lgw_cnt2utc(struct tref ref, uint32_t count_us, struct timespec* utc);
 This function is typically used when a packet must be sent at an accurate time
 (eg. to send a piggy-back response after receiving a packet from a node) to
 transform an absolute UTC time into a matching internal concentrator timestamp.
+The result is rounded to the nearest microsecond and wraps like the counter.
 */
 int lgw_utc2cnt(struct tref ref,struct timespec utc, uint32_t* count_us);
 
@@ -213,6 +394,7 @@ int lgw_utc2cnt(struct tref ref,struct timespec utc, uint32_t* count_us);
 This function is typically used when a packet is received to transform the
 internal counter-based timestamp in an absolute timestamp with an accuracy in
 the order of a millisecond.
+Same rounding and counter range as lgw_cnt2utc.
 */
 int lgw_cnt2gps(struct tref ref, uint32_t count_us, struct timespec* gps_time);
 
@@ -227,9 +409,93 @@ int lgw_cnt2gps(struct tref ref, uint32_t count_us, struct timespec* gps_time);
 This function is typically used when a packet must be sent at an accurate time
 (eg. to send a piggy-back response after receiving a packet from a node) to
 transform an absolute GPS time into a matching internal concentrator timestamp.
+Same rounding as lgw_utc2cnt.
 */
 int lgw_gps2cnt(struct tref ref, struct timespec gps_time, uint32_t* count_us);
 
+/**
+@brief Initialize a published time reference
+@param pub pointer to the published reference
+@return success if the reference was initialized
+
+The reference is invalid until the first successful lgw_tref_sync or
+lgw_tref_set.
+*/
+int lgw_tref_init(struct lgw_tref_pub_s *pub);
+
+/**
+@brief Synchronize a published time reference with a new GPS & timestamp pair
+@param pub pointer to the published reference
+@param count_us internal timestamp counter of the LoRa concentrator at the time pulse
+@param utc UTC time of the time pulse, with ns precision (leap seconds are ignored)
+@param gps_time GPS time of the time pulse, with ns precision (leap seconds are ignored)
+@return success if the time reference could be refreshed, as lgw_gps_sync
+
+Same processing as lgw_gps_sync, the new reference (and the estimator state,
+even if the sync point is rejected) is published to the readers in one step.
+Only one thread (typically the GPS thread) may update a published reference;
+no lock is needed between that thread and the readers.
+*/
+int lgw_tref_sync(struct lgw_tref_pub_s *pub, uint32_t count_us, struct timespec utc, struct timespec gps_time);
+
+/**
+@brief Select the clock error estimator of a published time reference
+@param pub pointer to the published reference
+@param conf estimator configuration
+@return success if the configuration is valid
+
+Same as lgw_gps_sync_setconf; the reference is invalid until the next
+synchronization. Same single writer rule as lgw_tref_sync.
+*/
+int lgw_tref_setconf(struct lgw_tref_pub_s *pub, const struct lgw_conf_drift_s *conf);
+
+/**
+@brief Publish a time reference computed by the caller
+@param pub pointer to the published reference
+@param ref time reference to publish
+@return success if the reference was published
+
+Same single writer rule as lgw_tref_sync.
+*/
+int lgw_tref_set(struct lgw_tref_pub_s *pub, const struct tref *ref);
+
+/**
+@brief Get a consistent copy of a published time reference
+@param pub pointer to the published reference
+@param ref pointer to store the copy
+@return success if the copy was made
+
+Readers never take a lock nor block the writer: a copy that overlaps an update
+is simply made again, which can only happen once per synchronization.
+*/
+int lgw_tref_get(const struct lgw_tref_pub_s *pub, struct tref *ref);
+
+/**
+@brief Convert an array of concentrator timestamp counter values to UTC time
+@param pub pointer to the published reference
+@param count_us array of internal timestamp counter values
+@param utc array of nb_val elements to store the UTC times
+@param nb_val number of values to convert
+@return success if the values were converted, error if the reference is invalid
+
+All the values are converted with the same copy of the reference, and give the
+same results as lgw_cnt2utc with that reference.
+*/
+int lgw_tref_cnt2utc(const struct lgw_tref_pub_s *pub, const uint32_t *count_us, struct timespec *utc, int nb_val);
+
+/**
+@brief Convert an array of concentrator timestamp counter values to GPS time
+@param pub pointer to the published reference
+@param count_us array of internal timestamp counter values
+@param gps_time array of nb_val elements to store the GPS times
+@param nb_val number of values to convert
+@return success if the values were converted, error if the reference is invalid
+
+All the values are converted with the same copy of the reference, and give the
+same results as lgw_cnt2gps with that reference.
+*/
+int lgw_tref_cnt2gps(const struct lgw_tref_pub_s *pub, const uint32_t *count_us, struct timespec *gps_time, int nb_val);
+
 #endif
 
 /* --- EOF ------------------------------------------------------------------ */
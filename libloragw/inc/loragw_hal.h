@@ -24,6 +24,7 @@ Maintainer: Sylvain Miermont
 #include <stdbool.h>    /* bool type */
 
 #include "config.h"     /* library configuration options (dynamically generated) */
+#include "loragw_pool.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC MACROS -------------------------------------------------------- */
@@ -155,6 +156,14 @@ Maintainer: Sylvain Miermont
 /* LBT constants */
 #define LBT_CHANNEL_FREQ_NB 8 /* Number of LBT channels */
 
+/* size of the TX metadata of struct lgw_pkt_tx_prep_s (16 bytes, plus the payload size for FSK) */
+#define LGW_TX_META_MAX     17
+
+/* firmware load verification, for lgw_start_setconf */
+#define LGW_FW_VERIFY_FULL      0    /* whole program memory read back and compared */
+#define LGW_FW_VERIFY_PREFIX    1    /* first bytes of the program memory read back and compared */
+#define LGW_FW_VERIFY_NONE      2    /* no readback */
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC TYPES --------------------------------------------------------- */
 
@@ -250,6 +259,30 @@ struct lgw_pkt_rx_s {
     uint8_t     payload[256];   /*!> buffer containing the payload */
 };
 
+/**
+@struct lgw_pkt_rx_ref_s
+@brief Structure containing the metadata of a packet that was received and a reference to its payload in a packet pool
+*/
+struct lgw_pkt_rx_ref_s {
+    uint32_t    freq_hz;        /*!> central frequency of the IF chain */
+    uint8_t     if_chain;       /*!> by which IF chain was packet received */
+    uint8_t     status;         /*!> status of the received packet */
+    uint32_t    count_us;       /*!> internal concentrator counter for timestamping, 1 microsecond resolution */
+    uint8_t     rf_chain;       /*!> through which RF chain the packet was received */
+    uint8_t     modulation;     /*!> modulation used by the packet */
+    uint8_t     bandwidth;      /*!> modulation bandwidth (LoRa only) */
+    uint32_t    datarate;       /*!> RX datarate of the packet (SF for LoRa) */
+    uint8_t     coderate;       /*!> error-correcting code of the packet (LoRa only) */
+    float       rssi;           /*!> average packet RSSI in dB */
+    float       snr;            /*!> average packet SNR, in dB (LoRa only) */
+    float       snr_min;        /*!> minimum packet SNR, in dB (LoRa only) */
+    float       snr_max;        /*!> maximum packet SNR, in dB (LoRa only) */
+    uint16_t    crc;            /*!> CRC that was received in the payload */
+    uint16_t    size;           /*!> payload size in bytes */
+    uint16_t    slot;           /*!> pool slot holding the payload, to be released with lgw_pool_release */
+    uint8_t     *payload;       /*!> pointer to the payload, valid until the slot is released */
+};
+
 /**
 @struct lgw_pkt_tx_s
 @brief Structure containing the configuration of a packet to send and a pointer to the payload
@@ -273,6 +306,20 @@ struct lgw_pkt_tx_s {
     uint8_t     payload[256];   /*!> buffer containing the payload */
 };
 
+/**
+@struct lgw_pkt_tx_prep_s
+@brief Packet to send, validated and converted to the TX buffer format by lgw_send_prepare
+*/
+struct lgw_pkt_tx_prep_s {
+    struct lgw_pkt_tx_s pkt;        /*!> packet, with the preamble size adjusted */
+    uint8_t     meta[LGW_TX_META_MAX]; /*!> TX buffer metadata, written before the payload */
+    uint8_t     meta_size;          /*!> number of metadata bytes */
+    uint16_t    tx_start_delay;     /*!> TX start delay, in microseconds */
+    int8_t      offset_i;           /*!> TX I offset correction */
+    int8_t      offset_q;           /*!> TX Q offset correction */
+    uint8_t     dig_gain;           /*!> SX1301 digital gain */
+};
+
 /**
 @struct lgw_tx_gain_s
 @brief Structure containing all gains of Tx chain
@@ -294,6 +341,39 @@ struct lgw_tx_gain_lut_s {
     uint8_t                 size;                       /*!> Number of LUT indexes */
 };
 
+/**
+@struct lgw_conf_start_s
+@brief Configuration structure for the start procedure of the concentrator
+*/
+struct lgw_conf_start_s {
+    bool        fast;           /*!> poll hardware ready conditions instead of waiting fixed delays */
+    uint16_t    timeout_ms;     /*!> fast start: maximum wait for each condition, 0 for default */
+    const char  *cal_file;      /*!> calibration cache file, NULL to calibrate at every start */
+    uint32_t    cal_max_age_s;  /*!> maximum age of cached calibration results, in seconds (0 for no limit) */
+    bool        cal_force;      /*!> calibrate (and refresh the cache) even if valid results are cached */
+    int8_t      temperature;    /*!> board temperature in degC, cached results are used in the same 10 degC band only */
+    uint8_t     fw_verify;      /*!> firmware load verification: LGW_FW_VERIFY_FULL (default), _PREFIX or _NONE */
+};
+
+/**
+@struct lgw_start_timing_s
+@brief Duration of each phase of the last start procedure, in microseconds
+*/
+struct lgw_start_timing_s {
+    uint32_t    connect;        /*!> SPI link opening and concentrator reset */
+    uint32_t    radio;          /*!> radios XTAL start, reset, setup and PLL lock */
+    uint32_t    calib;          /*!> calibration firmware load and calibration */
+    uint32_t    modem;          /*!> modems configuration */
+    uint32_t    firmware;       /*!> AGC and arbiter firmwares load and start */
+    uint32_t    agc;            /*!> AGC firmware initialization handshake */
+    uint32_t    lbt;            /*!> LBT channels scan (SX1301AP2 ref design only) */
+    uint32_t    total;          /*!> whole start procedure */
+    bool        cal_cached;     /*!> calibration results were loaded from the cache */
+    uint32_t    fw_cal;         /*!> calibration firmware load (0 if calibration was skipped) */
+    uint32_t    fw_arb;         /*!> arbiter firmware load */
+    uint32_t    fw_agc;         /*!> AGC firmware load */
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
@@ -334,12 +414,39 @@ int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf);
 */
 int lgw_txgain_setconf(struct lgw_tx_gain_lut_s *conf);
 
+/**
+@brief Configure the start procedure of the concentrator (must configure before start)
+@param conf structure containing the configuration parameters
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+With fast start, lgw_start polls the radios, the end of calibration and the AGC
+firmware acknowledgements, each for timeout_ms at most, instead of waiting the
+fixed worst-case delays. lgw_start fails if one of them is not reached in time.
+
+With a calibration cache file, the results of a successful calibration are
+stored in the file, and the next starts with the same radios configuration,
+hardware and temperature band reload them instead of calibrating.
+
+Firmwares are loaded in the MCUs with the selected verification: full readback,
+readback of the first 512 bytes only (prefix), or none. A firmware is not
+reloaded if its MCU still holds the image loaded by a previous start of the
+same process; for the AGC firmware, only when that start skips the calibration.
+*/
+int lgw_start_setconf(struct lgw_conf_start_s conf);
+
 /**
 @brief Connect to the LoRa concentrator, reset it and configure it according to previously set parameters
 @return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
 */
 int lgw_start(void);
 
+/**
+@brief Get the duration of each phase of the last successful start
+@param timing pointer to the structure that will receive the durations
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_start_timing(struct lgw_start_timing_s *timing);
+
 /**
 @brief Stop the LoRa concentrator and disconnect it
 @return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
@@ -354,6 +461,19 @@ int lgw_stop(void);
 */
 int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data);
 
+/**
+@brief Same as lgw_receive, but the payloads are read directly into the slots of a packet pool
+@param pool pointer to a packet pool initialized with lgw_pool_init
+@param max_pkt maximum number of packet that must be retrieved (equal to the size of the array of struct)
+@param pkt_ref pointer to an array of struct that will receive the packet metadata and payload references
+@return LGW_HAL_ERROR id the operation failed, else the number of packets retrieved
+
+Each packet retrieved holds a pool slot until the application releases it with
+lgw_pool_release. When the pool is empty, the packets are left in the
+concentrator FIFO. Packets larger than the pool slots are dropped and counted.
+*/
+int lgw_receive_pool(struct lgw_pkt_pool_s *pool, uint8_t max_pkt, struct lgw_pkt_rx_ref_s *pkt_ref);
+
 /**
 @brief Schedule a packet to be send immediately or after a delay depending on tx_mode
 @param pkt_data structure containing the data and metadata for the packet to send
@@ -380,6 +500,36 @@ the protocol.
 */
 int lgw_send(struct lgw_pkt_tx_s pkt_data);
 
+/**
+@brief Validate a packet and convert it to the TX buffer format, without sending it
+@param pkt_data pointer to the structure containing the data and metadata of the packet
+@param prep pointer to the structure that will receive the prepared packet
+@return LGW_HAL_ERROR id the packet is not valid, LGW_HAL_SUCCESS else
+
+The PLL frequency code, TX start delay, power settings and metadata are
+computed once; the prepared packet can then be sent any number of times with
+lgw_send_prepared. It is only valid until the concentrator is stopped.
+*/
+int lgw_send_prepare(struct lgw_pkt_tx_s *pkt_data, struct lgw_pkt_tx_prep_s *prep);
+
+/**
+@brief Send a packet prepared by lgw_send_prepare (non blocking)
+@param prep pointer to the prepared packet
+@param count_us trigger timestamp, in microseconds (TIMESTAMPED mode only, ignored otherwise)
+@return LGW_HAL_ERROR id the operation failed, LGW_LBT_ISSUE if the channel is busy (LBT), LGW_HAL_SUCCESS else
+
+Same behaviour as lgw_send. All the register accesses are sent in a single SPI
+message, and the TX registers are only written when their value changes.
+*/
+int lgw_send_prepared(struct lgw_pkt_tx_prep_s *prep, uint32_t count_us);
+
+/**
+@brief Give the number of packets waiting in the concentrator RX FIFO, without fetching them
+@param nb_pkt pointer to receive the number of packets stored
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_rx_pending(uint8_t *nb_pkt);
+
 /**
 @brief Give the the status of different part of the LoRa concentrator
 @param select is used to select what status we want to know
@@ -410,10 +560,28 @@ const char* lgw_version_info(void);
 /**
 @brief Return time on air of given packet, in milliseconds
 @param packet is a pointer to the packet structure
-@return the packet time on air in milliseconds
+@return the packet time on air in milliseconds (truncated for LoRa, plus 1 ms of margin for FSK), 0 if the packet is not valid
 */
 uint32_t lgw_time_on_air(struct lgw_pkt_tx_s *packet);
 
+/**
+@brief Return time on air of given packet, in microseconds
+@param packet is a pointer to the packet structure
+@return the packet time on air in microseconds (exact for LoRa, rounded up for FSK), 0 if the packet is not valid
+
+Integer computation, LoRa symbol durations are read from a table.
+*/
+uint32_t lgw_time_on_air_us(struct lgw_pkt_tx_s *packet);
+
+/**
+@brief Compute the time on air of an array of packets, in microseconds
+@param packets pointer to an array of packets
+@param nb_pkt number of packets
+@param toa_us pointer to an array receiving the time on air of each packet (0 for an invalid packet)
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_time_on_air_batch(struct lgw_pkt_tx_s *packets, uint16_t nb_pkt, uint32_t *toa_us);
+
 #endif
 
 /* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,210 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Always-compiled instrumentation of the library hot paths.
+    Each probed function (lgw_receive, lgw_send, register and SPI accesses)
+    counts its calls and records its latency in a log-linear histogram. The
+    counters are kept per thread, so recording never takes a lock. Snapshots
+    sum them, and can be exported to a file read at runtime by util_perf.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _LORAGW_PERF_H
+#define _LORAGW_PERF_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "config.h"     /* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_PERF_SUCCESS        0
+#define LGW_PERF_ERROR          -1
+
+#define LGW_PERF_THREAD_MAX     16  /* threads with their own counters, the others are not measured */
+#define LGW_PERF_NAME_SIZE      16  /* size of a thread name, terminating null included */
+
+/* latency histogram: a first bucket for [0, 2^LOG2_MIN[ ns, then each power of
+two up to 2^LOG2_MAX ns is split in HIST_SUB linear buckets; longer latencies go
+to the last bucket */
+#define LGW_PERF_HIST_LOG2_MIN  8   /* 256 ns */
+#define LGW_PERF_HIST_LOG2_MAX  32  /* 4.3 s */
+#define LGW_PERF_HIST_SUB_LOG2  2
+#define LGW_PERF_HIST_SUB       (1 << LGW_PERF_HIST_SUB_LOG2)
+#define LGW_PERF_HIST_NB        (1 + (LGW_PERF_HIST_LOG2_MAX - LGW_PERF_HIST_LOG2_MIN) * LGW_PERF_HIST_SUB)
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@enum lgw_perf_probe_e
+@brief Measured functions
+*/
+enum lgw_perf_probe_e {
+    LGW_PERF_RECEIVE,   /*!> lgw_receive and lgw_receive_pool */
+    LGW_PERF_SEND,      /*!> lgw_send and lgw_send_prepared */
+    LGW_PERF_REG_R,     /*!> lgw_reg_r */
+    LGW_PERF_REG_W,     /*!> lgw_reg_w */
+    LGW_PERF_REG_RB,    /*!> lgw_reg_rb */
+    LGW_PERF_REG_WB,    /*!> lgw_reg_wb */
+    LGW_PERF_SPI,       /*!> one SPI message (spidev ioctl) */
+    LGW_PERF_PROBE_NB
+};
+
+/**
+@enum lgw_perf_counter_e
+@brief Event counters
+*/
+enum lgw_perf_counter_e {
+    LGW_PERF_SPI_BYTES,     /*!> bytes moved on the SPI bus, both directions counted once */
+    LGW_PERF_PAGE_SWITCH,   /*!> register page selections sent to the SX1301 */
+    LGW_PERF_RX_PKT,        /*!> packets returned by lgw_receive */
+    LGW_PERF_TX_PKT,        /*!> packets accepted by lgw_send */
+    LGW_PERF_COUNTER_NB
+};
+
+/**
+@struct lgw_perf_probe_s
+@brief Calls and latency of a measured function
+*/
+struct lgw_perf_probe_s {
+    uint64_t    nb_call;                    /*!> number of calls */
+    uint64_t    total_ns;                   /*!> cumulated latency */
+    uint64_t    max_ns;                     /*!> longest call */
+    uint32_t    hist[LGW_PERF_HIST_NB];     /*!> latency histogram, see lgw_perf_bucket_ns */
+};
+
+/**
+@struct lgw_perf_thread_s
+@brief Counters of one thread
+*/
+struct lgw_perf_thread_s {
+    char                    name[LGW_PERF_NAME_SIZE];   /*!> thread name when it first recorded something */
+    int32_t                 tid;                        /*!> kernel thread id, 0 once the thread exited */
+    struct lgw_perf_probe_s probe[LGW_PERF_PROBE_NB];
+    uint64_t                counter[LGW_PERF_COUNTER_NB];
+};
+
+/**
+@struct lgw_perf_snapshot_s
+@brief Copy of all the counters at a given time
+
+The counters only increase: the activity during an interval is the difference
+of two snapshots (see lgw_perf_diff). A thread slot is reused, counters
+included, by a new thread once its thread has exited.
+*/
+struct lgw_perf_snapshot_s {
+    uint64_t                time_ns;    /*!> CLOCK_MONOTONIC time of the snapshot */
+    uint32_t                nb_thread;  /*!> number of thread slots used */
+    uint32_t                nb_lost;    /*!> measures dropped because all the slots were taken */
+    struct lgw_perf_probe_s probe[LGW_PERF_PROBE_NB];       /*!> all threads */
+    uint64_t                counter[LGW_PERF_COUNTER_NB];   /*!> all threads */
+    struct lgw_perf_thread_s thread[LGW_PERF_THREAD_MAX];   /*!> per thread */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- INTERNAL SHARED FUNCTIONS -------------------------------------------- */
+
+/* time stamp taken when entering a probed function, 0 if measures are disabled */
+uint64_t lgw_perf_start(void);
+
+/* record a call of a probed function that started at t0 (from lgw_perf_start) */
+void lgw_perf_stop(enum lgw_perf_probe_e probe, uint64_t t0);
+
+/* add n to an event counter */
+void lgw_perf_add(enum lgw_perf_counter_e counter, uint64_t n);
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Enable or disable the measures
+@param enable true to record (default), false to make the probes return right away
+@return LGW_PERF_SUCCESS
+*/
+int lgw_perf_enable(bool enable);
+
+/**
+@brief Copy the counters of all the threads
+@param snap pointer to the structure that will receive the counters
+@return LGW_PERF_ERROR id the operation failed, LGW_PERF_SUCCESS else
+
+The threads keep recording while the snapshot is taken; the counters of each
+thread are copied consistently.
+*/
+int lgw_perf_snapshot(struct lgw_perf_snapshot_s *snap);
+
+/**
+@brief Compute the activity between two snapshots
+@param older pointer to the first snapshot
+@param newer pointer to the second snapshot
+@param diff pointer to the structure that will receive newer - older (can be newer)
+@return LGW_PERF_ERROR id the operation failed, LGW_PERF_SUCCESS else
+
+The maximum latencies cannot be subtracted, the ones of newer are kept.
+*/
+int lgw_perf_diff(const struct lgw_perf_snapshot_s *older, const struct lgw_perf_snapshot_s *newer, struct lgw_perf_snapshot_s *diff);
+
+/**
+@brief Lower bound of a latency histogram bucket
+@param bucket index of the bucket [0, LGW_PERF_HIST_NB]
+@return latency in ns; bucket i holds [lgw_perf_bucket_ns(i), lgw_perf_bucket_ns(i + 1)[
+*/
+uint64_t lgw_perf_bucket_ns(int bucket);
+
+/**
+@brief Estimate a latency percentile from a histogram
+@param probe pointer to the probe counters
+@param percent percentile to estimate [0, 100]
+@return latency in ns, interpolated inside the bucket; 0 if the probe was never called
+*/
+uint64_t lgw_perf_percentile(const struct lgw_perf_probe_s *probe, double percent);
+
+/**
+@brief Write a snapshot of the counters to a file
+@param path path of the file, replaced atomically
+@return LGW_PERF_ERROR id the operation failed, LGW_PERF_SUCCESS else
+*/
+int lgw_perf_export(const char *path);
+
+/**
+@brief Read a snapshot written by lgw_perf_export
+@param path path of the file
+@param snap pointer to the structure that will receive the counters
+@return LGW_PERF_ERROR if the file cannot be read or was written by another version of the library, LGW_PERF_SUCCESS else
+*/
+int lgw_perf_import(const char *path, struct lgw_perf_snapshot_s *snap);
+
+/**
+@brief Start a thread exporting the counters periodically
+@param path path of the file (see lgw_perf_export)
+@param period_ms export period in milliseconds
+@return LGW_PERF_ERROR id the operation failed, LGW_PERF_SUCCESS else
+
+This lets util_perf follow a running application without any other change.
+*/
+int lgw_perf_export_start(const char *path, uint32_t period_ms);
+
+/**
+@brief Stop the export thread
+@return LGW_PERF_ERROR if it was not running, LGW_PERF_SUCCESS else
+*/
+int lgw_perf_export_stop(void);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
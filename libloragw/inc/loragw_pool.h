@@ -0,0 +1,107 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Pool of preallocated packet payload buffers.
+    lgw_receive_pool reads the payload of received packets directly into the
+    pool slots (no intermediate copy), the application gives the slots back
+    with lgw_pool_release once it is done with the packets.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _LORAGW_POOL_H
+#define _LORAGW_POOL_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "config.h"     /* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_POOL_SUCCESS    0
+#define LGW_POOL_ERROR      -1
+
+#define LGW_POOL_ALIGN      64      /* slots are aligned on, and sized in multiples of, a cache line */
+#define LGW_POOL_SLOT_NONE  0xFFFF  /* invalid slot number */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_pkt_pool_s
+@brief Pool of packet payload buffers, to be handled with the lgw_pool_* functions only
+
+The pool is not thread-safe: if slots are released by another thread than the
+one receiving packets, calls must be serialized by the application.
+*/
+struct lgw_pkt_pool_s {
+    uint8_t     *mem;           /*!> slots memory, LGW_POOL_ALIGN aligned */
+    uint16_t    *free_slot;     /*!> stack of the free slot numbers */
+    uint8_t     *in_use;        /*!> 1 for the slots given by lgw_pool_get and not released yet */
+    uint16_t    nb_slot;        /*!> number of slots */
+    uint16_t    nb_free;        /*!> number of free slots */
+    uint16_t    slot_size;      /*!> size of a slot in bytes, multiple of LGW_POOL_ALIGN */
+    uint16_t    max_size;       /*!> largest payload a slot can hold */
+    uint32_t    nb_drop;        /*!> packets dropped because their payload was larger than max_size or their metadata invalid */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Allocate the slots of a packet pool
+@param pool pointer to the pool to initialize
+@param nb_slot number of slots (maximum number of packets held by the application at the same time)
+@param max_size largest payload a slot must hold, in bytes [1..256]
+@return LGW_POOL_ERROR id the operation failed, LGW_POOL_SUCCESS else
+
+Packets received with a payload larger than max_size are dropped and counted.
+*/
+int lgw_pool_init(struct lgw_pkt_pool_s *pool, uint16_t nb_slot, uint16_t max_size);
+
+/**
+@brief Release the memory of a packet pool
+@param pool pointer to the pool
+@return LGW_POOL_ERROR id the operation failed, LGW_POOL_SUCCESS else
+*/
+int lgw_pool_free(struct lgw_pkt_pool_s *pool);
+
+/**
+@brief Take a free slot from the pool
+@param pool pointer to the pool
+@return the slot number, LGW_POOL_SLOT_NONE if the pool is empty
+*/
+uint16_t lgw_pool_get(struct lgw_pkt_pool_s *pool);
+
+/**
+@brief Give a slot back to the pool, once the packet it holds is not needed anymore
+@param pool pointer to the pool
+@param slot slot number
+@return LGW_POOL_ERROR id the slot is not valid or already free, LGW_POOL_SUCCESS else
+*/
+int lgw_pool_release(struct lgw_pkt_pool_s *pool, uint16_t slot);
+
+/**
+@brief Get the buffer of a slot
+@param pool pointer to the pool
+@param slot slot number
+@return pointer to the buffer of the slot, NULL if the slot is not valid
+*/
+uint8_t *lgw_pool_buffer(struct lgw_pkt_pool_s *pool, uint16_t slot);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
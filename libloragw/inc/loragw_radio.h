@@ -68,6 +68,8 @@ int lgw_sx127x_reg_w(uint8_t address, uint8_t reg_value);
 
 int lgw_sx127x_reg_r(uint8_t address, uint8_t *reg_value);
 
+uint8_t sx125x_read(uint8_t channel, uint8_t addr);
+
 
 #endif
 /* --- EOF ------------------------------------------------------------------ */
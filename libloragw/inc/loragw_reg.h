@@ -38,6 +38,7 @@ struct lgw_reg_s {
     bool    sign;        /*!< 1 indicates the register is signed (2 complem.) */
     uint8_t leng;        /*!< number of bits in the register */
     bool    rdon;        /*!< 1 indicates a read-only register */
+    bool    vola;        /*!< 1 indicates a volatile register (can be modified by the hardware or the MCUs) */
     int32_t dflt;        /*!< register default value */
 };
 
@@ -53,6 +54,35 @@ int reg_r_align32(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target
 #define LGW_REG_SUCCESS  0
 #define LGW_REG_ERROR    -1
 
+#define LGW_REG_CACHE_OFF       0   /* every register access goes to the concentrator */
+#define LGW_REG_CACHE_ON        1   /* non-volatile registers are read from a shadow copy */
+#define LGW_REG_CACHE_VERIFY    2   /* shadow copy maintained, but checked against the concentrator on every read */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_reg_page_stats_s
+@brief Register page selection counters
+*/
+struct lgw_reg_page_stats_s {
+    uint32_t    nb_access;      /*!> number of accesses to registers that belong to a page */
+    uint32_t    nb_switch;      /*!> number of PAGE_REG writes, explicit ones included */
+    uint32_t    nb_skipped;     /*!> number of accesses for which the page was already selected */
+    uint32_t    nb_invalidate;  /*!> number of times the selected page was forgotten (MCU handover) */
+};
+
+/**
+@struct lgw_reg_lock_stats_s
+@brief Register lock counters, to measure the contention between threads
+*/
+struct lgw_reg_lock_stats_s {
+    uint32_t    nb_lock;        /*!> number of register transactions (outermost lock acquisitions) */
+    uint32_t    nb_contended;   /*!> number of transactions that had to wait for another thread */
+    uint64_t    wait_ns;        /*!> total time spent waiting for the lock, in nanoseconds */
+    uint32_t    wait_max_ns;    /*!> longest wait for the lock, in nanoseconds */
+};
+
 /*
 auto generated register mapping for C code : 11-Jul-2013 13:20:40
 this file contains autogenerated C struct used to access the LORA registers
@@ -455,6 +485,126 @@ int lgw_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size);
 */
 int lgw_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size);
 
+/**
+@brief Forget which register page is selected
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+
+The next access to a paged register will write PAGE_REG. This is done
+automatically when EMERGENCY_FORCE_HOST_CTRL is written, because the MCUs can
+select any page while they control the register file. Apart from that, the
+page is only written when it changes.
+*/
+int lgw_reg_page_invalidate(void);
+
+/**
+@brief Get the register page selection counters
+@param stats pointer to the structure that will receive the counters
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_page_stats(struct lgw_reg_page_stats_s *stats);
+
+/**
+@brief Reset the register page selection counters
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_page_stats_reset(void);
+
+/**
+@brief Configure the shadow copy of the concentrator register file
+@param mode LGW_REG_CACHE_OFF, LGW_REG_CACHE_ON or LGW_REG_CACHE_VERIFY
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+
+Only the bytes that contain no read-only nor volatile register are cached, so
+a read-modify-write of a sub-byte register costs a single SPI write once the
+byte is known. The cache is emptied on soft-reset and when the register file
+is handed over to or taken back from the MCUs (EMERGENCY_FORCE_HOST_CTRL).
+In verify mode, every cached read is also done on the concentrator, the
+hardware value is returned and the mismatches are counted.
+*/
+int lgw_reg_cache_setconf(uint8_t mode);
+
+/**
+@brief Forget all the register values held in the shadow copy
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_cache_invalidate(void);
+
+/**
+@brief Get the shadow copy statistics since the last lgw_reg_cache_setconf
+@param hit pointer to receive the number of reads found in the cache
+@param miss pointer to receive the number of cacheable reads not in the cache
+@param mismatch pointer to receive the number of cached values found different from the hardware (verify mode)
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_cache_stats(uint32_t *hit, uint32_t *miss, uint32_t *mismatch);
+
+/**
+@brief Start queuing register accesses instead of sending them one by one
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+
+Until the matching lgw_reg_batch_end, register writes (including page switches
+and soft-reset) are queued and sent together in a single SPI message.
+Register reads still return immediately: the accesses queued so far are sent
+before the read. A read-modify-write of a byte already written in the batch
+reuses the queued value instead of reading it back.
+Batches can be nested, only the outermost lgw_reg_batch_end sends the queue.
+*/
+int lgw_reg_batch_begin(void);
+
+/**
+@brief Queue a register burst read in the current batch
+@param register_id register number in the data structure describing registers
+@param data pointer to byte array that will be written when the batch is sent
+@param size size of the transfer, in byte(s)
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+
+The data is only available after the outermost lgw_reg_batch_end. The value
+read is not stored in the register cache. Without an open batch, this is the
+same as lgw_reg_rb.
+*/
+int lgw_reg_batch_rb(uint16_t register_id, uint8_t *data, uint16_t size);
+
+/**
+@brief Send the register accesses queued since lgw_reg_batch_begin
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+
+SPI errors on the queued writes are only reported here.
+*/
+int lgw_reg_batch_end(void);
+
+/**
+@brief Lock the register file of the concentrator for a sequence of accesses
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+
+Every register access takes that lock for the duration of its SPI transaction,
+page selection included, and a batch holds it from lgw_reg_batch_begin to
+lgw_reg_batch_end. Several threads can therefore access the same concentrator
+without application locking; their transactions are interleaved. A thread
+that needs several accesses to be atomic (eg. an indirect register access
+through an address and a data register) takes the lock around them.
+The lock is recursive and belongs to the concentrator context.
+*/
+int lgw_reg_lock(void);
+
+/**
+@brief Release the register lock taken by lgw_reg_lock
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_unlock(void);
+
+/**
+@brief Get the register lock counters
+@param stats pointer to the structure that will receive the counters
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_lock_stats(struct lgw_reg_lock_stats_s *stats);
+
+/**
+@brief Reset the register lock counters
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_lock_stats_reset(void);
+
 
 #endif
 
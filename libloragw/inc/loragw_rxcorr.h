@@ -0,0 +1,67 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Correction tables applied to received packets (timestamp processing delay
+    and FSK RSSI linearization), computed once when the concentrator starts so
+    that lgw_receive only does lookups.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+#ifndef _LORAGW_RXCORR_H
+#define _LORAGW_RXCORR_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_RXCORR_SUCCESS  0
+#define LGW_RXCORR_ERROR    -1
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Compute the correction tables for the current RX configuration
+@param lora_rx_bw bandwidth of the LoRa 'stand alone' modem
+@param fsk_rx_dr datarate of the FSK modem, 0 if not used
+@param rssi_offset RSSI offset of each RF chain
+@return LGW_RXCORR_ERROR id the operation failed, LGW_RXCORR_SUCCESS else
+*/
+int rxcorr_setup(uint8_t lora_rx_bw, uint32_t fsk_rx_dr, const float *rssi_offset);
+
+/**
+@brief Get the timestamp correction of a received packet
+@param ifmod type of modem the packet was received by (IF_LORA_MULTI, IF_LORA_STD, IF_FSK_STD)
+@param sf spreading factor field of the packet metadata
+@param cr coding rate field of the packet metadata
+@param crc_en true if the packet has a CRC
+@param size payload size
+@return processing delay to subtract from the raw timestamp, in microseconds
+*/
+uint32_t rxcorr_timestamp(int ifmod, uint8_t sf, uint8_t cr, bool crc_en, uint8_t size);
+
+/**
+@brief Get the linearized RSSI of a packet received by the FSK modem
+@param rf_chain RF chain the packet was received on
+@param rssi_raw RSSI field of the packet metadata
+@return RSSI in dBm
+*/
+float rxcorr_rssi_fsk(uint8_t rf_chain, uint8_t rssi_raw);
+
+#endif
+/* --- EOF ------------------------------------------------------------------ */
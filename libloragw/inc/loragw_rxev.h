@@ -0,0 +1,104 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    RX event notification.
+    Provides a file descriptor (eventfd) that becomes readable when packets are
+    waiting in the concentrator RX FIFO, so applications can sleep in poll() or
+    epoll() instead of calling lgw_receive at a fixed interval.
+    The event is driven by a host GPIO edge when the concentrator RX interrupt
+    is wired, or by polling the RX FIFO status register otherwise.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _LORAGW_RXEV_H
+#define _LORAGW_RXEV_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "config.h"     /* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_RXEV_SUCCESS    0
+#define LGW_RXEV_ERROR      -1
+
+#define LGW_RXEV_GPIO_NONE      -1      /* no GPIO wired, poll the RX FIFO status register */
+#define LGW_RXEV_POLL_DEFAULT   1000    /* default RX FIFO status polling period, in microseconds */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_conf_rxev_s
+@brief Configuration structure for the RX event notification
+*/
+struct lgw_conf_rxev_s {
+    int         gpio;       /*!> host GPIO (sysfs number) wired to the concentrator RX interrupt, LGW_RXEV_GPIO_NONE if not wired */
+    const char  *gpio_path; /*!> GPIO value file to watch instead of /sys/class/gpio/gpio<N>/value (eg. a named pipe to simulate the line), NULL for sysfs */
+    uint32_t    poll_us;    /*!> RX FIFO status polling period when no GPIO is used, in microseconds */
+};
+
+/**
+@struct lgw_rxev_stats_s
+@brief Counters maintained by the RX event notification
+*/
+struct lgw_rxev_stats_s {
+    uint32_t    nb_edge;    /*!> number of GPIO edges detected */
+    uint32_t    nb_poll;    /*!> number of RX FIFO status register reads */
+    uint32_t    nb_notify;  /*!> number of times the event file descriptor was signaled */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Start watching the concentrator for received packets
+@param conf pointer to the configuration, NULL to poll the RX FIFO status with the default period
+@return LGW_RXEV_ERROR if the operation failed, else a file descriptor to poll (POLLIN)
+
+The GPIO must already be exported and configured as an input. When a sysfs GPIO
+is used, its edge detection is set to "rising".
+The file descriptor is owned by the library and closed by lgw_rxev_stop.
+*/
+int lgw_rxev_start(struct lgw_conf_rxev_s *conf);
+
+/**
+@brief Stop watching the concentrator and close the event file descriptor
+@return LGW_RXEV_ERROR if the notification was not started, LGW_RXEV_SUCCESS else
+*/
+int lgw_rxev_stop(void);
+
+/**
+@brief Acknowledge the RX event, before fetching packets with lgw_receive
+@return LGW_RXEV_ERROR if the operation failed, LGW_RXEV_SUCCESS else
+
+The event is only signaled again by a new GPIO edge (or by the next poll of the
+FIFO status), so the application must call lgw_receive until it returns less
+packets than requested.
+*/
+int lgw_rxev_ack(void);
+
+/**
+@brief Get the counters of the RX event notification
+@param stats pointer to the structure that will receive the counters
+@return LGW_RXEV_ERROR id the operation failed, LGW_RXEV_SUCCESS else
+*/
+int lgw_rxev_stats(struct lgw_rxev_stats_s *stats);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
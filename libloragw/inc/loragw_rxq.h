@@ -0,0 +1,119 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Background RX acquisition thread.
+    The thread drains the concentrator RX FIFO with lgw_receive and pushes the
+    packets into a lock-free single-producer/multi-consumer ring. Any number of
+    application threads can then fetch packets from the ring, without polling
+    the concentrator themselves.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _LORAGW_RXQ_H
+#define _LORAGW_RXQ_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "config.h"     /* library configuration options (dynamically generated) */
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_RXQ_SUCCESS     0
+#define LGW_RXQ_ERROR       -1
+
+#define LGW_RXQ_SIZE_DEFAULT    256     /* default ring capacity, in packets */
+#define LGW_RXQ_POLL_DEFAULT    2000    /* default pause between two polls of an empty FIFO, in microseconds */
+#define LGW_RXQ_CPU_ANY         -1      /* do not pin the acquisition thread to a CPU */
+#define LGW_RXQ_WAIT_FOREVER    -1      /* lgw_rxq_wait timeout value to wait without time limit */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_conf_rxq_s
+@brief Configuration structure for the RX acquisition thread
+*/
+struct lgw_conf_rxq_s {
+    uint32_t    size;       /*!> ring capacity in packets, rounded up to a power of 2 */
+    uint32_t    poll_us;    /*!> pause between two polls when the FIFO was found empty, in microseconds */
+    int         cpu;        /*!> CPU the acquisition thread is pinned to, LGW_RXQ_CPU_ANY for none */
+};
+
+/**
+@struct lgw_rxq_stats_s
+@brief Counters maintained by the RX acquisition thread
+*/
+struct lgw_rxq_stats_s {
+    uint32_t    nb_poll;        /*!> number of lgw_receive calls */
+    uint32_t    nb_pkt;         /*!> number of packets fetched from the concentrator */
+    uint32_t    nb_overflow;    /*!> number of packets dropped because the ring was full */
+    uint32_t    nb_error;       /*!> number of lgw_receive calls that failed */
+    uint32_t    max_fill;       /*!> highest number of packets waiting in the ring */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Start the RX acquisition thread
+@param conf pointer to the thread configuration, NULL to use the default values
+@return LGW_RXQ_ERROR if the thread could not be started, LGW_RXQ_SUCCESS else
+
+The concentrator must already be started. Once the thread runs, the application
+must fetch packets with lgw_rxq_receive or lgw_rxq_wait instead of lgw_receive.
+*/
+int lgw_rxq_start(struct lgw_conf_rxq_s *conf);
+
+/**
+@brief Stop the RX acquisition thread and release the ring
+@return LGW_RXQ_ERROR if the thread was not running, LGW_RXQ_SUCCESS else
+
+Packets still waiting in the ring are lost and consumers blocked in lgw_rxq_wait
+are released. Consumers that are fetching packets when the function is called
+are waited for before the ring is freed; later calls to lgw_rxq_receive fail.
+Must be called before lgw_stop.
+*/
+int lgw_rxq_stop(void);
+
+/**
+@brief Fetch packets from the ring, without waiting
+@param max_pkt maximum number of packets to fetch
+@param pkt_data pointer to an array of struct that will receive the packets
+@return LGW_RXQ_ERROR id the operation failed, else the number of packets fetched
+*/
+int lgw_rxq_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data);
+
+/**
+@brief Fetch packets from the ring, waiting for at least one if the ring is empty
+@param max_pkt maximum number of packets to fetch
+@param pkt_data pointer to an array of struct that will receive the packets
+@param timeout_ms maximum waiting time in milliseconds, LGW_RXQ_WAIT_FOREVER for no limit
+@return LGW_RXQ_ERROR id the operation failed, else the number of packets fetched (0 on timeout or thread stop)
+*/
+int lgw_rxq_wait(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data, int32_t timeout_ms);
+
+/**
+@brief Get the counters of the RX acquisition thread
+@param stats pointer to the structure that will receive the counters
+@return LGW_RXQ_ERROR id the operation failed, LGW_RXQ_SUCCESS else
+*/
+int lgw_rxq_stats(struct lgw_rxq_stats_s *stats);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,111 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Control of the software SX1301 simulator (SPI backend selected with
+    CFG_SPI=sim in library.cfg).
+    Only available when the library is built with the simulator.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _LORAGW_SIM_H
+#define _LORAGW_SIM_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "config.h"     /* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_SIM_SUCCESS     0
+#define LGW_SIM_ERROR       -1
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_sim_conf_s
+@brief Configuration of the simulator
+
+When lgw_sim_setconf is not called, the configuration is read from the
+environment when the SPI link is opened for the first time:
+LGW_SIM_FPGA, LGW_SIM_RX_RATE, LGW_SIM_RX_SIZE, LGW_SIM_SPI_MSG_NS and
+LGW_SIM_SPI_BYTE_NS (all 0 by default, except LGW_SIM_RX_SIZE = 16).
+Each SPI device path opened gets its own simulated chip (4 at most), the
+configuration and the counters are common to all of them.
+*/
+struct lgw_sim_conf_s {
+    bool        fpga;       /*!> simulate an FPGA with SPI mux header (SX1301AP2 ref design) */
+    float       rx_rate;    /*!> uplinks injected per second once the concentrator is started, 0 to disable */
+    uint8_t     rx_size;    /*!> payload size of the injected uplinks, in bytes (4 min) */
+    uint32_t    msg_ns;     /*!> simulated duration of a SPI message (system call, chip select), in nanoseconds */
+    uint32_t    byte_ns;    /*!> simulated duration of a byte on the bus, in nanoseconds (1000 at 8 MHz) */
+};
+
+/**
+@struct lgw_sim_stats_s
+@brief Counters maintained by the simulator
+*/
+struct lgw_sim_stats_s {
+    uint32_t    nb_msg;         /*!> number of SPI messages */
+    uint32_t    nb_frame;       /*!> number of chip select frames (accesses) */
+    uint32_t    nb_byte;        /*!> number of bytes on the bus, commands included */
+    uint32_t    nb_page_switch; /*!> number of writes to the page register changing the page */
+    uint32_t    nb_rx_gen;      /*!> number of uplinks injected */
+    uint32_t    nb_rx_fetch;    /*!> number of uplinks removed from the RX FIFO by the host */
+    uint32_t    nb_rx_overflow; /*!> number of uplinks lost because the RX FIFO or data buffer was full */
+    uint32_t    nb_tx;          /*!> number of TX triggers */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Configure the simulator
+@param conf pointer to the configuration
+@return LGW_SIM_ERROR if the configuration is invalid, LGW_SIM_SUCCESS else
+
+Can be called at any time. The FPGA option is taken into account at the next
+connection to the concentrator.
+*/
+int lgw_sim_setconf(struct lgw_sim_conf_s *conf);
+
+/**
+@brief Inject one uplink in the RX FIFO of the chip simulated on the default SPI device
+@param if_chain IF chain the packet is received on [0..9]
+@param sf LoRa spreading factor [7..12]
+@param size payload size, in bytes
+@param payload pointer to the payload
+@return LGW_SIM_ERROR if the concentrator is not started or the FIFO is full, LGW_SIM_SUCCESS else
+*/
+int lgw_sim_inject(uint8_t if_chain, uint8_t sf, uint8_t size, const uint8_t *payload);
+
+/**
+@brief Get the counters of the simulator
+@param stats pointer to the structure that will receive the counters
+@return LGW_SIM_ERROR id the operation failed, LGW_SIM_SUCCESS else
+*/
+int lgw_sim_stats(struct lgw_sim_stats_s *stats);
+
+/**
+@brief Reset the counters of the simulator
+@return LGW_SIM_SUCCESS
+*/
+int lgw_sim_stats_reset(void);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -43,9 +43,50 @@ Maintainer: Sylvain Miermont
 #define LGW_SPI_MUX_TARGET_EEPROM   0x2
 #define LGW_SPI_MUX_TARGET_SX127X   0x3
 
+#define LGW_SPI_DELAY_NONE      0   /* back-to-back transactions */
+#define LGW_SPI_DELAY_BUSYWAIT  1   /* spin on the monotonic clock until the minimum gap has elapsed */
+#define LGW_SPI_DELAY_SLEEP     2   /* usleep() after each transaction (scheduler latency applies) */
+
+#define LGW_SPI_BATCH_MAX       128     /* max number of accesses queued in a batch */
+#define LGW_SPI_BATCH_SIZE      4096    /* max number of bytes queued in a batch, commands included (default spidev buffer size) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_spi_batch_s
+@brief List of SPI accesses sent to the concentrator in a single SPI message
+*/
+struct lgw_spi_batch_s {
+    void        *spi_target;                    /*!> generic pointer to SPI target the batch is sent to */
+    uint16_t    nb_op;                          /*!> number of accesses queued */
+    uint16_t    nb_byte;                        /*!> number of bytes queued, commands included */
+    uint16_t    op_len[LGW_SPI_BATCH_MAX];      /*!> length of each access, command included */
+    uint8_t     op_cmd[LGW_SPI_BATCH_MAX];      /*!> command length of each access */
+    uint8_t     *op_dest[LGW_SPI_BATCH_MAX];    /*!> where read data is copied after the flush (NULL for writes) */
+    uint8_t     tx_buf[LGW_SPI_BATCH_SIZE];     /*!> commands and data to be sent */
+    uint8_t     rx_buf[LGW_SPI_BATCH_SIZE];     /*!> data received during the flush */
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
+/**
+@brief Select the delay policy applied between two SPI transactions
+@param mode LGW_SPI_DELAY_NONE, LGW_SPI_DELAY_BUSYWAIT or LGW_SPI_DELAY_SLEEP
+@param delay_ns minimum gap between two transactions, in nanoseconds
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_set_delay(uint8_t mode, uint32_t delay_ns);
+
+/**
+@brief Get the delay policy applied between two SPI transactions
+@param mode pointer to receive the current delay mode
+@param delay_ns pointer to receive the current minimum gap, in nanoseconds
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_get_delay(uint8_t *mode, uint32_t *delay_ns);
+
 /**
 @brief LoRa concentrator SPI setup (configure I/O and peripherals)
 @param spi_target_ptr pointer on a generic pointer to SPI target (implementation dependant)
@@ -54,6 +95,14 @@ Maintainer: Sylvain Miermont
 
 int lgw_spi_open(void **spi_target_ptr);
 
+/**
+@brief LoRa concentrator SPI setup on a given SPI device
+@param spi_path path of the SPI device (eg. "/dev/spidev1.0"), NULL for the default one
+@param spi_target_ptr pointer on a generic pointer to SPI target (implementation dependant)
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_open_path(const char *spi_path, void **spi_target_ptr);
+
 /**
 @brief LoRa concentrator SPI close
 @param spi_target generic pointer to SPI target (implementation dependant)
@@ -100,6 +149,68 @@ int lgw_spi_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, u
 */
 int lgw_spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size);
 
+/**
+@brief Initialize an empty SPI batch
+@param batch pointer to the batch structure
+@param spi_target generic pointer to SPI target the batch will be sent to
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_batch_init(struct lgw_spi_batch_s *batch, void *spi_target);
+
+/**
+@brief Queue a single-byte write in a SPI batch
+@param batch pointer to the batch structure
+@param address 7-bit register address
+@param data data byte to write
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+
+If the batch is full, it is flushed before the new access is queued.
+*/
+int lgw_spi_batch_w(struct lgw_spi_batch_s *batch, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t data);
+
+/**
+@brief Queue a single-byte read in a SPI batch
+@param batch pointer to the batch structure
+@param address 7-bit register address
+@param data pointer to the byte that will be written when the batch is flushed
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_batch_r(struct lgw_spi_batch_s *batch, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data);
+
+/**
+@brief Queue a burst (multiple-byte) write in a SPI batch
+@param batch pointer to the batch structure
+@param address 7-bit register address
+@param data pointer to byte array that will be sent (copied, can be reused on return)
+@param size size of the transfer, in byte(s)
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+
+Bursts too large to fit in a batch are sent immediately, after the accesses
+already queued.
+*/
+int lgw_spi_batch_wb(struct lgw_spi_batch_s *batch, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size);
+
+/**
+@brief Queue a burst (multiple-byte) read in a SPI batch
+@param batch pointer to the batch structure
+@param address 7-bit register address
+@param data pointer to byte array that will be written when the batch is flushed
+@param size size of the transfer, in byte(s)
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_batch_rb(struct lgw_spi_batch_s *batch, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size);
+
+/**
+@brief Send all the accesses queued in a SPI batch in a single SPI message
+@param batch pointer to the batch structure
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+
+Chip select is released between two accesses, so each access is seen by the
+concentrator exactly as if it was sent alone. Read data is copied to the
+destination buffers and the batch is emptied, even in case of error.
+*/
+int lgw_spi_batch_flush(struct lgw_spi_batch_s *batch);
+
 #endif
 
 /* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,142 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    TX scheduler queue.
+    Timestamped packets are queued in trigger time order and a background
+    thread programs each of them in the SX1301 TX buffer with lgw_send as soon
+    as the previous one is sent. Packets overlapping a queued one (time on air)
+    are rejected, and the outcome of each packet is reported to a callback.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _LORAGW_TXQ_H
+#define _LORAGW_TXQ_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "config.h"     /* library configuration options (dynamically generated) */
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_TXQ_SUCCESS     0
+#define LGW_TXQ_ERROR       -1
+#define LGW_TXQ_COLLISION   -2      /* lgw_txq_enqueue: packet overlaps a packet already queued */
+
+#define LGW_TXQ_SIZE_DEFAULT    32      /* default queue capacity, in packets */
+#define LGW_TXQ_POLL_DEFAULT    1000    /* default pause between two polls of the TX status, in microseconds */
+#define LGW_TXQ_LEAD_DEFAULT    50000   /* default programming window before the trigger time, in microseconds */
+#define LGW_TXQ_MARGIN_DEFAULT  3000    /* default minimum time to program a packet before its trigger time, in microseconds */
+#define LGW_TXQ_GUARD_DEFAULT   3000    /* default minimum gap between two packets, in microseconds */
+
+/* packet outcome, for struct lgw_txq_result_s */
+#define LGW_TXQ_STATUS_SENT     0   /* packet emitted */
+#define LGW_TXQ_STATUS_LATE     1   /* trigger time too close or already passed when the packet could be programmed */
+#define LGW_TXQ_STATUS_FAILED   2   /* lgw_send failed (invalid parameters or channel busy for LBT) */
+#define LGW_TXQ_STATUS_FLUSHED  3   /* packet removed by lgw_txq_stop before being sent */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_txq_result_s
+@brief Outcome of a queued packet
+*/
+struct lgw_txq_result_s {
+    uint32_t    id;         /*!> identifier given to lgw_txq_enqueue */
+    uint32_t    count_us;   /*!> trigger time of the packet */
+    uint8_t     status;     /*!> LGW_TXQ_STATUS_* */
+};
+
+/**
+@struct lgw_conf_txq_s
+@brief Configuration structure for the TX scheduler queue
+*/
+struct lgw_conf_txq_s {
+    uint32_t    size;       /*!> queue capacity in packets */
+    uint32_t    poll_us;    /*!> pause between two polls of the TX status while packets are queued, in microseconds */
+    uint32_t    lead_us;    /*!> a packet is programmed when its trigger time is less than lead_us away */
+    uint32_t    margin_us;  /*!> a packet is reported late when its trigger time is less than margin_us away */
+    uint32_t    guard_us;   /*!> minimum gap between the end of a packet and the start of the next one */
+    void        (*done)(const struct lgw_txq_result_s *result, void *arg); /*!> outcome callback, called from the scheduler thread (NULL for none) */
+    void        *arg;       /*!> opaque pointer passed to the callback */
+};
+
+/**
+@struct lgw_txq_stats_s
+@brief Counters maintained by the TX scheduler
+*/
+struct lgw_txq_stats_s {
+    uint32_t    nb_queued;      /*!> number of packets accepted by lgw_txq_enqueue */
+    uint32_t    nb_collision;   /*!> number of packets rejected because they overlap a queued packet */
+    uint32_t    nb_sent;        /*!> number of packets emitted */
+    uint32_t    nb_late;        /*!> number of packets not programmed in time */
+    uint32_t    nb_failed;      /*!> number of packets lgw_send refused */
+    uint32_t    nb_preempt;     /*!> number of programmed packets put back in the queue for an earlier one */
+    uint32_t    max_fill;       /*!> highest number of packets waiting in the queue */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Start the TX scheduler thread
+@param conf pointer to the scheduler configuration, NULL to use the default values
+@return LGW_TXQ_ERROR if the thread could not be started, LGW_TXQ_SUCCESS else
+
+The concentrator must already be started. Once the scheduler runs, the
+application must send packets with lgw_txq_enqueue instead of lgw_send.
+*/
+int lgw_txq_start(struct lgw_conf_txq_s *conf);
+
+/**
+@brief Stop the TX scheduler thread and flush the queue
+@return LGW_TXQ_ERROR if the thread was not running, LGW_TXQ_SUCCESS else
+
+Queued packets are reported with the LGW_TXQ_STATUS_FLUSHED status, from the
+calling thread. A packet already programmed is aborted if its emission has not
+started yet. Must be called before lgw_stop.
+*/
+int lgw_txq_stop(void);
+
+/**
+@brief Queue a packet for emission at its trigger time
+@param pkt_data structure containing the data and metadata of the packet (TIMESTAMPED mode only)
+@param id identifier of the packet, reported in its outcome
+@return LGW_TXQ_COLLISION if the packet overlaps a queued packet, LGW_TXQ_ERROR id the packet cannot be queued, LGW_TXQ_SUCCESS else
+
+The emission interval of a packet starts at its count_us trigger time and lasts
+its time on air (lgw_time_on_air_us), plus the guard time.
+*/
+int lgw_txq_enqueue(struct lgw_pkt_tx_s *pkt_data, uint32_t id);
+
+/**
+@brief Get the number of packets waiting in the queue, the programmed one included
+@return number of packets
+*/
+int lgw_txq_pending(void);
+
+/**
+@brief Get the counters of the TX scheduler
+@param stats pointer to the structure that will receive the counters
+@return LGW_TXQ_ERROR id the operation failed, LGW_TXQ_SUCCESS else
+*/
+int lgw_txq_stats(struct lgw_txq_stats_s *stats);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
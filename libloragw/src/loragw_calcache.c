@@ -0,0 +1,197 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Calibration cache: stores the results of the radios calibration in a file
+    so that a warm restart with the same hardware and configuration can reload
+    them instead of running the calibration firmware again.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stddef.h>     /* offsetof */
+#include <stdio.h>      /* printf fprintf fopen fread fwrite rename */
+#include <string.h>     /* memset memcmp */
+#include <time.h>       /* time */
+
+#include "loragw_calcache.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#if DEBUG_HAL == 1
+    #define DEBUG_MSG(str)                fprintf(stderr, str)
+    #define DEBUG_PRINTF(fmt, args...)    fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+    #define CHECK_NULL(a)                if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_CALCACHE_ERROR;}
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+    #define CHECK_NULL(a)                if(a==NULL){return LGW_CALCACHE_ERROR;}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
+
+#define CALCACHE_MAGIC      0x4C43574C /* "LWCL" */
+#define CALCACHE_VERSION    1
+#define CALCACHE_PATH_MAX   256
+
+/* Cache file content. The file is a raw copy of this structure, it is only
+meant to be read back by the same build on the same gateway. */
+struct calcache_file_s {
+    uint32_t                magic;
+    uint16_t                version;
+    uint16_t                size;       /* size of the structure, detects a layout change */
+    int64_t                 time;       /* when the calibration was done (UTC, seconds) */
+    struct calcache_key_s   key;
+    struct calcache_data_s  data;
+    uint32_t                checksum;   /* of all the previous bytes */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* Fletcher-32 like checksum, enough to detect a truncated or damaged file */
+static uint32_t calcache_checksum(const struct calcache_file_s *f) {
+    const uint8_t *p = (const uint8_t *)f;
+    uint32_t a = 1, b = 0;
+    size_t i;
+
+    for (i = 0; i < offsetof(struct calcache_file_s, checksum); ++i) {
+        a = (a + p[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+/* The keys are compared field by field, padding bytes are not significant */
+static bool calcache_key_equal(const struct calcache_key_s *a, const struct calcache_key_s *b) {
+    int i;
+
+    for (i = 0; i < LGW_RF_CHAIN_NB; ++i) {
+        if (a->rf_freq[i] != b->rf_freq[i]) {
+            return false;
+        }
+    }
+    return (a->cal_cmd == b->cal_cmd) && (a->chip_version == b->chip_version) &&
+           (a->fpga_version == b->fpga_version) && (a->temp_band == b->temp_band);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int calcache_load(const char *path, const struct calcache_key_s *key, uint32_t max_age_s, struct calcache_data_s *data) {
+    struct calcache_file_s f;
+    FILE *fp;
+    size_t n;
+    int64_t now;
+
+    CHECK_NULL(path);
+    CHECK_NULL(key);
+    CHECK_NULL(data);
+
+    fp = fopen(path, "rb");
+    if (fp == NULL) {
+        DEBUG_PRINTF("Note: no calibration cache %s\n", path);
+        return LGW_CALCACHE_ERROR;
+    }
+    n = fread(&f, 1, sizeof f, fp);
+    fclose(fp);
+
+    if ((n != sizeof f) || (f.magic != CALCACHE_MAGIC) || (f.version != CALCACHE_VERSION) ||
+        (f.size != sizeof f) || (f.checksum != calcache_checksum(&f))) {
+        DEBUG_PRINTF("WARNING: invalid calibration cache %s\n", path);
+        return LGW_CALCACHE_ERROR;
+    }
+    if (calcache_key_equal(&f.key, key) == false) {
+        DEBUG_MSG("Note: calibration cache does not match the hardware or configuration\n");
+        return LGW_CALCACHE_ERROR;
+    }
+    now = (int64_t)time(NULL);
+    if ((max_age_s != 0) && ((now < f.time) || ((now - f.time) > (int64_t)max_age_s))) {
+        DEBUG_PRINTF("Note: calibration cache expired (age %lld s)\n", (long long)(now - f.time));
+        return LGW_CALCACHE_ERROR;
+    }
+
+    *data = f.data;
+    DEBUG_PRINTF("Note: calibration loaded from cache (age %lld s)\n", (long long)(now - f.time));
+    return LGW_CALCACHE_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int calcache_save(const char *path, const struct calcache_key_s *key, const struct calcache_data_s *data) {
+    struct calcache_file_s f;
+    char tmp_path[CALCACHE_PATH_MAX];
+    FILE *fp;
+    int x;
+
+    CHECK_NULL(path);
+    CHECK_NULL(key);
+    CHECK_NULL(data);
+
+    memset(&f, 0, sizeof f);
+    f.magic = CALCACHE_MAGIC;
+    f.version = CALCACHE_VERSION;
+    f.size = sizeof f;
+    f.time = (int64_t)time(NULL);
+    f.key = *key;
+    f.data = *data;
+    f.checksum = calcache_checksum(&f);
+
+    /* write a temporary file then rename it, so that a crash never leaves a
+    partial cache behind */
+    x = snprintf(tmp_path, sizeof tmp_path, "%s.tmp", path);
+    if ((x < 0) || ((size_t)x >= sizeof tmp_path)) {
+        DEBUG_MSG("ERROR: CALIBRATION CACHE PATH TOO LONG\n");
+        return LGW_CALCACHE_ERROR;
+    }
+    fp = fopen(tmp_path, "wb");
+    if (fp == NULL) {
+        DEBUG_PRINTF("ERROR: FAILED TO CREATE CALIBRATION CACHE %s\n", tmp_path);
+        return LGW_CALCACHE_ERROR;
+    }
+    x = (fwrite(&f, 1, sizeof f, fp) == sizeof f) ? 0 : -1;
+    x |= fclose(fp);
+    if ((x != 0) || (rename(tmp_path, path) != 0)) {
+        DEBUG_PRINTF("ERROR: FAILED TO WRITE CALIBRATION CACHE %s\n", path);
+        remove(tmp_path);
+        return LGW_CALCACHE_ERROR;
+    }
+
+    DEBUG_PRINTF("Note: calibration results stored in %s\n", path);
+    return LGW_CALCACHE_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int8_t calcache_temp_band(int8_t temperature) {
+    /* round towards minus infinity so that bands all have the same width */
+    if (temperature >= 0) {
+        return temperature / CALCACHE_TEMP_BAND;
+    } else {
+        return -((CALCACHE_TEMP_BAND - 1 - temperature) / CALCACHE_TEMP_BAND);
+    }
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,307 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Concentrator contexts, to drive several concentrators from one process.
+    The lgw_ctx_* functions bind the context to the calling thread for the
+    duration of the call and run the matching function of the HAL.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf */
+#include <stdlib.h>     /* calloc free */
+#include <string.h>     /* strlen strcpy */
+
+#include "loragw_ctx.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#if DEBUG_CTX == 1
+    #define DEBUG_MSG(str)                fprintf(stderr, str)
+    #define DEBUG_PRINTF(fmt, args...)    fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+    #define CHECK_NULL(a)                if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_CTX_ERROR;}
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+    #define CHECK_NULL(a)                if(a==NULL){return LGW_CTX_ERROR;}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+/* state of the default context, defined in the modules */
+extern struct lgw_reg_state_s lgw_reg_state_default;
+extern struct lgw_hal_state_s lgw_hal_state_default;
+extern struct lgw_fpga_state_s lgw_fpga_state_default;
+extern struct lgw_lbt_state_s lgw_lbt_state_default;
+extern struct lgw_rxcorr_state_s lgw_rxcorr_state_default;
+extern struct lgw_rxq_state_s lgw_rxq_state_default;
+extern struct lgw_rxev_state_s lgw_rxev_state_default;
+extern struct lgw_txq_state_s lgw_txq_state_default;
+
+static struct lgw_ctx_s lgw_ctx_default = {
+    .spi_path = "",
+    .spi_target = NULL,
+    .spi_mux_mode = 0,
+    .reg = &lgw_reg_state_default,
+    .hal = &lgw_hal_state_default,
+    .fpga = &lgw_fpga_state_default,
+    .lbt = &lgw_lbt_state_default,
+    .rxcorr = &lgw_rxcorr_state_default,
+    .rxq = &lgw_rxq_state_default,
+    .rxev = &lgw_rxev_state_default,
+    .txq = &lgw_txq_state_default
+};
+
+__thread struct lgw_ctx_s *lgw_ctx_cur = &lgw_ctx_default;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static void ctx_free(struct lgw_ctx_s *ctx);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* free functions accept the NULL pointers of a partially created context */
+static void ctx_free(struct lgw_ctx_s *ctx) {
+    lgw_reg_state_free(ctx->reg);
+    lgw_hal_state_free(ctx->hal);
+    lgw_fpga_state_free(ctx->fpga);
+    lgw_lbt_state_free(ctx->lbt);
+    lgw_rxcorr_state_free(ctx->rxcorr);
+    lgw_rxq_state_free(ctx->rxq);
+    lgw_rxev_state_free(ctx->rxev);
+    lgw_txq_state_free(ctx->txq);
+    free(ctx);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+struct lgw_ctx_s *lgw_ctx_create(const char *spi_path) {
+    struct lgw_ctx_s *ctx;
+
+    if ((spi_path != NULL) && (strlen(spi_path) >= LGW_CTX_PATH_MAX)) {
+        DEBUG_PRINTF("ERROR: SPI DEVICE PATH TOO LONG (%s)\n", spi_path);
+        return NULL;
+    }
+
+    ctx = calloc(1, sizeof *ctx);
+    if (ctx == NULL) {
+        DEBUG_MSG("ERROR: MALLOC FAIL\n");
+        return NULL;
+    }
+    if (spi_path != NULL) {
+        strcpy(ctx->spi_path, spi_path);
+    }
+    ctx->reg = lgw_reg_state_new();
+    ctx->hal = lgw_hal_state_new();
+    ctx->fpga = lgw_fpga_state_new();
+    ctx->lbt = lgw_lbt_state_new();
+    ctx->rxcorr = lgw_rxcorr_state_new();
+    ctx->rxq = lgw_rxq_state_new();
+    ctx->rxev = lgw_rxev_state_new();
+    ctx->txq = lgw_txq_state_new();
+    if ((ctx->reg == NULL) || (ctx->hal == NULL) || (ctx->fpga == NULL) || (ctx->lbt == NULL) || (ctx->rxcorr == NULL) || (ctx->rxq == NULL) || (ctx->rxev == NULL) || (ctx->txq == NULL)) {
+        DEBUG_MSG("ERROR: MALLOC FAIL\n");
+        ctx_free(ctx);
+        return NULL;
+    }
+
+    DEBUG_PRINTF("Note: context created for SPI device %s\n", (spi_path != NULL) ? spi_path : "(default)");
+    return ctx;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_destroy(struct lgw_ctx_s *ctx) {
+    CHECK_NULL(ctx);
+    if (ctx == &lgw_ctx_default) {
+        DEBUG_MSG("ERROR: THE DEFAULT CONTEXT CANNOT BE DESTROYED\n");
+        return LGW_CTX_ERROR;
+    }
+    if (ctx->spi_target != NULL) {
+        DEBUG_MSG("ERROR: CONCENTRATOR STILL CONNECTED, CANNOT DESTROY CONTEXT\n");
+        return LGW_CTX_ERROR;
+    }
+    if (lgw_ctx_cur == ctx) {
+        lgw_ctx_cur = &lgw_ctx_default;
+    }
+
+    ctx_free(ctx);
+    return LGW_CTX_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_bind(struct lgw_ctx_s *ctx) {
+    lgw_ctx_cur = (ctx != NULL) ? ctx : &lgw_ctx_default;
+    return LGW_CTX_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+struct lgw_ctx_s *lgw_ctx_get(void) {
+    return lgw_ctx_cur;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_board_setconf(struct lgw_ctx_s *ctx, struct lgw_conf_board_s conf) {
+    struct lgw_ctx_s *prev = lgw_ctx_cur;
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_cur = ctx;
+    x = lgw_board_setconf(conf);
+    lgw_ctx_cur = prev;
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_rxrf_setconf(struct lgw_ctx_s *ctx, uint8_t rf_chain, struct lgw_conf_rxrf_s conf) {
+    struct lgw_ctx_s *prev = lgw_ctx_cur;
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_cur = ctx;
+    x = lgw_rxrf_setconf(rf_chain, conf);
+    lgw_ctx_cur = prev;
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_rxif_setconf(struct lgw_ctx_s *ctx, uint8_t if_chain, struct lgw_conf_rxif_s conf) {
+    struct lgw_ctx_s *prev = lgw_ctx_cur;
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_cur = ctx;
+    x = lgw_rxif_setconf(if_chain, conf);
+    lgw_ctx_cur = prev;
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_txgain_setconf(struct lgw_ctx_s *ctx, struct lgw_tx_gain_lut_s *conf) {
+    struct lgw_ctx_s *prev = lgw_ctx_cur;
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_cur = ctx;
+    x = lgw_txgain_setconf(conf);
+    lgw_ctx_cur = prev;
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_start(struct lgw_ctx_s *ctx) {
+    struct lgw_ctx_s *prev = lgw_ctx_cur;
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_cur = ctx;
+    x = lgw_start();
+    lgw_ctx_cur = prev;
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_stop(struct lgw_ctx_s *ctx) {
+    struct lgw_ctx_s *prev = lgw_ctx_cur;
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_cur = ctx;
+    x = lgw_stop();
+    lgw_ctx_cur = prev;
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_receive(struct lgw_ctx_s *ctx, uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
+    struct lgw_ctx_s *prev = lgw_ctx_cur;
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_cur = ctx;
+    x = lgw_receive(max_pkt, pkt_data);
+    lgw_ctx_cur = prev;
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_send(struct lgw_ctx_s *ctx, struct lgw_pkt_tx_s pkt_data) {
+    struct lgw_ctx_s *prev = lgw_ctx_cur;
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_cur = ctx;
+    x = lgw_send(pkt_data);
+    lgw_ctx_cur = prev;
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_status(struct lgw_ctx_s *ctx, uint8_t select, uint8_t *code) {
+    struct lgw_ctx_s *prev = lgw_ctx_cur;
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_cur = ctx;
+    x = lgw_status(select, code);
+    lgw_ctx_cur = prev;
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_abort_tx(struct lgw_ctx_s *ctx) {
+    struct lgw_ctx_s *prev = lgw_ctx_cur;
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_cur = ctx;
+    x = lgw_abort_tx();
+    lgw_ctx_cur = prev;
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_get_trigcnt(struct lgw_ctx_s *ctx, uint32_t *trig_cnt_us) {
+    struct lgw_ctx_s *prev = lgw_ctx_cur;
+    int x;
+
+    CHECK_NULL(ctx);
+    lgw_ctx_cur = ctx;
+    x = lgw_get_trigcnt(trig_cnt_us);
+    lgw_ctx_cur = prev;
+    return x;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
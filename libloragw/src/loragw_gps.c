@@ -28,7 +28,9 @@ Maintainer: Michael Coracin
 #include <time.h>       /* struct timespec */
 #include <fcntl.h>      /* open */
 #include <termios.h>    /* tcflush */
-#include <math.h>       /* modf */
+#include <math.h>       /* sqrt floor lround */
+#include <pthread.h>    /* pthread_mutex_lock */
+#include <sys/uio.h>    /* readv */
 
 #include <stdlib.h>
 
@@ -53,11 +55,57 @@ Maintainer: Michael Coracin
 /* --- PRIVATE CONSTANTS ---------------------------------------------------- */
 
 #define TS_CPS              1E6 /* count-per-second of the timestamp counter */
+#define CNT2NS_SHIFT        40  /* fixed point ratios of the conversions, see ratio_cnt2ns */
+#define NS2CNT_SHIFT        52
+#define CNT2NS_ONE          (1E3 * 1099511627776.0)     /* 1000 ns per tick, scaled by 2^40 */
+#define NS2CNT_ONE          (4503599627370496.0 / 1E3)  /* 1/1000 tick per ns, scaled by 2^52 */
 #define PLUS_10PPM          1.00001
 #define MINUS_10PPM         0.99999
+#define DRIFT_NB_ABERRANT   3       /* successive rejected sync points that reset a reference */
+#define DRIFT_GATE          5.0     /* sync points further than that many standard deviations from the estimate are rejected */
+#define DRIFT_XTAL_VAR      100.0   /* initial variance of the clock error, (10 ppm)^2 in (counts per second)^2 */
+#define DRIFT_ZETA          0.7071  /* damping of the PLL */
 #define DEFAULT_BAUDRATE    B9600
+#define GPS_EPOCH_UNIX      315964800   /* GPS epoch 06.Jan.1980 00:00:00 UTC, in seconds since the Unix epoch */
+#define GPS_LEAP_DEFAULT    18          /* GPS-UTC offset since 01.Jan.2017, used until a NAV-TIMEGPS message gives it */
 
 #define UBX_MSG_NAVTIMEGPS_LEN  16
+#define UBX_NAVTIMEGPS_PAYLOAD  16
+#define UBX_KEEP_PAYLOAD        16  /* longer UBX frames are only checked, not kept in the stream ring */
+
+/* frame synchronization states of a GPS stream */
+#define ST_SYNC             0   /* looking for a UBX or NMEA sync char */
+#define ST_UBX_SYNC2        1   /* second UBX sync char */
+#define ST_UBX_HEADER       2   /* class, ID and payload length */
+#define ST_UBX_PAYLOAD      3
+#define ST_UBX_CK_A         4
+#define ST_UBX_CK_B         5
+#define ST_NMEA_FIELDS      6   /* up to the '*' */
+#define ST_NMEA_CK_1        7
+#define ST_NMEA_CK_2        8
+#define ST_NMEA_END         9   /* up to the LF */
+
+#define STREAM_MASK         (LGW_GPS_STREAM_SIZE - 1)
+#if (LGW_GPS_STREAM_SIZE & STREAM_MASK) != 0
+    #error "LGW_GPS_STREAM_SIZE must be a power of 2"
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* NMEA sentence or UBX frame to decode, in a stream ring buffer or in a linear
+buffer (mask with all bits set) */
+struct frame_s {
+    const uint8_t   *buf;
+    uint32_t        mask;
+    uint32_t        start;      /* index of the sync char */
+    const uint16_t  *field;     /* NMEA: offset of each field, field 0 is the label */
+    int             nb_field;
+    int             field_end;  /* NMEA: offset of the '*' */
+};
+
+#define FRAME_BYTE(f, i)        ((f)->buf[((f)->start + (uint32_t)(i)) & (f)->mask])
+#define FIELD_BYTE(f, k, i)     FRAME_BYTE(f, (f)->field[k] + (i))
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
@@ -72,9 +120,8 @@ static short gps_min = 0; /* minutes (0-59) */
 static short gps_sec = 0; /* seconds (0-60)(60 is for leap second) */
 static float gps_fra = 0.0; /* fractions of seconds (<1) */
 static bool gps_time_ok = false;
-static int16_t gps_week = 0; /* GPS week number of the navigation epoch */
-static uint32_t gps_iTOW = 0; /* GPS time of week in milliseconds */
-static int32_t gps_fTOW = 0; /* Fractional part of iTOW (+/-500000) in nanosec */
+static int64_t gps_ns = 0; /* GPS time of the last navigation epoch (RMC or NAV-TIMEGPS), in ns since the GPS epoch */
+static int gps_leap = GPS_LEAP_DEFAULT; /* GPS-UTC offset, in seconds */
 
 static short gps_dla = 0; /* degrees of latitude */
 static double gps_mla = 0.0; /* minutes of latitude */
@@ -90,6 +137,9 @@ static short gps_sat = 0; /* number of satellites used for fix */
 
 static struct termios ttyopt_restore;
 
+/* protects the variables above, written by the parsers and read by lgw_gps_get */
+static pthread_mutex_t mx_gps = PTHREAD_MUTEX_INITIALIZER;
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
 
@@ -99,9 +149,59 @@ static char nibble_to_hexchar(uint8_t a);
 
 static bool validate_nmea_checksum(const char *serial_buff, int buff_size);
 
-static bool match_label(const char *s, char *label, int size, char wildcard);
+static bool frame_label(const struct frame_s *f, const char *label, char wildcard);
+
+static int field_size(const struct frame_s *f, int k);
+
+static char field_char(const struct frame_s *f, int k);
+
+static bool field_int(const struct frame_s *f, int k, int *pos, int width, int *val);
+
+static bool field_dec(const struct frame_s *f, int k, int *pos, int width, double *val);
+
+/* decoders shared by the framed buffer parsers and the stream parser, called with the GPS lock held */
+static enum gps_msg ubx_decode(const struct frame_s *f);
+
+static enum gps_msg nmea_decode(const struct frame_s *f);
+
+static void stream_resync(struct lgw_gps_stream_s *s);
+
+/* time reference helpers, shared by the single value and the array conversions */
+static bool tref_valid(const struct tref *ref);
+
+/* clock error estimators of lgw_gps_sync */
+static void sync_reset(struct tref *ref, uint32_t count_us, const struct timespec *utc, const struct timespec *gps_time);
+
+static int sync_slope(struct tref *ref, uint32_t count_us, const struct timespec *utc, const struct timespec *gps_time);
+
+static int sync_filter(struct tref *ref, uint32_t count_us, const struct timespec *utc, const struct timespec *gps_time);
+
+static void ns_to_timespec(int64_t ns, struct timespec *t);
 
-static int str_chop(char *s, int buff_size, char separator, int *idx_ary, int max_idx);
+static void timespec_add(struct timespec *t, double sec);
+
+static int32_t days_from_civil(int32_t year, uint32_t mon, uint32_t day);
+
+static uint64_t mul_shift(uint64_t x, uint64_t k, int shift);
+
+static uint64_t ratio_cnt2ns(const struct tref *ref);
+
+static uint64_t ratio_ns2cnt(const struct tref *ref);
+
+static void ratio_cache(struct tref *ref);
+
+static void tref_read(const struct lgw_tref_pub_s *pub, struct tref *ref, uint64_t *cnt2ns, uint64_t *ns2cnt);
+
+static void cnt2time(const struct tref *ref, const struct timespec *ref_time, uint64_t cnt2ns, uint32_t count_us, struct timespec *t);
+
+static uint32_t time2cnt(const struct tref *ref, const struct timespec *ref_time, uint64_t ns2cnt, const struct timespec *t);
+
+/* bodies of the public functions, called with the GPS lock held */
+static enum gps_msg gps_parse_ubx(const char *serial_buff, size_t buff_size, size_t *msg_size);
+
+static enum gps_msg gps_parse_nmea(const char *serial_buff, int buff_size);
+
+static int gps_get(struct timespec *utc, struct timespec *gps_time, struct coord_s *loc, struct coord_s *err);
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
@@ -195,57 +295,660 @@ static bool validate_nmea_checksum(const char *serial_buff, int buff_size) {
 
 /*
 Return true if the "label" string (can contain wildcard characters) matches
-the begining of the "s" string
+the begining of the frame
 */
-static bool match_label(const char *s, char *label, int size, char wildcard) {
+static bool frame_label(const struct frame_s *f, const char *label, char wildcard) {
     int i;
 
-    for (i=0; i < size; i++) {
+    for (i=0; label[i] != 0; i++) {
         if (label[i] == wildcard) continue;
-        if (label[i] != s[i]) return false;
+        if (label[i] != (char)FRAME_BYTE(f, i)) return false;
     }
     return true;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+/* number of characters of a NMEA field, separator excluded */
+static int field_size(const struct frame_s *f, int k) {
+    if (k + 1 < f->nb_field) {
+        return f->field[k+1] - f->field[k] - 1;
+    } else {
+        return f->field_end - f->field[k];
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* first character of a NMEA field, 0 if it is empty */
+static char field_char(const struct frame_s *f, int k) {
+    if (field_size(f, k) > 0) {
+        return (char)FIELD_BYTE(f, k, 0);
+    } else {
+        return 0;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 /*
-Chop a string into smaller strings
-Replace every separator in the input character buffer by a null character so
-that all s[index] are valid strings.
-Populate an array of integer 'idx_ary' representing indexes of token in the
-string.
-buff_size and max_idx are there to prevent segfaults.
-Return the number of token found (number of idx_ary filled).
+Read a signed integer of at most 'width' characters at position *pos of a NMEA
+field, like sscanf "%<width>d" would; *pos is moved after it.
+Return false if there is no digit.
 */
-int str_chop(char *s, int buff_size, char separator, int *idx_ary, int max_idx) {
-    int i = 0; /* index in the string */
-    int j = 0; /* index in the result array */
+static bool field_int(const struct frame_s *f, int k, int *pos, int width, int *val) {
+    int i = *pos;
+    int end = field_size(f, k);
+    int v = 0;
+    int nb_digit = 0;
+    bool neg = false;
+    char c;
+
+    if (end > *pos + width) {
+        end = *pos + width;
+    }
+    if ((i < end) && (FIELD_BYTE(f, k, i) == '-')) {
+        neg = true;
+        ++i;
+    }
+    for (; i < end; ++i) {
+        c = (char)FIELD_BYTE(f, k, i);
+        if ((c < '0') || (c > '9')) break;
+        v = (v * 10) + (c - '0');
+        ++nb_digit;
+    }
+    if (nb_digit == 0) {
+        return false;
+    }
+    *pos = i;
+    *val = neg ? -v : v;
+    return true;
+}
 
-    if ((s == NULL) || (buff_size < 0) || (separator == 0) || (idx_ary == NULL) || (max_idx < 0)) {
-        /* unsafe to do anything */
-        return -1;
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Read an unsigned decimal number (eg. 17.11437 or .34) of at most 'width'
+characters at position *pos of a NMEA field; *pos is moved after it.
+Return false if there is no digit.
+*/
+static bool field_dec(const struct frame_s *f, int k, int *pos, int width, double *val) {
+    int i = *pos;
+    int end = field_size(f, k);
+    uint64_t mant = 0;
+    double div = 1.0;
+    int nb_digit = 0;
+    bool dot = false;
+    char c;
+
+    if (end > *pos + width) {
+        end = *pos + width;
     }
-    if ((buff_size == 0) || (max_idx == 0)) {
-        /* nothing to do */
-        return 0;
+    for (; i < end; ++i) {
+        c = (char)FIELD_BYTE(f, k, i);
+        if ((c >= '0') && (c <= '9')) {
+            mant = (mant * 10) + (uint64_t)(c - '0');
+            if (dot) div *= 10.0;
+            ++nb_digit;
+        } else if ((c == '.') && !dot) {
+            dot = true;
+        } else {
+            break;
+        }
     }
-    s[buff_size - 1] = 0; /* add string terminator at the end of the buffer, just to be sure */
-    idx_ary[j] = 0;
-    j += 1;
-    /* loop until string terminator is reached */
-    while (s[i] != 0) {
-        if (s[i] == separator) {
-            s[i] = 0; /* replace separator by string terminator */
-            if (j >= max_idx) { /* no more room in the index array */
-                return j;
+    if (nb_digit == 0) {
+        return false;
+    }
+    *pos = i;
+    *val = (double)mant / div;
+    return true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Decode a UBX frame whose checksum was verified, the GPS lock being held.
+The frame bytes are read in place.
+*/
+static enum gps_msg ubx_decode(const struct frame_s *f) {
+    uint8_t valid;      /* iTOW, fTOW, week and leap seconds validity */
+    uint32_t iTOW;      /* GPS time of week in milliseconds */
+    int32_t fTOW;       /* Fractional part of iTOW (+/-500000) in nanosec */
+    int16_t week;       /* GPS week number of the navigation epoch */
+    unsigned int payload_length;
+
+    payload_length  = FRAME_BYTE(f, 4);
+    payload_length |= FRAME_BYTE(f, 5) << 8;
+
+    /* Check for Class 0x01 (NAV) and ID 0x20 (NAV-TIMEGPS) */
+    if ((FRAME_BYTE(f, 2) == 0x01) && (FRAME_BYTE(f, 3) == 0x20) && (payload_length == UBX_NAVTIMEGPS_PAYLOAD)) {
+        /* Check validity of information */
+        valid = FRAME_BYTE(f, 17);
+        if ((valid & 0x03) == 0x03) { /* towValid, weekValid */
+            /* Parse buffer to extract GPS time */
+            /* Warning: payload byte ordering is Little Endian */
+            iTOW =  FRAME_BYTE(f, 6);
+            iTOW |= FRAME_BYTE(f, 7) << 8;
+            iTOW |= FRAME_BYTE(f, 8) << 16;
+            iTOW |= (uint32_t)FRAME_BYTE(f, 9) << 24; /* GPS time of week, in ms */
+
+            fTOW =  FRAME_BYTE(f, 10);
+            fTOW |= FRAME_BYTE(f, 11) << 8;
+            fTOW |= FRAME_BYTE(f, 12) << 16;
+            fTOW |= (uint32_t)FRAME_BYTE(f, 13) << 24; /* Fractional part of iTOW, in ns */
+
+            week =  FRAME_BYTE(f, 14);
+            week |= FRAME_BYTE(f, 15) << 8; /* GPS week number */
+
+            /* Number of ns since GPS epoch 06.Jan.1980, iTOW + fTOW can be negative at the start of a week */
+            gps_ns = ((int64_t)week * 604800 * 1000000000) + ((int64_t)iTOW * 1000000) + fTOW; /* day*hours*minutes*secondes: 7*24*60*60; */
+            if ((valid & 0x04) != 0) { /* leapSValid */
+                gps_leap = (int8_t)FRAME_BYTE(f, 16);
             }
-            idx_ary[j] = i+1; /* next token start after replaced separator */
-            ++j;
+            gps_time_ok = true;
+        } else { /* valid */
+            gps_time_ok = false;
         }
-        ++i;
+
+        return UBX_NAV_TIMEGPS;
+    } else if ((FRAME_BYTE(f, 2) == 0x05) && (FRAME_BYTE(f, 3) == 0x00)) {
+        DEBUG_MSG("NOTE: UBX ACK-NAK received\n");
+        return IGNORED;
+    } else if ((FRAME_BYTE(f, 2) == 0x05) && (FRAME_BYTE(f, 3) == 0x01)) {
+        DEBUG_MSG("NOTE: UBX ACK-ACK received\n");
+        return IGNORED;
+    } else { /* not a supported message */
+        DEBUG_MSG("ERROR: UBX message is not supported (%02x %02x)\n", FRAME_BYTE(f, 2), FRAME_BYTE(f, 3));
+        return IGNORED;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Decode a NMEA sentence whose checksum was verified and whose fields were
+indexed, the GPS lock being held.
+The fields are read in place, the frame is not modified.
+*/
+static enum gps_msg nmea_decode(const struct frame_s *f) {
+    int hou, min, sec, day, mon, yea, sat, dla, dlo, alt;
+    double fra, mla, mlo;
+    char ola, olo;
+    time_t utc;
+    int pos;
+    bool i, j, k;
+
+    if (frame_label(f, "$G?RMC", '?')) {
+        /*
+        NMEA sentence format: $xxRMC,time,status,lat,NS,long,EW,spd,cog,date,mv,mvEW,posMode*cs<CR><LF>
+        Valid fix: $GPRMC,083559.34,A,4717.11437,N,00833.91522,E,0.004,77.52,091202,,,A*00
+        No fix: $GPRMC,,V,,,,,,,,,,N*00
+        */
+        if (f->nb_field != 13) {
+            DEBUG_MSG("Warning: invalid RMC sentence (number of fields)\n");
+            return IGNORED;
+        }
+        /* parse GPS status */
+        gps_mod = field_char(f, 12); /* get first character, no need to bother with sscanf */
+        if ((gps_mod != 'N') && (gps_mod != 'A') && (gps_mod != 'D')) {
+            gps_mod = 'N';
+        }
+        /* parse complete time: hhmmss.ss and ddmmyy */
+        pos = 0;
+        i = field_int(f, 1, &pos, 2, &hou) && field_int(f, 1, &pos, 2, &min) && field_int(f, 1, &pos, 2, &sec) && field_dec(f, 1, &pos, 4, &fra);
+        pos = 0;
+        j = field_int(f, 9, &pos, 2, &day) && field_int(f, 9, &pos, 2, &mon) && field_int(f, 9, &pos, 2, &yea);
+        if (i && j) {
+            gps_hou = hou;
+            gps_min = min;
+            gps_sec = sec;
+            gps_fra = (float)fra;
+            gps_day = day;
+            gps_mon = mon;
+            gps_yea = yea;
+            if (lgw_date2utc(yea, mon, day, hou, min, sec, &utc) != LGW_GPS_SUCCESS) {
+                gps_time_ok = false;
+                DEBUG_MSG("Warning: invalid RMC sentence (date)\n");
+            } else if ((gps_mod == 'A') || (gps_mod == 'D')) {
+                /* GPS time of the epoch, with the GPS-UTC offset learnt from NAV-TIMEGPS or the default one */
+                gps_ns = (((int64_t)utc - GPS_EPOCH_UNIX + gps_leap) * 1000000000) + (int32_t)(gps_fra * 1e9);
+                gps_time_ok = true;
+                DEBUG_MSG("Note: Valid RMC sentence, GPS locked, date: 20%02d-%02d-%02dT%02d:%02d:%06.3fZ\n", gps_yea, gps_mon, gps_day, gps_hou, gps_min, gps_fra + (float)gps_sec);
+            } else {
+                gps_time_ok = false;
+                DEBUG_MSG("Note: Valid RMC sentence, no satellite fix, estimated date: 20%02d-%02d-%02dT%02d:%02d:%06.3fZ\n", gps_yea, gps_mon, gps_day, gps_hou, gps_min, gps_fra + (float)gps_sec);
+            }
+        } else {
+            /* could not get a valid hour AND date */
+            gps_time_ok = false;
+            DEBUG_MSG("Note: Valid RMC sentence, mode %c, no date\n", gps_mod);
+        }
+        return NMEA_RMC;
+    } else if (frame_label(f, "$G?GGA", '?')) {
+        /*
+        NMEA sentence format: $xxGGA,time,lat,NS,long,EW,quality,numSV,HDOP,alt,M,sep,M,diffAge,diffStation*cs<CR><LF>
+        Valid fix: $GPGGA,092725.00,4717.11399,N,00833.91590,E,1,08,1.01,499.6,M,48.0,M,,*5B
+        */
+        if (f->nb_field != 15) {
+            DEBUG_MSG("Warning: invalid GGA sentence (number of fields)\n");
+            return IGNORED;
+        }
+        /* parse number of satellites used for fix */
+        pos = 0;
+        if (field_int(f, 7, &pos, 6, &sat)) {
+            gps_sat = sat;
+        }
+        /* parse 3D coordinates: ddmm.mmmmm, dddmm.mmmmm and altitude */
+        pos = 0;
+        i = field_int(f, 2, &pos, 2, &dla) && field_dec(f, 2, &pos, 10, &mla);
+        ola = field_char(f, 3);
+        pos = 0;
+        j = field_int(f, 4, &pos, 3, &dlo) && field_dec(f, 4, &pos, 10, &mlo);
+        olo = field_char(f, 5);
+        pos = 0;
+        k = field_int(f, 9, &pos, 6, &alt);
+        if (i && j && k && ((ola=='N')||(ola=='S')) && ((olo=='E')||(olo=='W'))) {
+            gps_dla = dla;
+            gps_mla = mla;
+            gps_ola = ola;
+            gps_dlo = dlo;
+            gps_mlo = mlo;
+            gps_olo = olo;
+            gps_alt = alt;
+            gps_pos_ok = true;
+            DEBUG_MSG("Note: Valid GGA sentence, %d sat, lat %02ddeg %06.3fmin %c, lon %03ddeg%06.3fmin %c, alt %d\n", gps_sat, gps_dla, gps_mla, gps_ola, gps_dlo, gps_mlo, gps_olo, gps_alt);
+        } else {
+            /* could not get a valid latitude, longitude AND altitude */
+            gps_pos_ok = false;
+            DEBUG_MSG("Note: Valid GGA sentence, %d sat, no coordinates\n", gps_sat);
+        }
+        return NMEA_GGA;
+    } else {
+        DEBUG_MSG("Note: ignored NMEA sentence\n"); /* quite verbose */
+        return IGNORED;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Drop the frame being received and resume the synchronization on the byte that
+follows its sync char (if the frame bytes are still in the ring)
+*/
+static void stream_resync(struct lgw_gps_stream_s *s) {
+    if (s->keep) {
+        s->rd = s->start + 1;
+    }
+    s->start = s->rd;
+    s->state = ST_SYNC;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static bool tref_valid(const struct tref *ref) {
+    return (ref->systime != 0) && (ref->xtal_err <= PLUS_10PPM) && (ref->xtal_err >= MINUS_10PPM);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Start a new estimation on a sync point: the clock error is kept if it is in
+range, with the initial uncertainty
+*/
+static void sync_reset(struct tref *ref, uint32_t count_us, const struct timespec *utc, const struct timespec *gps_time) {
+    struct lgw_drift_s *d = &ref->drift;
+    double meas = (d->conf.meas_std_us > 0.0) ? d->conf.meas_std_us : LGW_DRIFT_MEAS_STD_DEFAULT;
+
+    ref->systime = time(NULL);
+    ref->count_us = count_us;
+    ref->utc = *utc;
+    ref->gps = *gps_time;
+    if ((ref->xtal_err > PLUS_10PPM) || (ref->xtal_err < MINUS_10PPM)) {
+        ref->xtal_err = 1.0;
+    }
+    ref->xtal_err_std = sqrt(DRIFT_XTAL_VAR) / TS_CPS;
+    ref->count_std = meas;
+    d->nb_point = 1;
+    d->nb_aberrant = 0;
+    d->p[0] = meas * meas;
+    d->p[1] = 0.0;
+    d->p[2] = DRIFT_XTAL_VAR;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Clock error measured as the slope between the last two sync points, with a
+sanity check of the slope
+*/
+static int sync_slope(struct tref *ref, uint32_t count_us, const struct timespec *utc, const struct timespec *gps_time) {
+    struct lgw_drift_s *d = &ref->drift;
+    double meas = (d->conf.meas_std_us > 0.0) ? d->conf.meas_std_us : LGW_DRIFT_MEAS_STD_DEFAULT;
+    double cnt_diff; /* internal concentrator time difference (in seconds) */
+    double utc_diff; /* UTC time difference (in seconds) */
+    double slope = 0.0; /* time slope between new reference and old reference (for sanity check) */
+    bool aberrant;
+
+    /* calculate the slope */
+    cnt_diff = (double)(count_us - ref->count_us) / (double)(TS_CPS); /* uncorrected by xtal_err */
+    utc_diff = (double)(utc->tv_sec - (ref->utc).tv_sec) + (1E-9 * (double)(utc->tv_nsec - (ref->utc).tv_nsec));
+
+    /* detect aberrant points by measuring if slope limits are exceeded */
+    if (utc_diff != 0) { // prevent divide by zero
+        slope = cnt_diff/utc_diff;
+        if ((slope > PLUS_10PPM) || (slope < MINUS_10PPM)) {
+            DEBUG_MSG("Warning: correction range exceeded\n");
+            aberrant = true;
+        } else {
+            aberrant = false;
+        }
+    } else {
+        DEBUG_MSG("Warning: aberrant UTC value for synchronization\n");
+        aberrant = true;
+    }
+
+    if (aberrant == false) {
+        /* value no aberrant -> sync with the new slope */
+        ref->systime = time(NULL);
+        ref->count_us = count_us;
+        ref->utc = *utc;
+        ref->gps = *gps_time;
+        ref->xtal_err = slope;
+        ref->xtal_err_std = 1.4142 * meas / (utc_diff * TS_CPS); /* two measurements */
+        ref->count_std = meas;
+        d->nb_point += 1;
+        d->nb_aberrant = 0;
+        return LGW_GPS_SUCCESS;
+    } else if (++d->nb_aberrant >= DRIFT_NB_ABERRANT) {
+        /* 3 successive aberrant values -> sync reset (keep xtal_err), next aberrant value resets again */
+        DEBUG_MSG("Warning: 3 successive aberrant sync attempts, sync reset\n");
+        sync_reset(ref, count_us, utc, gps_time);
+        d->nb_aberrant = DRIFT_NB_ABERRANT;
+        return LGW_GPS_SUCCESS;
+    } else {
+        /* only 1 or 2 successive aberrant values -> ignore and return an error */
+        return LGW_GPS_ERROR;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Filtered clock error: the counter value expected at the time of the sync point
+is predicted from the reference, and the difference with the latched value
+(innovation) corrects the counter offset and the clock error, with the gains of
+a Kalman filter or of a PLL. The new reference is the filtered time at which
+the counter had the latched value, the jitter of the time pulse is smoothed.
+*/
+static int sync_filter(struct tref *ref, uint32_t count_us, const struct timespec *utc, const struct timespec *gps_time) {
+    struct lgw_drift_s *d = &ref->drift;
+    double meas = (d->conf.meas_std_us > 0.0) ? d->conf.meas_std_us : LGW_DRIFT_MEAS_STD_DEFAULT;
+    double dt; /* time since the reference, in seconds */
+    double f; /* counts per second */
+    double pred, y; /* counts predicted since the reference, innovation */
+    double p00, p01, p11, q, s, k0, k1;
+    double wn, kp, ki;
+
+    if ((ref->systime == 0) || (d->nb_point == 0)) {
+        sync_reset(ref, count_us, utc, gps_time);
+        return LGW_GPS_SUCCESS;
+    }
+
+    /* innovation, the counter wrap is resolved around the prediction */
+    dt = (double)(utc->tv_sec - ref->utc.tv_sec) + (1E-9 * (double)(utc->tv_nsec - ref->utc.tv_nsec));
+    f = TS_CPS * ref->xtal_err;
+    pred = floor(f * dt);
+    y = (double)(int32_t)(count_us - ref->count_us - (uint32_t)(int64_t)pred) - ((f * dt) - pred);
+
+    /* random walk of the clock error, in counts^2 per second^3 */
+    q = (d->conf.wander_ppm > 0.0) ? d->conf.wander_ppm : LGW_DRIFT_WANDER_DEFAULT;
+    q *= q;
+
+    if (d->conf.filter == LGW_DRIFT_KALMAN) {
+        /* prediction of the covariance */
+        p00 = d->p[0] + 2.0 * dt * d->p[1] + dt * dt * d->p[2] + q * dt * dt * dt / 3.0;
+        p01 = d->p[1] + dt * d->p[2] + q * dt * dt / 2.0;
+        p11 = d->p[2] + q * dt;
+        s = p00 + meas * meas;
+        k0 = p00 / s;
+        k1 = p01 / s;
+    } else {
+        /* fixed gains of a 2nd order loop, the innovations give the uncertainty, the random walk widens the gate after a gap */
+        wn = 2.0 * M_PI * ((d->conf.bw_hz > 0.0) ? d->conf.bw_hz : LGW_DRIFT_BW_DEFAULT) * dt;
+        kp = 2.0 * DRIFT_ZETA * wn;
+        ki = wn * wn;
+        if (kp > 1.0) {
+            kp = 1.0;
+            ki = 0.25;
+        }
+        p00 = p01 = p11 = 0.0;
+        s = d->p[0] + dt * dt * d->p[2] + q * dt * dt * dt / 3.0 + meas * meas;
+        k0 = kp;
+        k1 = (dt > 0.0) ? ki / dt : 0.0;
+    }
+
+    /* reject the points too far from the estimate, or that would put the clock error out of range */
+    if ((dt <= 0.0) || (fabs(y) > DRIFT_GATE * sqrt(s)) || (((f + k1 * y) / TS_CPS) > PLUS_10PPM) || (((f + k1 * y) / TS_CPS) < MINUS_10PPM)) {
+        DEBUG_MSG("Warning: aberrant sync point, %.3f us from the estimate\n", y);
+        if (++d->nb_aberrant >= DRIFT_NB_ABERRANT) {
+            DEBUG_MSG("Warning: 3 successive aberrant sync attempts, sync reset\n");
+            sync_reset(ref, count_us, utc, gps_time);
+            return LGW_GPS_SUCCESS;
+        }
+        return LGW_GPS_ERROR;
+    }
+
+    /* correction */
+    if (d->conf.filter == LGW_DRIFT_KALMAN) {
+        d->p[0] = (1.0 - k0) * p00;
+        d->p[1] = (1.0 - k0) * p01;
+        d->p[2] = p11 - k1 * p01;
+        ref->xtal_err_std = sqrt(d->p[2]) / TS_CPS;
+        ref->count_std = sqrt(d->p[0]);
+    } else {
+        d->p[0] += kp * ((y * y) - d->p[0]);
+        d->p[2] += kp * ((k1 * y * k1 * y) - d->p[2]);
+        ref->xtal_err_std = sqrt(d->p[2]) / TS_CPS;
+        ref->count_std = sqrt(d->p[0]);
+    }
+    f += k1 * y;
+
+    /* the latched value is (1 - k0) * y counts after the filtered counter value at the time of the sync point */
+    ref->systime = time(NULL);
+    ref->count_us = count_us;
+    ref->utc = *utc;
+    ref->gps = *gps_time;
+    timespec_add(&ref->utc, (1.0 - k0) * y / f);
+    timespec_add(&ref->gps, (1.0 - k0) * y / f);
+    ref->xtal_err = f / TS_CPS;
+    d->nb_point += 1;
+    d->nb_aberrant = 0;
+
+    return LGW_GPS_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* split a signed number of nanoseconds into a normalized time */
+static void ns_to_timespec(int64_t ns, struct timespec *t) {
+    t->tv_sec = (time_t)(ns / 1000000000);
+    t->tv_nsec = (long)(ns % 1000000000);
+    if (t->tv_nsec < 0) {
+        t->tv_sec -= 1;
+        t->tv_nsec += 1000000000;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* add a small number of seconds to a time, rounded to the nanosecond */
+static void timespec_add(struct timespec *t, double sec) {
+    long ns = lround(sec * 1E9);
+
+    t->tv_sec += ns / 1000000000;
+    t->tv_nsec += ns % 1000000000;
+    if (t->tv_nsec < 0) {
+        t->tv_sec -= 1;
+        t->tv_nsec += 1000000000;
+    } else if (t->tv_nsec >= 1000000000) {
+        t->tv_sec += 1;
+        t->tv_nsec -= 1000000000;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Number of days from 01.Jan.1970 to a date of the proleptic Gregorian calendar
+(mon 1-12, day 1-31), without time zone nor table: the year is counted from
+March so that the leap day is the last one, in 400 years eras of 146097 days
+*/
+static int32_t days_from_civil(int32_t year, uint32_t mon, uint32_t day) {
+    int32_t era;
+    uint32_t yoe, doy, doe; /* year of era [0,399], day of year [0,365], day of era [0,146096] */
+
+    year -= (mon <= 2) ? 1 : 0;
+    era = ((year >= 0) ? year : (year - 399)) / 400;
+    yoe = (uint32_t)(year - (era * 400));
+    doy = (((153 * ((mon > 2) ? (mon - 3) : (mon + 9))) + 2) / 5) + day - 1;
+    doe = (yoe * 365) + (yoe / 4) - (yoe / 100) + doy;
+    return (era * 146097) + (int32_t)doe - 719468;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Compute round(x * k / 2^shift), with 0 < shift < 64 and a result that fits in
+64 bits; the 128-bit product is built from 32-bit halves where the compiler has
+no 128-bit type (32-bit ARM)
+*/
+static uint64_t mul_shift(uint64_t x, uint64_t k, int shift) {
+#ifdef __SIZEOF_INT128__
+    return (uint64_t)(((unsigned __int128)x * k + ((unsigned __int128)1 << (shift - 1))) >> shift);
+#else
+    uint64_t lo, mid1, mid2, hi, carry;
+    uint64_t half = (uint64_t)1 << (shift - 1);
+
+    lo = (x & 0xFFFFFFFF) * (k & 0xFFFFFFFF);
+    mid1 = (x >> 32) * (k & 0xFFFFFFFF);
+    mid2 = (x & 0xFFFFFFFF) * (k >> 32);
+    hi = (x >> 32) * (k >> 32);
+    carry = (lo >> 32) + (mid1 & 0xFFFFFFFF) + (mid2 & 0xFFFFFFFF);
+    lo = (lo & 0xFFFFFFFF) | (carry << 32);
+    hi += (mid1 >> 32) + (mid2 >> 32) + (carry >> 32);
+
+    lo += half;
+    hi += (lo < half) ? 1 : 0;
+    return (hi << (64 - shift)) | (lo >> shift);
+#endif
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Fixed point ratios of a reference: nanoseconds per counter tick (scaled by
+2^40, about 2^50) and counter ticks per nanosecond (scaled by 2^52, about 2^42).
+The rounding of the ratios adds less than 1/500 ns (or us) to a conversion over
+the whole counter range.
+The ratios cached in the reference are used as long as xtal_err is the value
+they were computed for, a reference built or modified by hand gets them
+computed on each conversion.
+*/
+static uint64_t ratio_cnt2ns(const struct tref *ref) {
+    if ((ref->cnt2ns != 0) && (ref->xtal_err_cached == ref->xtal_err)) {
+        return ref->cnt2ns;
+    }
+    return (uint64_t)(int64_t)((CNT2NS_ONE / ref->xtal_err) + 0.5);
+}
+
+static uint64_t ratio_ns2cnt(const struct tref *ref) {
+    if ((ref->ns2cnt != 0) && (ref->xtal_err_cached == ref->xtal_err)) {
+        return ref->ns2cnt;
+    }
+    return (uint64_t)(int64_t)((NS2CNT_ONE * ref->xtal_err) + 0.5);
+}
+
+/* compute the ratios of a valid reference once, null ratios are never used */
+static void ratio_cache(struct tref *ref) {
+    ref->cnt2ns = 0;
+    ref->ns2cnt = 0;
+    if (tref_valid(ref)) {
+        ref->cnt2ns = ratio_cnt2ns(ref);
+        ref->ns2cnt = ratio_ns2cnt(ref);
+        ref->xtal_err_cached = ref->xtal_err;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* consistent copy of a published reference and of its ratios */
+static void tref_read(const struct lgw_tref_pub_s *pub, struct tref *ref, uint64_t *cnt2ns, uint64_t *ns2cnt) {
+    uint32_t seq;
+
+    do {
+        seq = __atomic_load_n(&pub->seq, __ATOMIC_ACQUIRE);
+        *ref = pub->ref;
+        *cnt2ns = pub->cnt2ns;
+        *ns2cnt = pub->ns2cnt;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || (__atomic_load_n(&pub->seq, __ATOMIC_RELAXED) != seq));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Add the time elapsed between the reference counter value and count_us to
+ref_time (the UTC or GPS time of the reference), rounded to the nanosecond.
+The counter difference is signed: count_us can be up to 2^31 us (35 minutes)
+before or after the reference, across a counter wrap.
+*/
+static void cnt2time(const struct tref *ref, const struct timespec *ref_time, uint64_t cnt2ns, uint32_t count_us, struct timespec *t) {
+    int32_t delta_cnt = (int32_t)(count_us - ref->count_us);
+    uint64_t delta_ns;
+    uint32_t sec;
+    long nsec;
+
+    delta_ns = mul_shift((delta_cnt < 0) ? -(int64_t)delta_cnt : delta_cnt, cnt2ns, CNT2NS_SHIFT);
+
+    /* delta_ns < 2^42 and 1E9 = 2^9 * 1953125: 32-bit division */
+    sec = (uint32_t)(delta_ns >> 9) / 1953125;
+    nsec = (long)(delta_ns - (uint64_t)sec * 1000000000);
+    if (delta_cnt >= 0) {
+        t->tv_sec = ref_time->tv_sec + sec;
+        t->tv_nsec = ref_time->tv_nsec + nsec;
+        if (t->tv_nsec >= 1000000000) { /* must carry one second */
+            t->tv_sec += 1;
+            t->tv_nsec -= 1000000000;
+        }
+    } else {
+        t->tv_sec = ref_time->tv_sec - sec;
+        t->tv_nsec = ref_time->tv_nsec - nsec;
+        if (t->tv_nsec < 0) { /* must borrow one second */
+            t->tv_sec -= 1;
+            t->tv_nsec += 1000000000;
+        }
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Add the counter ticks elapsed between ref_time and t to the reference counter
+value, rounded to the microsecond; t can be before ref_time, the result wraps
+like the counter
+*/
+static uint32_t time2cnt(const struct tref *ref, const struct timespec *ref_time, uint64_t ns2cnt, const struct timespec *t) {
+    int64_t delta_ns;
+    uint32_t delta_cnt;
+
+    delta_ns = (int64_t)(t->tv_sec - ref_time->tv_sec) * 1000000000 + (t->tv_nsec - ref_time->tv_nsec);
+    if (delta_ns >= 0) {
+        delta_cnt = (uint32_t)mul_shift(delta_ns, ns2cnt, NS2CNT_SHIFT);
+        return ref->count_us + delta_cnt;
+    } else {
+        delta_cnt = (uint32_t)mul_shift(-delta_ns, ns2cnt, NS2CNT_SHIFT);
+        return ref->count_us - delta_cnt;
     }
-    return j;
 }
 
 /* -------------------------------------------------------------------------- */
@@ -355,9 +1058,6 @@ int lgw_gps_enable(char *tty_path, char *gps_family, speed_t target_brate, int *
         DEBUG_MSG("ERROR: Failed to write on serial port (written=%d)\n", (int) num_written);
     }
 
-    /* get timezone info */
-    tzset();
-
     /* initialize global variables */
     gps_time_ok = false;
     gps_pos_ok = false;
@@ -391,11 +1091,20 @@ int lgw_gps_disable(int fd) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 enum gps_msg lgw_parse_ubx(const char *serial_buff, size_t buff_size, size_t *msg_size) {
-    bool valid = 0;    /* iTOW, fTOW and week validity */
+    enum gps_msg x;
+
+    pthread_mutex_lock(&mx_gps);
+    x = gps_parse_ubx(serial_buff, buff_size, msg_size);
+    pthread_mutex_unlock(&mx_gps);
+    return x;
+}
+
+static enum gps_msg gps_parse_ubx(const char *serial_buff, size_t buff_size, size_t *msg_size) {
     unsigned int payload_length;
     uint8_t ck_a, ck_b;
     uint8_t ck_a_rcv, ck_b_rcv;
     unsigned int i;
+    struct frame_s frame;
 
     *msg_size = 0; /* ensure msg_size alway receives a value */
 
@@ -437,56 +1146,10 @@ enum gps_msg lgw_parse_ubx(const char *serial_buff, size_t buff_size, size_t *ms
 
             /* Compare checksums and parse if OK */
             if ((ck_a == ck_a_rcv) && (ck_b == ck_b_rcv)) {
-                /* Check for Class 0x01 (NAV) and ID 0x20 (NAV-TIMEGPS) */
-                if ((serial_buff[2] == 0x01) && (serial_buff[3] == 0x20)) {
-                    /* Check validity of information */
-                    valid = serial_buff[17] & 0x3; /* towValid, weekValid */
-                    if (valid) {
-                        /* Parse buffer to extract GPS time */
-                        /* Warning: payload byte ordering is Little Endian */
-                        gps_iTOW =  (uint8_t)serial_buff[6];
-                        gps_iTOW |= (uint8_t)serial_buff[7] << 8;
-                        gps_iTOW |= (uint8_t)serial_buff[8] << 16;
-                        gps_iTOW |= (uint8_t)serial_buff[9] << 24; /* GPS time of week, in ms */
-
-                        gps_fTOW =  (uint8_t)serial_buff[10];
-                        gps_fTOW |= (uint8_t)serial_buff[11] << 8;
-                        gps_fTOW |= (uint8_t)serial_buff[12] << 16;
-                        gps_fTOW |= (uint8_t)serial_buff[13] << 24; /* Fractional part of iTOW, in ns */
-
-                        gps_week =  (uint8_t)serial_buff[14];
-                        gps_week |= (uint8_t)serial_buff[15] << 8; /* GPS week number */
-
-                        gps_time_ok = true;
-#if 0
-                        /* For debug */
-                        {
-                            short ubx_gps_hou = 0; /* hours (0-23) */
-                            short ubx_gps_min = 0; /* minutes (0-59) */
-                            short ubx_gps_sec = 0; /* seconds (0-59) */
-
-                            /* Format GPS time in hh:mm:ss based on iTOW */
-                            ubx_gps_sec = (gps_iTOW / 1000) % 60;
-                            ubx_gps_min = (gps_iTOW / 1000 / 60) % 60;
-                            ubx_gps_hou = (gps_iTOW / 1000 / 60 / 60) % 24;
-                            printf("  GPS time = %02d:%02d:%02d\n", ubx_gps_hou, ubx_gps_min, ubx_gps_sec);
-                        }
-#endif
-                    } else { /* valid */
-                        gps_time_ok = false;
-                    }
-
-                    return UBX_NAV_TIMEGPS;
-                } else if ((serial_buff[2] == 0x05) && (serial_buff[3] == 0x00)) {
-                    DEBUG_MSG("NOTE: UBX ACK-NAK received\n");
-                    return IGNORED;
-                } else if ((serial_buff[2] == 0x05) && (serial_buff[3] == 0x01)) {
-                    DEBUG_MSG("NOTE: UBX ACK-ACK received\n");
-                    return IGNORED;
-                } else { /* not a supported message */
-                    DEBUG_MSG("ERROR: UBX message is not supported (%02x %02x)\n", serial_buff[2], serial_buff[3]);
-                    return IGNORED;
-                }
+                frame.buf = (const uint8_t *)serial_buff;
+                frame.mask = 0xFFFFFFFF;
+                frame.start = 0;
+                return ubx_decode(&frame);
             } else { /* checksum failed */
                 DEBUG_MSG("ERROR: UBX message is corrupted, checksum failed\n");
                 return INVALID;
@@ -504,17 +1167,25 @@ enum gps_msg lgw_parse_ubx(const char *serial_buff, size_t buff_size, size_t *ms
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 enum gps_msg lgw_parse_nmea(const char *serial_buff, int buff_size) {
-    int i, j, k;
-    int str_index[30]; /* string index from the string chopping */
-    int nb_fields; /* number of strings detected by string chopping */
-    char parser_buf[256]; /* parsing modifies buffer so need a local copy */
+    enum gps_msg x;
+
+    pthread_mutex_lock(&mx_gps);
+    x = gps_parse_nmea(serial_buff, buff_size);
+    pthread_mutex_unlock(&mx_gps);
+    return x;
+}
+
+static enum gps_msg gps_parse_nmea(const char *serial_buff, int buff_size) {
+    int i;
+    uint16_t field[LGW_GPS_NMEA_FIELD_MAX]; /* offset of the fields in the sentence */
+    struct frame_s frame;
 
     /* check input parameters */
     if (serial_buff == NULL) {
         return UNKNOWN;
     }
 
-    if(buff_size > (int)(sizeof(parser_buf) - 1)) {
+    if(buff_size > (LGW_GPS_NMEA_MAX_SIZE - 1)) {
         DEBUG_MSG("Note: input string to big for parsing\n");
         return INVALID;
     }
@@ -526,119 +1197,280 @@ enum gps_msg lgw_parse_nmea(const char *serial_buff, int buff_size) {
     } else if (!validate_nmea_checksum(serial_buff, buff_size)) {
         DEBUG_MSG("Warning: invalid NMEA sentence (bad checksum)\n");
         return INVALID;
-    } else if (match_label(serial_buff, "$G?RMC", 6, '?')) {
-        /*
-        NMEA sentence format: $xxRMC,time,status,lat,NS,long,EW,spd,cog,date,mv,mvEW,posMode*cs<CR><LF>
-        Valid fix: $GPRMC,083559.34,A,4717.11437,N,00833.91522,E,0.004,77.52,091202,,,A*00
-        No fix: $GPRMC,,V,,,,,,,,,,N*00
-        */
-        memcpy(parser_buf, serial_buff, buff_size);
-        parser_buf[buff_size] = '\0';
-        nb_fields = str_chop(parser_buf, buff_size, ',', str_index, ARRAY_SIZE(str_index));
-        if (nb_fields != 13) {
-            DEBUG_MSG("Warning: invalid RMC sentence (number of fields)\n");
-            return IGNORED;
-        }
-        /* parse GPS status */
-        gps_mod = *(parser_buf + str_index[12]); /* get first character, no need to bother with sscanf */
-        if ((gps_mod != 'N') && (gps_mod != 'A') && (gps_mod != 'D')) {
-            gps_mod = 'N';
-        }
-        /* parse complete time */
-        i = sscanf(parser_buf + str_index[1], "%2hd%2hd%2hd%4f", &gps_hou, &gps_min, &gps_sec, &gps_fra);
-        j = sscanf(parser_buf + str_index[9], "%2hd%2hd%2hd", &gps_day, &gps_mon, &gps_yea);
-        if ((i == 4) && (j == 3)) {
-            if ((gps_mod == 'A') || (gps_mod == 'D')) {
-                gps_time_ok = true;
-                DEBUG_MSG("Note: Valid RMC sentence, GPS locked, date: 20%02d-%02d-%02dT%02d:%02d:%06.3fZ\n", gps_yea, gps_mon, gps_day, gps_hou, gps_min, gps_fra + (float)gps_sec);
-            } else {
-                gps_time_ok = false;
-                DEBUG_MSG("Note: Valid RMC sentence, no satellite fix, estimated date: 20%02d-%02d-%02dT%02d:%02d:%06.3fZ\n", gps_yea, gps_mon, gps_day, gps_hou, gps_min, gps_fra + (float)gps_sec);
-            }
-        } else {
-            /* could not get a valid hour AND date */
-            gps_time_ok = false;
-            DEBUG_MSG("Note: Valid RMC sentence, mode %c, no date\n", gps_mod);
+    }
+
+    /* index the fields up to the checksum, the sentence is parsed in place */
+    frame.buf = (const uint8_t *)serial_buff;
+    frame.mask = 0xFFFFFFFF;
+    frame.start = 0;
+    frame.field = field;
+    field[0] = 0;
+    frame.nb_field = 1;
+    for (i = 0; (i < buff_size) && (serial_buff[i] != '*'); ++i) {
+        if ((serial_buff[i] == ',') && (frame.nb_field < LGW_GPS_NMEA_FIELD_MAX)) {
+            field[frame.nb_field++] = i + 1;
         }
-        return NMEA_RMC;
-    } else if (match_label(serial_buff, "$G?GGA", 6, '?')) {
-        /*
-        NMEA sentence format: $xxGGA,time,lat,NS,long,EW,quality,numSV,HDOP,alt,M,sep,M,diffAge,diffStation*cs<CR><LF>
-        Valid fix: $GPGGA,092725.00,4717.11399,N,00833.91590,E,1,08,1.01,499.6,M,48.0,M,,*5B
-        */
-        memcpy(parser_buf, serial_buff, buff_size);
-        parser_buf[buff_size] = '\0';
-        nb_fields = str_chop(parser_buf, buff_size, ',', str_index, ARRAY_SIZE(str_index));
-        if (nb_fields != 15) {
-            DEBUG_MSG("Warning: invalid GGA sentence (number of fields)\n");
-            return IGNORED;
+    }
+    frame.field_end = i;
+    return nmea_decode(&frame);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_gps_stream_init(struct lgw_gps_stream_s *s) {
+    CHECK_NULL(s);
+
+    memset(s, 0, sizeof *s);
+    s->state = ST_SYNC;
+    return LGW_GPS_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+ssize_t lgw_gps_stream_read(struct lgw_gps_stream_s *s, int fd) {
+    struct iovec iov[2];
+    uint32_t size; /* free space in the ring */
+    uint32_t wr;
+    ssize_t n;
+
+    if (s == NULL) {
+        return -1;
+    }
+
+    /* the bytes of the frame being received are kept, to resynchronize on them if it is invalid */
+    size = LGW_GPS_STREAM_SIZE - (s->wr - s->start);
+    if (size == 0) {
+        return 0;
+    }
+
+    /* read directly in the ring, in two parts if the free space wraps */
+    wr = s->wr & STREAM_MASK;
+    iov[0].iov_base = &s->buf[wr];
+    if (wr + size <= LGW_GPS_STREAM_SIZE) {
+        iov[0].iov_len = size;
+        n = readv(fd, iov, 1);
+    } else {
+        iov[0].iov_len = LGW_GPS_STREAM_SIZE - wr;
+        iov[1].iov_base = &s->buf[0];
+        iov[1].iov_len = size - iov[0].iov_len;
+        n = readv(fd, iov, 2);
+    }
+    if (n > 0) {
+        s->wr += (uint32_t)n;
+    }
+    return n;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+size_t lgw_gps_stream_write(struct lgw_gps_stream_s *s, const void *data, size_t size) {
+    uint32_t wr, n;
+
+    if ((s == NULL) || (data == NULL)) {
+        return 0;
+    }
+
+    if (size > LGW_GPS_STREAM_SIZE - (s->wr - s->start)) {
+        size = LGW_GPS_STREAM_SIZE - (s->wr - s->start);
+    }
+    wr = s->wr & STREAM_MASK;
+    n = LGW_GPS_STREAM_SIZE - wr; /* up to the end of the ring */
+    if (size <= n) {
+        memcpy(&s->buf[wr], data, size);
+    } else {
+        memcpy(&s->buf[wr], data, n);
+        memcpy(&s->buf[0], (const uint8_t *)data + n, size - n);
+    }
+    s->wr += (uint32_t)size;
+    return size;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+enum gps_msg lgw_gps_stream_next(struct lgw_gps_stream_s *s) {
+    uint8_t c;
+    struct frame_s frame;
+    enum gps_msg x;
+
+    if (s == NULL) {
+        return UNKNOWN;
+    }
+
+    /* each byte goes once through the state machine, unless it follows the sync char of a dropped frame */
+    while (s->rd != s->wr) {
+        c = s->buf[s->rd & STREAM_MASK];
+        ++(s->rd);
+
+        switch (s->state) {
+            case ST_SYNC:
+                s->start = s->rd - 1;
+                s->keep = true;
+                if (c == LGW_GPS_UBX_SYNC_CHAR) {
+                    s->state = ST_UBX_SYNC2;
+                } else if (c == LGW_GPS_NMEA_SYNC_CHAR) {
+                    s->ck_x = 0;
+                    s->nb_field = 1;
+                    s->field[0] = 0;
+                    s->state = ST_NMEA_FIELDS;
+                } else {
+                    s->start = s->rd;
+                    ++(s->nb_skipped);
+                }
+                break;
+
+            case ST_UBX_SYNC2:
+                if (c == 0x62) {
+                    s->cnt = 0;
+                    s->ck_a = 0;
+                    s->ck_b = 0;
+                    s->state = ST_UBX_HEADER;
+                } else {
+                    ++(s->nb_skipped);
+                    stream_resync(s);
+                }
+                break;
+
+            case ST_UBX_HEADER:
+                s->ck_a += c;
+                s->ck_b += s->ck_a;
+                if (++(s->cnt) < 4) {
+                    break;
+                }
+                s->len = s->buf[(s->start + 4) & STREAM_MASK] | (c << 8);
+                if (s->len > LGW_GPS_UBX_MAX_PAYLOAD) {
+                    DEBUG_MSG("WARNING: UBX frame dropped, payload length %u\n", s->len);
+                    ++(s->nb_invalid);
+                    stream_resync(s);
+                    return INVALID;
+                }
+                /* only the short frames are decoded, the others are released as they are checked */
+                s->keep = (s->len <= UBX_KEEP_PAYLOAD);
+                s->cnt = 0;
+                s->state = (s->len > 0) ? ST_UBX_PAYLOAD : ST_UBX_CK_A;
+                break;
+
+            case ST_UBX_PAYLOAD:
+                s->ck_a += c;
+                s->ck_b += s->ck_a;
+                if (++(s->cnt) == s->len) {
+                    s->state = ST_UBX_CK_A;
+                }
+                break;
+
+            case ST_UBX_CK_A:
+                if (c == s->ck_a) {
+                    s->state = ST_UBX_CK_B;
+                    break;
+                }
+                /* fall through */
+            case ST_UBX_CK_B:
+                if ((s->state == ST_UBX_CK_A) || (c != s->ck_b)) {
+                    DEBUG_MSG("ERROR: UBX message is corrupted, checksum failed\n");
+                    ++(s->nb_invalid);
+                    stream_resync(s);
+                    return INVALID;
+                }
+                ++(s->nb_frame);
+                x = IGNORED;
+                if (s->keep) {
+                    frame.buf = s->buf;
+                    frame.mask = STREAM_MASK;
+                    frame.start = s->start;
+                    pthread_mutex_lock(&mx_gps);
+                    x = ubx_decode(&frame);
+                    pthread_mutex_unlock(&mx_gps);
+                }
+                s->start = s->rd;
+                s->state = ST_SYNC;
+                return x;
+
+            case ST_NMEA_FIELDS:
+                if (c == '*') {
+                    s->field_end = s->rd - 1 - s->start;
+                    s->state = ST_NMEA_CK_1;
+                } else if ((c < 0x20) || (c > 0x7E) || (c == LGW_GPS_NMEA_SYNC_CHAR) || (s->rd - s->start > LGW_GPS_NMEA_MAX_SIZE)) {
+                    DEBUG_MSG("Warning: invalid NMEA sentence (character 0x%02x at %u)\n", c, s->rd - 1 - s->start);
+                    ++(s->nb_invalid);
+                    stream_resync(s);
+                    return INVALID;
+                } else {
+                    s->ck_x ^= c;
+                    if ((c == ',') && (s->nb_field < LGW_GPS_NMEA_FIELD_MAX)) {
+                        s->field[s->nb_field++] = s->rd - s->start;
+                    }
+                }
+                break;
+
+            case ST_NMEA_CK_1:
+            case ST_NMEA_CK_2:
+                if (c != (uint8_t)nibble_to_hexchar((s->state == ST_NMEA_CK_1) ? (s->ck_x >> 4) : (s->ck_x & 0x0F))) {
+                    DEBUG_MSG("Warning: invalid NMEA sentence (bad checksum)\n");
+                    ++(s->nb_invalid);
+                    stream_resync(s);
+                    return INVALID;
+                }
+                ++(s->state);
+                break;
+
+            case ST_NMEA_END:
+                if (c == '\r') {
+                    break;
+                } else if (c != '\n') {
+                    ++(s->nb_invalid);
+                    stream_resync(s);
+                    return INVALID;
+                }
+                ++(s->nb_frame);
+                frame.buf = s->buf;
+                frame.mask = STREAM_MASK;
+                frame.start = s->start;
+                frame.field = s->field;
+                frame.nb_field = s->nb_field;
+                frame.field_end = s->field_end;
+                pthread_mutex_lock(&mx_gps);
+                x = nmea_decode(&frame);
+                pthread_mutex_unlock(&mx_gps);
+                s->start = s->rd;
+                s->state = ST_SYNC;
+                return x;
+
+            default:
+                stream_resync(s);
         }
-        /* parse number of satellites used for fix */
-        sscanf(parser_buf + str_index[7], "%hd", &gps_sat);
-        /* parse 3D coordinates */
-        i = sscanf(parser_buf + str_index[2], "%2hd%10lf", &gps_dla, &gps_mla);
-        gps_ola = *(parser_buf + str_index[3]);
-        j = sscanf(parser_buf + str_index[4], "%3hd%10lf", &gps_dlo, &gps_mlo);
-        gps_olo = *(parser_buf + str_index[5]);
-        k = sscanf(parser_buf + str_index[9], "%hd", &gps_alt);
-        if ((i == 2) && (j == 2) && (k == 1) && ((gps_ola=='N')||(gps_ola=='S')) && ((gps_olo=='E')||(gps_olo=='W'))) {
-            gps_pos_ok = true;
-            DEBUG_MSG("Note: Valid GGA sentence, %d sat, lat %02ddeg %06.3fmin %c, lon %03ddeg%06.3fmin %c, alt %d\n", gps_sat, gps_dla, gps_mla, gps_ola, gps_dlo, gps_mlo, gps_olo, gps_alt);
-        } else {
-            /* could not get a valid latitude, longitude AND altitude */
-            gps_pos_ok = false;
-            DEBUG_MSG("Note: Valid GGA sentence, %d sat, no coordinates\n", gps_sat);
+
+        /* bytes of a frame that is not kept are released as soon as they are checked */
+        if (!s->keep) {
+            s->start = s->rd;
         }
-        return NMEA_GGA;
-    } else {
-        DEBUG_MSG("Note: ignored NMEA sentence\n"); /* quite verbose */
-        return IGNORED;
     }
+
+    return UNKNOWN;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_gps_get(struct timespec *utc, struct timespec *gps_time, struct coord_s *loc, struct coord_s *err) {
-    struct tm x;
-    time_t y;
-    double intpart, fractpart;
+    int x;
 
-    if (utc != NULL) {
+    pthread_mutex_lock(&mx_gps);
+    x = gps_get(utc, gps_time, loc, err);
+    pthread_mutex_unlock(&mx_gps);
+    return x;
+}
+
+static int gps_get(struct timespec *utc, struct timespec *gps_time, struct coord_s *loc, struct coord_s *err) {
+    if ((utc != NULL) || (gps_time != NULL)) {
         if (!gps_time_ok) {
             DEBUG_MSG("ERROR: NO VALID TIME TO RETURN\n");
             return LGW_GPS_ERROR;
         }
-        memset(&x, 0, sizeof(x));
-        if (gps_yea < 100) { /* 2-digits year, 20xx */
-            x.tm_year = gps_yea + 100; /* 100 years offset to 1900 */
-        } else { /* 4-digits year, Gregorian calendar */
-            x.tm_year = gps_yea - 1900;
-        }
-        x.tm_mon = gps_mon - 1; /* tm_mon is [0,11], gps_mon is [1,12] */
-        x.tm_mday = gps_day;
-        x.tm_hour = gps_hou;
-        x.tm_min = gps_min;
-        x.tm_sec = gps_sec;
-        y = mktime(&x) - timezone; /* need to substract timezone bc mktime assumes time vector is local time */
-        if (y == (time_t)(-1)) {
-            DEBUG_MSG("ERROR: FAILED TO CONVERT BROKEN-DOWN TIME\n");
-            return LGW_GPS_ERROR;
-        }
-        utc->tv_sec = y;
-        utc->tv_nsec = (int32_t)(gps_fra * 1e9);
+    }
+    /* both times come from the GPS time of the last epoch, UTC being behind by the GPS-UTC offset */
+    if (utc != NULL) {
+        ns_to_timespec(gps_ns + ((int64_t)(GPS_EPOCH_UNIX - gps_leap) * 1000000000), utc);
     }
     if (gps_time != NULL) {
-        if (!gps_time_ok) {
-            DEBUG_MSG("ERROR: NO VALID TIME TO RETURN\n");
-            return LGW_GPS_ERROR;
-        }
-        fractpart = modf(((double)gps_iTOW / 1E3) + ((double)gps_fTOW / 1E9), &intpart);
-        /* Number of seconds since beginning on current GPS week */
-        gps_time->tv_sec = (time_t)intpart;
-        /* Number of seconds since GPS epoch 06.Jan.1980 */
-        gps_time->tv_sec += (time_t)gps_week * 604800; /* day*hours*minutes*secondes: 7*24*60*60; */
-        /* Fractional part in nanoseconds */
-        gps_time->tv_nsec = (long)(fractpart * 1E9);
+        ns_to_timespec(gps_ns, gps_time);
     }
     if (loc != NULL) {
         if (!gps_pos_ok) {
@@ -661,101 +1493,90 @@ int lgw_gps_get(struct timespec *utc, struct timespec *gps_time, struct coord_s
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int lgw_gps_sync(struct tref *ref, uint32_t count_us, struct timespec utc, struct timespec gps_time) {
-    double cnt_diff; /* internal concentrator time difference (in seconds) */
-    double utc_diff; /* UTC time difference (in seconds) */
-    double slope; /* time slope between new reference and old reference (for sanity check) */
+int lgw_date2utc(int year, int mon, int day, int hou, int min, int sec, time_t *utc) {
+    static const uint8_t days_in_month[12] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    int64_t t;
 
-    bool aber_n0; /* is the update value for synchronization aberrant or not ? */
-    static bool aber_min1 = false; /* keep track of whether value at sync N-1 was aberrant or not  */
-    static bool aber_min2 = false; /* keep track of whether value at sync N-2 was aberrant or not  */
+    CHECK_NULL(utc);
 
-    CHECK_NULL(ref);
+    if ((year >= 0) && (year < 100)) { /* 2-digits year, 20xx */
+        year += 2000;
+    }
+    if ((mon < 1) || (mon > 12) || (day < 1) || (day > days_in_month[mon - 1]) || (hou < 0) || (hou > 23) || (min < 0) || (min > 59) || (sec < 0) || (sec > 60)) {
+        DEBUG_MSG("ERROR: INVALID DATE %d-%02d-%02dT%02d:%02d:%02d\n", year, mon, day, hou, min, sec);
+        return LGW_GPS_ERROR;
+    }
+    if ((mon == 2) && (day == 29) && (((year % 4) != 0) || (((year % 100) == 0) && ((year % 400) != 0)))) {
+        DEBUG_MSG("ERROR: INVALID DATE %d-02-29, NOT A LEAP YEAR\n", year);
+        return LGW_GPS_ERROR;
+    }
+    if ((year < -5000000) || (year > 5000000)) {
+        DEBUG_MSG("ERROR: YEAR %d OUT OF RANGE\n", year);
+        return LGW_GPS_ERROR;
+    }
 
-    /* calculate the slope */
+    /* a leap second (sec 60) is the first second of the next minute, as for POSIX time */
+    t = ((int64_t)days_from_civil(year, (uint32_t)mon, (uint32_t)day) * 86400) + (hou * 3600) + (min * 60) + sec;
+    if ((int64_t)(time_t)t != t) {
+        DEBUG_MSG("ERROR: DATE OUT OF THE RANGE OF TIME_T\n");
+        return LGW_GPS_ERROR;
+    }
+    *utc = (time_t)t;
 
-    cnt_diff = (double)(count_us - ref->count_us) / (double)(TS_CPS); /* uncorrected by xtal_err */
-    utc_diff = (double)(utc.tv_sec - (ref->utc).tv_sec) + (1E-9 * (double)(utc.tv_nsec - (ref->utc).tv_nsec));
+    return LGW_GPS_SUCCESS;
+}
 
-    /* detect aberrant points by measuring if slope limits are exceeded */
-    if (utc_diff != 0) { // prevent divide by zero
-        slope = cnt_diff/utc_diff;
-        if ((slope > PLUS_10PPM) || (slope < MINUS_10PPM)) {
-            DEBUG_MSG("Warning: correction range exceeded\n");
-            aber_n0 = true;
-        } else {
-            aber_n0 = false;
-        }
-    } else {
-        DEBUG_MSG("Warning: aberrant UTC value for synchronization\n");
-        aber_n0 = true;
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_gps_sync(struct tref *ref, uint32_t count_us, struct timespec utc, struct timespec gps_time) {
+    int ret;
+
+    CHECK_NULL(ref);
+
+    switch (ref->drift.conf.filter) {
+        case LGW_DRIFT_KALMAN:
+        case LGW_DRIFT_PLL:
+            ret = sync_filter(ref, count_us, &utc, &gps_time);
+            break;
+        default:
+            ret = sync_slope(ref, count_us, &utc, &gps_time);
     }
 
-    /* watch if the 3 latest sync point were aberrant or not */
-    if (aber_n0 == false) {
-        /* value no aberrant -> sync with smoothed slope */
-        ref->systime = time(NULL);
-        ref->count_us = count_us;
-        ref->utc.tv_sec = utc.tv_sec;
-        ref->utc.tv_nsec = utc.tv_nsec;
-        ref->gps.tv_sec = gps_time.tv_sec;
-        ref->gps.tv_nsec = gps_time.tv_nsec;
-        ref->xtal_err = slope;
-        aber_min2 = aber_min1;
-        aber_min1 = aber_n0;
-        return LGW_GPS_SUCCESS;
-    } else if (aber_n0 && aber_min1 && aber_min2) {
-        /* 3 successive aberrant values -> sync reset (keep xtal_err) */
-        ref->systime = time(NULL);
-        ref->count_us = count_us;
-        ref->utc.tv_sec = utc.tv_sec;
-        ref->utc.tv_nsec = utc.tv_nsec;
-        ref->gps.tv_sec = gps_time.tv_sec;
-        ref->gps.tv_nsec = gps_time.tv_nsec;
-        /* reset xtal_err only if the present value is out of range */
-        if ((ref->xtal_err > PLUS_10PPM) || (ref->xtal_err < MINUS_10PPM)) {
-            ref->xtal_err = 1.0;
-        }
-        DEBUG_MSG("Warning: 3 successive aberrant sync attempts, sync reset\n");
-        aber_min2 = aber_min1;
-        aber_min1 = aber_n0;
-        return LGW_GPS_SUCCESS;
-    } else {
-        /* only 1 or 2 successive aberrant values -> ignore and return an error */
-        aber_min2 = aber_min1;
-        aber_min1 = aber_n0;
+    /* the conversions with that reference then run without floating point */
+    ratio_cache(ref);
+    return ret;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_gps_sync_setconf(struct tref *ref, const struct lgw_conf_drift_s *conf) {
+    CHECK_NULL(ref);
+    CHECK_NULL(conf);
+    if ((conf->filter != LGW_DRIFT_SLOPE) && (conf->filter != LGW_DRIFT_KALMAN) && (conf->filter != LGW_DRIFT_PLL)) {
+        DEBUG_MSG("ERROR: UNKNOWN CLOCK ERROR ESTIMATOR\n");
+        return LGW_GPS_ERROR;
+    }
+    if ((conf->meas_std_us < 0.0) || (conf->wander_ppm < 0.0) || (conf->bw_hz < 0.0)) {
+        DEBUG_MSG("ERROR: INVALID CLOCK ERROR ESTIMATOR PARAMETERS\n");
         return LGW_GPS_ERROR;
     }
 
+    memset(&ref->drift, 0, sizeof ref->drift);
+    ref->drift.conf = *conf;
+    ref->systime = 0;
     return LGW_GPS_SUCCESS;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_cnt2utc(struct tref ref, uint32_t count_us, struct timespec *utc) {
-    double delta_sec;
-    double intpart, fractpart;
-    long tmp;
-
     CHECK_NULL(utc);
-    if ((ref.systime == 0) || (ref.xtal_err > PLUS_10PPM) || (ref.xtal_err < MINUS_10PPM)) {
+    if (!tref_valid(&ref)) {
         DEBUG_MSG("ERROR: INVALID REFERENCE FOR CNT -> UTC CONVERSION\n");
         return LGW_GPS_ERROR;
     }
 
-    /* calculate delta in seconds between reference count_us and target count_us */
-    delta_sec = (double)(count_us - ref.count_us) / (TS_CPS * ref.xtal_err);
-
-    /* now add that delta to reference UTC time */
-    fractpart = modf (delta_sec , &intpart);
-    tmp = ref.utc.tv_nsec + (long)(fractpart * 1E9);
-    if (tmp < (long)1E9) { /* the nanosecond part doesn't overflow */
-        utc->tv_sec = ref.utc.tv_sec + (time_t)intpart;
-        utc->tv_nsec = tmp;
-    } else { /* must carry one second */
-        utc->tv_sec = ref.utc.tv_sec + (time_t)intpart + 1;
-        utc->tv_nsec = tmp - (long)1E9;
-    }
+    cnt2time(&ref, &ref.utc, ratio_cnt2ns(&ref), count_us, utc);
 
     return LGW_GPS_SUCCESS;
 }
@@ -763,20 +1584,13 @@ int lgw_cnt2utc(struct tref ref, uint32_t count_us, struct timespec *utc) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_utc2cnt(struct tref ref, struct timespec utc, uint32_t *count_us) {
-    double delta_sec;
-
     CHECK_NULL(count_us);
-    if ((ref.systime == 0) || (ref.xtal_err > PLUS_10PPM) || (ref.xtal_err < MINUS_10PPM)) {
+    if (!tref_valid(&ref)) {
         DEBUG_MSG("ERROR: INVALID REFERENCE FOR UTC -> CNT CONVERSION\n");
         return LGW_GPS_ERROR;
     }
 
-    /* calculate delta in seconds between reference utc and target utc */
-    delta_sec = (double)(utc.tv_sec - ref.utc.tv_sec);
-    delta_sec += 1E-9 * (double)(utc.tv_nsec - ref.utc.tv_nsec);
-
-    /* now convert that to internal counter tics and add that to reference counter value */
-    *count_us = ref.count_us + (uint32_t)(delta_sec * TS_CPS * ref.xtal_err);
+    *count_us = time2cnt(&ref, &ref.utc, ratio_ns2cnt(&ref), &utc);
 
     return LGW_GPS_SUCCESS;
 }
@@ -784,50 +1598,156 @@ int lgw_utc2cnt(struct tref ref, struct timespec utc, uint32_t *count_us) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_cnt2gps(struct tref ref, uint32_t count_us, struct timespec *gps_time) {
-    double delta_sec;
-    double intpart, fractpart;
-    long tmp;
-
     CHECK_NULL(gps_time);
-    if ((ref.systime == 0) || (ref.xtal_err > PLUS_10PPM) || (ref.xtal_err < MINUS_10PPM)) {
+    if (!tref_valid(&ref)) {
         DEBUG_MSG("ERROR: INVALID REFERENCE FOR CNT -> GPS CONVERSION\n");
         return LGW_GPS_ERROR;
     }
 
-    /* calculate delta in milliseconds between reference count_us and target count_us */
-    delta_sec = (double)(count_us - ref.count_us) / (TS_CPS * ref.xtal_err);
+    cnt2time(&ref, &ref.gps, ratio_cnt2ns(&ref), count_us, gps_time);
+
+    return LGW_GPS_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-    /* now add that delta to reference GPS time */
-    fractpart = modf (delta_sec , &intpart);
-    tmp = ref.gps.tv_nsec + (long)(fractpart * 1E9);
-    if (tmp < (long)1E9) { /* the nanosecond part doesn't overflow */
-        gps_time->tv_sec = ref.gps.tv_sec + (time_t)intpart;
-        gps_time->tv_nsec = tmp;
-    } else { /* must carry one second */
-        gps_time->tv_sec = ref.gps.tv_sec + (time_t)intpart + 1;
-        gps_time->tv_nsec = tmp - (long)1E9;
+int lgw_gps2cnt(struct tref ref, struct timespec gps_time, uint32_t *count_us) {
+    CHECK_NULL(count_us);
+    if (!tref_valid(&ref)) {
+        DEBUG_MSG("ERROR: INVALID REFERENCE FOR GPS -> CNT CONVERSION\n");
+        return LGW_GPS_ERROR;
     }
 
+    *count_us = time2cnt(&ref, &ref.gps, ratio_ns2cnt(&ref), &gps_time);
+
     return LGW_GPS_SUCCESS;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int lgw_gps2cnt(struct tref ref, struct timespec gps_time, uint32_t *count_us) {
-    double delta_sec;
+int lgw_tref_init(struct lgw_tref_pub_s *pub) {
+    CHECK_NULL(pub);
+
+    memset(pub, 0, sizeof *pub);
+    return LGW_GPS_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_tref_sync(struct lgw_tref_pub_s *pub, uint32_t count_us, struct timespec utc, struct timespec gps_time) {
+    struct tref ref;
+    int i;
+
+    CHECK_NULL(pub);
+
+    /* only the writer modifies the published reference, it can read it without precaution */
+    ref = pub->ref;
+    i = lgw_gps_sync(&ref, count_us, utc, gps_time);
+    lgw_tref_set(pub, &ref); /* the estimator state changes even when the point is rejected */
+    return i;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_tref_setconf(struct lgw_tref_pub_s *pub, const struct lgw_conf_drift_s *conf) {
+    struct tref ref;
+
+    CHECK_NULL(pub);
+
+    ref = pub->ref;
+    if (lgw_gps_sync_setconf(&ref, conf) != LGW_GPS_SUCCESS) {
+        return LGW_GPS_ERROR;
+    }
+    return lgw_tref_set(pub, &ref);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_tref_set(struct lgw_tref_pub_s *pub, const struct tref *ref) {
+    uint64_t cnt2ns = 0, ns2cnt = 0; /* null ratios mark an invalid reference */
+    uint32_t seq;
+
+    CHECK_NULL(pub);
+    CHECK_NULL(ref);
+
+    /* the ratios are computed once here, the readers convert without floating point */
+    if (tref_valid(ref)) {
+        cnt2ns = ratio_cnt2ns(ref);
+        ns2cnt = ratio_ns2cnt(ref);
+    }
+
+    /* odd sequence while the reference is modified, readers copying it meanwhile retry */
+    seq = __atomic_load_n(&pub->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&pub->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    pub->ref = *ref;
+    pub->ref.cnt2ns = cnt2ns; /* lgw_tref_get then returns a reference with its ratios */
+    pub->ref.ns2cnt = ns2cnt;
+    pub->ref.xtal_err_cached = ref->xtal_err;
+    pub->cnt2ns = cnt2ns;
+    pub->ns2cnt = ns2cnt;
+    __atomic_store_n(&pub->seq, seq + 2, __ATOMIC_RELEASE);
+
+    return LGW_GPS_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_tref_get(const struct lgw_tref_pub_s *pub, struct tref *ref) {
+    uint64_t cnt2ns, ns2cnt;
+
+    CHECK_NULL(pub);
+    CHECK_NULL(ref);
+
+    tref_read(pub, ref, &cnt2ns, &ns2cnt);
+
+    return LGW_GPS_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_tref_cnt2utc(const struct lgw_tref_pub_s *pub, const uint32_t *count_us, struct timespec *utc, int nb_val) {
+    struct tref ref;
+    uint64_t cnt2ns, ns2cnt;
+    int i;
+
+    CHECK_NULL(pub);
     CHECK_NULL(count_us);
-    if ((ref.systime == 0) || (ref.xtal_err > PLUS_10PPM) || (ref.xtal_err < MINUS_10PPM)) {
-        DEBUG_MSG("ERROR: INVALID REFERENCE FOR GPS -> CNT CONVERSION\n");
+    CHECK_NULL(utc);
+
+    tref_read(pub, &ref, &cnt2ns, &ns2cnt);
+    if (cnt2ns == 0) {
+        DEBUG_MSG("ERROR: INVALID REFERENCE FOR CNT -> UTC CONVERSION\n");
         return LGW_GPS_ERROR;
     }
 
-    /* calculate delta in seconds between reference gps time and target gps time */
-    delta_sec = (double)(gps_time.tv_sec - ref.gps.tv_sec);
-    delta_sec += 1E-9 * (double)(gps_time.tv_nsec - ref.gps.tv_nsec);
+    for (i = 0; i < nb_val; ++i) {
+        cnt2time(&ref, &ref.utc, cnt2ns, count_us[i], &utc[i]);
+    }
 
-    /* now convert that to internal counter tics and add that to reference counter value */
-    *count_us = ref.count_us + (uint32_t)(delta_sec * TS_CPS * ref.xtal_err);
+    return LGW_GPS_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_tref_cnt2gps(const struct lgw_tref_pub_s *pub, const uint32_t *count_us, struct timespec *gps_time, int nb_val) {
+    struct tref ref;
+    uint64_t cnt2ns, ns2cnt;
+    int i;
+
+    CHECK_NULL(pub);
+    CHECK_NULL(count_us);
+    CHECK_NULL(gps_time);
+
+    tref_read(pub, &ref, &cnt2ns, &ns2cnt);
+    if (cnt2ns == 0) {
+        DEBUG_MSG("ERROR: INVALID REFERENCE FOR CNT -> GPS CONVERSION\n");
+        return LGW_GPS_ERROR;
+    }
+
+    for (i = 0; i < nb_val; ++i) {
+        cnt2time(&ref, &ref.gps, cnt2ns, count_us[i], &gps_time[i]);
+    }
 
     return LGW_GPS_SUCCESS;
 }
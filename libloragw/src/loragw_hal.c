@@ -17,11 +17,15 @@ Maintainer: Sylvain Miermont
 /* -------------------------------------------------------------------------- */
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
+#define _GNU_SOURCE     /* needed for PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP to be defined */
+
 #include <stdint.h>     /* C99 types */
 #include <stdbool.h>    /* bool type */
 #include <stdio.h>      /* printf fprintf */
+#include <stdlib.h>     /* malloc free */
 #include <string.h>     /* memcpy */
-#include <math.h>       /* pow, cell */
+#include <pthread.h>
+#include <time.h>       /* clock_gettime */
 
 #include "loragw_reg.h"
 #include "loragw_hal.h"
@@ -30,6 +34,10 @@ Maintainer: Sylvain Miermont
 #include "loragw_radio.h"
 #include "loragw_fpga.h"
 #include "loragw_lbt.h"
+#include "loragw_rxcorr.h"
+#include "loragw_calcache.h"
+#include "loragw_ctx.h"
+#include "loragw_perf.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -62,22 +70,34 @@ Maintainer: Sylvain Miermont
 #define FW_VERSION_CAL      2 /* Expected version of calibration firmware */
 #define FW_VERSION_AGC      4 /* Expected version of AGC firmware */
 #define FW_VERSION_ARB      1 /* Expected version of arbiter firmware */
+#define FW_CHECK_CHUNK_BYTE 1024 /* firmware readback is done by chunks of that size */
+#define FW_CHECK_PREFIX_BYTE 512 /* size of the firmware readback in prefix mode */
 
 #define TX_METADATA_NB      16
+#define TX_REG_OFFSET_I     0 /* index of the TX registers in tx_reg_shadow */
+#define TX_REG_OFFSET_Q     1
+#define TX_REG_GAIN         2
+#define TX_REG_START_DELAY  3
+#define TX_REG_NB           4
+#define TX_REG_UNKNOWN      0x7FFFFFFF
 #define RX_METADATA_NB      16
 
 #define AGC_CMD_WAIT        16
 #define AGC_CMD_ABORT       17
 
+#define START_RADIO_XTAL_MS     500  /* radios XTAL start-up, worst case */
+#define START_CAL_TIME_MS       2300 /* measured between 2.1 and 2.2 sec, because 1 TX only */
+#define START_LBT_SCAN_MS       8400 /* LBT channels scan, no hardware ready condition */
+#define START_TIMEOUT_MS        3000 /* fast start: default maximum wait for each condition */
+#define START_CAL_POLL_MS       10   /* fast start: end of calibration polling interval */
+#define START_AGC_CMD_US        100  /* fast start: time for the AGC firmware to take AGC_CMD_WAIT into account */
+
 #define MIN_LORA_PREAMBLE   6
 #define STD_LORA_PREAMBLE   8
 #define MIN_FSK_PREAMBLE    3
 #define STD_FSK_PREAMBLE    5
 
 #define RSSI_MULTI_BIAS     -35 /* difference between "multi" modem RSSI offset and "stand-alone" modem RSSI offset */
-#define RSSI_FSK_POLY_0     60 /* polynomiam coefficients to linearize FSK RSSI */
-#define RSSI_FSK_POLY_1     1.5351
-#define RSSI_FSK_POLY_2     0.003
 
 /* Useful bandwidth of SX125x radios to consider depending on channel bandwidth */
 /* Note: the below values come from lab measurements. For any question, please contact Semtech support */
@@ -101,83 +121,203 @@ const char lgw_version_string[] = "Version: " LIBLORAGW_VERSION ";";
 #include "cal_fw.var" /* external definition of the variable */
 
 /*
-The following static variables are the configuration set that the user can
-modify using rxrf_setconf, rxif_setconf and txgain_setconf functions.
-The functions _start and _send then use that set to configure the hardware.
+The HAL state is kept per concentrator context (see loragw_ctx).
+It holds the configuration set that the user can modify using rxrf_setconf,
+rxif_setconf and txgain_setconf functions. The functions _start and _send then
+use that set to configure the hardware.
 
 Parameters validity and coherency is verified by the _setconf functions and
 the _start and _send functions assume they are valid.
 */
+struct lgw_hal_state_s {
+    /* serialize the RX and the TX paths separately: the register accesses are
+    made atomic by the register lock (see loragw_reg) and the two paths use
+    disjoint parts of this state and separate data ports of the SX1301, so a
+    downlink can be programmed between two packets of a RX FIFO drain */
+    pthread_mutex_t mx_rx;
+    pthread_mutex_t mx_tx;
+
+    bool is_started;
+
+    bool rf_enable[LGW_RF_CHAIN_NB];
+    uint32_t rf_rx_freq[LGW_RF_CHAIN_NB]; /* absolute, in Hz */
+    float rf_rssi_offset[LGW_RF_CHAIN_NB];
+    bool rf_tx_enable[LGW_RF_CHAIN_NB];
+    uint32_t rf_tx_notch_freq[LGW_RF_CHAIN_NB];
+    enum lgw_radio_type_e rf_radio_type[LGW_RF_CHAIN_NB];
+
+    bool if_enable[LGW_IF_CHAIN_NB];
+    bool if_rf_chain[LGW_IF_CHAIN_NB]; /* for each IF, 0 -> radio A, 1 -> radio B */
+    int32_t if_freq[LGW_IF_CHAIN_NB]; /* relative to radio frequency, +/- in Hz */
+
+    uint8_t lora_multi_sfmask[LGW_MULTI_NB]; /* enables SF for LoRa 'multi' modems */
+
+    uint8_t lora_rx_bw; /* bandwidth setting for LoRa standalone modem */
+    uint8_t lora_rx_sf; /* spreading factor setting for LoRa standalone modem */
+    bool lora_rx_ppm_offset;
+
+    uint8_t fsk_rx_bw; /* bandwidth setting of FSK modem */
+    uint32_t fsk_rx_dr; /* FSK modem datarate in bauds */
+    uint8_t fsk_sync_word_size; /* number of bytes for FSK sync word */
+    uint64_t fsk_sync_word; /* FSK sync word (ALIGNED RIGHT, MSbit first) */
+
+    bool lorawan_public;
+    uint8_t rf_clkout;
+
+    struct lgw_tx_gain_lut_s txgain_lut;
+
+    /* TX I/Q imbalance coefficients for mixer gain = 8 to 15 */
+    int8_t cal_offset_a_i[8]; /* TX I offset for radio A */
+    int8_t cal_offset_a_q[8]; /* TX Q offset for radio A */
+    int8_t cal_offset_b_i[8]; /* TX I offset for radio B */
+    int8_t cal_offset_b_q[8]; /* TX Q offset for radio B */
+
+    /* start procedure */
+    bool start_fast;
+    uint16_t start_timeout_ms;
+    struct lgw_start_timing_s start_timing;
+
+    /* calibration cache, disabled if the file path is empty */
+    char start_cal_file[256];
+    uint32_t start_cal_max_age_s;
+    bool start_cal_force;
+    int8_t start_cal_temp_band;
+
+    /* firmware load */
+    uint8_t start_fw_verify;
+    uint32_t mcu_fw_hash[2]; /* hash of the image last loaded and verified in each MCU, 0 if unknown */
+
+    /* TX preparation caches, cleared at each start */
+    uint32_t tx_pll_freq_hz; /* frequency of the cached PLL code, 0 if none */
+    uint8_t tx_pll_code[3];
+    uint16_t tx_start_delay_cache[2][8]; /* per notch filter state and bandwidth, 0 if not computed yet */
+    int32_t tx_reg_shadow[TX_REG_NB]; /* last value written in the TX registers, TX_REG_UNKNOWN if unknown */
+};
+
+#define HAL_STATE_INIT { \
+    .mx_rx = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP, \
+    .mx_tx = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP, \
+    .is_started = false, \
+    .fsk_sync_word_size = 3, /* default number of bytes for FSK sync word */ \
+    .fsk_sync_word = 0xC194C1, /* default FSK sync word */ \
+    .lorawan_public = false, \
+    .rf_clkout = 0, \
+    .txgain_lut = { \
+        .size = 2, \
+        .lut[0] = { .dig_gain = 0, .pa_gain = 2, .dac_gain = 3, .mix_gain = 10, .rf_power = 14 }, \
+        .lut[1] = { .dig_gain = 0, .pa_gain = 3, .dac_gain = 3, .mix_gain = 14, .rf_power = 27 } \
+    }, \
+    .start_fast = false, \
+    .start_timeout_ms = START_TIMEOUT_MS, \
+    .start_fw_verify = LGW_FW_VERIFY_FULL \
+}
+
+/* LoRa symbol duration in microseconds, per bandwidth (500 kHz down to 7.8 kHz) and SF (7 to 12) */
+static const uint32_t lora_symb_us[7][6] = {
+    {    256,    512,   1024,   2048,   4096,   8192 },
+    {    512,   1024,   2048,   4096,   8192,  16384 },
+    {   1024,   2048,   4096,   8192,  16384,  32768 },
+    {   2048,   4096,   8192,  16384,  32768,  65536 },
+    {   4096,   8192,  16384,  32768,  65536, 131072 },
+    {   8192,  16384,  32768,  65536, 131072, 262144 },
+    {  16384,  32768,  65536, 131072, 262144, 524288 }
+};
+
+/* RX IQ mismatch compensation, set by the calibration firmware */
+static const uint16_t cal_iq_reg[CALCACHE_IQ_NB] = {
+    LGW_IQ_MISMATCH_A_AMP_COEFF,
+    LGW_IQ_MISMATCH_A_PHI_COEFF,
+    LGW_IQ_MISMATCH_B_AMP_COEFF,
+    LGW_IQ_MISMATCH_B_SEL_I,
+    LGW_IQ_MISMATCH_B_PHI_COEFF
+};
 
-static bool lgw_is_started;
-
-static bool rf_enable[LGW_RF_CHAIN_NB];
-static uint32_t rf_rx_freq[LGW_RF_CHAIN_NB]; /* absolute, in Hz */
-static float rf_rssi_offset[LGW_RF_CHAIN_NB];
-static bool rf_tx_enable[LGW_RF_CHAIN_NB];
-static uint32_t rf_tx_notch_freq[LGW_RF_CHAIN_NB];
-static enum lgw_radio_type_e rf_radio_type[LGW_RF_CHAIN_NB];
-
-static bool if_enable[LGW_IF_CHAIN_NB];
-static bool if_rf_chain[LGW_IF_CHAIN_NB]; /* for each IF, 0 -> radio A, 1 -> radio B */
-static int32_t if_freq[LGW_IF_CHAIN_NB]; /* relative to radio frequency, +/- in Hz */
-
-static uint8_t lora_multi_sfmask[LGW_MULTI_NB]; /* enables SF for LoRa 'multi' modems */
-
-static uint8_t lora_rx_bw; /* bandwidth setting for LoRa standalone modem */
-static uint8_t lora_rx_sf; /* spreading factor setting for LoRa standalone modem */
-static bool lora_rx_ppm_offset;
-
-static uint8_t fsk_rx_bw; /* bandwidth setting of FSK modem */
-static uint32_t fsk_rx_dr; /* FSK modem datarate in bauds */
-static uint8_t fsk_sync_word_size = 3; /* default number of bytes for FSK sync word */
-static uint64_t fsk_sync_word= 0xC194C1; /* default FSK sync word (ALIGNED RIGHT, MSbit first) */
-
-static bool lorawan_public = false;
-static uint8_t rf_clkout = 0;
-
-static struct lgw_tx_gain_lut_s txgain_lut = {
-    .size = 2,
-    .lut[0] = {
-        .dig_gain = 0,
-        .pa_gain = 2,
-        .dac_gain = 3,
-        .mix_gain = 10,
-        .rf_power = 14
-    },
-    .lut[1] = {
-        .dig_gain = 0,
-        .pa_gain = 3,
-        .dac_gain = 3,
-        .mix_gain = 14,
-        .rf_power = 27
-    }};
-
-/* TX I/Q imbalance coefficients for mixer gain = 8 to 15 */
-static int8_t cal_offset_a_i[8]; /* TX I offset for radio A */
-static int8_t cal_offset_a_q[8]; /* TX Q offset for radio A */
-static int8_t cal_offset_b_i[8]; /* TX I offset for radio B */
-static int8_t cal_offset_b_q[8]; /* TX Q offset for radio B */
+/* -------------------------------------------------------------------------- */
+/* --- INTERNAL SHARED VARIABLES -------------------------------------------- */
+
+struct lgw_hal_state_s lgw_hal_state_default = HAL_STATE_INIT; /*! state of the default context */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
 
 int load_firmware(uint8_t target, uint8_t *firmware, uint16_t size);
 
+static uint32_t fw_hash(const uint8_t *firmware, uint16_t size);
+
+static int fw_check(const uint8_t *firmware, uint16_t size);
+
 void lgw_constant_adjust(void);
 
 int32_t lgw_sf_getval(int x);
 int32_t lgw_bw_getval(int x);
 
+static int hal_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data, struct lgw_pkt_pool_s *pool, struct lgw_pkt_rx_ref_s *pkt_ref);
+
+static int hal_send(struct lgw_pkt_tx_s pkt_data);
+
+static int hal_send_prepare(struct lgw_pkt_tx_s *pkt, struct lgw_pkt_tx_prep_s *prep);
+
+static int hal_send_prepared(struct lgw_pkt_tx_prep_s *prep, uint32_t count_us);
+
+static int toa_lora_symb(struct lgw_pkt_tx_s *packet, uint32_t *symb_us, uint32_t *quarter_nb);
+static uint64_t toa_fsk_bits(struct lgw_pkt_tx_s *packet);
+
+static void tx_reg_invalidate(void);
+static int tx_reg_w(int index, uint16_t register_id, int32_t reg_value);
+
+static uint32_t start_phase_us(struct timespec *t);
+static int start_wait_radios(void);
+static int start_wait_agc_status(uint8_t mask, uint8_t status, unsigned poll_ms, int32_t *read_val);
+static int start_agc_cmd(uint8_t cmd, uint8_t status);
+static int start_calibrate(uint8_t cal_cmd, struct calcache_data_s *cal, uint32_t *fw_time_us);
+static void start_cal_key(uint8_t cal_cmd, struct calcache_key_s *key);
+static int start_load_firmware(uint8_t target, uint8_t *firmware, uint16_t size, uint8_t version, uint32_t *time_us);
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
+/* FNV-1a hash of a firmware image */
+static uint32_t fw_hash(const uint8_t *firmware, uint16_t size) {
+    uint32_t h = 2166136261u;
+    int i;
+
+    for (i = 0; i < size; ++i) {
+        h = (h ^ firmware[i]) * 16777619u;
+    }
+    return h;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Compare the beginning of the MCU program RAM muxed to the host with a
+firmware image. The program RAM address register is 8-bit wide, so it can only
+be read sequentially from its start. */
+static int fw_check(const uint8_t *firmware, uint16_t size) {
+    uint8_t fw_check[FW_CHECK_CHUNK_BYTE];
+    int32_t dummy;
+    uint16_t i, n;
+
+    lgw_reg_w(LGW_MCU_PROM_ADDR, 0);
+    lgw_reg_r(LGW_MCU_PROM_DATA, &dummy); /* bug workaround */
+    for (i = 0; i < size; i += n) {
+        n = ((size - i) < FW_CHECK_CHUNK_BYTE) ? (size - i) : FW_CHECK_CHUNK_BYTE;
+        if (lgw_reg_rb(LGW_MCU_PROM_DATA, fw_check, n) != LGW_REG_SUCCESS) {
+            return -1;
+        }
+        if (memcmp(&firmware[i], fw_check, n) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 /* size is the firmware size in bytes (not 14b words) */
 int load_firmware(uint8_t target, uint8_t *firmware, uint16_t size) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
     int reg_rst;
     int reg_sel;
-    uint8_t fw_check[8192];
-    int32_t dummy;
 
     /* check parameters */
     CHECK_NULL(firmware);
@@ -199,6 +339,7 @@ int load_firmware(uint8_t target, uint8_t *firmware, uint16_t size) {
         DEBUG_MSG("ERROR: NOT A VALID TARGET FOR LOADING FIRMWARE\n");
         return -1;
     }
+    hal->mcu_fw_hash[target] = 0;
 
     /* reset the targeted MCU */
     lgw_reg_w(reg_rst, 1);
@@ -211,22 +352,36 @@ int load_firmware(uint8_t target, uint8_t *firmware, uint16_t size) {
     lgw_reg_wb(LGW_MCU_PROM_DATA, firmware, size);
 
     /* Read back firmware code for check */
-    lgw_reg_r( LGW_MCU_PROM_DATA, &dummy ); /* bug workaround */
-    lgw_reg_rb( LGW_MCU_PROM_DATA, fw_check, size );
-    if (memcmp(firmware, fw_check, size) != 0) {
-        printf ("ERROR: Failed to load fw %d\n", (int)target);
-        return -1;
+    switch (hal->start_fw_verify) {
+        case LGW_FW_VERIFY_NONE:
+            break;
+        case LGW_FW_VERIFY_PREFIX:
+            if (fw_check(firmware, FW_CHECK_PREFIX_BYTE) != 0) {
+                printf ("ERROR: Failed to load fw %d\n", (int)target);
+                return -1;
+            }
+            break;
+        default:
+            if (fw_check(firmware, size) != 0) {
+                printf ("ERROR: Failed to load fw %d\n", (int)target);
+                return -1;
+            }
     }
 
     /* give back control of the MCU program ram to the MCU */
     lgw_reg_w(reg_sel, 1);
 
+    hal->mcu_fw_hash[target] = fw_hash(firmware, size);
     return 0;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 void lgw_constant_adjust(void) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
+
+    /* all the constants are sent in a single SPI message */
+    lgw_reg_batch_begin();
 
     /* I/Q path setup */
     // lgw_reg_w(LGW_RX_INVERT_IQ,0); /* default 0 */
@@ -270,7 +425,7 @@ void lgw_constant_adjust(void) {
     // lgw_reg_w(LGW_SYNCH_DETECT_TH,1); /* default 1 */
     // lgw_reg_w(LGW_ZERO_PAD,0); /* default 0 */
     lgw_reg_w(LGW_SNR_AVG_CST,3); /* default 2 */
-    if (lorawan_public) { /* LoRa network */
+    if (hal->lorawan_public) { /* LoRa network */
         lgw_reg_w(LGW_FRAME_SYNCH_PEAK1_POS,3); /* default 1 */
         lgw_reg_w(LGW_FRAME_SYNCH_PEAK2_POS,4); /* default 2 */
     } else { /* private network */
@@ -292,7 +447,7 @@ void lgw_constant_adjust(void) {
     // lgw_reg_w(LGW_MBWSSF_FRAME_SYNCH_GAIN,1); /* default 1 */
     // lgw_reg_w(LGW_MBWSSF_SYNCH_DETECT_TH,1); /* default 1 */
     // lgw_reg_w(LGW_MBWSSF_ZERO_PAD,0); /* default 0 */
-    if (lorawan_public) { /* LoRa network */
+    if (hal->lorawan_public) { /* LoRa network */
         lgw_reg_w(LGW_MBWSSF_FRAME_SYNCH_PEAK1_POS,3); /* default 1 */
         lgw_reg_w(LGW_MBWSSF_FRAME_SYNCH_PEAK2_POS,4); /* default 2 */
     } else {
@@ -333,7 +488,7 @@ void lgw_constant_adjust(void) {
     /* TX LoRa */
     // lgw_reg_w(LGW_TX_MODE,0); /* default 0 */
     lgw_reg_w(LGW_TX_SWAP_IQ,1); /* "normal" polarity; default 0 */
-    if (lorawan_public) { /* LoRa network */
+    if (hal->lorawan_public) { /* LoRa network */
         lgw_reg_w(LGW_TX_FRAME_SYNCH_PEAK1_POS,3); /* default 1 */
         lgw_reg_w(LGW_TX_FRAME_SYNCH_PEAK2_POS,4); /* default 2 */
     } else { /* Private network */
@@ -347,6 +502,7 @@ void lgw_constant_adjust(void) {
     // lgw_reg_w(LGW_FSK_TX_PATTERN_EN,1); /* default 1 */
     // lgw_reg_w(LGW_FSK_TX_PREAMBLE_SEQ,0); /* default 0 */
 
+    lgw_reg_batch_end();
     return;
 }
 
@@ -404,27 +560,335 @@ uint16_t lgw_get_tx_start_delay(bool tx_notch_enable, uint8_t bw) {
 
     tx_start_delay = (float)TX_START_DELAY_DEFAULT - bw_delay_us - notch_delay_us;
 
-    printf("INFO: tx_start_delay=%u (%f) - (%u, bw_delay=%f, notch_delay=%f)\n", (uint16_t)tx_start_delay, tx_start_delay, TX_START_DELAY_DEFAULT, bw_delay_us, notch_delay_us);
+    DEBUG_PRINTF("INFO: tx_start_delay=%u (%f) - (%u, bw_delay=%f, notch_delay=%f)\n", (uint16_t)tx_start_delay, tx_start_delay, TX_START_DELAY_DEFAULT, bw_delay_us, notch_delay_us);
 
     return (uint16_t)tx_start_delay; /* keep truncating instead of rounding: better behaviour measured */
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Forget the values of the TX registers and the TX preparation caches */
+static void tx_reg_invalidate(void) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
+    int i;
+
+    for (i = 0; i < TX_REG_NB; ++i) {
+        hal->tx_reg_shadow[i] = TX_REG_UNKNOWN;
+    }
+    hal->tx_pll_freq_hz = 0;
+    memset(hal->tx_start_delay_cache, 0, sizeof hal->tx_start_delay_cache);
+}
+
+/* Write a TX register, unless it already holds that value */
+static int tx_reg_w(int index, uint16_t register_id, int32_t reg_value) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
+
+    if (hal->tx_reg_shadow[index] == reg_value) {
+        return LGW_REG_SUCCESS;
+    }
+    hal->tx_reg_shadow[index] = reg_value;
+    return lgw_reg_w(register_id, reg_value);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Time elapsed since t in microseconds, t is then set to now for the next phase */
+static uint32_t start_phase_us(struct timespec *t) {
+    struct timespec now;
+    uint32_t us;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    us = (uint32_t)((now.tv_sec - t->tv_sec) * 1000000 + (now.tv_nsec - t->tv_nsec) / 1000);
+    *t = now;
+    return us;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Wait for the radios XTAL to run, by polling their version register */
+static int start_wait_radios(void) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
+    struct timespec t0, t;
+    uint8_t version[LGW_RF_CHAIN_NB];
+    int i, nb_ok;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    do {
+        for (i = 0, nb_ok = 0; i < LGW_RF_CHAIN_NB; ++i) {
+            version[i] = sx125x_read(i, 0x07);
+            nb_ok += ((version[i] != 0x00) && (version[i] != 0xFF)) ? 1 : 0;
+        }
+        if (nb_ok == LGW_RF_CHAIN_NB) {
+            return LGW_HAL_SUCCESS;
+        }
+        wait_ms(1);
+        t = t0;
+    } while ((start_phase_us(&t) / 1000) < hal->start_timeout_ms);
+
+    DEBUG_PRINTF("ERROR: RADIOS NOT RESPONDING (VERSION 0x%02X 0x%02X)\n", version[0], version[1]);
+    return LGW_HAL_ERROR;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Poll the AGC MCU status until (status & mask) == status, for start_timeout_ms at most */
+static int start_wait_agc_status(uint8_t mask, uint8_t status, unsigned poll_ms, int32_t *read_val) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
+    struct timespec t0, t;
+    uint32_t elapsed_us = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (;;) {
+        lgw_reg_r(LGW_MCU_AGC_STATUS, read_val);
+        if ((*read_val & mask) == status) {
+            return LGW_HAL_SUCCESS;
+        }
+        if ((elapsed_us / 1000) >= hal->start_timeout_ms) {
+            return LGW_HAL_ERROR;
+        }
+        if (poll_ms > 0) {
+            wait_ms(poll_ms);
+        }
+        t = t0;
+        elapsed_us = start_phase_us(&t);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* One AGC firmware initialization transaction: send a command after
+AGC_CMD_WAIT and check the status the firmware acknowledges it with */
+static int start_agc_cmd(uint8_t cmd, uint8_t status) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
+    int32_t read_val;
+    int x;
+
+    lgw_reg_w(LGW_RADIO_SELECT, AGC_CMD_WAIT); /* start a transaction */
+    if (hal->start_fast == true) {
+        wait_us(START_AGC_CMD_US);
+        lgw_reg_w(LGW_RADIO_SELECT, cmd);
+        x = start_wait_agc_status(0xFF, status, 0, &read_val);
+    } else {
+        wait_ms(1);
+        lgw_reg_w(LGW_RADIO_SELECT, cmd);
+        wait_ms(1);
+        lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
+        x = (read_val == status) ? LGW_HAL_SUCCESS : LGW_HAL_ERROR;
+    }
+    if (x != LGW_HAL_SUCCESS) {
+        DEBUG_PRINTF("ERROR: AGC FIRMWARE INITIALIZATION FAILURE, STATUS 0x%02X\n", (uint8_t)read_val);
+    }
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Run the calibration firmware and read back its results */
+static int start_calibrate(uint8_t cal_cmd, struct calcache_data_s *cal, uint32_t *fw_time_us) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
+    int i;
+    int32_t read_val;
+    uint8_t fw_version;
+
+    /* Load the calibration firmware  */
+    if (start_load_firmware(MCU_AGC, cal_firmware, MCU_AGC_FW_BYTE, FW_VERSION_CAL, fw_time_us) != 0) {
+        return LGW_HAL_ERROR;
+    }
+    lgw_reg_w(LGW_FORCE_HOST_RADIO_CTRL, 0); /* gives to AGC MCU the control of the radios */
+    lgw_reg_w(LGW_RADIO_SELECT, cal_cmd); /* send calibration configuration word */
+    lgw_reg_w(LGW_MCU_RST_1, 0);
+
+    /* Check firmware version */
+    lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, FW_VERSION_ADDR);
+    lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
+    fw_version = (uint8_t)read_val;
+    if (fw_version != FW_VERSION_CAL) {
+        printf("ERROR: Version of calibration firmware not expected, actual:%d expected:%d\n", fw_version, FW_VERSION_CAL);
+        return LGW_HAL_ERROR;
+    }
+
+    lgw_reg_w(LGW_PAGE_REG, 3); /* Calibration will start on this condition as soon as MCU can talk to concentrator registers */
+    lgw_reg_w(LGW_EMERGENCY_FORCE_HOST_CTRL, 0); /* Give control of concentrator registers to MCU */
+
+    /* Wait for calibration to end */
+    if (hal->start_fast == true) {
+        DEBUG_PRINTF("Note: calibration started (timeout: %u ms)\n", hal->start_timeout_ms);
+        if (start_wait_agc_status(0x80, 0x80, START_CAL_POLL_MS, &read_val) != LGW_HAL_SUCCESS) {
+            lgw_reg_w(LGW_EMERGENCY_FORCE_HOST_CTRL, 1); /* Take back control */
+            DEBUG_PRINTF("ERROR: END OF CALIBRATION NOT REPORTED WITHIN %u MS\n", hal->start_timeout_ms);
+            return LGW_HAL_ERROR;
+        }
+    } else {
+        DEBUG_PRINTF("Note: calibration started (time: %u ms)\n", START_CAL_TIME_MS);
+        wait_ms(START_CAL_TIME_MS); /* Wait for end of calibration */
+    }
+    lgw_reg_w(LGW_EMERGENCY_FORCE_HOST_CTRL, 1); /* Take back control */
+
+    /* Get calibration status */
+    lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
+    cal->cal_status = (uint8_t)read_val;
+
+    /* Get TX DC offset values */
+    for(i=0; i<=7; ++i) {
+        lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xA0+i);
+        lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
+        cal->offset_a_i[i] = (int8_t)read_val;
+        lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xA8+i);
+        lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
+        cal->offset_a_q[i] = (int8_t)read_val;
+        lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xB0+i);
+        lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
+        cal->offset_b_i[i] = (int8_t)read_val;
+        lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xB8+i);
+        lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
+        cal->offset_b_q[i] = (int8_t)read_val;
+    }
+
+    /* Get RX IQ mismatch compensation */
+    for (i = 0; i < CALCACHE_IQ_NB; ++i) {
+        lgw_reg_r(cal_iq_reg[i], &cal->iq[i]);
+    }
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Load a firmware, unless the MCU already holds that image: same image loaded
+last time (hash), version of the firmware that ran found in the MCU data RAM,
+and beginning of the program RAM identical.
+The hash is only known to the process that loaded the image, so a firmware is
+always loaded by the first start of a process. The AGC program RAM is
+overwritten by the calibration firmware, so the AGC firmware is only reused by
+starts that skip the calibration (results from the calibration cache). */
+static int start_load_firmware(uint8_t target, uint8_t *firmware, uint16_t size, uint8_t version, uint32_t *time_us) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
+    struct timespec t;
+    int32_t read_val;
+    int reg_sel = (target == MCU_ARB) ? LGW_MCU_SELECT_MUX_0 : LGW_MCU_SELECT_MUX_1;
+    int x;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    /* after a reset both program RAMs are muxed to the host: only the targeted
+    one must be, for the readback and so that a load does not clobber the other */
+    lgw_reg_w((target == MCU_ARB) ? LGW_MCU_SELECT_MUX_1 : LGW_MCU_SELECT_MUX_0, 1);
+
+    x = -1;
+    if ((hal->mcu_fw_hash[target] != 0) && (hal->mcu_fw_hash[target] == fw_hash(firmware, size))) {
+        lgw_reg_w((target == MCU_ARB) ? LGW_MCU_RST_0 : LGW_MCU_RST_1, 1);
+        lgw_reg_w((target == MCU_ARB) ? LGW_DBG_ARB_MCU_RAM_ADDR : LGW_DBG_AGC_MCU_RAM_ADDR, FW_VERSION_ADDR);
+        lgw_reg_r((target == MCU_ARB) ? LGW_DBG_ARB_MCU_RAM_DATA : LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
+        if ((uint8_t)read_val == version) {
+            lgw_reg_w(reg_sel, 0);
+            x = fw_check(firmware, FW_CHECK_PREFIX_BYTE);
+            lgw_reg_w(reg_sel, 1);
+        }
+    }
+    if (x == 0) {
+        DEBUG_PRINTF("Note: MCU %d already holds firmware v%u, not reloaded\n", target, version);
+    } else {
+        x = load_firmware(target, firmware, size);
+    }
+    *time_us = start_phase_us(&t);
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Hardware and configuration the calibration results depend on */
+static void start_cal_key(uint8_t cal_cmd, struct calcache_key_s *key) {
+    struct lgw_ctx_s *ctx = lgw_ctx_cur;
+    struct lgw_hal_state_s *hal = ctx->hal;
+    int i;
+    int32_t read_val;
+
+    memset(key, 0, sizeof *key);
+    key->cal_cmd = cal_cmd;
+    for (i = 0; i < LGW_RF_CHAIN_NB; ++i) {
+        key->rf_freq[i] = hal->rf_enable[i] ? hal->rf_rx_freq[i] : 0;
+    }
+    lgw_reg_r(LGW_VERSION, &read_val);
+    key->chip_version = (uint8_t)read_val;
+    if ((ctx->spi_mux_mode == LGW_SPI_MUX_MODE1) && (lgw_fpga_reg_r(LGW_FPGA_VERSION, &read_val) == LGW_REG_SUCCESS)) {
+        key->fpga_version = (uint8_t)read_val;
+    }
+    key->temp_band = hal->start_cal_temp_band;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Number of LoRa symbols of a packet, preamble counted in quarters of symbols */
+static int toa_lora_symb(struct lgw_pkt_tx_s *packet, uint32_t *symb_us, uint32_t *quarter_nb) {
+    int32_t num, den, payload_nb;
+    uint8_t SF, H, DE;
+    int bw_index;
+
+    /* symbol durations, power of 2 microseconds for every bandwidth */
+    switch (packet->bandwidth) {
+        case BW_500KHZ: bw_index = 0; break;
+        case BW_250KHZ: bw_index = 1; break;
+        case BW_125KHZ: bw_index = 2; break;
+        case BW_62K5HZ: bw_index = 3; break;
+        case BW_31K2HZ: bw_index = 4; break;
+        case BW_15K6HZ: bw_index = 5; break;
+        case BW_7K8HZ: bw_index = 6; break;
+        default:
+            DEBUG_PRINTF("ERROR: Cannot compute time on air for this packet, unsupported bandwidth (0x%02X)\n", packet->bandwidth);
+            return -1;
+    }
+    if (lgw_sf_getval(packet->datarate) == -1) {
+        DEBUG_PRINTF("ERROR: Cannot compute time on air for this packet, unsupported datarate (0x%02X)\n", packet->datarate);
+        return -1;
+    }
+    SF = (uint8_t)lgw_sf_getval(packet->datarate);
+    *symb_us = lora_symb_us[bw_index][SF - 7];
+
+    /* payload symbols, ceil() of a possibly negative fraction */
+    H = (packet->no_header==false) ? 0 : 1; /* header is always enabled, except for beacons */
+    DE = (SF >= 11) ? 1 : 0; /* Low datarate optimization enabled for SF11 and SF12 */
+    num = 8*packet->size - 4*SF + 28 + 16 - 20*H;
+    den = 4*(SF - 2*DE);
+    payload_nb = (num > 0) ? ((num + den - 1) / den) : -((-num) / den);
+    payload_nb = 8 + payload_nb * (packet->coderate + 4);
+
+    /* preamble + 4.25 symbols of sync, then the payload */
+    *quarter_nb = 4*(uint32_t)packet->preamble + 17 + 4*(uint32_t)payload_nb;
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Number of bits of a FSK packet: PREAMBLE + SYNC_WORD + PKT_LEN + PKT_PAYLOAD + CRC
+        PREAMBLE: default 5 bytes
+        SYNC_WORD: default 3 bytes
+        PKT_LEN: 1 byte (variable length mode)
+        PKT_PAYLOAD: x bytes
+        CRC: 0 or 2 bytes
+*/
+static uint64_t toa_fsk_bits(struct lgw_pkt_tx_s *packet) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
+
+    return 8 * (uint64_t)(packet->preamble + hal->fsk_sync_word_size + 1 + packet->size + ((packet->no_crc == true) ? 0 : 2));
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
 int lgw_board_setconf(struct lgw_conf_board_s conf) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
 
     /* check if the concentrator is running */
-    if (lgw_is_started == true) {
+    if (hal->is_started == true) {
         DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
         return LGW_HAL_ERROR;
     }
 
     /* set internal config according to parameters */
-    lorawan_public = conf.lorawan_public;
-    rf_clkout = conf.clksrc;
+    hal->lorawan_public = conf.lorawan_public;
+    hal->rf_clkout = conf.clksrc;
 
-    DEBUG_PRINTF("Note: board configuration; lorawan_public:%d, clksrc:%d\n", lorawan_public, rf_clkout);
+    DEBUG_PRINTF("Note: board configuration; lorawan_public:%d, clksrc:%d\n", hal->lorawan_public, hal->rf_clkout);
 
     return LGW_HAL_SUCCESS;
 }
@@ -432,10 +896,11 @@ int lgw_board_setconf(struct lgw_conf_board_s conf) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_lbt_setconf(struct lgw_conf_lbt_s conf) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
     int x;
 
     /* check if the concentrator is running */
-    if (lgw_is_started == true) {
+    if (hal->is_started == true) {
         DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
         return LGW_HAL_ERROR;
     }
@@ -452,9 +917,10 @@ int lgw_lbt_setconf(struct lgw_conf_lbt_s conf) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_rxrf_setconf(uint8_t rf_chain, struct lgw_conf_rxrf_s conf) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
 
     /* check if the concentrator is running */
-    if (lgw_is_started == true) {
+    if (hal->is_started == true) {
         DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
         return LGW_HAL_ERROR;
     }
@@ -478,14 +944,14 @@ int lgw_rxrf_setconf(uint8_t rf_chain, struct lgw_conf_rxrf_s conf) {
     }
 
     /* set internal config according to parameters */
-    rf_enable[rf_chain] = conf.enable;
-    rf_rx_freq[rf_chain] = conf.freq_hz;
-    rf_rssi_offset[rf_chain] = conf.rssi_offset;
-    rf_radio_type[rf_chain] = conf.type;
-    rf_tx_enable[rf_chain] = conf.tx_enable;
-    rf_tx_notch_freq[rf_chain] = conf.tx_notch_freq;
+    hal->rf_enable[rf_chain] = conf.enable;
+    hal->rf_rx_freq[rf_chain] = conf.freq_hz;
+    hal->rf_rssi_offset[rf_chain] = conf.rssi_offset;
+    hal->rf_radio_type[rf_chain] = conf.type;
+    hal->rf_tx_enable[rf_chain] = conf.tx_enable;
+    hal->rf_tx_notch_freq[rf_chain] = conf.tx_notch_freq;
 
-    DEBUG_PRINTF("Note: rf_chain %d configuration; en:%d freq:%d rssi_offset:%f radio_type:%d tx_enable:%d tx_notch_freq:%u\n", rf_chain, rf_enable[rf_chain], rf_rx_freq[rf_chain], rf_rssi_offset[rf_chain], rf_radio_type[rf_chain], rf_tx_enable[rf_chain], rf_tx_notch_freq[rf_chain]);
+    DEBUG_PRINTF("Note: rf_chain %d configuration; en:%d freq:%d rssi_offset:%f radio_type:%d tx_enable:%d tx_notch_freq:%u\n", rf_chain, hal->rf_enable[rf_chain], hal->rf_rx_freq[rf_chain], hal->rf_rssi_offset[rf_chain], hal->rf_radio_type[rf_chain], hal->rf_tx_enable[rf_chain], hal->rf_tx_notch_freq[rf_chain]);
 
     return LGW_HAL_SUCCESS;
 }
@@ -493,11 +959,12 @@ int lgw_rxrf_setconf(uint8_t rf_chain, struct lgw_conf_rxrf_s conf) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
     int32_t bw_hz;
     uint32_t rf_rx_bandwidth;
 
     /* check if the concentrator is running */
-    if (lgw_is_started == true) {
+    if (hal->is_started == true) {
         DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
         return LGW_HAL_ERROR;
     }
@@ -510,8 +977,8 @@ int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
 
     /* if chain is disabled, don't care about most parameters */
     if (conf.enable == false) {
-        if_enable[if_chain] = false;
-        if_freq[if_chain] = 0;
+        hal->if_enable[if_chain] = false;
+        hal->if_freq[if_chain] = 0;
         DEBUG_PRINTF("Note: if_chain %d disabled\n", if_chain);
         return LGW_HAL_SUCCESS;
     }
@@ -567,18 +1034,18 @@ int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
                 return LGW_HAL_ERROR;
             }
             /* set internal configuration  */
-            if_enable[if_chain] = conf.enable;
-            if_rf_chain[if_chain] = conf.rf_chain;
-            if_freq[if_chain] = conf.freq_hz;
-            lora_rx_bw = conf.bandwidth;
-            lora_rx_sf = (uint8_t)(DR_LORA_MULTI & conf.datarate); /* filter SF out of the 7-12 range */
+            hal->if_enable[if_chain] = conf.enable;
+            hal->if_rf_chain[if_chain] = conf.rf_chain;
+            hal->if_freq[if_chain] = conf.freq_hz;
+            hal->lora_rx_bw = conf.bandwidth;
+            hal->lora_rx_sf = (uint8_t)(DR_LORA_MULTI & conf.datarate); /* filter SF out of the 7-12 range */
             if (SET_PPM_ON(conf.bandwidth, conf.datarate)) {
-                lora_rx_ppm_offset = true;
+                hal->lora_rx_ppm_offset = true;
             } else {
-                lora_rx_ppm_offset = false;
+                hal->lora_rx_ppm_offset = false;
             }
 
-            DEBUG_PRINTF("Note: LoRa 'std' if_chain %d configuration; en:%d freq:%d bw:%d dr:%d\n", if_chain, if_enable[if_chain], if_freq[if_chain], lora_rx_bw, lora_rx_sf);
+            DEBUG_PRINTF("Note: LoRa 'std' if_chain %d configuration; en:%d freq:%d bw:%d dr:%d\n", if_chain, hal->if_enable[if_chain], hal->if_freq[if_chain], hal->lora_rx_bw, hal->lora_rx_sf);
             break;
 
         case IF_LORA_MULTI:
@@ -599,12 +1066,12 @@ int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
                 return LGW_HAL_ERROR;
             }
             /* set internal configuration  */
-            if_enable[if_chain] = conf.enable;
-            if_rf_chain[if_chain] = conf.rf_chain;
-            if_freq[if_chain] = conf.freq_hz;
-            lora_multi_sfmask[if_chain] = (uint8_t)(DR_LORA_MULTI & conf.datarate); /* filter SF out of the 7-12 range */
+            hal->if_enable[if_chain] = conf.enable;
+            hal->if_rf_chain[if_chain] = conf.rf_chain;
+            hal->if_freq[if_chain] = conf.freq_hz;
+            hal->lora_multi_sfmask[if_chain] = (uint8_t)(DR_LORA_MULTI & conf.datarate); /* filter SF out of the 7-12 range */
 
-            DEBUG_PRINTF("Note: LoRa 'multi' if_chain %d configuration; en:%d freq:%d SF_mask:0x%02x\n", if_chain, if_enable[if_chain], if_freq[if_chain], lora_multi_sfmask[if_chain]);
+            DEBUG_PRINTF("Note: LoRa 'multi' if_chain %d configuration; en:%d freq:%d SF_mask:0x%02x\n", if_chain, hal->if_enable[if_chain], hal->if_freq[if_chain], hal->lora_multi_sfmask[if_chain]);
             break;
 
         case IF_FSK_STD:
@@ -625,16 +1092,16 @@ int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
                 return LGW_HAL_ERROR;
             }
             /* set internal configuration  */
-            if_enable[if_chain] = conf.enable;
-            if_rf_chain[if_chain] = conf.rf_chain;
-            if_freq[if_chain] = conf.freq_hz;
-            fsk_rx_bw = conf.bandwidth;
-            fsk_rx_dr = conf.datarate;
+            hal->if_enable[if_chain] = conf.enable;
+            hal->if_rf_chain[if_chain] = conf.rf_chain;
+            hal->if_freq[if_chain] = conf.freq_hz;
+            hal->fsk_rx_bw = conf.bandwidth;
+            hal->fsk_rx_dr = conf.datarate;
             if (conf.sync_word > 0) {
-                fsk_sync_word_size = conf.sync_word_size;
-                fsk_sync_word = conf.sync_word;
+                hal->fsk_sync_word_size = conf.sync_word_size;
+                hal->fsk_sync_word = conf.sync_word;
             }
-            DEBUG_PRINTF("Note: FSK if_chain %d configuration; en:%d freq:%d bw:%d dr:%d (%d real dr) sync:0x%0*llX\n", if_chain, if_enable[if_chain], if_freq[if_chain], fsk_rx_bw, fsk_rx_dr, LGW_XTAL_FREQU/(LGW_XTAL_FREQU/fsk_rx_dr), 2*fsk_sync_word_size, fsk_sync_word);
+            DEBUG_PRINTF("Note: FSK if_chain %d configuration; en:%d freq:%d bw:%d dr:%d (%d real dr) sync:0x%0*llX\n", if_chain, hal->if_enable[if_chain], hal->if_freq[if_chain], hal->fsk_rx_bw, hal->fsk_rx_dr, LGW_XTAL_FREQU/(LGW_XTAL_FREQU/hal->fsk_rx_dr), 2*hal->fsk_sync_word_size, hal->fsk_sync_word);
             break;
 
         default:
@@ -648,6 +1115,7 @@ int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_txgain_setconf(struct lgw_tx_gain_lut_s *conf) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
     int i;
 
     /* Check LUT size */
@@ -656,9 +1124,9 @@ int lgw_txgain_setconf(struct lgw_tx_gain_lut_s *conf) {
         return LGW_HAL_ERROR;
     }
 
-    txgain_lut.size = conf->size;
+    hal->txgain_lut.size = conf->size;
 
-    for (i = 0; i < txgain_lut.size; i++) {
+    for (i = 0; i < hal->txgain_lut.size; i++) {
         /* Check gain range */
         if (conf->lut[i].dig_gain > 3) {
             DEBUG_MSG("ERROR: TX gain LUT: SX1301 digital gain must be between 0 and 3\n");
@@ -681,12 +1149,44 @@ int lgw_txgain_setconf(struct lgw_tx_gain_lut_s *conf) {
         }
 
         /* Set internal LUT */
-        txgain_lut.lut[i].dig_gain = conf->lut[i].dig_gain;
-        txgain_lut.lut[i].dac_gain = conf->lut[i].dac_gain;
-        txgain_lut.lut[i].mix_gain = conf->lut[i].mix_gain;
-        txgain_lut.lut[i].pa_gain  = conf->lut[i].pa_gain;
-        txgain_lut.lut[i].rf_power = conf->lut[i].rf_power;
+        hal->txgain_lut.lut[i].dig_gain = conf->lut[i].dig_gain;
+        hal->txgain_lut.lut[i].dac_gain = conf->lut[i].dac_gain;
+        hal->txgain_lut.lut[i].mix_gain = conf->lut[i].mix_gain;
+        hal->txgain_lut.lut[i].pa_gain  = conf->lut[i].pa_gain;
+        hal->txgain_lut.lut[i].rf_power = conf->lut[i].rf_power;
+    }
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_start_setconf(struct lgw_conf_start_s conf) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
+
+    /* check if the concentrator is running */
+    if (hal->is_started == true) {
+        DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
+        return LGW_HAL_ERROR;
+    }
+
+    if ((conf.cal_file != NULL) && (strlen(conf.cal_file) >= sizeof hal->start_cal_file)) {
+        DEBUG_MSG("ERROR: CALIBRATION CACHE FILE PATH TOO LONG\n");
+        return LGW_HAL_ERROR;
+    }
+
+    hal->start_fast = conf.fast;
+    hal->start_timeout_ms = (conf.timeout_ms != 0) ? conf.timeout_ms : START_TIMEOUT_MS;
+    if (conf.cal_file != NULL) {
+        strcpy(hal->start_cal_file, conf.cal_file);
+    } else {
+        hal->start_cal_file[0] = '\0';
     }
+    hal->start_cal_max_age_s = conf.cal_max_age_s;
+    hal->start_cal_force = conf.cal_force;
+    hal->start_cal_temp_band = calcache_temp_band(conf.temperature);
+    hal->start_fw_verify = conf.fw_verify;
+    DEBUG_PRINTF("Note: start configuration; fast:%d, timeout:%u ms, calibration cache:%s\n", hal->start_fast, hal->start_timeout_ms, hal->start_cal_file);
 
     return LGW_HAL_SUCCESS;
 }
@@ -694,6 +1194,7 @@ int lgw_txgain_setconf(struct lgw_tx_gain_lut_s *conf) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_start(void) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
     int i, err;
     int reg_stat;
     unsigned x;
@@ -702,22 +1203,30 @@ int lgw_start(void) {
     uint8_t load_val;
     uint8_t fw_version;
     uint8_t cal_cmd;
-    uint16_t cal_time;
     uint8_t cal_status;
+    uint8_t cal_mask;
+    struct calcache_key_s cal_key;
+    struct calcache_data_s cal;
+    struct timespec t_start, t_phase;
+    struct lgw_start_timing_s timing;
 
     uint64_t fsk_sync_word_reg;
 
-    if (lgw_is_started == true) {
+    if (hal->is_started == true) {
         DEBUG_MSG("Note: LoRa concentrator already started, restarting it now\n");
     }
+    memset(&timing, 0, sizeof timing);
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+    t_phase = t_start;
 
-    reg_stat = lgw_connect(false, rf_tx_notch_freq[rf_tx_enable[1]?1:0]);
+    reg_stat = lgw_connect(false, hal->rf_tx_notch_freq[hal->rf_tx_enable[1]?1:0]);
     if (reg_stat == LGW_REG_ERROR) {
         DEBUG_MSG("ERROR: FAIL TO CONNECT BOARD\n");
         return LGW_HAL_ERROR;
     }
 
     /* reset the registers (also shuts the radios down) */
+    lgw_reg_batch_begin();
     lgw_soft_reset();
 
     /* gate clocks */
@@ -727,23 +1236,35 @@ int lgw_start(void) {
     /* switch on and reset the radios (also starts the 32 MHz XTAL) */
     lgw_reg_w(LGW_RADIO_A_EN,1);
     lgw_reg_w(LGW_RADIO_B_EN,1);
-    wait_ms(500); /* TODO: optimize */
+    if (lgw_reg_batch_end() != LGW_REG_SUCCESS) {
+        DEBUG_MSG("ERROR: FAIL TO RESET THE CONCENTRATOR\n");
+        return LGW_HAL_ERROR;
+    }
+    timing.connect = start_phase_us(&t_phase);
+    if (hal->start_fast == false) {
+        wait_ms(START_RADIO_XTAL_MS);
+    }
     lgw_reg_w(LGW_RADIO_RST,1);
     wait_ms(5);
     lgw_reg_w(LGW_RADIO_RST,0);
+    if ((hal->start_fast == true) && (start_wait_radios() != LGW_HAL_SUCCESS)) {
+        return LGW_HAL_ERROR;
+    }
 
     /* setup the radios */
-    err = lgw_setup_sx125x(0, rf_clkout, rf_enable[0], rf_radio_type[0], rf_rx_freq[0]);
+    err = lgw_setup_sx125x(0, hal->rf_clkout, hal->rf_enable[0], hal->rf_radio_type[0], hal->rf_rx_freq[0]);
     if (err != 0) {
         DEBUG_MSG("ERROR: Failed to setup sx125x radio for RF chain 0\n");
         return LGW_HAL_ERROR;
     }
-    err = lgw_setup_sx125x(1, rf_clkout, rf_enable[1], rf_radio_type[1], rf_rx_freq[1]);
+    err = lgw_setup_sx125x(1, hal->rf_clkout, hal->rf_enable[1], hal->rf_radio_type[1], hal->rf_rx_freq[1]);
     if (err != 0) {
         DEBUG_MSG("ERROR: Failed to setup sx125x radio for RF chain 0\n");
         return LGW_HAL_ERROR;
     }
 
+    timing.radio = start_phase_us(&t_phase);
+
     /* gives AGC control of GPIOs to enable Tx external digital filter */
     lgw_reg_w(LGW_GPIO_MODE,31); /* Set all GPIOs as output */
     lgw_reg_w(LGW_GPIO_SELECT_OUTPUT,0);
@@ -780,13 +1301,13 @@ int lgw_start(void) {
 
     /* select calibration command */
     cal_cmd = 0;
-    cal_cmd |= rf_enable[0] ? 0x01 : 0x00; /* Bit 0: Calibrate Rx IQ mismatch compensation on radio A */
-    cal_cmd |= rf_enable[1] ? 0x02 : 0x00; /* Bit 1: Calibrate Rx IQ mismatch compensation on radio B */
-    cal_cmd |= (rf_enable[0] && rf_tx_enable[0]) ? 0x04 : 0x00; /* Bit 2: Calibrate Tx DC offset on radio A */
-    cal_cmd |= (rf_enable[1] && rf_tx_enable[1]) ? 0x08 : 0x00; /* Bit 3: Calibrate Tx DC offset on radio B */
+    cal_cmd |= hal->rf_enable[0] ? 0x01 : 0x00; /* Bit 0: Calibrate Rx IQ mismatch compensation on radio A */
+    cal_cmd |= hal->rf_enable[1] ? 0x02 : 0x00; /* Bit 1: Calibrate Rx IQ mismatch compensation on radio B */
+    cal_cmd |= (hal->rf_enable[0] && hal->rf_tx_enable[0]) ? 0x04 : 0x00; /* Bit 2: Calibrate Tx DC offset on radio A */
+    cal_cmd |= (hal->rf_enable[1] && hal->rf_tx_enable[1]) ? 0x08 : 0x00; /* Bit 3: Calibrate Tx DC offset on radio B */
     cal_cmd |= 0x10; /* Bit 4: 0: calibrate with DAC gain=2, 1: with DAC gain=3 (use 3) */
 
-    switch (rf_radio_type[0]) { /* we assume that there is only one radio type on the board */
+    switch (hal->rf_radio_type[0]) { /* we assume that there is only one radio type on the board */
         case LGW_RADIO_TYPE_SX1255:
             cal_cmd |= 0x20; /* Bit 5: 0: SX1257, 1: SX1255 */
             break;
@@ -794,39 +1315,43 @@ int lgw_start(void) {
             cal_cmd |= 0x00; /* Bit 5: 0: SX1257, 1: SX1255 */
             break;
         default:
-            DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d FOR RADIO TYPE\n", rf_radio_type[0]);
+            DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d FOR RADIO TYPE\n", hal->rf_radio_type[0]);
             break;
     }
 
     cal_cmd |= 0x00; /* Bit 6-7: Board type 0: ref, 1: FPGA, 3: board X */
-    cal_time = 2300; /* measured between 2.1 and 2.2 sec, because 1 TX only */
-
-    /* Load the calibration firmware  */
-    load_firmware(MCU_AGC, cal_firmware, MCU_AGC_FW_BYTE);
-    lgw_reg_w(LGW_FORCE_HOST_RADIO_CTRL, 0); /* gives to AGC MCU the control of the radios */
-    lgw_reg_w(LGW_RADIO_SELECT, cal_cmd); /* send calibration configuration word */
-    lgw_reg_w(LGW_MCU_RST_1, 0);
 
-    /* Check firmware version */
-    lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, FW_VERSION_ADDR);
-    lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-    fw_version = (uint8_t)read_val;
-    if (fw_version != FW_VERSION_CAL) {
-        printf("ERROR: Version of calibration firmware not expected, actual:%d expected:%d\n", fw_version, FW_VERSION_CAL);
-        return -1;
+    /* run the calibration, or reuse the results of a previous one */
+    if (hal->start_cal_file[0] != '\0') {
+        start_cal_key(cal_cmd, &cal_key);
     }
-
-    lgw_reg_w(LGW_PAGE_REG, 3); /* Calibration will start on this condition as soon as MCU can talk to concentrator registers */
-    lgw_reg_w(LGW_EMERGENCY_FORCE_HOST_CTRL, 0); /* Give control of concentrator registers to MCU */
-
-    /* Wait for calibration to end */
-    DEBUG_PRINTF("Note: calibration started (time: %u ms)\n", cal_time);
-    wait_ms(cal_time); /* Wait for end of calibration */
-    lgw_reg_w(LGW_EMERGENCY_FORCE_HOST_CTRL, 1); /* Take back control */
-
-    /* Get calibration status */
-    lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
-    cal_status = (uint8_t)read_val;
+    if ((hal->start_cal_file[0] != '\0') && (hal->start_cal_force == false) &&
+        (calcache_load(hal->start_cal_file, &cal_key, hal->start_cal_max_age_s, &cal) == LGW_CALCACHE_SUCCESS)) {
+        DEBUG_MSG("Note: calibration results loaded from cache, calibration skipped\n");
+        lgw_reg_batch_begin();
+        for (i = 0; i < CALCACHE_IQ_NB; ++i) {
+            lgw_reg_w(cal_iq_reg[i], cal.iq[i]);
+        }
+        if (lgw_reg_batch_end() != LGW_REG_SUCCESS) {
+            DEBUG_MSG("ERROR: FAIL TO RESTORE CALIBRATION RESULTS\n");
+            return LGW_HAL_ERROR;
+        }
+        timing.cal_cached = true;
+    } else {
+        if (start_calibrate(cal_cmd, &cal, &timing.fw_cal) != LGW_HAL_SUCCESS) {
+            return LGW_HAL_ERROR;
+        }
+        /* only cache a calibration that fully succeeded */
+        cal_mask = 0x81;
+        cal_mask |= (cal_cmd & 0x01) ? 0x0A : 0x00;
+        cal_mask |= (cal_cmd & 0x02) ? 0x14 : 0x00;
+        cal_mask |= (cal_cmd & 0x04) ? 0x20 : 0x00;
+        cal_mask |= (cal_cmd & 0x08) ? 0x40 : 0x00;
+        if ((hal->start_cal_file[0] != '\0') && ((cal.cal_status & cal_mask) == cal_mask)) {
+            calcache_save(hal->start_cal_file, &cal_key, &cal);
+        }
+    }
+    cal_status = cal.cal_status;
     /*
         bit 7: calibration finished
         bit 0: could access SX1301 registers
@@ -843,63 +1368,58 @@ int lgw_start(void) {
     } else {
         DEBUG_PRINTF("Note: calibration finished (status = %u)\n", cal_status);
     }
-    if (rf_enable[0] && ((cal_status & 0x02) == 0)) {
+    if (hal->rf_enable[0] && ((cal_status & 0x02) == 0)) {
         DEBUG_MSG("WARNING: calibration could not access radio A\n");
     }
-    if (rf_enable[1] && ((cal_status & 0x04) == 0)) {
+    if (hal->rf_enable[1] && ((cal_status & 0x04) == 0)) {
         DEBUG_MSG("WARNING: calibration could not access radio B\n");
     }
-    if (rf_enable[0] && ((cal_status & 0x08) == 0)) {
+    if (hal->rf_enable[0] && ((cal_status & 0x08) == 0)) {
         DEBUG_MSG("WARNING: problem in calibration of radio A for image rejection\n");
     }
-    if (rf_enable[1] && ((cal_status & 0x10) == 0)) {
+    if (hal->rf_enable[1] && ((cal_status & 0x10) == 0)) {
         DEBUG_MSG("WARNING: problem in calibration of radio B for image rejection\n");
     }
-    if (rf_enable[0] && rf_tx_enable[0] && ((cal_status & 0x20) == 0)) {
+    if (hal->rf_enable[0] && hal->rf_tx_enable[0] && ((cal_status & 0x20) == 0)) {
         DEBUG_MSG("WARNING: problem in calibration of radio A for TX DC offset\n");
     }
-    if (rf_enable[1] && rf_tx_enable[1] && ((cal_status & 0x40) == 0)) {
+    if (hal->rf_enable[1] && hal->rf_tx_enable[1] && ((cal_status & 0x40) == 0)) {
         DEBUG_MSG("WARNING: problem in calibration of radio B for TX DC offset\n");
     }
 
-    /* Get TX DC offset values */
-    for(i=0; i<=7; ++i) {
-        lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xA0+i);
-        lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-        cal_offset_a_i[i] = (int8_t)read_val;
-        lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xA8+i);
-        lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-        cal_offset_a_q[i] = (int8_t)read_val;
-        lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xB0+i);
-        lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-        cal_offset_b_i[i] = (int8_t)read_val;
-        lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xB8+i);
-        lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-        cal_offset_b_q[i] = (int8_t)read_val;
-    }
+    /* TX DC offset values */
+    memcpy(hal->cal_offset_a_i, cal.offset_a_i, sizeof hal->cal_offset_a_i);
+    memcpy(hal->cal_offset_a_q, cal.offset_a_q, sizeof hal->cal_offset_a_q);
+    memcpy(hal->cal_offset_b_i, cal.offset_b_i, sizeof hal->cal_offset_b_i);
+    memcpy(hal->cal_offset_b_q, cal.offset_b_q, sizeof hal->cal_offset_b_q);
+
+    timing.calib = start_phase_us(&t_phase);
 
     /* load adjusted parameters */
     lgw_constant_adjust();
 
     /* Sanity check for RX frequency */
-    if (rf_rx_freq[0] == 0) {
+    if (hal->rf_rx_freq[0] == 0) {
         DEBUG_MSG("ERROR: wrong configuration, rf_rx_freq[0] is not set\n");
         return LGW_HAL_ERROR;
     }
 
+    /* modem configuration is sent in a single SPI message */
+    lgw_reg_batch_begin();
+
     /* Freq-to-time-drift calculation */
-    x = 4096000000 / (rf_rx_freq[0] >> 1); /* dividend: (4*2048*1000000) >> 1, rescaled to avoid 32b overflow */
+    x = 4096000000 / (hal->rf_rx_freq[0] >> 1); /* dividend: (4*2048*1000000) >> 1, rescaled to avoid 32b overflow */
     x = ( x > 63 ) ? 63 : x; /* saturation */
     lgw_reg_w(LGW_FREQ_TO_TIME_DRIFT, x); /* default 9 */
 
-    x = 4096000000 / (rf_rx_freq[0] >> 3); /* dividend: (16*2048*1000000) >> 3, rescaled to avoid 32b overflow */
+    x = 4096000000 / (hal->rf_rx_freq[0] >> 3); /* dividend: (16*2048*1000000) >> 3, rescaled to avoid 32b overflow */
     x = ( x > 63 ) ? 63 : x; /* saturation */
     lgw_reg_w(LGW_MBWSSF_FREQ_TO_TIME_DRIFT, x); /* default 36 */
 
     /* configure LoRa 'multi' demodulators aka. LoRa 'sensor' channels (IF0-3) */
     radio_select = 0; /* IF mapping to radio A/B (per bit, 0=A, 1=B) */
     for(i=0; i<LGW_MULTI_NB; ++i) {
-        radio_select += (if_rf_chain[i] == 1 ? 1 << i : 0); /* transform bool array into binary word */
+        radio_select += (hal->if_rf_chain[i] == 1 ? 1 << i : 0); /* transform bool array into binary word */
     }
     /*
     lgw_reg_w(LGW_RADIO_SELECT, radio_select);
@@ -908,41 +1428,42 @@ int lgw_start(void) {
     will be loaded in LGW_RADIO_SELECT at the end of start procedure.
     */
 
-    lgw_reg_w(LGW_IF_FREQ_0, IF_HZ_TO_REG(if_freq[0])); /* default -384 */
-    lgw_reg_w(LGW_IF_FREQ_1, IF_HZ_TO_REG(if_freq[1])); /* default -128 */
-    lgw_reg_w(LGW_IF_FREQ_2, IF_HZ_TO_REG(if_freq[2])); /* default 128 */
-    lgw_reg_w(LGW_IF_FREQ_3, IF_HZ_TO_REG(if_freq[3])); /* default 384 */
-    lgw_reg_w(LGW_IF_FREQ_4, IF_HZ_TO_REG(if_freq[4])); /* default -384 */
-    lgw_reg_w(LGW_IF_FREQ_5, IF_HZ_TO_REG(if_freq[5])); /* default -128 */
-    lgw_reg_w(LGW_IF_FREQ_6, IF_HZ_TO_REG(if_freq[6])); /* default 128 */
-    lgw_reg_w(LGW_IF_FREQ_7, IF_HZ_TO_REG(if_freq[7])); /* default 384 */
-
-    lgw_reg_w(LGW_CORR0_DETECT_EN, (if_enable[0] == true) ? lora_multi_sfmask[0] : 0); /* default 0 */
-    lgw_reg_w(LGW_CORR1_DETECT_EN, (if_enable[1] == true) ? lora_multi_sfmask[1] : 0); /* default 0 */
-    lgw_reg_w(LGW_CORR2_DETECT_EN, (if_enable[2] == true) ? lora_multi_sfmask[2] : 0); /* default 0 */
-    lgw_reg_w(LGW_CORR3_DETECT_EN, (if_enable[3] == true) ? lora_multi_sfmask[3] : 0); /* default 0 */
-    lgw_reg_w(LGW_CORR4_DETECT_EN, (if_enable[4] == true) ? lora_multi_sfmask[4] : 0); /* default 0 */
-    lgw_reg_w(LGW_CORR5_DETECT_EN, (if_enable[5] == true) ? lora_multi_sfmask[5] : 0); /* default 0 */
-    lgw_reg_w(LGW_CORR6_DETECT_EN, (if_enable[6] == true) ? lora_multi_sfmask[6] : 0); /* default 0 */
-    lgw_reg_w(LGW_CORR7_DETECT_EN, (if_enable[7] == true) ? lora_multi_sfmask[7] : 0); /* default 0 */
+    lgw_reg_w(LGW_IF_FREQ_0, IF_HZ_TO_REG(hal->if_freq[0])); /* default -384 */
+    lgw_reg_w(LGW_IF_FREQ_1, IF_HZ_TO_REG(hal->if_freq[1])); /* default -128 */
+    lgw_reg_w(LGW_IF_FREQ_2, IF_HZ_TO_REG(hal->if_freq[2])); /* default 128 */
+    lgw_reg_w(LGW_IF_FREQ_3, IF_HZ_TO_REG(hal->if_freq[3])); /* default 384 */
+    lgw_reg_w(LGW_IF_FREQ_4, IF_HZ_TO_REG(hal->if_freq[4])); /* default -384 */
+    lgw_reg_w(LGW_IF_FREQ_5, IF_HZ_TO_REG(hal->if_freq[5])); /* default -128 */
+    lgw_reg_w(LGW_IF_FREQ_6, IF_HZ_TO_REG(hal->if_freq[6])); /* default 128 */
+    lgw_reg_w(LGW_IF_FREQ_7, IF_HZ_TO_REG(hal->if_freq[7])); /* default 384 */
+
+    lgw_reg_w(LGW_CORR0_DETECT_EN, (hal->if_enable[0] == true) ? hal->lora_multi_sfmask[0] : 0); /* default 0 */
+    lgw_reg_w(LGW_CORR1_DETECT_EN, (hal->if_enable[1] == true) ? hal->lora_multi_sfmask[1] : 0); /* default 0 */
+    lgw_reg_w(LGW_CORR2_DETECT_EN, (hal->if_enable[2] == true) ? hal->lora_multi_sfmask[2] : 0); /* default 0 */
+    lgw_reg_w(LGW_CORR3_DETECT_EN, (hal->if_enable[3] == true) ? hal->lora_multi_sfmask[3] : 0); /* default 0 */
+    lgw_reg_w(LGW_CORR4_DETECT_EN, (hal->if_enable[4] == true) ? hal->lora_multi_sfmask[4] : 0); /* default 0 */
+    lgw_reg_w(LGW_CORR5_DETECT_EN, (hal->if_enable[5] == true) ? hal->lora_multi_sfmask[5] : 0); /* default 0 */
+    lgw_reg_w(LGW_CORR6_DETECT_EN, (hal->if_enable[6] == true) ? hal->lora_multi_sfmask[6] : 0); /* default 0 */
+    lgw_reg_w(LGW_CORR7_DETECT_EN, (hal->if_enable[7] == true) ? hal->lora_multi_sfmask[7] : 0); /* default 0 */
 
     lgw_reg_w(LGW_PPM_OFFSET, 0x60); /* as the threshold is 16ms, use 0x60 to enable ppm_offset for SF12 and SF11 @125kHz*/
 
     lgw_reg_w(LGW_CONCENTRATOR_MODEM_ENABLE, 1); /* default 0 */
 
     /* configure LoRa 'stand-alone' modem (IF8) */
-    lgw_reg_w(LGW_IF_FREQ_8, IF_HZ_TO_REG(if_freq[8])); /* MBWSSF modem (default 0) */
-    if (if_enable[8] == true) {
-        lgw_reg_w(LGW_MBWSSF_RADIO_SELECT, if_rf_chain[8]);
-        switch(lora_rx_bw) {
+    lgw_reg_w(LGW_IF_FREQ_8, IF_HZ_TO_REG(hal->if_freq[8])); /* MBWSSF modem (default 0) */
+    if (hal->if_enable[8] == true) {
+        lgw_reg_w(LGW_MBWSSF_RADIO_SELECT, hal->if_rf_chain[8]);
+        switch(hal->lora_rx_bw) {
             case BW_125KHZ: lgw_reg_w(LGW_MBWSSF_MODEM_BW, 0); break;
             case BW_250KHZ: lgw_reg_w(LGW_MBWSSF_MODEM_BW, 1); break;
             case BW_500KHZ: lgw_reg_w(LGW_MBWSSF_MODEM_BW, 2); break;
             default:
-                DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", lora_rx_bw);
+                DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", hal->lora_rx_bw);
+                lgw_reg_batch_end();
                 return LGW_HAL_ERROR;
         }
-        switch(lora_rx_sf) {
+        switch(hal->lora_rx_sf) {
             case DR_LORA_SF7: lgw_reg_w(LGW_MBWSSF_RATE_SF, 7); break;
             case DR_LORA_SF8: lgw_reg_w(LGW_MBWSSF_RATE_SF, 8); break;
             case DR_LORA_SF9: lgw_reg_w(LGW_MBWSSF_RATE_SF, 9); break;
@@ -950,34 +1471,43 @@ int lgw_start(void) {
             case DR_LORA_SF11: lgw_reg_w(LGW_MBWSSF_RATE_SF, 11); break;
             case DR_LORA_SF12: lgw_reg_w(LGW_MBWSSF_RATE_SF, 12); break;
             default:
-                DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", lora_rx_sf);
+                DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", hal->lora_rx_sf);
+                lgw_reg_batch_end();
                 return LGW_HAL_ERROR;
         }
-        lgw_reg_w(LGW_MBWSSF_PPM_OFFSET, lora_rx_ppm_offset); /* default 0 */
+        lgw_reg_w(LGW_MBWSSF_PPM_OFFSET, hal->lora_rx_ppm_offset); /* default 0 */
         lgw_reg_w(LGW_MBWSSF_MODEM_ENABLE, 1); /* default 0 */
     } else {
         lgw_reg_w(LGW_MBWSSF_MODEM_ENABLE, 0);
     }
 
     /* configure FSK modem (IF9) */
-    lgw_reg_w(LGW_IF_FREQ_9, IF_HZ_TO_REG(if_freq[9])); /* FSK modem, default 0 */
-    lgw_reg_w(LGW_FSK_PSIZE, fsk_sync_word_size-1);
-    lgw_reg_w(LGW_FSK_TX_PSIZE, fsk_sync_word_size-1);
-    fsk_sync_word_reg = fsk_sync_word << (8 * (8 - fsk_sync_word_size));
+    lgw_reg_w(LGW_IF_FREQ_9, IF_HZ_TO_REG(hal->if_freq[9])); /* FSK modem, default 0 */
+    lgw_reg_w(LGW_FSK_PSIZE, hal->fsk_sync_word_size-1);
+    lgw_reg_w(LGW_FSK_TX_PSIZE, hal->fsk_sync_word_size-1);
+    fsk_sync_word_reg = hal->fsk_sync_word << (8 * (8 - hal->fsk_sync_word_size));
     lgw_reg_w(LGW_FSK_REF_PATTERN_LSB, (uint32_t)(0xFFFFFFFF & fsk_sync_word_reg));
     lgw_reg_w(LGW_FSK_REF_PATTERN_MSB, (uint32_t)(0xFFFFFFFF & (fsk_sync_word_reg >> 32)));
-    if (if_enable[9] == true) {
-        lgw_reg_w(LGW_FSK_RADIO_SELECT, if_rf_chain[9]);
-        lgw_reg_w(LGW_FSK_BR_RATIO, LGW_XTAL_FREQU/fsk_rx_dr); /* setting the dividing ratio for datarate */
-        lgw_reg_w(LGW_FSK_CH_BW_EXPO, fsk_rx_bw);
+    if (hal->if_enable[9] == true) {
+        lgw_reg_w(LGW_FSK_RADIO_SELECT, hal->if_rf_chain[9]);
+        lgw_reg_w(LGW_FSK_BR_RATIO, LGW_XTAL_FREQU/hal->fsk_rx_dr); /* setting the dividing ratio for datarate */
+        lgw_reg_w(LGW_FSK_CH_BW_EXPO, hal->fsk_rx_bw);
         lgw_reg_w(LGW_FSK_MODEM_ENABLE, 1); /* default 0 */
     } else {
         lgw_reg_w(LGW_FSK_MODEM_ENABLE, 0);
     }
+    if (lgw_reg_batch_end() != LGW_REG_SUCCESS) {
+        DEBUG_MSG("ERROR: FAIL TO CONFIGURE THE MODEMS\n");
+        return LGW_HAL_ERROR;
+    }
+
+    timing.modem = start_phase_us(&t_phase);
 
     /* Load firmware */
-    load_firmware(MCU_ARB, arb_firmware, MCU_ARB_FW_BYTE);
-    load_firmware(MCU_AGC, agc_firmware, MCU_AGC_FW_BYTE);
+    if ((start_load_firmware(MCU_ARB, arb_firmware, MCU_ARB_FW_BYTE, FW_VERSION_ARB, &timing.fw_arb) != 0) ||
+        (start_load_firmware(MCU_AGC, agc_firmware, MCU_AGC_FW_BYTE, FW_VERSION_AGC, &timing.fw_agc) != 0)) {
+        return LGW_HAL_ERROR;
+    }
 
     /* gives the AGC MCU control over radio, RF front-end and filter gain */
     lgw_reg_w(LGW_FORCE_HOST_RADIO_CTRL, 0);
@@ -1005,115 +1535,167 @@ int lgw_start(void) {
         return LGW_HAL_ERROR;
     }
 
-    DEBUG_MSG("Info: Initialising AGC firmware...\n");
-    wait_ms(1);
+    timing.firmware = start_phase_us(&t_phase);
 
-    lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
-    if (read_val != 0x10) {
+    DEBUG_MSG("Info: Initialising AGC firmware...\n");
+    if (hal->start_fast == true) {
+        err = start_wait_agc_status(0xFF, 0x10, 0, &read_val);
+    } else {
+        wait_ms(1);
+        lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
+        err = (read_val == 0x10) ? LGW_HAL_SUCCESS : LGW_HAL_ERROR;
+    }
+    if (err != LGW_HAL_SUCCESS) {
         DEBUG_PRINTF("ERROR: AGC FIRMWARE INITIALIZATION FAILURE, STATUS 0x%02X\n", (uint8_t)read_val);
         return LGW_HAL_ERROR;
     }
 
     /* Update Tx gain LUT and start AGC */
-    for (i = 0; i < txgain_lut.size; ++i) {
-        lgw_reg_w(LGW_RADIO_SELECT, AGC_CMD_WAIT); /* start a transaction */
-        wait_ms(1);
-        load_val = txgain_lut.lut[i].mix_gain + (16 * txgain_lut.lut[i].dac_gain) + (64 * txgain_lut.lut[i].pa_gain);
-        lgw_reg_w(LGW_RADIO_SELECT, load_val);
-        wait_ms(1);
-        lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
-        if (read_val != (0x30 + i)) {
-            DEBUG_PRINTF("ERROR: AGC FIRMWARE INITIALIZATION FAILURE, STATUS 0x%02X\n", (uint8_t)read_val);
+    for (i = 0; i < hal->txgain_lut.size; ++i) {
+        load_val = hal->txgain_lut.lut[i].mix_gain + (16 * hal->txgain_lut.lut[i].dac_gain) + (64 * hal->txgain_lut.lut[i].pa_gain);
+        if (start_agc_cmd(load_val, 0x30 + i) != LGW_HAL_SUCCESS) {
             return LGW_HAL_ERROR;
         }
     }
     /* As the AGC fw is waiting for 16 entries, we need to abort the transaction if we get less entries */
-    if (txgain_lut.size < TX_GAIN_LUT_SIZE_MAX) {
-        lgw_reg_w(LGW_RADIO_SELECT, AGC_CMD_WAIT);
-        wait_ms(1);
-        load_val = AGC_CMD_ABORT;
-        lgw_reg_w(LGW_RADIO_SELECT, load_val);
-        wait_ms(1);
-        lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
-        if (read_val != 0x30) {
-            DEBUG_PRINTF("ERROR: AGC FIRMWARE INITIALIZATION FAILURE, STATUS 0x%02X\n", (uint8_t)read_val);
+    if (hal->txgain_lut.size < TX_GAIN_LUT_SIZE_MAX) {
+        if (start_agc_cmd(AGC_CMD_ABORT, 0x30) != LGW_HAL_SUCCESS) {
             return LGW_HAL_ERROR;
         }
     }
 
     /* Load Tx freq MSBs (always 3 if f > 768 for SX1257 or f > 384 for SX1255 */
-    lgw_reg_w(LGW_RADIO_SELECT, AGC_CMD_WAIT);
-    wait_ms(1);
-    lgw_reg_w(LGW_RADIO_SELECT, 3);
-    wait_ms(1);
-    lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
-    if (read_val != 0x33) {
-        DEBUG_PRINTF("ERROR: AGC FIRMWARE INITIALIZATION FAILURE, STATUS 0x%02X\n", (uint8_t)read_val);
+    if (start_agc_cmd(3, 0x33) != LGW_HAL_SUCCESS) {
         return LGW_HAL_ERROR;
     }
 
     /* Load chan_select firmware option */
-    lgw_reg_w(LGW_RADIO_SELECT, AGC_CMD_WAIT);
-    wait_ms(1);
-    lgw_reg_w(LGW_RADIO_SELECT, 0);
-    wait_ms(1);
-    lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
-    if (read_val != 0x30) {
-        DEBUG_PRINTF("ERROR: AGC FIRMWARE INITIALIZATION FAILURE, STATUS 0x%02X\n", (uint8_t)read_val);
+    if (start_agc_cmd(0, 0x30) != LGW_HAL_SUCCESS) {
         return LGW_HAL_ERROR;
     }
 
     /* End AGC firmware init and check status */
-    lgw_reg_w(LGW_RADIO_SELECT, AGC_CMD_WAIT);
-    wait_ms(1);
-    lgw_reg_w(LGW_RADIO_SELECT, radio_select); /* Load intended value of RADIO_SELECT */
-    wait_ms(1);
     DEBUG_MSG("Info: putting back original RADIO_SELECT value\n");
-    lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
-    if (read_val != 0x40) {
-        DEBUG_PRINTF("ERROR: AGC FIRMWARE INITIALIZATION FAILURE, STATUS 0x%02X\n", (uint8_t)read_val);
+    if (start_agc_cmd(radio_select, 0x40) != LGW_HAL_SUCCESS) { /* Load intended value of RADIO_SELECT */
         return LGW_HAL_ERROR;
     }
 
     /* enable GPS event capture */
     lgw_reg_w(LGW_GPS_EN, 1);
 
+    timing.agc = start_phase_us(&t_phase);
+
     /* */
     if (lbt_is_enabled() == true) {
         printf("INFO: Configuring LBT, this may take few seconds, please wait...\n");
-        wait_ms(8400);
+        wait_ms(START_LBT_SCAN_MS);
     }
+    timing.lbt = start_phase_us(&t_phase);
+
+    /* RX timestamp and RSSI corrections for this configuration */
+    rxcorr_setup(hal->lora_rx_bw, hal->fsk_rx_dr, hal->rf_rssi_offset);
 
-    lgw_is_started = true;
+    timing.total = start_phase_us(&t_start);
+    hal->start_timing = timing;
+    DEBUG_PRINTF("Note: started in %u us (connect %u, radio %u, calib %u, modem %u, firmware %u, agc %u, lbt %u)\n", timing.total,
+                 timing.connect, timing.radio, timing.calib, timing.modem, timing.firmware, timing.agc, timing.lbt);
+    DEBUG_PRINTF("Note: firmware load time (cal %u, arb %u, agc %u)\n", timing.fw_cal, timing.fw_arb, timing.fw_agc);
+
+    tx_reg_invalidate();
+    hal->is_started = true;
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_start_timing(struct lgw_start_timing_s *timing) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
+
+    CHECK_NULL(timing);
+
+    *timing = hal->start_timing;
     return LGW_HAL_SUCCESS;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_stop(void) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
+
+    /* wait for a send or a FIFO drain in progress in another thread */
+    pthread_mutex_lock(&hal->mx_tx);
+    pthread_mutex_lock(&hal->mx_rx);
     lgw_soft_reset();
     lgw_disconnect();
 
-    lgw_is_started = false;
+    hal->is_started = false;
+    pthread_mutex_unlock(&hal->mx_rx);
+    pthread_mutex_unlock(&hal->mx_tx);
     return LGW_HAL_SUCCESS;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
-    int nb_pkt_fetch; /* loop variable and return value */
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
+    uint64_t t0 = lgw_perf_start();
+    int x;
+
+    CHECK_NULL(pkt_data);
+    pthread_mutex_lock(&hal->mx_rx);
+    x = hal_receive(max_pkt, pkt_data, NULL, NULL);
+    pthread_mutex_unlock(&hal->mx_rx);
+    lgw_perf_stop(LGW_PERF_RECEIVE, t0);
+    if (x > 0) {
+        lgw_perf_add(LGW_PERF_RX_PKT, x);
+    }
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_receive_pool(struct lgw_pkt_pool_s *pool, uint8_t max_pkt, struct lgw_pkt_rx_ref_s *pkt_ref) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
+    uint64_t t0 = lgw_perf_start();
+    int x;
+
+    CHECK_NULL(pool);
+    CHECK_NULL(pkt_ref);
+    pthread_mutex_lock(&hal->mx_rx);
+    x = hal_receive(max_pkt, NULL, pool, pkt_ref);
+    pthread_mutex_unlock(&hal->mx_rx);
+    lgw_perf_stop(LGW_PERF_RECEIVE, t0);
+    if (x > 0) {
+        lgw_perf_add(LGW_PERF_RX_PKT, x);
+    }
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Fetch packets from the RX FIFO, either into the pkt_data array or, if pool is
+not NULL, into pool slots referenced by the pkt_ref array. In both cases the
+payload is read by the SPI burst directly into its final buffer. */
+static int hal_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data, struct lgw_pkt_pool_s *pool, struct lgw_pkt_rx_ref_s *pkt_ref) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
+    int nb_pkt_fetch; /* return value */
+    int nb_pkt_drop = 0; /* packets dropped, too large for the pool slots or with invalid metadata */
     struct lgw_pkt_rx_s *p; /* pointer to the current structure in the struct array */
-    uint8_t buff[255+RX_METADATA_NB]; /* buffer to store the result of SPI read bursts */
+    struct lgw_pkt_rx_s pkt_pool; /* metadata of the current packet, when using a pool */
+    struct lgw_pkt_rx_ref_s *r; /* pointer to the current reference in the reference array */
+    uint8_t *payload; /* where the payload of the current packet is read */
+    uint16_t slot = LGW_POOL_SLOT_NONE; /* pool slot of the current packet */
+    uint8_t buff[RX_METADATA_NB]; /* buffer to store the metadata that follows the payload */
+    uint8_t fifo_status[5]; /* status of the packet at the head of the RX FIFO */
     unsigned sz; /* size of the payload, uses to address metadata */
     int ifmod; /* type of if_chain/modem a packet was received by */
     int stat_fifo; /* the packet status as indicated in the FIFO */
     uint32_t raw_timestamp; /* timestamp when internal 'RX finished' was triggered */
-    uint32_t delay_x, delay_y, delay_z; /* temporary variable for timestamp offset calculation */
     uint32_t timestamp_correction; /* correction to account for processing delay */
-    uint32_t sf, cr, bw_pow, crc_en, ppm; /* used to calculate timestamp correction */
+    uint32_t sf, cr, crc_en; /* used to look up the timestamp correction */
 
     /* check if the concentrator is running */
-    if (lgw_is_started == false) {
+    if (hal->is_started == false) {
         DEBUG_MSG("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE RECEIVING\n");
         return LGW_HAL_ERROR;
     }
@@ -1123,23 +1705,28 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
         DEBUG_PRINTF("ERROR: %d = INVALID MAX NUMBER OF PACKETS TO FETCH\n", max_pkt);
         return LGW_HAL_ERROR;
     }
-    CHECK_NULL(pkt_data);
 
     /* Initialize buffer */
     memset (buff, 0, sizeof buff);
 
+    /* fetch the RX FIFO status of the first packet, the status of the next
+    ones is fetched together with the data of the previous packet */
+    if( LGW_REG_SUCCESS != lgw_reg_rb(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, fifo_status, 5) ){
+        //DEBUG_PRINTF("lgw_reg_rb error %x %x %x %x %x\n", fifo_status[0], fifo_status[1], fifo_status[2], fifo_status[3], fifo_status[4]);
+        return 0;
+    }
+
     /* iterate max_pkt times at most */
     for (nb_pkt_fetch = 0; nb_pkt_fetch < max_pkt; ++nb_pkt_fetch) {
 
         /* point to the proper struct in the struct array */
-        p = &pkt_data[nb_pkt_fetch];
-
-        /* fetch all the RX FIFO data */
-        if( LGW_REG_SUCCESS != lgw_reg_rb(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, buff, 5) ){
-            //DEBUG_PRINTF("lgw_reg_rb error %x %x %x %x %x\n", buff[0], buff[1], buff[2], buff[3], buff[4]);
+        if (pool == NULL) {
+            p = &pkt_data[nb_pkt_fetch];
+        } else {
+            p = &pkt_pool;
         }
 
-        //DEBUG_PRINTF("lgw_reg_rb status %02x %02x %02x %02x %02x\n", buff[0], buff[1], buff[2], buff[3], buff[4]);
+        //DEBUG_PRINTF("lgw_reg_rb status %02x %02x %02x %02x %02x\n", fifo_status[0], fifo_status[1], fifo_status[2], fifo_status[3], fifo_status[4]);
 
         /* 0:   number of packets available in RX data buffer */
         /* 1,2: start address of the current packet in RX data buffer */
@@ -1147,40 +1734,92 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
         /* 4:   size of the current packet payload in byte */
 
         /* how many packets are in the RX buffer ? Break if zero */
-        if (buff[0] == 0) {
+        if (fifo_status[0] == 0) {
             break; /* no more packets to fetch, exit out of FOR loop */
         }
 
         /* sanity check */
-        if (buff[0] > LGW_PKT_FIFO_SIZE) {
-            DEBUG_PRINTF("WARNING: %u = INVALID NUMBER OF PACKETS TO FETCH, ABORTING\n", buff[0]);
+        if (fifo_status[0] > LGW_PKT_FIFO_SIZE) {
+            DEBUG_PRINTF("WARNING: %u = INVALID NUMBER OF PACKETS TO FETCH, ABORTING\n", fifo_status[0]);
             break;
         }
 
-        //DEBUG_PRINTF("FIFO content: %x %x %x %x %x\n", buff[0], buff[1], buff[2], buff[3], buff[4]);
-
-        p->size = buff[4];
+        p->size = fifo_status[4];
         sz = p->size;
-        stat_fifo = buff[3]; /* will be used later, need to save it before overwriting buff */
-
-        /* get payload + metadata */
-        lgw_reg_rb(LGW_RX_DATA_BUF_DATA, buff, sz+RX_METADATA_NB);
+        stat_fifo = fifo_status[3];
+
+        /* select the payload destination */
+        if (pool == NULL) {
+            payload = p->payload;
+        } else if (sz > pool->max_size) {
+            /* does not fit in a slot, drop it to not block the FIFO */
+            DEBUG_PRINTF("WARNING: %u BYTES PACKET TOO LARGE FOR POOL SLOTS, DROPPED\n", sz);
+            lgw_reg_batch_begin();
+            lgw_reg_w(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, 0);
+            lgw_reg_batch_rb(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, fifo_status, 5);
+            if (lgw_reg_batch_end() != LGW_REG_SUCCESS) {
+                DEBUG_MSG("ERROR: FAILED TO DROP PACKET FROM RX FIFO\n");
+                break;
+            }
+            pool->nb_drop += 1;
+            if (++nb_pkt_drop > LGW_PKT_FIFO_SIZE) {
+                break;
+            }
+            --nb_pkt_fetch; /* retry with the next packet */
+            continue;
+        } else {
+            slot = lgw_pool_get(pool);
+            if (slot == LGW_POOL_SLOT_NONE) {
+                DEBUG_MSG("Note: packet pool empty, packets left in RX FIFO\n");
+                break;
+            }
+            payload = lgw_pool_buffer(pool, slot);
+        }
 
-        /* copy payload to result struct */
-        memcpy((void *)p->payload, (void *)buff, sz);
+        /* get payload (directly in its destination) + metadata, advance packet
+        FIFO and get the status of the next packet, in a single SPI message.
+        The data port read pointer carries on from the payload to the metadata. */
+        lgw_reg_batch_begin();
+        if (sz > 0) {
+            lgw_reg_batch_rb(LGW_RX_DATA_BUF_DATA, payload, sz);
+        }
+        lgw_reg_batch_rb(LGW_RX_DATA_BUF_DATA, buff, RX_METADATA_NB);
+        lgw_reg_w(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, 0);
+        if ((nb_pkt_fetch + 1) < max_pkt) {
+            lgw_reg_batch_rb(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, fifo_status, 5);
+        }
+        if (lgw_reg_batch_end() != LGW_REG_SUCCESS) {
+            DEBUG_MSG("ERROR: FAILED TO FETCH PACKET FROM RX FIFO\n");
+            if (pool != NULL) {
+                lgw_pool_release(pool, slot);
+            }
+            break;
+        }
 
         /* process metadata */
-        p->if_chain = buff[sz+0];
+        p->if_chain = buff[0];
         if (p->if_chain >= LGW_IF_CHAIN_NB) {
-            DEBUG_PRINTF("WARNING: %u NOT A VALID IF_CHAIN NUMBER, ABORTING\n", p->if_chain);
-            break;
+            /* the FIFO is already advanced, drop that packet and go on with the next ones */
+            DEBUG_PRINTF("WARNING: %u NOT A VALID IF_CHAIN NUMBER, PACKET DROPPED\n", p->if_chain);
+            if (pool != NULL) {
+                lgw_pool_release(pool, slot);
+                pool->nb_drop += 1;
+            }
+            if (++nb_pkt_drop > LGW_PKT_FIFO_SIZE) {
+                break;
+            }
+            if (((nb_pkt_fetch + 1) >= max_pkt) && (lgw_reg_rb(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, fifo_status, 5) != LGW_REG_SUCCESS)) {
+                break; /* status of the next packet was not fetched with this one */
+            }
+            --nb_pkt_fetch; /* retry with the next packet */
+            continue;
         }
         ifmod = ifmod_config[p->if_chain];
         DEBUG_PRINTF("[%d %d]\n", p->if_chain, ifmod);
 
-        p->rf_chain = (uint8_t)if_rf_chain[p->if_chain];
-        p->freq_hz = (uint32_t)((int32_t)rf_rx_freq[p->rf_chain] + if_freq[p->if_chain]);
-        p->rssi = (float)buff[sz+5] + rf_rssi_offset[p->rf_chain];
+        p->rf_chain = (uint8_t)hal->if_rf_chain[p->if_chain];
+        p->freq_hz = (uint32_t)((int32_t)hal->rf_rx_freq[p->rf_chain] + hal->if_freq[p->if_chain]);
+        p->rssi = (float)buff[5] + hal->rf_rssi_offset[p->rf_chain];
 
         if ((ifmod == IF_LORA_MULTI) || (ifmod == IF_LORA_STD)) {
             DEBUG_MSG("Note: LoRa packet\n");
@@ -1202,15 +1841,15 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
                     crc_en = 0;
             }
             p->modulation = MOD_LORA;
-            p->snr = ((float)((int8_t)buff[sz+2]))/4;
-            p->snr_min = ((float)((int8_t)buff[sz+3]))/4;
-            p->snr_max = ((float)((int8_t)buff[sz+4]))/4;
+            p->snr = ((float)((int8_t)buff[2]))/4;
+            p->snr_min = ((float)((int8_t)buff[3]))/4;
+            p->snr_max = ((float)((int8_t)buff[4]))/4;
             if (ifmod == IF_LORA_MULTI) {
                 p->bandwidth = BW_125KHZ; /* fixed in hardware */
             } else {
-                p->bandwidth = lora_rx_bw; /* get the parameter from the config variable */
+                p->bandwidth = hal->lora_rx_bw; /* get the parameter from the config variable */
             }
-            sf = (buff[sz+1] >> 4) & 0x0F;
+            sf = (buff[1] >> 4) & 0x0F;
             switch (sf) {
                 case 7: p->datarate = DR_LORA_SF7; break;
                 case 8: p->datarate = DR_LORA_SF8; break;
@@ -1220,7 +1859,7 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
                 case 12: p->datarate = DR_LORA_SF12; break;
                 default: p->datarate = DR_UNDEFINED;
             }
-            cr = (buff[sz+1] >> 1) & 0x07;
+            cr = (buff[1] >> 1) & 0x07;
             switch (cr) {
                 case 1: p->coderate = CR_LORA_4_5; break;
                 case 2: p->coderate = CR_LORA_4_6; break;
@@ -1229,52 +1868,11 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
                 default: p->coderate = CR_UNDEFINED;
             }
 
-            /* determine if 'PPM mode' is on, needed for timestamp correction */
-            if (SET_PPM_ON(p->bandwidth,p->datarate)) {
-                ppm = 1;
-            } else {
-                ppm = 0;
-            }
-
-            /* timestamp correction code, base delay */
-            if (ifmod == IF_LORA_STD) { /* if packet was received on the stand-alone LoRa modem */
-                switch (lora_rx_bw) {
-                    case BW_125KHZ:
-                        delay_x = 64;
-                        bw_pow = 1;
-                        break;
-                    case BW_250KHZ:
-                        delay_x = 32;
-                        bw_pow = 2;
-                        break;
-                    case BW_500KHZ:
-                        delay_x = 16;
-                        bw_pow = 4;
-                        break;
-                    default:
-                        DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", p->bandwidth);
-                        delay_x = 0;
-                        bw_pow = 0;
-                }
-            } else { /* packet was received on one of the sensor channels = 125kHz */
-                delay_x = 114;
-                bw_pow = 1;
-            }
-
-            /* timestamp correction code, variable delay */
-            if ((sf >= 6) && (sf <= 12) && (bw_pow > 0)) {
-                if ((2*(sz + 2*crc_en) - (sf-7)) <= 0) { /* payload fits entirely in first 8 symbols */
-                    delay_y = ( ((1<<(sf-1)) * (sf+1)) + (3 * (1<<(sf-4))) ) / bw_pow;
-                    delay_z = 32 * (2*(sz+2*crc_en) + 5) / bw_pow;
-                } else {
-                    delay_y = ( ((1<<(sf-1)) * (sf+1)) + ((4 - ppm) * (1<<(sf-4))) ) / bw_pow;
-                    delay_z = (16 + 4*cr) * (((2*(sz+2*crc_en)-sf+6) % (sf - 2*ppm)) + 1) / bw_pow;
-                }
-                timestamp_correction = delay_x + delay_y + delay_z;
-            } else {
-                timestamp_correction = 0;
+            /* timestamp correction, precomputed at start */
+            if ((sf < 6) || (sf > 12)) {
                 DEBUG_MSG("WARNING: invalid packet, no timestamp correction\n");
             }
+            timestamp_correction = rxcorr_timestamp(ifmod, sf, cr, crc_en, sz);
 
             /* RSSI correction */
             if (ifmod == IF_LORA_MULTI) {
@@ -1301,13 +1899,13 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
             p->snr = -128.0;
             p->snr_min = -128.0;
             p->snr_max = -128.0;
-            p->bandwidth = fsk_rx_bw;
-            p->datarate = fsk_rx_dr;
+            p->bandwidth = hal->fsk_rx_bw;
+            p->datarate = hal->fsk_rx_dr;
             p->coderate = CR_UNDEFINED;
-            timestamp_correction = ((uint32_t)680000 / fsk_rx_dr) - 20;
+            timestamp_correction = rxcorr_timestamp(ifmod, 0, 0, false, sz);
 
             /* RSSI correction */
-            p->rssi = RSSI_FSK_POLY_0 + RSSI_FSK_POLY_1 * p->rssi + RSSI_FSK_POLY_2 * pow(p->rssi, 2);
+            p->rssi = rxcorr_rssi_fsk(p->rf_chain, buff[5]);
         } else {
             DEBUG_MSG("ERROR: UNEXPECTED PACKET ORIGIN\n");
             p->status = STAT_UNDEFINED;
@@ -1322,12 +1920,31 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
             timestamp_correction = 0;
         }
 
-        raw_timestamp = (uint32_t)buff[sz+6] + ((uint32_t)buff[sz+7] << 8) + ((uint32_t)buff[sz+8] << 16) + ((uint32_t)buff[sz+9] << 24);
+        raw_timestamp = (uint32_t)buff[6] + ((uint32_t)buff[7] << 8) + ((uint32_t)buff[8] << 16) + ((uint32_t)buff[9] << 24);
         p->count_us = raw_timestamp - timestamp_correction;
-        p->crc = (uint16_t)buff[sz+10] + ((uint16_t)buff[sz+11] << 8);
-
-        /* advance packet FIFO */
-        lgw_reg_w(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, 0);
+        p->crc = (uint16_t)buff[10] + ((uint16_t)buff[11] << 8);
+
+        /* fill the pool reference */
+        if (pool != NULL) {
+            r = &pkt_ref[nb_pkt_fetch];
+            r->freq_hz = p->freq_hz;
+            r->if_chain = p->if_chain;
+            r->status = p->status;
+            r->count_us = p->count_us;
+            r->rf_chain = p->rf_chain;
+            r->modulation = p->modulation;
+            r->bandwidth = p->bandwidth;
+            r->datarate = p->datarate;
+            r->coderate = p->coderate;
+            r->rssi = p->rssi;
+            r->snr = p->snr;
+            r->snr_min = p->snr_min;
+            r->snr_max = p->snr_max;
+            r->crc = p->crc;
+            r->size = p->size;
+            r->slot = slot;
+            r->payload = payload;
+        }
     }
 
     return nb_pkt_fetch;
@@ -1336,22 +1953,85 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_send(struct lgw_pkt_tx_s pkt_data) {
-    int i, x;
-    uint8_t buff[256+TX_METADATA_NB]; /* buffer to prepare the packet to send + metadata before SPI write burst */
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
+    uint64_t t0 = lgw_perf_start();
+    int x;
+
+    pthread_mutex_lock(&hal->mx_tx);
+    x = hal_send(pkt_data);
+    pthread_mutex_unlock(&hal->mx_tx);
+    lgw_perf_stop(LGW_PERF_SEND, t0);
+    if (x == LGW_HAL_SUCCESS) {
+        lgw_perf_add(LGW_PERF_TX_PKT, 1);
+    }
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_send_prepare(struct lgw_pkt_tx_s *pkt_data, struct lgw_pkt_tx_prep_s *prep) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
+    int x;
+
+    CHECK_NULL(pkt_data);
+    CHECK_NULL(prep);
+
+    pthread_mutex_lock(&hal->mx_tx);
+    x = hal_send_prepare(pkt_data, prep);
+    pthread_mutex_unlock(&hal->mx_tx);
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_send_prepared(struct lgw_pkt_tx_prep_s *prep, uint32_t count_us) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
+    uint64_t t0 = lgw_perf_start();
+    int x;
+
+    CHECK_NULL(prep);
+
+    pthread_mutex_lock(&hal->mx_tx);
+    x = hal_send_prepared(prep, count_us);
+    pthread_mutex_unlock(&hal->mx_tx);
+    lgw_perf_stop(LGW_PERF_SEND, t0);
+    if (x == LGW_HAL_SUCCESS) {
+        lgw_perf_add(LGW_PERF_TX_PKT, 1);
+    }
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int hal_send(struct lgw_pkt_tx_s pkt_data) {
+    struct lgw_pkt_tx_prep_s prep;
+    int x;
+
+    x = hal_send_prepare(&pkt_data, &prep);
+    if (x != LGW_HAL_SUCCESS) {
+        return x;
+    }
+    return hal_send_prepared(&prep, pkt_data.count_us);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int hal_send_prepare(struct lgw_pkt_tx_s *pkt, struct lgw_pkt_tx_prep_s *prep) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
+    struct lgw_pkt_tx_s pkt_data;
+    uint8_t *buff = prep->meta; /* metadata, the payload is sent from the packet structure */
     uint32_t part_int = 0; /* integer part for PLL register value calculation */
     uint32_t part_frac = 0; /* fractional part for PLL register value calculation */
     uint16_t fsk_dr_div; /* divider to configure for target datarate */
-    int transfer_size = 0; /* data to transfer from host to TX databuffer */
-    int payload_offset = 0; /* start of the payload content in the databuffer */
     uint8_t pow_index = 0; /* 4-bit value to set the firmware TX power */
     uint8_t target_mix_gain = 0; /* used to select the proper I/Q offset correction */
-    uint32_t count_trig = 0; /* timestamp value in trigger mode corrected for TX start delay */
-    bool tx_allowed = false;
     uint16_t tx_start_delay;
     bool tx_notch_enable = false;
 
+    pkt_data = *pkt;
+
     /* check if the concentrator is running */
-    if (lgw_is_started == false) {
+    if (hal->is_started == false) {
         DEBUG_MSG("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE SENDING\n");
         return LGW_HAL_ERROR;
     }
@@ -1363,11 +2043,11 @@ int lgw_send(struct lgw_pkt_tx_s pkt_data) {
     }
 
     /* check input variables */
-    if (rf_tx_enable[pkt_data.rf_chain] == false) {
+    if (hal->rf_tx_enable[pkt_data.rf_chain] == false) {
         DEBUG_MSG("ERROR: SELECTED RF_CHAIN IS DISABLED FOR TX ON SELECTED BOARD\n");
         return LGW_HAL_ERROR;
     }
-    if (rf_enable[pkt_data.rf_chain] == false) {
+    if (hal->rf_enable[pkt_data.rf_chain] == false) {
         DEBUG_MSG("ERROR: SELECTED RF_CHAIN IS DISABLED\n");
         return LGW_HAL_ERROR;
     }
@@ -1415,62 +2095,62 @@ int lgw_send(struct lgw_pkt_tx_s pkt_data) {
         tx_notch_enable = true;
     }
 
-    /* Get the TX start delay to be applied for this TX */
-    tx_start_delay = lgw_get_tx_start_delay(tx_notch_enable, pkt_data.bandwidth);
+    /* Get the TX start delay to be applied for this TX (float computation, cached) */
+    tx_start_delay = hal->tx_start_delay_cache[tx_notch_enable ? 1 : 0][pkt_data.bandwidth & 0x07];
+    if (tx_start_delay == 0) {
+        tx_start_delay = lgw_get_tx_start_delay(tx_notch_enable, pkt_data.bandwidth);
+        hal->tx_start_delay_cache[tx_notch_enable ? 1 : 0][pkt_data.bandwidth & 0x07] = tx_start_delay;
+    }
 
     /* interpretation of TX power */
-    for (pow_index = txgain_lut.size-1; pow_index > 0; pow_index--) {
-        if (txgain_lut.lut[pow_index].rf_power <= pkt_data.rf_power) {
+    for (pow_index = hal->txgain_lut.size-1; pow_index > 0; pow_index--) {
+        if (hal->txgain_lut.lut[pow_index].rf_power <= pkt_data.rf_power) {
             break;
         }
     }
 
-    /* loading TX imbalance correction */
-    target_mix_gain = txgain_lut.lut[pow_index].mix_gain;
+    /* TX imbalance correction */
+    target_mix_gain = hal->txgain_lut.lut[pow_index].mix_gain;
     if (pkt_data.rf_chain == 0) { /* use radio A calibration table */
-        lgw_reg_w(LGW_TX_OFFSET_I, cal_offset_a_i[target_mix_gain - 8]);
-        lgw_reg_w(LGW_TX_OFFSET_Q, cal_offset_a_q[target_mix_gain - 8]);
+        prep->offset_i = hal->cal_offset_a_i[target_mix_gain - 8];
+        prep->offset_q = hal->cal_offset_a_q[target_mix_gain - 8];
     } else { /* use radio B calibration table */
-        lgw_reg_w(LGW_TX_OFFSET_I, cal_offset_b_i[target_mix_gain - 8]);
-        lgw_reg_w(LGW_TX_OFFSET_Q, cal_offset_b_q[target_mix_gain - 8]);
+        prep->offset_i = hal->cal_offset_b_i[target_mix_gain - 8];
+        prep->offset_q = hal->cal_offset_b_q[target_mix_gain - 8];
     }
 
-    /* Set digital gain from LUT */
-    lgw_reg_w(LGW_TX_GAIN, txgain_lut.lut[pow_index].dig_gain);
+    /* digital gain from LUT */
+    prep->dig_gain = hal->txgain_lut.lut[pow_index].dig_gain;
 
-    /* fixed metadata, useful payload and misc metadata compositing */
-    transfer_size = TX_METADATA_NB + pkt_data.size; /*  */
-    payload_offset = TX_METADATA_NB; /* start the payload just after the metadata */
+    /* fixed metadata and misc metadata compositing */
+    prep->meta_size = TX_METADATA_NB;
+    memset(buff, 0, LGW_TX_META_MAX);
 
-    /* metadata 0 to 2, TX PLL frequency */
-    switch (rf_radio_type[0]) { /* we assume that there is only one radio type on the board */
-        case LGW_RADIO_TYPE_SX1255:
-            part_int = pkt_data.freq_hz / (SX125x_32MHz_FRAC << 7); /* integer part, gives the MSB */
-            part_frac = ((pkt_data.freq_hz % (SX125x_32MHz_FRAC << 7)) << 9) / SX125x_32MHz_FRAC; /* fractional part, gives middle part and LSB */
-            break;
-        case LGW_RADIO_TYPE_SX1257:
-            part_int = pkt_data.freq_hz / (SX125x_32MHz_FRAC << 8); /* integer part, gives the MSB */
-            part_frac = ((pkt_data.freq_hz % (SX125x_32MHz_FRAC << 8)) << 8) / SX125x_32MHz_FRAC; /* fractional part, gives middle part and LSB */
-            break;
-        default:
-            DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d FOR RADIO TYPE\n", rf_radio_type[0]);
-            break;
+    /* metadata 0 to 2, TX PLL frequency (integer divisions, cached for the last frequency) */
+    if ((hal->tx_pll_freq_hz == 0) || (pkt_data.freq_hz != hal->tx_pll_freq_hz)) {
+        switch (hal->rf_radio_type[0]) { /* we assume that there is only one radio type on the board */
+            case LGW_RADIO_TYPE_SX1255:
+                part_int = pkt_data.freq_hz / (SX125x_32MHz_FRAC << 7); /* integer part, gives the MSB */
+                part_frac = ((pkt_data.freq_hz % (SX125x_32MHz_FRAC << 7)) << 9) / SX125x_32MHz_FRAC; /* fractional part, gives middle part and LSB */
+                break;
+            case LGW_RADIO_TYPE_SX1257:
+                part_int = pkt_data.freq_hz / (SX125x_32MHz_FRAC << 8); /* integer part, gives the MSB */
+                part_frac = ((pkt_data.freq_hz % (SX125x_32MHz_FRAC << 8)) << 8) / SX125x_32MHz_FRAC; /* fractional part, gives middle part and LSB */
+                break;
+            default:
+                DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d FOR RADIO TYPE\n", hal->rf_radio_type[0]);
+                break;
+        }
+        hal->tx_pll_code[0] = 0xFF & part_int; /* Most Significant Byte */
+        hal->tx_pll_code[1] = 0xFF & (part_frac >> 8); /* middle byte */
+        hal->tx_pll_code[2] = 0xFF & part_frac; /* Least Significant Byte */
+        hal->tx_pll_freq_hz = pkt_data.freq_hz;
     }
+    buff[0] = hal->tx_pll_code[0];
+    buff[1] = hal->tx_pll_code[1];
+    buff[2] = hal->tx_pll_code[2];
 
-    buff[0] = 0xFF & part_int; /* Most Significant Byte */
-    buff[1] = 0xFF & (part_frac >> 8); /* middle byte */
-    buff[2] = 0xFF & part_frac; /* Least Significant Byte */
-
-    /* metadata 3 to 6, timestamp trigger value */
-    /* TX state machine must be triggered at (T0 - lgw_i_tx_start_delay_us) for packet to start being emitted at T0 */
-    if (pkt_data.tx_mode == TIMESTAMPED)
-    {
-        count_trig = pkt_data.count_us - (uint32_t)tx_start_delay;
-        buff[3] = 0xFF & (count_trig >> 24);
-        buff[4] = 0xFF & (count_trig >> 16);
-        buff[5] = 0xFF & (count_trig >> 8);
-        buff[6] = 0xFF &  count_trig;
-    }
+    /* metadata 3 to 6, timestamp trigger value, set by hal_send_prepared */
 
     /* parameters depending on modulation  */
     if (pkt_data.modulation == MOD_LORA) {
@@ -1580,8 +2260,7 @@ int lgw_send(struct lgw_pkt_tx_s pkt_data) {
 
         /* insert payload size in the packet for variable mode */
         buff[16] = pkt_data.size;
-        ++transfer_size; /* one more byte to transfer to the TX modem */
-        ++payload_offset; /* start the payload with one more byte of offset */
+        ++prep->meta_size; /* one more byte to transfer to the TX modem, before the payload */
 
         /* MSB of RF frequency is now used in AGC firmware to implement large/narrow filtering in SX1257/55 */
         buff[0] &= 0x7F; /* Always use narrow band for FSK (force MSB to 0) */
@@ -1591,44 +2270,84 @@ int lgw_send(struct lgw_pkt_tx_s pkt_data) {
         return LGW_HAL_ERROR;
     }
 
-    /* Configure TX start delay based on TX notch filter */
-    lgw_reg_w(LGW_TX_START_DELAY, tx_start_delay);
+    prep->tx_start_delay = tx_start_delay;
+    prep->pkt = pkt_data;
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int hal_send_prepared(struct lgw_pkt_tx_prep_s *prep, uint32_t count_us) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
+    uint8_t *buff = prep->meta;
+    uint32_t count_trig = 0; /* timestamp value in trigger mode corrected for TX start delay */
+    bool tx_allowed = false;
+    uint8_t trig;
+    int i, x;
+
+    /* check if the concentrator is running */
+    if (hal->is_started == false) {
+        DEBUG_MSG("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE SENDING\n");
+        return LGW_HAL_ERROR;
+    }
+
+    /* metadata 3 to 6, timestamp trigger value */
+    /* TX state machine must be triggered at (T0 - lgw_i_tx_start_delay_us) for packet to start being emitted at T0 */
+    if (prep->pkt.tx_mode == TIMESTAMPED)
+    {
+        prep->pkt.count_us = count_us;
+        count_trig = count_us - (uint32_t)prep->tx_start_delay;
+        buff[3] = 0xFF & (count_trig >> 24);
+        buff[4] = 0xFF & (count_trig >> 16);
+        buff[5] = 0xFF & (count_trig >> 8);
+        buff[6] = 0xFF &  count_trig;
+    }
+
+    switch (prep->pkt.tx_mode) {
+        case IMMEDIATE: trig = 0x01; break; /* TX_TRIG_IMMEDIATE */
+        case TIMESTAMPED: trig = 0x02; break; /* TX_TRIG_DELAYED */
+        case ON_GPS: trig = 0x04; break; /* TX_TRIG_GPS */
+        default:
+            DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", prep->pkt.tx_mode);
+            return LGW_HAL_ERROR;
+    }
 
-    /* copy payload from user struct to buffer containing metadata */
-    memcpy((void *)(buff + payload_offset), (void *)(pkt_data.payload), pkt_data.size);
+    /* all the register accesses of the TX are sent in a single SPI message */
+    lgw_reg_batch_begin();
+
+    /* TX imbalance correction, digital gain and TX start delay, only written when changed */
+    tx_reg_w(TX_REG_OFFSET_I, LGW_TX_OFFSET_I, prep->offset_i);
+    tx_reg_w(TX_REG_OFFSET_Q, LGW_TX_OFFSET_Q, prep->offset_q);
+    tx_reg_w(TX_REG_GAIN, LGW_TX_GAIN, prep->dig_gain);
+    tx_reg_w(TX_REG_START_DELAY, LGW_TX_START_DELAY, prep->tx_start_delay);
 
     /* reset TX command flags */
-    lgw_abort_tx();
+    lgw_reg_w(LGW_TX_TRIG_ALL, 0);
 
     /* put metadata + payload in the TX data buffer */
     lgw_reg_w(LGW_TX_DATA_BUF_ADDR, 0);
-    lgw_reg_wb(LGW_TX_DATA_BUF_DATA, buff, transfer_size);
-    DEBUG_ARRAY(i, transfer_size, buff);
+    lgw_reg_wb(LGW_TX_DATA_BUF_DATA, buff, prep->meta_size);
+    if (prep->pkt.size > 0) {
+        lgw_reg_wb(LGW_TX_DATA_BUF_DATA, prep->pkt.payload, prep->pkt.size); /* data port, continues after the metadata */
+    }
+    DEBUG_ARRAY(i, prep->meta_size, buff);
 
-    x = lbt_is_channel_free(&pkt_data, tx_start_delay, &tx_allowed);
+    x = lbt_is_channel_free(&prep->pkt, prep->tx_start_delay, &tx_allowed);
     if (x != LGW_LBT_SUCCESS) {
+        lgw_reg_batch_end();
         DEBUG_MSG("ERROR: Failed to check channel availability for TX\n");
         return LGW_HAL_ERROR;
     }
     if (tx_allowed == true) {
-        switch(pkt_data.tx_mode) {
-            case IMMEDIATE:
-                lgw_reg_w(LGW_TX_TRIG_IMMEDIATE, 1);
-                break;
-
-            case TIMESTAMPED:
-                lgw_reg_w(LGW_TX_TRIG_DELAYED, 1);
-                break;
-
-            case ON_GPS:
-                lgw_reg_w(LGW_TX_TRIG_GPS, 1);
-                break;
-
-            default:
-                DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", pkt_data.tx_mode);
-                return LGW_HAL_ERROR;
+        /* the TX command flags were just cleared, set the one of the TX mode */
+        lgw_reg_w(LGW_TX_TRIG_ALL, trig);
+        if (lgw_reg_batch_end() != LGW_REG_SUCCESS) {
+            DEBUG_MSG("ERROR: FAILED TO SEND TX REGISTERS\n");
+            tx_reg_invalidate();
+            return LGW_HAL_ERROR;
         }
     } else {
+        lgw_reg_batch_end();
         DEBUG_MSG("ERROR: Cannot send packet, channel is busy (LBT)\n");
         return LGW_LBT_ISSUE;
     }
@@ -1638,7 +2357,32 @@ int lgw_send(struct lgw_pkt_tx_s pkt_data) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_rx_pending(uint8_t *nb_pkt) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
+    int i;
+    int32_t val;
+
+    CHECK_NULL(nb_pkt);
+
+    /* check if the concentrator is running */
+    if (hal->is_started == false) {
+        DEBUG_MSG("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE RECEIVING\n");
+        return LGW_HAL_ERROR;
+    }
+
+    i = lgw_reg_r(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, &val);
+    if (i == LGW_REG_SUCCESS) {
+        *nb_pkt = (uint8_t)val;
+        return LGW_HAL_SUCCESS;
+    } else {
+        return LGW_HAL_ERROR;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_status(uint8_t select, uint8_t *code) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
     int32_t read_value;
 
     /* check input variables */
@@ -1646,7 +2390,7 @@ int lgw_status(uint8_t select, uint8_t *code) {
 
     if (select == TX_STATUS) {
         lgw_reg_r(LGW_TX_STATUS, &read_value);
-        if (lgw_is_started == false) {
+        if (hal->is_started == false) {
             *code = TX_OFF;
         } else if ((read_value & 0x10) == 0) { /* bit 4 @1: TX programmed */
             *code = TX_FREE;
@@ -1671,9 +2415,12 @@ int lgw_status(uint8_t select, uint8_t *code) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_abort_tx(void) {
+    struct lgw_hal_state_s *hal = lgw_ctx_cur->hal;
     int i;
 
+    pthread_mutex_lock(&hal->mx_tx);
     i = lgw_reg_w(LGW_TX_TRIG_ALL, 0);
+    pthread_mutex_unlock(&hal->mx_tx);
 
     if (i == LGW_REG_SUCCESS) return LGW_HAL_SUCCESS;
     else return LGW_HAL_ERROR;
@@ -1703,11 +2450,7 @@ const char* lgw_version_info() {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 uint32_t lgw_time_on_air(struct lgw_pkt_tx_s *packet) {
-    int32_t val;
-    uint8_t SF, H, DE;
-    uint16_t BW;
-    uint32_t payloadSymbNb, Tpacket;
-    double Tsym, Tpreamble, Tpayload, Tfsk;
+    uint32_t symb_us, quarter_nb;
 
     if (packet == NULL) {
         DEBUG_MSG("ERROR: Failed to compute time on air, wrong parameter\n");
@@ -1715,58 +2458,72 @@ uint32_t lgw_time_on_air(struct lgw_pkt_tx_s *packet) {
     }
 
     if (packet->modulation == MOD_LORA) {
-        /* Get bandwidth */
-        val = lgw_bw_getval(packet->bandwidth);
-        if (val != -1) {
-            BW = (uint16_t)(val / 1E3);
-        } else {
-            DEBUG_PRINTF("ERROR: Cannot compute time on air for this packet, unsupported bandwidth (0x%02X)\n", packet->bandwidth);
+        if (toa_lora_symb(packet, &symb_us, &quarter_nb) != 0) {
             return 0;
         }
+        return (uint32_t)(((uint64_t)quarter_nb * symb_us / 4) / 1000);
+    } else if ((packet->modulation == MOD_FSK) && (packet->datarate != 0)) {
+        return (uint32_t)(toa_fsk_bits(packet) * 1000 / packet->datarate) + 1; /* add margin for rounding */
+    } else {
+        DEBUG_PRINTF("ERROR: Cannot compute time on air for this packet, unsupported modulation (0x%02X)\n", packet->modulation);
+        return 0;
+    }
+}
 
-        /* Get datarate */
-        val = lgw_sf_getval(packet->datarate);
-        if (val != -1) {
-            SF = (uint8_t)val;
-        } else {
-            DEBUG_PRINTF("ERROR: Cannot compute time on air for this packet, unsupported datarate (0x%02X)\n", packet->datarate);
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint32_t lgw_time_on_air_us(struct lgw_pkt_tx_s *packet) {
+    uint32_t symb_us, quarter_nb;
+
+    if (packet == NULL) {
+        DEBUG_MSG("ERROR: Failed to compute time on air, wrong parameter\n");
+        return 0;
+    }
+
+    if (packet->modulation == MOD_LORA) {
+        if (toa_lora_symb(packet, &symb_us, &quarter_nb) != 0) {
             return 0;
         }
+        return (uint32_t)((uint64_t)quarter_nb * symb_us / 4); /* symbols are at least 256 us long, exact */
+    } else if ((packet->modulation == MOD_FSK) && (packet->datarate != 0)) {
+        return (uint32_t)((toa_fsk_bits(packet) * 1000000 + packet->datarate - 1) / packet->datarate); /* rounded up */
+    } else {
+        DEBUG_PRINTF("ERROR: Cannot compute time on air for this packet, unsupported modulation (0x%02X)\n", packet->modulation);
+        return 0;
+    }
+}
 
-        /* Duration of 1 symbol */
-        Tsym = pow(2, SF) / BW;
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-        /* Duration of preamble */
-        Tpreamble = ((double)(packet->preamble) + 4.25) * Tsym;
+int lgw_time_on_air_batch(struct lgw_pkt_tx_s *packets, uint16_t nb_pkt, uint32_t *toa_us) {
+    int i;
 
-        /* Duration of payload */
-        H = (packet->no_header==false) ? 0 : 1; /* header is always enabled, except for beacons */
-        DE = (SF >= 11) ? 1 : 0; /* Low datarate optimization enabled for SF11 and SF12 */
+    CHECK_NULL(packets);
+    CHECK_NULL(toa_us);
 
-        payloadSymbNb = 8 + (ceil((double)(8*packet->size - 4*SF + 28 + 16 - 20*H) / (double)(4*(SF - 2*DE))) * (packet->coderate + 4)); /* Explicitely cast to double to keep precision of the division */
+    for (i = 0; i < nb_pkt; ++i) {
+        toa_us[i] = lgw_time_on_air_us(&packets[i]);
+    }
+    return LGW_HAL_SUCCESS;
+}
 
-        Tpayload = payloadSymbNb * Tsym;
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-        /* Duration of packet */
-        Tpacket = Tpreamble + Tpayload;
-    } else if (packet->modulation == MOD_FSK) {
-        /* PREAMBLE + SYNC_WORD + PKT_LEN + PKT_PAYLOAD + CRC
-                PREAMBLE: default 5 bytes
-                SYNC_WORD: default 3 bytes
-                PKT_LEN: 1 byte (variable length mode)
-                PKT_PAYLOAD: x bytes
-                CRC: 0 or 2 bytes
-        */
-        Tfsk = (8 * (double)(packet->preamble + fsk_sync_word_size + 1 + packet->size + ((packet->no_crc == true) ? 0 : 2)) / (double)packet->datarate) * 1E3;
+struct lgw_hal_state_s *lgw_hal_state_new(void) {
+    struct lgw_hal_state_s *state;
 
-        /* Duration of packet */
-        Tpacket = (uint32_t)Tfsk + 1; /* add margin for rounding */
-    } else {
-        Tpacket = 0;
-        DEBUG_PRINTF("ERROR: Cannot compute time on air for this packet, unsupported modulation (0x%02X)\n", packet->modulation);
+    state = malloc(sizeof *state);
+    if (state == NULL) {
+        return NULL;
     }
+    *state = (struct lgw_hal_state_s)HAL_STATE_INIT;
+    return state;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-    return Tpacket;
+void lgw_hal_state_free(struct lgw_hal_state_s *state) {
+    free(state);
 }
 
 /* --- EOF ------------------------------------------------------------------ */
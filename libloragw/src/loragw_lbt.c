@@ -19,13 +19,14 @@ Maintainer: Michael Coracin
 #include <stdint.h>     /* C99 types */
 #include <stdbool.h>    /* bool type */
 #include <stdio.h>      /* printf fprintf */
-#include <stdlib.h>     /* abs, labs, llabs */
+#include <stdlib.h>     /* abs, labs, llabs, malloc, free */
 #include <string.h>     /* memset */
 
 #include "loragw_radio.h"
 #include "loragw_aux.h"
 #include "loragw_lbt.h"
 #include "loragw_fpga.h"
+#include "loragw_ctx.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -50,21 +51,24 @@ Maintainer: Michael Coracin
 /* --- PRIVATE CONSTANTS ---------------------------------------------------- */
 
 /* -------------------------------------------------------------------------- */
-/* --- INTERNAL SHARED VARIABLES -------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
-extern void *lgw_spi_target; /*! generic pointer to the SPI device */
-extern uint8_t lgw_spi_mux_mode; /*! current SPI mux mode used */
-extern uint16_t lgw_i_tx_start_delay_us;
+/* state of the LBT module, one per concentrator context */
+struct lgw_lbt_state_s {
+    bool                        enable;
+    uint8_t                     nb_active_channel;
+    int8_t                      rssi_target_dBm;
+    int8_t                      rssi_offset_dB;
+    uint32_t                    start_freq;
+    struct lgw_conf_lbt_chan_s  channel_cfg[LBT_CHANNEL_FREQ_NB];
+};
+
+#define LBT_STATE_INIT { .enable = false }
 
 /* -------------------------------------------------------------------------- */
-/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+/* --- INTERNAL SHARED VARIABLES -------------------------------------------- */
 
-static bool lbt_enable;
-static uint8_t lbt_nb_active_channel;
-static int8_t lbt_rssi_target_dBm;
-static int8_t lbt_rssi_offset_dB;
-static uint32_t lbt_start_freq;
-static struct lgw_conf_lbt_chan_s lbt_channel_cfg[LBT_CHANNEL_FREQ_NB];
+struct lgw_lbt_state_s lgw_lbt_state_default = LBT_STATE_INIT; /*! state of the default context */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
@@ -75,6 +79,7 @@ bool is_equal_freq(uint32_t a, uint32_t b);
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
 int lbt_setconf(struct lgw_conf_lbt_s * conf) {
+    struct lgw_lbt_state_s *lbt = lgw_ctx_cur->lbt;
     int i;
 
     /* Check input parameters */
@@ -87,17 +92,17 @@ int lbt_setconf(struct lgw_conf_lbt_s * conf) {
     }
 
     /* Initialize LBT channels configuration */
-    memset(lbt_channel_cfg, 0, sizeof lbt_channel_cfg);
+    memset(lbt->channel_cfg, 0, sizeof lbt->channel_cfg);
 
     /* Set internal LBT config according to parameters */
-    lbt_enable = conf->enable;
-    lbt_nb_active_channel = conf->nb_channel;
-    lbt_rssi_target_dBm = conf->rssi_target;
-    lbt_rssi_offset_dB = conf->rssi_offset;
-
-    for (i=0; i<lbt_nb_active_channel; i++) {
-        lbt_channel_cfg[i].freq_hz = conf->channels[i].freq_hz;
-        lbt_channel_cfg[i].scan_time_us = conf->channels[i].scan_time_us;
+    lbt->enable = conf->enable;
+    lbt->nb_active_channel = conf->nb_channel;
+    lbt->rssi_target_dBm = conf->rssi_target;
+    lbt->rssi_offset_dB = conf->rssi_offset;
+
+    for (i=0; i<lbt->nb_active_channel; i++) {
+        lbt->channel_cfg[i].freq_hz = conf->channels[i].freq_hz;
+        lbt->channel_cfg[i].scan_time_us = conf->channels[i].scan_time_us;
     }
 
     return LGW_LBT_SUCCESS;
@@ -106,6 +111,7 @@ int lbt_setconf(struct lgw_conf_lbt_s * conf) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lbt_setup(void) {
+    struct lgw_lbt_state_s *lbt = lgw_ctx_cur->lbt;
     int x, i;
     int32_t val;
     uint32_t freq_offset;
@@ -129,10 +135,10 @@ int lbt_setup(void) {
     }
     switch(val) {
         case 0:
-            lbt_start_freq = 915000000;
+            lbt->start_freq = 915000000;
             break;
         case 1:
-            lbt_start_freq = 863000000;
+            lbt->start_freq = 863000000;
             break;
         default:
             DEBUG_PRINTF("ERROR: LBT start frequency %d is not supported\n", val);
@@ -140,43 +146,43 @@ int lbt_setup(void) {
     }
 
     /* Configure SX127x for FSK */
-    x = lgw_setup_sx127x(lbt_start_freq, MOD_FSK, LGW_SX127X_RXBW_100K_HZ, lbt_rssi_offset_dB); /* 200KHz LBT channels */
+    x = lgw_setup_sx127x(lbt->start_freq, MOD_FSK, LGW_SX127X_RXBW_100K_HZ, lbt->rssi_offset_dB); /* 200KHz LBT channels */
     if (x != LGW_REG_SUCCESS) {
         DEBUG_MSG("ERROR: Failed to configure SX127x for LBT\n");
         return LGW_LBT_ERROR;
     }
 
     /* Configure FPGA for LBT */
-    val = -2*lbt_rssi_target_dBm; /* Convert RSSI target in dBm to FPGA register format */
+    val = -2*lbt->rssi_target_dBm; /* Convert RSSI target in dBm to FPGA register format */
     x = lgw_fpga_reg_w(LGW_FPGA_RSSI_TARGET, val);
     if (x != LGW_REG_SUCCESS) {
         DEBUG_MSG("ERROR: Failed to configure FPGA for LBT\n");
         return LGW_LBT_ERROR;
     }
     /* Set default values for non-active LBT channels */
-    for (i=lbt_nb_active_channel; i<LBT_CHANNEL_FREQ_NB; i++) {
-        lbt_channel_cfg[i].freq_hz = lbt_start_freq;
-        lbt_channel_cfg[i].scan_time_us = 128; /* fastest scan for non-active channels */
+    for (i=lbt->nb_active_channel; i<LBT_CHANNEL_FREQ_NB; i++) {
+        lbt->channel_cfg[i].freq_hz = lbt->start_freq;
+        lbt->channel_cfg[i].scan_time_us = 128; /* fastest scan for non-active channels */
     }
     /* Configure FPGA for both active and non-active LBT channels */
     for (i=0; i<LBT_CHANNEL_FREQ_NB; i++) {
         /* Check input parameters */
-        if (lbt_channel_cfg[i].freq_hz < lbt_start_freq) {
-            DEBUG_PRINTF("ERROR: LBT channel frequency is out of range (%u)\n", lbt_channel_cfg[i].freq_hz);
+        if (lbt->channel_cfg[i].freq_hz < lbt->start_freq) {
+            DEBUG_PRINTF("ERROR: LBT channel frequency is out of range (%u)\n", lbt->channel_cfg[i].freq_hz);
             return LGW_LBT_ERROR;
         }
-        if ((lbt_channel_cfg[i].scan_time_us != 128) && (lbt_channel_cfg[i].scan_time_us != 5000)) {
-            DEBUG_PRINTF("ERROR: LBT channel scan time is not supported (%u)\n", lbt_channel_cfg[i].scan_time_us);
+        if ((lbt->channel_cfg[i].scan_time_us != 128) && (lbt->channel_cfg[i].scan_time_us != 5000)) {
+            DEBUG_PRINTF("ERROR: LBT channel scan time is not supported (%u)\n", lbt->channel_cfg[i].scan_time_us);
             return LGW_LBT_ERROR;
         }
         /* Configure */
-        freq_offset = (lbt_channel_cfg[i].freq_hz - lbt_start_freq) / 100E3; /* 100kHz unit */
+        freq_offset = (lbt->channel_cfg[i].freq_hz - lbt->start_freq) / 100E3; /* 100kHz unit */
         x = lgw_fpga_reg_w(LGW_FPGA_LBT_CH0_FREQ_OFFSET+i, (int32_t)freq_offset);
         if (x != LGW_REG_SUCCESS) {
             DEBUG_PRINTF("ERROR: Failed to configure FPGA for LBT channel %d (freq offset)\n", i);
             return LGW_LBT_ERROR;
         }
-        if (lbt_channel_cfg[i].scan_time_us == 5000) { /* configured to 128 by default */
+        if (lbt->channel_cfg[i].scan_time_us == 5000) { /* configured to 128 by default */
             x = lgw_fpga_reg_w(LGW_FPGA_LBT_SCAN_TIME_CH0+i, 1);
             if (x != LGW_REG_SUCCESS) {
                 DEBUG_PRINTF("ERROR: Failed to configure FPGA for LBT channel %d (freq offset)\n", i);
@@ -186,13 +192,13 @@ int lbt_setup(void) {
     }
 
     DEBUG_MSG("Note: LBT configuration:\n");
-    DEBUG_PRINTF("\tlbt_enable: %d\n", lbt_enable );
-    DEBUG_PRINTF("\tlbt_nb_active_channel: %d\n", lbt_nb_active_channel );
-    DEBUG_PRINTF("\tlbt_start_freq: %d\n", lbt_start_freq);
-    DEBUG_PRINTF("\tlbt_rssi_target: %d\n", lbt_rssi_target_dBm );
+    DEBUG_PRINTF("\tlbt_enable: %d\n", lbt->enable );
+    DEBUG_PRINTF("\tlbt_nb_active_channel: %d\n", lbt->nb_active_channel );
+    DEBUG_PRINTF("\tlbt_start_freq: %d\n", lbt->start_freq);
+    DEBUG_PRINTF("\tlbt_rssi_target: %d\n", lbt->rssi_target_dBm );
     for (i=0; i<LBT_CHANNEL_FREQ_NB; i++) {
-        DEBUG_PRINTF("\tlbt_channel_cfg[%d].freq_hz: %u\n", i, lbt_channel_cfg[i].freq_hz );
-        DEBUG_PRINTF("\tlbt_channel_cfg[%d].scan_time_us: %u\n", i, lbt_channel_cfg[i].scan_time_us );
+        DEBUG_PRINTF("\tlbt_channel_cfg[%d].freq_hz: %u\n", i, lbt->channel_cfg[i].freq_hz );
+        DEBUG_PRINTF("\tlbt_channel_cfg[%d].scan_time_us: %u\n", i, lbt->channel_cfg[i].scan_time_us );
     }
 
     return LGW_LBT_SUCCESS;
@@ -216,6 +222,7 @@ int lbt_start(void) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lbt_is_channel_free(struct lgw_pkt_tx_s * pkt_data, uint16_t tx_start_delay, bool * tx_allowed) {
+    struct lgw_lbt_state_s *lbt = lgw_ctx_cur->lbt;
     int i;
     int32_t val;
     uint32_t tx_start_time = 0;
@@ -236,7 +243,7 @@ int lbt_is_channel_free(struct lgw_pkt_tx_s * pkt_data, uint16_t tx_start_delay,
     }
 
     /* Check if TX is allowed */
-    if (lbt_enable == true) {
+    if (lbt->enable == true) {
         /* TX allowed for LoRa only */
         if (pkt_data->modulation != MOD_LORA) {
             *tx_allowed = false;
@@ -268,12 +275,12 @@ int lbt_is_channel_free(struct lgw_pkt_tx_s * pkt_data, uint16_t tx_start_delay,
         lbt_channel_decod_1 = -1;
         lbt_channel_decod_2 = -1;
         if (pkt_data->bandwidth == BW_125KHZ) {
-            for (i=0; i<lbt_nb_active_channel; i++) {
-                if (is_equal_freq(pkt_data->freq_hz, lbt_channel_cfg[i].freq_hz) == true) {
-                    DEBUG_PRINTF("LBT: select channel %d (%u Hz)\n", i, lbt_channel_cfg[i].freq_hz);
+            for (i=0; i<lbt->nb_active_channel; i++) {
+                if (is_equal_freq(pkt_data->freq_hz, lbt->channel_cfg[i].freq_hz) == true) {
+                    DEBUG_PRINTF("LBT: select channel %d (%u Hz)\n", i, lbt->channel_cfg[i].freq_hz);
                     lbt_channel_decod_1 = i;
                     lbt_channel_decod_2 = i;
-                    if (lbt_channel_cfg[i].scan_time_us == 5000) {
+                    if (lbt->channel_cfg[i].scan_time_us == 5000) {
                         tx_max_time = 4000000; /* 4 seconds */
                     } else { /* scan_time_us = 128 */
                         tx_max_time = 400000; /* 400 milliseconds */
@@ -284,12 +291,12 @@ int lbt_is_channel_free(struct lgw_pkt_tx_s * pkt_data, uint16_t tx_start_delay,
         } else if (pkt_data->bandwidth == BW_250KHZ) {
             /* In case of 250KHz, the TX freq has to be in between 2 consecutive channels of 200KHz BW.
                 The TX can only be over 2 channels, not more */
-            for (i=0; i<(lbt_nb_active_channel-1); i++) {
-                if ((is_equal_freq(pkt_data->freq_hz, (lbt_channel_cfg[i].freq_hz+lbt_channel_cfg[i+1].freq_hz)/2) == true) && ((lbt_channel_cfg[i+1].freq_hz-lbt_channel_cfg[i].freq_hz)==200E3)) {
-                    DEBUG_PRINTF("LBT: select channels %d,%d (%u Hz)\n", i, i+1, (lbt_channel_cfg[i].freq_hz+lbt_channel_cfg[i+1].freq_hz)/2);
+            for (i=0; i<(lbt->nb_active_channel-1); i++) {
+                if ((is_equal_freq(pkt_data->freq_hz, (lbt->channel_cfg[i].freq_hz+lbt->channel_cfg[i+1].freq_hz)/2) == true) && ((lbt->channel_cfg[i+1].freq_hz-lbt->channel_cfg[i].freq_hz)==200E3)) {
+                    DEBUG_PRINTF("LBT: select channels %d,%d (%u Hz)\n", i, i+1, (lbt->channel_cfg[i].freq_hz+lbt->channel_cfg[i+1].freq_hz)/2);
                     lbt_channel_decod_1 = i;
                     lbt_channel_decod_2 = i+1;
-                    if (lbt_channel_cfg[i].scan_time_us == 5000) {
+                    if (lbt->channel_cfg[i].scan_time_us == 5000) {
                         tx_max_time = 4000000; /* 4 seconds */
                     } else { /* scan_time_us = 128 */
                         tx_max_time = 200000; /* 200 milliseconds */
@@ -320,7 +327,7 @@ int lbt_is_channel_free(struct lgw_pkt_tx_s * pkt_data, uint16_t tx_start_delay,
             lbt_time = 0;
         }
 
-        packet_duration = lgw_time_on_air(pkt_data) * 1000UL;
+        packet_duration = lgw_time_on_air_us(pkt_data);
         tx_end_time = (tx_start_time + packet_duration) & LBT_TIMESTAMP_MASK;
         if (lbt_time < tx_end_time) {
             delta_time = tx_end_time - lbt_time;
@@ -362,7 +369,9 @@ int lbt_is_channel_free(struct lgw_pkt_tx_s * pkt_data, uint16_t tx_start_delay,
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 bool lbt_is_enabled(void) {
-    return lbt_enable;
+    struct lgw_lbt_state_s *lbt = lgw_ctx_cur->lbt;
+
+    return lbt->enable;
 }
 
 /* -------------------------------------------------------------------------- */
@@ -388,4 +397,23 @@ bool is_equal_freq(uint32_t a, uint32_t b) {
     return false;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+struct lgw_lbt_state_s *lgw_lbt_state_new(void) {
+    struct lgw_lbt_state_s *state;
+
+    state = malloc(sizeof *state);
+    if (state == NULL) {
+        return NULL;
+    }
+    *state = (struct lgw_lbt_state_s)LBT_STATE_INIT;
+    return state;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_lbt_state_free(struct lgw_lbt_state_s *state) {
+    free(state);
+}
+
 /* --- EOF ------------------------------------------------------------------ */
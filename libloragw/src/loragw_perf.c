@@ -0,0 +1,602 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Always-compiled instrumentation of the library hot paths.
+    Each thread records in its own slot, published to the readers with a
+    sequence counter: recording costs two clock reads and a few stores, and
+    never waits for a reader.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#define _GNU_SOURCE     /* needed for pthread_getname_np and syscall to be defined */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf snprintf fopen fwrite */
+#include <stdlib.h>     /* malloc free */
+#include <string.h>     /* memset memcpy strcmp */
+#include <errno.h>      /* ETIMEDOUT */
+#include <time.h>       /* clock_gettime */
+#include <pthread.h>
+#include <unistd.h>     /* syscall */
+#include <sys/syscall.h> /* SYS_gettid */
+
+#include "loragw_perf.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#if DEBUG_PERF == 1
+    #define DEBUG_MSG(str)              fprintf(stderr, str)
+    #define DEBUG_PRINTF(fmt, args...)  fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+    #define CHECK_NULL(a)               if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_PERF_ERROR;}
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+    #define CHECK_NULL(a)               if(a==NULL){return LGW_PERF_ERROR;}
+#endif
+
+#define ATOMIC_LOAD(p)          __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(p, v)      __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define ATOMIC_INC(p)           __atomic_add_fetch(p, 1, __ATOMIC_RELAXED)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/*
+The owner thread makes seq odd before updating its counters and even again
+after, readers retry their copy until they see the same even value before and
+after it. A slot stays bound to its thread until the thread exits, then it is
+handed, counters included, to the next thread needing one.
+*/
+struct perf_slot_s {
+    uint32_t                    seq;
+    bool                        used;   /* bound to a thread at least once */
+    bool                        owned;  /* bound to a running thread */
+    struct lgw_perf_thread_s    c;
+};
+
+/* header of the export file */
+struct perf_file_s {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    size;       /* size of the snapshot that follows */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define PERF_MAGIC      "LGWPERF"
+#define PERF_VERSION    1
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static bool perf_enabled = true;
+static uint32_t perf_nb_lost = 0;
+
+static struct perf_slot_s perf_slot[LGW_PERF_THREAD_MAX];
+static pthread_mutex_t mx_perf = PTHREAD_MUTEX_INITIALIZER; /* slot binding and snapshots */
+static pthread_once_t perf_once = PTHREAD_ONCE_INIT;
+static pthread_key_t perf_key; /* releases the slot when its thread exits */
+
+static __thread struct perf_slot_s *perf_cur = NULL;
+static __thread bool perf_no_slot = false;
+
+/* export thread */
+static pthread_t export_thread;
+static pthread_mutex_t mx_export = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_export;
+static bool export_running = false;
+static char *export_path = NULL;
+static uint32_t export_period_ms;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static uint64_t perf_now(void);
+
+static int perf_bucket(uint64_t ns);
+
+static void perf_release(void *arg);
+
+static void perf_key_create(void);
+
+static struct perf_slot_s *perf_bind(void);
+
+static void perf_copy(struct perf_slot_s *slot, struct lgw_perf_thread_s *dest);
+
+static void perf_sum(struct lgw_perf_probe_s *sum, const struct lgw_perf_probe_s *p);
+
+static void *perf_export_thread(void *arg);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static uint64_t perf_now(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* log-linear bucket: power of two, then the next LGW_PERF_HIST_SUB_LOG2 bits */
+static int perf_bucket(uint64_t ns) {
+    int log2;
+
+    if (ns < (1ULL << LGW_PERF_HIST_LOG2_MIN)) {
+        return 0;
+    }
+    log2 = 63 - __builtin_clzll(ns);
+    if (log2 >= LGW_PERF_HIST_LOG2_MAX) {
+        return LGW_PERF_HIST_NB - 1;
+    }
+    return 1 + (log2 - LGW_PERF_HIST_LOG2_MIN) * LGW_PERF_HIST_SUB + (int)((ns >> (log2 - LGW_PERF_HIST_SUB_LOG2)) & (LGW_PERF_HIST_SUB - 1));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* thread exit: the slot keeps its counters and can be bound to another thread */
+static void perf_release(void *arg) {
+    struct perf_slot_s *slot = arg;
+
+    pthread_mutex_lock(&mx_perf);
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->c.tid = 0;
+    ATOMIC_STORE(&slot->seq, slot->seq + 1);
+    slot->owned = false;
+    pthread_mutex_unlock(&mx_perf);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void perf_key_create(void) {
+    pthread_key_create(&perf_key, perf_release);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Bind a slot to the calling thread: preferably the slot of an exited thread of
+the same name (eg. a restarted RX queue thread), then a never used one, then
+any free one */
+static struct perf_slot_s *perf_bind(void) {
+    struct perf_slot_s *slot = NULL;
+    char name[LGW_PERF_NAME_SIZE];
+    int i;
+
+    pthread_once(&perf_once, perf_key_create);
+    memset(name, 0, sizeof name);
+    pthread_getname_np(pthread_self(), name, sizeof name);
+
+    pthread_mutex_lock(&mx_perf);
+    for (i = 0; (slot == NULL) && (i < LGW_PERF_THREAD_MAX); ++i) {
+        if (perf_slot[i].used && !perf_slot[i].owned && (strcmp(perf_slot[i].c.name, name) == 0)) {
+            slot = &perf_slot[i];
+        }
+    }
+    for (i = 0; (slot == NULL) && (i < LGW_PERF_THREAD_MAX); ++i) {
+        if (!perf_slot[i].used) {
+            slot = &perf_slot[i];
+        }
+    }
+    for (i = 0; (slot == NULL) && (i < LGW_PERF_THREAD_MAX); ++i) {
+        if (!perf_slot[i].owned) {
+            slot = &perf_slot[i];
+        }
+    }
+    if (slot != NULL) {
+        __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        memcpy(slot->c.name, name, sizeof name);
+        slot->c.tid = (int32_t)syscall(SYS_gettid);
+        ATOMIC_STORE(&slot->seq, slot->seq + 1);
+        slot->used = true;
+        slot->owned = true;
+        pthread_setspecific(perf_key, slot);
+        DEBUG_PRINTF("Note: thread %d (%s) bound to slot %d\n", slot->c.tid, name, (int)(slot - perf_slot));
+    } else {
+        DEBUG_PRINTF("WARNING: no slot left for thread %s, it will not be measured\n", name);
+        perf_no_slot = true;
+    }
+    pthread_mutex_unlock(&mx_perf);
+
+    perf_cur = slot;
+    return slot;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* consistent copy of the counters of a slot, while its thread keeps recording */
+static void perf_copy(struct perf_slot_s *slot, struct lgw_perf_thread_s *dest) {
+    uint32_t seq;
+
+    for (;;) {
+        seq = ATOMIC_LOAD(&slot->seq);
+        if ((seq & 1) != 0) {
+            continue; /* update in progress */
+        }
+        memcpy(dest, &slot->c, sizeof *dest);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq) {
+            return;
+        }
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void perf_sum(struct lgw_perf_probe_s *sum, const struct lgw_perf_probe_s *p) {
+    int i;
+
+    sum->nb_call += p->nb_call;
+    sum->total_ns += p->total_ns;
+    if (p->max_ns > sum->max_ns) {
+        sum->max_ns = p->max_ns;
+    }
+    for (i = 0; i < LGW_PERF_HIST_NB; ++i) {
+        sum->hist[i] += p->hist[i];
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void *perf_export_thread(void *arg) {
+    struct timespec next;
+    int x = 0;
+
+    (void)arg;
+    pthread_setname_np(pthread_self(), "lgw_perf");
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    pthread_mutex_lock(&mx_export);
+    while (export_running) {
+        if (x == ETIMEDOUT) {
+            lgw_perf_export(export_path);
+        }
+        if (x != 0) {
+            next.tv_sec += export_period_ms / 1000;
+            next.tv_nsec += (export_period_ms % 1000) * 1000000;
+            if (next.tv_nsec >= 1000000000) {
+                next.tv_sec += 1;
+                next.tv_nsec -= 1000000000;
+            }
+        }
+        x = pthread_cond_timedwait(&cond_export, &mx_export, &next);
+    }
+    pthread_mutex_unlock(&mx_export);
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- INTERNAL SHARED FUNCTIONS -------------------------------------------- */
+
+uint64_t lgw_perf_start(void) {
+    if (!__atomic_load_n(&perf_enabled, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+    return perf_now();
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_perf_stop(enum lgw_perf_probe_e probe, uint64_t t0) {
+    struct perf_slot_s *slot = perf_cur;
+    struct lgw_perf_probe_s *p;
+    uint64_t ns;
+
+    if (t0 == 0) {
+        return;
+    }
+    ns = perf_now() - t0;
+    if ((slot == NULL) && (perf_no_slot || ((slot = perf_bind()) == NULL))) {
+        ATOMIC_INC(&perf_nb_lost);
+        return;
+    }
+
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    p = &slot->c.probe[probe];
+    p->nb_call += 1;
+    p->total_ns += ns;
+    if (ns > p->max_ns) {
+        p->max_ns = ns;
+    }
+    p->hist[perf_bucket(ns)] += 1;
+    ATOMIC_STORE(&slot->seq, slot->seq + 1);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_perf_add(enum lgw_perf_counter_e counter, uint64_t n) {
+    struct perf_slot_s *slot = perf_cur;
+
+    if (!__atomic_load_n(&perf_enabled, __ATOMIC_RELAXED)) {
+        return;
+    }
+    if ((slot == NULL) && (perf_no_slot || ((slot = perf_bind()) == NULL))) {
+        ATOMIC_INC(&perf_nb_lost);
+        return;
+    }
+
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->c.counter[counter] += n;
+    ATOMIC_STORE(&slot->seq, slot->seq + 1);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int lgw_perf_enable(bool enable) {
+    __atomic_store_n(&perf_enabled, enable, __ATOMIC_RELAXED);
+    return LGW_PERF_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_perf_snapshot(struct lgw_perf_snapshot_s *snap) {
+    int i, j;
+
+    CHECK_NULL(snap);
+
+    memset(snap, 0, sizeof *snap);
+    pthread_mutex_lock(&mx_perf);
+    for (i = 0; i < LGW_PERF_THREAD_MAX; ++i) {
+        if (!perf_slot[i].used) {
+            continue;
+        }
+        perf_copy(&perf_slot[i], &snap->thread[snap->nb_thread]);
+        for (j = 0; j < LGW_PERF_PROBE_NB; ++j) {
+            perf_sum(&snap->probe[j], &snap->thread[snap->nb_thread].probe[j]);
+        }
+        for (j = 0; j < LGW_PERF_COUNTER_NB; ++j) {
+            snap->counter[j] += snap->thread[snap->nb_thread].counter[j];
+        }
+        snap->nb_thread += 1;
+    }
+    pthread_mutex_unlock(&mx_perf);
+    snap->nb_lost = __atomic_load_n(&perf_nb_lost, __ATOMIC_RELAXED);
+    snap->time_ns = perf_now();
+
+    return LGW_PERF_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_perf_diff(const struct lgw_perf_snapshot_s *older, const struct lgw_perf_snapshot_s *newer, struct lgw_perf_snapshot_s *diff) {
+    struct lgw_perf_probe_s *d;
+    const struct lgw_perf_probe_s *o, *n;
+    int i, j, k;
+
+    CHECK_NULL(older);
+    CHECK_NULL(newer);
+    CHECK_NULL(diff);
+
+    if (diff != newer) {
+        memcpy(diff, newer, sizeof *diff);
+    }
+    diff->time_ns -= older->time_ns;
+    diff->nb_lost -= older->nb_lost;
+
+    /* slots are never freed, so slot i of the older snapshot is slot i of the newer one */
+    for (i = -1; i < (int)older->nb_thread; ++i) {
+        for (j = 0; j < LGW_PERF_PROBE_NB; ++j) {
+            o = (i < 0) ? &older->probe[j] : &older->thread[i].probe[j];
+            d = (i < 0) ? &diff->probe[j] : &diff->thread[i].probe[j];
+            n = d;
+            d->nb_call = n->nb_call - o->nb_call;
+            d->total_ns = n->total_ns - o->total_ns;
+            for (k = 0; k < LGW_PERF_HIST_NB; ++k) {
+                d->hist[k] = n->hist[k] - o->hist[k];
+            }
+        }
+        for (j = 0; j < LGW_PERF_COUNTER_NB; ++j) {
+            if (i < 0) {
+                diff->counter[j] -= older->counter[j];
+            } else {
+                diff->thread[i].counter[j] -= older->thread[i].counter[j];
+            }
+        }
+    }
+
+    return LGW_PERF_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint64_t lgw_perf_bucket_ns(int bucket) {
+    int log2;
+
+    if (bucket <= 0) {
+        return 0;
+    }
+    if (bucket >= LGW_PERF_HIST_NB) {
+        return 1ULL << LGW_PERF_HIST_LOG2_MAX;
+    }
+    log2 = LGW_PERF_HIST_LOG2_MIN + (bucket - 1) / LGW_PERF_HIST_SUB;
+    return (1ULL << log2) + (uint64_t)((bucket - 1) % LGW_PERF_HIST_SUB) * (1ULL << (log2 - LGW_PERF_HIST_SUB_LOG2));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint64_t lgw_perf_percentile(const struct lgw_perf_probe_s *probe, double percent) {
+    uint64_t nb = 0;
+    uint64_t cumul = 0;
+    uint64_t lo, hi, ns;
+    double target;
+    int i;
+
+    if (probe == NULL) {
+        return 0;
+    }
+    for (i = 0; i < LGW_PERF_HIST_NB; ++i) {
+        nb += probe->hist[i];
+    }
+    if (nb == 0) {
+        return 0;
+    }
+
+    target = (percent < 0.0) ? 0.0 : (percent > 100.0) ? (double)nb : percent * nb / 100.0;
+    for (i = 0; i < LGW_PERF_HIST_NB - 1; ++i) {
+        if ((probe->hist[i] > 0) && ((cumul + probe->hist[i]) >= target)) {
+            break;
+        }
+        cumul += probe->hist[i];
+    }
+
+    /* linear interpolation inside the bucket, the last one ends at the maximum */
+    lo = lgw_perf_bucket_ns(i);
+    hi = (i == LGW_PERF_HIST_NB - 1) ? probe->max_ns : lgw_perf_bucket_ns(i + 1);
+    ns = lo + (uint64_t)((hi - lo) * ((target - cumul) / probe->hist[i]));
+    return ((probe->max_ns > 0) && (ns > probe->max_ns)) ? probe->max_ns : ns;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_perf_export(const char *path) {
+    struct lgw_perf_snapshot_s *snap;
+    struct perf_file_s head;
+    char tmp_path[256];
+    FILE *f;
+    int x = LGW_PERF_ERROR;
+
+    CHECK_NULL(path);
+
+    snap = malloc(sizeof *snap); /* too large for the stack of small threads */
+    if (snap == NULL) {
+        DEBUG_MSG("ERROR: FAILED TO ALLOCATE SNAPSHOT\n");
+        return LGW_PERF_ERROR;
+    }
+    lgw_perf_snapshot(snap);
+
+    memset(&head, 0, sizeof head);
+    memcpy(head.magic, PERF_MAGIC, sizeof PERF_MAGIC);
+    head.version = PERF_VERSION;
+    head.size = sizeof *snap;
+
+    /* written next to the target then renamed, readers never see a partial file */
+    snprintf(tmp_path, sizeof tmp_path, "%s.tmp", path);
+    f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        DEBUG_PRINTF("ERROR: FAILED TO OPEN %s\n", tmp_path);
+    } else if ((fwrite(&head, sizeof head, 1, f) != 1) || (fwrite(snap, sizeof *snap, 1, f) != 1)) {
+        DEBUG_PRINTF("ERROR: FAILED TO WRITE %s\n", tmp_path);
+        fclose(f);
+    } else if ((fclose(f) != 0) || (rename(tmp_path, path) != 0)) {
+        DEBUG_PRINTF("ERROR: FAILED TO REPLACE %s\n", path);
+    } else {
+        x = LGW_PERF_SUCCESS;
+    }
+
+    free(snap);
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_perf_import(const char *path, struct lgw_perf_snapshot_s *snap) {
+    struct perf_file_s head;
+    FILE *f;
+    int x = LGW_PERF_ERROR;
+
+    CHECK_NULL(path);
+    CHECK_NULL(snap);
+
+    f = fopen(path, "rb");
+    if (f == NULL) {
+        DEBUG_PRINTF("ERROR: FAILED TO OPEN %s\n", path);
+        return LGW_PERF_ERROR;
+    }
+    if (fread(&head, sizeof head, 1, f) != 1) {
+        DEBUG_PRINTF("ERROR: FAILED TO READ %s\n", path);
+    } else if ((memcmp(head.magic, PERF_MAGIC, sizeof PERF_MAGIC) != 0) || (head.version != PERF_VERSION) || (head.size != sizeof *snap)) {
+        DEBUG_PRINTF("ERROR: %s WAS NOT WRITTEN BY THIS VERSION OF THE LIBRARY\n", path);
+    } else if (fread(snap, sizeof *snap, 1, f) != 1) {
+        DEBUG_PRINTF("ERROR: FAILED TO READ %s\n", path);
+    } else {
+        x = LGW_PERF_SUCCESS;
+    }
+
+    fclose(f);
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_perf_export_start(const char *path, uint32_t period_ms) {
+    pthread_condattr_t attr;
+
+    CHECK_NULL(path);
+    if (period_ms == 0) {
+        DEBUG_MSG("ERROR: EXPORT PERIOD MUST NOT BE NULL\n");
+        return LGW_PERF_ERROR;
+    }
+
+    pthread_mutex_lock(&mx_export);
+    if (export_running) {
+        pthread_mutex_unlock(&mx_export);
+        DEBUG_MSG("ERROR: EXPORT THREAD ALREADY RUNNING\n");
+        return LGW_PERF_ERROR;
+    }
+    export_path = strdup(path);
+    if (export_path == NULL) {
+        pthread_mutex_unlock(&mx_export);
+        return LGW_PERF_ERROR;
+    }
+    export_period_ms = period_ms;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&cond_export, &attr);
+    pthread_condattr_destroy(&attr);
+    export_running = true;
+    if (pthread_create(&export_thread, NULL, perf_export_thread, NULL) != 0) {
+        DEBUG_MSG("ERROR: FAILED TO CREATE EXPORT THREAD\n");
+        export_running = false;
+        pthread_cond_destroy(&cond_export);
+        free(export_path);
+        export_path = NULL;
+        pthread_mutex_unlock(&mx_export);
+        return LGW_PERF_ERROR;
+    }
+    pthread_mutex_unlock(&mx_export);
+
+    return LGW_PERF_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_perf_export_stop(void) {
+    pthread_mutex_lock(&mx_export);
+    if (!export_running) {
+        pthread_mutex_unlock(&mx_export);
+        return LGW_PERF_ERROR;
+    }
+    export_running = false;
+    pthread_cond_signal(&cond_export);
+    pthread_mutex_unlock(&mx_export);
+
+    pthread_join(export_thread, NULL);
+    pthread_cond_destroy(&cond_export);
+    lgw_perf_export(export_path); /* last values */
+    free(export_path);
+    export_path = NULL;
+
+    return LGW_PERF_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,155 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Pool of preallocated packet payload buffers.
+    lgw_receive_pool reads the payload of received packets directly into the
+    pool slots (no intermediate copy), the application gives the slots back
+    with lgw_pool_release once it is done with the packets.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf */
+#include <stdlib.h>     /* posix_memalign malloc free */
+#include <string.h>     /* memset */
+
+#include "loragw_pool.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#if DEBUG_POOL == 1
+    #define DEBUG_MSG(str)                fprintf(stderr, str)
+    #define DEBUG_PRINTF(fmt, args...)    fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+    #define CHECK_NULL(a)                if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_POOL_ERROR;}
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+    #define CHECK_NULL(a)                if(a==NULL){return LGW_POOL_ERROR;}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define POOL_MAX_SIZE       256 /* size of the payload buffer of struct lgw_pkt_rx_s */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int lgw_pool_init(struct lgw_pkt_pool_s *pool, uint16_t nb_slot, uint16_t max_size) {
+    void *mem;
+    int i;
+
+    /* check input variables */
+    CHECK_NULL(pool);
+    if ((nb_slot == 0) || (nb_slot == LGW_POOL_SLOT_NONE)) {
+        DEBUG_PRINTF("ERROR: %u IS NOT A VALID NUMBER OF SLOTS\n", nb_slot);
+        return LGW_POOL_ERROR;
+    }
+    if ((max_size == 0) || (max_size > POOL_MAX_SIZE)) {
+        DEBUG_PRINTF("ERROR: %u IS NOT A VALID SLOT SIZE\n", max_size);
+        return LGW_POOL_ERROR;
+    }
+
+    memset(pool, 0, sizeof *pool);
+    pool->slot_size = (max_size + LGW_POOL_ALIGN - 1) & ~(LGW_POOL_ALIGN - 1);
+    if (posix_memalign(&mem, LGW_POOL_ALIGN, (size_t)nb_slot * pool->slot_size) != 0) {
+        DEBUG_MSG("ERROR: FAILED TO ALLOCATE POOL SLOTS\n");
+        return LGW_POOL_ERROR;
+    }
+    pool->free_slot = malloc(nb_slot * sizeof(uint16_t));
+    pool->in_use = calloc(nb_slot, sizeof(uint8_t));
+    if ((pool->free_slot == NULL) || (pool->in_use == NULL)) {
+        DEBUG_MSG("ERROR: MALLOC FAIL\n");
+        free(pool->free_slot);
+        free(pool->in_use);
+        free(mem);
+        pool->free_slot = NULL;
+        pool->in_use = NULL;
+        return LGW_POOL_ERROR;
+    }
+
+    /* all slots free, lowest numbers given first */
+    for (i = 0; i < nb_slot; ++i) {
+        pool->free_slot[i] = nb_slot - 1 - i;
+    }
+    pool->mem = mem;
+    pool->nb_slot = nb_slot;
+    pool->nb_free = nb_slot;
+    pool->max_size = max_size;
+    DEBUG_PRINTF("Note: packet pool of %u slots of %u bytes\n", nb_slot, pool->slot_size);
+    return LGW_POOL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_pool_free(struct lgw_pkt_pool_s *pool) {
+    CHECK_NULL(pool);
+
+    free(pool->mem);
+    free(pool->free_slot);
+    free(pool->in_use);
+    memset(pool, 0, sizeof *pool);
+    return LGW_POOL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint16_t lgw_pool_get(struct lgw_pkt_pool_s *pool) {
+    uint16_t slot;
+
+    if ((pool == NULL) || (pool->nb_free == 0)) {
+        return LGW_POOL_SLOT_NONE;
+    }
+    pool->nb_free -= 1;
+    slot = pool->free_slot[pool->nb_free];
+    pool->in_use[slot] = 1;
+    return slot;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_pool_release(struct lgw_pkt_pool_s *pool, uint16_t slot) {
+    CHECK_NULL(pool);
+    if ((slot >= pool->nb_slot) || (pool->in_use[slot] == 0)) {
+        DEBUG_PRINTF("ERROR: CANNOT RELEASE SLOT %u\n", slot);
+        return LGW_POOL_ERROR;
+    }
+
+    pool->in_use[slot] = 0;
+    pool->free_slot[pool->nb_free] = slot;
+    pool->nb_free += 1;
+    return LGW_POOL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint8_t *lgw_pool_buffer(struct lgw_pkt_pool_s *pool, uint16_t slot) {
+    if ((pool == NULL) || (slot >= pool->nb_slot)) {
+        return NULL;
+    }
+    return pool->mem + ((size_t)slot * pool->slot_size);
+}
+
+/* --- EOF ------------------------------------------------------------------ */
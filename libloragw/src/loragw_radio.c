@@ -31,6 +31,7 @@ Maintainer: Michael Coracin
 #include "loragw_hal.h"
 #include "loragw_radio.h"
 #include "loragw_fpga.h"
+#include "loragw_ctx.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -99,11 +100,6 @@ const struct lgw_sx127x_FSK_bandwidth_s sx127x_FskBandwidths[] =
     { 250000, 0, 1 }    /* LGW_SX127X_RXBW_250K_HZ */
 };
 
-/* -------------------------------------------------------------------------- */
-/* --- PRIVATE VARIABLES ---------------------------------------------------- */
-
-extern void *lgw_spi_target; /*! generic pointer to the SPI device */
-
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
 
@@ -150,12 +146,14 @@ void sx125x_write(uint8_t channel, uint8_t addr, uint8_t data) {
             return;
     }
 
-    /* SPI master data write procedure */
+    /* SPI master data write procedure, sent as a single SPI message */
+    lgw_reg_batch_begin();
     lgw_reg_w(reg_cs, 0);
     lgw_reg_w(reg_add, 0x80 | addr); /* MSB at 1 for write operation */
     lgw_reg_w(reg_dat, data);
     lgw_reg_w(reg_cs, 1);
     lgw_reg_w(reg_cs, 0);
+    lgw_reg_batch_end();
 
     return;
 }
@@ -197,13 +195,15 @@ uint8_t sx125x_read(uint8_t channel, uint8_t addr) {
             return 0;
     }
 
-    /* SPI master data read procedure */
+    /* SPI master data read procedure, locked so no other thread uses the SPI master in between */
+    lgw_reg_lock();
     lgw_reg_w(reg_cs, 0);
     lgw_reg_w(reg_add, addr); /* MSB at 0 for read operation */
     lgw_reg_w(reg_dat, 0);
     lgw_reg_w(reg_cs, 1);
     lgw_reg_w(reg_cs, 0);
     lgw_reg_r(reg_rb, &read_value);
+    lgw_reg_unlock();
 
     return (uint8_t)read_value;
 }
@@ -407,6 +407,7 @@ int lgw_setup_sx125x(uint8_t rf_chain, uint8_t rf_clkout, bool rf_enable, uint8_
     DEBUG_PRINTF("Note: SX125x #%d version register returned 0x%02x\n", rf_chain, sx125x_read(rf_chain, 0x07));
 
     /* General radio setup */
+    lgw_reg_batch_begin();
     if (rf_clkout == rf_chain) {
         sx125x_write(rf_chain, 0x10, SX125x_TX_DAC_CLK_SEL + 2);
         DEBUG_PRINTF("Note: SX125x #%d clock output enabled\n", rf_chain);
@@ -426,9 +427,11 @@ int lgw_setup_sx125x(uint8_t rf_chain, uint8_t rf_clkout, bool rf_enable, uint8_
             DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d FOR RADIO TYPE\n", rf_radio_type);
             break;
     }
+    lgw_reg_batch_end();
 
     if (rf_enable == true) {
         /* Tx gain and trim */
+        lgw_reg_batch_begin();
         sx125x_write(rf_chain, 0x08, SX125x_TX_MIX_GAIN + SX125x_TX_DAC_GAIN*16);
         sx125x_write(rf_chain, 0x0A, SX125x_TX_ANA_BW + SX125x_TX_PLL_BW*32);
         sx125x_write(rf_chain, 0x0B, SX125x_TX_DAC_BW);
@@ -456,6 +459,7 @@ int lgw_setup_sx125x(uint8_t rf_chain, uint8_t rf_clkout, bool rf_enable, uint8_
         sx125x_write(rf_chain, 0x01,0xFF & part_int); /* Most Significant Byte */
         sx125x_write(rf_chain, 0x02,0xFF & (part_frac >> 8)); /* middle byte */
         sx125x_write(rf_chain, 0x03,0xFF & part_frac); /* Least Significant Byte */
+        lgw_reg_batch_end();
 
         /* start and PLL lock */
         do {
@@ -479,13 +483,25 @@ int lgw_setup_sx125x(uint8_t rf_chain, uint8_t rf_clkout, bool rf_enable, uint8_
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_sx127x_reg_w(uint8_t address, uint8_t reg_value) {
-    return lgw_spi_w(lgw_spi_target, LGW_SPI_MUX_MODE1, LGW_SPI_MUX_TARGET_SX127X, address, reg_value);
+    struct lgw_ctx_s *ctx = lgw_ctx_cur;
+    int x;
+
+    lgw_reg_lock(); /* the SX127x shares the SPI bus with the SX1301 */
+    x = lgw_spi_w(ctx->spi_target, LGW_SPI_MUX_MODE1, LGW_SPI_MUX_TARGET_SX127X, address, reg_value);
+    lgw_reg_unlock();
+    return x;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_sx127x_reg_r(uint8_t address, uint8_t *reg_value) {
-    return lgw_spi_r(lgw_spi_target, LGW_SPI_MUX_MODE1, LGW_SPI_MUX_TARGET_SX127X, address, reg_value);
+    struct lgw_ctx_s *ctx = lgw_ctx_cur;
+    int x;
+
+    lgw_reg_lock(); /* the SX127x shares the SPI bus with the SX1301 */
+    x = lgw_spi_r(ctx->spi_target, LGW_SPI_MUX_MODE1, LGW_SPI_MUX_TARGET_SX127X, address, reg_value);
+    lgw_reg_unlock();
+    return x;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -20,13 +20,21 @@ Maintainer: Sylvain Miermont
 /* -------------------------------------------------------------------------- */
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
+#define _GNU_SOURCE     /* needed for PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP to be defined */
+
 #include <stdint.h>     /* C99 types */
 #include <stdbool.h>    /* bool type */
 #include <stdio.h>      /* printf fprintf */
+#include <stdlib.h>     /* malloc free */
+#include <string.h>     /* memset */
+#include <time.h>       /* clock_gettime */
+#include <pthread.h>
 
 #include "loragw_spi.h"
 #include "loragw_reg.h"
 #include "loragw_fpga.h"
+#include "loragw_ctx.h"
+#include "loragw_perf.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -48,6 +56,12 @@ Maintainer: Sylvain Miermont
 #define PAGE_ADDR        0x00
 #define PAGE_MASK        0x03
 
+#define REG_CACHE_COMMON    (PAGE_MASK+1) /* row of the shadow tables used for registers common to all pages */
+#define REG_CACHE_ROWS      (PAGE_MASK+2)
+#define REG_MAP_UNUSED      0 /* no register in that byte */
+#define REG_MAP_CACHEABLE   1 /* only writable, non-volatile registers in that byte */
+#define REG_MAP_VOLATILE    2 /* at least one read-only or volatile register in that byte */
+
 const uint8_t FPGA_VERSION[] = { 31, 33 }; /* several versions could be supported */
 
 /*
@@ -57,356 +71,661 @@ this file is autogenerated from registers description
 293 registers are defined
 */
 const struct lgw_reg_s loregs[LGW_TOTALREGS] = {
-    {-1,0,0,0,2,0,0},         /* PAGE_REG */
-    {-1,0,7,0,1,0,0},         /* SOFT_RESET */
-    {-1,1,0,0,8,1,103},       /* VERSION */
-    {-1,2,0,0,16,0,0},        /* RX_DATA_BUF_ADDR */
-    {-1,4,0,0,8,0,0},         /* RX_DATA_BUF_DATA */
-    {-1,5,0,0,8,0,0},         /* TX_DATA_BUF_ADDR */
-    {-1,6,0,0,8,0,0},         /* TX_DATA_BUF_DATA */
-    {-1,7,0,0,8,0,0},         /* CAPTURE_RAM_ADDR */
-    {-1,8,0,0,8,1,0},         /* CAPTURE_RAM_DATA */
-    {-1,9,0,0,8,0,0},         /* MCU_PROM_ADDR */
-    {-1,10,0,0,8,0,0},        /* MCU_PROM_DATA */
-    {-1,11,0,0,8,0,0},        /* RX_PACKET_DATA_FIFO_NUM_STORED */
-    {-1,12,0,0,16,1,0},       /* RX_PACKET_DATA_FIFO_ADDR_POINTER */
-    {-1,14,0,0,8,1,0},        /* RX_PACKET_DATA_FIFO_STATUS */
-    {-1,15,0,0,8,1,0},        /* RX_PACKET_DATA_FIFO_PAYLOAD_SIZE */
-    {-1,16,0,0,1,0,0},        /* MBWSSF_MODEM_ENABLE */
-    {-1,16,1,0,1,0,0},        /* CONCENTRATOR_MODEM_ENABLE */
-    {-1,16,2,0,1,0,0},        /* FSK_MODEM_ENABLE */
-    {-1,16,3,0,1,0,0},        /* GLOBAL_EN */
-    {-1,17,0,0,1,0,1},        /* CLK32M_EN */
-    {-1,17,1,0,1,0,1},        /* CLKHS_EN */
-    {-1,18,0,0,1,0,0},        /* START_BIST0 */
-    {-1,18,1,0,1,0,0},        /* START_BIST1 */
-    {-1,18,2,0,1,0,0},        /* CLEAR_BIST0 */
-    {-1,18,3,0,1,0,0},        /* CLEAR_BIST1 */
-    {-1,19,0,0,1,1,0},        /* BIST0_FINISHED */
-    {-1,19,1,0,1,1,0},        /* BIST1_FINISHED */
-    {-1,20,0,0,1,1,0},        /* MCU_AGC_PROG_RAM_BIST_STATUS */
-    {-1,20,1,0,1,1,0},        /* MCU_ARB_PROG_RAM_BIST_STATUS */
-    {-1,20,2,0,1,1,0},        /* CAPTURE_RAM_BIST_STATUS */
-    {-1,20,3,0,1,1,0},        /* CHAN_FIR_RAM0_BIST_STATUS */
-    {-1,20,4,0,1,1,0},        /* CHAN_FIR_RAM1_BIST_STATUS */
-    {-1,21,0,0,1,1,0},        /* CORR0_RAM_BIST_STATUS */
-    {-1,21,1,0,1,1,0},        /* CORR1_RAM_BIST_STATUS */
-    {-1,21,2,0,1,1,0},        /* CORR2_RAM_BIST_STATUS */
-    {-1,21,3,0,1,1,0},        /* CORR3_RAM_BIST_STATUS */
-    {-1,21,4,0,1,1,0},        /* CORR4_RAM_BIST_STATUS */
-    {-1,21,5,0,1,1,0},        /* CORR5_RAM_BIST_STATUS */
-    {-1,21,6,0,1,1,0},        /* CORR6_RAM_BIST_STATUS */
-    {-1,21,7,0,1,1,0},        /* CORR7_RAM_BIST_STATUS */
-    {-1,22,0,0,1,1,0},        /* MODEM0_RAM0_BIST_STATUS */
-    {-1,22,1,0,1,1,0},        /* MODEM1_RAM0_BIST_STATUS */
-    {-1,22,2,0,1,1,0},        /* MODEM2_RAM0_BIST_STATUS */
-    {-1,22,3,0,1,1,0},        /* MODEM3_RAM0_BIST_STATUS */
-    {-1,22,4,0,1,1,0},        /* MODEM4_RAM0_BIST_STATUS */
-    {-1,22,5,0,1,1,0},        /* MODEM5_RAM0_BIST_STATUS */
-    {-1,22,6,0,1,1,0},        /* MODEM6_RAM0_BIST_STATUS */
-    {-1,22,7,0,1,1,0},        /* MODEM7_RAM0_BIST_STATUS */
-    {-1,23,0,0,1,1,0},        /* MODEM0_RAM1_BIST_STATUS */
-    {-1,23,1,0,1,1,0},        /* MODEM1_RAM1_BIST_STATUS */
-    {-1,23,2,0,1,1,0},        /* MODEM2_RAM1_BIST_STATUS */
-    {-1,23,3,0,1,1,0},        /* MODEM3_RAM1_BIST_STATUS */
-    {-1,23,4,0,1,1,0},        /* MODEM4_RAM1_BIST_STATUS */
-    {-1,23,5,0,1,1,0},        /* MODEM5_RAM1_BIST_STATUS */
-    {-1,23,6,0,1,1,0},        /* MODEM6_RAM1_BIST_STATUS */
-    {-1,23,7,0,1,1,0},        /* MODEM7_RAM1_BIST_STATUS */
-    {-1,24,0,0,1,1,0},        /* MODEM0_RAM2_BIST_STATUS */
-    {-1,24,1,0,1,1,0},        /* MODEM1_RAM2_BIST_STATUS */
-    {-1,24,2,0,1,1,0},        /* MODEM2_RAM2_BIST_STATUS */
-    {-1,24,3,0,1,1,0},        /* MODEM3_RAM2_BIST_STATUS */
-    {-1,24,4,0,1,1,0},        /* MODEM4_RAM2_BIST_STATUS */
-    {-1,24,5,0,1,1,0},        /* MODEM5_RAM2_BIST_STATUS */
-    {-1,24,6,0,1,1,0},        /* MODEM6_RAM2_BIST_STATUS */
-    {-1,24,7,0,1,1,0},        /* MODEM7_RAM2_BIST_STATUS */
-    {-1,25,0,0,1,1,0},        /* MODEM_MBWSSF_RAM0_BIST_STATUS */
-    {-1,25,1,0,1,1,0},        /* MODEM_MBWSSF_RAM1_BIST_STATUS */
-    {-1,25,2,0,1,1,0},        /* MODEM_MBWSSF_RAM2_BIST_STATUS */
-    {-1,26,0,0,1,1,0},        /* MCU_AGC_DATA_RAM_BIST0_STATUS */
-    {-1,26,1,0,1,1,0},        /* MCU_AGC_DATA_RAM_BIST1_STATUS */
-    {-1,26,2,0,1,1,0},        /* MCU_ARB_DATA_RAM_BIST0_STATUS */
-    {-1,26,3,0,1,1,0},        /* MCU_ARB_DATA_RAM_BIST1_STATUS */
-    {-1,26,4,0,1,1,0},        /* TX_TOP_RAM_BIST0_STATUS */
-    {-1,26,5,0,1,1,0},        /* TX_TOP_RAM_BIST1_STATUS */
-    {-1,26,6,0,1,1,0},        /* DATA_MNGT_RAM_BIST0_STATUS */
-    {-1,26,7,0,1,1,0},        /* DATA_MNGT_RAM_BIST1_STATUS */
-    {-1,27,0,0,4,0,0},        /* GPIO_SELECT_INPUT */
-    {-1,28,0,0,4,0,0},        /* GPIO_SELECT_OUTPUT */
-    {-1,29,0,0,5,0,0},        /* GPIO_MODE */
-    {-1,30,0,0,5,1,0},        /* GPIO_PIN_REG_IN */
-    {-1,31,0,0,5,0,0},        /* GPIO_PIN_REG_OUT */
-    {-1,32,0,0,8,1,0},        /* MCU_AGC_STATUS */
-    {-1,125,0,0,8,1,0},       /* MCU_ARB_STATUS */
-    {-1,126,0,0,8,1,1},       /* CHIP_ID */
-    {-1,127,0,0,1,0,1},       /* EMERGENCY_FORCE_HOST_CTRL */
-    {0,33,0,0,1,0,0},         /* RX_INVERT_IQ */
-    {0,33,1,0,1,0,1},         /* MODEM_INVERT_IQ */
-    {0,33,2,0,1,0,0},         /* MBWSSF_MODEM_INVERT_IQ */
-    {0,33,3,0,1,0,0},         /* RX_EDGE_SELECT */
-    {0,33,4,0,1,0,0},         /* MISC_RADIO_EN */
-    {0,33,5,0,1,0,0},         /* FSK_MODEM_INVERT_IQ */
-    {0,34,0,0,4,0,7},         /* FILTER_GAIN */
-    {0,35,0,0,8,0,240},       /* RADIO_SELECT */
-    {0,36,0,1,13,0,-384},     /* IF_FREQ_0 */
-    {0,38,0,1,13,0,-128},     /* IF_FREQ_1 */
-    {0,40,0,1,13,0,128},      /* IF_FREQ_2 */
-    {0,42,0,1,13,0,384},      /* IF_FREQ_3 */
-    {0,44,0,1,13,0,-384},     /* IF_FREQ_4 */
-    {0,46,0,1,13,0,-128},     /* IF_FREQ_5 */
-    {0,48,0,1,13,0,128},      /* IF_FREQ_6 */
-    {0,50,0,1,13,0,384},      /* IF_FREQ_7 */
-    {0,52,0,1,13,0,0},        /* IF_FREQ_8 */
-    {0,54,0,1,13,0,0},        /* IF_FREQ_9 */
-    {0,64,0,0,1,0,0},        /* CHANN_OVERRIDE_AGC_GAIN */
-    {0,64,1,0,4,0,7},        /* CHANN_AGC_GAIN */
-    {0,65,0,0,7,0,0},        /* CORR0_DETECT_EN */
-    {0,66,0,0,7,0,0},        /* CORR1_DETECT_EN */
-    {0,67,0,0,7,0,0},        /* CORR2_DETECT_EN */
-    {0,68,0,0,7,0,0},        /* CORR3_DETECT_EN */
-    {0,69,0,0,7,0,0},        /* CORR4_DETECT_EN */
-    {0,70,0,0,7,0,0},        /* CORR5_DETECT_EN */
-    {0,71,0,0,7,0,0},        /* CORR6_DETECT_EN */
-    {0,72,0,0,7,0,0},        /* CORR7_DETECT_EN */
-    {0,73,0,0,1,0,0},        /* CORR_SAME_PEAKS_OPTION_SF6 */
-    {0,73,1,0,1,0,1},        /* CORR_SAME_PEAKS_OPTION_SF7 */
-    {0,73,2,0,1,0,1},        /* CORR_SAME_PEAKS_OPTION_SF8 */
-    {0,73,3,0,1,0,1},        /* CORR_SAME_PEAKS_OPTION_SF9 */
-    {0,73,4,0,1,0,1},        /* CORR_SAME_PEAKS_OPTION_SF10 */
-    {0,73,5,0,1,0,1},        /* CORR_SAME_PEAKS_OPTION_SF11 */
-    {0,73,6,0,1,0,1},        /* CORR_SAME_PEAKS_OPTION_SF12 */
-    {0,74,0,0,4,0,4},        /* CORR_SIG_NOISE_RATIO_SF6 */
-    {0,74,4,0,4,0,4},        /* CORR_SIG_NOISE_RATIO_SF7 */
-    {0,75,0,0,4,0,4},        /* CORR_SIG_NOISE_RATIO_SF8 */
-    {0,75,4,0,4,0,4},        /* CORR_SIG_NOISE_RATIO_SF9 */
-    {0,76,0,0,4,0,4},        /* CORR_SIG_NOISE_RATIO_SF10 */
-    {0,76,4,0,4,0,4},        /* CORR_SIG_NOISE_RATIO_SF11 */
-    {0,77,0,0,4,0,4},        /* CORR_SIG_NOISE_RATIO_SF12 */
-    {0,78,0,0,4,0,4},        /* CORR_NUM_SAME_PEAK */
-    {0,78,4,0,3,0,5},        /* CORR_MAC_GAIN */
-    {0,81,0,0,12,0,0},       /* ADJUST_MODEM_START_OFFSET_RDX4 */
-    {0,83,0,0,12,0,4092},    /* ADJUST_MODEM_START_OFFSET_SF12_RDX4 */
-    {0,85,0,0,8,0,7},        /* DBG_CORR_SELECT_SF */
-    {0,86,0,0,8,0,0},        /* DBG_CORR_SELECT_CHANNEL */
-    {0,87,0,0,8,1,0},        /* DBG_DETECT_CPT */
-    {0,88,0,0,8,1,0},        /* DBG_SYMB_CPT */
-    {0,89,0,0,1,0,1},        /* CHIRP_INVERT_RX */
-    {0,89,1,0,1,0,1},        /* DC_NOTCH_EN */
-    {0,90,0,0,1,0,0},        /* IMPLICIT_CRC_EN */
-    {0,90,1,0,3,0,0},        /* IMPLICIT_CODING_RATE */
-    {0,91,0,0,8,0,0},        /* IMPLICIT_PAYLOAD_LENGHT */
-    {0,92,0,0,8,0,29},       /* FREQ_TO_TIME_INVERT */
-    {0,93,0,0,6,0,9},        /* FREQ_TO_TIME_DRIFT */
-    {0,94,0,0,2,0,2},        /* PAYLOAD_FINE_TIMING_GAIN */
-    {0,94,2,0,2,0,1},        /* PREAMBLE_FINE_TIMING_GAIN */
-    {0,94,4,0,2,0,0},        /* TRACKING_INTEGRAL */
-    {0,95,0,0,4,0,1},        /* FRAME_SYNCH_PEAK1_POS */
-    {0,95,4,0,4,0,2},        /* FRAME_SYNCH_PEAK2_POS */
-    {0,96,0,0,16,0,10},      /* PREAMBLE_SYMB1_NB */
-    {0,98,0,0,1,0,1},        /* FRAME_SYNCH_GAIN */
-    {0,98,1,0,1,0,1},        /* SYNCH_DETECT_TH */
-    {0,99,0,0,4,0,8},        /* LLR_SCALE */
-    {0,99,4,0,2,0,2},        /* SNR_AVG_CST */
-    {0,100,0,0,7,0,0},       /* PPM_OFFSET */
-    {0,101,0,0,8,0,255},     /* MAX_PAYLOAD_LEN */
-    {0,102,0,0,1,0,1},        /* ONLY_CRC_EN */
-    {0,103,0,0,8,0,0},        /* ZERO_PAD */
-    {0,104,0,0,4,0,8},        /* DEC_GAIN_OFFSET */
-    {0,104,4,0,4,0,7},        /* CHAN_GAIN_OFFSET */
-    {0,105,1,0,1,0,1},        /* FORCE_HOST_RADIO_CTRL */
-    {0,105,2,0,1,0,1},        /* FORCE_HOST_FE_CTRL */
-    {0,105,3,0,1,0,1},        /* FORCE_DEC_FILTER_GAIN */
-    {0,106,0,0,1,0,1},        /* MCU_RST_0 */
-    {0,106,1,0,1,0,1},        /* MCU_RST_1 */
-    {0,106,2,0,1,0,0},        /* MCU_SELECT_MUX_0 */
-    {0,106,3,0,1,0,0},        /* MCU_SELECT_MUX_1 */
-    {0,106,4,0,1,1,0},        /* MCU_CORRUPTION_DETECTED_0 */
-    {0,106,5,0,1,1,0},        /* MCU_CORRUPTION_DETECTED_1 */
-    {0,106,6,0,1,0,0},        /* MCU_SELECT_EDGE_0 */
-    {0,106,7,0,1,0,0},        /* MCU_SELECT_EDGE_1 */
-    {0,107,0,0,8,0,1},        /* CHANN_SELECT_RSSI */
-    {0,108,0,0,8,0,32},       /* RSSI_BB_DEFAULT_VALUE */
-    {0,109,0,0,8,0,100},      /* RSSI_DEC_DEFAULT_VALUE */
-    {0,110,0,0,8,0,100},      /* RSSI_CHANN_DEFAULT_VALUE */
-    {0,111,0,0,5,0,7},        /* RSSI_BB_FILTER_ALPHA */
-    {0,112,0,0,5,0,5},        /* RSSI_DEC_FILTER_ALPHA */
-    {0,113,0,0,5,0,8},        /* RSSI_CHANN_FILTER_ALPHA */
-    {0,114,0,0,6,0,0},        /* IQ_MISMATCH_A_AMP_COEFF */
-    {0,115,0,0,6,0,0},        /* IQ_MISMATCH_A_PHI_COEFF */
-    {0,116,0,0,6,0,0},        /* IQ_MISMATCH_B_AMP_COEFF */
-    {0,116,6,0,1,0,0},        /* IQ_MISMATCH_B_SEL_I */
-    {0,117,0,0,6,0,0},        /* IQ_MISMATCH_B_PHI_COEFF */
-    {1,33,0,0,1,0,0},         /* TX_TRIG_IMMEDIATE */
-    {1,33,1,0,1,0,0},         /* TX_TRIG_DELAYED */
-    {1,33,2,0,1,0,0},         /* TX_TRIG_GPS */
-    {1,34,0,0,16,0,0},        /* TX_START_DELAY */
-    {1,36,0,0,4,0,1},        /* TX_FRAME_SYNCH_PEAK1_POS */
-    {1,36,4,0,4,0,2},        /* TX_FRAME_SYNCH_PEAK2_POS */
-    {1,37,0,0,3,0,0},        /* TX_RAMP_DURATION */
-    {1,39,0,1,8,0,0},        /* TX_OFFSET_I */
-    {1,40,0,1,8,0,0},        /* TX_OFFSET_Q */
-    {1,41,0,0,1,0,0},        /* TX_MODE */
-    {1,41,1,0,4,0,0},        /* TX_ZERO_PAD */
-    {1,41,5,0,1,0,0},        /* TX_EDGE_SELECT */
-    {1,41,6,0,1,0,0},        /* TX_EDGE_SELECT_TOP */
-    {1,42,0,0,2,0,0},        /* TX_GAIN */
-    {1,42,2,0,3,0,5},        /* TX_CHIRP_LOW_PASS */
-    {1,42,5,0,2,0,0},        /* TX_FCC_WIDEBAND */
-    {1,42,7,0,1,0,1},        /* TX_SWAP_IQ */
-    {1,43,0,0,1,0,0},        /* MBWSSF_IMPLICIT_HEADER */
-    {1,43,1,0,1,0,0},        /* MBWSSF_IMPLICIT_CRC_EN */
-    {1,43,2,0,3,0,0},        /* MBWSSF_IMPLICIT_CODING_RATE */
-    {1,44,0,0,8,0,0},        /* MBWSSF_IMPLICIT_PAYLOAD_LENGHT */
-    {1,45,0,0,1,0,1},        /* MBWSSF_AGC_FREEZE_ON_DETECT */
-    {1,46,0,0,4,0,1},        /* MBWSSF_FRAME_SYNCH_PEAK1_POS */
-    {1,46,4,0,4,0,2},        /* MBWSSF_FRAME_SYNCH_PEAK2_POS */
-    {1,47,0,0,16,0,10},      /* MBWSSF_PREAMBLE_SYMB1_NB */
-    {1,49,0,0,1,0,1},        /* MBWSSF_FRAME_SYNCH_GAIN */
-    {1,49,1,0,1,0,1},        /* MBWSSF_SYNCH_DETECT_TH */
-    {1,50,0,0,8,0,10},       /* MBWSSF_DETECT_MIN_SINGLE_PEAK */
-    {1,51,0,0,3,0,3},        /* MBWSSF_DETECT_TRIG_SAME_PEAK_NB */
-    {1,52,0,0,8,0,29},       /* MBWSSF_FREQ_TO_TIME_INVERT */
-    {1,53,0,0,6,0,36},       /* MBWSSF_FREQ_TO_TIME_DRIFT */
-    {1,54,0,0,12,0,0},       /* MBWSSF_PPM_CORRECTION */
-    {1,56,0,0,2,0,2},        /* MBWSSF_PAYLOAD_FINE_TIMING_GAIN */
-    {1,56,2,0,2,0,1},        /* MBWSSF_PREAMBLE_FINE_TIMING_GAIN */
-    {1,56,4,0,2,0,0},        /* MBWSSF_TRACKING_INTEGRAL */
-    {1,57,0,0,8,0,0},        /* MBWSSF_ZERO_PAD */
-    {1,58,0,0,2,0,0},        /* MBWSSF_MODEM_BW */
-    {1,58,2,0,1,0,0},        /* MBWSSF_RADIO_SELECT */
-    {1,58,3,0,1,0,1},        /* MBWSSF_RX_CHIRP_INVERT */
-    {1,59,0,0,4,0,8},        /* MBWSSF_LLR_SCALE */
-    {1,59,4,0,2,0,3},        /* MBWSSF_SNR_AVG_CST */
-    {1,59,6,0,1,0,0},        /* MBWSSF_PPM_OFFSET */
-    {1,60,0,0,4,0,7},        /* MBWSSF_RATE_SF */
-    {1,60,4,0,1,0,1},        /* MBWSSF_ONLY_CRC_EN */
-    {1,61,0,0,8,0,255},      /* MBWSSF_MAX_PAYLOAD_LEN */
-    {1,62,0,0,8,1,128},      /* TX_STATUS */
-    {1,63,0,0,3,0,0},        /* FSK_CH_BW_EXPO */
-    {1,63,3,0,3,0,0},        /* FSK_RSSI_LENGTH */
-    {1,63,6,0,1,0,0},        /* FSK_RX_INVERT */
-    {1,63,7,0,1,0,0},        /* FSK_PKT_MODE */
-    {1,64,0,0,3,0,0},        /* FSK_PSIZE */
-    {1,64,3,0,1,0,0},        /* FSK_CRC_EN */
-    {1,64,4,0,2,0,0},        /* FSK_DCFREE_ENC */
-    {1,64,6,0,1,0,0},        /* FSK_CRC_IBM */
-    {1,65,0,0,5,0,0},        /* FSK_ERROR_OSR_TOL */
-    {1,65,7,0,1,0,0},        /* FSK_RADIO_SELECT */
-    {1,66,0,0,16,0,0},       /* FSK_BR_RATIO */
-    {1,68,0,0,32,0,0},       /* FSK_REF_PATTERN_LSB */
-    {1,72,0,0,32,0,0},       /* FSK_REF_PATTERN_MSB */
-    {1,76,0,0,8,0,0},        /* FSK_PKT_LENGTH */
-    {1,77,0,0,1,0,1},        /* FSK_TX_GAUSSIAN_EN */
-    {1,77,1,0,2,0,0},        /* FSK_TX_GAUSSIAN_SELECT_BT */
-    {1,77,3,0,1,0,1},        /* FSK_TX_PATTERN_EN */
-    {1,77,4,0,1,0,0},        /* FSK_TX_PREAMBLE_SEQ */
-    {1,77,5,0,3,0,0},        /* FSK_TX_PSIZE */
-    {1,80,0,0,8,0,0},        /* FSK_NODE_ADRS */
-    {1,81,0,0,8,0,0},        /* FSK_BROADCAST */
-    {1,82,0,0,1,0,1},        /* FSK_AUTO_AFC_ON */
-    {1,83,0,0,10,0,0},       /* FSK_PATTERN_TIMEOUT_CFG */
-    {2,33,0,0,8,0,0},        /* SPI_RADIO_A__DATA */
-    {2,34,0,0,8,1,0},        /* SPI_RADIO_A__DATA_READBACK */
-    {2,35,0,0,8,0,0},        /* SPI_RADIO_A__ADDR */
-    {2,37,0,0,1,0,0},        /* SPI_RADIO_A__CS */
-    {2,38,0,0,8,0,0},        /* SPI_RADIO_B__DATA */
-    {2,39,0,0,8,1,0},        /* SPI_RADIO_B__DATA_READBACK */
-    {2,40,0,0,8,0,0},        /* SPI_RADIO_B__ADDR */
-    {2,42,0,0,1,0,0},        /* SPI_RADIO_B__CS */
-    {2,43,0,0,1,0,0},        /* RADIO_A_EN */
-    {2,43,1,0,1,0,0},        /* RADIO_B_EN */
-    {2,43,2,0,1,0,1},        /* RADIO_RST */
-    {2,43,3,0,1,0,0},        /* LNA_A_EN */
-    {2,43,4,0,1,0,0},        /* PA_A_EN */
-    {2,43,5,0,1,0,0},        /* LNA_B_EN */
-    {2,43,6,0,1,0,0},        /* PA_B_EN */
-    {2,44,0,0,2,0,0},        /* PA_GAIN */
-    {2,45,0,0,4,0,2},        /* LNA_A_CTRL_LUT */
-    {2,45,4,0,4,0,4},        /* PA_A_CTRL_LUT */
-    {2,46,0,0,4,0,2},        /* LNA_B_CTRL_LUT */
-    {2,46,4,0,4,0,4},        /* PA_B_CTRL_LUT */
-    {2,47,0,0,5,0,0},        /* CAPTURE_SOURCE */
-    {2,47,5,0,1,0,0},        /* CAPTURE_START */
-    {2,47,6,0,1,0,0},        /* CAPTURE_FORCE_TRIGGER */
-    {2,47,7,0,1,0,0},        /* CAPTURE_WRAP */
-    {2,48,0,0,16,0,0},       /* CAPTURE_PERIOD */
-    {2,51,0,0,8,1,0},        /* MODEM_STATUS */
-    {2,52,0,0,8,1,0},        /* VALID_HEADER_COUNTER_0 */
-    {2,54,0,0,8,1,0},        /* VALID_PACKET_COUNTER_0 */
-    {2,56,0,0,8,1,0},        /* VALID_HEADER_COUNTER_MBWSSF */
-    {2,57,0,0,8,1,0},        /* VALID_HEADER_COUNTER_FSK */
-    {2,58,0,0,8,1,0},        /* VALID_PACKET_COUNTER_MBWSSF */
-    {2,59,0,0,8,1,0},        /* VALID_PACKET_COUNTER_FSK */
-    {2,60,0,0,8,1,0},        /* CHANN_RSSI */
-    {2,61,0,0,8,1,0},        /* BB_RSSI */
-    {2,62,0,0,8,1,0},        /* DEC_RSSI */
-    {2,63,0,0,8,1,0},        /* DBG_MCU_DATA */
-    {2,64,0,0,8,1,0},        /* DBG_ARB_MCU_RAM_DATA */
-    {2,65,0,0,8,1,0},        /* DBG_AGC_MCU_RAM_DATA */
-    {2,66,0,0,16,1,0},       /* NEXT_PACKET_CNT */
-    {2,68,0,0,16,1,0},       /* ADDR_CAPTURE_COUNT */
-    {2,70,0,0,32,1,0},       /* TIMESTAMP */
-    {2,74,0,0,4,1,0},        /* DBG_CHANN0_GAIN */
-    {2,74,4,0,4,1,0},        /* DBG_CHANN1_GAIN */
-    {2,75,0,0,4,1,0},        /* DBG_CHANN2_GAIN */
-    {2,75,4,0,4,1,0},        /* DBG_CHANN3_GAIN */
-    {2,76,0,0,4,1,0},        /* DBG_CHANN4_GAIN */
-    {2,76,4,0,4,1,0},        /* DBG_CHANN5_GAIN */
-    {2,77,0,0,4,1,0},        /* DBG_CHANN6_GAIN */
-    {2,77,4,0,4,1,0},        /* DBG_CHANN7_GAIN */
-    {2,78,0,0,4,1,0},        /* DBG_DEC_FILT_GAIN */
-    {2,79,0,0,3,1,0},        /* SPI_DATA_FIFO_PTR */
-    {2,79,3,0,3,1,0},        /* PACKET_DATA_FIFO_PTR */
-    {2,80,0,0,8,0,0},        /* DBG_ARB_MCU_RAM_ADDR */
-    {2,81,0,0,8,0,0},        /* DBG_AGC_MCU_RAM_ADDR */
-    {2,82,0,0,1,0,0},        /* SPI_MASTER_CHIP_SELECT_POLARITY */
-    {2,82,1,0,1,0,0},        /* SPI_MASTER_CPOL */
-    {2,82,2,0,1,0,0},        /* SPI_MASTER_CPHA */
-    {2,83,0,0,1,0,0},        /* SIG_GEN_ANALYSER_MUX_SEL */
-    {2,84,0,0,1,0,0},        /* SIG_GEN_EN */
-    {2,84,1,0,1,0,0},        /* SIG_ANALYSER_EN */
-    {2,84,2,0,2,0,0},        /* SIG_ANALYSER_AVG_LEN */
-    {2,84,4,0,3,0,0},        /* SIG_ANALYSER_PRECISION */
-    {2,84,7,0,1,1,0},        /* SIG_ANALYSER_VALID_OUT */
-    {2,85,0,0,8,0,0},        /* SIG_GEN_FREQ */
-    {2,86,0,0,8,0,0},        /* SIG_ANALYSER_FREQ */
-    {2,87,0,0,8,1,0},        /* SIG_ANALYSER_I_OUT */
-    {2,88,0,0,8,1,0},        /* SIG_ANALYSER_Q_OUT */
-    {2,89,0,0,1,0,0},        /* GPS_EN */
-    {2,89,1,0,1,0,1},        /* GPS_POL */
-    {2,90,0,1,8,0,0},        /* SW_TEST_REG1 */
-    {2,91,2,1,6,0,0},        /* SW_TEST_REG2 */
-    {2,92,0,1,16,0,0},       /* SW_TEST_REG3 */
-    {2,94,0,0,4,1,0},        /* DATA_MNGT_STATUS */
-    {2,95,0,0,5,1,0},        /* DATA_MNGT_CPT_FRAME_ALLOCATED */
-    {2,96,0,0,5,1,0},        /* DATA_MNGT_CPT_FRAME_FINISHED */
-    {2,97,0,0,5,1,0},        /* DATA_MNGT_CPT_FRAME_READEN */
-    {1,33,0,0,8,0,0}         /* TX_TRIG_ALL (alias) */
+    {-1,0,0,0,2,0,1,0},         /* PAGE_REG */
+    {-1,0,7,0,1,0,1,0},         /* SOFT_RESET */
+    {-1,1,0,0,8,1,0,103},       /* VERSION */
+    {-1,2,0,0,16,0,1,0},        /* RX_DATA_BUF_ADDR */
+    {-1,4,0,0,8,0,1,0},         /* RX_DATA_BUF_DATA */
+    {-1,5,0,0,8,0,1,0},         /* TX_DATA_BUF_ADDR */
+    {-1,6,0,0,8,0,1,0},         /* TX_DATA_BUF_DATA */
+    {-1,7,0,0,8,0,1,0},         /* CAPTURE_RAM_ADDR */
+    {-1,8,0,0,8,1,1,0},         /* CAPTURE_RAM_DATA */
+    {-1,9,0,0,8,0,1,0},         /* MCU_PROM_ADDR */
+    {-1,10,0,0,8,0,1,0},        /* MCU_PROM_DATA */
+    {-1,11,0,0,8,0,1,0},        /* RX_PACKET_DATA_FIFO_NUM_STORED */
+    {-1,12,0,0,16,1,1,0},       /* RX_PACKET_DATA_FIFO_ADDR_POINTER */
+    {-1,14,0,0,8,1,1,0},        /* RX_PACKET_DATA_FIFO_STATUS */
+    {-1,15,0,0,8,1,1,0},        /* RX_PACKET_DATA_FIFO_PAYLOAD_SIZE */
+    {-1,16,0,0,1,0,0,0},        /* MBWSSF_MODEM_ENABLE */
+    {-1,16,1,0,1,0,0,0},        /* CONCENTRATOR_MODEM_ENABLE */
+    {-1,16,2,0,1,0,0,0},        /* FSK_MODEM_ENABLE */
+    {-1,16,3,0,1,0,0,0},        /* GLOBAL_EN */
+    {-1,17,0,0,1,0,0,1},        /* CLK32M_EN */
+    {-1,17,1,0,1,0,0,1},        /* CLKHS_EN */
+    {-1,18,0,0,1,0,1,0},        /* START_BIST0 */
+    {-1,18,1,0,1,0,1,0},        /* START_BIST1 */
+    {-1,18,2,0,1,0,1,0},        /* CLEAR_BIST0 */
+    {-1,18,3,0,1,0,1,0},        /* CLEAR_BIST1 */
+    {-1,19,0,0,1,1,1,0},        /* BIST0_FINISHED */
+    {-1,19,1,0,1,1,1,0},        /* BIST1_FINISHED */
+    {-1,20,0,0,1,1,1,0},        /* MCU_AGC_PROG_RAM_BIST_STATUS */
+    {-1,20,1,0,1,1,1,0},        /* MCU_ARB_PROG_RAM_BIST_STATUS */
+    {-1,20,2,0,1,1,1,0},        /* CAPTURE_RAM_BIST_STATUS */
+    {-1,20,3,0,1,1,1,0},        /* CHAN_FIR_RAM0_BIST_STATUS */
+    {-1,20,4,0,1,1,1,0},        /* CHAN_FIR_RAM1_BIST_STATUS */
+    {-1,21,0,0,1,1,1,0},        /* CORR0_RAM_BIST_STATUS */
+    {-1,21,1,0,1,1,1,0},        /* CORR1_RAM_BIST_STATUS */
+    {-1,21,2,0,1,1,1,0},        /* CORR2_RAM_BIST_STATUS */
+    {-1,21,3,0,1,1,1,0},        /* CORR3_RAM_BIST_STATUS */
+    {-1,21,4,0,1,1,1,0},        /* CORR4_RAM_BIST_STATUS */
+    {-1,21,5,0,1,1,1,0},        /* CORR5_RAM_BIST_STATUS */
+    {-1,21,6,0,1,1,1,0},        /* CORR6_RAM_BIST_STATUS */
+    {-1,21,7,0,1,1,1,0},        /* CORR7_RAM_BIST_STATUS */
+    {-1,22,0,0,1,1,1,0},        /* MODEM0_RAM0_BIST_STATUS */
+    {-1,22,1,0,1,1,1,0},        /* MODEM1_RAM0_BIST_STATUS */
+    {-1,22,2,0,1,1,1,0},        /* MODEM2_RAM0_BIST_STATUS */
+    {-1,22,3,0,1,1,1,0},        /* MODEM3_RAM0_BIST_STATUS */
+    {-1,22,4,0,1,1,1,0},        /* MODEM4_RAM0_BIST_STATUS */
+    {-1,22,5,0,1,1,1,0},        /* MODEM5_RAM0_BIST_STATUS */
+    {-1,22,6,0,1,1,1,0},        /* MODEM6_RAM0_BIST_STATUS */
+    {-1,22,7,0,1,1,1,0},        /* MODEM7_RAM0_BIST_STATUS */
+    {-1,23,0,0,1,1,1,0},        /* MODEM0_RAM1_BIST_STATUS */
+    {-1,23,1,0,1,1,1,0},        /* MODEM1_RAM1_BIST_STATUS */
+    {-1,23,2,0,1,1,1,0},        /* MODEM2_RAM1_BIST_STATUS */
+    {-1,23,3,0,1,1,1,0},        /* MODEM3_RAM1_BIST_STATUS */
+    {-1,23,4,0,1,1,1,0},        /* MODEM4_RAM1_BIST_STATUS */
+    {-1,23,5,0,1,1,1,0},        /* MODEM5_RAM1_BIST_STATUS */
+    {-1,23,6,0,1,1,1,0},        /* MODEM6_RAM1_BIST_STATUS */
+    {-1,23,7,0,1,1,1,0},        /* MODEM7_RAM1_BIST_STATUS */
+    {-1,24,0,0,1,1,1,0},        /* MODEM0_RAM2_BIST_STATUS */
+    {-1,24,1,0,1,1,1,0},        /* MODEM1_RAM2_BIST_STATUS */
+    {-1,24,2,0,1,1,1,0},        /* MODEM2_RAM2_BIST_STATUS */
+    {-1,24,3,0,1,1,1,0},        /* MODEM3_RAM2_BIST_STATUS */
+    {-1,24,4,0,1,1,1,0},        /* MODEM4_RAM2_BIST_STATUS */
+    {-1,24,5,0,1,1,1,0},        /* MODEM5_RAM2_BIST_STATUS */
+    {-1,24,6,0,1,1,1,0},        /* MODEM6_RAM2_BIST_STATUS */
+    {-1,24,7,0,1,1,1,0},        /* MODEM7_RAM2_BIST_STATUS */
+    {-1,25,0,0,1,1,1,0},        /* MODEM_MBWSSF_RAM0_BIST_STATUS */
+    {-1,25,1,0,1,1,1,0},        /* MODEM_MBWSSF_RAM1_BIST_STATUS */
+    {-1,25,2,0,1,1,1,0},        /* MODEM_MBWSSF_RAM2_BIST_STATUS */
+    {-1,26,0,0,1,1,1,0},        /* MCU_AGC_DATA_RAM_BIST0_STATUS */
+    {-1,26,1,0,1,1,1,0},        /* MCU_AGC_DATA_RAM_BIST1_STATUS */
+    {-1,26,2,0,1,1,1,0},        /* MCU_ARB_DATA_RAM_BIST0_STATUS */
+    {-1,26,3,0,1,1,1,0},        /* MCU_ARB_DATA_RAM_BIST1_STATUS */
+    {-1,26,4,0,1,1,1,0},        /* TX_TOP_RAM_BIST0_STATUS */
+    {-1,26,5,0,1,1,1,0},        /* TX_TOP_RAM_BIST1_STATUS */
+    {-1,26,6,0,1,1,1,0},        /* DATA_MNGT_RAM_BIST0_STATUS */
+    {-1,26,7,0,1,1,1,0},        /* DATA_MNGT_RAM_BIST1_STATUS */
+    {-1,27,0,0,4,0,0,0},        /* GPIO_SELECT_INPUT */
+    {-1,28,0,0,4,0,0,0},        /* GPIO_SELECT_OUTPUT */
+    {-1,29,0,0,5,0,0,0},        /* GPIO_MODE */
+    {-1,30,0,0,5,1,1,0},        /* GPIO_PIN_REG_IN */
+    {-1,31,0,0,5,0,1,0},        /* GPIO_PIN_REG_OUT */
+    {-1,32,0,0,8,1,1,0},        /* MCU_AGC_STATUS */
+    {-1,125,0,0,8,1,1,0},       /* MCU_ARB_STATUS */
+    {-1,126,0,0,8,1,1,1},       /* CHIP_ID */
+    {-1,127,0,0,1,0,1,1},       /* EMERGENCY_FORCE_HOST_CTRL */
+    {0,33,0,0,1,0,0,0},         /* RX_INVERT_IQ */
+    {0,33,1,0,1,0,0,1},         /* MODEM_INVERT_IQ */
+    {0,33,2,0,1,0,0,0},         /* MBWSSF_MODEM_INVERT_IQ */
+    {0,33,3,0,1,0,0,0},         /* RX_EDGE_SELECT */
+    {0,33,4,0,1,0,0,0},         /* MISC_RADIO_EN */
+    {0,33,5,0,1,0,0,0},         /* FSK_MODEM_INVERT_IQ */
+    {0,34,0,0,4,0,1,7},         /* FILTER_GAIN */
+    {0,35,0,0,8,0,1,240},       /* RADIO_SELECT */
+    {0,36,0,1,13,0,0,-384},     /* IF_FREQ_0 */
+    {0,38,0,1,13,0,0,-128},     /* IF_FREQ_1 */
+    {0,40,0,1,13,0,0,128},      /* IF_FREQ_2 */
+    {0,42,0,1,13,0,0,384},      /* IF_FREQ_3 */
+    {0,44,0,1,13,0,0,-384},     /* IF_FREQ_4 */
+    {0,46,0,1,13,0,0,-128},     /* IF_FREQ_5 */
+    {0,48,0,1,13,0,0,128},      /* IF_FREQ_6 */
+    {0,50,0,1,13,0,0,384},      /* IF_FREQ_7 */
+    {0,52,0,1,13,0,0,0},        /* IF_FREQ_8 */
+    {0,54,0,1,13,0,0,0},        /* IF_FREQ_9 */
+    {0,64,0,0,1,0,0,0},        /* CHANN_OVERRIDE_AGC_GAIN */
+    {0,64,1,0,4,0,1,7},        /* CHANN_AGC_GAIN */
+    {0,65,0,0,7,0,0,0},        /* CORR0_DETECT_EN */
+    {0,66,0,0,7,0,0,0},        /* CORR1_DETECT_EN */
+    {0,67,0,0,7,0,0,0},        /* CORR2_DETECT_EN */
+    {0,68,0,0,7,0,0,0},        /* CORR3_DETECT_EN */
+    {0,69,0,0,7,0,0,0},        /* CORR4_DETECT_EN */
+    {0,70,0,0,7,0,0,0},        /* CORR5_DETECT_EN */
+    {0,71,0,0,7,0,0,0},        /* CORR6_DETECT_EN */
+    {0,72,0,0,7,0,0,0},        /* CORR7_DETECT_EN */
+    {0,73,0,0,1,0,0,0},        /* CORR_SAME_PEAKS_OPTION_SF6 */
+    {0,73,1,0,1,0,0,1},        /* CORR_SAME_PEAKS_OPTION_SF7 */
+    {0,73,2,0,1,0,0,1},        /* CORR_SAME_PEAKS_OPTION_SF8 */
+    {0,73,3,0,1,0,0,1},        /* CORR_SAME_PEAKS_OPTION_SF9 */
+    {0,73,4,0,1,0,0,1},        /* CORR_SAME_PEAKS_OPTION_SF10 */
+    {0,73,5,0,1,0,0,1},        /* CORR_SAME_PEAKS_OPTION_SF11 */
+    {0,73,6,0,1,0,0,1},        /* CORR_SAME_PEAKS_OPTION_SF12 */
+    {0,74,0,0,4,0,0,4},        /* CORR_SIG_NOISE_RATIO_SF6 */
+    {0,74,4,0,4,0,0,4},        /* CORR_SIG_NOISE_RATIO_SF7 */
+    {0,75,0,0,4,0,0,4},        /* CORR_SIG_NOISE_RATIO_SF8 */
+    {0,75,4,0,4,0,0,4},        /* CORR_SIG_NOISE_RATIO_SF9 */
+    {0,76,0,0,4,0,0,4},        /* CORR_SIG_NOISE_RATIO_SF10 */
+    {0,76,4,0,4,0,0,4},        /* CORR_SIG_NOISE_RATIO_SF11 */
+    {0,77,0,0,4,0,0,4},        /* CORR_SIG_NOISE_RATIO_SF12 */
+    {0,78,0,0,4,0,0,4},        /* CORR_NUM_SAME_PEAK */
+    {0,78,4,0,3,0,0,5},        /* CORR_MAC_GAIN */
+    {0,81,0,0,12,0,0,0},       /* ADJUST_MODEM_START_OFFSET_RDX4 */
+    {0,83,0,0,12,0,0,4092},    /* ADJUST_MODEM_START_OFFSET_SF12_RDX4 */
+    {0,85,0,0,8,0,0,7},        /* DBG_CORR_SELECT_SF */
+    {0,86,0,0,8,0,0,0},        /* DBG_CORR_SELECT_CHANNEL */
+    {0,87,0,0,8,1,1,0},        /* DBG_DETECT_CPT */
+    {0,88,0,0,8,1,1,0},        /* DBG_SYMB_CPT */
+    {0,89,0,0,1,0,0,1},        /* CHIRP_INVERT_RX */
+    {0,89,1,0,1,0,0,1},        /* DC_NOTCH_EN */
+    {0,90,0,0,1,0,0,0},        /* IMPLICIT_CRC_EN */
+    {0,90,1,0,3,0,0,0},        /* IMPLICIT_CODING_RATE */
+    {0,91,0,0,8,0,0,0},        /* IMPLICIT_PAYLOAD_LENGHT */
+    {0,92,0,0,8,0,0,29},       /* FREQ_TO_TIME_INVERT */
+    {0,93,0,0,6,0,0,9},        /* FREQ_TO_TIME_DRIFT */
+    {0,94,0,0,2,0,0,2},        /* PAYLOAD_FINE_TIMING_GAIN */
+    {0,94,2,0,2,0,0,1},        /* PREAMBLE_FINE_TIMING_GAIN */
+    {0,94,4,0,2,0,0,0},        /* TRACKING_INTEGRAL */
+    {0,95,0,0,4,0,0,1},        /* FRAME_SYNCH_PEAK1_POS */
+    {0,95,4,0,4,0,0,2},        /* FRAME_SYNCH_PEAK2_POS */
+    {0,96,0,0,16,0,0,10},      /* PREAMBLE_SYMB1_NB */
+    {0,98,0,0,1,0,0,1},        /* FRAME_SYNCH_GAIN */
+    {0,98,1,0,1,0,0,1},        /* SYNCH_DETECT_TH */
+    {0,99,0,0,4,0,0,8},        /* LLR_SCALE */
+    {0,99,4,0,2,0,0,2},        /* SNR_AVG_CST */
+    {0,100,0,0,7,0,0,0},       /* PPM_OFFSET */
+    {0,101,0,0,8,0,0,255},     /* MAX_PAYLOAD_LEN */
+    {0,102,0,0,1,0,0,1},        /* ONLY_CRC_EN */
+    {0,103,0,0,8,0,0,0},        /* ZERO_PAD */
+    {0,104,0,0,4,0,0,8},        /* DEC_GAIN_OFFSET */
+    {0,104,4,0,4,0,0,7},        /* CHAN_GAIN_OFFSET */
+    {0,105,1,0,1,0,0,1},        /* FORCE_HOST_RADIO_CTRL */
+    {0,105,2,0,1,0,0,1},        /* FORCE_HOST_FE_CTRL */
+    {0,105,3,0,1,0,0,1},        /* FORCE_DEC_FILTER_GAIN */
+    {0,106,0,0,1,0,0,1},        /* MCU_RST_0 */
+    {0,106,1,0,1,0,0,1},        /* MCU_RST_1 */
+    {0,106,2,0,1,0,0,0},        /* MCU_SELECT_MUX_0 */
+    {0,106,3,0,1,0,0,0},        /* MCU_SELECT_MUX_1 */
+    {0,106,4,0,1,1,1,0},        /* MCU_CORRUPTION_DETECTED_0 */
+    {0,106,5,0,1,1,1,0},        /* MCU_CORRUPTION_DETECTED_1 */
+    {0,106,6,0,1,0,0,0},        /* MCU_SELECT_EDGE_0 */
+    {0,106,7,0,1,0,0,0},        /* MCU_SELECT_EDGE_1 */
+    {0,107,0,0,8,0,0,1},        /* CHANN_SELECT_RSSI */
+    {0,108,0,0,8,0,0,32},       /* RSSI_BB_DEFAULT_VALUE */
+    {0,109,0,0,8,0,0,100},      /* RSSI_DEC_DEFAULT_VALUE */
+    {0,110,0,0,8,0,0,100},      /* RSSI_CHANN_DEFAULT_VALUE */
+    {0,111,0,0,5,0,0,7},        /* RSSI_BB_FILTER_ALPHA */
+    {0,112,0,0,5,0,0,5},        /* RSSI_DEC_FILTER_ALPHA */
+    {0,113,0,0,5,0,0,8},        /* RSSI_CHANN_FILTER_ALPHA */
+    {0,114,0,0,6,0,0,0},        /* IQ_MISMATCH_A_AMP_COEFF */
+    {0,115,0,0,6,0,0,0},        /* IQ_MISMATCH_A_PHI_COEFF */
+    {0,116,0,0,6,0,0,0},        /* IQ_MISMATCH_B_AMP_COEFF */
+    {0,116,6,0,1,0,0,0},        /* IQ_MISMATCH_B_SEL_I */
+    {0,117,0,0,6,0,0,0},        /* IQ_MISMATCH_B_PHI_COEFF */
+    {1,33,0,0,1,0,1,0},         /* TX_TRIG_IMMEDIATE */
+    {1,33,1,0,1,0,1,0},         /* TX_TRIG_DELAYED */
+    {1,33,2,0,1,0,1,0},         /* TX_TRIG_GPS */
+    {1,34,0,0,16,0,0,0},        /* TX_START_DELAY */
+    {1,36,0,0,4,0,0,1},        /* TX_FRAME_SYNCH_PEAK1_POS */
+    {1,36,4,0,4,0,0,2},        /* TX_FRAME_SYNCH_PEAK2_POS */
+    {1,37,0,0,3,0,0,0},        /* TX_RAMP_DURATION */
+    {1,39,0,1,8,0,0,0},        /* TX_OFFSET_I */
+    {1,40,0,1,8,0,0,0},        /* TX_OFFSET_Q */
+    {1,41,0,0,1,0,0,0},        /* TX_MODE */
+    {1,41,1,0,4,0,0,0},        /* TX_ZERO_PAD */
+    {1,41,5,0,1,0,0,0},        /* TX_EDGE_SELECT */
+    {1,41,6,0,1,0,0,0},        /* TX_EDGE_SELECT_TOP */
+    {1,42,0,0,2,0,0,0},        /* TX_GAIN */
+    {1,42,2,0,3,0,0,5},        /* TX_CHIRP_LOW_PASS */
+    {1,42,5,0,2,0,0,0},        /* TX_FCC_WIDEBAND */
+    {1,42,7,0,1,0,0,1},        /* TX_SWAP_IQ */
+    {1,43,0,0,1,0,0,0},        /* MBWSSF_IMPLICIT_HEADER */
+    {1,43,1,0,1,0,0,0},        /* MBWSSF_IMPLICIT_CRC_EN */
+    {1,43,2,0,3,0,0,0},        /* MBWSSF_IMPLICIT_CODING_RATE */
+    {1,44,0,0,8,0,0,0},        /* MBWSSF_IMPLICIT_PAYLOAD_LENGHT */
+    {1,45,0,0,1,0,0,1},        /* MBWSSF_AGC_FREEZE_ON_DETECT */
+    {1,46,0,0,4,0,0,1},        /* MBWSSF_FRAME_SYNCH_PEAK1_POS */
+    {1,46,4,0,4,0,0,2},        /* MBWSSF_FRAME_SYNCH_PEAK2_POS */
+    {1,47,0,0,16,0,0,10},      /* MBWSSF_PREAMBLE_SYMB1_NB */
+    {1,49,0,0,1,0,0,1},        /* MBWSSF_FRAME_SYNCH_GAIN */
+    {1,49,1,0,1,0,0,1},        /* MBWSSF_SYNCH_DETECT_TH */
+    {1,50,0,0,8,0,0,10},       /* MBWSSF_DETECT_MIN_SINGLE_PEAK */
+    {1,51,0,0,3,0,0,3},        /* MBWSSF_DETECT_TRIG_SAME_PEAK_NB */
+    {1,52,0,0,8,0,0,29},       /* MBWSSF_FREQ_TO_TIME_INVERT */
+    {1,53,0,0,6,0,0,36},       /* MBWSSF_FREQ_TO_TIME_DRIFT */
+    {1,54,0,0,12,0,0,0},       /* MBWSSF_PPM_CORRECTION */
+    {1,56,0,0,2,0,0,2},        /* MBWSSF_PAYLOAD_FINE_TIMING_GAIN */
+    {1,56,2,0,2,0,0,1},        /* MBWSSF_PREAMBLE_FINE_TIMING_GAIN */
+    {1,56,4,0,2,0,0,0},        /* MBWSSF_TRACKING_INTEGRAL */
+    {1,57,0,0,8,0,0,0},        /* MBWSSF_ZERO_PAD */
+    {1,58,0,0,2,0,0,0},        /* MBWSSF_MODEM_BW */
+    {1,58,2,0,1,0,0,0},        /* MBWSSF_RADIO_SELECT */
+    {1,58,3,0,1,0,0,1},        /* MBWSSF_RX_CHIRP_INVERT */
+    {1,59,0,0,4,0,0,8},        /* MBWSSF_LLR_SCALE */
+    {1,59,4,0,2,0,0,3},        /* MBWSSF_SNR_AVG_CST */
+    {1,59,6,0,1,0,0,0},        /* MBWSSF_PPM_OFFSET */
+    {1,60,0,0,4,0,0,7},        /* MBWSSF_RATE_SF */
+    {1,60,4,0,1,0,0,1},        /* MBWSSF_ONLY_CRC_EN */
+    {1,61,0,0,8,0,0,255},      /* MBWSSF_MAX_PAYLOAD_LEN */
+    {1,62,0,0,8,1,1,128},      /* TX_STATUS */
+    {1,63,0,0,3,0,0,0},        /* FSK_CH_BW_EXPO */
+    {1,63,3,0,3,0,0,0},        /* FSK_RSSI_LENGTH */
+    {1,63,6,0,1,0,0,0},        /* FSK_RX_INVERT */
+    {1,63,7,0,1,0,0,0},        /* FSK_PKT_MODE */
+    {1,64,0,0,3,0,0,0},        /* FSK_PSIZE */
+    {1,64,3,0,1,0,0,0},        /* FSK_CRC_EN */
+    {1,64,4,0,2,0,0,0},        /* FSK_DCFREE_ENC */
+    {1,64,6,0,1,0,0,0},        /* FSK_CRC_IBM */
+    {1,65,0,0,5,0,0,0},        /* FSK_ERROR_OSR_TOL */
+    {1,65,7,0,1,0,0,0},        /* FSK_RADIO_SELECT */
+    {1,66,0,0,16,0,0,0},       /* FSK_BR_RATIO */
+    {1,68,0,0,32,0,0,0},       /* FSK_REF_PATTERN_LSB */
+    {1,72,0,0,32,0,0,0},       /* FSK_REF_PATTERN_MSB */
+    {1,76,0,0,8,0,0,0},        /* FSK_PKT_LENGTH */
+    {1,77,0,0,1,0,0,1},        /* FSK_TX_GAUSSIAN_EN */
+    {1,77,1,0,2,0,0,0},        /* FSK_TX_GAUSSIAN_SELECT_BT */
+    {1,77,3,0,1,0,0,1},        /* FSK_TX_PATTERN_EN */
+    {1,77,4,0,1,0,0,0},        /* FSK_TX_PREAMBLE_SEQ */
+    {1,77,5,0,3,0,0,0},        /* FSK_TX_PSIZE */
+    {1,80,0,0,8,0,0,0},        /* FSK_NODE_ADRS */
+    {1,81,0,0,8,0,0,0},        /* FSK_BROADCAST */
+    {1,82,0,0,1,0,0,1},        /* FSK_AUTO_AFC_ON */
+    {1,83,0,0,10,0,0,0},       /* FSK_PATTERN_TIMEOUT_CFG */
+    {2,33,0,0,8,0,1,0},        /* SPI_RADIO_A__DATA */
+    {2,34,0,0,8,1,1,0},        /* SPI_RADIO_A__DATA_READBACK */
+    {2,35,0,0,8,0,1,0},        /* SPI_RADIO_A__ADDR */
+    {2,37,0,0,1,0,1,0},        /* SPI_RADIO_A__CS */
+    {2,38,0,0,8,0,1,0},        /* SPI_RADIO_B__DATA */
+    {2,39,0,0,8,1,1,0},        /* SPI_RADIO_B__DATA_READBACK */
+    {2,40,0,0,8,0,1,0},        /* SPI_RADIO_B__ADDR */
+    {2,42,0,0,1,0,1,0},        /* SPI_RADIO_B__CS */
+    {2,43,0,0,1,0,1,0},        /* RADIO_A_EN */
+    {2,43,1,0,1,0,1,0},        /* RADIO_B_EN */
+    {2,43,2,0,1,0,1,1},        /* RADIO_RST */
+    {2,43,3,0,1,0,1,0},        /* LNA_A_EN */
+    {2,43,4,0,1,0,1,0},        /* PA_A_EN */
+    {2,43,5,0,1,0,1,0},        /* LNA_B_EN */
+    {2,43,6,0,1,0,1,0},        /* PA_B_EN */
+    {2,44,0,0,2,0,1,0},        /* PA_GAIN */
+    {2,45,0,0,4,0,0,2},        /* LNA_A_CTRL_LUT */
+    {2,45,4,0,4,0,0,4},        /* PA_A_CTRL_LUT */
+    {2,46,0,0,4,0,0,2},        /* LNA_B_CTRL_LUT */
+    {2,46,4,0,4,0,0,4},        /* PA_B_CTRL_LUT */
+    {2,47,0,0,5,0,0,0},        /* CAPTURE_SOURCE */
+    {2,47,5,0,1,0,1,0},        /* CAPTURE_START */
+    {2,47,6,0,1,0,1,0},        /* CAPTURE_FORCE_TRIGGER */
+    {2,47,7,0,1,0,0,0},        /* CAPTURE_WRAP */
+    {2,48,0,0,16,0,0,0},       /* CAPTURE_PERIOD */
+    {2,51,0,0,8,1,1,0},        /* MODEM_STATUS */
+    {2,52,0,0,8,1,1,0},        /* VALID_HEADER_COUNTER_0 */
+    {2,54,0,0,8,1,1,0},        /* VALID_PACKET_COUNTER_0 */
+    {2,56,0,0,8,1,1,0},        /* VALID_HEADER_COUNTER_MBWSSF */
+    {2,57,0,0,8,1,1,0},        /* VALID_HEADER_COUNTER_FSK */
+    {2,58,0,0,8,1,1,0},        /* VALID_PACKET_COUNTER_MBWSSF */
+    {2,59,0,0,8,1,1,0},        /* VALID_PACKET_COUNTER_FSK */
+    {2,60,0,0,8,1,1,0},        /* CHANN_RSSI */
+    {2,61,0,0,8,1,1,0},        /* BB_RSSI */
+    {2,62,0,0,8,1,1,0},        /* DEC_RSSI */
+    {2,63,0,0,8,1,1,0},        /* DBG_MCU_DATA */
+    {2,64,0,0,8,1,1,0},        /* DBG_ARB_MCU_RAM_DATA */
+    {2,65,0,0,8,1,1,0},        /* DBG_AGC_MCU_RAM_DATA */
+    {2,66,0,0,16,1,1,0},       /* NEXT_PACKET_CNT */
+    {2,68,0,0,16,1,1,0},       /* ADDR_CAPTURE_COUNT */
+    {2,70,0,0,32,1,1,0},       /* TIMESTAMP */
+    {2,74,0,0,4,1,1,0},        /* DBG_CHANN0_GAIN */
+    {2,74,4,0,4,1,1,0},        /* DBG_CHANN1_GAIN */
+    {2,75,0,0,4,1,1,0},        /* DBG_CHANN2_GAIN */
+    {2,75,4,0,4,1,1,0},        /* DBG_CHANN3_GAIN */
+    {2,76,0,0,4,1,1,0},        /* DBG_CHANN4_GAIN */
+    {2,76,4,0,4,1,1,0},        /* DBG_CHANN5_GAIN */
+    {2,77,0,0,4,1,1,0},        /* DBG_CHANN6_GAIN */
+    {2,77,4,0,4,1,1,0},        /* DBG_CHANN7_GAIN */
+    {2,78,0,0,4,1,1,0},        /* DBG_DEC_FILT_GAIN */
+    {2,79,0,0,3,1,1,0},        /* SPI_DATA_FIFO_PTR */
+    {2,79,3,0,3,1,1,0},        /* PACKET_DATA_FIFO_PTR */
+    {2,80,0,0,8,0,0,0},        /* DBG_ARB_MCU_RAM_ADDR */
+    {2,81,0,0,8,0,0,0},        /* DBG_AGC_MCU_RAM_ADDR */
+    {2,82,0,0,1,0,0,0},        /* SPI_MASTER_CHIP_SELECT_POLARITY */
+    {2,82,1,0,1,0,0,0},        /* SPI_MASTER_CPOL */
+    {2,82,2,0,1,0,0,0},        /* SPI_MASTER_CPHA */
+    {2,83,0,0,1,0,0,0},        /* SIG_GEN_ANALYSER_MUX_SEL */
+    {2,84,0,0,1,0,0,0},        /* SIG_GEN_EN */
+    {2,84,1,0,1,0,0,0},        /* SIG_ANALYSER_EN */
+    {2,84,2,0,2,0,0,0},        /* SIG_ANALYSER_AVG_LEN */
+    {2,84,4,0,3,0,0,0},        /* SIG_ANALYSER_PRECISION */
+    {2,84,7,0,1,1,1,0},        /* SIG_ANALYSER_VALID_OUT */
+    {2,85,0,0,8,0,0,0},        /* SIG_GEN_FREQ */
+    {2,86,0,0,8,0,0,0},        /* SIG_ANALYSER_FREQ */
+    {2,87,0,0,8,1,1,0},        /* SIG_ANALYSER_I_OUT */
+    {2,88,0,0,8,1,1,0},        /* SIG_ANALYSER_Q_OUT */
+    {2,89,0,0,1,0,0,0},        /* GPS_EN */
+    {2,89,1,0,1,0,0,1},        /* GPS_POL */
+    {2,90,0,1,8,0,0,0},        /* SW_TEST_REG1 */
+    {2,91,2,1,6,0,0,0},        /* SW_TEST_REG2 */
+    {2,92,0,1,16,0,0,0},       /* SW_TEST_REG3 */
+    {2,94,0,0,4,1,1,0},        /* DATA_MNGT_STATUS */
+    {2,95,0,0,5,1,1,0},        /* DATA_MNGT_CPT_FRAME_ALLOCATED */
+    {2,96,0,0,5,1,1,0},        /* DATA_MNGT_CPT_FRAME_FINISHED */
+    {2,97,0,0,5,1,1,0},        /* DATA_MNGT_CPT_FRAME_READEN */
+    {1,33,0,0,8,0,1,0}         /* TX_TRIG_ALL (alias) */
 };
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
-static int lgw_regpage = -1; /*! keep the value of the register page selected */
+/* state of the register layer, one per concentrator context */
+struct lgw_reg_state_s {
+    /* serializes the register transactions (see lgw_reg_lock) */
+    pthread_mutex_t             mx;
+    int                         lock_depth;     /*! nesting level of the lock in the thread owning it */
+    struct lgw_reg_lock_stats_s lock_stats;
+
+    int                         page;           /*! keep the value of the register page selected */
+    bool                        page_valid;     /*! false when the page may have been changed behind our back (MCU handover) */
+    struct lgw_reg_page_stats_s page_stats;
+
+    /* register batching (see lgw_reg_batch_begin) */
+    int                         batch_depth;    /*! number of nested lgw_reg_batch_begin calls */
+    struct lgw_spi_batch_s      batch;          /*! SPI accesses queued while batching */
+    int16_t                     batch_shadow[REG_CACHE_ROWS][128]; /*! last SX1301 byte queued for each page/address during the current batch, -1 if unknown */
+
+    /* shadow copy of the register file (see lgw_reg_cache_setconf) */
+    uint8_t                     cache_mode;
+    int16_t                     cache[REG_CACHE_ROWS][128]; /*! cached value of each SX1301 byte, -1 if unknown */
+    uint32_t                    cache_hit;
+    uint32_t                    cache_miss;
+    uint32_t                    cache_mismatch;
+};
+
+#define REG_STATE_INIT { .mx = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP, .page = -1, .page_valid = false, .batch_depth = 0, .cache_mode = LGW_REG_CACHE_OFF }
+
+/* REG_MAP_* class of each SX1301 byte, built from loregs, common to all contexts */
+static uint8_t reg_map[REG_CACHE_ROWS][128];
+static pthread_once_t reg_map_once = PTHREAD_ONCE_INIT;
 
 /* -------------------------------------------------------------------------- */
 /* --- INTERNAL SHARED VARIABLES -------------------------------------------- */
 
-void *lgw_spi_target = NULL; /*! generic pointer to the SPI device */
-uint8_t lgw_spi_mux_mode = 0; /*! current SPI mux mode used */
+struct lgw_reg_state_s lgw_reg_state_default = REG_STATE_INIT; /*! state of the default context */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
 
+/* bodies of the public functions, called with the register lock held */
+static int reg_connect(bool spi_only, uint32_t tx_notch_freq);
+static int reg_write(uint16_t register_id, int32_t reg_value);
+static int reg_read(uint16_t register_id, int32_t *reg_value);
+static int reg_write_burst(uint16_t register_id, uint8_t *data, uint16_t size);
+static int reg_read_burst(uint16_t register_id, uint8_t *data, uint16_t size);
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Classify each byte of the SX1301 register file from the loregs table:
+registers of page -1 are mapped on a dedicated row, common to all pages */
+static void reg_map_init(void) {
+    int i, j;
+    int row, nb_byte;
+    uint8_t cls;
+
+    memset(reg_map, REG_MAP_UNUSED, sizeof reg_map);
+    for (i=0; i<LGW_TOTALREGS; ++i) {
+        row = (loregs[i].page < 0) ? REG_CACHE_COMMON : loregs[i].page;
+        nb_byte = (loregs[i].offs + loregs[i].leng + 7) / 8;
+        cls = ((loregs[i].rdon == 1) || (loregs[i].vola == 1)) ? REG_MAP_VOLATILE : REG_MAP_CACHEABLE;
+        for (j=0; (j < nb_byte) && ((loregs[i].addr + j) < 128); ++j) {
+            if (reg_map[row][loregs[i].addr + j] < cls) {
+                reg_map[row][loregs[i].addr + j] = cls;
+            }
+        }
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Row of the shadow tables holding an SX1301 byte, -1 if the page is unknown */
+static int reg_row(uint8_t address) {
+    struct lgw_reg_state_s *reg = lgw_ctx_cur->reg;
+
+    if (reg_map[REG_CACHE_COMMON][address & 0x7F] != REG_MAP_UNUSED) {
+        return REG_CACHE_COMMON;
+    } else if (reg->page_valid == true) {
+        return reg->page;
+    } else {
+        return -1;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Cache entry of a byte, NULL if the access does not target a cacheable
+SX1301 byte or if the cache is disabled */
+static int16_t *reg_cache_entry(void *spi_target, uint8_t spi_mux_target, uint8_t address) {
+    struct lgw_ctx_s *ctx = lgw_ctx_cur;
+    struct lgw_reg_state_s *reg = ctx->reg;
+    int row;
+
+    if ((reg->cache_mode == LGW_REG_CACHE_OFF) || (spi_target != ctx->spi_target) || (spi_mux_target != LGW_SPI_MUX_TARGET_SX1301)) {
+        return NULL;
+    }
+    row = reg_row(address);
+    if ((row < 0) || (reg_map[row][address & 0x7F] != REG_MAP_CACHEABLE)) {
+        return NULL;
+    }
+    return &reg->cache[row][address & 0x7F];
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Compare a byte read from the concentrator with its cached value and refresh
+the cache */
+static void reg_cache_update(int16_t *c, uint8_t data) {
+    struct lgw_reg_state_s *reg = lgw_ctx_cur->reg;
+
+    if ((*c >= 0) && ((uint8_t)*c != data)) {
+        reg->cache_mismatch += 1;
+        DEBUG_PRINTF("WARNING: REGISTER CACHE MISMATCH (row %d, address %d): cached 0x%02X, read 0x%02X\n", (int)(c - &reg->cache[0][0]) / 128, (int)(c - &reg->cache[0][0]) % 128, (uint8_t)*c, data);
+    }
+    *c = data;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void reg_cache_clear(void) {
+    struct lgw_reg_state_s *reg = lgw_ctx_cur->reg;
+
+    memset(reg->cache, 0xFF, sizeof reg->cache);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* SPI accesses of the register layer, queued instead of being sent while a
+batch is open; reads send the queued accesses first to preserve ordering */
+
+static bool reg_batch_active(void *spi_target) {
+    struct lgw_reg_state_s *reg = lgw_ctx_cur->reg;
+
+    return ((reg->batch_depth > 0) && (spi_target == reg->batch.spi_target));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int reg_spi_w(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t data) {
+    struct lgw_reg_state_s *reg = lgw_ctx_cur->reg;
+    int16_t *c;
+    int row;
+
+    c = reg_cache_entry(spi_target, spi_mux_target, address);
+    if (c != NULL) {
+        *c = data;
+    }
+
+    if (reg_batch_active(spi_target)) {
+        row = reg_row(address);
+        if ((spi_mux_target == LGW_SPI_MUX_TARGET_SX1301) && (row >= 0)) {
+            reg->batch_shadow[row][address & 0x7F] = data;
+        }
+        return lgw_spi_batch_w(&reg->batch, spi_mux_mode, spi_mux_target, address, data);
+    } else {
+        return lgw_spi_w(spi_target, spi_mux_mode, spi_mux_target, address, data);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int reg_spi_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+    struct lgw_reg_state_s *reg = lgw_ctx_cur->reg;
+    int16_t *c;
+    int row;
+    int i;
+
+    /* bursts starting on a volatile byte (data buffers) do not touch the cache */
+    if (reg_cache_entry(spi_target, spi_mux_target, address) != NULL) {
+        for (i=0; (i < size) && ((address + i) < 128); ++i) {
+            c = reg_cache_entry(spi_target, spi_mux_target, address + i);
+            if (c != NULL) {
+                *c = data[i];
+            }
+        }
+    }
+
+    if (reg_batch_active(spi_target)) {
+        row = reg_row(address);
+        if ((spi_mux_target == LGW_SPI_MUX_TARGET_SX1301) && (row >= 0)) {
+            for (i=address; (i < (address + size)) && (i < 128); ++i) {
+                reg->batch_shadow[row][i] = -1;
+            }
+        }
+        return lgw_spi_batch_wb(&reg->batch, spi_mux_mode, spi_mux_target, address, data, size);
+    } else {
+        return lgw_spi_wb(spi_target, spi_mux_mode, spi_mux_target, address, data, size);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int reg_spi_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data) {
+    struct lgw_reg_state_s *reg = lgw_ctx_cur->reg;
+    int16_t *c;
+    int spi_stat;
+
+    c = reg_cache_entry(spi_target, spi_mux_target, address);
+    if (c != NULL) {
+        if (*c >= 0) {
+            reg->cache_hit += 1;
+            if (reg->cache_mode == LGW_REG_CACHE_ON) {
+                *data = (uint8_t)*c;
+                return LGW_SPI_SUCCESS;
+            }
+        } else {
+            reg->cache_miss += 1;
+        }
+    }
+
+    if (reg_batch_active(spi_target)) {
+        if (lgw_spi_batch_flush(&reg->batch) != LGW_SPI_SUCCESS) {
+            return LGW_SPI_ERROR;
+        }
+    }
+    spi_stat = lgw_spi_r(spi_target, spi_mux_mode, spi_mux_target, address, data);
+
+    if ((c != NULL) && (spi_stat == LGW_SPI_SUCCESS)) {
+        reg_cache_update(c, *data);
+    }
+    return spi_stat;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int reg_spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+    struct lgw_reg_state_s *reg = lgw_ctx_cur->reg;
+    int16_t *c;
+    bool cached;
+    int spi_stat;
+    int i;
+
+    /* only bursts starting on a cacheable byte (multi-byte registers) are cached */
+    cached = (reg_cache_entry(spi_target, spi_mux_target, address) != NULL);
+    if (cached) {
+        for (i=0; i<size; ++i) {
+            c = ((address + i) < 128) ? reg_cache_entry(spi_target, spi_mux_target, address + i) : NULL;
+            if ((c == NULL) || (*c < 0)) {
+                break;
+            }
+        }
+        if (i == size) {
+            reg->cache_hit += 1;
+            if (reg->cache_mode == LGW_REG_CACHE_ON) {
+                for (i=0; i<size; ++i) {
+                    data[i] = (uint8_t)*reg_cache_entry(spi_target, spi_mux_target, address + i);
+                }
+                return LGW_SPI_SUCCESS;
+            }
+        } else {
+            reg->cache_miss += 1;
+        }
+    }
+
+    if (reg_batch_active(spi_target)) {
+        if (lgw_spi_batch_flush(&reg->batch) != LGW_SPI_SUCCESS) {
+            return LGW_SPI_ERROR;
+        }
+    }
+    spi_stat = lgw_spi_rb(spi_target, spi_mux_mode, spi_mux_target, address, data, size);
+
+    if (cached && (spi_stat == LGW_SPI_SUCCESS)) {
+        for (i=0; (i < size) && ((address + i) < 128); ++i) {
+            c = reg_cache_entry(spi_target, spi_mux_target, address + i);
+            if (c != NULL) {
+                reg_cache_update(c, data[i]);
+            }
+        }
+    }
+    return spi_stat;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Old value of a byte for a read-modify-write: while batching, reuse the value
+queued earlier in the same batch instead of flushing to read it back, then try
+the register cache */
+static int reg_spi_r_rmw(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data) {
+    struct lgw_reg_state_s *reg = lgw_ctx_cur->reg;
+    int16_t v;
+    int row;
+
+    row = reg_row(address);
+    if (reg_batch_active(spi_target) && (spi_mux_target == LGW_SPI_MUX_TARGET_SX1301) && (row >= 0)) {
+        v = reg->batch_shadow[row][address & 0x7F];
+        if (v >= 0) {
+            *data = (uint8_t)v;
+            return LGW_SPI_SUCCESS;
+        }
+    }
+    return reg_spi_r(spi_target, spi_mux_mode, spi_mux_target, address, data);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int page_switch(uint8_t target) {
-    lgw_regpage = PAGE_MASK & target;
-    lgw_spi_w(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, PAGE_ADDR, (uint8_t)lgw_regpage);
+    struct lgw_ctx_s *ctx = lgw_ctx_cur;
+    struct lgw_reg_state_s *reg = ctx->reg;
+
+    reg->page = PAGE_MASK & target;
+    reg->page_valid = true;
+    reg->page_stats.nb_switch += 1;
+    lgw_perf_add(LGW_PERF_PAGE_SWITCH, 1);
+    reg_spi_w(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, PAGE_ADDR, (uint8_t)reg->page);
     return LGW_REG_SUCCESS;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+/* Select the page of a register, only if it is not known to be selected */
+static int page_select(int8_t page) {
+    struct lgw_reg_state_s *reg = lgw_ctx_cur->reg;
+
+    if (page == -1) {
+        return LGW_REG_SUCCESS;
+    }
+    reg->page_stats.nb_access += 1;
+    if ((reg->page_valid == true) && (page == reg->page)) {
+        reg->page_stats.nb_skipped += 1;
+        return LGW_REG_SUCCESS;
+    }
+    return page_switch(page);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 bool check_fpga_version(uint8_t version) {
     int i;
 
@@ -428,14 +747,14 @@ int reg_w_align32(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target
 
     if ((r.leng == 8) && (r.offs == 0)) {
         /* direct write */
-        spi_stat += lgw_spi_w(spi_target, spi_mux_mode, spi_mux_target, r.addr, (uint8_t)reg_value);
+        spi_stat += reg_spi_w(spi_target, spi_mux_mode, spi_mux_target, r.addr, (uint8_t)reg_value);
     } else if ((r.offs + r.leng) <= 8) {
         /* single-byte read-modify-write, offs:[0-7], leng:[1-7] */
-        spi_stat += lgw_spi_r(spi_target, spi_mux_mode, spi_mux_target, r.addr, &buf[0]);
+        spi_stat += reg_spi_r_rmw(spi_target, spi_mux_mode, spi_mux_target, r.addr, &buf[0]);
         buf[1] = ((1 << r.leng) - 1) << r.offs; /* bit mask */
         buf[2] = ((uint8_t)reg_value) << r.offs; /* new data offsetted */
         buf[3] = (~buf[1] & buf[0]) | (buf[1] & buf[2]); /* mixing old & new data */
-        spi_stat += lgw_spi_w(spi_target, spi_mux_mode, spi_mux_target, r.addr, buf[3]);
+        spi_stat += reg_spi_w(spi_target, spi_mux_mode, spi_mux_target, r.addr, buf[3]);
     } else if ((r.offs == 0) && (r.leng > 0) && (r.leng <= 32)) {
         /* multi-byte direct write routine */
         size_byte = (r.leng + 7) / 8; /* add a byte if it's not an exact multiple of 8 */
@@ -445,7 +764,7 @@ int reg_w_align32(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target
             buf[i] = (uint8_t)(0x000000FF & reg_value);
             reg_value = (reg_value >> 8);
         }
-        spi_stat += lgw_spi_wb(spi_target, spi_mux_mode, spi_mux_target, r.addr, buf, size_byte); /* write the register in one burst */
+        spi_stat += reg_spi_wb(spi_target, spi_mux_mode, spi_mux_target, r.addr, buf, size_byte); /* write the register in one burst */
     } else {
         /* register spanning multiple memory bytes but with an offset */
         DEBUG_MSG("ERROR: REGISTER SIZE AND OFFSET ARE NOT SUPPORTED\n");
@@ -466,7 +785,7 @@ int reg_r_align32(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target
 
     if ((r.offs + r.leng) <= 8) {
         /* read one byte, then shift and mask bits to get reg value with sign extension if needed */
-        spi_stat += lgw_spi_r(spi_target, spi_mux_mode, spi_mux_target, r.addr, &bufu[0]);
+        spi_stat += reg_spi_r(spi_target, spi_mux_mode, spi_mux_target, r.addr, &bufu[0]);
         bufu[1] = bufu[0] << (8 - r.leng - r.offs); /* left-align the data */
         if (r.sign == true) {
             bufs[2] = bufs[1] >> (8 - r.leng); /* right align the data with sign extension (ARITHMETIC right shift) */
@@ -477,7 +796,7 @@ int reg_r_align32(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target
         }
     } else if ((r.offs == 0) && (r.leng > 0) && (r.leng <= 32)) {
         size_byte = (r.leng + 7) / 8; /* add a byte if it's not an exact multiple of 8 */
-        spi_stat += lgw_spi_rb(spi_target, spi_mux_mode, spi_mux_target, r.addr, bufu, size_byte);
+        spi_stat += reg_spi_rb(spi_target, spi_mux_mode, spi_mux_target, r.addr, bufu, size_byte);
         u = 0;
         for (i=(size_byte-1); i>=0; --i) {
             u = (uint32_t)bufu[i] + (u << 8); /* transform a 4-byte array into a 32 bit word */
@@ -502,18 +821,37 @@ int reg_r_align32(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target
 
 /* Concentrator connect */
 int lgw_connect(bool spi_only, uint32_t tx_notch_freq) {
+    int x;
+
+    lgw_reg_lock();
+    x = reg_connect(spi_only, tx_notch_freq);
+    lgw_reg_unlock();
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int reg_connect(bool spi_only, uint32_t tx_notch_freq) {
+    struct lgw_ctx_s *ctx = lgw_ctx_cur;
+    struct lgw_reg_state_s *reg = ctx->reg;
     int spi_stat = LGW_SPI_SUCCESS;
     uint8_t u = 0;
     int x;
 
     /* check SPI link status */
-    if (lgw_spi_target != NULL) {
+    if (ctx->spi_target != NULL) {
         DEBUG_MSG("WARNING: concentrator was already connected\n");
-        lgw_spi_close(lgw_spi_target);
+        lgw_spi_close(ctx->spi_target);
     }
+    /* a new link never inherits accesses queued on the previous one */
+    for (; reg->batch_depth > 0; reg->batch_depth -= 1) {
+        lgw_reg_unlock(); /* held by this thread since lgw_reg_batch_begin */
+    }
+    pthread_once(&reg_map_once, reg_map_init);
+    reg_cache_clear();
 
     /* open the SPI link */
-    spi_stat = lgw_spi_open(&lgw_spi_target);
+    spi_stat = lgw_spi_open_path((ctx->spi_path[0] != '\0') ? ctx->spi_path : NULL, &ctx->spi_target);
     if (spi_stat != LGW_SPI_SUCCESS) {
         DEBUG_MSG("ERROR CONNECTING CONCENTRATOR\n");
         return LGW_REG_ERROR;
@@ -522,7 +860,7 @@ int lgw_connect(bool spi_only, uint32_t tx_notch_freq) {
     if (spi_only == false ) {
         /* Detect if the gateway has an FPGA with SPI mux header support */
         /* First, we assume there is an FPGA, and try to read its version */
-        spi_stat = lgw_spi_r(lgw_spi_target, LGW_SPI_MUX_MODE1, LGW_SPI_MUX_TARGET_FPGA, loregs[LGW_VERSION].addr, &u);
+        spi_stat = lgw_spi_r(ctx->spi_target, LGW_SPI_MUX_MODE1, LGW_SPI_MUX_TARGET_FPGA, loregs[LGW_VERSION].addr, &u);
         if (spi_stat != LGW_SPI_SUCCESS) {
             DEBUG_MSG("ERROR READING VERSION REGISTER\n");
             return LGW_REG_ERROR;
@@ -530,13 +868,13 @@ int lgw_connect(bool spi_only, uint32_t tx_notch_freq) {
         if (check_fpga_version(u) != true) {
             /* We failed to read expected FPGA version, so let's assume there is no FPGA */
             DEBUG_PRINTF("INFO: no FPGA detected or version not supported (v%u)\n", u);
-            lgw_spi_mux_mode = LGW_SPI_MUX_MODE0;
+            ctx->spi_mux_mode = LGW_SPI_MUX_MODE0;
         } else {
             DEBUG_PRINTF("INFO: detected FPGA with SPI mux header (v%u)\n", u);
-            lgw_spi_mux_mode = LGW_SPI_MUX_MODE1;
+            ctx->spi_mux_mode = LGW_SPI_MUX_MODE1;
             /* FPGA Soft Reset */
-            lgw_spi_w(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_FPGA, 0, 1);
-            lgw_spi_w(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_FPGA, 0, 0);
+            lgw_spi_w(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_FPGA, 0, 1);
+            lgw_spi_w(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_FPGA, 0, 0);
             /* FPGA configure */
             x = lgw_fpga_configure(tx_notch_freq);
             if (x != LGW_REG_SUCCESS) {
@@ -546,7 +884,7 @@ int lgw_connect(bool spi_only, uint32_t tx_notch_freq) {
         }
 
         /* check SX1301 version */
-        spi_stat = lgw_spi_r(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, loregs[LGW_VERSION].addr, &u);
+        spi_stat = lgw_spi_r(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, loregs[LGW_VERSION].addr, &u);
         if (spi_stat != LGW_SPI_SUCCESS) {
             DEBUG_MSG("ERROR READING CHIP VERSION REGISTER\n");
             return LGW_REG_ERROR;
@@ -557,12 +895,13 @@ int lgw_connect(bool spi_only, uint32_t tx_notch_freq) {
         }
 
         /* write 0 to the page/reset register */
-        spi_stat = lgw_spi_w(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, loregs[LGW_PAGE_REG].addr, 0);
+        spi_stat = lgw_spi_w(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, loregs[LGW_PAGE_REG].addr, 0);
         if (spi_stat != LGW_SPI_SUCCESS) {
             DEBUG_MSG("ERROR WRITING PAGE REGISTER\n");
             return LGW_REG_ERROR;
         } else {
-            lgw_regpage = 0;
+            reg->page = 0;
+            reg->page_valid = true;
         }
     }
 
@@ -574,12 +913,26 @@ int lgw_connect(bool spi_only, uint32_t tx_notch_freq) {
 
 /* Concentrator disconnect */
 int lgw_disconnect(void) {
-    if (lgw_spi_target != NULL) {
-        lgw_spi_close(lgw_spi_target);
-        lgw_spi_target = NULL;
+    struct lgw_ctx_s *ctx = lgw_ctx_cur;
+    struct lgw_reg_state_s *reg = ctx->reg;
+
+    lgw_reg_lock();
+    if (ctx->spi_target != NULL) {
+        if (reg->batch_depth > 0) {
+            DEBUG_MSG("WARNING: register batch still open, sending queued accesses\n");
+            lgw_spi_batch_flush(&reg->batch);
+            for (; reg->batch_depth > 0; reg->batch_depth -= 1) {
+                lgw_reg_unlock(); /* held by this thread since lgw_reg_batch_begin */
+            }
+        }
+        lgw_spi_close(ctx->spi_target);
+        ctx->spi_target = NULL;
+        reg_cache_clear();
+        lgw_reg_unlock();
         DEBUG_MSG("Note: success disconnecting the concentrator\n");
         return LGW_REG_SUCCESS;
     } else {
+        lgw_reg_unlock();
         DEBUG_MSG("WARNING: concentrator was already disconnected\n");
         return LGW_REG_ERROR;
     }
@@ -589,13 +942,22 @@ int lgw_disconnect(void) {
 
 /* soft-reset function */
 int lgw_soft_reset(void) {
+    struct lgw_ctx_s *ctx = lgw_ctx_cur;
+    struct lgw_reg_state_s *reg = ctx->reg;
+
     /* check if SPI is initialised */
-    if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+    lgw_reg_lock();
+    if ((ctx->spi_target == NULL) || (reg->page < 0)) {
+        lgw_reg_unlock();
         DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
         return LGW_REG_ERROR;
     }
-    lgw_spi_w(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, 0, 0x80); /* 1 -> SOFT_RESET bit */
-    lgw_regpage = 0; /* reset the paging static variable */
+    reg_spi_w(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, 0, 0x80); /* 1 -> SOFT_RESET bit */
+    reg->page = 0; /* reset the paging static variable */
+    reg->page_valid = true;
+    memset(reg->batch_shadow, 0xFF, sizeof reg->batch_shadow); /* values queued before the reset are stale, mark them unknown */
+    reg_cache_clear();
+    lgw_reg_unlock();
     return LGW_REG_SUCCESS;
 }
 
@@ -603,6 +965,8 @@ int lgw_soft_reset(void) {
 
 /* register verification */
 int lgw_reg_check(FILE *f) {
+    struct lgw_ctx_s *ctx = lgw_ctx_cur;
+    struct lgw_reg_state_s *reg = ctx->reg;
     struct lgw_reg_s r;
     int32_t read_value;
     char ok_msg[] = "+++MATCH+++";
@@ -611,7 +975,7 @@ int lgw_reg_check(FILE *f) {
     int i;
 
     /* check if SPI is initialised */
-    if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+    if ((ctx->spi_target == NULL) || (reg->page < 0)) {
         DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
         fprintf(f, "ERROR: CONCENTRATOR UNCONNECTED\n");
         return LGW_REG_ERROR;
@@ -636,6 +1000,21 @@ int lgw_reg_check(FILE *f) {
 
 /* Write to a register addressed by name */
 int lgw_reg_w(uint16_t register_id, int32_t reg_value) {
+    uint64_t t0 = lgw_perf_start();
+    int x;
+
+    lgw_reg_lock();
+    x = reg_write(register_id, reg_value);
+    lgw_reg_unlock();
+    lgw_perf_stop(LGW_PERF_REG_W, t0);
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int reg_write(uint16_t register_id, int32_t reg_value) {
+    struct lgw_ctx_s *ctx = lgw_ctx_cur;
+    struct lgw_reg_state_s *reg = ctx->reg;
     int spi_stat = LGW_SPI_SUCCESS;
     struct lgw_reg_s r;
 
@@ -646,7 +1025,7 @@ int lgw_reg_w(uint16_t register_id, int32_t reg_value) {
     }
 
     /* check if SPI is initialised */
-    if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+    if ((ctx->spi_target == NULL) || (reg->page < 0)) {
         DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
         return LGW_REG_ERROR;
     }
@@ -672,11 +1051,16 @@ int lgw_reg_w(uint16_t register_id, int32_t reg_value) {
     }
 
     /* select proper register page if needed */
-    if ((r.page != -1) && (r.page != lgw_regpage)) {
-        spi_stat += page_switch(r.page);
-    }
+    spi_stat += page_select(r.page);
 
-    spi_stat += reg_w_align32(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, r, reg_value);
+    spi_stat += reg_w_align32(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, r, reg_value);
+
+    /* the MCUs can modify any register and select any page while they have
+    control of the register file, forget everything on both handovers */
+    if (register_id == LGW_EMERGENCY_FORCE_HOST_CTRL) {
+        reg_cache_clear();
+        lgw_reg_page_invalidate();
+    }
 
     if (spi_stat != LGW_SPI_SUCCESS) {
         DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER WRITE\n");
@@ -690,6 +1074,21 @@ int lgw_reg_w(uint16_t register_id, int32_t reg_value) {
 
 /* Read to a register addressed by name */
 int lgw_reg_r(uint16_t register_id, int32_t *reg_value) {
+    uint64_t t0 = lgw_perf_start();
+    int x;
+
+    lgw_reg_lock();
+    x = reg_read(register_id, reg_value);
+    lgw_reg_unlock();
+    lgw_perf_stop(LGW_PERF_REG_R, t0);
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int reg_read(uint16_t register_id, int32_t *reg_value) {
+    struct lgw_ctx_s *ctx = lgw_ctx_cur;
+    struct lgw_reg_state_s *reg = ctx->reg;
     int spi_stat = LGW_SPI_SUCCESS;
     struct lgw_reg_s r;
 
@@ -701,7 +1100,7 @@ int lgw_reg_r(uint16_t register_id, int32_t *reg_value) {
     }
 
     /* check if SPI is initialised */
-    if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+    if ((ctx->spi_target == NULL) || (reg->page < 0)) {
         DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
         return LGW_REG_ERROR;
     }
@@ -710,11 +1109,9 @@ int lgw_reg_r(uint16_t register_id, int32_t *reg_value) {
     r = loregs[register_id];
 
     /* select proper register page if needed */
-    if ((r.page != -1) && (r.page != lgw_regpage)) {
-        spi_stat += page_switch(r.page);
-    }
+    spi_stat += page_select(r.page);
 
-    spi_stat += reg_r_align32(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, r, reg_value);
+    spi_stat += reg_r_align32(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, r, reg_value);
 
     if (spi_stat != LGW_SPI_SUCCESS) {
         DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER WRITE\n");
@@ -728,6 +1125,21 @@ int lgw_reg_r(uint16_t register_id, int32_t *reg_value) {
 
 /* Point to a register by name and do a burst write */
 int lgw_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size) {
+    uint64_t t0 = lgw_perf_start();
+    int x;
+
+    lgw_reg_lock();
+    x = reg_write_burst(register_id, data, size);
+    lgw_reg_unlock();
+    lgw_perf_stop(LGW_PERF_REG_WB, t0);
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int reg_write_burst(uint16_t register_id, uint8_t *data, uint16_t size) {
+    struct lgw_ctx_s *ctx = lgw_ctx_cur;
+    struct lgw_reg_state_s *reg = ctx->reg;
     int spi_stat = LGW_SPI_SUCCESS;
     struct lgw_reg_s r;
 
@@ -743,7 +1155,7 @@ int lgw_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size) {
     }
 
     /* check if SPI is initialised */
-    if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+    if ((ctx->spi_target == NULL) || (reg->page < 0)) {
         DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
         return LGW_REG_ERROR;
     }
@@ -758,12 +1170,10 @@ int lgw_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size) {
     }
 
     /* select proper register page if needed */
-    if ((r.page != -1) && (r.page != lgw_regpage)) {
-        spi_stat += page_switch(r.page);
-    }
+    spi_stat += page_select(r.page);
 
     /* do the burst write */
-    spi_stat += lgw_spi_wb(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, r.addr, data, size);
+    spi_stat += reg_spi_wb(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, r.addr, data, size);
 
     if (spi_stat != LGW_SPI_SUCCESS) {
         DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER BURST WRITE\n");
@@ -777,6 +1187,21 @@ int lgw_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size) {
 
 /* Point to a register by name and do a burst read */
 int lgw_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
+    uint64_t t0 = lgw_perf_start();
+    int x;
+
+    lgw_reg_lock();
+    x = reg_read_burst(register_id, data, size);
+    lgw_reg_unlock();
+    lgw_perf_stop(LGW_PERF_REG_RB, t0);
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int reg_read_burst(uint16_t register_id, uint8_t *data, uint16_t size) {
+    struct lgw_ctx_s *ctx = lgw_ctx_cur;
+    struct lgw_reg_state_s *reg = ctx->reg;
     int spi_stat = LGW_SPI_SUCCESS;
     struct lgw_reg_s r;
 
@@ -792,7 +1217,7 @@ int lgw_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
     }
 
     /* check if SPI is initialised */
-    if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+    if ((ctx->spi_target == NULL) || (reg->page < 0)) {
         DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
         return LGW_REG_ERROR;
     }
@@ -801,12 +1226,10 @@ int lgw_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
     r = loregs[register_id];
 
     /* select proper register page if needed */
-    if ((r.page != -1) && (r.page != lgw_regpage)) {
-        spi_stat += page_switch(r.page);
-    }
+    spi_stat += page_select(r.page);
 
     /* do the burst read */
-    spi_stat += lgw_spi_rb(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, r.addr, data, size);
+    spi_stat += reg_spi_rb(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, r.addr, data, size);
 
     if (spi_stat != LGW_SPI_SUCCESS) {
         DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER BURST READ\n");
@@ -816,4 +1239,283 @@ int lgw_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
     }
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Register page state */
+int lgw_reg_page_invalidate(void) {
+    struct lgw_reg_state_s *reg = lgw_ctx_cur->reg;
+
+    lgw_reg_lock();
+    reg->page_valid = false;
+    reg->page_stats.nb_invalidate += 1;
+    lgw_reg_unlock();
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_reg_page_stats(struct lgw_reg_page_stats_s *stats) {
+    struct lgw_reg_state_s *reg = lgw_ctx_cur->reg;
+
+    CHECK_NULL(stats);
+
+    lgw_reg_lock();
+    *stats = reg->page_stats;
+    lgw_reg_unlock();
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_reg_page_stats_reset(void) {
+    struct lgw_reg_state_s *reg = lgw_ctx_cur->reg;
+
+    lgw_reg_lock();
+    memset(&reg->page_stats, 0, sizeof reg->page_stats);
+    lgw_reg_unlock();
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Register shadow cache configuration */
+int lgw_reg_cache_setconf(uint8_t mode) {
+    struct lgw_reg_state_s *reg = lgw_ctx_cur->reg;
+
+    if ((mode != LGW_REG_CACHE_OFF) && (mode != LGW_REG_CACHE_ON) && (mode != LGW_REG_CACHE_VERIFY)) {
+        DEBUG_PRINTF("ERROR: %u IS NOT A VALID REGISTER CACHE MODE\n", mode);
+        return LGW_REG_ERROR;
+    }
+
+    lgw_reg_lock();
+    reg->cache_mode = mode;
+    reg_cache_clear();
+    reg->cache_hit = 0;
+    reg->cache_miss = 0;
+    reg->cache_mismatch = 0;
+    lgw_reg_unlock();
+    DEBUG_PRINTF("Note: register cache mode %u\n", mode);
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_reg_cache_invalidate(void) {
+    lgw_reg_lock();
+    reg_cache_clear();
+    lgw_reg_unlock();
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_reg_cache_stats(uint32_t *hit, uint32_t *miss, uint32_t *mismatch) {
+    struct lgw_reg_state_s *reg = lgw_ctx_cur->reg;
+
+    CHECK_NULL(hit);
+    CHECK_NULL(miss);
+    CHECK_NULL(mismatch);
+
+    lgw_reg_lock();
+    *hit = reg->cache_hit;
+    *miss = reg->cache_miss;
+    *mismatch = reg->cache_mismatch;
+    lgw_reg_unlock();
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Start queuing register writes */
+int lgw_reg_batch_begin(void) {
+    struct lgw_ctx_s *ctx = lgw_ctx_cur;
+    struct lgw_reg_state_s *reg = ctx->reg;
+
+    /* the lock is held until the matching lgw_reg_batch_end, so that no other
+    thread queues accesses in the batch or sends accesses in the middle of it */
+    lgw_reg_lock();
+
+    /* check if SPI is initialised */
+    if ((ctx->spi_target == NULL) || (reg->page < 0)) {
+        lgw_reg_unlock();
+        DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
+        return LGW_REG_ERROR;
+    }
+
+    /* batches can be nested, only the outermost one is sent */
+    if (reg->batch_depth == 0) {
+        lgw_spi_batch_init(&reg->batch, ctx->spi_target);
+        memset(reg->batch_shadow, 0xFF, sizeof reg->batch_shadow);
+    }
+    reg->batch_depth += 1;
+
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Point to a register by name and queue a burst read in the current batch */
+int lgw_reg_batch_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
+    struct lgw_ctx_s *ctx = lgw_ctx_cur;
+    struct lgw_reg_state_s *reg = ctx->reg;
+    int spi_stat = LGW_SPI_SUCCESS;
+    struct lgw_reg_s r;
+
+    /* check input parameters */
+    CHECK_NULL(data);
+    if (size == 0) {
+        DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+        return LGW_REG_ERROR;
+    }
+    if (register_id >= LGW_TOTALREGS) {
+        DEBUG_MSG("ERROR: REGISTER NUMBER OUT OF DEFINED RANGE\n");
+        return LGW_REG_ERROR;
+    }
+
+    /* the batch, if any, belongs to the thread holding the lock */
+    lgw_reg_lock();
+
+    /* without an open batch, this is a plain burst read */
+    if (reg->batch_depth <= 0) {
+        spi_stat = reg_read_burst(register_id, data, size);
+        lgw_reg_unlock();
+        return spi_stat;
+    }
+
+    /* get register struct from the struct array */
+    r = loregs[register_id];
+
+    /* select proper register page if needed */
+    spi_stat += page_select(r.page);
+
+    /* queue the burst read, data is only valid after lgw_reg_batch_end */
+    spi_stat += lgw_spi_batch_rb(&reg->batch, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, r.addr, data, size);
+    lgw_reg_unlock();
+
+    if (spi_stat != LGW_SPI_SUCCESS) {
+        DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER BATCH READ\n");
+        return LGW_REG_ERROR;
+    } else {
+        return LGW_REG_SUCCESS;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Send the register writes queued since the outermost lgw_reg_batch_begin */
+int lgw_reg_batch_end(void) {
+    struct lgw_reg_state_s *reg = lgw_ctx_cur->reg;
+    int spi_stat;
+
+    /* a batch opened by another thread is only seen once it is closed */
+    lgw_reg_lock();
+    if (reg->batch_depth <= 0) {
+        lgw_reg_unlock();
+        DEBUG_MSG("ERROR: NO REGISTER BATCH OPEN\n");
+        return LGW_REG_ERROR;
+    }
+
+    /* release the lock taken by the matching lgw_reg_batch_begin too */
+    reg->batch_depth -= 1;
+    if (reg->batch_depth > 0) {
+        lgw_reg_unlock();
+        lgw_reg_unlock();
+        return LGW_REG_SUCCESS;
+    }
+
+    spi_stat = lgw_spi_batch_flush(&reg->batch);
+    lgw_reg_unlock();
+    lgw_reg_unlock();
+    if (spi_stat != LGW_SPI_SUCCESS) {
+        DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER BATCH\n");
+        return LGW_REG_ERROR;
+    } else {
+        return LGW_REG_SUCCESS;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Take the register lock of the concentrator, measuring the time spent waiting
+for another thread */
+int lgw_reg_lock(void) {
+    struct lgw_reg_state_s *reg = lgw_ctx_cur->reg;
+    struct timespec t0, t1;
+    uint64_t wait_ns;
+
+    if (pthread_mutex_trylock(&reg->mx) != 0) {
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        pthread_mutex_lock(&reg->mx);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        wait_ns = (uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000000 + t1.tv_nsec - t0.tv_nsec;
+        reg->lock_stats.nb_contended += 1;
+        reg->lock_stats.wait_ns += wait_ns;
+        if (wait_ns > reg->lock_stats.wait_max_ns) {
+            reg->lock_stats.wait_max_ns = (wait_ns > UINT32_MAX) ? UINT32_MAX : (uint32_t)wait_ns;
+        }
+    }
+    if (reg->lock_depth == 0) {
+        reg->lock_stats.nb_lock += 1;
+    }
+    reg->lock_depth += 1;
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_reg_unlock(void) {
+    struct lgw_reg_state_s *reg = lgw_ctx_cur->reg;
+
+    reg->lock_depth -= 1;
+    pthread_mutex_unlock(&reg->mx);
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_reg_lock_stats(struct lgw_reg_lock_stats_s *stats) {
+    struct lgw_reg_state_s *reg = lgw_ctx_cur->reg;
+
+    CHECK_NULL(stats);
+
+    lgw_reg_lock();
+    *stats = reg->lock_stats;
+    if (reg->lock_depth == 1) {
+        stats->nb_lock -= 1; /* not counting this one */
+    }
+    lgw_reg_unlock();
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_reg_lock_stats_reset(void) {
+    struct lgw_reg_state_s *reg = lgw_ctx_cur->reg;
+
+    lgw_reg_lock();
+    memset(&reg->lock_stats, 0, sizeof reg->lock_stats);
+    lgw_reg_unlock();
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Register layer state of a new concentrator context */
+struct lgw_reg_state_s *lgw_reg_state_new(void) {
+    struct lgw_reg_state_s *state;
+
+    state = malloc(sizeof *state);
+    if (state == NULL) {
+        return NULL;
+    }
+    *state = (struct lgw_reg_state_s)REG_STATE_INIT;
+    return state;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_reg_state_free(struct lgw_reg_state_s *state) {
+    free(state);
+}
+
 /* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,282 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Correction tables applied to received packets (timestamp processing delay
+    and FSK RSSI linearization), computed once when the concentrator starts so
+    that lgw_receive only does lookups.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf */
+#include <stdlib.h>     /* malloc free */
+#include <math.h>       /* pow */
+
+#include "loragw_rxcorr.h"
+#include "loragw_ctx.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#if DEBUG_RXCORR == 1
+    #define DEBUG_MSG(str)                fprintf(stderr, str)
+    #define DEBUG_PRINTF(fmt, args...)    fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+    #define CHECK_NULL(a)                if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_RXCORR_ERROR;}
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+    #define CHECK_NULL(a)                if(a==NULL){return LGW_RXCORR_ERROR;}
+#endif
+
+#define SET_PPM_ON(bw,dr)   (((bw == BW_125KHZ) && ((dr == DR_LORA_SF11) || (dr == DR_LORA_SF12))) || ((bw == BW_250KHZ) && (dr == DR_LORA_SF12)))
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define RSSI_FSK_POLY_0     60 /* polynomiam coefficients to linearize FSK RSSI */
+#define RSSI_FSK_POLY_1     1.5351
+#define RSSI_FSK_POLY_2     0.003
+
+/* LoRa timestamp table dimensions */
+#define TS_MODEM_MULTI      0
+#define TS_MODEM_STD        1
+#define TS_MODEM_NB         2
+#define TS_SF_MIN           6 /* no correction outside of [TS_SF_MIN..TS_SF_MAX] */
+#define TS_SF_MAX           12
+#define TS_CR_NB            8 /* 3-bit field, all values are corrected */
+#define TS_LEN_NB           258 /* payload size plus the 2 CRC bytes */
+#define TS_CLS_SHORT        12 /* payload fits in the first symbols, other classes are (2*len-sf+6) % (sf-2*ppm) */
+#define TS_CLS_NB           13
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+/* correction tables of one concentrator context */
+struct lgw_rxcorr_state_s {
+    /* LoRa timestamp correction, max value is below 2^15 (SF12 at 125 kHz).
+    The delay only depends on the payload length (size + 2 bytes if CRC) through
+    a class that has a few values per SF, so the length is mapped to its class
+    first, then the class indexes the correction. */
+    uint8_t     ts_cls[TS_MODEM_NB][TS_SF_MAX - TS_SF_MIN + 1][TS_LEN_NB];
+    uint16_t    ts_lora[TS_MODEM_NB][TS_SF_MAX - TS_SF_MIN + 1][TS_CR_NB][TS_CLS_NB];
+
+    uint32_t    ts_fsk; /* FSK timestamp correction, does not depend on the packet */
+
+    float       rssi_fsk[LGW_RF_CHAIN_NB][256]; /* linearized FSK RSSI */
+};
+
+#define RXCORR_STATE_INIT { .ts_fsk = 0 }
+
+/* -------------------------------------------------------------------------- */
+/* --- INTERNAL SHARED VARIABLES -------------------------------------------- */
+
+struct lgw_rxcorr_state_s lgw_rxcorr_state_default = RXCORR_STATE_INIT; /*! state of the default context */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static uint32_t rxcorr_ppm(int ifmod, uint8_t lora_rx_bw, uint32_t sf);
+
+static uint32_t rxcorr_timestamp_lora(int ifmod, uint8_t lora_rx_bw, uint32_t sf, uint32_t cr, uint32_t crc_en, unsigned sz);
+
+static uint8_t rxcorr_timestamp_class(uint32_t sf, uint32_t ppm, unsigned len);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* 'PPM mode' (low datarate optimization) of a LoRa modem */
+static uint32_t rxcorr_ppm(int ifmod, uint8_t lora_rx_bw, uint32_t sf) {
+    uint8_t bandwidth;
+    uint32_t datarate;
+
+    bandwidth = (ifmod == IF_LORA_MULTI) ? BW_125KHZ : lora_rx_bw;
+    switch (sf) {
+        case 7: datarate = DR_LORA_SF7; break;
+        case 8: datarate = DR_LORA_SF8; break;
+        case 9: datarate = DR_LORA_SF9; break;
+        case 10: datarate = DR_LORA_SF10; break;
+        case 11: datarate = DR_LORA_SF11; break;
+        case 12: datarate = DR_LORA_SF12; break;
+        default: datarate = DR_UNDEFINED;
+    }
+
+    /* determine if 'PPM mode' is on */
+    if (SET_PPM_ON(bandwidth, datarate)) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+/* Processing delay between the end of a LoRa packet and its timestamp.
+The computation is done on unsigned 32-bit integers, as lgw_receive used to. */
+static uint32_t rxcorr_timestamp_lora(int ifmod, uint8_t lora_rx_bw, uint32_t sf, uint32_t cr, uint32_t crc_en, unsigned sz) {
+    uint32_t delay_x, delay_y, delay_z; /* temporary variable for timestamp offset calculation */
+    uint32_t bw_pow, ppm;
+
+    ppm = rxcorr_ppm(ifmod, lora_rx_bw, sf);
+
+    /* base delay */
+    if (ifmod == IF_LORA_STD) { /* if packet was received on the stand-alone LoRa modem */
+        switch (lora_rx_bw) {
+            case BW_125KHZ:
+                delay_x = 64;
+                bw_pow = 1;
+                break;
+            case BW_250KHZ:
+                delay_x = 32;
+                bw_pow = 2;
+                break;
+            case BW_500KHZ:
+                delay_x = 16;
+                bw_pow = 4;
+                break;
+            default:
+                delay_x = 0;
+                bw_pow = 0;
+        }
+    } else { /* packet was received on one of the sensor channels = 125kHz */
+        delay_x = 114;
+        bw_pow = 1;
+    }
+
+    /* variable delay */
+    if ((sf >= 6) && (sf <= 12) && (bw_pow > 0)) {
+        if ((2*(sz + 2*crc_en) - (sf-7)) <= 0) { /* payload fits entirely in first 8 symbols */
+            delay_y = ( ((1<<(sf-1)) * (sf+1)) + (3 * (1<<(sf-4))) ) / bw_pow;
+            delay_z = 32 * (2*(sz+2*crc_en) + 5) / bw_pow;
+        } else {
+            delay_y = ( ((1<<(sf-1)) * (sf+1)) + ((4 - ppm) * (1<<(sf-4))) ) / bw_pow;
+            delay_z = (16 + 4*cr) * (((2*(sz+2*crc_en)-sf+6) % (sf - 2*ppm)) + 1) / bw_pow;
+        }
+        return delay_x + delay_y + delay_z;
+    } else {
+        return 0;
+    }
+}
+
+/* Class of a payload length for rxcorr_timestamp_lora: two lengths of the same
+class get the same delay, for any modem, bandwidth and coding rate. */
+static uint8_t rxcorr_timestamp_class(uint32_t sf, uint32_t ppm, unsigned len) {
+    if ((2*len - (sf-7)) == 0) {
+        return TS_CLS_SHORT;
+    } else {
+        return (uint8_t)((2*len - sf + 6) % (sf - 2*ppm));
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int rxcorr_setup(uint8_t lora_rx_bw, uint32_t fsk_rx_dr, const float *rssi_offset) {
+    struct lgw_rxcorr_state_s *rxcorr = lgw_ctx_cur->rxcorr;
+    static const int ifmod[TS_MODEM_NB] = {IF_LORA_MULTI, IF_LORA_STD};
+    float rssi;
+    uint8_t *cls;
+    uint32_t ppm;
+    int m, sf, cr, crc, sz, len, rf, raw;
+
+    CHECK_NULL(rssi_offset);
+
+    /* LoRa timestamp correction, lengths of a same class write the same value */
+    for (m = 0; m < TS_MODEM_NB; ++m) {
+        for (sf = TS_SF_MIN; sf <= TS_SF_MAX; ++sf) {
+            cls = rxcorr->ts_cls[m][sf - TS_SF_MIN];
+            ppm = rxcorr_ppm(ifmod[m], lora_rx_bw, sf);
+            for (len = 0; len < TS_LEN_NB; ++len) {
+                cls[len] = rxcorr_timestamp_class(sf, ppm, len);
+            }
+            for (len = 0; len < TS_LEN_NB; ++len) {
+                crc = (len >= 256) ? 1 : 0;
+                sz = len - 2*crc;
+                for (cr = 0; cr < TS_CR_NB; ++cr) {
+                    rxcorr->ts_lora[m][sf - TS_SF_MIN][cr][cls[len]] = (uint16_t)rxcorr_timestamp_lora(ifmod[m], lora_rx_bw, sf, cr, crc, sz);
+                }
+            }
+        }
+    }
+    if ((lora_rx_bw != BW_125KHZ) && (lora_rx_bw != BW_250KHZ) && (lora_rx_bw != BW_500KHZ)) {
+        DEBUG_PRINTF("WARNING: %d NOT A VALID LORA STD BANDWIDTH, NO TIMESTAMP CORRECTION FOR THAT MODEM\n", lora_rx_bw);
+    }
+
+    /* FSK timestamp correction */
+    rxcorr->ts_fsk = (fsk_rx_dr != 0) ? ((uint32_t)680000 / fsk_rx_dr) - 20 : 0;
+
+    /* FSK RSSI linearization, for every RF chain RSSI offset */
+    for (rf = 0; rf < LGW_RF_CHAIN_NB; ++rf) {
+        for (raw = 0; raw < 256; ++raw) {
+            rssi = (float)raw + rssi_offset[rf];
+            rssi = RSSI_FSK_POLY_0 + RSSI_FSK_POLY_1 * rssi + RSSI_FSK_POLY_2 * pow(rssi, 2);
+            rxcorr->rssi_fsk[rf][raw] = rssi;
+        }
+    }
+
+    return LGW_RXCORR_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint32_t rxcorr_timestamp(int ifmod, uint8_t sf, uint8_t cr, bool crc_en, uint8_t size) {
+    struct lgw_rxcorr_state_s *rxcorr = lgw_ctx_cur->rxcorr;
+    int m;
+
+    switch (ifmod) {
+        case IF_LORA_MULTI:
+        case IF_LORA_STD:
+            if ((sf < TS_SF_MIN) || (sf > TS_SF_MAX) || (cr >= TS_CR_NB)) {
+                return 0;
+            }
+            m = (ifmod == IF_LORA_STD) ? TS_MODEM_STD : TS_MODEM_MULTI;
+            return rxcorr->ts_lora[m][sf - TS_SF_MIN][cr][rxcorr->ts_cls[m][sf - TS_SF_MIN][size + (crc_en ? 2 : 0)]];
+        case IF_FSK_STD:
+            return rxcorr->ts_fsk;
+        default:
+            return 0;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+float rxcorr_rssi_fsk(uint8_t rf_chain, uint8_t rssi_raw) {
+    struct lgw_rxcorr_state_s *rxcorr = lgw_ctx_cur->rxcorr;
+
+    if (rf_chain >= LGW_RF_CHAIN_NB) {
+        return -128.0;
+    }
+    return rxcorr->rssi_fsk[rf_chain][rssi_raw];
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+struct lgw_rxcorr_state_s *lgw_rxcorr_state_new(void) {
+    struct lgw_rxcorr_state_s *state;
+
+    state = malloc(sizeof *state);
+    if (state == NULL) {
+        return NULL;
+    }
+    *state = (struct lgw_rxcorr_state_s)RXCORR_STATE_INIT;
+    return state;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_rxcorr_state_free(struct lgw_rxcorr_state_s *state) {
+    free(state);
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,356 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    RX event notification.
+    Provides a file descriptor (eventfd) that becomes readable when packets are
+    waiting in the concentrator RX FIFO, so applications can sleep in poll() or
+    epoll() instead of calling lgw_receive at a fixed interval.
+    The event is driven by a host GPIO edge when the concentrator RX interrupt
+    is wired, or by polling the RX FIFO status register otherwise.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#define _GNU_SOURCE     /* needed for ppoll to be defined */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf snprintf */
+#include <stdlib.h>     /* malloc free */
+#include <string.h>     /* memset */
+#include <errno.h>      /* errno EINTR */
+#include <fcntl.h>      /* open */
+#include <unistd.h>     /* read write lseek close */
+#include <poll.h>       /* ppoll POLLIN POLLPRI */
+#include <time.h>       /* timespec */
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>   /* fstat S_ISFIFO */
+
+#include "loragw_hal.h"
+#include "loragw_rxev.h"
+#include "loragw_ctx.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#if DEBUG_RXEV == 1
+    #define DEBUG_MSG(str)              fprintf(stderr, str)
+    #define DEBUG_PRINTF(fmt, args...)  fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+    #define CHECK_NULL(a)               if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_RXEV_ERROR;}
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+    #define CHECK_NULL(a)               if(a==NULL){return LGW_RXEV_ERROR;}
+#endif
+
+#define ATOMIC_INC(p)           __atomic_add_fetch(p, 1, __ATOMIC_RELAXED)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define GPIO_SYSFS_PATH     "/sys/class/gpio/gpio%d/%s"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+/* RX event notification of one concentrator context */
+struct lgw_rxev_state_s {
+    int                 fd;             /* eventfd given to the application */
+    int                 stop_fd;        /* eventfd used to stop the watching thread */
+    int                 gpio_fd;        /* GPIO value file, -1 when the RX FIFO status is polled */
+    bool                gpio_fifo;      /* GPIO simulated by a named pipe, edges are the bytes written to it */
+    struct timespec     poll;           /* RX FIFO status polling period */
+    pthread_t           thread;
+
+    struct lgw_rxev_stats_s stats;
+};
+
+#define RXEV_STATE_INIT { .fd = -1, .stop_fd = -1, .gpio_fd = -1 }
+
+/* -------------------------------------------------------------------------- */
+/* --- INTERNAL SHARED VARIABLES -------------------------------------------- */
+
+struct lgw_rxev_state_s lgw_rxev_state_default = RXEV_STATE_INIT; /*! state of the default context */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static int gpio_open(struct lgw_conf_rxev_s *conf);
+
+static void rxev_notify(void);
+
+static void rxev_check_fifo(void);
+
+static void *rxev_watch(void *arg);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static int gpio_open(struct lgw_conf_rxev_s *conf) {
+    struct lgw_rxev_state_s *rxev = lgw_ctx_cur->rxev;
+    char path[64];
+    const char *value_path;
+    struct stat st;
+    char buf[8];
+    int fd;
+
+    if (conf->gpio_path != NULL) {
+        value_path = conf->gpio_path;
+    } else {
+        /* sysfs GPIO, report rising edges as POLLPRI on the value file */
+        snprintf(path, sizeof path, GPIO_SYSFS_PATH, conf->gpio, "edge");
+        fd = open(path, O_WRONLY);
+        if (fd < 0) {
+            DEBUG_PRINTF("ERROR: FAILED TO OPEN %s, IS THE GPIO EXPORTED?\n", path);
+            return -1;
+        }
+        if (write(fd, "rising", 6) != 6) {
+            DEBUG_PRINTF("ERROR: FAILED TO SET EDGE DETECTION ON GPIO %d\n", conf->gpio);
+            close(fd);
+            return -1;
+        }
+        close(fd);
+        snprintf(path, sizeof path, GPIO_SYSFS_PATH, conf->gpio, "value");
+        value_path = path;
+    }
+
+    /* O_RDWR keeps a named pipe open even when no writer is connected */
+    fd = open(value_path, O_RDWR | O_NONBLOCK);
+    if (fd < 0) {
+        fd = open(value_path, O_RDONLY | O_NONBLOCK);
+    }
+    if (fd < 0) {
+        DEBUG_PRINTF("ERROR: FAILED TO OPEN %s\n", value_path);
+        return -1;
+    }
+    rxev->gpio_fifo = ((fstat(fd, &st) == 0) && S_ISFIFO(st.st_mode));
+
+    /* the first read clears the pending state of a sysfs value file */
+    if (rxev->gpio_fifo == false) {
+        if (read(fd, buf, sizeof buf) < 0) {
+            DEBUG_PRINTF("WARNING: FAILED TO READ %s\n", value_path);
+        }
+    }
+    return fd;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void rxev_notify(void) {
+    struct lgw_rxev_state_s *rxev = lgw_ctx_cur->rxev;
+    uint64_t one = 1;
+
+    /* counted first, the application may read the counters as soon as it is woken up */
+    ATOMIC_INC(&rxev->stats.nb_notify);
+    if (write(rxev->fd, &one, sizeof one) != sizeof one) {
+        DEBUG_MSG("WARNING: FAILED TO SIGNAL RX EVENT\n");
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void rxev_check_fifo(void) {
+    struct lgw_rxev_state_s *rxev = lgw_ctx_cur->rxev;
+    uint8_t nb_pkt = 0;
+
+    ATOMIC_INC(&rxev->stats.nb_poll);
+    if ((lgw_rx_pending(&nb_pkt) == LGW_HAL_SUCCESS) && (nb_pkt > 0)) {
+        rxev_notify();
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void *rxev_watch(void *arg) {
+    struct lgw_ctx_s *ctx = arg; /* context of the thread that started this one */
+    struct lgw_rxev_state_s *rxev = ctx->rxev;
+    struct pollfd pfd[2];
+    nfds_t nfd;
+    char buf[64];
+    int x;
+
+    pthread_setname_np(pthread_self(), "lgw_rxev"); /* identifies its counters in loragw_perf */
+    lgw_ctx_bind(ctx);
+    pfd[0].fd = rxev->stop_fd;
+    pfd[0].events = POLLIN;
+    if (rxev->gpio_fd >= 0) {
+        pfd[1].fd = rxev->gpio_fd;
+        pfd[1].events = (rxev->gpio_fifo) ? POLLIN : (POLLPRI | POLLERR);
+        nfd = 2;
+        /* packets received before the start raised the line already, no edge will come for them */
+        rxev_check_fifo();
+    } else {
+        nfd = 1;
+    }
+
+    for (;;) {
+        x = ppoll(pfd, nfd, (nfd == 2) ? NULL : &rxev->poll, NULL);
+        if (x < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            DEBUG_MSG("ERROR: POLL FAILED, RX EVENT WATCHING STOPPED\n");
+            break;
+        }
+        if (pfd[0].revents != 0) {
+            break; /* stop requested */
+        }
+        if (nfd == 1) {
+            rxev_check_fifo(); /* polling period elapsed */
+        } else if (pfd[1].revents != 0) {
+            /* consume the edge before signaling, so that the next one is not missed */
+            if (rxev->gpio_fifo == false) {
+                lseek(rxev->gpio_fd, 0, SEEK_SET);
+            }
+            while (read(rxev->gpio_fd, buf, sizeof buf) == sizeof buf);
+            ATOMIC_INC(&rxev->stats.nb_edge);
+            rxev_notify();
+        }
+    }
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int lgw_rxev_start(struct lgw_conf_rxev_s *conf) {
+    struct lgw_rxev_state_s *rxev = lgw_ctx_cur->rxev;
+    struct lgw_conf_rxev_s c = {LGW_RXEV_GPIO_NONE, NULL, LGW_RXEV_POLL_DEFAULT};
+
+    if (rxev->fd >= 0) {
+        DEBUG_MSG("ERROR: RX EVENT NOTIFICATION ALREADY STARTED\n");
+        return LGW_RXEV_ERROR;
+    }
+    if (conf != NULL) {
+        c = *conf;
+    }
+    if (((c.gpio == LGW_RXEV_GPIO_NONE) && (c.gpio_path == NULL)) && (c.poll_us == 0)) {
+        DEBUG_MSG("ERROR: RX FIFO STATUS POLLING PERIOD CAN'T BE NULL\n");
+        return LGW_RXEV_ERROR;
+    }
+    memset(&rxev->stats, 0, sizeof rxev->stats);
+    rxev->poll.tv_sec = c.poll_us / 1000000;
+    rxev->poll.tv_nsec = (c.poll_us % 1000000) * 1000;
+
+    /* GPIO line, if any */
+    rxev->gpio_fd = -1;
+    if ((c.gpio != LGW_RXEV_GPIO_NONE) || (c.gpio_path != NULL)) {
+        rxev->gpio_fd = gpio_open(&c);
+        if (rxev->gpio_fd < 0) {
+            return LGW_RXEV_ERROR;
+        }
+    }
+
+    rxev->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    rxev->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((rxev->fd < 0) || (rxev->stop_fd < 0)) {
+        DEBUG_MSG("ERROR: FAILED TO CREATE EVENT FILE DESCRIPTORS\n");
+        goto fail;
+    }
+    if (pthread_create(&rxev->thread, NULL, rxev_watch, lgw_ctx_cur) != 0) {
+        DEBUG_MSG("ERROR: FAILED TO CREATE RX EVENT THREAD\n");
+        goto fail;
+    }
+
+    DEBUG_PRINTF("Note: RX event notification started (%s)\n", (rxev->gpio_fd >= 0) ? "GPIO edge" : "RX FIFO status polling");
+    return rxev->fd;
+
+fail:
+    if (rxev->fd >= 0) close(rxev->fd);
+    if (rxev->stop_fd >= 0) close(rxev->stop_fd);
+    if (rxev->gpio_fd >= 0) close(rxev->gpio_fd);
+    rxev->fd = -1;
+    rxev->stop_fd = -1;
+    rxev->gpio_fd = -1;
+    return LGW_RXEV_ERROR;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rxev_stop(void) {
+    struct lgw_rxev_state_s *rxev = lgw_ctx_cur->rxev;
+    uint64_t one = 1;
+
+    if (rxev->fd < 0) {
+        DEBUG_MSG("ERROR: RX EVENT NOTIFICATION NOT STARTED\n");
+        return LGW_RXEV_ERROR;
+    }
+
+    if (write(rxev->stop_fd, &one, sizeof one) != sizeof one) {
+        DEBUG_MSG("WARNING: FAILED TO SIGNAL RX EVENT THREAD\n");
+    }
+    pthread_join(rxev->thread, NULL);
+
+    close(rxev->fd);
+    close(rxev->stop_fd);
+    if (rxev->gpio_fd >= 0) close(rxev->gpio_fd);
+    rxev->fd = -1;
+    rxev->stop_fd = -1;
+    rxev->gpio_fd = -1;
+    return LGW_RXEV_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rxev_ack(void) {
+    struct lgw_rxev_state_s *rxev = lgw_ctx_cur->rxev;
+    uint64_t val;
+
+    if (rxev->fd < 0) {
+        DEBUG_MSG("ERROR: RX EVENT NOTIFICATION NOT STARTED\n");
+        return LGW_RXEV_ERROR;
+    }
+
+    /* non-blocking, nothing to read (EAGAIN) is not an error */
+    if ((read(rxev->fd, &val, sizeof val) < 0) && (errno != EAGAIN)) {
+        return LGW_RXEV_ERROR;
+    }
+    return LGW_RXEV_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rxev_stats(struct lgw_rxev_stats_s *stats) {
+    struct lgw_rxev_state_s *rxev = lgw_ctx_cur->rxev;
+
+    CHECK_NULL(stats);
+
+    stats->nb_edge = __atomic_load_n(&rxev->stats.nb_edge, __ATOMIC_RELAXED);
+    stats->nb_poll = __atomic_load_n(&rxev->stats.nb_poll, __ATOMIC_RELAXED);
+    stats->nb_notify = __atomic_load_n(&rxev->stats.nb_notify, __ATOMIC_RELAXED);
+    return LGW_RXEV_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+struct lgw_rxev_state_s *lgw_rxev_state_new(void) {
+    struct lgw_rxev_state_s *state;
+
+    state = malloc(sizeof *state);
+    if (state == NULL) {
+        return NULL;
+    }
+    *state = (struct lgw_rxev_state_s)RXEV_STATE_INIT;
+    return state;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_rxev_state_free(struct lgw_rxev_state_s *state) {
+    free(state);
+}
+
+/* --- EOF ------------------------------------------------------------------ */
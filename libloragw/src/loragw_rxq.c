@@ -0,0 +1,426 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Background RX acquisition thread.
+    The thread drains the concentrator RX FIFO with lgw_receive and pushes the
+    packets into a lock-free single-producer/multi-consumer ring. Any number of
+    application threads can then fetch packets from the ring, without polling
+    the concentrator themselves.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#define _GNU_SOURCE     /* needed for pthread_setaffinity_np and CPU_SET to be defined */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf */
+#include <stdlib.h>     /* malloc free */
+#include <string.h>     /* memset */
+#include <errno.h>      /* ETIMEDOUT */
+#include <time.h>       /* clock_gettime clock_nanosleep */
+#include <pthread.h>
+#include <sched.h>      /* cpu_set_t CPU_ZERO CPU_SET */
+
+#include "loragw_hal.h"
+#include "loragw_rxq.h"
+#include "loragw_ctx.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#if DEBUG_RXQ == 1
+    #define DEBUG_MSG(str)              fprintf(stderr, str)
+    #define DEBUG_PRINTF(fmt, args...)  fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+    #define CHECK_NULL(a)               if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_RXQ_ERROR;}
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+    #define CHECK_NULL(a)               if(a==NULL){return LGW_RXQ_ERROR;}
+#endif
+
+#define ATOMIC_LOAD(p)          __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(p, v)      __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define ATOMIC_INC(p)           __atomic_add_fetch(p, 1, __ATOMIC_RELAXED)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/*
+Each slot of the ring carries a sequence number telling who owns it:
+- seq == pos        : free, the producer can fill it for position pos
+- seq == pos + 1    : filled, a consumer can claim it for position pos
+Consumers claim a position by moving the shared read index with a CAS, copy the
+packet, then hand the slot back to the producer for the next lap (pos + size).
+The producer never waits: if the slot is still owned by a consumer, the ring is
+full and the packet is dropped.
+*/
+struct rxq_slot_s {
+    uint32_t            seq;
+    struct lgw_pkt_rx_s pkt;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define RXQ_SIZE_MAX    65536   /* ring capacity upper bound, in packets */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+/* RX queue of one concentrator context */
+struct lgw_rxq_state_s {
+    struct rxq_slot_s   *ring;
+    uint32_t            mask;           /* ring capacity - 1 */
+    uint32_t            head;           /* next position written, only used by the producer */
+    uint32_t            tail;           /* next position read, shared by the consumers */
+
+    bool                running;
+    uint32_t            poll_us;
+    pthread_t           thread;
+
+    /* consumers waiting for packets sleep on this condition, the producer broadcasts after each push */
+    pthread_mutex_t     mx_wait;
+    pthread_cond_t      cond;
+    uint32_t            nb_user;        /* consumers reading the ring, protected by mx_wait; the ring is freed when it is back to 0 */
+
+    struct lgw_rxq_stats_s stats;
+};
+
+#define RXQ_STATE_INIT { \
+    .ring = NULL, \
+    .running = false, \
+    .nb_user = 0, \
+    .mx_wait = PTHREAD_MUTEX_INITIALIZER, \
+    .cond = PTHREAD_COND_INITIALIZER \
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- INTERNAL SHARED VARIABLES -------------------------------------------- */
+
+struct lgw_rxq_state_s lgw_rxq_state_default = RXQ_STATE_INIT; /*! state of the default context */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static bool ring_push(const struct lgw_pkt_rx_s *pkt);
+
+static bool ring_pop(struct lgw_pkt_rx_s *pkt);
+
+static bool ring_empty(void);
+
+static void *rxq_acquisition(void *arg);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static bool ring_push(const struct lgw_pkt_rx_s *pkt) {
+    struct lgw_rxq_state_s *rxq = lgw_ctx_cur->rxq;
+    struct rxq_slot_s *slot = &rxq->ring[rxq->head & rxq->mask];
+    uint32_t fill;
+
+    if (ATOMIC_LOAD(&slot->seq) != rxq->head) {
+        return false; /* ring full, slot not released by the consumers yet */
+    }
+    slot->pkt = *pkt;
+    ATOMIC_STORE(&slot->seq, rxq->head + 1);
+    rxq->head += 1;
+
+    fill = rxq->head - __atomic_load_n(&rxq->tail, __ATOMIC_RELAXED);
+    if (fill > rxq->stats.max_fill) {
+        __atomic_store_n(&rxq->stats.max_fill, fill, __ATOMIC_RELAXED);
+    }
+    return true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static bool ring_pop(struct lgw_pkt_rx_s *pkt) {
+    struct lgw_rxq_state_s *rxq = lgw_ctx_cur->rxq;
+    struct rxq_slot_s *slot;
+    uint32_t pos;
+    int32_t dif;
+
+    pos = __atomic_load_n(&rxq->tail, __ATOMIC_RELAXED);
+    for (;;) {
+        slot = &rxq->ring[pos & rxq->mask];
+        dif = (int32_t)(ATOMIC_LOAD(&slot->seq) - (pos + 1));
+        if (dif == 0) {
+            /* slot filled, try to claim it (pos is reloaded if another consumer was faster) */
+            if (__atomic_compare_exchange_n(&rxq->tail, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *pkt = slot->pkt;
+                ATOMIC_STORE(&slot->seq, pos + rxq->mask + 1);
+                return true;
+            }
+        } else if (dif < 0) {
+            return false; /* ring empty */
+        } else {
+            pos = __atomic_load_n(&rxq->tail, __ATOMIC_RELAXED); /* another consumer claimed that position */
+        }
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static bool ring_empty(void) {
+    struct lgw_rxq_state_s *rxq = lgw_ctx_cur->rxq;
+    uint32_t pos = __atomic_load_n(&rxq->tail, __ATOMIC_RELAXED);
+
+    return (ATOMIC_LOAD(&rxq->ring[pos & rxq->mask].seq) != (pos + 1));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void *rxq_acquisition(void *arg) {
+    struct lgw_ctx_s *ctx = arg; /* context of the thread that started this one */
+    struct lgw_rxq_state_s *rxq = ctx->rxq;
+    struct lgw_pkt_rx_s buf[LGW_PKT_FIFO_SIZE];
+    struct timespec pause;
+    int nb_pkt;
+    int i;
+
+    pthread_setname_np(pthread_self(), "lgw_rxq"); /* identifies its counters in loragw_perf */
+    lgw_ctx_bind(ctx);
+    pause.tv_sec = rxq->poll_us / 1000000;
+    pause.tv_nsec = (rxq->poll_us % 1000000) * 1000;
+
+    while (ATOMIC_LOAD(&rxq->running)) {
+        nb_pkt = lgw_receive(LGW_PKT_FIFO_SIZE, buf);
+        ATOMIC_INC(&rxq->stats.nb_poll);
+
+        if (nb_pkt == LGW_HAL_ERROR) {
+            ATOMIC_INC(&rxq->stats.nb_error);
+            nb_pkt = 0;
+        } else if (nb_pkt > 0) {
+            for (i = 0; i < nb_pkt; ++i) {
+                if (ring_push(&buf[i]) == false) {
+                    ATOMIC_INC(&rxq->stats.nb_overflow);
+                    DEBUG_MSG("WARNING: RX RING FULL, PACKET DROPPED\n");
+                }
+            }
+            __atomic_add_fetch(&rxq->stats.nb_pkt, nb_pkt, __ATOMIC_RELAXED);
+            pthread_mutex_lock(&rxq->mx_wait);
+            pthread_cond_broadcast(&rxq->cond);
+            pthread_mutex_unlock(&rxq->mx_wait);
+        }
+
+        /* a full read means more packets may be pending, poll again right away */
+        if (nb_pkt < LGW_PKT_FIFO_SIZE) {
+            clock_nanosleep(CLOCK_MONOTONIC, 0, &pause, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int lgw_rxq_start(struct lgw_conf_rxq_s *conf) {
+    struct lgw_rxq_state_s *rxq = lgw_ctx_cur->rxq;
+    struct lgw_conf_rxq_s c = {LGW_RXQ_SIZE_DEFAULT, LGW_RXQ_POLL_DEFAULT, LGW_RXQ_CPU_ANY};
+    cpu_set_t cpuset;
+    uint32_t size;
+    uint32_t i;
+    int x;
+
+    if (rxq->running) {
+        DEBUG_MSG("ERROR: RX ACQUISITION THREAD ALREADY RUNNING\n");
+        return LGW_RXQ_ERROR;
+    }
+    if (conf != NULL) {
+        c = *conf;
+    }
+    if ((c.size == 0) || (c.size > RXQ_SIZE_MAX)) {
+        DEBUG_PRINTF("ERROR: INVALID RX RING SIZE %u\n", c.size);
+        return LGW_RXQ_ERROR;
+    }
+    for (size = 1; size < c.size; size <<= 1);
+
+    /* allocate the ring, all slots free for the first lap */
+    rxq->ring = malloc(size * sizeof(struct rxq_slot_s));
+    if (rxq->ring == NULL) {
+        DEBUG_MSG("ERROR: FAILED TO ALLOCATE RX RING\n");
+        return LGW_RXQ_ERROR;
+    }
+    for (i = 0; i < size; ++i) {
+        rxq->ring[i].seq = i;
+    }
+    rxq->mask = size - 1;
+    rxq->head = 0;
+    rxq->tail = 0;
+    rxq->poll_us = c.poll_us;
+    memset(&rxq->stats, 0, sizeof rxq->stats);
+
+    ATOMIC_STORE(&rxq->running, true);
+    x = pthread_create(&rxq->thread, NULL, rxq_acquisition, lgw_ctx_cur);
+    if (x != 0) {
+        DEBUG_MSG("ERROR: FAILED TO CREATE RX ACQUISITION THREAD\n");
+        ATOMIC_STORE(&rxq->running, false);
+        free(rxq->ring);
+        rxq->ring = NULL;
+        return LGW_RXQ_ERROR;
+    }
+
+    /* affinity failure is not fatal, the thread simply runs on any CPU */
+    if (c.cpu != LGW_RXQ_CPU_ANY) {
+        CPU_ZERO(&cpuset);
+        CPU_SET(c.cpu, &cpuset);
+        x = pthread_setaffinity_np(rxq->thread, sizeof cpuset, &cpuset);
+        if (x != 0) {
+            DEBUG_PRINTF("WARNING: FAILED TO PIN RX ACQUISITION THREAD TO CPU %d\n", c.cpu);
+        }
+    }
+
+    DEBUG_PRINTF("Note: RX acquisition thread started, ring of %u packets, poll every %u us\n", size, rxq->poll_us);
+    return LGW_RXQ_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rxq_stop(void) {
+    struct lgw_rxq_state_s *rxq = lgw_ctx_cur->rxq;
+
+    if (rxq->running == false) {
+        DEBUG_MSG("ERROR: RX ACQUISITION THREAD NOT RUNNING\n");
+        return LGW_RXQ_ERROR;
+    }
+
+    /* stop the producer, wake up the consumers waiting for packets, and wait for those reading the ring */
+    ATOMIC_STORE(&rxq->running, false);
+    pthread_join(rxq->thread, NULL);
+    pthread_mutex_lock(&rxq->mx_wait);
+    pthread_cond_broadcast(&rxq->cond);
+    while (rxq->nb_user > 0) {
+        pthread_cond_wait(&rxq->cond, &rxq->mx_wait);
+    }
+    free(rxq->ring);
+    rxq->ring = NULL;
+    pthread_mutex_unlock(&rxq->mx_wait);
+
+    return LGW_RXQ_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rxq_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
+    struct lgw_rxq_state_s *rxq = lgw_ctx_cur->rxq;
+    int nb_pkt = 0;
+
+    CHECK_NULL(pkt_data);
+
+    /* register as a user of the ring, so that lgw_rxq_stop does not free it under our feet */
+    pthread_mutex_lock(&rxq->mx_wait);
+    if ((rxq->ring == NULL) || (ATOMIC_LOAD(&rxq->running) == false)) {
+        pthread_mutex_unlock(&rxq->mx_wait);
+        DEBUG_MSG("ERROR: RX ACQUISITION THREAD NOT RUNNING\n");
+        return LGW_RXQ_ERROR;
+    }
+    rxq->nb_user += 1;
+    pthread_mutex_unlock(&rxq->mx_wait);
+
+    while ((nb_pkt < max_pkt) && ring_pop(&pkt_data[nb_pkt])) {
+        ++nb_pkt;
+    }
+
+    pthread_mutex_lock(&rxq->mx_wait);
+    rxq->nb_user -= 1;
+    if ((rxq->nb_user == 0) && (ATOMIC_LOAD(&rxq->running) == false)) {
+        pthread_cond_broadcast(&rxq->cond); /* lgw_rxq_stop is waiting */
+    }
+    pthread_mutex_unlock(&rxq->mx_wait);
+    return nb_pkt;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rxq_wait(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data, int32_t timeout_ms) {
+    struct lgw_rxq_state_s *rxq = lgw_ctx_cur->rxq;
+    struct timespec deadline;
+    int nb_pkt;
+    int x = 0;
+
+    nb_pkt = lgw_rxq_receive(max_pkt, pkt_data);
+    if (nb_pkt != 0) {
+        return nb_pkt;
+    }
+
+    if (timeout_ms != LGW_RXQ_WAIT_FOREVER) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    /* another consumer may empty the ring right after the wake-up, so loop until something is fetched */
+    do {
+        pthread_mutex_lock(&rxq->mx_wait);
+        while (ATOMIC_LOAD(&rxq->running) && ring_empty() && (x != ETIMEDOUT)) {
+            if (timeout_ms == LGW_RXQ_WAIT_FOREVER) {
+                pthread_cond_wait(&rxq->cond, &rxq->mx_wait);
+            } else {
+                x = pthread_cond_timedwait(&rxq->cond, &rxq->mx_wait, &deadline);
+            }
+        }
+        pthread_mutex_unlock(&rxq->mx_wait);
+        if (ATOMIC_LOAD(&rxq->running) == false) {
+            return 0; /* thread stopped while waiting */
+        }
+        nb_pkt = lgw_rxq_receive(max_pkt, pkt_data);
+        if (nb_pkt == LGW_RXQ_ERROR) {
+            return (ATOMIC_LOAD(&rxq->running) == false) ? 0 : LGW_RXQ_ERROR; /* thread stopped since the wake-up */
+        }
+    } while ((nb_pkt == 0) && (x != ETIMEDOUT));
+
+    return nb_pkt;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rxq_stats(struct lgw_rxq_stats_s *stats) {
+    struct lgw_rxq_state_s *rxq = lgw_ctx_cur->rxq;
+
+    CHECK_NULL(stats);
+
+    stats->nb_poll = __atomic_load_n(&rxq->stats.nb_poll, __ATOMIC_RELAXED);
+    stats->nb_pkt = __atomic_load_n(&rxq->stats.nb_pkt, __ATOMIC_RELAXED);
+    stats->nb_overflow = __atomic_load_n(&rxq->stats.nb_overflow, __ATOMIC_RELAXED);
+    stats->nb_error = __atomic_load_n(&rxq->stats.nb_error, __ATOMIC_RELAXED);
+    stats->max_fill = __atomic_load_n(&rxq->stats.max_fill, __ATOMIC_RELAXED);
+    return LGW_RXQ_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+struct lgw_rxq_state_s *lgw_rxq_state_new(void) {
+    struct lgw_rxq_state_s *state;
+
+    state = malloc(sizeof *state);
+    if (state == NULL) {
+        return NULL;
+    }
+    *state = (struct lgw_rxq_state_s)RXQ_STATE_INIT;
+    return state;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_rxq_state_free(struct lgw_rxq_state_s *state) {
+    free(state);
+}
+
+/* --- EOF ------------------------------------------------------------------ */
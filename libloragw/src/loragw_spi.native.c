@@ -29,12 +29,14 @@ Maintainer: Sylvain Miermont
 #include <unistd.h>        /* lseek, close */
 #include <fcntl.h>        /* open */
 #include <string.h>        /* memset */
+#include <time.h>          /* clock_gettime */
 
 #include <sys/ioctl.h>
 #include <linux/spi/spidev.h>
 
 #include "loragw_spi.h"
 #include "loragw_hal.h"
+#include "loragw_perf.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -50,8 +52,6 @@ Maintainer: Sylvain Miermont
     #define CHECK_NULL(a)                if(a==NULL){return LGW_SPI_ERROR;}
 #endif
 
-#define SPI_DELAY                           (8)
-
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS ---------------------------------------------------- */
 
@@ -61,11 +61,144 @@ Maintainer: Sylvain Miermont
 #define SPI_DEV_PATH    "/dev/spidev0.0"
 //#define SPI_DEV_PATH    "/dev/spidev32766.0"
 
+#define SPI_DELAY_MODE_DEFAULT  LGW_SPI_DELAY_BUSYWAIT
+#define SPI_DELAY_NS_DEFAULT    8000 /* same minimum gap as the former usleep(8) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static uint8_t spi_delay_mode = SPI_DELAY_MODE_DEFAULT;
+static uint32_t spi_delay_ns = SPI_DELAY_NS_DEFAULT;
+static struct timespec spi_last_end = {0, 0}; /* end of the last SPI transaction (busy-wait mode) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* Called right before a transaction: in busy-wait mode, spin until the minimum
+gap since the end of the previous transaction has elapsed */
+static void spi_delay_before(void) {
+    struct timespec now;
+    int64_t elapsed_ns;
+
+    if ((spi_delay_mode != LGW_SPI_DELAY_BUSYWAIT) || (spi_delay_ns == 0)) {
+        return;
+    }
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed_ns = (int64_t)(now.tv_sec - spi_last_end.tv_sec) * 1000000000 + (now.tv_nsec - spi_last_end.tv_nsec);
+    } while (elapsed_ns < (int64_t)spi_delay_ns);
+}
+
+/* Called right after a transaction: sleep (legacy behaviour) or timestamp the
+end of the transaction for the busy-wait of the next one */
+static void spi_delay_after(void) {
+    switch (spi_delay_mode) {
+        case LGW_SPI_DELAY_BUSYWAIT:
+            clock_gettime(CLOCK_MONOTONIC, &spi_last_end);
+            break;
+        case LGW_SPI_DELAY_SLEEP:
+            if (spi_delay_ns > 0) {
+                usleep((spi_delay_ns + 999) / 1000); /* round up to the next microsecond */
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/* One SPI message of nb_transfer transfers, measured for loragw_perf */
+static int spi_message(int spi_device, struct spi_ioc_transfer *k, int nb_transfer) {
+    uint64_t t0 = lgw_perf_start();
+    int a;
+
+    a = ioctl(spi_device, SPI_IOC_MESSAGE(nb_transfer), k);
+    lgw_perf_stop(LGW_PERF_SPI, t0);
+    if (a > 0) {
+        lgw_perf_add(LGW_PERF_SPI_BYTES, a);
+    }
+    return a;
+}
+
+/* Queue one access (command + data) in a batch, flushing it first if full */
+static int spi_batch_add(struct lgw_spi_batch_s *batch, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t access, uint8_t address, const uint8_t *data, uint8_t *dest, uint16_t size) {
+    uint8_t command_size;
+    uint16_t len;
+    uint8_t *out;
+    int a;
+
+    command_size = (spi_mux_mode == LGW_SPI_MUX_MODE1) ? 2 : 1;
+    len = command_size + size;
+
+    /* make room for the new access */
+    if ((batch->nb_op >= LGW_SPI_BATCH_MAX) || ((batch->nb_byte + len) > LGW_SPI_BATCH_SIZE)) {
+        a = lgw_spi_batch_flush(batch);
+        if (a != LGW_SPI_SUCCESS) {
+            return LGW_SPI_ERROR;
+        }
+    }
+
+    /* append the command and the data to be sent */
+    out = &batch->tx_buf[batch->nb_byte];
+    if (spi_mux_mode == LGW_SPI_MUX_MODE1) {
+        out[0] = spi_mux_target;
+        out[1] = access | (address & 0x7F);
+    } else {
+        out[0] = access | (address & 0x7F);
+    }
+    if (data != NULL) {
+        memcpy(&out[command_size], data, size);
+    } else {
+        memset(&out[command_size], 0, size);
+    }
+
+    batch->op_len[batch->nb_op] = len;
+    batch->op_cmd[batch->nb_op] = command_size;
+    batch->op_dest[batch->nb_op] = dest;
+    batch->nb_op += 1;
+    batch->nb_byte += len;
+
+    return LGW_SPI_SUCCESS;
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
+/* Inter-transaction delay policy */
+int lgw_spi_set_delay(uint8_t mode, uint32_t delay_ns) {
+    if ((mode != LGW_SPI_DELAY_NONE) && (mode != LGW_SPI_DELAY_BUSYWAIT) && (mode != LGW_SPI_DELAY_SLEEP)) {
+        DEBUG_PRINTF("ERROR: %u IS NOT A VALID SPI DELAY MODE\n", mode);
+        return LGW_SPI_ERROR;
+    }
+
+    spi_delay_mode = mode;
+    spi_delay_ns = delay_ns;
+    spi_last_end.tv_sec = 0;
+    spi_last_end.tv_nsec = 0;
+    DEBUG_PRINTF("Note: SPI delay mode %u, %u ns\n", spi_delay_mode, spi_delay_ns);
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_get_delay(uint8_t *mode, uint32_t *delay_ns) {
+    CHECK_NULL(mode);
+    CHECK_NULL(delay_ns);
+
+    *mode = spi_delay_mode;
+    *delay_ns = spi_delay_ns;
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 /* SPI initialization and configuration */
 int lgw_spi_open(void **spi_target_ptr) {
+    return lgw_spi_open_path(NULL, spi_target_ptr);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_open_path(const char *spi_path, void **spi_target_ptr) {
     int *spi_device = NULL;
     int dev;
     int a=0, b=0;
@@ -82,9 +215,13 @@ int lgw_spi_open(void **spi_target_ptr) {
     }
 
     /* open SPI device */
-    dev = open(SPI_DEV_PATH, O_RDWR);
+    if (spi_path == NULL) {
+        spi_path = SPI_DEV_PATH;
+    }
+    dev = open(spi_path, O_RDWR);
     if (dev < 0) {
-        DEBUG_PRINTF("ERROR: failed to open SPI device %s\n", SPI_DEV_PATH);
+        DEBUG_PRINTF("ERROR: failed to open SPI device %s\n", spi_path);
+        free(spi_device);
         return LGW_SPI_ERROR;
     }
 
@@ -199,9 +336,9 @@ int lgw_spi_w(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, ui
     k.speed_hz = SPI_SPEED;
     k.cs_change = 0;
     k.bits_per_word = 8;
-    a = ioctl(spi_device, SPI_IOC_MESSAGE(1), &k);
-
-    usleep(SPI_DELAY);
+    spi_delay_before();
+    a = spi_message(spi_device, &k, 1);
+    spi_delay_after();
 
     /* determine return code */
     if (a != (int)k.len) {
@@ -251,9 +388,9 @@ int lgw_spi_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, ui
     k.rx_buf = (unsigned long) in_buf;
     k.len = command_size;
     k.cs_change = 0;
-    a = ioctl(spi_device, SPI_IOC_MESSAGE(1), &k);
-
-    usleep(SPI_DELAY);
+    spi_delay_before();
+    a = spi_message(spi_device, &k, 1);
+    spi_delay_after();
 
     /* determine return code */
     if (a != (int)k.len) {
@@ -308,17 +445,18 @@ int lgw_spi_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, u
     k[0].len = command_size;
     k[0].cs_change = 0;
     k[1].cs_change = 0;
+    spi_delay_before();
     for (i=0; size_to_do > 0; ++i) {
         chunk_size = (size_to_do < LGW_BURST_CHUNK) ? size_to_do : LGW_BURST_CHUNK;
         offset = i * LGW_BURST_CHUNK;
         k[1].tx_buf = (unsigned long)(data + offset);
         k[1].len = chunk_size;
-        byte_transfered += (ioctl(spi_device, SPI_IOC_MESSAGE(2), &k) - k[0].len );
+        byte_transfered += (spi_message(spi_device, k, 2) - k[0].len );
         DEBUG_PRINTF("BURST WRITE: to trans %d # chunk %d # transferred %d \n", size_to_do, chunk_size, byte_transfered);
         size_to_do -= chunk_size; /* subtract the quantity of data already transferred */
     }
 
-    usleep(SPI_DELAY);
+    spi_delay_after();
 
     /* determine return code */
     if (byte_transfered != size) {
@@ -372,17 +510,18 @@ int lgw_spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, u
     k[0].len = command_size;
     k[0].cs_change = 0;
     k[1].cs_change = 0;
+    spi_delay_before();
     for (i=0; size_to_do > 0; ++i) {
         chunk_size = (size_to_do < LGW_BURST_CHUNK) ? size_to_do : LGW_BURST_CHUNK;
         offset = i * LGW_BURST_CHUNK;
         k[1].rx_buf = (unsigned long)(data + offset);
         k[1].len = chunk_size;
-        byte_transfered += (ioctl(spi_device, SPI_IOC_MESSAGE(2), &k) - k[0].len );
+        byte_transfered += (spi_message(spi_device, k, 2) - k[0].len );
         DEBUG_PRINTF("BURST READ: to trans %d # chunk %d # transferred %d \n", size_to_do, chunk_size, byte_transfered);
         size_to_do -= chunk_size;  /* subtract the quantity of data already transferred */
     }
 
-    usleep(SPI_DELAY);
+    spi_delay_after();
 
     /* determine return code */
     if (byte_transfered != size) {
@@ -394,4 +533,161 @@ int lgw_spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, u
     }
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Batch of accesses sent in a single SPI message */
+int lgw_spi_batch_init(struct lgw_spi_batch_s *batch, void *spi_target) {
+    /* check input variables */
+    CHECK_NULL(batch);
+    CHECK_NULL(spi_target);
+
+    batch->spi_target = spi_target;
+    batch->nb_op = 0;
+    batch->nb_byte = 0;
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_batch_w(struct lgw_spi_batch_s *batch, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t data) {
+    /* check input variables */
+    CHECK_NULL(batch);
+    if ((address & 0x80) != 0) {
+        DEBUG_MSG("WARNING: SPI address > 127\n");
+    }
+
+    return spi_batch_add(batch, spi_mux_mode, spi_mux_target, WRITE_ACCESS, address, &data, NULL, 1);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_batch_r(struct lgw_spi_batch_s *batch, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data) {
+    /* check input variables */
+    CHECK_NULL(batch);
+    if ((address & 0x80) != 0) {
+        DEBUG_MSG("WARNING: SPI address > 127\n");
+    }
+    CHECK_NULL(data);
+
+    return spi_batch_add(batch, spi_mux_mode, spi_mux_target, READ_ACCESS, address, NULL, data, 1);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_batch_wb(struct lgw_spi_batch_s *batch, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+    /* check input variables */
+    CHECK_NULL(batch);
+    if ((address & 0x80) != 0) {
+        DEBUG_MSG("WARNING: SPI address > 127\n");
+    }
+    CHECK_NULL(data);
+    if (size == 0) {
+        DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+        return LGW_SPI_ERROR;
+    }
+
+    /* bursts larger than a batch are sent on their own, in order */
+    if ((size + 2) > LGW_SPI_BATCH_SIZE) {
+        if (lgw_spi_batch_flush(batch) != LGW_SPI_SUCCESS) {
+            return LGW_SPI_ERROR;
+        }
+        return lgw_spi_wb(batch->spi_target, spi_mux_mode, spi_mux_target, address, data, size);
+    }
+
+    return spi_batch_add(batch, spi_mux_mode, spi_mux_target, WRITE_ACCESS, address, data, NULL, size);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_batch_rb(struct lgw_spi_batch_s *batch, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+    /* check input variables */
+    CHECK_NULL(batch);
+    if ((address & 0x80) != 0) {
+        DEBUG_MSG("WARNING: SPI address > 127\n");
+    }
+    CHECK_NULL(data);
+    if (size == 0) {
+        DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+        return LGW_SPI_ERROR;
+    }
+
+    /* bursts larger than a batch are sent on their own, in order */
+    if ((size + 2) > LGW_SPI_BATCH_SIZE) {
+        if (lgw_spi_batch_flush(batch) != LGW_SPI_SUCCESS) {
+            return LGW_SPI_ERROR;
+        }
+        return lgw_spi_rb(batch->spi_target, spi_mux_mode, spi_mux_target, address, data, size);
+    }
+
+    return spi_batch_add(batch, spi_mux_mode, spi_mux_target, READ_ACCESS, address, NULL, data, size);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_batch_flush(struct lgw_spi_batch_s *batch) {
+    int spi_device;
+    struct spi_ioc_transfer k[LGW_SPI_BATCH_MAX];
+    uint16_t delay_us;
+    int offset = 0;
+    int a;
+    int i;
+
+    /* check input variables */
+    CHECK_NULL(batch);
+    if (batch->nb_op == 0) {
+        return LGW_SPI_SUCCESS;
+    }
+    CHECK_NULL(batch->spi_target);
+
+    spi_device = *(int *)batch->spi_target; /* must check that spi_target is not null beforehand */
+
+    /* the minimum gap between accesses is enforced by the driver inside the message */
+    delay_us = (spi_delay_mode == LGW_SPI_DELAY_NONE) ? 0 : (uint16_t)((spi_delay_ns + 999) / 1000);
+
+    /* one transfer per access, chip select released between them */
+    memset(k, 0, batch->nb_op * sizeof(k[0]));
+    for (i=0; i<batch->nb_op; ++i) {
+        k[i].tx_buf = (unsigned long)&batch->tx_buf[offset];
+        k[i].rx_buf = (unsigned long)&batch->rx_buf[offset];
+        k[i].len = batch->op_len[i];
+        k[i].speed_hz = SPI_SPEED;
+        k[i].bits_per_word = 8;
+        if (i < (batch->nb_op - 1)) {
+            k[i].cs_change = 1;
+            k[i].delay_usecs = delay_us;
+        }
+        offset += batch->op_len[i];
+    }
+
+    /* I/O transaction */
+    spi_delay_before();
+    a = spi_message(spi_device, k, batch->nb_op);
+    spi_delay_after();
+    DEBUG_PRINTF("BATCH: %u access(es), %u bytes, transferred %d\n", batch->nb_op, batch->nb_byte, a);
+
+    /* resolve reads */
+    if (a == (int)batch->nb_byte) {
+        offset = 0;
+        for (i=0; i<batch->nb_op; ++i) {
+            if (batch->op_dest[i] != NULL) {
+                memcpy(batch->op_dest[i], &batch->rx_buf[offset + batch->op_cmd[i]], batch->op_len[i] - batch->op_cmd[i]);
+            }
+            offset += batch->op_len[i];
+        }
+    }
+
+    /* empty the batch */
+    batch->nb_op = 0;
+    batch->nb_byte = 0;
+
+    /* determine return code */
+    if (a != offset) {
+        DEBUG_MSG("ERROR: SPI BATCH FAILURE\n");
+        return LGW_SPI_ERROR;
+    } else {
+        DEBUG_MSG("Note: SPI batch success\n");
+        return LGW_SPI_SUCCESS;
+    }
+}
+
 /* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,1447 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Software SX1301 simulator, replacing the SPI link to the concentrator.
+    SPI frames are decoded like the chip does (command byte, burst with
+    auto-incremented address, FIFO data ports) and applied to a model of the
+    register file, the RX data buffer and packet FIFO, the TX buffer, the MCUs
+    program memory and firmwares, the radios and the optional FPGA.
+    Uplinks are injected at a configurable rate once the concentrator is
+    started, so the HAL and the applications can run on any Linux host.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>        /* C99 types */
+#include <stdbool.h>       /* bool type */
+#include <stdio.h>         /* printf fprintf */
+#include <stdlib.h>        /* malloc free getenv */
+#include <unistd.h>        /* usleep */
+#include <string.h>        /* memset memcpy memcmp */
+#include <time.h>          /* clock_gettime */
+#include <pthread.h>
+
+#include "loragw_spi.h"
+#include "loragw_reg.h"
+#include "loragw_sim.h"
+#include "loragw_perf.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#if DEBUG_SPI == 1
+    #define DEBUG_MSG(str)                fprintf(stderr, str)
+    #define DEBUG_PRINTF(fmt, args...)    fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+    #define CHECK_NULL(a)                if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_SPI_ERROR;}
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+    #define CHECK_NULL(a)                if(a==NULL){return LGW_SPI_ERROR;}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define READ_ACCESS     0x00
+#define WRITE_ACCESS    0x80
+
+#define SPI_DELAY_MODE_DEFAULT  LGW_SPI_DELAY_BUSYWAIT
+#define SPI_DELAY_NS_DEFAULT    8000 /* same minimum gap as the former usleep(8) */
+
+#define MCU_ARB_FW_BYTE     8192 /* size of the firmware IN BYTES, needed by the .var files */
+#define MCU_AGC_FW_BYTE     8192
+#define MCU_PROM_SIZE       8192
+#define MCU_RAM_SIZE        256
+#define MCU_ARB             0
+#define MCU_AGC             1
+#define FW_VERSION_ADDR     0x20 /* Address of firmware version in data memory */
+#define FW_VERSION_CAL      2
+#define FW_VERSION_AGC      4
+#define FW_VERSION_ARB      1
+#define AGC_CMD_WAIT        16
+#define AGC_CMD_ABORT       17
+#define AGC_LUT_SIZE        16
+
+#define SIM_CHIP_NB         4 /* number of SPI devices (concentrators) simulated */
+#define SIM_PATH_MAX        64
+
+#define SIM_ROW_COMMON      4 /* registers present on all pages (page -1 in the register table) */
+#define SIM_ROWS            5
+#define SIM_ADDR_NB         128
+
+#define RX_BUF_SIZE         4096 /* RX data buffer, in bytes (power of 2) */
+#define RX_FIFO_SIZE        16
+#define RX_METADATA_NB      16
+#define RX_STATUS_CRC_OK    5
+#define RX_SIZE_DEFAULT     16
+#define RX_BACKLOG_MAX      (2 * RX_FIFO_SIZE) /* generator catch-up limit after the host stalled */
+#define TX_BUF_SIZE         256
+#define TX_STATUS_PROG      0x10 /* TX_STATUS bit 4: TX programmed */
+#define TX_STATUS_EMIT      0x20 /* TX_STATUS bit 5: TX sequence running */
+#define TX_XTAL_FREQ        32000000 /* FSK baudrate divider reference */
+
+#define SX125X_VERSION      0x21
+#define SX125X_REG_VERSION  0x07
+#define SX125X_REG_STAT     0x11
+#define SX125X_PLL_LOCKED   0x03 /* RX and TX PLL locked */
+#define SX127X_REG_VERSION  0x42
+#define SX127X_VERSION      0x12
+#define FPGA_VERSION_SIM    33
+#define FPGA_FEATURE_SIM    0x02 /* TX notch filter only */
+
+/* behaviour attached to a register address */
+enum sim_hook_e {
+    HOOK_NONE = 0,
+    HOOK_PAGE,
+    HOOK_RX_BUF_ADDR,
+    HOOK_RX_BUF_DATA,
+    HOOK_RX_FIFO,
+    HOOK_TX_BUF_ADDR,
+    HOOK_TX_BUF_DATA,
+    HOOK_TX_STATUS,
+    HOOK_PROM_ADDR,
+    HOOK_PROM_DATA,
+    HOOK_EMERGENCY,
+    HOOK_RADIO_SELECT,
+    HOOK_MCU_CTRL,
+    HOOK_TX_TRIG,
+    HOOK_RADIO_A_CS,
+    HOOK_RADIO_B_CS,
+    HOOK_ARB_RAM_ADDR,
+    HOOK_AGC_RAM_ADDR,
+    HOOK_TIMESTAMP
+};
+
+/* firmware running on a MCU */
+enum sim_fw_e {
+    FW_NONE = 0,
+    FW_UNKNOWN,
+    FW_CAL,
+    FW_AGC,
+    FW_ARB
+};
+
+/* progress of the AGC firmware initialization handshake */
+enum sim_agc_e {
+    AGC_LUT = 0,
+    AGC_FREQ,
+    AGC_CHAN,
+    AGC_END,
+    AGC_RUN
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct sim_mcu_s {
+    uint8_t     fw;                     /* firmware running, FW_NONE while in reset */
+    uint8_t     prom[MCU_PROM_SIZE];    /* program memory */
+    uint8_t     ram[MCU_RAM_SIZE];      /* data memory */
+};
+
+struct sim_rx_s {
+    uint16_t    addr;   /* start address in the RX data buffer */
+    uint8_t     size;   /* payload size */
+    uint8_t     status; /* CRC status */
+};
+
+/* one simulated concentrator, attached to a SPI device path */
+struct sim_chip_s {
+    char            path[SIM_PATH_MAX]; /* SPI device, empty for the default one */
+    bool            attached;   /* path assigned to the chip */
+    bool            powered;
+    struct timespec t0;         /* last reset, origin of the timestamp counter */
+    bool            fpga;       /* FPGA present on the SPI bus, latched at each connection */
+
+    /* SX1301 register file */
+    uint8_t         page;
+    uint8_t         reg[SIM_ROWS][SIM_ADDR_NB];
+    uint32_t        ts_latch;
+
+    /* RX data buffer and packet FIFO */
+    uint8_t         rx_buf[RX_BUF_SIZE];
+    struct sim_rx_s rx_fifo[RX_FIFO_SIZE];
+    uint8_t         rx_head;
+    uint8_t         rx_nb;
+    uint16_t        rx_wr;      /* where the next packet is written */
+    uint16_t        rx_rd;      /* data port read pointer */
+    uint16_t        rx_used;    /* bytes used by the packets in the FIFO */
+
+    /* packet generator */
+    struct timespec gen_t0;
+    uint64_t        gen_nb;
+    uint32_t        gen_seq;
+
+    /* TX buffer */
+    uint8_t         tx_buf[TX_BUF_SIZE];
+    uint8_t         tx_ptr;
+    bool            tx_pending; /* a TX is programmed, until the end of its emission or an abort */
+    uint32_t        tx_start;   /* timestamp of the start of the TX sequence */
+    uint32_t        tx_end;     /* timestamp of the end of the emission */
+
+    /* MCUs */
+    struct sim_mcu_s mcu[2];
+    uint16_t        prom_ptr;
+    uint8_t         prom_prefetch;
+    bool            agc_armed;
+    uint8_t         agc_state;
+    uint8_t         agc_lut_nb;
+
+    /* radios, FPGA and other SPI targets */
+    uint8_t         radio_reg[2][SIM_ADDR_NB];
+    uint8_t         fpga_reg[SIM_ADDR_NB];
+    uint8_t         sx127x_reg[SIM_ADDR_NB];
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+extern const struct lgw_reg_s loregs[LGW_TOTALREGS]; /* register table, defined in loragw_reg.c */
+
+/* firmwares, to recognize what the host loads in the MCUs */
+#include "arb_fw.var"       /* external definition of the variable */
+#include "agc_fw.var"       /* external definition of the variable */
+#include "cal_fw.var"       /* external definition of the variable */
+
+static uint8_t spi_delay_mode = SPI_DELAY_MODE_DEFAULT;
+static uint32_t spi_delay_ns = SPI_DELAY_NS_DEFAULT;
+static struct timespec spi_last_end = {0, 0}; /* end of the last SPI transaction (busy-wait mode) */
+
+static pthread_mutex_t mx_sim = PTHREAD_MUTEX_INITIALIZER; /* one SPI message at a time */
+
+static bool sim_conf_set = false; /* configuration given by lgw_sim_setconf, not by the environment */
+static struct lgw_sim_conf_s sim_conf = {false, 0.0, RX_SIZE_DEFAULT, 0, 0};
+static struct lgw_sim_stats_s sim_stats;
+
+/* register table mapping, common to all the simulated chips */
+static uint8_t sim_hook[SIM_ROWS][SIM_ADDR_NB];
+static bool sim_common[SIM_ADDR_NB];
+
+static struct sim_chip_s sim_chip[SIM_CHIP_NB]; /* chip 0 is on the default SPI device */
+static struct sim_chip_s *sim = &sim_chip[0]; /* chip addressed by the SPI message in progress, protected by mx_sim */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* Called right before a transaction: in busy-wait mode, spin until the minimum
+gap since the end of the previous transaction has elapsed */
+static void spi_delay_before(void) {
+    struct timespec now;
+    int64_t elapsed_ns;
+
+    if ((spi_delay_mode != LGW_SPI_DELAY_BUSYWAIT) || (spi_delay_ns == 0)) {
+        return;
+    }
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed_ns = (int64_t)(now.tv_sec - spi_last_end.tv_sec) * 1000000000 + (now.tv_nsec - spi_last_end.tv_nsec);
+    } while (elapsed_ns < (int64_t)spi_delay_ns);
+}
+
+/* Called right after a transaction: sleep (legacy behaviour) or timestamp the
+end of the transaction for the busy-wait of the next one */
+static void spi_delay_after(void) {
+    switch (spi_delay_mode) {
+        case LGW_SPI_DELAY_BUSYWAIT:
+            clock_gettime(CLOCK_MONOTONIC, &spi_last_end);
+            break;
+        case LGW_SPI_DELAY_SLEEP:
+            if (spi_delay_ns > 0) {
+                usleep((spi_delay_ns + 999) / 1000); /* round up to the next microsecond */
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/* Queue one access (command + data) in a batch, flushing it first if full */
+static int spi_batch_add(struct lgw_spi_batch_s *batch, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t access, uint8_t address, const uint8_t *data, uint8_t *dest, uint16_t size) {
+    uint8_t command_size;
+    uint16_t len;
+    uint8_t *out;
+    int a;
+
+    command_size = (spi_mux_mode == LGW_SPI_MUX_MODE1) ? 2 : 1;
+    len = command_size + size;
+
+    /* make room for the new access */
+    if ((batch->nb_op >= LGW_SPI_BATCH_MAX) || ((batch->nb_byte + len) > LGW_SPI_BATCH_SIZE)) {
+        a = lgw_spi_batch_flush(batch);
+        if (a != LGW_SPI_SUCCESS) {
+            return LGW_SPI_ERROR;
+        }
+    }
+
+    /* append the command and the data to be sent */
+    out = &batch->tx_buf[batch->nb_byte];
+    if (spi_mux_mode == LGW_SPI_MUX_MODE1) {
+        out[0] = spi_mux_target;
+        out[1] = access | (address & 0x7F);
+    } else {
+        out[0] = access | (address & 0x7F);
+    }
+    if (data != NULL) {
+        memcpy(&out[command_size], data, size);
+    } else {
+        memset(&out[command_size], 0, size);
+    }
+
+    batch->op_len[batch->nb_op] = len;
+    batch->op_cmd[batch->nb_op] = command_size;
+    batch->op_dest[batch->nb_op] = dest;
+    batch->nb_op += 1;
+    batch->nb_byte += len;
+
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int64_t sim_elapsed_ns(const struct timespec *t) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)(now.tv_sec - t->tv_sec) * 1000000000 + (now.tv_nsec - t->tv_nsec);
+}
+
+/* Value of the SX1301 timestamp counter (1 MHz, reset with the chip) */
+static uint32_t sim_timestamp(void) {
+    return (uint32_t)(sim_elapsed_ns(&sim->t0) / 1000);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Registers present on all pages live in a dedicated row */
+static inline uint8_t sim_row(uint8_t addr) {
+    return sim_common[addr] ? SIM_ROW_COMMON : sim->page;
+}
+
+/* Attach a behaviour to the address of a register of the table */
+static void sim_hook_set(int reg, uint8_t hook) {
+    const struct lgw_reg_s *r = &loregs[reg];
+    int row = (r->page == -1) ? SIM_ROW_COMMON : r->page;
+    int i;
+
+    /* multi-byte registers: attach the behaviour to every byte */
+    for (i = 0; i < (r->offs + r->leng + 7) / 8; ++i) {
+        sim_hook[row][r->addr + i] = hook;
+    }
+}
+
+/* Map the register table on the register file, done once at power-on */
+static void sim_hook_init(void) {
+    int i;
+
+    memset(sim_common, 0, sizeof sim_common);
+    memset(sim_hook, HOOK_NONE, sizeof sim_hook);
+    for (i = 0; i < LGW_TOTALREGS; ++i) {
+        if (loregs[i].page == -1) {
+            sim_common[loregs[i].addr] = true;
+        }
+    }
+
+    sim_hook_set(LGW_PAGE_REG, HOOK_PAGE);
+    sim_hook_set(LGW_RX_DATA_BUF_ADDR, HOOK_RX_BUF_ADDR);
+    sim_hook_set(LGW_RX_DATA_BUF_DATA, HOOK_RX_BUF_DATA);
+    sim_hook_set(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, HOOK_RX_FIFO);
+    sim_hook_set(LGW_TX_DATA_BUF_ADDR, HOOK_TX_BUF_ADDR);
+    sim_hook_set(LGW_TX_DATA_BUF_DATA, HOOK_TX_BUF_DATA);
+    sim_hook_set(LGW_TX_STATUS, HOOK_TX_STATUS);
+    sim_hook_set(LGW_MCU_PROM_ADDR, HOOK_PROM_ADDR);
+    sim_hook_set(LGW_MCU_PROM_DATA, HOOK_PROM_DATA);
+    sim_hook_set(LGW_EMERGENCY_FORCE_HOST_CTRL, HOOK_EMERGENCY);
+    sim_hook_set(LGW_RADIO_SELECT, HOOK_RADIO_SELECT);
+    sim_hook_set(LGW_MCU_RST_0, HOOK_MCU_CTRL); /* resets and program memory mux share the same byte */
+    sim_hook_set(LGW_TX_TRIG_ALL, HOOK_TX_TRIG);
+    sim_hook_set(LGW_SPI_RADIO_A__CS, HOOK_RADIO_A_CS);
+    sim_hook_set(LGW_SPI_RADIO_B__CS, HOOK_RADIO_B_CS);
+    sim_hook_set(LGW_DBG_ARB_MCU_RAM_ADDR, HOOK_ARB_RAM_ADDR);
+    sim_hook_set(LGW_DBG_AGC_MCU_RAM_ADDR, HOOK_AGC_RAM_ADDR);
+    sim_hook_set(LGW_TIMESTAMP, HOOK_TIMESTAMP);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Load the default value of every register of the table */
+static void sim_reg_defaults(void) {
+    const struct lgw_reg_s *r;
+    int row;
+    int i, j;
+    int bits;
+
+    memset(sim->reg, 0, sizeof sim->reg);
+    for (i = 0; i < LGW_TOTALREGS; ++i) {
+        r = &loregs[i];
+        row = (r->page == -1) ? SIM_ROW_COMMON : r->page;
+        if (r->leng < 8) {
+            sim->reg[row][r->addr] |= (uint8_t)((r->dflt & ((1 << r->leng) - 1)) << r->offs);
+        } else {
+            for (j = 0; j < (r->leng + 7) / 8; ++j) { /* LSB at the base address */
+                bits = r->leng - (8 * j);
+                bits = (bits > 8) ? 8 : bits;
+                sim->reg[row][r->addr + j] |= (uint8_t)((r->dflt >> (8 * j)) & ((1 << bits) - 1));
+            }
+        }
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Refresh the RX FIFO status registers (head of the FIFO) */
+static void sim_rx_status(void) {
+    uint8_t *fifo = &sim->reg[SIM_ROW_COMMON][loregs[LGW_RX_PACKET_DATA_FIFO_NUM_STORED].addr];
+    struct sim_rx_s *head = &sim->rx_fifo[sim->rx_head];
+
+    fifo[0] = sim->rx_nb;
+    fifo[1] = (sim->rx_nb > 0) ? (uint8_t)(head->addr & 0xFF) : 0;
+    fifo[2] = (sim->rx_nb > 0) ? (uint8_t)(head->addr >> 8) : 0;
+    fifo[3] = (sim->rx_nb > 0) ? head->status : 0;
+    fifo[4] = (sim->rx_nb > 0) ? head->size : 0;
+}
+
+static void sim_rx_reset(void) {
+    sim->rx_head = 0;
+    sim->rx_nb = 0;
+    sim->rx_wr = 0;
+    sim->rx_rd = 0;
+    sim->rx_used = 0;
+    sim_rx_status();
+}
+
+/* Store a received packet (payload + metadata) in the RX data buffer */
+static bool sim_rx_push(uint8_t if_chain, uint8_t sf, uint8_t size, const uint8_t *payload, uint32_t tstamp) {
+    uint8_t meta[RX_METADATA_NB];
+    struct sim_rx_s *p;
+    int i;
+
+    if ((sim->rx_nb >= RX_FIFO_SIZE) || ((sim->rx_used + size + RX_METADATA_NB) > RX_BUF_SIZE)) {
+        sim_stats.nb_rx_overflow += 1;
+        return false;
+    }
+
+    memset(meta, 0, sizeof meta);
+    meta[0] = if_chain;
+    meta[1] = (uint8_t)((sf << 4) | (1 << 1)); /* coding rate 4/5 */
+    meta[2] = 40; /* SNR 10 dB, in 1/4 dB */
+    meta[3] = 36;
+    meta[4] = 44;
+    meta[5] = 120; /* RSSI before RF chain offset */
+    meta[6] = (uint8_t)(tstamp);
+    meta[7] = (uint8_t)(tstamp >> 8);
+    meta[8] = (uint8_t)(tstamp >> 16);
+    meta[9] = (uint8_t)(tstamp >> 24);
+
+    p = &sim->rx_fifo[(sim->rx_head + sim->rx_nb) % RX_FIFO_SIZE];
+    p->addr = sim->rx_wr;
+    p->size = size;
+    p->status = RX_STATUS_CRC_OK;
+    for (i = 0; i < size; ++i) {
+        sim->rx_buf[sim->rx_wr++ % RX_BUF_SIZE] = payload[i];
+    }
+    for (i = 0; i < RX_METADATA_NB; ++i) {
+        sim->rx_buf[sim->rx_wr++ % RX_BUF_SIZE] = meta[i];
+    }
+    sim->rx_wr %= RX_BUF_SIZE;
+    sim->rx_used += size + RX_METADATA_NB;
+    if (sim->rx_nb == 0) {
+        sim->rx_rd = p->addr;
+    }
+    sim->rx_nb += 1;
+    sim_stats.nb_rx_gen += 1;
+    sim_rx_status();
+    return true;
+}
+
+/* Remove the packet at the head of the FIFO */
+static void sim_rx_pop(void) {
+    if (sim->rx_nb == 0) {
+        return;
+    }
+    sim->rx_used -= sim->rx_fifo[sim->rx_head].size + RX_METADATA_NB;
+    sim->rx_head = (sim->rx_head + 1) % RX_FIFO_SIZE;
+    sim->rx_nb -= 1;
+    if (sim->rx_nb > 0) {
+        sim->rx_rd = sim->rx_fifo[sim->rx_head].addr;
+    }
+    sim_stats.nb_rx_fetch += 1;
+    sim_rx_status();
+}
+
+/* Inject the uplinks due since the last call, at the configured rate.
+Payload starts with a 32-bit sequence number (LSB first) so that the host can
+check for lost or duplicated packets. */
+static void sim_rx_generate(void) {
+    uint8_t payload[255];
+    uint64_t due;
+    uint8_t size;
+    int i;
+
+    if ((sim->agc_state != AGC_RUN) || (sim_conf.rx_rate <= 0.0)) {
+        return;
+    }
+
+    due = (uint64_t)((double)sim_elapsed_ns(&sim->gen_t0) * sim_conf.rx_rate / 1e9);
+    if ((due - sim->gen_nb) > RX_BACKLOG_MAX) { /* the host stalled, older packets are lost */
+        sim_stats.nb_rx_overflow += (uint32_t)(due - sim->gen_nb - RX_BACKLOG_MAX);
+        sim->gen_nb = due - RX_BACKLOG_MAX;
+    }
+    size = (sim_conf.rx_size < 4) ? 4 : sim_conf.rx_size;
+    for (; sim->gen_nb < due; ++sim->gen_nb) {
+        payload[0] = (uint8_t)(sim->gen_seq);
+        payload[1] = (uint8_t)(sim->gen_seq >> 8);
+        payload[2] = (uint8_t)(sim->gen_seq >> 16);
+        payload[3] = (uint8_t)(sim->gen_seq >> 24);
+        for (i = 4; i < size; ++i) {
+            payload[i] = (uint8_t)(sim->gen_seq + i);
+        }
+        sim_rx_push(sim->gen_seq % 8, 7 + (sim->gen_seq % 6), size, payload, sim_timestamp());
+        sim->gen_seq += 1;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Identify the firmware loaded in a MCU program memory */
+static uint8_t sim_mcu_fw(int mcu) {
+    if ((mcu == MCU_ARB) && (memcmp(sim->mcu[mcu].prom, arb_firmware, MCU_ARB_FW_BYTE) == 0)) {
+        return FW_ARB;
+    }
+    if ((mcu == MCU_AGC) && (memcmp(sim->mcu[mcu].prom, agc_firmware, MCU_AGC_FW_BYTE) == 0)) {
+        return FW_AGC;
+    }
+    if ((mcu == MCU_AGC) && (memcmp(sim->mcu[mcu].prom, cal_firmware, MCU_AGC_FW_BYTE) == 0)) {
+        return FW_CAL;
+    }
+    return FW_UNKNOWN;
+}
+
+/* MCU reset released: start the firmware */
+static void sim_mcu_start(int mcu) {
+    struct sim_mcu_s *m = &sim->mcu[mcu];
+
+    m->fw = sim_mcu_fw(mcu);
+    memset(m->ram, 0, sizeof m->ram);
+    switch (m->fw) {
+        case FW_ARB:
+            m->ram[FW_VERSION_ADDR] = FW_VERSION_ARB;
+            break;
+        case FW_AGC:
+            m->ram[FW_VERSION_ADDR] = FW_VERSION_AGC;
+            sim->reg[SIM_ROW_COMMON][loregs[LGW_MCU_AGC_STATUS].addr] = 0x10;
+            sim->agc_armed = false;
+            sim->agc_state = AGC_LUT;
+            sim->agc_lut_nb = 0;
+            break;
+        case FW_CAL:
+            m->ram[FW_VERSION_ADDR] = FW_VERSION_CAL;
+            sim->reg[SIM_ROW_COMMON][loregs[LGW_MCU_AGC_STATUS].addr] = 0x00;
+            break;
+        default:
+            DEBUG_PRINTF("Note: unknown firmware started on MCU %d\n", mcu);
+            break;
+    }
+}
+
+/* MCU put in reset */
+static void sim_mcu_stop(int mcu) {
+    sim->mcu[mcu].fw = FW_NONE;
+    if (mcu == MCU_AGC) {
+        sim->agc_state = AGC_LUT;
+    }
+}
+
+/* Calibration firmware given access to the registers: calibrate the radios
+requested in the command word and report success, with arbitrary non-default
+results (TX DC offsets in data memory, RX IQ mismatch compensation registers).
+The firmware leaves the register page it used selected. */
+static void sim_mcu_calibrate(void) {
+    uint8_t cmd = sim->reg[0][loregs[LGW_RADIO_SELECT].addr];
+    uint8_t status = 0x81;
+    int i;
+
+    for (i = 0; i < 32; ++i) {
+        sim->mcu[MCU_AGC].ram[0xA0 + i] = (uint8_t)(i - 16);
+    }
+    sim->reg[0][loregs[LGW_IQ_MISMATCH_A_AMP_COEFF].addr] = 0x05;
+    sim->reg[0][loregs[LGW_IQ_MISMATCH_A_PHI_COEFF].addr] = 0x3A;
+    sim->reg[0][loregs[LGW_IQ_MISMATCH_B_AMP_COEFF].addr] = 0x47; /* shared with IQ_MISMATCH_B_SEL_I */
+    sim->reg[0][loregs[LGW_IQ_MISMATCH_B_PHI_COEFF].addr] = 0x11;
+
+    if (cmd & 0x01) status |= 0x02 | 0x08;
+    if (cmd & 0x02) status |= 0x04 | 0x10;
+    if (cmd & 0x04) status |= 0x20;
+    if (cmd & 0x08) status |= 0x40;
+    sim->reg[SIM_ROW_COMMON][loregs[LGW_MCU_AGC_STATUS].addr] = status;
+    sim->page = 2;
+}
+
+/* AGC firmware initialization handshake, one command after each AGC_CMD_WAIT */
+static void sim_mcu_agc_cmd(uint8_t cmd) {
+    uint8_t *status = &sim->reg[SIM_ROW_COMMON][loregs[LGW_MCU_AGC_STATUS].addr];
+
+    if ((sim->mcu[MCU_AGC].fw != FW_AGC) || (sim->agc_state == AGC_RUN)) {
+        return;
+    }
+    if (!sim->agc_armed) {
+        sim->agc_armed = (cmd == AGC_CMD_WAIT);
+        return;
+    }
+    sim->agc_armed = false;
+
+    switch (sim->agc_state) {
+        case AGC_LUT:
+            if ((cmd == AGC_CMD_ABORT) || (sim->agc_lut_nb >= AGC_LUT_SIZE - 1)) {
+                *status = (cmd == AGC_CMD_ABORT) ? 0x30 : (uint8_t)(0x30 + sim->agc_lut_nb);
+                sim->agc_state = AGC_FREQ;
+            } else {
+                *status = (uint8_t)(0x30 + sim->agc_lut_nb);
+                sim->agc_lut_nb += 1;
+            }
+            break;
+        case AGC_FREQ:
+            *status = 0x30 | (cmd & 0x0F);
+            sim->agc_state = AGC_CHAN;
+            break;
+        case AGC_CHAN:
+            *status = 0x30 | (cmd & 0x0F);
+            sim->agc_state = AGC_END;
+            break;
+        default: /* end of initialization, the concentrator starts receiving */
+            *status = 0x40;
+            sim->agc_state = AGC_RUN;
+            clock_gettime(CLOCK_MONOTONIC, &sim->gen_t0);
+            sim->gen_nb = 0;
+            break;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Duration of the packet described by the TX buffer metadata, in microseconds */
+static uint32_t sim_tx_airtime(void) {
+    uint32_t sf, cr, bw_div, de, h, nb_symb, preamble, div;
+    int32_t num;
+
+    preamble = (sim->tx_buf[12] << 8) | sim->tx_buf[13];
+    if (sim->tx_buf[7] & 0x10) { /* FSK: preamble, sync word, length, payload, CRC */
+        div = (sim->tx_buf[14] << 8) | sim->tx_buf[15];
+        if (div == 0) {
+            return 0;
+        }
+        return (uint32_t)((uint64_t)8 * (preamble + 3 + 1 + sim->tx_buf[10] + ((sim->tx_buf[11] & 0x02) ? 2 : 0)) * div * 1000000 / TX_XTAL_FREQ);
+    }
+    sf = sim->tx_buf[9] & 0x0F;
+    cr = (sim->tx_buf[9] >> 4) & 0x07;
+    bw_div = 1 << (sim->tx_buf[11] & 0x03); /* 125 kHz, 250 kHz, 500 kHz */
+    h = (sim->tx_buf[11] & 0x04) ? 1 : 0;
+    de = (sim->tx_buf[11] & 0x08) ? 1 : 0;
+    if ((sf < 6) || (sf > 12)) {
+        return 0;
+    }
+    num = 8 * sim->tx_buf[10] - 4 * sf + 28 + ((sim->tx_buf[9] & 0x80) ? 16 : 0) - 20 * h;
+    nb_symb = 8 + ((num > 0) ? ((num + 4 * (sf - 2 * de) - 1) / (4 * (sf - 2 * de))) * (cr + 4) : 0);
+    return (((preamble * 4 + 17) << sf) / 4 + (nb_symb << sf)) * 8 / bw_div; /* 8 us per chip at 125 kHz */
+}
+
+/* TX trigger: the TX sequence starts at the programmed timestamp (delayed) or
+right away, and the packet ends after the TX start delay and its airtime */
+static void sim_tx_trigger(uint8_t data) {
+    uint8_t *d = &sim->reg[1][loregs[LGW_TX_START_DELAY].addr];
+
+    if ((data & 0x07) == 0) {
+        sim->tx_pending = false; /* abort */
+        return;
+    }
+    sim_stats.nb_tx += 1;
+    if (data & 0x02) {
+        sim->tx_start = ((uint32_t)sim->tx_buf[3] << 24) | ((uint32_t)sim->tx_buf[4] << 16) | ((uint32_t)sim->tx_buf[5] << 8) | sim->tx_buf[6];
+    } else {
+        sim->tx_start = sim_timestamp();
+    }
+    sim->tx_end = sim->tx_start + (d[0] | (d[1] << 8)) + sim_tx_airtime();
+    sim->tx_pending = true;
+}
+
+/* TX status register at the current time */
+static uint8_t sim_tx_status(uint8_t reg) {
+    uint32_t now = sim_timestamp();
+
+    reg &= ~(TX_STATUS_PROG | TX_STATUS_EMIT);
+    if (sim->tx_pending && ((int32_t)(now - sim->tx_end) >= 0)) {
+        sim->tx_pending = false;
+    }
+    if (sim->tx_pending) {
+        reg |= TX_STATUS_PROG;
+        if ((int32_t)(now - sim->tx_start) >= 0) {
+            reg |= TX_STATUS_EMIT;
+        }
+    }
+    return reg;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Radio SPI master: the transfer is done on the rising edge of chip select */
+static void sim_radio_cs(int radio, int reg_data, int reg_rb, int reg_addr, uint8_t old, uint8_t data) {
+    uint8_t addr = sim->reg[2][loregs[reg_addr].addr];
+
+    if (((old & 0x01) != 0) || ((data & 0x01) == 0)) {
+        return;
+    }
+    if (addr & 0x80) {
+        addr &= 0x7F;
+        if ((addr != SX125X_REG_VERSION) && (addr != SX125X_REG_STAT)) {
+            sim->radio_reg[radio][addr] = sim->reg[2][loregs[reg_data].addr];
+        }
+    } else {
+        sim->reg[2][loregs[reg_rb].addr] = sim->radio_reg[radio][addr & 0x7F];
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Put the chip back in its power-on state (soft reset) */
+static void sim_reset(void) {
+    sim_reg_defaults();
+    sim->page = 0;
+    clock_gettime(CLOCK_MONOTONIC, &sim->t0);
+    sim_rx_reset();
+    sim->tx_ptr = 0;
+    sim->tx_pending = false;
+    sim->prom_ptr = 0;
+    sim_mcu_stop(MCU_ARB);
+    sim_mcu_stop(MCU_AGC);
+}
+
+static void sim_power_on(void) {
+    const char *s;
+
+    /* configuration from the environment, for unmodified applications */
+    if (sim_conf_set == false) {
+        s = getenv("LGW_SIM_FPGA");
+        sim_conf.fpga = (s != NULL) && (atoi(s) != 0);
+        s = getenv("LGW_SIM_RX_RATE");
+        sim_conf.rx_rate = (s != NULL) ? (float)atof(s) : 0.0;
+        s = getenv("LGW_SIM_RX_SIZE");
+        sim_conf.rx_size = (s != NULL) ? (uint8_t)atoi(s) : RX_SIZE_DEFAULT;
+        s = getenv("LGW_SIM_SPI_MSG_NS");
+        sim_conf.msg_ns = (s != NULL) ? (uint32_t)atol(s) : 0;
+        s = getenv("LGW_SIM_SPI_BYTE_NS");
+        sim_conf.byte_ns = (s != NULL) ? (uint32_t)atol(s) : 0;
+    }
+
+    sim_hook_init();
+    memset(sim->mcu, 0, sizeof sim->mcu);
+    memset(sim->radio_reg, 0, sizeof sim->radio_reg);
+    sim->radio_reg[0][SX125X_REG_VERSION] = SX125X_VERSION;
+    sim->radio_reg[1][SX125X_REG_VERSION] = SX125X_VERSION;
+    sim->radio_reg[0][SX125X_REG_STAT] = SX125X_PLL_LOCKED;
+    sim->radio_reg[1][SX125X_REG_STAT] = SX125X_PLL_LOCKED;
+    memset(sim->fpga_reg, 0, sizeof sim->fpga_reg);
+    sim->fpga_reg[0] = FPGA_FEATURE_SIM;
+    sim->fpga_reg[1] = FPGA_VERSION_SIM;
+    memset(sim->sx127x_reg, 0, sizeof sim->sx127x_reg);
+    sim->sx127x_reg[SX127X_REG_VERSION] = SX127X_VERSION;
+    sim_reset();
+    sim->powered = true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Read one byte of the SX1301 register file */
+static uint8_t sim_read(uint8_t addr) {
+    uint8_t row = sim_row(addr);
+    uint8_t data;
+    int mcu;
+
+    switch (sim_hook[row][addr]) {
+        case HOOK_RX_BUF_DATA:
+            return sim->rx_buf[sim->rx_rd++ % RX_BUF_SIZE];
+        case HOOK_PROM_DATA: /* reads are pipelined by one byte */
+            data = sim->prom_prefetch;
+            mcu = ((sim->reg[0][loregs[LGW_MCU_SELECT_MUX_1].addr] & 0x08) == 0) ? MCU_AGC : MCU_ARB;
+            sim->prom_prefetch = sim->mcu[mcu].prom[sim->prom_ptr % MCU_PROM_SIZE];
+            sim->prom_ptr = (sim->prom_ptr + 1) % MCU_PROM_SIZE;
+            return data;
+        case HOOK_RX_FIFO: /* host polls the FIFO, deliver the uplinks due */
+            sim_rx_generate();
+            break;
+        case HOOK_TX_STATUS:
+            return sim_tx_status(sim->reg[row][addr]);
+        case HOOK_TIMESTAMP: /* counter latched when its LSB is read */
+            if (addr == loregs[LGW_TIMESTAMP].addr) {
+                sim->ts_latch = sim_timestamp();
+            }
+            return (uint8_t)(sim->ts_latch >> (8 * (addr - loregs[LGW_TIMESTAMP].addr)));
+        default:
+            break;
+    }
+    return sim->reg[row][addr];
+}
+
+/* Write one byte of the SX1301 register file */
+static void sim_write(uint8_t addr, uint8_t data) {
+    uint8_t row = sim_row(addr);
+    uint8_t old = sim->reg[row][addr];
+    int i;
+
+    sim->reg[row][addr] = data;
+
+    switch (sim_hook[row][addr]) {
+        case HOOK_PAGE:
+            if (data & 0x80) {
+                sim_reset();
+                break;
+            }
+            if ((data & 0x03) != sim->page) {
+                sim_stats.nb_page_switch += 1;
+            }
+            sim->page = data & 0x03;
+            sim->reg[row][addr] = sim->page;
+            break;
+        case HOOK_RX_BUF_ADDR:
+            sim->rx_rd = (uint16_t)(sim->reg[row][loregs[LGW_RX_DATA_BUF_ADDR].addr] | (sim->reg[row][loregs[LGW_RX_DATA_BUF_ADDR].addr + 1] << 8));
+            break;
+        case HOOK_RX_BUF_DATA:
+            sim->rx_buf[sim->rx_rd++ % RX_BUF_SIZE] = data;
+            break;
+        case HOOK_RX_FIFO: /* any write advances the FIFO */
+            sim_rx_pop();
+            break;
+        case HOOK_TX_BUF_ADDR:
+            sim->tx_ptr = data;
+            break;
+        case HOOK_TX_BUF_DATA:
+            sim->tx_buf[sim->tx_ptr++] = data;
+            break;
+        case HOOK_PROM_ADDR:
+            sim->prom_ptr = data;
+            break;
+        case HOOK_PROM_DATA: /* every MCU whose program memory is muxed to the host */
+            for (i = 0; i < 2; ++i) {
+                if ((sim->reg[0][loregs[LGW_MCU_SELECT_MUX_0].addr] & (0x04 << i)) == 0) {
+                    sim->mcu[i].prom[sim->prom_ptr % MCU_PROM_SIZE] = data;
+                }
+            }
+            sim->prom_ptr = (sim->prom_ptr + 1) % MCU_PROM_SIZE;
+            break;
+        case HOOK_EMERGENCY:
+            if (((data & 0x01) == 0) && (sim->mcu[MCU_AGC].fw == FW_CAL)) {
+                sim_mcu_calibrate();
+            }
+            break;
+        case HOOK_RADIO_SELECT:
+            sim_mcu_agc_cmd(data);
+            break;
+        case HOOK_MCU_CTRL:
+            for (i = 0; i < 2; ++i) {
+                if (((old >> i) & 0x01) && !((data >> i) & 0x01)) {
+                    sim_mcu_start(i);
+                } else if (!((old >> i) & 0x01) && ((data >> i) & 0x01)) {
+                    sim_mcu_stop(i);
+                }
+            }
+            break;
+        case HOOK_TX_TRIG:
+            sim_tx_trigger(data);
+            break;
+        case HOOK_RADIO_A_CS:
+            sim_radio_cs(0, LGW_SPI_RADIO_A__DATA, LGW_SPI_RADIO_A__DATA_READBACK, LGW_SPI_RADIO_A__ADDR, old, data);
+            break;
+        case HOOK_RADIO_B_CS:
+            sim_radio_cs(1, LGW_SPI_RADIO_B__DATA, LGW_SPI_RADIO_B__DATA_READBACK, LGW_SPI_RADIO_B__ADDR, old, data);
+            break;
+        case HOOK_ARB_RAM_ADDR:
+            sim->reg[2][loregs[LGW_DBG_ARB_MCU_RAM_DATA].addr] = sim->mcu[MCU_ARB].ram[data % MCU_RAM_SIZE];
+            break;
+        case HOOK_AGC_RAM_ADDR:
+            sim->reg[2][loregs[LGW_DBG_AGC_MCU_RAM_DATA].addr] = sim->mcu[MCU_AGC].ram[data % MCU_RAM_SIZE];
+            break;
+        default:
+            break;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* One chip select frame, decoded the way the SPI slave does: optional mux
+header (FPGA), command byte, then data with auto-incremented address except
+for the FIFO data ports */
+static void sim_frame(const uint8_t *tx, uint8_t *rx, uint16_t len) {
+    uint8_t target = LGW_SPI_MUX_TARGET_SX1301;
+    uint8_t *regs = NULL;
+    uint8_t cmd, addr;
+    uint8_t hook;
+    uint16_t i;
+
+    if (sim->fpga) { /* every frame goes through the FPGA mux */
+        if (len < 2) {
+            return;
+        }
+        target = tx[0];
+        rx[0] = 0;
+        tx += 1;
+        rx += 1;
+        len -= 1;
+    }
+    if (len < 1) {
+        return;
+    }
+    cmd = tx[0];
+    addr = cmd & 0x7F;
+    rx[0] = 0;
+
+    switch (target) {
+        case LGW_SPI_MUX_TARGET_SX1301:
+            for (i = 1; i < len; ++i) {
+                if (cmd & WRITE_ACCESS) {
+                    sim_write(addr, tx[i]);
+                    rx[i] = 0;
+                } else {
+                    rx[i] = sim_read(addr);
+                }
+                hook = sim_hook[sim_row(addr)][addr];
+                if ((hook != HOOK_RX_BUF_DATA) && (hook != HOOK_TX_BUF_DATA) && (hook != HOOK_PROM_DATA)) {
+                    addr = (addr + 1) & 0x7F;
+                }
+            }
+            return;
+        case LGW_SPI_MUX_TARGET_FPGA:
+            regs = sim->fpga_reg;
+            break;
+        case LGW_SPI_MUX_TARGET_SX127X:
+            regs = sim->sx127x_reg;
+            break;
+        default: /* EEPROM not simulated */
+            memset(rx, 0xFF, len);
+            return;
+    }
+
+    for (i = 1; i < len; ++i) {
+        if (cmd & WRITE_ACCESS) {
+            if ((regs == sim->fpga_reg) && (addr == 0)) {
+                regs[0] = (regs[0] & ~0x01) | (tx[i] & 0x01); /* only the soft reset bit is writable */
+            } else if ((regs == sim->fpga_reg) && (addr == 1)) {
+                /* version is read-only */
+            } else {
+                regs[addr] = tx[i];
+            }
+            rx[i] = 0;
+        } else {
+            rx[i] = regs[addr];
+        }
+        addr = (addr + 1) & 0x7F;
+    }
+}
+
+/* One SPI message made of several frames, with the modeled bus time */
+static void sim_message(void *spi_target, const uint8_t *tx, uint8_t *rx, const uint16_t *frame_len, int nb_frame) {
+    uint64_t t0 = lgw_perf_start();
+    struct timespec t;
+    int64_t cost_ns;
+    int offset = 0;
+    int i;
+
+    pthread_mutex_lock(&mx_sim);
+    sim = &sim_chip[*(int *)spi_target];
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    for (i = 0; i < nb_frame; ++i) {
+        sim_frame(&tx[offset], &rx[offset], frame_len[i]);
+        offset += frame_len[i];
+    }
+    sim_stats.nb_msg += 1;
+    sim_stats.nb_frame += nb_frame;
+    sim_stats.nb_byte += offset;
+    pthread_mutex_unlock(&mx_sim);
+
+    /* busy-wait for the time the message would take on a real bus */
+    cost_ns = (int64_t)sim_conf.msg_ns + (int64_t)sim_conf.byte_ns * offset;
+    if (cost_ns > 0) {
+        while (sim_elapsed_ns(&t) < cost_ns);
+    }
+    lgw_perf_stop(LGW_PERF_SPI, t0);
+    lgw_perf_add(LGW_PERF_SPI_BYTES, offset);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+/* Inter-transaction delay policy */
+int lgw_spi_set_delay(uint8_t mode, uint32_t delay_ns) {
+    if ((mode != LGW_SPI_DELAY_NONE) && (mode != LGW_SPI_DELAY_BUSYWAIT) && (mode != LGW_SPI_DELAY_SLEEP)) {
+        DEBUG_PRINTF("ERROR: %u IS NOT A VALID SPI DELAY MODE\n", mode);
+        return LGW_SPI_ERROR;
+    }
+
+    spi_delay_mode = mode;
+    spi_delay_ns = delay_ns;
+    spi_last_end.tv_sec = 0;
+    spi_last_end.tv_nsec = 0;
+    DEBUG_PRINTF("Note: SPI delay mode %u, %u ns\n", spi_delay_mode, spi_delay_ns);
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_get_delay(uint8_t *mode, uint32_t *delay_ns) {
+    CHECK_NULL(mode);
+    CHECK_NULL(delay_ns);
+
+    *mode = spi_delay_mode;
+    *delay_ns = spi_delay_ns;
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* SPI initialization and configuration */
+int lgw_spi_open(void **spi_target_ptr) {
+    return lgw_spi_open_path(NULL, spi_target_ptr);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Each SPI device path gets its own simulated chip, the default device is chip 0 */
+int lgw_spi_open_path(const char *spi_path, void **spi_target_ptr) {
+    int *spi_device = NULL;
+    int i;
+
+    /* check input variables */
+    CHECK_NULL(spi_target_ptr); /* cannot be null, must point on a void pointer (*spi_target_ptr can be null) */
+    if ((spi_path != NULL) && (strlen(spi_path) >= SIM_PATH_MAX)) {
+        DEBUG_PRINTF("ERROR: SPI DEVICE PATH TOO LONG (%s)\n", spi_path);
+        return LGW_SPI_ERROR;
+    }
+
+    /* allocate memory for the device descriptor */
+    spi_device = malloc(sizeof(int));
+    if (spi_device == NULL) {
+        DEBUG_MSG("ERROR: MALLOC FAIL\n");
+        return LGW_SPI_ERROR;
+    }
+
+    pthread_mutex_lock(&mx_sim);
+    i = 0;
+    if (spi_path != NULL) {
+        for (i = 1; i < SIM_CHIP_NB; ++i) {
+            if ((sim_chip[i].attached == false) || (strcmp(sim_chip[i].path, spi_path) == 0)) {
+                break;
+            }
+        }
+        if (i == SIM_CHIP_NB) {
+            pthread_mutex_unlock(&mx_sim);
+            free(spi_device);
+            DEBUG_PRINTF("ERROR: NO SIMULATED CHIP LEFT FOR SPI DEVICE %s\n", spi_path);
+            return LGW_SPI_ERROR;
+        }
+        if (sim_chip[i].attached == false) {
+            strcpy(sim_chip[i].path, spi_path);
+            sim_chip[i].attached = true;
+        }
+    }
+
+    /* the simulated chip keeps its state between connections, like the real one */
+    sim = &sim_chip[i];
+    if (sim->powered == false) {
+        sim_power_on();
+    }
+    sim->fpga = sim_conf.fpga;
+    pthread_mutex_unlock(&mx_sim);
+
+    *spi_device = i;
+    *spi_target_ptr = (void *)spi_device;
+    DEBUG_PRINTF("Note: SPI simulator opened, chip %d (FPGA %d, RX rate %.1f pkt/s)\n", i, sim_conf.fpga, sim_conf.rx_rate);
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* SPI release */
+int lgw_spi_close(void *spi_target) {
+    /* check input variables */
+    CHECK_NULL(spi_target);
+
+    free(spi_target);
+    DEBUG_MSG("Note: SPI simulator closed\n");
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Simple write */
+int lgw_spi_w(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t data) {
+    uint8_t out_buf[3];
+    uint8_t in_buf[ARRAY_SIZE(out_buf)];
+    uint16_t command_size;
+
+    /* check input variables */
+    CHECK_NULL(spi_target);
+    if ((address & 0x80) != 0) {
+        DEBUG_MSG("WARNING: SPI address > 127\n");
+    }
+
+    /* prepare frame to be sent */
+    if (spi_mux_mode == LGW_SPI_MUX_MODE1) {
+        out_buf[0] = spi_mux_target;
+        out_buf[1] = WRITE_ACCESS | (address & 0x7F);
+        out_buf[2] = data;
+        command_size = 3;
+    } else {
+        out_buf[0] = WRITE_ACCESS | (address & 0x7F);
+        out_buf[1] = data;
+        command_size = 2;
+    }
+
+    /* I/O transaction */
+    spi_delay_before();
+    sim_message(spi_target, out_buf, in_buf, &command_size, 1);
+    spi_delay_after();
+
+    DEBUG_MSG("Note: SPI write success\n");
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Simple read */
+int lgw_spi_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data) {
+    uint8_t out_buf[3];
+    uint8_t in_buf[ARRAY_SIZE(out_buf)];
+    uint16_t command_size;
+
+    /* check input variables */
+    CHECK_NULL(spi_target);
+    if ((address & 0x80) != 0) {
+        DEBUG_MSG("WARNING: SPI address > 127\n");
+    }
+    CHECK_NULL(data);
+
+    /* prepare frame to be sent */
+    if (spi_mux_mode == LGW_SPI_MUX_MODE1) {
+        out_buf[0] = spi_mux_target;
+        out_buf[1] = READ_ACCESS | (address & 0x7F);
+        out_buf[2] = 0x00;
+        command_size = 3;
+    } else {
+        out_buf[0] = READ_ACCESS | (address & 0x7F);
+        out_buf[1] = 0x00;
+        command_size = 2;
+    }
+
+    /* I/O transaction */
+    spi_delay_before();
+    sim_message(spi_target, out_buf, in_buf, &command_size, 1);
+    spi_delay_after();
+
+    DEBUG_MSG("Note: SPI read success\n");
+    *data = in_buf[command_size - 1];
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Burst (multiple-byte) write */
+int lgw_spi_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+    uint8_t *out_buf, *in_buf;
+    uint8_t command_size;
+    uint16_t len;
+
+    /* check input parameters */
+    CHECK_NULL(spi_target);
+    if ((address & 0x80) != 0) {
+        DEBUG_MSG("WARNING: SPI address > 127\n");
+    }
+    CHECK_NULL(data);
+    if (size == 0) {
+        DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+        return LGW_SPI_ERROR;
+    }
+
+    command_size = (spi_mux_mode == LGW_SPI_MUX_MODE1) ? 2 : 1;
+    len = command_size + size;
+    out_buf = malloc(2 * len);
+    if (out_buf == NULL) {
+        DEBUG_MSG("ERROR: MALLOC FAIL\n");
+        return LGW_SPI_ERROR;
+    }
+    in_buf = out_buf + len;
+
+    /* prepare command byte */
+    if (spi_mux_mode == LGW_SPI_MUX_MODE1) {
+        out_buf[0] = spi_mux_target;
+        out_buf[1] = WRITE_ACCESS | (address & 0x7F);
+    } else {
+        out_buf[0] = WRITE_ACCESS | (address & 0x7F);
+    }
+    memcpy(&out_buf[command_size], data, size);
+
+    /* I/O transaction, chip select held for the whole burst */
+    spi_delay_before();
+    sim_message(spi_target, out_buf, in_buf, &len, 1);
+    spi_delay_after();
+    free(out_buf);
+
+    DEBUG_MSG("Note: SPI burst write success\n");
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Burst (multiple-byte) read */
+int lgw_spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+    uint8_t *out_buf, *in_buf;
+    uint8_t command_size;
+    uint16_t len;
+
+    /* check input parameters */
+    CHECK_NULL(spi_target);
+    if ((address & 0x80) != 0) {
+        DEBUG_MSG("WARNING: SPI address > 127\n");
+    }
+    CHECK_NULL(data);
+    if (size == 0) {
+        DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+        return LGW_SPI_ERROR;
+    }
+
+    command_size = (spi_mux_mode == LGW_SPI_MUX_MODE1) ? 2 : 1;
+    len = command_size + size;
+    out_buf = calloc(2, len);
+    if (out_buf == NULL) {
+        DEBUG_MSG("ERROR: MALLOC FAIL\n");
+        return LGW_SPI_ERROR;
+    }
+    in_buf = out_buf + len;
+
+    /* prepare command byte */
+    if (spi_mux_mode == LGW_SPI_MUX_MODE1) {
+        out_buf[0] = spi_mux_target;
+        out_buf[1] = READ_ACCESS | (address & 0x7F);
+    } else {
+        out_buf[0] = READ_ACCESS | (address & 0x7F);
+    }
+
+    /* I/O transaction, chip select held for the whole burst */
+    spi_delay_before();
+    sim_message(spi_target, out_buf, in_buf, &len, 1);
+    spi_delay_after();
+    memcpy(data, &in_buf[command_size], size);
+    free(out_buf);
+
+    DEBUG_MSG("Note: SPI burst read success\n");
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Batch of accesses sent in a single SPI message */
+int lgw_spi_batch_init(struct lgw_spi_batch_s *batch, void *spi_target) {
+    /* check input variables */
+    CHECK_NULL(batch);
+    CHECK_NULL(spi_target);
+
+    batch->spi_target = spi_target;
+    batch->nb_op = 0;
+    batch->nb_byte = 0;
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_batch_w(struct lgw_spi_batch_s *batch, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t data) {
+    /* check input variables */
+    CHECK_NULL(batch);
+    if ((address & 0x80) != 0) {
+        DEBUG_MSG("WARNING: SPI address > 127\n");
+    }
+
+    return spi_batch_add(batch, spi_mux_mode, spi_mux_target, WRITE_ACCESS, address, &data, NULL, 1);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_batch_r(struct lgw_spi_batch_s *batch, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data) {
+    /* check input variables */
+    CHECK_NULL(batch);
+    if ((address & 0x80) != 0) {
+        DEBUG_MSG("WARNING: SPI address > 127\n");
+    }
+    CHECK_NULL(data);
+
+    return spi_batch_add(batch, spi_mux_mode, spi_mux_target, READ_ACCESS, address, NULL, data, 1);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_batch_wb(struct lgw_spi_batch_s *batch, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+    /* check input variables */
+    CHECK_NULL(batch);
+    if ((address & 0x80) != 0) {
+        DEBUG_MSG("WARNING: SPI address > 127\n");
+    }
+    CHECK_NULL(data);
+    if (size == 0) {
+        DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+        return LGW_SPI_ERROR;
+    }
+
+    /* bursts larger than a batch are sent on their own, in order */
+    if ((size + 2) > LGW_SPI_BATCH_SIZE) {
+        if (lgw_spi_batch_flush(batch) != LGW_SPI_SUCCESS) {
+            return LGW_SPI_ERROR;
+        }
+        return lgw_spi_wb(batch->spi_target, spi_mux_mode, spi_mux_target, address, data, size);
+    }
+
+    return spi_batch_add(batch, spi_mux_mode, spi_mux_target, WRITE_ACCESS, address, data, NULL, size);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_batch_rb(struct lgw_spi_batch_s *batch, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+    /* check input variables */
+    CHECK_NULL(batch);
+    if ((address & 0x80) != 0) {
+        DEBUG_MSG("WARNING: SPI address > 127\n");
+    }
+    CHECK_NULL(data);
+    if (size == 0) {
+        DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+        return LGW_SPI_ERROR;
+    }
+
+    /* bursts larger than a batch are sent on their own, in order */
+    if ((size + 2) > LGW_SPI_BATCH_SIZE) {
+        if (lgw_spi_batch_flush(batch) != LGW_SPI_SUCCESS) {
+            return LGW_SPI_ERROR;
+        }
+        return lgw_spi_rb(batch->spi_target, spi_mux_mode, spi_mux_target, address, data, size);
+    }
+
+    return spi_batch_add(batch, spi_mux_mode, spi_mux_target, READ_ACCESS, address, NULL, data, size);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_batch_flush(struct lgw_spi_batch_s *batch) {
+    int offset = 0;
+    int i;
+
+    /* check input variables */
+    CHECK_NULL(batch);
+    if (batch->nb_op == 0) {
+        return LGW_SPI_SUCCESS;
+    }
+    CHECK_NULL(batch->spi_target);
+
+    /* I/O transaction, one frame per access */
+    spi_delay_before();
+    sim_message(batch->spi_target, batch->tx_buf, batch->rx_buf, batch->op_len, batch->nb_op);
+    spi_delay_after();
+    DEBUG_PRINTF("BATCH: %u access(es), %u bytes\n", batch->nb_op, batch->nb_byte);
+
+    /* resolve reads */
+    for (i=0; i<batch->nb_op; ++i) {
+        if (batch->op_dest[i] != NULL) {
+            memcpy(batch->op_dest[i], &batch->rx_buf[offset + batch->op_cmd[i]], batch->op_len[i] - batch->op_cmd[i]);
+        }
+        offset += batch->op_len[i];
+    }
+
+    /* empty the batch */
+    batch->nb_op = 0;
+    batch->nb_byte = 0;
+
+    DEBUG_MSG("Note: SPI batch success\n");
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Simulator control */
+int lgw_sim_setconf(struct lgw_sim_conf_s *conf) {
+    int i;
+
+    if (conf == NULL) {
+        return LGW_SIM_ERROR;
+    }
+    if (conf->rx_rate < 0.0) {
+        DEBUG_PRINTF("ERROR: %f IS NOT A VALID RX RATE\n", conf->rx_rate);
+        return LGW_SIM_ERROR;
+    }
+
+    pthread_mutex_lock(&mx_sim);
+    sim_conf = *conf;
+    sim_conf_set = true;
+    for (i = 0; i < SIM_CHIP_NB; ++i) {
+        clock_gettime(CLOCK_MONOTONIC, &sim_chip[i].gen_t0); /* new rate applies from now on */
+        sim_chip[i].gen_nb = 0;
+    }
+    pthread_mutex_unlock(&mx_sim);
+    return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_inject(uint8_t if_chain, uint8_t sf, uint8_t size, const uint8_t *payload) {
+    bool a;
+
+    if (payload == NULL) {
+        return LGW_SIM_ERROR;
+    }
+
+    pthread_mutex_lock(&mx_sim);
+    sim = &sim_chip[0];
+    if (sim->agc_state != AGC_RUN) {
+        pthread_mutex_unlock(&mx_sim);
+        DEBUG_MSG("ERROR: CONCENTRATOR NOT STARTED, CANNOT INJECT PACKET\n");
+        return LGW_SIM_ERROR;
+    }
+    a = sim_rx_push(if_chain, sf, size, payload, sim_timestamp());
+    pthread_mutex_unlock(&mx_sim);
+    return a ? LGW_SIM_SUCCESS : LGW_SIM_ERROR;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_stats(struct lgw_sim_stats_s *stats) {
+    if (stats == NULL) {
+        return LGW_SIM_ERROR;
+    }
+
+    pthread_mutex_lock(&mx_sim);
+    *stats = sim_stats;
+    pthread_mutex_unlock(&mx_sim);
+    return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_stats_reset(void) {
+    pthread_mutex_lock(&mx_sim);
+    memset(&sim_stats, 0, sizeof sim_stats);
+    pthread_mutex_unlock(&mx_sim);
+    return LGW_SIM_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,481 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    TX scheduler queue.
+    Timestamped packets are queued in trigger time order and a background
+    thread programs each of them in the SX1301 TX buffer with lgw_send as soon
+    as the previous one is sent. Packets overlapping a queued one (time on air)
+    are rejected, and the outcome of each packet is reported to a callback.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#define _GNU_SOURCE     /* needed for pthread_setname_np to be defined */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf */
+#include <stdlib.h>     /* malloc free */
+#include <string.h>     /* memset memmove */
+#include <time.h>       /* clock_nanosleep */
+#include <pthread.h>
+
+#include "loragw_hal.h"
+#include "loragw_txq.h"
+#include "loragw_ctx.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#if DEBUG_TXQ == 1
+    #define DEBUG_MSG(str)              fprintf(stderr, str)
+    #define DEBUG_PRINTF(fmt, args...)  fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+    #define CHECK_NULL(a)               if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_TXQ_ERROR;}
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+    #define CHECK_NULL(a)               if(a==NULL){return LGW_TXQ_ERROR;}
+#endif
+
+/* timestamps wrap around every 72 minutes, compare them through their difference */
+#define TS_BEFORE(a, b)     ((int32_t)((a) - (b)) < 0)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct txq_entry_s {
+    struct lgw_pkt_tx_s pkt;
+    uint32_t            id;
+    uint32_t            duration_us;    /* time on air */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define TXQ_SIZE_MAX    1024    /* queue capacity upper bound, in packets */
+#define TXQ_RESULT_NB   8       /* outcomes reported per scheduler loop, at most */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+/* TX queue of one concentrator context */
+struct lgw_txq_state_s {
+    /* queue sorted by trigger time, the packet programmed in the TX buffer is kept aside */
+    struct txq_entry_s      *entry;
+    uint32_t                size;
+    uint32_t                nb;
+    struct txq_entry_s      prog;
+    bool                    prog_valid;
+
+    struct lgw_conf_txq_s   conf;
+    bool                    running;
+    pthread_t               thread;
+
+    /* protects the queue, the programmed packet and the counters; the scheduler sleeps on the condition while there is nothing to send */
+    pthread_mutex_t         mx;
+    pthread_cond_t          cond;
+
+    struct lgw_txq_stats_s  stats;
+};
+
+#define TXQ_STATE_INIT { \
+    .entry = NULL, \
+    .prog_valid = false, \
+    .running = false, \
+    .mx = PTHREAD_MUTEX_INITIALIZER, \
+    .cond = PTHREAD_COND_INITIALIZER \
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- INTERNAL SHARED VARIABLES -------------------------------------------- */
+
+struct lgw_txq_state_s lgw_txq_state_default = TXQ_STATE_INIT; /*! state of the default context */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static bool queue_overlap(const struct txq_entry_s *a, const struct txq_entry_s *b);
+
+static void queue_insert(const struct txq_entry_s *e);
+
+static void queue_pop(struct txq_entry_s *e);
+
+static void txq_result(struct lgw_txq_result_s *res, int *nb_res, const struct txq_entry_s *e, uint8_t status);
+
+static void *txq_scheduler(void *arg);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static bool queue_overlap(const struct txq_entry_s *a, const struct txq_entry_s *b) {
+    struct lgw_txq_state_s *txq = lgw_ctx_cur->txq;
+    int32_t dif = (int32_t)(b->pkt.count_us - a->pkt.count_us);
+
+    if (dif >= 0) {
+        return (uint32_t)dif < (a->duration_us + txq->conf.guard_us);
+    } else {
+        return (uint32_t)(-dif) < (b->duration_us + txq->conf.guard_us);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void queue_insert(const struct txq_entry_s *e) {
+    struct lgw_txq_state_s *txq = lgw_ctx_cur->txq;
+    uint32_t i = txq->nb;
+
+    /* few packets are queued at a time, a sorted array is enough */
+    while ((i > 0) && TS_BEFORE(e->pkt.count_us, txq->entry[i-1].pkt.count_us)) {
+        --i;
+    }
+    memmove(&txq->entry[i+1], &txq->entry[i], (txq->nb - i) * sizeof(struct txq_entry_s));
+    txq->entry[i] = *e;
+    txq->nb += 1;
+    if ((txq->nb + (txq->prog_valid ? 1 : 0)) > txq->stats.max_fill) {
+        txq->stats.max_fill = txq->nb + (txq->prog_valid ? 1 : 0);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void queue_pop(struct txq_entry_s *e) {
+    struct lgw_txq_state_s *txq = lgw_ctx_cur->txq;
+
+    *e = txq->entry[0];
+    txq->nb -= 1;
+    memmove(&txq->entry[0], &txq->entry[1], txq->nb * sizeof(struct txq_entry_s));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void txq_result(struct lgw_txq_result_s *res, int *nb_res, const struct txq_entry_s *e, uint8_t status) {
+    struct lgw_txq_state_s *txq = lgw_ctx_cur->txq;
+
+    switch (status) {
+        case LGW_TXQ_STATUS_SENT: txq->stats.nb_sent += 1; break;
+        case LGW_TXQ_STATUS_LATE: txq->stats.nb_late += 1; break;
+        case LGW_TXQ_STATUS_FAILED: txq->stats.nb_failed += 1; break;
+        default: break;
+    }
+    res[*nb_res].id = e->id;
+    res[*nb_res].count_us = e->pkt.count_us;
+    res[*nb_res].status = status;
+    *nb_res += 1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void *txq_scheduler(void *arg) {
+    struct lgw_ctx_s *ctx = arg; /* context of the thread that started this one */
+    struct lgw_txq_state_s *txq = ctx->txq;
+    struct lgw_txq_result_s res[TXQ_RESULT_NB];
+    struct txq_entry_s e;
+    struct lgw_pkt_tx_s pkt;
+    struct timespec pause;
+    uint32_t now;
+    int32_t dt;
+    uint8_t tx_status;
+    bool running, preempt, send, failed;
+    int nb_res;
+    int i;
+
+    pthread_setname_np(pthread_self(), "lgw_txq"); /* identifies its counters in loragw_perf */
+    lgw_ctx_bind(ctx);
+    pause.tv_sec = txq->conf.poll_us / 1000000;
+    pause.tv_nsec = (txq->conf.poll_us % 1000000) * 1000;
+
+    for (;;) {
+        pthread_mutex_lock(&txq->mx);
+        while (txq->running && (txq->nb == 0) && (txq->prog_valid == false)) {
+            pthread_cond_wait(&txq->cond, &txq->mx);
+        }
+        running = txq->running;
+        pthread_mutex_unlock(&txq->mx);
+        if (running == false) {
+            break;
+        }
+
+        if ((lgw_status(TX_STATUS, &tx_status) != LGW_HAL_SUCCESS) || (lgw_get_trigcnt(&now) != LGW_HAL_SUCCESS)) {
+            DEBUG_MSG("ERROR: FAILED TO GET TX STATUS\n");
+            clock_nanosleep(CLOCK_MONOTONIC, 0, &pause, NULL);
+            continue;
+        }
+
+        nb_res = 0;
+        preempt = false;
+        send = false;
+        pthread_mutex_lock(&txq->mx);
+
+        if (txq->prog_valid) {
+            if (tx_status == TX_FREE) {
+                txq->prog_valid = false;
+                txq_result(res, &nb_res, &txq->prog, LGW_TXQ_STATUS_SENT);
+            } else if ((tx_status == TX_SCHEDULED) && (txq->nb > 0) && TS_BEFORE(txq->entry[0].pkt.count_us, txq->prog.pkt.count_us) && ((int32_t)(txq->prog.pkt.count_us - now) > (int32_t)txq->conf.margin_us)) {
+                /* an earlier packet was queued after this one was programmed, and there is still time to swap them */
+                preempt = true;
+                txq->prog_valid = false;
+                queue_insert(&txq->prog);
+                txq->stats.nb_preempt += 1;
+                DEBUG_PRINTF("Note: TX of packet %u preempted\n", txq->prog.id);
+            }
+        }
+
+        /* drop the packets that cannot be programmed in time anymore, take the next one out of the queue if its trigger time is close */
+        while ((txq->prog_valid == false) && (txq->nb > 0) && (nb_res < TXQ_RESULT_NB)) {
+            dt = (int32_t)(txq->entry[0].pkt.count_us - now);
+            if (dt < (int32_t)txq->conf.margin_us) {
+                queue_pop(&e);
+                txq_result(res, &nb_res, &e, LGW_TXQ_STATUS_LATE);
+                DEBUG_PRINTF("WARNING: packet %u too late (%d us to its trigger time)\n", e.id, dt);
+            } else if (dt <= (int32_t)txq->conf.lead_us) {
+                queue_pop(&txq->prog);
+                txq->prog_valid = true; /* still checked for collisions by lgw_txq_enqueue while it is sent */
+                pkt = txq->prog.pkt;
+                send = true;
+            } else {
+                break;
+            }
+        }
+
+        pthread_mutex_unlock(&txq->mx);
+
+        /* the SPI accesses are done without the lock, so lgw_txq_enqueue and lgw_txq_pending do not wait for them */
+        if (preempt) {
+            lgw_abort_tx();
+        }
+        failed = false;
+        if (send && (lgw_send(pkt) != LGW_HAL_SUCCESS)) {
+            pthread_mutex_lock(&txq->mx);
+            txq->prog_valid = false;
+            txq_result(res, &nb_res, &txq->prog, LGW_TXQ_STATUS_FAILED);
+            pthread_mutex_unlock(&txq->mx);
+            failed = true;
+        }
+
+        /* outcomes are reported without the lock, so the callback can queue packets */
+        if (txq->conf.done != NULL) {
+            for (i = 0; i < nb_res; ++i) {
+                txq->conf.done(&res[i], txq->conf.arg);
+            }
+        }
+        if ((nb_res < TXQ_RESULT_NB) && (failed == false)) { /* after a failed send, try the next packet right away */
+            clock_nanosleep(CLOCK_MONOTONIC, 0, &pause, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int lgw_txq_start(struct lgw_conf_txq_s *conf) {
+    struct lgw_txq_state_s *txq = lgw_ctx_cur->txq;
+    struct lgw_conf_txq_s c = {LGW_TXQ_SIZE_DEFAULT, LGW_TXQ_POLL_DEFAULT, LGW_TXQ_LEAD_DEFAULT, LGW_TXQ_MARGIN_DEFAULT, LGW_TXQ_GUARD_DEFAULT, NULL, NULL};
+    int x;
+
+    if (txq->running) {
+        DEBUG_MSG("ERROR: TX SCHEDULER THREAD ALREADY RUNNING\n");
+        return LGW_TXQ_ERROR;
+    }
+    if (conf != NULL) {
+        c = *conf;
+    }
+    if ((c.size == 0) || (c.size > TXQ_SIZE_MAX)) {
+        DEBUG_PRINTF("ERROR: INVALID TX QUEUE SIZE %u\n", c.size);
+        return LGW_TXQ_ERROR;
+    }
+    if ((c.lead_us <= c.margin_us) || (c.lead_us > 0x7FFFFFFF)) {
+        DEBUG_MSG("ERROR: TX PROGRAMMING WINDOW MUST BE LARGER THAN THE MARGIN\n");
+        return LGW_TXQ_ERROR;
+    }
+
+    txq->entry = malloc(c.size * sizeof(struct txq_entry_s));
+    if (txq->entry == NULL) {
+        DEBUG_MSG("ERROR: FAILED TO ALLOCATE TX QUEUE\n");
+        return LGW_TXQ_ERROR;
+    }
+    txq->size = c.size;
+    txq->nb = 0;
+    txq->prog_valid = false;
+    txq->conf = c;
+    memset(&txq->stats, 0, sizeof txq->stats);
+
+    txq->running = true;
+    x = pthread_create(&txq->thread, NULL, txq_scheduler, lgw_ctx_cur);
+    if (x != 0) {
+        DEBUG_MSG("ERROR: FAILED TO CREATE TX SCHEDULER THREAD\n");
+        txq->running = false;
+        free(txq->entry);
+        txq->entry = NULL;
+        return LGW_TXQ_ERROR;
+    }
+
+    DEBUG_PRINTF("Note: TX scheduler started, queue of %u packets\n", txq->size);
+    return LGW_TXQ_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_txq_stop(void) {
+    struct lgw_txq_state_s *txq = lgw_ctx_cur->txq;
+    struct lgw_txq_result_s res;
+    uint8_t tx_status;
+    uint32_t i;
+
+    if (txq->running == false) {
+        DEBUG_MSG("ERROR: TX SCHEDULER THREAD NOT RUNNING\n");
+        return LGW_TXQ_ERROR;
+    }
+
+    pthread_mutex_lock(&txq->mx);
+    txq->running = false;
+    pthread_cond_signal(&txq->cond);
+    pthread_mutex_unlock(&txq->mx);
+    pthread_join(txq->thread, NULL);
+
+    /* a packet already being emitted is let go to its end */
+    if (txq->prog_valid) {
+        res.id = txq->prog.id;
+        res.count_us = txq->prog.pkt.count_us;
+        if ((lgw_status(TX_STATUS, &tx_status) == LGW_HAL_SUCCESS) && (tx_status == TX_SCHEDULED)) {
+            lgw_abort_tx();
+            res.status = LGW_TXQ_STATUS_FLUSHED;
+        } else {
+            res.status = LGW_TXQ_STATUS_SENT;
+            txq->stats.nb_sent += 1;
+        }
+        txq->prog_valid = false;
+        if (txq->conf.done != NULL) {
+            txq->conf.done(&res, txq->conf.arg);
+        }
+    }
+    for (i = 0; i < txq->nb; ++i) {
+        res.id = txq->entry[i].id;
+        res.count_us = txq->entry[i].pkt.count_us;
+        res.status = LGW_TXQ_STATUS_FLUSHED;
+        if (txq->conf.done != NULL) {
+            txq->conf.done(&res, txq->conf.arg);
+        }
+    }
+
+    pthread_mutex_lock(&txq->mx);
+    txq->nb = 0;
+    free(txq->entry);
+    txq->entry = NULL;
+    pthread_mutex_unlock(&txq->mx);
+
+    return LGW_TXQ_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_txq_enqueue(struct lgw_pkt_tx_s *pkt_data, uint32_t id) {
+    struct lgw_txq_state_s *txq = lgw_ctx_cur->txq;
+    struct txq_entry_s e;
+    uint32_t i;
+
+    CHECK_NULL(pkt_data);
+    if (pkt_data->tx_mode != TIMESTAMPED) {
+        DEBUG_MSG("ERROR: ONLY TIMESTAMPED PACKETS CAN BE QUEUED\n");
+        return LGW_TXQ_ERROR;
+    }
+    if (pkt_data->size > sizeof pkt_data->payload) {
+        DEBUG_MSG("ERROR: PAYLOAD LENGTH TOO BIG\n");
+        return LGW_TXQ_ERROR;
+    }
+
+    e.pkt = *pkt_data;
+    e.id = id;
+    e.duration_us = lgw_time_on_air_us(pkt_data);
+    if (e.duration_us == 0) {
+        DEBUG_MSG("ERROR: CANNOT COMPUTE TIME ON AIR OF THE PACKET\n");
+        return LGW_TXQ_ERROR;
+    }
+
+    pthread_mutex_lock(&txq->mx);
+    if (txq->running == false) {
+        pthread_mutex_unlock(&txq->mx);
+        DEBUG_MSG("ERROR: TX SCHEDULER THREAD NOT RUNNING\n");
+        return LGW_TXQ_ERROR;
+    }
+    if ((txq->nb + (txq->prog_valid ? 1 : 0)) >= txq->size) {
+        pthread_mutex_unlock(&txq->mx);
+        DEBUG_MSG("ERROR: TX QUEUE FULL\n");
+        return LGW_TXQ_ERROR;
+    }
+    for (i = 0; i < txq->nb; ++i) {
+        if (queue_overlap(&txq->entry[i], &e)) {
+            break;
+        }
+    }
+    if ((i < txq->nb) || (txq->prog_valid && queue_overlap(&txq->prog, &e))) {
+        txq->stats.nb_collision += 1;
+        pthread_mutex_unlock(&txq->mx);
+        DEBUG_PRINTF("WARNING: packet %u collides with a queued packet\n", id);
+        return LGW_TXQ_COLLISION;
+    }
+    queue_insert(&e);
+    txq->stats.nb_queued += 1;
+    pthread_cond_signal(&txq->cond);
+    pthread_mutex_unlock(&txq->mx);
+
+    return LGW_TXQ_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_txq_pending(void) {
+    struct lgw_txq_state_s *txq = lgw_ctx_cur->txq;
+    int nb;
+
+    pthread_mutex_lock(&txq->mx);
+    nb = txq->nb + (txq->prog_valid ? 1 : 0);
+    pthread_mutex_unlock(&txq->mx);
+    return nb;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_txq_stats(struct lgw_txq_stats_s *stats) {
+    struct lgw_txq_state_s *txq = lgw_ctx_cur->txq;
+
+    CHECK_NULL(stats);
+
+    pthread_mutex_lock(&txq->mx);
+    *stats = txq->stats;
+    pthread_mutex_unlock(&txq->mx);
+    return LGW_TXQ_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+struct lgw_txq_state_s *lgw_txq_state_new(void) {
+    struct lgw_txq_state_s *state;
+
+    state = malloc(sizeof *state);
+    if (state == NULL) {
+        return NULL;
+    }
+    *state = (struct lgw_txq_state_s)TXQ_STATE_INIT;
+    return state;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_txq_state_free(struct lgw_txq_state_s *state) {
+    free(state);
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,343 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Replay harness for the clock error estimators of lgw_gps_sync
+    Without argument, replays synthetic time pulse traces (known clock error,
+    counter quantization, outliers, missing pulses, counter wraps) through each
+    estimator and checks their accuracy, their uncertainty and the independence
+    of the references.
+    With a trace file recorded by test_loragw_gps (-t option), replays it and
+    prints the accuracy of each estimator.
+    No concentrator nor GPS receiver is needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fopen fgets */
+#include <stdlib.h>     /* EXIT_* rand */
+#include <string.h>     /* memcmp */
+#include <math.h>       /* sqrt fabs floor log sin cos */
+
+#include "loragw_gps.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define TRACE_MAX       20000   /* time pulses in a trace */
+#define TRACE_DURATION  14400   /* seconds of a synthetic trace, the counter wraps 3 times */
+#define HORIZON         128     /* seconds between a synchronization and the use of the reference (Class B beacon period) */
+#define WARMUP          120     /* seconds not evaluated at the start of a trace */
+#define GPS_UTC_OFFSET  (315964800 - 18)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* time pulse, with the exact counter value when the trace is synthetic */
+struct pulse_s {
+    uint32_t        count_us;
+    struct timespec utc;
+    struct timespec gps;
+    double          true_cnt;   /* exact counter value, modulo 2^32 */
+    double          true_xtal;  /* exact clock error */
+    bool            outlier;
+};
+
+/* accuracy of an estimator on a trace */
+struct result_s {
+    int     nb_eval;
+    int     nb_rejected;
+    int     nb_outlier;     /* outliers rejected */
+    int     nb_in_3sigma;   /* clock error within 3 estimated standard deviations */
+    double  rms_us;         /* error of the counter value predicted HORIZON seconds ahead */
+    double  max_us;
+    double  xtal_rms_ppm;   /* error of the clock error */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static struct pulse_s trace[TRACE_MAX];
+static int trace_size;
+static int trace_index[TRACE_DURATION + 1]; /* pulse of each second of a synthetic trace, -1 if missing */
+static bool synthetic = true;
+
+static const struct {
+    const char *name;
+    struct lgw_conf_drift_s conf;
+} estimator[] = {
+    {"slope", {LGW_DRIFT_SLOPE, 0.0, 0.0, 0.0}},
+    {"kalman", {LGW_DRIFT_KALMAN, 0.0, 0.0, 0.0}},
+    {"pll", {LGW_DRIFT_PLL, 0.0, 0.0, 0.0}}
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static double gauss(void) {
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0), v = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Synthetic trace: clock error with an offset, a temperature cycle and a random
+walk; the counter is latched at each time pulse (30 ns jitter) and truncated to
+the microsecond; some pulses are missing (and a 10 minutes outage), some
+latched values are wrong
+*/
+static void trace_make(unsigned seed) {
+    double cnt, xtal, walk = 0.0, offset;
+    int t;
+
+    srand(seed);
+    offset = ((double)rand() / RAND_MAX - 0.5) * 8E-6;
+    cnt = (double)(rand() % 4000) * 1E6;
+    trace_size = 0;
+    for (t = 0; t <= TRACE_DURATION; ++t) {
+        walk += 0.002E-6 * gauss();
+        xtal = 1.0 + offset + 0.5E-6 * sin(2.0 * M_PI * t / 3600.0) + walk;
+        if (t > 0) {
+            cnt += 1E6 * xtal;
+        }
+        if (cnt >= 4294967296.0) {
+            cnt -= 4294967296.0;
+        }
+        trace_index[t] = -1;
+        if (((rand() % 100) == 0) || ((t > 5000) && (t < 5600))) {
+            continue;
+        }
+        trace_index[t] = trace_size;
+        trace[trace_size].true_cnt = cnt;
+        trace[trace_size].true_xtal = xtal;
+        trace[trace_size].count_us = (uint32_t)(int64_t)floor(cnt + 0.03 * gauss());
+        trace[trace_size].outlier = ((rand() % 200) == 0);
+        if (trace[trace_size].outlier) {
+            trace[trace_size].count_us += (uint32_t)((rand() % 2) ? 1 : -1) * (uint32_t)(20 + rand() % 2000);
+        }
+        trace[trace_size].utc.tv_sec = 1500000000 + t;
+        trace[trace_size].utc.tv_nsec = 0;
+        trace[trace_size].gps.tv_sec = 1500000000 + t - GPS_UTC_OFFSET;
+        trace[trace_size].gps.tv_nsec = 0;
+        ++trace_size;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* trace recorded by test_loragw_gps: count_us utc_sec utc_nsec gps_sec gps_nsec per line */
+static int trace_read(const char *name) {
+    FILE *f;
+    char line[128];
+    unsigned long cnt;
+    long long us, gs;
+    long un, gn;
+    int t;
+
+    f = fopen(name, "r");
+    if (f == NULL) {
+        printf("ERROR: impossible to open %s\n", name);
+        return -1;
+    }
+    trace_size = 0;
+    while ((fgets(line, sizeof line, f) != NULL) && (trace_size < TRACE_MAX)) {
+        if (sscanf(line, "%lu %lld %ld %lld %ld", &cnt, &us, &un, &gs, &gn) != 5) {
+            continue;
+        }
+        trace[trace_size].count_us = (uint32_t)cnt;
+        trace[trace_size].utc.tv_sec = (time_t)us;
+        trace[trace_size].utc.tv_nsec = un;
+        trace[trace_size].gps.tv_sec = (time_t)gs;
+        trace[trace_size].gps.tv_nsec = gn;
+        trace[trace_size].outlier = false;
+        ++trace_size;
+    }
+    fclose(f);
+
+    /* the recorded latched values are the reference of the predictions */
+    for (t = 0; t <= TRACE_DURATION; ++t) {
+        trace_index[t] = -1;
+    }
+    for (t = 0; t < trace_size; ++t) {
+        us = (long long)(trace[t].utc.tv_sec - trace[0].utc.tv_sec);
+        if ((us >= 0) && (us <= TRACE_DURATION)) {
+            trace_index[us] = t;
+        }
+        trace[t].true_cnt = trace[t].count_us;
+        trace[t].true_xtal = 0.0;
+    }
+    synthetic = false;
+    return trace_size;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* synchronize on each pulse of the trace, predict the counter value HORIZON seconds later */
+static void replay(const struct lgw_conf_drift_s *conf, struct result_s *r) {
+    struct tref ref;
+    struct timespec t;
+    uint32_t cnt;
+    double err, sum = 0.0, sum_xtal = 0.0;
+    int i, k;
+    long long sec;
+
+    memset(&ref, 0, sizeof ref);
+    memset(r, 0, sizeof *r);
+    lgw_gps_sync_setconf(&ref, conf);
+    for (i = 0; i < trace_size; ++i) {
+        if (lgw_gps_sync(&ref, trace[i].count_us, trace[i].utc, trace[i].gps) != LGW_GPS_SUCCESS) {
+            ++r->nb_rejected;
+            r->nb_outlier += trace[i].outlier ? 1 : 0;
+        }
+        sec = (long long)(trace[i].utc.tv_sec - trace[0].utc.tv_sec);
+        if ((sec < WARMUP) || (sec + HORIZON > TRACE_DURATION) || ((k = trace_index[sec + HORIZON]) < 0) || trace[k].outlier) {
+            continue;
+        }
+        t = trace[k].utc;
+        if (lgw_utc2cnt(ref, t, &cnt) != LGW_GPS_SUCCESS) {
+            continue;
+        }
+        err = (double)(int32_t)(cnt - (uint32_t)(int64_t)floor(trace[k].true_cnt)) - (trace[k].true_cnt - floor(trace[k].true_cnt));
+        ++r->nb_eval;
+        sum += err * err;
+        r->max_us = (fabs(err) > r->max_us) ? fabs(err) : r->max_us;
+        if (synthetic) {
+            err = ref.xtal_err - trace[i].true_xtal;
+            sum_xtal += err * err;
+            r->nb_in_3sigma += (fabs(err) <= 3.0 * ref.xtal_err_std) ? 1 : 0;
+        }
+    }
+    if (r->nb_eval > 0) {
+        r->rms_us = sqrt(sum / r->nb_eval);
+        r->xtal_rms_ppm = 1E6 * sqrt(sum_xtal / r->nb_eval);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void result_print(const char *name, const struct result_s *r) {
+    printf("  %-8s %6d points, %4d rejected, error at %d s: %8.3f us rms %9.3f us max", name, r->nb_eval, r->nb_rejected, HORIZON, r->rms_us, r->max_us);
+    if (synthetic) {
+        printf(", clock error %.4f ppm rms, %.1f%% within 3 sigma", r->xtal_rms_ppm, 100.0 * r->nb_in_3sigma / r->nb_eval);
+    }
+    printf("\n");
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    struct result_s r[ARRAY_SIZE(estimator)];
+    struct tref ref_a, ref_b, ref_c;
+    struct pulse_s trace_b[64];
+    int nb_outlier = 0;
+    int nb_err = 0;
+    unsigned seed;
+    int i, k;
+
+    printf("Beginning of test for the clock error estimators\n");
+
+    /* recorded trace */
+    if (argc > 1) {
+        if (trace_read(argv[1]) <= 0) {
+            return EXIT_FAILURE;
+        }
+        printf("%s: %d time pulses\n", argv[1], trace_size);
+        for (k = 0; k < (int)ARRAY_SIZE(estimator); ++k) {
+            replay(&estimator[k].conf, &r[k]);
+            result_print(estimator[k].name, &r[k]);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    /* synthetic traces */
+    for (seed = 1; seed <= 4; ++seed) {
+        trace_make(seed);
+        for (i = 0, nb_outlier = 0; i < trace_size; ++i) {
+            nb_outlier += trace[i].outlier ? 1 : 0;
+        }
+        printf("Trace %u: %d time pulses, %d outliers\n", seed, trace_size, nb_outlier);
+        for (k = 0; k < (int)ARRAY_SIZE(estimator); ++k) {
+            replay(&estimator[k].conf, &r[k]);
+            result_print(estimator[k].name, &r[k]);
+        }
+
+        /* the filters must be much more accurate than the slope, the Kalman filter must know its uncertainty */
+        if ((r[1].rms_us > r[0].rms_us / 4) || (r[2].rms_us > r[0].rms_us / 2) || (r[1].max_us > r[0].max_us) || (r[2].max_us > r[0].max_us)) {
+            printf("ERROR: filtered estimates not more accurate than the slope\n");
+            ++nb_err;
+        }
+        if (r[1].nb_in_3sigma < 0.95 * r[1].nb_eval) {
+            printf("ERROR: estimated uncertainty of the Kalman filter too low\n");
+            ++nb_err;
+        }
+        if ((r[1].nb_outlier < nb_outlier * 9 / 10) || (r[2].nb_outlier < nb_outlier * 9 / 10)) {
+            printf("ERROR: outliers not rejected by the filters\n");
+            ++nb_err;
+        }
+    }
+
+    /* the state is in the reference: interleaved references give the same results as separate ones */
+    trace_make(5);
+    memcpy(trace_b, trace + 1000, sizeof trace_b);
+    memset(&ref_a, 0, sizeof ref_a);
+    memset(&ref_b, 0, sizeof ref_b);
+    memset(&ref_c, 0, sizeof ref_c);
+    lgw_gps_sync_setconf(&ref_a, &estimator[1].conf);
+    lgw_gps_sync_setconf(&ref_b, &estimator[1].conf);
+    lgw_gps_sync_setconf(&ref_c, &estimator[1].conf);
+    for (i = 0; i < (int)ARRAY_SIZE(trace_b); ++i) {
+        lgw_gps_sync(&ref_a, trace[i].count_us, trace[i].utc, trace[i].gps);
+        lgw_gps_sync(&ref_b, trace_b[i].count_us, trace_b[i].utc, trace_b[i].gps);
+    }
+    for (i = 0; i < (int)ARRAY_SIZE(trace_b); ++i) {
+        lgw_gps_sync(&ref_c, trace[i].count_us, trace[i].utc, trace[i].gps);
+    }
+    if ((ref_a.count_us != ref_c.count_us) || (ref_a.utc.tv_nsec != ref_c.utc.tv_nsec) || (ref_a.xtal_err != ref_c.xtal_err) ||
+        (memcmp(&ref_a.drift, &ref_c.drift, sizeof ref_a.drift) != 0)) {
+        printf("ERROR: interleaved references interfere\n");
+        ++nb_err;
+    }
+
+    /* invalid configurations */
+    {
+        struct lgw_conf_drift_s conf = {LGW_DRIFT_KALMAN, -1.0, 0.0, 0.0};
+
+        if (lgw_gps_sync_setconf(&ref_a, &conf) != LGW_GPS_ERROR) {
+            printf("ERROR: negative measurement noise accepted\n");
+            ++nb_err;
+        }
+    }
+
+    printf("End of test for the clock error estimators, %d error(s)\n", nb_err);
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -26,11 +26,11 @@ Maintainer: Michael Coracin
 
 #include <stdint.h>     /* C99 types */
 #include <stdbool.h>    /* bool type */
-#include <stdio.h>      /* printf */
+#include <stdio.h>      /* printf fopen fprintf */
 #include <string.h>     /* memset */
 #include <signal.h>     /* sigaction */
 #include <stdlib.h>     /* exit */
-#include <unistd.h>     /* read */
+#include <unistd.h>     /* getopt */
 
 #include "loragw_hal.h"
 #include "loragw_gps.h"
@@ -42,12 +42,15 @@ Maintainer: Michael Coracin
 static int exit_sig = 0; /* 1 -> application terminates cleanly (shut down hardware, close open files, etc) */
 static int quit_sig = 0; /* 1 -> application terminates without shutting down the hardware */
 
-struct tref ppm_ref;
+static struct lgw_tref_pub_s ppm_ref; /* time reference published to the conversion functions */
+
+static FILE *trace_file = NULL; /* synchronization points, for test_loragw_drift */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
 
 static void sig_handler(int sigio);
+static void usage(void);
 static void gps_process_sync(void);
 static void gps_process_coords(void);
 
@@ -62,6 +65,14 @@ static void sig_handler(int sigio) {
     }
 }
 
+/* describe command line options */
+static void usage(void) {
+    printf("Library version information: %s\n", lgw_version_info());
+    printf( "Available options:\n");
+    printf( " -h print this help\n");
+    printf( " -t <file> record the synchronization points in a trace file for test_loragw_drift\n");
+}
+
 static void gps_process_sync(void) {
     /* variables for PPM pulse GPS synchronization */
     uint32_t ppm_tstamp;
@@ -69,6 +80,7 @@ static void gps_process_sync(void) {
     struct timespec ppm_utc;
 
     /* variables for timestamp <-> GPS time conversions */
+    struct tref ref;
     uint32_t x, z;
     struct timespec y;
 
@@ -86,32 +98,39 @@ static void gps_process_sync(void) {
         return;
     }
 
+    /* record the synchronization point */
+    if (trace_file != NULL) {
+        fprintf(trace_file, "%u %lld %ld %lld %ld\n", ppm_tstamp, (long long)ppm_utc.tv_sec, ppm_utc.tv_nsec, (long long)ppm_gps.tv_sec, ppm_gps.tv_nsec);
+        fflush(trace_file);
+    }
+
     /* try to update synchronize time reference with the new GPS & timestamp */
-    i = lgw_gps_sync(&ppm_ref, ppm_tstamp, ppm_utc, ppm_gps);
+    i = lgw_tref_sync(&ppm_ref, ppm_tstamp, ppm_utc, ppm_gps);
     if (i != LGW_GPS_SUCCESS) {
         printf("    Synchronization error.\n");
         return;
     }
+    lgw_tref_get(&ppm_ref, &ref);
 
     /* display result */
     printf("    * Synchronization successful *\n");
-    printf("    UTC reference time: %lld.%09ld\n", (long long)ppm_ref.utc.tv_sec, ppm_ref.utc.tv_nsec);
-    printf("    GPS reference time: %lld.%09ld\n", (long long)ppm_ref.gps.tv_sec, ppm_ref.gps.tv_nsec);
-    printf("    Internal counter reference value: %u\n", ppm_ref.count_us);
-    printf("    Clock error: %.9f\n", ppm_ref.xtal_err);
+    printf("    UTC reference time: %lld.%09ld\n", (long long)ref.utc.tv_sec, ref.utc.tv_nsec);
+    printf("    GPS reference time: %lld.%09ld\n", (long long)ref.gps.tv_sec, ref.gps.tv_nsec);
+    printf("    Internal counter reference value: %u\n", ref.count_us);
+    printf("    Clock error: %.9f\n", ref.xtal_err);
 
     x = ppm_tstamp + 500000;
     printf("    * Test of timestamp counter <-> GPS value conversion *\n");
     printf("    Test value: %u\n", x);
-    lgw_cnt2gps(ppm_ref, x, &y);
+    lgw_cnt2gps(ref, x, &y);
     printf("    Conversion to GPS: %lld.%09ld\n", (long long)y.tv_sec, y.tv_nsec);
-    lgw_gps2cnt(ppm_ref, y, &z);
+    lgw_gps2cnt(ref, y, &z);
     printf("    Converted back: %u ==> %dµs\n", z, (int32_t)(z-x));
     printf("    * Test of timestamp counter <-> UTC value conversion *\n");
     printf("    Test value: %u\n", x);
-    lgw_cnt2utc(ppm_ref, x, &y);
+    lgw_cnt2utc(ref, x, &y);
     printf("    Conversion to UTC: %lld.%09ld\n", (long long)y.tv_sec, y.tv_nsec);
-    lgw_utc2cnt(ppm_ref, y, &z);
+    lgw_utc2cnt(ref, y, &z);
     printf("    Converted back: %u ==> %dµs\n", z, (int32_t)(z-x));
 }
 
@@ -131,7 +150,7 @@ static void gps_process_coords(void) {
 /* -------------------------------------------------------------------------- */
 /* --- MAIN FUNCTION -------------------------------------------------------- */
 
-int main()
+int main(int argc, char **argv)
 {
     struct sigaction sigact; /* SIGQUIT&SIGINT&SIGTERM signal handling */
 
@@ -142,13 +161,33 @@ int main()
     struct lgw_conf_rxrf_s rfconf;
 
     /* serial variables */
-    char serial_buff[128]; /* buffer to receive GPS data */
-    size_t wr_idx = 0;     /* pointer to end of chars in buffer */
+    static struct lgw_gps_stream_s gps_stream; /* reassembles the GPS frames across reads */
     int gps_tty_dev; /* file descriptor to the serial port of the GNSS module */
 
     /* NMEA/UBX variables */
     enum gps_msg latest_msg; /* keep track of latest NMEA/UBX message parsed */
 
+    /* parse command line options */
+    while ((i = getopt (argc, argv, "ht:")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return -1;
+                break;
+            case 't': /* <file> trace of the synchronization points */
+                trace_file = fopen(optarg, "w");
+                if (trace_file == NULL) {
+                    printf("ERROR: impossible to create trace file %s\n", optarg);
+                    return -1;
+                }
+                break;
+            default:
+                printf("ERROR: argument parsing\n");
+                usage();
+                return -1;
+        }
+    }
+
     /* configure signal handling */
     sigemptyset(&sigact.sa_mask);
     sigact.sa_flags = 0;
@@ -187,91 +226,29 @@ int main()
     lgw_start();
 
     /* initialize some variables before loop */
-    memset(serial_buff, 0, sizeof serial_buff);
-    memset(&ppm_ref, 0, sizeof ppm_ref);
+    lgw_gps_stream_init(&gps_stream);
+    lgw_tref_init(&ppm_ref);
 
     /* loop until user action */
     while ((quit_sig != 1) && (exit_sig != 1)) {
-        size_t rd_idx = 0;
-        size_t frame_end_idx = 0;
-
         /* blocking non-canonical read on serial port */
-        ssize_t nb_char = read(gps_tty_dev, serial_buff + wr_idx, LGW_GPS_MIN_MSG_SIZE);
+        ssize_t nb_char = lgw_gps_stream_read(&gps_stream, gps_tty_dev);
         if (nb_char <= 0) {
-            printf("WARNING: [gps] read() returned value %d\n", nb_char);
+            printf("WARNING: [gps] read() returned value %d\n", (int)nb_char);
             continue;
         }
-        wr_idx += (size_t)nb_char;
-
-        /*******************************************
-         * Scan buffer for UBX/NMEA sync chars and *
-         * attempt to decode frame if one is found *
-         *******************************************/
-        while (rd_idx < wr_idx) {
-            size_t frame_size = 0;
-
-            /* Scan buffer for UBX sync char */
-            if (serial_buff[rd_idx] == LGW_GPS_UBX_SYNC_CHAR) {
-
-                /***********************
-                 * Found UBX sync char *
-                 ***********************/
-                latest_msg = lgw_parse_ubx(&serial_buff[rd_idx], (wr_idx - rd_idx), &frame_size);
-
-                if (frame_size > 0) {
-                    if (latest_msg == INCOMPLETE) {
-                        /* UBX header found but frame appears to be missing bytes */
-                        frame_size = 0;
-                    } else if (latest_msg == INVALID) {
-                        /* message header received but message appears to be corrupted */
-                        printf("WARNING: [gps] could not get a valid message from GPS (no time)\n");
-                        frame_size = 0;
-                    } else if (latest_msg == UBX_NAV_TIMEGPS) {
-                        printf("\n~~ UBX NAV-TIMEGPS sentence, triggering synchronization attempt ~~\n");
-                        gps_process_sync();
-                    }
-                }
-            } else if(serial_buff[rd_idx] == LGW_GPS_NMEA_SYNC_CHAR) {
-                /************************
-                 * Found NMEA sync char *
-                 ************************/
-                /* scan for NMEA end marker (LF = 0x0a) */
-                char* nmea_end_ptr = memchr(&serial_buff[rd_idx],(int)0x0a, (wr_idx - rd_idx));
-
-                if (nmea_end_ptr) {
-                    /* found end marker */
-                    frame_size = nmea_end_ptr - &serial_buff[rd_idx] + 1;
-                    latest_msg = lgw_parse_nmea(&serial_buff[rd_idx], frame_size);
-
-                    if(latest_msg == INVALID || latest_msg == UNKNOWN) {
-                        /* checksum failed */
-                        frame_size = 0;
-                    } else if (latest_msg == NMEA_RMC) { /* Get location from RMC frames */
-                        gps_process_coords();
-                    }
-                }
-            }
 
-            if (frame_size > 0) {
-                /* At this point message is a checksum verified frame
-                   we're processed or ignored. Remove frame from buffer */
-                rd_idx += frame_size;
-                frame_end_idx = rd_idx;
-            } else {
-                rd_idx++;
+        /* decode all the frames completed by that read */
+        while ((latest_msg = lgw_gps_stream_next(&gps_stream)) != UNKNOWN) {
+            if (latest_msg == INVALID) {
+                /* message header received but message appears to be corrupted */
+                printf("WARNING: [gps] could not get a valid message from GPS (no time)\n");
+            } else if (latest_msg == UBX_NAV_TIMEGPS) {
+                printf("\n~~ UBX NAV-TIMEGPS sentence, triggering synchronization attempt ~~\n");
+                gps_process_sync();
+            } else if (latest_msg == NMEA_RMC) { /* Get location from RMC frames */
+                gps_process_coords();
             }
-        } /* ...for(rd_idx = 0... */
-
-        if (frame_end_idx) {
-          /* Frames have been processed. Remove bytes to end of last processed frame */
-          memcpy(serial_buff,&serial_buff[frame_end_idx],wr_idx - frame_end_idx);
-          wr_idx -= frame_end_idx;
-        } /* ...for(rd_idx = 0... */
-
-        /* Prevent buffer overflow */
-        if ((sizeof(serial_buff) - wr_idx) < LGW_GPS_MIN_MSG_SIZE) {
-            memcpy(serial_buff,&serial_buff[LGW_GPS_MIN_MSG_SIZE],wr_idx - LGW_GPS_MIN_MSG_SIZE);
-            wr_idx -= LGW_GPS_MIN_MSG_SIZE;
         }
     }
 
@@ -280,6 +257,9 @@ int main()
         lgw_gps_disable(gps_tty_dev);
         lgw_stop();
     }
+    if (trace_file != NULL) {
+        fclose(trace_file);
+    }
 
     printf("\nEnd of test for loragw_gps.c\n");
     exit(EXIT_SUCCESS);
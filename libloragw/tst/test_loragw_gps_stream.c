@@ -0,0 +1,436 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Minimum test program for the GPS stream parser
+    Checks the NMEA decoding against sscanf, then feeds a generated stream of
+    NMEA sentences, UBX frames, noise and corrupted frames to lgw_gps_stream_*
+    in chunks of random sizes, and checks it gives the same results as framing
+    each message and calling lgw_parse_nmea/lgw_parse_ubx. Finally measures the
+    parsing speed. No GPS module is needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf sprintf sscanf */
+#include <stdlib.h>     /* EXIT_* rand */
+#include <string.h>     /* memset memcpy memchr */
+#include <time.h>       /* clock_gettime mktime */
+
+#include "loragw_gps.h"
+#include "test_loragw_util.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NB_MSG          2000    /* messages in the generated stream */
+#define NB_CHUNKING     50      /* ways of cutting the stream in reads */
+#define NB_PRELUDE      3       /* messages that set the parser state at the start of the stream */
+#define BENCH_SIZE      (1 << 20)
+#define BENCH_NB_LOOP   20
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* what lgw_gps_get returns after a message is parsed */
+struct result_s {
+    enum gps_msg    type;
+    int             ret_time;
+    struct timespec utc;
+    struct timespec gps;
+    int             ret_pos;
+    struct coord_s  loc;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static uint8_t stream_buf[NB_MSG * 300];
+static size_t stream_size;
+static size_t msg_start[NB_MSG], msg_size[NB_MSG];
+static bool msg_valid[NB_MSG];
+static int nb_msg;
+
+static struct result_s ref_res[NB_MSG], res[NB_MSG];
+static uint8_t bench_buf[BENCH_SIZE];
+
+static struct lgw_gps_stream_s stream;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* add $, checksum and CR LF around a NMEA sentence body, return the frame size */
+static size_t nmea_make(uint8_t *buf, const char *body) {
+    uint8_t ck = 0;
+    const char *p;
+
+    for (p = body; *p != 0; ++p) {
+        ck ^= (uint8_t)*p;
+    }
+    return (size_t)sprintf((char *)buf, "$%s*%02X\r\n", body, ck);
+}
+
+/* add sync chars, header and checksum around a UBX payload, return the frame size */
+static size_t ubx_make(uint8_t *buf, uint8_t cls, uint8_t id, const uint8_t *payload, uint16_t len) {
+    uint8_t ck_a = 0, ck_b = 0;
+    int i;
+
+    buf[0] = 0xB5;
+    buf[1] = 0x62;
+    buf[2] = cls;
+    buf[3] = id;
+    buf[4] = (uint8_t)len;
+    buf[5] = (uint8_t)(len >> 8);
+    memcpy(buf + 6, payload, len);
+    for (i = 2; i < 6 + len; ++i) {
+        ck_a += buf[i];
+        ck_b += ck_a;
+    }
+    buf[6 + len] = ck_a;
+    buf[7 + len] = ck_b;
+    return 8 + len;
+}
+
+/* message of the given kind (random if negative), return its size; *valid is false if it was corrupted */
+static size_t msg_make(uint8_t *buf, int kind, bool *valid) {
+    char body[200];
+    uint8_t payload[200];
+    size_t size;
+    int i, k;
+
+    switch ((kind < 0) ? rand() % 8 : kind) {
+        case 0:
+        case 1:
+            sprintf(body, "G%cRMC,%02d%02d%02d.%02d,%c,4717.11437,N,00833.91522,E,0.004,77.52,%02d%02d%02d,,,%c", (rand() % 2) ? 'P' : 'N',
+                    rand() % 24, rand() % 60, rand() % 60, rand() % 100, (rand() % 4) ? 'A' : 'V', 1 + rand() % 28, 1 + rand() % 12, rand() % 100, (rand() % 4) ? 'A' : 'N');
+            size = nmea_make(buf, body);
+            break;
+        case 2:
+            sprintf(body, "GPGGA,092725.00,%02d%02d.%05d,%c,%03d%02d.%05d,%c,1,%02d,1.01,%d.%d,M,48.0,M,,", rand() % 90, rand() % 60, rand() % 100000, (rand() % 2) ? 'N' : 'S',
+                    rand() % 180, rand() % 60, rand() % 100000, (rand() % 2) ? 'E' : 'W', rand() % 20, rand() % 3000 - 100, rand() % 10);
+            size = nmea_make(buf, body);
+            break;
+        case 3:
+            size = nmea_make(buf, "GPGSV,3,1,11,03,03,111,00,04,15,270,00,06,01,010,00,13,06,292,00");
+            break;
+        case 4:
+        case 5: /* NAV-TIMEGPS */
+            for (i = 0; i < 16; ++i) {
+                payload[i] = (uint8_t)(rand() % 0x60); /* no sync char */
+            }
+            payload[11] = (rand() % 4) ? 0x07 : 0x04; /* valid flags */
+            size = ubx_make(buf, 0x01, 0x20, payload, 16);
+            break;
+        case 6: /* ACK-ACK */
+            payload[0] = 0x06;
+            payload[1] = 0x01;
+            size = ubx_make(buf, 0x05, 0x01, payload, 2);
+            break;
+        default: /* long message, not decoded */
+            k = 20 + rand() % 180;
+            for (i = 0; i < k; ++i) {
+                payload[i] = (uint8_t)(rand() % 0x60);
+            }
+            size = ubx_make(buf, 0x01, 0x35, payload, k);
+    }
+
+    /* corrupt one byte of the payload or of the sentence after its label */
+    *valid = true;
+    if ((kind < 0) && (rand() % 16 == 0)) {
+        if (buf[0] == LGW_GPS_UBX_SYNC_CHAR) {
+            buf[6 + rand() % (size - 8)] ^= 0x01;
+        } else {
+            buf[6 + rand() % (size - 11)] ^= 0x01;
+        }
+        *valid = false;
+    }
+    return size;
+}
+
+static void get_result(enum gps_msg type, struct result_s *r) {
+    memset(r, 0, sizeof *r);
+    r->type = type;
+    r->ret_time = lgw_gps_get(&r->utc, &r->gps, NULL, NULL);
+    r->ret_pos = lgw_gps_get(NULL, NULL, &r->loc, NULL);
+}
+
+static bool same_result(const struct result_s *a, const struct result_s *b) {
+    if ((a->type != b->type) || (a->ret_time != b->ret_time) || (a->ret_pos != b->ret_pos)) {
+        return false;
+    }
+    if ((a->ret_time == LGW_GPS_SUCCESS) && ((a->utc.tv_sec != b->utc.tv_sec) || (a->utc.tv_nsec != b->utc.tv_nsec) || (a->gps.tv_sec != b->gps.tv_sec) || (a->gps.tv_nsec != b->gps.tv_nsec))) {
+        return false;
+    }
+    if ((a->ret_pos == LGW_GPS_SUCCESS) && ((a->loc.lat != b->loc.lat) || (a->loc.lon != b->loc.lon) || (a->loc.alt != b->loc.alt))) {
+        return false;
+    }
+    return true;
+}
+
+/* frame the messages of a buffer and parse them like test_loragw_gps does, return the number of messages parsed */
+static unsigned framed_parse(const uint8_t *data, size_t size) {
+    char serial_buff[128];
+    size_t wr_idx = 0, rd_idx, frame_end_idx, frame_size, n, pos = 0;
+    unsigned nb = 0;
+    enum gps_msg latest_msg;
+    char *nmea_end_ptr;
+
+    while (pos < size) {
+        /* same reads as the serial port with VMIN = 8 */
+        n = (size - pos < LGW_GPS_MIN_MSG_SIZE) ? size - pos : LGW_GPS_MIN_MSG_SIZE;
+        memcpy(serial_buff + wr_idx, data + pos, n);
+        pos += n;
+        wr_idx += n;
+        rd_idx = 0;
+        frame_end_idx = 0;
+        while (rd_idx < wr_idx) {
+            frame_size = 0;
+            if ((uint8_t)serial_buff[rd_idx] == LGW_GPS_UBX_SYNC_CHAR) {
+                latest_msg = lgw_parse_ubx(&serial_buff[rd_idx], (wr_idx - rd_idx), &frame_size);
+                if ((latest_msg == INCOMPLETE) || (latest_msg == INVALID)) {
+                    frame_size = 0;
+                }
+            } else if (serial_buff[rd_idx] == LGW_GPS_NMEA_SYNC_CHAR) {
+                nmea_end_ptr = memchr(&serial_buff[rd_idx], 0x0a, (wr_idx - rd_idx));
+                if (nmea_end_ptr) {
+                    frame_size = nmea_end_ptr - &serial_buff[rd_idx] + 1;
+                    latest_msg = lgw_parse_nmea(&serial_buff[rd_idx], frame_size);
+                    if ((latest_msg == INVALID) || (latest_msg == UNKNOWN)) {
+                        frame_size = 0;
+                    }
+                }
+            }
+            if (frame_size > 0) {
+                rd_idx += frame_size;
+                frame_end_idx = rd_idx;
+                ++nb;
+            } else {
+                rd_idx++;
+            }
+        }
+        if (frame_end_idx) {
+            memmove(serial_buff, &serial_buff[frame_end_idx], wr_idx - frame_end_idx);
+            wr_idx -= frame_end_idx;
+        }
+        if ((sizeof(serial_buff) - wr_idx) < LGW_GPS_MIN_MSG_SIZE) {
+            memmove(serial_buff, &serial_buff[LGW_GPS_MIN_MSG_SIZE], wr_idx - LGW_GPS_MIN_MSG_SIZE);
+            wr_idx -= LGW_GPS_MIN_MSG_SIZE;
+        }
+    }
+    return nb;
+}
+
+/* feed a buffer to the stream parser by reads of the given size, return the number of messages parsed */
+static unsigned stream_parse(const uint8_t *data, size_t size, size_t chunk) {
+    size_t n, pos = 0;
+    unsigned nb = 0;
+    enum gps_msg x;
+
+    while (pos < size) {
+        n = lgw_gps_stream_write(&stream, data + pos, (size - pos < chunk) ? size - pos : chunk);
+        pos += n;
+        while ((x = lgw_gps_stream_next(&stream)) != UNKNOWN) {
+            if (x != INVALID) {
+                ++nb;
+            }
+        }
+    }
+    return nb;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+    uint8_t buf[300];
+    char body[200];
+    struct result_s r;
+    struct tm x;
+    struct coord_s loc;
+    short hou, min, sec, day, mon, yea, dla, dlo, alt;
+    float fra;
+    double mla, mlo;
+    time_t t;
+    size_t size, pos, chunk;
+    unsigned nb_check = 0, nb_err = 0, nb_ref, nb_event;
+    unsigned nb_stream, nb_framed;
+    enum gps_msg type;
+    struct timespec start, stop;
+    double t_framed, t_stream;
+    int i, j, k;
+
+    printf("Beginning of test for the GPS stream parser\n");
+    srand(1);
+    tzset();
+
+    /* NMEA decoding against sscanf */
+    for (i = 0; i < 10000; ++i) {
+        hou = rand() % 24; min = rand() % 60; sec = rand() % 60; day = 1 + rand() % 28; mon = 1 + rand() % 12; yea = rand() % 100;
+        sprintf(body, "GPRMC,%02d%02d%02d.%0*d,A,4717.11437,N,00833.91522,E,0.004,77.52,%02d%02d%02d,,,A", hou, min, sec, 1 + i % 3, rand() % 1000 % (i % 3 == 0 ? 10 : (i % 3 == 1 ? 100 : 1000)), day, mon, yea);
+        size = nmea_make(buf, body);
+        if (lgw_parse_nmea((const char *)buf, size) != NMEA_RMC) {
+            ++nb_err;
+            continue;
+        }
+        sscanf(body + 6, "%2hd%2hd%2hd%4f", &hou, &min, &sec, &fra);
+        memset(&x, 0, sizeof x);
+        x.tm_year = yea + 100;
+        x.tm_mon = mon - 1;
+        x.tm_mday = day;
+        x.tm_hour = hou;
+        x.tm_min = min;
+        x.tm_sec = sec;
+        t = mktime(&x) - timezone;
+        get_result(NMEA_RMC, &r);
+        ++nb_check;
+        CHECK((r.ret_time == LGW_GPS_SUCCESS) && (r.utc.tv_sec == t) && (r.utc.tv_nsec == (int32_t)(fra * 1e9)),
+              "%s decoded as %lld.%09ld\n", body, (long long)r.utc.tv_sec, r.utc.tv_nsec);
+
+        sprintf(body, "GPGGA,092725.00,%02d%02d.%0*d,%c,%03d%02d.%05d,%c,1,08,1.01,%d.%d,M,48.0,M,,", rand() % 90, rand() % 60, 1 + i % 5, rand() % 10000, (i % 2) ? 'N' : 'S',
+                rand() % 180, rand() % 60, rand() % 100000, (i % 4 < 2) ? 'E' : 'W', rand() % 3000 - 100, rand() % 10);
+        size = nmea_make(buf, body);
+        if (lgw_parse_nmea((const char *)buf, size) != NMEA_GGA) {
+            ++nb_err;
+            continue;
+        }
+        k = 0;
+        for (j = 0; k < 2; ++j) {
+            k += (body[j] == ',') ? 1 : 0;
+        }
+        sscanf(body + j, "%2hd%10lf", &dla, &mla);
+        for (k = 0; k < 2; ++j) {
+            k += (body[j] == ',') ? 1 : 0;
+        }
+        sscanf(body + j, "%3hd%10lf", &dlo, &mlo);
+        for (k = 0; k < 5; ++j) {
+            k += (body[j] == ',') ? 1 : 0;
+        }
+        sscanf(body + j, "%hd", &alt);
+        loc.lat = ((double)dla + (mla/60.0)) * ((i % 2) ? 1.0 : -1.0);
+        loc.lon = ((double)dlo + (mlo/60.0)) * ((i % 4 < 2) ? 1.0 : -1.0);
+        loc.alt = alt;
+        get_result(NMEA_GGA, &r);
+        ++nb_check;
+        CHECK((r.ret_pos == LGW_GPS_SUCCESS) && (r.loc.lat == loc.lat) && (r.loc.lon == loc.lon) && (r.loc.alt == loc.alt),
+              "%s decoded as %.9f %.9f %d\n", body, r.loc.lat, r.loc.lon, r.loc.alt);
+    }
+    printf("NMEA decoding: %u sentences checked against sscanf, %u error(s)\n", nb_check, nb_err);
+
+    /* generated stream, results of the framed parsers as reference */
+    stream_size = 0;
+    for (nb_msg = 0; nb_msg < NB_MSG; ++nb_msg) {
+        if (rand() % 8 == 0) { /* noise between messages */
+            k = 1 + rand() % 20;
+            for (j = 0; j < k; ++j) {
+                stream_buf[stream_size++] = (uint8_t)(0x25 + rand() % 0x80);
+            }
+        }
+        msg_start[nb_msg] = stream_size;
+        /* start with a NAV-TIMEGPS, a RMC and a GGA: they set the whole parser state */
+        msg_size[nb_msg] = msg_make(stream_buf + stream_size, (nb_msg < NB_PRELUDE) ? (4 - 2 * nb_msg) : -1, &msg_valid[nb_msg]);
+        stream_size += msg_size[nb_msg];
+    }
+    nb_ref = 0;
+    for (i = 0; i < nb_msg; ++i) {
+        if (!msg_valid[i]) {
+            continue;
+        }
+        if (stream_buf[msg_start[i]] == LGW_GPS_UBX_SYNC_CHAR) {
+            type = lgw_parse_ubx((const char *)stream_buf + msg_start[i], msg_size[i], &size);
+        } else {
+            type = lgw_parse_nmea((const char *)stream_buf + msg_start[i], msg_size[i]);
+        }
+        get_result(type, &ref_res[nb_ref++]);
+    }
+
+    /* same stream cut in reads of random sizes */
+    nb_check = 0;
+    for (i = 0; i < NB_CHUNKING; ++i) {
+        lgw_gps_stream_init(&stream);
+        nb_event = 0;
+        pos = 0;
+        while (pos < stream_size) {
+            chunk = (i == 0) ? 1 : 1 + rand() % ((i % 2) ? 16 : 600);
+            if (chunk > stream_size - pos) {
+                chunk = stream_size - pos;
+            }
+            pos += lgw_gps_stream_write(&stream, stream_buf + pos, chunk);
+            while ((type = lgw_gps_stream_next(&stream)) != UNKNOWN) {
+                if ((type != INVALID) && (nb_event < NB_MSG)) {
+                    get_result(type, &res[nb_event++]);
+                }
+            }
+        }
+        ++nb_check;
+        for (j = 0; j < (int)nb_ref; ++j) {
+            /* results of the first messages still depend on what was parsed before */
+            if ((j >= (int)nb_event) || ((j >= NB_PRELUDE) && !same_result(&ref_res[j], &res[j]))) {
+                break;
+            }
+        }
+        if ((nb_event != nb_ref) || (j != (int)nb_ref) || (stream.nb_frame != nb_ref) || (stream.nb_invalid < (unsigned)(nb_msg - nb_ref))) {
+            printf("ERROR: chunking %d: %u messages parsed instead of %u, first difference at %d, %u invalid frames\n", i, nb_event, nb_ref, j, stream.nb_invalid);
+            ++nb_err;
+        }
+    }
+    printf("Stream: %d messages (%u valid), %u bytes, %u chunkings checked, %u bytes skipped, %u error(s)\n", nb_msg, nb_ref, (unsigned)stream_size, nb_check, stream.nb_skipped, nb_err);
+
+    /* speed, on the valid messages the 128-byte buffer of the framed loop can hold */
+    for (size = 0, i = 0; size + 300 < BENCH_SIZE; i = (i + 1) % nb_msg) {
+        if (msg_valid[i] && (msg_size[i] <= 100)) {
+            memcpy(bench_buf + size, stream_buf + msg_start[i], msg_size[i]);
+            size += msg_size[i];
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (j = 0; j < BENCH_NB_LOOP; ++j) {
+        nb_framed = framed_parse(bench_buf, size);
+        sink += nb_framed;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    t_framed = elapsed_ns(&start, &stop) / ((double)BENCH_NB_LOOP * size);
+    lgw_gps_stream_init(&stream);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (j = 0; j < BENCH_NB_LOOP; ++j) {
+        nb_stream = stream_parse(bench_buf, size, 512);
+        sink += nb_stream;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    t_stream = elapsed_ns(&start, &stop) / ((double)BENCH_NB_LOOP * size);
+    if (nb_stream != nb_framed) {
+        printf("ERROR: %u messages parsed by the stream parser, %u by the framed loop\n", nb_stream, nb_framed);
+        ++nb_err;
+    }
+    printf("Time per byte: %.1f ns framed loop with lgw_parse_*, %.1f ns stream parser (%u messages in %u bytes)\n", t_framed, t_stream, nb_stream, (unsigned)size);
+
+    printf("End of test for the GPS stream parser, %u error(s)\n", nb_err);
+
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
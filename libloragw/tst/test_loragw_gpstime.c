@@ -0,0 +1,321 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Minimum test program for the UTC and GPS time computed by lgw_gps_get
+    Compares lgw_date2utc with the former mktime based conversion on every day
+    of the 1970-2099 range (2 and 4 digits years, leap seconds), checks the
+    UTC and GPS times returned by lgw_gps_get after RMC sentences (GPS time
+    from the date and the GPS-UTC offset) and NAV-TIMEGPS frames (UTC time from
+    the GPS time and the offset of the frame), and measures the speed of both conversions. No GPS module is needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf sprintf */
+#include <stdlib.h>     /* EXIT_* rand setenv */
+#include <string.h>     /* memset memcpy */
+#include <time.h>       /* clock_gettime mktime tzset */
+#include <math.h>       /* modf */
+
+#include "loragw_gps.h"
+#include "test_loragw_util.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define YEAR_FIRST      1970
+#define YEAR_LAST       2099
+#define NB_FRAME        100000  /* random RMC sentences and NAV-TIMEGPS frames */
+#define BENCH_SIZE      1024
+#define BENCH_NB_LOOP   200
+#define GPS_EPOCH_UNIX  315964800   /* 06.Jan.1980 00:00:00 UTC */
+#define LEAP_DEFAULT    18          /* GPS-UTC offset assumed before any NAV-TIMEGPS frame */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct date_s {
+    int year, mon, day, hou, min, sec;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static int nb_err = 0;
+
+static struct date_s bench_date[BENCH_SIZE];
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* former conversion of lgw_gps_get, depends on the process time zone */
+static time_t __attribute__ ((noinline)) old_date2utc(int year, int mon, int day, int hou, int min, int sec) {
+    struct tm x;
+
+    memset(&x, 0, sizeof(x));
+    if (year < 100) { /* 2-digits year, 20xx */
+        x.tm_year = year + 100; /* 100 years offset to 1900 */
+    } else { /* 4-digits year, Gregorian calendar */
+        x.tm_year = year - 1900;
+    }
+    x.tm_mon = mon - 1; /* tm_mon is [0,11], mon is [1,12] */
+    x.tm_mday = day;
+    x.tm_hour = hou;
+    x.tm_min = min;
+    x.tm_sec = sec;
+    return mktime(&x) - timezone; /* need to substract timezone bc mktime assumes time vector is local time */
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* former computation of the GPS time */
+static void old_gps_time(int16_t week, uint32_t itow, int32_t ftow, struct timespec *gps_time) {
+    double intpart, fractpart;
+
+    fractpart = modf(((double)itow / 1E3) + ((double)ftow / 1E9), &intpart);
+    gps_time->tv_sec = (time_t)intpart;
+    gps_time->tv_sec += (time_t)week * 604800;
+    gps_time->tv_nsec = (long)(fractpart * 1E9);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int month_length(int year, int mon) {
+    static const int len[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    bool leap = ((year % 4) == 0) && (((year % 100) != 0) || ((year % 400) == 0));
+
+    return len[mon - 1] + (((mon == 2) && leap) ? 1 : 0);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* compare both conversions of a date, return 1 if it was checked */
+static int date_check(int year, int mon, int day, int hou, int min, int sec) {
+    time_t t_old, t_new = 0;
+    int x;
+
+    t_old = old_date2utc(year, mon, day, hou, min, sec);
+    x = lgw_date2utc(year, mon, day, hou, min, sec, &t_new);
+    if (t_old == (time_t)(-1)) { /* out of the range of a 32-bit time_t */
+        CHECK(x == LGW_GPS_ERROR, "%04d-%02d-%02dT%02d:%02d:%02d out of range accepted\n", year, mon, day, hou, min, sec);
+        return 0;
+    }
+    CHECK((x == LGW_GPS_SUCCESS) && (t_new == t_old), "%04d-%02d-%02dT%02d:%02d:%02d: %lld instead of %lld\n", year, mon, day, hou, min, sec, (long long)t_new, (long long)t_old);
+    return 1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* add $, checksum and CR LF around a NMEA sentence body, return the frame size */
+static size_t nmea_make(uint8_t *buf, const char *body) {
+    uint8_t ck = 0;
+    const char *p;
+
+    for (p = body; *p != 0; ++p) {
+        ck ^= (uint8_t)*p;
+    }
+    return (size_t)sprintf((char *)buf, "$%s*%02X\r\n", body, ck);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* NAV-TIMEGPS frame with valid time of week, week number and leap seconds, return the frame size */
+static size_t timegps_make(uint8_t *buf, int16_t week, uint32_t itow, int32_t ftow, int8_t leap) {
+    uint8_t ck_a = 0, ck_b = 0;
+    int i;
+
+    memset(buf, 0, 24);
+    buf[0] = 0xB5;
+    buf[1] = 0x62;
+    buf[2] = 0x01;
+    buf[3] = 0x20;
+    buf[4] = 16;
+    for (i = 0; i < 4; ++i) {
+        buf[6 + i] = (uint8_t)(itow >> (8 * i));
+        buf[10 + i] = (uint8_t)((uint32_t)ftow >> (8 * i));
+    }
+    buf[14] = (uint8_t)week;
+    buf[15] = (uint8_t)((uint16_t)week >> 8);
+    buf[16] = (uint8_t)leap;
+    buf[17] = 0x07; /* towValid, weekValid, leapSValid */
+    for (i = 2; i < 22; ++i) {
+        ck_a += buf[i];
+        ck_b += ck_a;
+    }
+    buf[22] = ck_a;
+    buf[23] = ck_b;
+    return 24;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+    static const struct date_s invalid[] = {
+        {2016, 0, 1, 0, 0, 0}, {2016, 13, 1, 0, 0, 0}, {2016, 1, 0, 0, 0, 0}, {2017, 2, 29, 0, 0, 0}, {2100, 2, 29, 0, 0, 0},
+        {2016, 4, 31, 0, 0, 0}, {2016, 1, 1, 24, 0, 0}, {2016, 1, 1, 0, 60, 0}, {2016, 1, 1, 0, 0, 61}, {2016, 1, 1, -1, 0, 0}
+    };
+    uint8_t buf[256];
+    size_t size;
+    char body[128];
+    struct timespec utc, gps, ref, start, stop;
+    time_t t;
+    const struct date_s *d;
+    int year, mon, day, sec, i, k, x;
+    int nb_check = 0, nb_ns = 0;
+    int16_t week;
+    uint32_t itow;
+    int32_t ftow;
+    int8_t leap;
+    double t_old, t_new;
+
+    printf("Beginning of test for the UTC and GPS time of lgw_gps_get\n");
+
+    /* the former conversion gives UTC time in any time zone; run it in UTC, as on a gateway */
+    setenv("TZ", "UTC0", 1);
+    tzset();
+
+    /* every day of the range with 4 and 2 digits years, first, last and leap second of the day */
+    for (year = YEAR_FIRST; year <= YEAR_LAST; ++year) {
+        for (mon = 1; mon <= 12; ++mon) {
+            for (day = 1; day <= 31; ++day) {
+                if (day > month_length(year, mon)) {
+                    x = lgw_date2utc(year, mon, day, 0, 0, 0, &t);
+                    CHECK(x == LGW_GPS_ERROR, "invalid date %04d-%02d-%02d accepted\n", year, mon, day);
+                    continue;
+                }
+                nb_check += date_check(year, mon, day, 0, 0, 0);
+                nb_check += date_check(year, mon, day, 23, 59, 59);
+                nb_check += date_check(year, mon, day, 23, 59, 60);
+                nb_check += date_check(year, mon, day, rand() % 24, rand() % 60, rand() % 61);
+                if (year >= 2000) {
+                    nb_check += date_check(year - 2000, mon, day, 12, 34, 56);
+                }
+            }
+        }
+    }
+    /* every second of a day with a leap second */
+    for (sec = 0; sec < 86400; ++sec) {
+        nb_check += date_check(2016, 12, 31, sec / 3600, (sec / 60) % 60, sec % 60);
+    }
+    for (i = 0; i < (int)(sizeof invalid / sizeof invalid[0]); ++i) {
+        d = &invalid[i];
+        x = lgw_date2utc(d->year, d->mon, d->day, d->hou, d->min, d->sec, &t);
+        CHECK(x == LGW_GPS_ERROR, "invalid date %04d-%02d-%02dT%02d:%02d:%02d accepted\n", d->year, d->mon, d->day, d->hou, d->min, d->sec);
+    }
+    printf("Dates %d-%d: %d conversions checked, %d error(s)\n", YEAR_FIRST, YEAR_LAST, nb_check, nb_err);
+
+    /* UTC time of RMC sentences, leap second included */
+    lgw_parse_nmea((char *)buf, (int)nmea_make(buf, "GPRMC,235960.00,A,4717.11437,N,00833.91522,E,0.004,77.52,311216,,,A"));
+    x = lgw_gps_get(&utc, NULL, NULL, NULL);
+    CHECK((x == LGW_GPS_SUCCESS) && (utc.tv_sec == 1483228800) && (utc.tv_nsec == 0), "leap second 2016-12-31T23:59:60 is %lld.%09ld\n", (long long)utc.tv_sec, utc.tv_nsec);
+    for (k = 0; k < NB_FRAME; ++k) {
+        year = rand() % 100;
+        mon = 1 + rand() % 12;
+        day = 1 + rand() % month_length(2000 + year, mon);
+        sec = rand() % 86400;
+        i = rand() % 100;
+        sprintf(body, "GPRMC,%02d%02d%02d.%02d,A,4717.11437,N,00833.91522,E,0.004,77.52,%02d%02d%02d,,,A", sec / 3600, (sec / 60) % 60, sec % 60, i, day, mon, year);
+        lgw_parse_nmea((char *)buf, (int)nmea_make(buf, body));
+        x = lgw_gps_get(&utc, &gps, NULL, NULL);
+        t = old_date2utc(year, mon, day, sec / 3600, (sec / 60) % 60, sec % 60);
+        CHECK((x == LGW_GPS_SUCCESS) && (utc.tv_sec == t) && (utc.tv_nsec == (int32_t)((float)(i / 100.0) * 1e9)), "%s: %lld.%09ld\n", body, (long long)utc.tv_sec, utc.tv_nsec);
+        /* no NAV-TIMEGPS frame yet, GPS time from the date and the default GPS-UTC offset */
+        CHECK((gps.tv_sec == (t - GPS_EPOCH_UNIX + LEAP_DEFAULT)) && (gps.tv_nsec == utc.tv_nsec), "%s: GPS time %lld.%09ld\n", body, (long long)gps.tv_sec, gps.tv_nsec);
+    }
+
+    /* GPS time of NAV-TIMEGPS frames, the former computation could be 1 ns off or not normalized */
+    for (k = 0; k < NB_FRAME; ++k) {
+        week = (int16_t)(rand() % 4096);
+        itow = (uint32_t)(rand() % 604800000);
+        ftow = (rand() % 1000001) - 500000;
+        if (k == 0) { /* start of a week */
+            itow = 0;
+            ftow = -300000;
+        }
+        leap = (int8_t)(LEAP_DEFAULT - 2 + rand() % 5);
+        lgw_parse_ubx((char *)buf, timegps_make(buf, week, itow, ftow, leap), &size);
+        x = lgw_gps_get(&utc, &gps, NULL, NULL);
+        old_gps_time(week, itow, ftow, &ref);
+        CHECK((x == LGW_GPS_SUCCESS) && (gps.tv_nsec >= 0) && (gps.tv_nsec < 1000000000), "week %d iTOW %u fTOW %d: %lld.%09ld not normalized\n", week, itow, ftow, (long long)gps.tv_sec, gps.tv_nsec);
+        if (ref.tv_nsec < 0) {
+            ref.tv_sec -= 1;
+            ref.tv_nsec += 1000000000;
+        }
+        x = (int)((ref.tv_sec - gps.tv_sec) * 1000000000 + (ref.tv_nsec - gps.tv_nsec));
+        CHECK(abs(x) <= 1, "week %d iTOW %u fTOW %d: %lld.%09ld instead of %lld.%09ld\n", week, itow, ftow, (long long)gps.tv_sec, gps.tv_nsec, (long long)ref.tv_sec, ref.tv_nsec);
+        nb_ns += (x != 0) ? 1 : 0;
+        /* UTC from the same GPS time, behind by the offset of the frame */
+        CHECK((utc.tv_sec == (gps.tv_sec + GPS_EPOCH_UNIX - leap)) && (utc.tv_nsec == gps.tv_nsec), "week %d iTOW %u fTOW %d leap %d: UTC %lld.%09ld\n", week, itow, ftow, leap, (long long)utc.tv_sec, utc.tv_nsec);
+    }
+
+    /* the GPS time of the next RMC sentences uses the offset given by the last NAV-TIMEGPS frame */
+    lgw_parse_ubx((char *)buf, timegps_make(buf, 1930, 0, 0, 17), &size);
+    lgw_parse_nmea((char *)buf, (int)nmea_make(buf, "GPRMC,235960.00,A,4717.11437,N,00833.91522,E,0.004,77.52,311216,,,A"));
+    x = lgw_gps_get(&utc, &gps, NULL, NULL);
+    CHECK((x == LGW_GPS_SUCCESS) && (utc.tv_sec == 1483228800) && (gps.tv_sec == (1483228800 - GPS_EPOCH_UNIX + 17)), "leap second 2016-12-31T23:59:60 is GPS time %lld\n", (long long)gps.tv_sec);
+    printf("lgw_gps_get: %d RMC sentences and %d NAV-TIMEGPS frames checked (%d former GPS times 1 ns off), %d error(s)\n", NB_FRAME, NB_FRAME, nb_ns, nb_err);
+
+    /* speed of the conversions */
+    for (i = 0; i < BENCH_SIZE; ++i) {
+        bench_date[i].year = 2000 + rand() % 38;
+        bench_date[i].mon = 1 + rand() % 12;
+        bench_date[i].day = 1 + rand() % 28;
+        bench_date[i].hou = rand() % 24;
+        bench_date[i].min = rand() % 60;
+        bench_date[i].sec = rand() % 60;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (k = 0; k < BENCH_NB_LOOP; ++k) {
+        for (i = 0; i < BENCH_SIZE; ++i) {
+            d = &bench_date[i];
+            sink += (uint32_t)old_date2utc(d->year, d->mon, d->day, d->hou, d->min, d->sec);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    t_old = elapsed_ns(&start, &stop) / ((double)BENCH_NB_LOOP * BENCH_SIZE);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (k = 0; k < BENCH_NB_LOOP; ++k) {
+        for (i = 0; i < BENCH_SIZE; ++i) {
+            d = &bench_date[i];
+            lgw_date2utc(d->year, d->mon, d->day, d->hou, d->min, d->sec, &t);
+            sink += (uint32_t)t;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    t_new = elapsed_ns(&start, &stop) / ((double)BENCH_NB_LOOP * BENCH_SIZE);
+    printf("Date -> UTC: %.1f ns mktime, %.1f ns lgw_date2utc\n", t_old, t_new);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (k = 0; k < BENCH_NB_LOOP * BENCH_SIZE; ++k) {
+        lgw_gps_get(&utc, &gps, NULL, NULL);
+        sink += (uint32_t)utc.tv_sec + (uint32_t)gps.tv_nsec;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    printf("lgw_gps_get, UTC and GPS time: %.1f ns\n", elapsed_ns(&start, &stop) / ((double)BENCH_NB_LOOP * BENCH_SIZE));
+
+    printf("End of test for the UTC and GPS time of lgw_gps_get, %d error(s)\n", nb_err);
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
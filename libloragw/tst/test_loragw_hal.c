@@ -107,6 +107,10 @@ int main(int argc, char **argv)
     double xd = 0.0;
     int xi = 0;
 
+    struct lgw_reg_page_stats_s page_before, page_after;
+    uint32_t rx_calls = 0, rx_page_switch = 0, rx_page_access = 0;
+    uint32_t tx_calls = 0, tx_page_switch = 0, tx_page_access = 0;
+
     /* parse command line options */
     while ((i = getopt (argc, argv, "ha:b:t:r:k:")) != -1) {
         switch (i) {
@@ -323,7 +327,12 @@ int main(int argc, char **argv)
         loop_cnt++;
 
         /* fetch N packets */
+        lgw_reg_page_stats(&page_before);
         nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+        lgw_reg_page_stats(&page_after);
+        rx_calls += 1;
+        rx_page_switch += page_after.nb_switch - page_before.nb_switch;
+        rx_page_access += page_after.nb_access - page_before.nb_access;
 
         if (nb_pkt == 0) {
             wait_ms(300);
@@ -390,7 +399,12 @@ int main(int argc, char **argv)
             txpkt.payload[17] = 0xff & (tx_cnt >> 16);
             txpkt.payload[18] = 0xff & (tx_cnt >> 8);
             txpkt.payload[19] = 0xff & tx_cnt;
+            lgw_reg_page_stats(&page_before);
             i = lgw_send(txpkt); /* non-blocking scheduling of TX packet */
+            lgw_reg_page_stats(&page_after);
+            tx_calls += 1;
+            tx_page_switch += page_after.nb_switch - page_before.nb_switch;
+            tx_page_access += page_after.nb_access - page_before.nb_access;
             j = 0;
             printf("+++\nSending packet #%d, rf path %d, return %d\nstatus -> ", tx_cnt, txpkt.rf_chain, i);
             do {
@@ -409,6 +423,10 @@ int main(int argc, char **argv)
         lgw_stop();
     }
 
+    /* SPI writes spent selecting register pages */
+    printf("\nlgw_receive: %u call(s), %u page switch(es) for %u paged register access(es)\n", rx_calls, rx_page_switch, rx_page_access);
+    printf("lgw_send: %u call(s), %u page switch(es) for %u paged register access(es)\n", tx_calls, tx_page_switch, tx_page_access);
+
     printf("\nEnd of test for loragw_hal.c\n");
     return 0;
 }
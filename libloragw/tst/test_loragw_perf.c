@@ -0,0 +1,292 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Minimum test program for the loragw_perf module
+    Checks the histogram buckets, the consistency of the snapshots taken while
+    threads record, the thread slots and the export file.
+    No concentrator is needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#define _GNU_SOURCE     /* needed for pthread_setname_np to be defined */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_* */
+#include <string.h>     /* memset */
+#include <unistd.h>     /* usleep unlink */
+#include <pthread.h>
+
+#include "loragw_perf.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NB_THREAD       4
+#define NB_LOOP         200000
+#define PERF_FILE       "/tmp/test_loragw_perf.bin"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static struct lgw_perf_snapshot_s snap, snap2;
+static volatile bool hold = false;
+static int nb_done = 0;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* find the counters of a thread by name, NULL if absent */
+static struct lgw_perf_thread_s *find_thread(struct lgw_perf_snapshot_s *s, const char *name) {
+    uint32_t i;
+
+    for (i = 0; i < s->nb_thread; ++i) {
+        if (strcmp(s->thread[i].name, name) == 0) {
+            return &s->thread[i];
+        }
+    }
+    return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* record a call and a packet per loop, like lgw_receive does */
+static void *recorder(void *arg) {
+    char name[LGW_PERF_NAME_SIZE];
+    int i;
+
+    snprintf(name, sizeof name, "perf_t%d", (int)(intptr_t)arg);
+    pthread_setname_np(pthread_self(), name);
+    for (i = 0; i < NB_LOOP; ++i) {
+        lgw_perf_stop(LGW_PERF_RECEIVE, lgw_perf_start());
+        lgw_perf_add(LGW_PERF_RX_PKT, 1);
+    }
+    __atomic_add_fetch(&nb_done, 1, __ATOMIC_RELEASE);
+    while (hold) {
+        usleep(1000);
+    }
+    return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* check that the counters of each thread were copied in a consistent state */
+static int check_consistency(const struct lgw_perf_snapshot_s *s) {
+    const struct lgw_perf_probe_s *p;
+    uint64_t nb;
+    uint32_t i;
+    int k;
+
+    for (i = 0; i < s->nb_thread; ++i) {
+        p = &s->thread[i].probe[LGW_PERF_RECEIVE];
+        nb = 0;
+        for (k = 0; k < LGW_PERF_HIST_NB; ++k) {
+            nb += p->hist[k];
+        }
+        if ((nb != p->nb_call) || (s->thread[i].counter[LGW_PERF_RX_PKT] > p->nb_call) ||
+            (s->thread[i].counter[LGW_PERF_RX_PKT] + 1 < p->nb_call)) {
+            printf("ERROR: thread %s copied while updating (%llu calls, %llu in histogram, %llu packets)\n", s->thread[i].name,
+                   (unsigned long long)p->nb_call, (unsigned long long)nb, (unsigned long long)s->thread[i].counter[LGW_PERF_RX_PKT]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+    pthread_t thread[LGW_PERF_THREAD_MAX + 2];
+    struct lgw_perf_probe_s probe;
+    struct lgw_perf_thread_s *t;
+    uint64_t lo, hi, d, ns;
+    int nb_snap = 0;
+    int nb_err = 0;
+    int i, k;
+
+    printf("Beginning of test for loragw_perf.c\n");
+
+    /* buckets are contiguous and each latency lands in the bucket containing it */
+    for (i = 0; i < LGW_PERF_HIST_NB; ++i) {
+        if (lgw_perf_bucket_ns(i) >= lgw_perf_bucket_ns(i + 1)) {
+            printf("ERROR: bucket %d [%llu, %llu[ is empty\n", i, (unsigned long long)lgw_perf_bucket_ns(i), (unsigned long long)lgw_perf_bucket_ns(i + 1));
+            ++nb_err;
+        }
+    }
+    if ((lgw_perf_bucket_ns(1) != (1ULL << LGW_PERF_HIST_LOG2_MIN)) || (lgw_perf_bucket_ns(LGW_PERF_HIST_NB) != (1ULL << LGW_PERF_HIST_LOG2_MAX))) {
+        printf("ERROR: histogram does not span [2^%d, 2^%d] ns\n", LGW_PERF_HIST_LOG2_MIN, LGW_PERF_HIST_LOG2_MAX);
+        ++nb_err;
+    }
+    pthread_setname_np(pthread_self(), "perf_main");
+    for (i = 4 * LGW_PERF_HIST_SUB + 1; i < LGW_PERF_HIST_NB; i += 3) {
+        /* middle of the bucket, far enough from its bounds for the clock reads not to matter */
+        lo = lgw_perf_bucket_ns(i);
+        hi = lgw_perf_bucket_ns(i + 1);
+        d = lo + (hi - lo) / 2;
+        if (d > 100000000) {
+            break;
+        }
+        lgw_perf_snapshot(&snap);
+        lgw_perf_stop(LGW_PERF_SEND, lgw_perf_start() - d);
+        lgw_perf_snapshot(&snap2);
+        lgw_perf_diff(&snap, &snap2, &snap2);
+        if (snap2.probe[LGW_PERF_SEND].hist[i] != 1) {
+            printf("ERROR: %llu ns not recorded in bucket %d\n", (unsigned long long)d, i);
+            ++nb_err;
+        }
+    }
+    printf("Histogram: %d buckets from %llu ns to %llu ns, %d error(s)\n", LGW_PERF_HIST_NB, (unsigned long long)lgw_perf_bucket_ns(1),
+           (unsigned long long)lgw_perf_bucket_ns(LGW_PERF_HIST_NB), nb_err);
+
+    /* percentile of a known distribution: 100 calls at 1 us, 100 calls at 1 ms */
+    memset(&probe, 0, sizeof probe);
+    for (i = 0; i < LGW_PERF_HIST_NB; ++i) {
+        if ((lgw_perf_bucket_ns(i) <= 1000) && (lgw_perf_bucket_ns(i + 1) > 1000)) {
+            probe.hist[i] = 100;
+        }
+        if ((lgw_perf_bucket_ns(i) <= 1000000) && (lgw_perf_bucket_ns(i + 1) > 1000000)) {
+            probe.hist[i] = 100;
+        }
+    }
+    probe.nb_call = 200;
+    probe.max_ns = 1000000;
+    ns = lgw_perf_percentile(&probe, 25.0);
+    if ((ns < 768) || (ns > 1280)) {
+        printf("ERROR: 25th percentile %llu ns instead of about 1 us\n", (unsigned long long)ns);
+        ++nb_err;
+    }
+    ns = lgw_perf_percentile(&probe, 99.0);
+    if ((ns < 786432) || (ns > 1000000)) {
+        printf("ERROR: 99th percentile %llu ns instead of about 1 ms\n", (unsigned long long)ns);
+        ++nb_err;
+    }
+    if (lgw_perf_percentile(&probe, 100.0) != probe.max_ns) {
+        printf("ERROR: 100th percentile is not the maximum\n");
+        ++nb_err;
+    }
+
+    /* snapshots taken while threads record */
+    lgw_perf_snapshot(&snap);
+    for (i = 0; i < NB_THREAD; ++i) {
+        pthread_create(&thread[i], NULL, recorder, (void *)(intptr_t)i);
+    }
+    while (__atomic_load_n(&nb_done, __ATOMIC_ACQUIRE) < NB_THREAD) {
+        lgw_perf_snapshot(&snap2);
+        if (check_consistency(&snap2) != 0) {
+            ++nb_err;
+            break;
+        }
+        ++nb_snap;
+    }
+    for (i = 0; i < NB_THREAD; ++i) {
+        pthread_join(thread[i], NULL);
+    }
+    lgw_perf_snapshot(&snap2);
+    lgw_perf_diff(&snap, &snap2, &snap2);
+    if (snap2.counter[LGW_PERF_RX_PKT] != (uint64_t)NB_THREAD * NB_LOOP) {
+        printf("ERROR: %llu packets counted instead of %d\n", (unsigned long long)snap2.counter[LGW_PERF_RX_PKT], NB_THREAD * NB_LOOP);
+        ++nb_err;
+    }
+    for (i = 0; i < NB_THREAD; ++i) {
+        char name[LGW_PERF_NAME_SIZE];
+
+        snprintf(name, sizeof name, "perf_t%d", i);
+        t = find_thread(&snap2, name);
+        if ((t == NULL) || (t->tid != 0) || (t->probe[LGW_PERF_RECEIVE].nb_call != NB_LOOP)) {
+            printf("ERROR: counters of thread %s missing or wrong\n", name);
+            ++nb_err;
+        }
+    }
+    printf("Threads: %d x %d calls, %d consistent snapshot(s) taken meanwhile, %.0f ns per probe (median)\n", NB_THREAD, NB_LOOP,
+           nb_snap, (double)lgw_perf_percentile(&snap2.probe[LGW_PERF_RECEIVE], 50.0));
+
+    /* a restarted thread gets its slot back, more threads than slots are not measured */
+    lgw_perf_snapshot(&snap);
+    pthread_create(&thread[0], NULL, recorder, (void *)(intptr_t)0);
+    pthread_join(thread[0], NULL);
+    lgw_perf_snapshot(&snap2);
+    t = find_thread(&snap2, "perf_t0");
+    if ((snap2.nb_thread != snap.nb_thread) || (t == NULL) || (t->probe[LGW_PERF_RECEIVE].nb_call != 2 * NB_LOOP)) {
+        printf("ERROR: slot of the restarted thread not reused\n");
+        ++nb_err;
+    }
+    hold = true;
+    for (i = 0; i < LGW_PERF_THREAD_MAX + 2; ++i) {
+        pthread_create(&thread[i], NULL, recorder, (void *)(intptr_t)(NB_THREAD + i));
+    }
+    usleep(200000);
+    hold = false;
+    for (i = 0; i < LGW_PERF_THREAD_MAX + 2; ++i) {
+        pthread_join(thread[i], NULL);
+    }
+    lgw_perf_snapshot(&snap2);
+    printf("Slots: %u used, %u measure(s) lost\n", snap2.nb_thread, snap2.nb_lost);
+    if ((snap2.nb_thread != LGW_PERF_THREAD_MAX) || (snap2.nb_lost == 0)) {
+        printf("ERROR: thread slots overflow not handled\n");
+        ++nb_err;
+    }
+
+    /* disabled measures */
+    lgw_perf_enable(false);
+    lgw_perf_snapshot(&snap);
+    lgw_perf_stop(LGW_PERF_SEND, lgw_perf_start());
+    lgw_perf_add(LGW_PERF_TX_PKT, 1);
+    lgw_perf_snapshot(&snap2);
+    if ((snap2.probe[LGW_PERF_SEND].nb_call != snap.probe[LGW_PERF_SEND].nb_call) || (snap2.counter[LGW_PERF_TX_PKT] != snap.counter[LGW_PERF_TX_PKT])) {
+        printf("ERROR: measures recorded while disabled\n");
+        ++nb_err;
+    }
+    lgw_perf_enable(true);
+
+    /* export file, written once and by the export thread */
+    unlink(PERF_FILE);
+    if ((lgw_perf_export(PERF_FILE) != LGW_PERF_SUCCESS) || (lgw_perf_import(PERF_FILE, &snap) != LGW_PERF_SUCCESS) ||
+        (snap.counter[LGW_PERF_RX_PKT] != snap2.counter[LGW_PERF_RX_PKT])) {
+        printf("ERROR: export file not read back\n");
+        ++nb_err;
+    }
+    unlink(PERF_FILE);
+    if (lgw_perf_export_start(PERF_FILE, 20) != LGW_PERF_SUCCESS) {
+        printf("ERROR: failed to start the export thread\n");
+        ++nb_err;
+    }
+    for (k = 0; (k < 100) && (lgw_perf_import(PERF_FILE, &snap) != LGW_PERF_SUCCESS); ++k) {
+        usleep(10000);
+    }
+    lgw_perf_add(LGW_PERF_TX_PKT, 1);
+    if ((k == 100) || (lgw_perf_export_stop() != LGW_PERF_SUCCESS) || (lgw_perf_import(PERF_FILE, &snap) != LGW_PERF_SUCCESS) ||
+        (snap.counter[LGW_PERF_TX_PKT] != snap2.counter[LGW_PERF_TX_PKT] + 1)) {
+        printf("ERROR: export thread did not update the file\n");
+        ++nb_err;
+    }
+    if (lgw_perf_export_stop() != LGW_PERF_ERROR) {
+        printf("ERROR: export thread stopped twice\n");
+        ++nb_err;
+    }
+    unlink(PERF_FILE);
+    if (lgw_perf_import(PERF_FILE, &snap) != LGW_PERF_ERROR) {
+        printf("ERROR: missing file imported\n");
+        ++nb_err;
+    }
+
+    printf("End of test for loragw_perf.c, %d error(s)\n", nb_err);
+
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
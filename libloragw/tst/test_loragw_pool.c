@@ -0,0 +1,123 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Minimum test program for the loragw_pool module
+    Checks slot alignment, exhaustion and release of a packet pool.
+    No concentrator is needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_* */
+#include <string.h>     /* memset */
+
+#include "loragw_pool.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NB_SLOT     16
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+    struct lgw_pkt_pool_s pool;
+    uint16_t slot[NB_SLOT];
+    uint8_t *buf;
+    int nb_err = 0;
+    int i;
+
+    printf("Beginning of test for loragw_pool.c\n");
+
+    /* invalid parameters */
+    if ((lgw_pool_init(&pool, 0, 64) != LGW_POOL_ERROR) || (lgw_pool_init(&pool, NB_SLOT, 0) != LGW_POOL_ERROR) ||
+        (lgw_pool_init(&pool, NB_SLOT, 257) != LGW_POOL_ERROR) || (lgw_pool_init(NULL, NB_SLOT, 64) != LGW_POOL_ERROR)) {
+        printf("ERROR: invalid pool parameters accepted\n");
+        ++nb_err;
+    }
+
+    if (lgw_pool_init(&pool, NB_SLOT, 65) != LGW_POOL_SUCCESS) {
+        printf("ERROR: failed to initialize pool\n");
+        return EXIT_FAILURE;
+    }
+    if (pool.slot_size != 2 * LGW_POOL_ALIGN) {
+        printf("ERROR: slot size %u is not rounded to the alignment\n", pool.slot_size);
+        ++nb_err;
+    }
+
+    /* take every slot, check they are distinct, aligned and writable */
+    for (i = 0; i < NB_SLOT; ++i) {
+        slot[i] = lgw_pool_get(&pool);
+        buf = lgw_pool_buffer(&pool, slot[i]);
+        if ((slot[i] == LGW_POOL_SLOT_NONE) || (buf == NULL) || (((uintptr_t)buf % LGW_POOL_ALIGN) != 0)) {
+            printf("ERROR: invalid slot %u\n", slot[i]);
+            ++nb_err;
+            continue;
+        }
+        memset(buf, i, pool.max_size);
+    }
+    for (i = 0; i < NB_SLOT; ++i) {
+        buf = lgw_pool_buffer(&pool, slot[i]);
+        if ((buf == NULL) || (buf[0] != i) || (buf[pool.max_size - 1] != i)) {
+            printf("ERROR: slot %u overwritten\n", slot[i]);
+            ++nb_err;
+        }
+    }
+    if ((lgw_pool_get(&pool) != LGW_POOL_SLOT_NONE) || (pool.nb_free != 0)) {
+        printf("ERROR: slot given by an empty pool\n");
+        ++nb_err;
+    }
+
+    /* release and reuse */
+    if (lgw_pool_release(&pool, slot[3]) != LGW_POOL_SUCCESS) {
+        ++nb_err;
+    }
+    if (lgw_pool_get(&pool) != slot[3]) {
+        printf("ERROR: released slot not reused\n");
+        ++nb_err;
+    }
+    if (lgw_pool_release(&pool, NB_SLOT) != LGW_POOL_ERROR) {
+        printf("ERROR: invalid slot released\n");
+        ++nb_err;
+    }
+
+    /* double release while other slots are in use, the slot must not be given twice */
+    if ((lgw_pool_release(&pool, slot[5]) != LGW_POOL_SUCCESS) || (lgw_pool_release(&pool, slot[5]) != LGW_POOL_ERROR)) {
+        printf("ERROR: slot released twice\n");
+        ++nb_err;
+    }
+    if ((pool.nb_free != 1) || (lgw_pool_get(&pool) != slot[5]) || (lgw_pool_get(&pool) != LGW_POOL_SLOT_NONE)) {
+        printf("ERROR: double release corrupted the free slots\n");
+        ++nb_err;
+    }
+    for (i = 0; i < NB_SLOT; ++i) {
+        lgw_pool_release(&pool, slot[i]);
+    }
+    if ((pool.nb_free != NB_SLOT) || (lgw_pool_release(&pool, slot[0]) != LGW_POOL_ERROR)) {
+        printf("ERROR: pool over-released\n");
+        ++nb_err;
+    }
+
+    lgw_pool_free(&pool);
+    printf("End of test for loragw_pool.c, %d error(s)\n", nb_err);
+
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,212 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Minimum test program for the loragw_rxcorr module
+    Checks that the precomputed RX correction tables are bit-exact with the
+    formulas lgw_receive used to evaluate for every packet, for all the
+    metadata values and several modem configurations.
+    No concentrator is needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_* */
+#include <string.h>     /* memcmp */
+#include <math.h>       /* pow */
+
+#include "loragw_hal.h"
+#include "loragw_rxcorr.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#define SET_PPM_ON(bw,dr)   (((bw == BW_125KHZ) && ((dr == DR_LORA_SF11) || (dr == DR_LORA_SF12))) || ((bw == BW_250KHZ) && (dr == DR_LORA_SF12)))
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define RSSI_FSK_POLY_0     60 /* polynomiam coefficients to linearize FSK RSSI */
+#define RSSI_FSK_POLY_1     1.5351
+#define RSSI_FSK_POLY_2     0.003
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* Reference: timestamp correction as computed in lgw_receive for each packet */
+static uint32_t ref_timestamp(int ifmod, uint8_t lora_rx_bw, uint32_t fsk_rx_dr, uint32_t sf, uint32_t cr, uint32_t crc_en, unsigned sz) {
+    struct lgw_pkt_rx_s pkt;
+    struct lgw_pkt_rx_s *p = &pkt;
+    uint32_t delay_x, delay_y, delay_z;
+    uint32_t bw_pow, ppm;
+
+    if (ifmod == IF_FSK_STD) {
+        return ((uint32_t)680000 / fsk_rx_dr) - 20;
+    }
+
+    if (ifmod == IF_LORA_MULTI) {
+        p->bandwidth = BW_125KHZ;
+    } else {
+        p->bandwidth = lora_rx_bw;
+    }
+    switch (sf) {
+        case 7: p->datarate = DR_LORA_SF7; break;
+        case 8: p->datarate = DR_LORA_SF8; break;
+        case 9: p->datarate = DR_LORA_SF9; break;
+        case 10: p->datarate = DR_LORA_SF10; break;
+        case 11: p->datarate = DR_LORA_SF11; break;
+        case 12: p->datarate = DR_LORA_SF12; break;
+        default: p->datarate = DR_UNDEFINED;
+    }
+
+    if (SET_PPM_ON(p->bandwidth,p->datarate)) {
+        ppm = 1;
+    } else {
+        ppm = 0;
+    }
+
+    if (ifmod == IF_LORA_STD) {
+        switch (lora_rx_bw) {
+            case BW_125KHZ:
+                delay_x = 64;
+                bw_pow = 1;
+                break;
+            case BW_250KHZ:
+                delay_x = 32;
+                bw_pow = 2;
+                break;
+            case BW_500KHZ:
+                delay_x = 16;
+                bw_pow = 4;
+                break;
+            default:
+                delay_x = 0;
+                bw_pow = 0;
+        }
+    } else {
+        delay_x = 114;
+        bw_pow = 1;
+    }
+
+    if ((sf >= 6) && (sf <= 12) && (bw_pow > 0)) {
+        if ((2*(sz + 2*crc_en) - (sf-7)) <= 0) {
+            delay_y = ( ((1<<(sf-1)) * (sf+1)) + (3 * (1<<(sf-4))) ) / bw_pow;
+            delay_z = 32 * (2*(sz+2*crc_en) + 5) / bw_pow;
+        } else {
+            delay_y = ( ((1<<(sf-1)) * (sf+1)) + ((4 - ppm) * (1<<(sf-4))) ) / bw_pow;
+            delay_z = (16 + 4*cr) * (((2*(sz+2*crc_en)-sf+6) % (sf - 2*ppm)) + 1) / bw_pow;
+        }
+        return delay_x + delay_y + delay_z;
+    } else {
+        return 0;
+    }
+}
+
+/* Reference: FSK RSSI as computed in lgw_receive for each packet */
+static float ref_rssi_fsk(uint8_t raw, float rssi_offset) {
+    struct lgw_pkt_rx_s pkt;
+    struct lgw_pkt_rx_s *p = &pkt;
+
+    p->rssi = (float)raw + rssi_offset;
+    p->rssi = RSSI_FSK_POLY_0 + RSSI_FSK_POLY_1 * p->rssi + RSSI_FSK_POLY_2 * pow(p->rssi, 2);
+    return p->rssi;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+    const uint8_t bw_list[] = {BW_125KHZ, BW_250KHZ, BW_500KHZ, BW_UNDEFINED, BW_62K5HZ};
+    const uint32_t dr_list[] = {1200, 9600, 50000, 64000, 250000};
+    const int ifmod_list[] = {IF_LORA_MULTI, IF_LORA_STD, IF_FSK_STD};
+    const float offset_list[] = {0.0, -166.0, -162.5, 3.3};
+    float rssi_offset[LGW_RF_CHAIN_NB];
+    uint32_t ts, ref;
+    float rssi, rssi_ref;
+    unsigned nb_check = 0, nb_err = 0;
+    unsigned i, m, sf, cr, crc, sz, o, rf, raw;
+
+    printf("Beginning of test for loragw_rxcorr.c\n");
+
+    for (i = 0; i < ARRAY_SIZE(bw_list); ++i) {
+        rssi_offset[0] = offset_list[i % ARRAY_SIZE(offset_list)];
+        rssi_offset[1] = offset_list[(i + 1) % ARRAY_SIZE(offset_list)];
+        if (rxcorr_setup(bw_list[i], dr_list[i], rssi_offset) != LGW_RXCORR_SUCCESS) {
+            printf("ERROR: failed to setup the correction tables\n");
+            return EXIT_FAILURE;
+        }
+
+        /* timestamp correction, every metadata value */
+        for (m = 0; m < ARRAY_SIZE(ifmod_list); ++m) {
+            for (sf = 0; sf < 16; ++sf) {
+                for (cr = 0; cr < 8; ++cr) {
+                    for (crc = 0; crc < 2; ++crc) {
+                        for (sz = 0; sz < 256; ++sz) {
+                            ts = rxcorr_timestamp(ifmod_list[m], sf, cr, crc, sz);
+                            ref = ref_timestamp(ifmod_list[m], bw_list[i], dr_list[i], sf, cr, crc, sz);
+                            ++nb_check;
+                            if (ts != ref) {
+                                if (nb_err < 10) {
+                                    printf("ERROR: bw %u ifmod 0x%02X sf %u cr %u crc %u size %u: %u instead of %u\n", bw_list[i], ifmod_list[m], sf, cr, crc, sz, ts, ref);
+                                }
+                                ++nb_err;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        /* FSK RSSI, every raw value on every RF chain */
+        for (rf = 0; rf < LGW_RF_CHAIN_NB; ++rf) {
+            for (raw = 0; raw < 256; ++raw) {
+                rssi = rxcorr_rssi_fsk(rf, raw);
+                rssi_ref = ref_rssi_fsk(raw, rssi_offset[rf]);
+                ++nb_check;
+                if (memcmp(&rssi, &rssi_ref, sizeof rssi) != 0) {
+                    if (nb_err < 10) {
+                        printf("ERROR: rf_chain %u raw RSSI %u: %f instead of %f\n", rf, raw, rssi, rssi_ref);
+                    }
+                    ++nb_err;
+                }
+            }
+        }
+    }
+
+    /* every offset on one chain, to cover the whole list */
+    for (o = 0; o < ARRAY_SIZE(offset_list); ++o) {
+        rssi_offset[0] = offset_list[o];
+        rxcorr_setup(BW_125KHZ, dr_list[0], rssi_offset);
+        for (raw = 0; raw < 256; ++raw) {
+            rssi = rxcorr_rssi_fsk(0, raw);
+            rssi_ref = ref_rssi_fsk(raw, offset_list[o]);
+            ++nb_check;
+            if (memcmp(&rssi, &rssi_ref, sizeof rssi) != 0) {
+                ++nb_err;
+            }
+        }
+    }
+
+    printf("%u values checked, %u mismatch(es)\n", nb_check, nb_err);
+    printf("End of test for loragw_rxcorr.c\n");
+
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,131 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Minimum test program for the loragw_rxev module
+    The concentrator RX interrupt line is simulated by a named pipe: each byte
+    written to the pipe is an edge. Checks that every edge wakes up poll() on
+    the event file descriptor and measures the wake-up latency.
+    No concentrator is needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_* */
+#include <fcntl.h>      /* open */
+#include <unistd.h>     /* write close unlink */
+#include <poll.h>       /* poll */
+#include <time.h>       /* clock_gettime */
+#include <sys/stat.h>   /* mkfifo */
+
+#include "loragw_rxev.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define SIM_GPIO_PATH   "/tmp/test_loragw_rxev.fifo"
+#define NB_EDGE         1000
+#define POLL_TIMEOUT_MS 1000
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+    int i;
+    int fd_ev, fd_gpio;
+    struct lgw_conf_rxev_s conf;
+    struct lgw_rxev_stats_s stats;
+    struct pollfd pfd;
+    struct timespec t0, t1;
+    uint32_t lat_ns, lat_min = UINT32_MAX, lat_max = 0;
+    uint64_t lat_sum = 0;
+    int nb_missed = 0;
+
+    printf("Beginning of test for loragw_rxev.c\n");
+
+    /* simulated GPIO line */
+    unlink(SIM_GPIO_PATH);
+    if (mkfifo(SIM_GPIO_PATH, 0600) != 0) {
+        printf("ERROR: failed to create %s\n", SIM_GPIO_PATH);
+        return EXIT_FAILURE;
+    }
+    conf.gpio = LGW_RXEV_GPIO_NONE;
+    conf.gpio_path = SIM_GPIO_PATH;
+    conf.poll_us = 0;
+    fd_ev = lgw_rxev_start(&conf);
+    if (fd_ev == LGW_RXEV_ERROR) {
+        printf("ERROR: failed to start RX event notification\n");
+        unlink(SIM_GPIO_PATH);
+        return EXIT_FAILURE;
+    }
+    fd_gpio = open(SIM_GPIO_PATH, O_WRONLY | O_NONBLOCK);
+    if (fd_gpio < 0) {
+        printf("ERROR: failed to open %s for writing\n", SIM_GPIO_PATH);
+        lgw_rxev_stop();
+        unlink(SIM_GPIO_PATH);
+        return EXIT_FAILURE;
+    }
+
+    /* one edge at a time, wait for the event before raising the next one */
+    pfd.fd = fd_ev;
+    pfd.events = POLLIN;
+    for (i = 0; i < NB_EDGE; ++i) {
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (write(fd_gpio, "1", 1) != 1) {
+            printf("ERROR: failed to raise simulated GPIO edge\n");
+            break;
+        }
+        if (poll(&pfd, 1, POLL_TIMEOUT_MS) != 1) {
+            ++nb_missed;
+            continue;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        lgw_rxev_ack();
+        lat_ns = (uint32_t)((t1.tv_sec - t0.tv_sec) * 1000000000 + (t1.tv_nsec - t0.tv_nsec));
+        lat_sum += lat_ns;
+        if (lat_ns < lat_min) lat_min = lat_ns;
+        if (lat_ns > lat_max) lat_max = lat_ns;
+    }
+
+    /* after the acknowledge, no event must be pending */
+    if (poll(&pfd, 1, 0) != 0) {
+        printf("ERROR: event still pending after acknowledge\n");
+        ++nb_missed;
+    }
+
+    lgw_rxev_stats(&stats);
+    lgw_rxev_stop();
+    close(fd_gpio);
+    unlink(SIM_GPIO_PATH);
+
+    printf("%d edges, %d missed, %u notifications\n", i, nb_missed, stats.nb_notify);
+    if (i > nb_missed) {
+        printf("wake-up latency: min %u us, avg %u us, max %u us\n", lat_min / 1000, (uint32_t)(lat_sum / (i - nb_missed) / 1000), lat_max / 1000);
+    }
+    printf("End of test for loragw_rxev.c\n");
+
+    return ((nb_missed == 0) && (i == NB_EDGE)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
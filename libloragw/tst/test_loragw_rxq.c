@@ -0,0 +1,414 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Test of the RX acquisition thread on the software SX1301 simulator
+    (library built with CFG_SPI=sim).
+    Checks that several consumers get every packet once and in order, that the
+    packets arriving while the ring is full are counted as overflow, that
+    lgw_rxq_wait times out and wakes up when a packet arrives, and that
+    lgw_rxq_stop releases the consumers blocked in lgw_rxq_wait.
+    No concentrator is needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_* */
+#include <string.h>     /* memset */
+#include <time.h>       /* clock_gettime */
+#include <pthread.h>
+
+#include "loragw_hal.h"
+#include "loragw_aux.h"
+#include "loragw_rxq.h"
+#include "loragw_sim.h"
+#include "test_loragw_util.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define PAYLOAD_SIZE    16
+#define NB_CONSUMER     4
+#define NB_PKT          4000    /* packets shared by the consumers */
+#define RING_SIZE       4096    /* larger than NB_PKT, so that the ring cannot overflow in the delivery test */
+#define SMALL_RING      16      /* one RX FIFO, for the overflow test */
+#define POLL_US         500     /* pause of the acquisition thread on an empty FIFO */
+#define TIMEOUT_MS      2000    /* bound of the busy waits of the test itself */
+#define WAIT_MS         100     /* lgw_rxq_wait timeout */
+#define WAIT_SLACK_MS   100     /* scheduling margin allowed on top of a wait */
+#define BLOCK_MS        50      /* time given to the consumers to block before they are woken up */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* one consumer thread */
+struct consumer_s {
+    pthread_t           thread;
+    int32_t             timeout_ms; /* lgw_rxq_wait timeout of a single wait */
+    int                 ret;        /* value returned by the single wait */
+    uint32_t            seq;        /* first packet fetched by the single wait */
+    struct timespec     t_ret;      /* time the single wait returned */
+    volatile bool       done;
+    int                 nb_pkt;     /* packets fetched in the delivery test */
+    int                 nb_disorder;/* packets fetched before a packet fetched earlier by the same consumer */
+    int                 nb_fail;    /* lgw_rxq_wait calls that failed */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static int nb_err = 0;
+
+static uint8_t seen[NB_PKT]; /* number of times each packet was fetched */
+static uint32_t nb_fetched = 0;
+static volatile bool consumer_stop = false;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static uint32_t elapsed_us(const struct timespec *t) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((now.tv_sec - t->tv_sec) * 1000000 + (now.tv_nsec - t->tv_nsec) / 1000);
+}
+
+static uint32_t pkt_seq(const struct lgw_pkt_rx_s *p) {
+    return p->payload[0] | (p->payload[1] << 8) | (p->payload[2] << 16) | ((uint32_t)p->payload[3] << 24);
+}
+
+/* Inject packet number seq, waiting for room in the RX FIFO */
+static int inject(uint32_t seq) {
+    uint8_t payload[PAYLOAD_SIZE];
+    struct timespec t;
+
+    memset(payload, 0, sizeof payload);
+    payload[0] = (uint8_t)(seq);
+    payload[1] = (uint8_t)(seq >> 8);
+    payload[2] = (uint8_t)(seq >> 16);
+    payload[3] = (uint8_t)(seq >> 24);
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    while (lgw_sim_inject(seq % 8, 7 + (seq % 6), PAYLOAD_SIZE, payload) != LGW_SIM_SUCCESS) {
+        if (elapsed_us(&t) > (TIMEOUT_MS * 1000)) {
+            printf("ERROR: RX FIFO not drained, packet %u not injected\n", seq);
+            return -1;
+        }
+        wait_ms(1);
+    }
+    return 0;
+}
+
+/* Wait until the acquisition thread has fetched nb_pkt packets from the concentrator */
+static int wait_fetched(uint32_t nb_pkt) {
+    struct lgw_rxq_stats_s stats;
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    do {
+        lgw_rxq_stats(&stats);
+        if (stats.nb_pkt >= nb_pkt) {
+            return 0;
+        }
+        wait_ms(1);
+    } while (elapsed_us(&t) < (TIMEOUT_MS * 1000));
+    printf("ERROR: %u packets fetched by the acquisition thread instead of %u\n", stats.nb_pkt, nb_pkt);
+    return -1;
+}
+
+/* Fetch packets until all the packets of the delivery test are fetched */
+static void *consumer_loop(void *arg) {
+    struct consumer_s *c = arg;
+    struct lgw_pkt_rx_s rxpkt[8];
+    uint32_t seq, last = 0;
+    int i, n;
+
+    while (!consumer_stop && (__atomic_load_n(&nb_fetched, __ATOMIC_RELAXED) < NB_PKT)) {
+        n = lgw_rxq_wait(8, rxpkt, WAIT_MS);
+        if (n == LGW_RXQ_ERROR) {
+            c->nb_fail += 1;
+            break;
+        }
+        for (i = 0; i < n; ++i) {
+            seq = pkt_seq(&rxpkt[i]);
+            if (seq < NB_PKT) {
+                __atomic_add_fetch(&seen[seq], 1, __ATOMIC_RELAXED);
+            }
+            if ((c->nb_pkt > 0) && (seq <= last)) {
+                c->nb_disorder += 1; /* the ring is FIFO, each consumer must see increasing numbers */
+            }
+            last = seq;
+            c->nb_pkt += 1;
+        }
+        __atomic_add_fetch(&nb_fetched, n, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+/* Wait once for packets, and record what the wait returned and when */
+static void *consumer_once(void *arg) {
+    struct consumer_s *c = arg;
+    struct lgw_pkt_rx_s rxpkt[8];
+
+    c->ret = lgw_rxq_wait(8, rxpkt, c->timeout_ms);
+    clock_gettime(CLOCK_MONOTONIC, &c->t_ret);
+    c->seq = (c->ret > 0) ? pkt_seq(&rxpkt[0]) : 0;
+    __atomic_store_n(&c->done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* Wait for the single wait of a consumer to return */
+static bool consumer_done(struct consumer_s *c) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    while (!__atomic_load_n(&c->done, __ATOMIC_ACQUIRE) && (elapsed_us(&t) < (TIMEOUT_MS * 1000))) {
+        wait_ms(1);
+    }
+    return c->done;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Several consumers fetch packets injected as fast as the FIFO is drained */
+static int delivery_test(void) {
+    struct lgw_conf_rxq_s conf = {RING_SIZE, POLL_US, LGW_RXQ_CPU_ANY};
+    struct consumer_s c[NB_CONSUMER];
+    struct lgw_rxq_stats_s stats;
+    struct timespec t;
+    int nb_missing = 0, nb_double = 0, nb_disorder = 0, nb_fail = 0;
+    int i;
+
+    memset(c, 0, sizeof c);
+    if (lgw_rxq_start(&conf) != LGW_RXQ_SUCCESS) {
+        printf("ERROR: failed to start the RX acquisition thread\n");
+        return -1;
+    }
+    for (i = 0; i < NB_CONSUMER; ++i) {
+        if (pthread_create(&c[i].thread, NULL, consumer_loop, &c[i]) != 0) {
+            printf("ERROR: failed to create consumer %d\n", i);
+            return -1;
+        }
+    }
+    for (i = 0; i < NB_PKT; ++i) {
+        if (inject(i) != 0) {
+            break;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    while ((__atomic_load_n(&nb_fetched, __ATOMIC_RELAXED) < NB_PKT) && (elapsed_us(&t) < (TIMEOUT_MS * 1000))) {
+        wait_ms(1);
+    }
+    consumer_stop = true;
+    for (i = 0; i < NB_CONSUMER; ++i) {
+        pthread_join(c[i].thread, NULL);
+        nb_disorder += c[i].nb_disorder;
+        nb_fail += c[i].nb_fail;
+    }
+    lgw_rxq_stats(&stats);
+    lgw_rxq_stop();
+
+    for (i = 0; i < NB_PKT; ++i) {
+        nb_missing += (seen[i] == 0) ? 1 : 0;
+        nb_double += (seen[i] > 1) ? 1 : 0;
+    }
+    printf("Delivery: %u packets to %d consumers (%d, %d, %d, %d), ring filled up to %u\n", nb_fetched, NB_CONSUMER,
+           c[0].nb_pkt, c[1].nb_pkt, c[2].nb_pkt, c[3].nb_pkt, stats.max_fill);
+    CHECK(nb_missing == 0, "%d packets lost\n", nb_missing);
+    CHECK(nb_double == 0, "%d packets fetched more than once\n", nb_double);
+    CHECK(nb_disorder == 0, "%d packets fetched out of order\n", nb_disorder);
+    CHECK(nb_fail == 0, "lgw_rxq_wait failed %d times\n", nb_fail);
+    CHECK((stats.nb_pkt == NB_PKT) && (stats.nb_overflow == 0), "%u packets fetched by the acquisition thread, %u overflow\n",
+          stats.nb_pkt, stats.nb_overflow);
+    return 0;
+}
+
+/* Fill a one-FIFO ring, then send one more FIFO: the second one must be dropped and counted */
+static int overflow_test(void) {
+    struct lgw_rxq_stats_s stats;
+    struct lgw_pkt_rx_s rxpkt[2 * SMALL_RING];
+    int i, n;
+
+    for (i = 0; i < 2 * SMALL_RING; ++i) {
+        if ((inject(i) != 0) || (wait_fetched(i + 1) != 0)) {
+            return -1;
+        }
+    }
+    lgw_rxq_stats(&stats);
+    CHECK(stats.nb_overflow == SMALL_RING, "%u overflow instead of %u\n", stats.nb_overflow, SMALL_RING);
+    CHECK(stats.max_fill == SMALL_RING, "ring filled up to %u instead of %u\n", stats.max_fill, SMALL_RING);
+
+    /* the packets kept are the first ones, and the ring is usable again once drained */
+    n = lgw_rxq_receive(2 * SMALL_RING, rxpkt);
+    CHECK(n == SMALL_RING, "%d packets in the full ring instead of %u\n", n, SMALL_RING);
+    for (i = 0; i < n; ++i) {
+        CHECK(pkt_seq(&rxpkt[i]) == (uint32_t)i, "packet %u kept instead of %d\n", pkt_seq(&rxpkt[i]), i);
+    }
+    if ((inject(2 * SMALL_RING) != 0) || (wait_fetched(2 * SMALL_RING + 1) != 0)) {
+        return -1;
+    }
+    n = lgw_rxq_receive(2 * SMALL_RING, rxpkt);
+    CHECK((n == 1) && (pkt_seq(&rxpkt[0]) == 2 * SMALL_RING), "%d packets received after the ring was drained\n", n);
+    lgw_rxq_stats(&stats);
+    CHECK(stats.nb_overflow == SMALL_RING, "%u overflow after the ring was drained\n", stats.nb_overflow);
+    printf("Overflow: %u packets fetched, %u dropped, ring filled up to %u\n", stats.nb_pkt, stats.nb_overflow, stats.max_fill);
+    return 0;
+}
+
+/* An empty ring times out, a packet wakes up a timed and an endless wait */
+static int wait_test(void) {
+    struct lgw_pkt_rx_s rxpkt[8];
+    struct consumer_s c;
+    struct timespec t;
+    uint32_t us;
+    int32_t timeout[2] = {TIMEOUT_MS, LGW_RXQ_WAIT_FOREVER};
+    int i, n;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    n = lgw_rxq_wait(8, rxpkt, WAIT_MS);
+    us = elapsed_us(&t);
+    printf("Wait: timeout after %.1f ms (%d ms requested)\n", us / 1000.0, WAIT_MS);
+    CHECK(n == 0, "%d packets returned by the wait on an empty ring\n", n);
+    CHECK((us >= (WAIT_MS * 1000)) && (us < ((WAIT_MS + WAIT_SLACK_MS) * 1000)), "wait timed out after %u us\n", us);
+
+    for (i = 0; i < 2; ++i) {
+        memset(&c, 0, sizeof c);
+        c.timeout_ms = timeout[i];
+        if (pthread_create(&c.thread, NULL, consumer_once, &c) != 0) {
+            printf("ERROR: failed to create the consumer\n");
+            return -1;
+        }
+        wait_ms(BLOCK_MS);
+        CHECK(c.done == false, "wait returned before any packet\n");
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        if ((inject(100 + i) != 0) || (consumer_done(&c) == false)) {
+            printf("ERROR: consumer not woken up by a packet\n");
+            return -1; /* the consumer is still blocked, it cannot be joined */
+        }
+        pthread_join(c.thread, NULL);
+        us = (uint32_t)((c.t_ret.tv_sec - t.tv_sec) * 1000000 + (c.t_ret.tv_nsec - t.tv_nsec) / 1000);
+        printf("Wait: %s wait woken up %.1f ms after the packet arrived\n", (i == 0) ? "timed" : "endless", us / 1000.0);
+        CHECK((c.ret == 1) && (c.seq == (uint32_t)(100 + i)), "wait returned %d, packet %u\n", c.ret, c.seq);
+        CHECK(us < (WAIT_SLACK_MS * 1000), "wait woken up after %u us\n", us);
+    }
+    return 0;
+}
+
+/* Stopping the thread releases the consumers blocked in lgw_rxq_wait */
+static int stop_test(void) {
+    struct lgw_pkt_rx_s rxpkt[8];
+    struct consumer_s c[NB_CONSUMER];
+    int nb_blocked = 0;
+    int i, n;
+
+    memset(c, 0, sizeof c);
+    for (i = 0; i < NB_CONSUMER; ++i) {
+        c[i].timeout_ms = (i % 2 == 0) ? LGW_RXQ_WAIT_FOREVER : TIMEOUT_MS * 10;
+        if (pthread_create(&c[i].thread, NULL, consumer_once, &c[i]) != 0) {
+            printf("ERROR: failed to create consumer %d\n", i);
+            return -1;
+        }
+    }
+    wait_ms(BLOCK_MS);
+    for (i = 0; i < NB_CONSUMER; ++i) {
+        CHECK(c[i].done == false, "consumer %d returned before the stop\n", i);
+    }
+    CHECK(lgw_rxq_stop() == LGW_RXQ_SUCCESS, "failed to stop the RX acquisition thread\n");
+    for (i = 0; i < NB_CONSUMER; ++i) {
+        if (consumer_done(&c[i])) {
+            pthread_join(c[i].thread, NULL);
+            CHECK(c[i].ret == 0, "consumer %d: wait returned %d after the stop\n", i, c[i].ret);
+        } else {
+            ++nb_blocked;
+        }
+    }
+    printf("Stop: %d of %d consumers released\n", NB_CONSUMER - nb_blocked, NB_CONSUMER);
+    CHECK(nb_blocked == 0, "%d consumers still blocked after the stop\n", nb_blocked);
+    n = lgw_rxq_receive(8, rxpkt);
+    CHECK(n == LGW_RXQ_ERROR, "lgw_rxq_receive returned %d after the stop\n", n);
+    return (nb_blocked == 0) ? 0 : -1;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+    struct lgw_sim_conf_s simconf;
+    struct lgw_conf_board_s boardconf;
+    struct lgw_conf_rxrf_s rfconf;
+    struct lgw_conf_rxif_s ifconf;
+    struct lgw_conf_rxq_s rxqconf = {SMALL_RING, POLL_US, LGW_RXQ_CPU_ANY};
+    int i;
+
+    printf("Beginning of test for the RX acquisition thread\n");
+
+    /* no bus cost, no packet generator: the test injects all the packets */
+    memset(&simconf, 0, sizeof simconf);
+    simconf.rx_size = PAYLOAD_SIZE;
+    lgw_sim_setconf(&simconf);
+
+    /* board, radios and LoRa multi-SF channels */
+    memset(&boardconf, 0, sizeof boardconf);
+    boardconf.lorawan_public = true;
+    boardconf.clksrc = 1;
+    lgw_board_setconf(boardconf);
+    memset(&rfconf, 0, sizeof rfconf);
+    rfconf.enable = true;
+    rfconf.type = LGW_RADIO_TYPE_SX1257;
+    rfconf.freq_hz = 867500000;
+    lgw_rxrf_setconf(0, rfconf);
+    rfconf.freq_hz = 868500000;
+    lgw_rxrf_setconf(1, rfconf);
+    memset(&ifconf, 0, sizeof ifconf);
+    ifconf.enable = true;
+    ifconf.datarate = DR_LORA_MULTI;
+    for (i = 0; i < 8; ++i) {
+        ifconf.rf_chain = i / 4;
+        ifconf.freq_hz = -300000 + 200000 * (i % 4);
+        lgw_rxif_setconf(i, ifconf);
+    }
+    if (lgw_start() != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to start the concentrator on the simulator\n");
+        return EXIT_FAILURE;
+    }
+
+    if (delivery_test() != 0) {
+        ++nb_err;
+    }
+
+    /* the overflow, wait and stop tests share one thread with a small ring */
+    if (lgw_rxq_start(&rxqconf) != LGW_RXQ_SUCCESS) {
+        printf("ERROR: failed to start the RX acquisition thread\n");
+        return EXIT_FAILURE;
+    }
+    if ((overflow_test() != 0) || (wait_test() != 0) || (stop_test() != 0)) {
+        printf("End of test for the RX acquisition thread, aborted with %d error(s)\n", nb_err + 1);
+        return EXIT_FAILURE; /* threads may still be blocked, do not stop the concentrator under them */
+    }
+
+    lgw_stop();
+    printf("End of test for the RX acquisition thread, %d error(s)\n", nb_err);
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,1075 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Test and benchmark of the HAL on the software SX1301 simulator
+    (library built with CFG_SPI=sim).
+    Starts the concentrator, checks the packets injected in the RX FIFO are
+    received intact and in order, measures the cost of draining the RX FIFO
+    with and without a modeled SPI bus, checks a TX is triggered and that the
+    TX scheduler queue sends packets in order, and that two concentrator
+    contexts driven from two threads work independently. Also checks that the
+    register cache serves, verifies and forgets register values as configured.
+    No concentrator is needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_* */
+#include <string.h>     /* memset */
+#include <time.h>       /* clock_gettime */
+#include <pthread.h>
+
+#include "loragw_hal.h"
+#include "loragw_reg.h"
+#include "loragw_spi.h"
+#include "loragw_aux.h"
+#include "loragw_txq.h"
+#include "loragw_sim.h"
+#include "loragw_ctx.h"
+#include "loragw_perf.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NB_ROUND        200     /* number of full RX FIFO drained by the benchmark */
+#define PAYLOAD_SIZE    32
+#define BUS_MSG_NS      20000   /* modeled cost of a SPI message (system call, chip select) */
+#define BUS_BYTE_NS     1000    /* modeled cost of a byte on the bus at 8 MHz */
+#define GEN_RATE        1000.0  /* uplinks per second for the packet generator test */
+#define GEN_TIME_MS     1000
+#define CAL_FILE        "/tmp/test_loragw_sim.cal"
+#define MCU_FW_BYTE     8192    /* size of a MCU firmware */
+#define NB_TX           100     /* number of downlinks sent by the TX benchmark */
+#define TXQ_LEAD_US     200000  /* TX scheduler programming window */
+#define TXQ_GAP_US      50000   /* gap between the trigger times of queued packets (41 ms on air) */
+#define POOL_NB_SLOT    8       /* half the RX FIFO */
+#define CTX_TIME_MS     500     /* reception time of each context in the multi-context test */
+#define LOCK_NB_ROUND   50      /* number of full RX FIFO drained during the RX/TX interleaving test */
+#define GPIO_MODE_ADDR  29      /* address of GPIO_MODE, a cacheable register common to all pages */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* one concentrator of the multi-context test */
+struct ctx_test_s {
+    const char          *path;      /* SPI device of the concentrator */
+    bool                bind;       /* bind the context to the thread, else use the lgw_ctx_* functions */
+    struct lgw_ctx_s    *ctx;
+    int                 nb_pkt;     /* packets received */
+    int                 nb_sent;    /* packets reported sent by the TX scheduler */
+    int                 nb_err;
+};
+
+/* RX side of the RX/TX interleaving test */
+struct lock_test_s {
+    volatile bool       done;       /* all the rounds were drained */
+    uint32_t            drain_us;   /* total time spent in lgw_receive */
+    int                 nb_pkt;
+    int                 nb_err;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static struct lgw_txq_result_s txq_res[16];
+static int txq_nb_res = 0;
+
+static struct lgw_perf_snapshot_s perf_old, perf_new; /* too large for the stack */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static uint32_t elapsed_us(const struct timespec *t) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((now.tv_sec - t->tv_sec) * 1000000 + (now.tv_nsec - t->tv_nsec) / 1000);
+}
+
+static uint32_t pkt_seq(const struct lgw_pkt_rx_s *p) {
+    return p->payload[0] | (p->payload[1] << 8) | (p->payload[2] << 16) | ((uint32_t)p->payload[3] << 24);
+}
+
+/* Fill the RX FIFO with packets numbered from seq */
+static int fill_fifo(uint32_t seq) {
+    uint8_t payload[PAYLOAD_SIZE];
+    int i;
+
+    memset(payload, 0, sizeof payload);
+    for (i = 0; i < LGW_PKT_FIFO_SIZE; ++i, ++seq) {
+        payload[0] = (uint8_t)(seq);
+        payload[1] = (uint8_t)(seq >> 8);
+        payload[2] = (uint8_t)(seq >> 16);
+        payload[3] = (uint8_t)(seq >> 24);
+        if (lgw_sim_inject(i % 8, 7 + (i % 6), PAYLOAD_SIZE, payload) != LGW_SIM_SUCCESS) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Drain full RX FIFOs and report the SPI cost per packet */
+static int bench_drain(const char *name) {
+    struct lgw_pkt_rx_s rxpkt[LGW_PKT_FIFO_SIZE];
+    struct lgw_sim_stats_s stats;
+    struct timespec t;
+    uint32_t time_us = 0;
+    int nb_pkt = 0;
+    int i, n;
+
+    lgw_sim_stats_reset();
+    for (i = 0; i < NB_ROUND; ++i) {
+        if (fill_fifo(i * LGW_PKT_FIFO_SIZE) != 0) {
+            printf("ERROR: failed to fill RX FIFO\n");
+            return -1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        n = lgw_receive(LGW_PKT_FIFO_SIZE, rxpkt);
+        time_us += elapsed_us(&t);
+        if (n != LGW_PKT_FIFO_SIZE) {
+            printf("ERROR: %d packets received instead of %d\n", n, LGW_PKT_FIFO_SIZE);
+            return -1;
+        }
+        nb_pkt += n;
+    }
+    lgw_sim_stats(&stats);
+
+    printf("%s: %d packets, %.2f SPI messages/pkt, %.1f bytes/pkt, %.2f us/pkt\n", name, nb_pkt,
+           (double)stats.nb_msg / nb_pkt, (double)stats.nb_byte / nb_pkt, (double)time_us / nb_pkt);
+    return 0;
+}
+
+static void print_timing(const char *name, const struct lgw_start_timing_s *t) {
+    printf("%s: %u ms (connect %u, radio %u, calib %u, modem %u, firmware %u, agc %u, lbt %u us)\n", name, t->total / 1000,
+           t->connect, t->radio, t->calib, t->modem, t->firmware, t->agc, t->lbt);
+}
+
+/* Start with the calibration cache and read the IQ mismatch compensation */
+static int start_cached(struct lgw_conf_start_s *conf, bool *cached, int32_t *iq) {
+    struct lgw_start_timing_s timing;
+    int i;
+
+    lgw_start_setconf(*conf);
+    if (lgw_start() != LGW_HAL_SUCCESS) {
+        return -1;
+    }
+    lgw_start_timing(&timing);
+    *cached = timing.cal_cached;
+    for (i = 0; i < 4; ++i) {
+        lgw_reg_r(LGW_IQ_MISMATCH_A_AMP_COEFF + i, &iq[i]);
+    }
+    lgw_stop();
+    return 0;
+}
+
+/* Calibrate once, then restart from the calibration cache */
+static int cal_cache_test(void) {
+    struct lgw_conf_start_s conf;
+    int32_t iq_cal[4], iq[4];
+    bool cached;
+    int nb_err = 0;
+
+    remove(CAL_FILE);
+    memset(&conf, 0, sizeof conf);
+    conf.fast = true;
+    conf.cal_file = CAL_FILE;
+    conf.temperature = 25;
+
+    if ((start_cached(&conf, &cached, iq_cal) != 0) || (cached == true)) {
+        printf("ERROR: first start did not calibrate\n");
+        ++nb_err;
+    }
+    if ((start_cached(&conf, &cached, iq) != 0) || (cached == false) || (memcmp(iq, iq_cal, sizeof iq) != 0)) {
+        printf("ERROR: calibration results not restored from cache\n");
+        ++nb_err;
+    }
+    conf.temperature = 35; /* other band */
+    if ((start_cached(&conf, &cached, iq) != 0) || (cached == true)) {
+        printf("ERROR: cached calibration used in another temperature band\n");
+        ++nb_err;
+    }
+    conf.cal_force = true;
+    if ((start_cached(&conf, &cached, iq) != 0) || (cached == true)) {
+        printf("ERROR: calibration not forced\n");
+        ++nb_err;
+    }
+    remove(CAL_FILE);
+
+    memset(&conf, 0, sizeof conf);
+    lgw_start_setconf(conf);
+    printf("Calibration cache: %d error(s)\n", nb_err);
+    return (nb_err == 0) ? 0 : -1;
+}
+
+/* Firmware load verification modes, and reuse of the firmwares already loaded */
+static int fw_load_test(void) {
+    const char *mode_name[] = {"full", "prefix", "none"};
+    struct lgw_conf_start_s conf;
+    struct lgw_start_timing_s timing;
+    struct lgw_sim_stats_s stats;
+    uint32_t nb_byte[3];
+    int nb_err = 0;
+    int i;
+
+    remove(CAL_FILE);
+    memset(&conf, 0, sizeof conf);
+    conf.fast = true;
+    conf.cal_file = CAL_FILE;
+    conf.cal_force = true; /* calibration and AGC firmwares loaded at every start */
+    for (i = LGW_FW_VERIFY_FULL; i <= LGW_FW_VERIFY_NONE; ++i) {
+        conf.fw_verify = i;
+        lgw_start_setconf(conf);
+        lgw_sim_stats_reset();
+        if (lgw_start() != LGW_HAL_SUCCESS) {
+            printf("ERROR: failed to start with %s firmware verification\n", mode_name[i]);
+            ++nb_err;
+        }
+        lgw_sim_stats(&stats);
+        lgw_start_timing(&timing);
+        lgw_stop();
+        nb_byte[i] = stats.nb_byte;
+        printf("Firmware load, %s verification: %u SPI bytes during start (cal %u, arb %u, agc %u us)\n", mode_name[i],
+               nb_byte[i], timing.fw_cal, timing.fw_arb, timing.fw_agc);
+    }
+    if ((nb_byte[LGW_FW_VERIFY_PREFIX] >= nb_byte[LGW_FW_VERIFY_FULL]) || (nb_byte[LGW_FW_VERIFY_NONE] >= nb_byte[LGW_FW_VERIFY_PREFIX])) {
+        printf("ERROR: firmware verification modes do not reduce SPI traffic\n");
+        ++nb_err;
+    }
+
+    /* calibration from cache: AGC and arbiter firmwares already in place */
+    conf.cal_force = false;
+    conf.fw_verify = LGW_FW_VERIFY_FULL;
+    lgw_start_setconf(conf);
+    lgw_sim_stats_reset();
+    if (lgw_start() != LGW_HAL_SUCCESS) {
+        ++nb_err;
+    }
+    lgw_sim_stats(&stats);
+    lgw_start_timing(&timing);
+    lgw_stop();
+    printf("Firmware reuse: %u SPI bytes during start (cal %u, arb %u, agc %u us)\n", stats.nb_byte, timing.fw_cal, timing.fw_arb, timing.fw_agc);
+    if ((timing.cal_cached == false) || (stats.nb_byte >= MCU_FW_BYTE)) {
+        printf("ERROR: firmwares reloaded\n");
+        ++nb_err;
+    }
+    remove(CAL_FILE);
+
+    memset(&conf, 0, sizeof conf);
+    lgw_start_setconf(conf);
+    return (nb_err == 0) ? 0 : -1;
+}
+
+static void txq_done(const struct lgw_txq_result_s *result, void *arg) {
+    (void)arg;
+    if (txq_nb_res < (int)(sizeof txq_res / sizeof txq_res[0])) {
+        txq_res[txq_nb_res++] = *result;
+    }
+}
+
+static int txq_wait_empty(void) {
+    int i;
+
+    for (i = 0; (i < 200) && (lgw_txq_pending() > 0); ++i) {
+        wait_ms(10);
+    }
+    return lgw_txq_pending();
+}
+
+/* TX scheduler queue: packets queued out of order, a colliding one, a late one,
+then a packet queued for before the one already programmed */
+static int txq_test(struct lgw_pkt_tx_s *txpkt) {
+    const uint32_t expect_id[] = {6, 1, 2, 3, 4, 8, 7};
+    struct lgw_conf_txq_s conf = {LGW_TXQ_SIZE_DEFAULT, LGW_TXQ_POLL_DEFAULT, TXQ_LEAD_US, LGW_TXQ_MARGIN_DEFAULT, LGW_TXQ_GUARD_DEFAULT, txq_done, NULL};
+    struct lgw_txq_stats_s stats;
+    uint32_t now;
+    uint8_t tx_status;
+    int nb_err = 0;
+    int i;
+
+    /* let the previous TX end */
+    do {
+        wait_ms(10);
+        lgw_status(TX_STATUS, &tx_status);
+    } while (tx_status != TX_FREE);
+
+    txq_nb_res = 0;
+    if (lgw_txq_start(&conf) != LGW_TXQ_SUCCESS) {
+        printf("ERROR: failed to start the TX scheduler\n");
+        return -1;
+    }
+    txpkt->tx_mode = TIMESTAMPED;
+    txpkt->datarate = DR_LORA_SF7;
+    txpkt->size = 10;
+
+    lgw_get_trigcnt(&now);
+    for (i = 4; i >= 1; --i) {
+        txpkt->count_us = now + TXQ_LEAD_US + 50000 + (i - 1) * TXQ_GAP_US;
+        if (lgw_txq_enqueue(txpkt, i) != LGW_TXQ_SUCCESS) {
+            ++nb_err;
+        }
+    }
+    txpkt->count_us = now + TXQ_LEAD_US + 50000 + 20000;
+    if (lgw_txq_enqueue(txpkt, 5) != LGW_TXQ_COLLISION) {
+        printf("ERROR: colliding packet accepted\n");
+        ++nb_err;
+    }
+    txpkt->count_us = now + 1000;
+    if (lgw_txq_enqueue(txpkt, 6) != LGW_TXQ_SUCCESS) {
+        ++nb_err;
+    }
+    txq_wait_empty();
+
+    /* packet 7 is programmed, packet 8 must go before it */
+    lgw_get_trigcnt(&now);
+    txpkt->count_us = now + 150000;
+    lgw_txq_enqueue(txpkt, 7);
+    wait_ms(20);
+    txpkt->count_us = now + 60000;
+    lgw_txq_enqueue(txpkt, 8);
+    if (txq_wait_empty() != 0) {
+        printf("ERROR: TX queue not empty\n");
+        ++nb_err;
+    }
+
+    lgw_txq_stats(&stats);
+    lgw_txq_stop();
+    printf("TX queue: %u queued, %u sent, %u late, %u collision(s), %u preemption(s)\n", stats.nb_queued, stats.nb_sent,
+           stats.nb_late, stats.nb_collision, stats.nb_preempt);
+    if (txq_nb_res != (int)(sizeof expect_id / sizeof expect_id[0])) {
+        printf("ERROR: %d outcomes reported instead of %d\n", txq_nb_res, (int)(sizeof expect_id / sizeof expect_id[0]));
+        ++nb_err;
+    }
+    for (i = 0; i < txq_nb_res; ++i) {
+        if ((i >= (int)(sizeof expect_id / sizeof expect_id[0])) || (txq_res[i].id != expect_id[i]) ||
+            (txq_res[i].status != ((expect_id[i] == 6) ? LGW_TXQ_STATUS_LATE : LGW_TXQ_STATUS_SENT))) {
+            printf("ERROR: outcome %d: packet %u, status %u\n", i, txq_res[i].id, txq_res[i].status);
+            ++nb_err;
+        }
+    }
+    if ((stats.nb_sent != 6) || (stats.nb_late != 1) || (stats.nb_collision != 1) || (stats.nb_preempt != 1)) {
+        ++nb_err;
+    }
+    return (nb_err == 0) ? 0 : -1;
+}
+
+static void ctx_txq_done(const struct lgw_txq_result_s *result, void *arg) {
+    struct ctx_test_s *t = arg;
+
+    if (result->status == LGW_TXQ_STATUS_SENT) {
+        t->nb_sent += 1;
+    }
+}
+
+/* Configure, start and use the concentrator of one context, from its own thread */
+static void *ctx_thread(void *arg) {
+    struct ctx_test_s *t = arg;
+    struct lgw_ctx_s *ctx = (t->bind) ? NULL : t->ctx;
+    struct lgw_conf_txq_s txqconf = {LGW_TXQ_SIZE_DEFAULT, LGW_TXQ_POLL_DEFAULT, TXQ_LEAD_US, LGW_TXQ_MARGIN_DEFAULT, LGW_TXQ_GUARD_DEFAULT, ctx_txq_done, t};
+    struct lgw_conf_board_s boardconf;
+    struct lgw_conf_rxrf_s rfconf;
+    struct lgw_conf_rxif_s ifconf;
+    struct lgw_pkt_rx_s rxpkt[LGW_PKT_FIFO_SIZE];
+    struct lgw_pkt_tx_s txpkt;
+    struct timespec t0;
+    uint32_t seq_next = 0;
+    uint32_t now;
+    int i, n;
+
+    if (t->bind) {
+        lgw_ctx_bind(t->ctx);
+    }
+    memset(&boardconf, 0, sizeof boardconf);
+    boardconf.lorawan_public = true;
+    boardconf.clksrc = 1;
+    memset(&rfconf, 0, sizeof rfconf);
+    rfconf.enable = true;
+    rfconf.type = LGW_RADIO_TYPE_SX1257;
+    rfconf.freq_hz = 867500000;
+    rfconf.tx_enable = true;
+    memset(&ifconf, 0, sizeof ifconf);
+    ifconf.enable = true;
+    ifconf.datarate = DR_LORA_MULTI;
+    ifconf.rf_chain = 0;
+    if (t->bind) {
+        lgw_board_setconf(boardconf);
+        lgw_rxrf_setconf(0, rfconf);
+        for (i = 0; i < 4; ++i) {
+            ifconf.freq_hz = -300000 + 200000 * i;
+            lgw_rxif_setconf(i, ifconf);
+        }
+        n = lgw_start();
+    } else {
+        lgw_ctx_board_setconf(ctx, boardconf);
+        lgw_ctx_rxrf_setconf(ctx, 0, rfconf);
+        for (i = 0; i < 4; ++i) {
+            ifconf.freq_hz = -300000 + 200000 * i;
+            lgw_ctx_rxif_setconf(ctx, i, ifconf);
+        }
+        n = lgw_ctx_start(ctx);
+    }
+    if (n != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to start the concentrator on %s\n", t->path);
+        t->nb_err += 1;
+        return NULL;
+    }
+
+    /* uplinks from the packet generator of this concentrator only */
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (elapsed_us(&t0) < (CTX_TIME_MS * 1000)) {
+        n = (t->bind) ? lgw_receive(LGW_PKT_FIFO_SIZE, rxpkt) : lgw_ctx_receive(ctx, LGW_PKT_FIFO_SIZE, rxpkt);
+        for (i = 0; i < n; ++i) {
+            if ((t->nb_pkt > 0) && (pkt_seq(&rxpkt[i]) != seq_next)) {
+                printf("ERROR: %s: generated packet %u received instead of %u\n", t->path, pkt_seq(&rxpkt[i]), seq_next);
+                t->nb_err += 1;
+            }
+            seq_next = pkt_seq(&rxpkt[i]) + 1;
+            t->nb_pkt += 1;
+        }
+    }
+
+    memset(&txpkt, 0, sizeof txpkt);
+    txpkt.freq_hz = 867500000;
+    txpkt.tx_mode = IMMEDIATE;
+    txpkt.rf_power = 14;
+    txpkt.modulation = MOD_LORA;
+    txpkt.bandwidth = BW_125KHZ;
+    txpkt.datarate = DR_LORA_SF7;
+    txpkt.coderate = CR_LORA_4_5;
+    txpkt.size = 10;
+    txpkt.preamble = 8;
+    if (t->bind) {
+        /* the scheduler thread works on the context of the thread that started it */
+        lgw_txq_start(&txqconf);
+        lgw_get_trigcnt(&now);
+        txpkt.tx_mode = TIMESTAMPED;
+        txpkt.count_us = now + 20000;
+        lgw_txq_enqueue(&txpkt, 1);
+        txq_wait_empty();
+        lgw_txq_stop();
+        lgw_stop();
+    } else {
+        t->nb_sent = (lgw_ctx_send(ctx, txpkt) == LGW_HAL_SUCCESS) ? 1 : 0;
+        wait_ms(50);
+        lgw_ctx_stop(ctx);
+    }
+    if (t->nb_sent != 1) {
+        printf("ERROR: %s: downlink not sent\n", t->path);
+        t->nb_err += 1;
+    }
+    return NULL;
+}
+
+/* Two concentrator contexts, each driven from its own thread, one bound to its
+context and one using the lgw_ctx_* functions, while the default context stays idle */
+static int ctx_test(void) {
+    struct ctx_test_s t[2] = {
+        {"/dev/spidev1.0", true, NULL, 0, 0, 0},
+        {"/dev/spidev2.0", false, NULL, 0, 0, 0}
+    };
+    struct lgw_sim_conf_s simconf;
+    struct lgw_sim_stats_s stats;
+    pthread_t thread[2];
+    int nb_err = 0;
+    int i;
+
+    memset(&simconf, 0, sizeof simconf);
+    simconf.rx_size = PAYLOAD_SIZE;
+    simconf.rx_rate = GEN_RATE;
+    lgw_sim_setconf(&simconf);
+    lgw_sim_stats_reset();
+    for (i = 0; i < 2; ++i) {
+        t[i].ctx = lgw_ctx_create(t[i].path);
+        if ((t[i].ctx == NULL) || (pthread_create(&thread[i], NULL, ctx_thread, &t[i]) != 0)) {
+            printf("ERROR: failed to create context %d\n", i);
+            return -1;
+        }
+    }
+    for (i = 0; i < 2; ++i) {
+        pthread_join(thread[i], NULL);
+        nb_err += t[i].nb_err;
+        if (t[i].nb_pkt == 0) {
+            printf("ERROR: %s: no packet received\n", t[i].path);
+            ++nb_err;
+        }
+        if (lgw_ctx_destroy(t[i].ctx) != LGW_CTX_SUCCESS) {
+            printf("ERROR: failed to destroy context %d\n", i);
+            ++nb_err;
+        }
+    }
+    simconf.rx_rate = 0.0;
+    lgw_sim_setconf(&simconf);
+    lgw_sim_stats(&stats);
+    printf("Contexts: %d and %d packets received, %u TX trigger(s), %d error(s)\n", t[0].nb_pkt, t[1].nb_pkt, stats.nb_tx, nb_err);
+    if ((stats.nb_tx != 2) || (stats.nb_rx_overflow != 0)) {
+        ++nb_err;
+    }
+    if (lgw_ctx_destroy(lgw_ctx_get()) != LGW_CTX_ERROR) {
+        printf("ERROR: default context destroyed\n");
+        ++nb_err;
+    }
+    return (nb_err == 0) ? 0 : -1;
+}
+
+/* Fill and drain the RX FIFO, concurrently with the downlinks of lock_test */
+static void *lock_rx_thread(void *arg) {
+    struct lock_test_s *t = arg;
+    struct lgw_pkt_rx_s rxpkt[LGW_PKT_FIFO_SIZE];
+    struct timespec ts;
+    int i, j, n;
+
+    for (i = 0; i < LOCK_NB_ROUND; ++i) {
+        if (fill_fifo(i * LGW_PKT_FIFO_SIZE) != 0) {
+            ++t->nb_err;
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        n = lgw_receive(LGW_PKT_FIFO_SIZE, rxpkt);
+        t->drain_us += elapsed_us(&ts);
+        if (n != LGW_PKT_FIFO_SIZE) {
+            printf("ERROR: %d packets received instead of %d\n", n, LGW_PKT_FIFO_SIZE);
+            ++t->nb_err;
+        }
+        for (j = 0; j < n; ++j) {
+            if ((pkt_seq(&rxpkt[j]) != (uint32_t)(i * LGW_PKT_FIFO_SIZE + j)) || (rxpkt[j].size != PAYLOAD_SIZE) ||
+                (rxpkt[j].status != STAT_CRC_OK)) {
+                printf("ERROR: packet %d of round %d corrupted\n", j, i);
+                ++t->nb_err;
+            }
+        }
+        t->nb_pkt += (n > 0) ? n : 0;
+    }
+    t->done = true;
+    return NULL;
+}
+
+/* Send downlinks while another thread drains the RX FIFO, on a modeled 8 MHz
+bus: a lgw_send must only wait for the packet being fetched, not for the whole
+drain */
+static int lock_test(struct lgw_pkt_tx_s *txpkt) {
+    struct lock_test_s rx;
+    struct lgw_sim_conf_s simconf;
+    struct lgw_sim_stats_s stats;
+    struct lgw_reg_lock_stats_s lock;
+    struct timespec t;
+    pthread_t thread;
+    uint32_t send_us = 0, send_max_us = 0, us;
+    int nb_sent = 0;
+    int nb_err = 0;
+
+    memset(&rx, 0, sizeof rx);
+    memset(&simconf, 0, sizeof simconf);
+    simconf.rx_size = PAYLOAD_SIZE;
+    simconf.msg_ns = BUS_MSG_NS;
+    simconf.byte_ns = BUS_BYTE_NS;
+    lgw_sim_setconf(&simconf);
+    txpkt->tx_mode = IMMEDIATE;
+    lgw_sim_stats_reset();
+    lgw_reg_lock_stats_reset();
+
+    if (pthread_create(&thread, NULL, lock_rx_thread, &rx) != 0) {
+        printf("ERROR: failed to create the RX thread\n");
+        return -1;
+    }
+    while (!rx.done) {
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        if (lgw_send(*txpkt) != LGW_HAL_SUCCESS) {
+            ++nb_err;
+        }
+        us = elapsed_us(&t);
+        send_us += us;
+        send_max_us = (us > send_max_us) ? us : send_max_us;
+        ++nb_sent;
+    }
+    pthread_join(thread, NULL);
+    lgw_sim_stats(&stats);
+    lgw_reg_lock_stats(&lock);
+
+    printf("Interleaving: %d packets received, %.1f us per drain; %d packets sent, %.1f us per send (max %u us)\n",
+           rx.nb_pkt, (double)rx.drain_us / LOCK_NB_ROUND, nb_sent, (double)send_us / nb_sent, send_max_us);
+    printf("Register lock: %u transactions, %u contended, %.1f us waited (max %.1f us)\n", lock.nb_lock,
+           lock.nb_contended, (double)lock.wait_ns / 1000.0, (double)lock.wait_max_ns / 1000.0);
+    nb_err += rx.nb_err;
+    if (rx.nb_pkt != LOCK_NB_ROUND * LGW_PKT_FIFO_SIZE) {
+        printf("ERROR: %d packets received instead of %d\n", rx.nb_pkt, LOCK_NB_ROUND * LGW_PKT_FIFO_SIZE);
+        ++nb_err;
+    }
+    if (stats.nb_tx != (uint32_t)nb_sent) {
+        printf("ERROR: %u TX triggered instead of %d\n", stats.nb_tx, nb_sent);
+        ++nb_err;
+    }
+    if ((double)send_us / nb_sent >= (double)rx.drain_us / LOCK_NB_ROUND) {
+        printf("ERROR: lgw_send waits for the RX drains\n");
+        ++nb_err;
+    }
+    if (lock.nb_contended == 0) {
+        printf("ERROR: no contention measured on the register lock\n");
+        ++nb_err;
+    }
+
+    simconf.msg_ns = 0;
+    simconf.byte_ns = 0;
+    lgw_sim_setconf(&simconf);
+    lgw_abort_tx();
+    return (nb_err == 0) ? 0 : -1;
+}
+
+/* SPI cost of a downlink, with a modeled 8 MHz bus */
+static int bench_tx(struct lgw_pkt_tx_s *txpkt) {
+    struct lgw_pkt_tx_prep_s prep;
+    struct lgw_sim_conf_s simconf;
+    struct lgw_sim_stats_s stats;
+    struct timespec t;
+    uint32_t us;
+    int nb_err = 0;
+    int i;
+
+    memset(&simconf, 0, sizeof simconf);
+    simconf.rx_size = PAYLOAD_SIZE;
+    simconf.msg_ns = BUS_MSG_NS;
+    simconf.byte_ns = BUS_BYTE_NS;
+    lgw_sim_setconf(&simconf);
+    txpkt->tx_mode = IMMEDIATE;
+    lgw_sim_stats_reset();
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    for (i = 0; i < NB_TX; ++i) {
+        if (lgw_send(*txpkt) != LGW_HAL_SUCCESS) {
+            ++nb_err;
+        }
+    }
+    us = elapsed_us(&t);
+    lgw_sim_stats(&stats);
+    printf("TX lgw_send: %.1f SPI messages, %.1f bytes, %.1f us per packet\n", (float)stats.nb_msg / NB_TX, (float)stats.nb_byte / NB_TX, (float)us / NB_TX);
+
+    if (lgw_send_prepare(txpkt, &prep) != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to prepare packet\n");
+        ++nb_err;
+    }
+    lgw_sim_stats_reset();
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    for (i = 0; i < NB_TX; ++i) {
+        if (lgw_send_prepared(&prep, 0) != LGW_HAL_SUCCESS) {
+            ++nb_err;
+        }
+    }
+    us = elapsed_us(&t);
+    lgw_sim_stats(&stats);
+    printf("TX lgw_send_prepared: %.1f SPI messages, %.1f bytes, %.1f us per packet\n", (float)stats.nb_msg / NB_TX, (float)stats.nb_byte / NB_TX, (float)us / NB_TX);
+    if (stats.nb_tx != NB_TX) {
+        printf("ERROR: %u TX triggered instead of %d\n", stats.nb_tx, NB_TX);
+        ++nb_err;
+    }
+
+    simconf.msg_ns = 0;
+    simconf.byte_ns = 0;
+    lgw_sim_setconf(&simconf);
+    lgw_abort_tx();
+    return (nb_err == 0) ? 0 : -1;
+}
+
+/* Receive in a packet pool smaller than the RX FIFO, then with slots too small */
+static int pool_test(void) {
+    struct lgw_pkt_pool_s pool;
+    struct lgw_pkt_rx_ref_s rxref[LGW_PKT_FIFO_SIZE];
+    struct lgw_pkt_rx_s rxpkt[LGW_PKT_FIFO_SIZE];
+    uint32_t seq;
+    int nb_err = 0;
+    int i, n, r;
+
+    if (lgw_pool_init(&pool, POOL_NB_SLOT, PAYLOAD_SIZE) != LGW_POOL_SUCCESS) {
+        printf("ERROR: failed to initialize packet pool\n");
+        return -1;
+    }
+    fill_fifo(0);
+    for (r = 0; r < (LGW_PKT_FIFO_SIZE / POOL_NB_SLOT); ++r) {
+        n = lgw_receive_pool(&pool, LGW_PKT_FIFO_SIZE, rxref);
+        if (n != POOL_NB_SLOT) {
+            printf("ERROR: %d packets received in pool instead of %d\n", n, POOL_NB_SLOT);
+            ++nb_err;
+        }
+        for (i = 0; i < n; ++i) {
+            seq = rxref[i].payload[0] | (rxref[i].payload[1] << 8);
+            if ((seq != (uint32_t)(r * POOL_NB_SLOT + i)) || (rxref[i].size != PAYLOAD_SIZE) || (rxref[i].payload != lgw_pool_buffer(&pool, rxref[i].slot)) ||
+                (((uintptr_t)rxref[i].payload % LGW_POOL_ALIGN) != 0) || (rxref[i].status != STAT_CRC_OK)) {
+                printf("ERROR: pool packet %d corrupted (seq %u, size %u, slot %u)\n", i, seq, rxref[i].size, rxref[i].slot);
+                ++nb_err;
+            }
+        }
+        /* nothing more can be received until slots are released */
+        if (lgw_receive_pool(&pool, LGW_PKT_FIFO_SIZE, rxref + n) != 0) {
+            printf("ERROR: packet received with an empty pool\n");
+            ++nb_err;
+        }
+        for (i = 0; i < n; ++i) {
+            lgw_pool_release(&pool, rxref[i].slot);
+        }
+    }
+    lgw_pool_free(&pool);
+
+    /* slots too small: packets are dropped and counted */
+    lgw_pool_init(&pool, POOL_NB_SLOT, PAYLOAD_SIZE - 1);
+    fill_fifo(0);
+    n = lgw_receive_pool(&pool, LGW_PKT_FIFO_SIZE, rxref);
+    if ((n != 0) || (pool.nb_drop != LGW_PKT_FIFO_SIZE) || (pool.nb_free != POOL_NB_SLOT)) {
+        printf("ERROR: %d oversize packets received, %u dropped\n", n, pool.nb_drop);
+        ++nb_err;
+    }
+    if (lgw_receive(LGW_PKT_FIFO_SIZE, rxpkt) != 0) {
+        printf("ERROR: RX FIFO not empty after drops\n");
+        ++nb_err;
+    }
+    lgw_pool_free(&pool);
+
+    printf("RX packet pool: %d error(s)\n", nb_err);
+    return (nb_err == 0) ? 0 : -1;
+}
+
+/* Shadow copy of the register file: reads served from the copy, mismatches
+counted in verify mode, copy emptied by a soft reset and by the register file
+handover to the MCUs. The chip is modified behind the register layer with a
+raw SPI write. */
+static int reg_cache_test(void) {
+    struct lgw_ctx_s *ctx = lgw_ctx_cur;
+    struct lgw_sim_stats_s stats;
+    uint32_t hit, miss, mismatch;
+    uint32_t hit0, miss0, mismatch0; /* counters before the reads checked, the write read-modify-writes update them */
+    int32_t val;
+    int nb_err = 0;
+
+    if (lgw_connect(false, 0) != LGW_REG_SUCCESS) {
+        printf("ERROR: failed to connect to the simulator\n");
+        return -1;
+    }
+
+    /* cache on: a known register is read without any SPI message, even if the chip changed */
+    lgw_reg_cache_setconf(LGW_REG_CACHE_ON);
+    lgw_reg_w(LGW_GPIO_MODE, 0x15);
+    lgw_reg_cache_stats(&hit0, &miss0, &mismatch0);
+    lgw_sim_stats_reset();
+    lgw_reg_r(LGW_GPIO_MODE, &val);
+    lgw_sim_stats(&stats);
+    lgw_reg_cache_stats(&hit, &miss, &mismatch);
+    if ((val != 0x15) || (stats.nb_msg != 0) || (hit != (hit0 + 1)) || (miss != miss0)) {
+        printf("ERROR: cache on: read 0x%02X, %u SPI messages, %u hit, %u miss\n", val, stats.nb_msg, hit - hit0, miss - miss0);
+        ++nb_err;
+    }
+    lgw_spi_w(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, GPIO_MODE_ADDR, 0x0A);
+    lgw_reg_r(LGW_GPIO_MODE, &val);
+    lgw_reg_cache_stats(&hit, &miss, &mismatch);
+    if ((val != 0x15) || (mismatch != 0)) {
+        printf("ERROR: cache on: read 0x%02X instead of the cached value, %u mismatch\n", val, mismatch);
+        ++nb_err;
+    }
+
+    /* cache verify: the chip is read every time, its value returned and the differences counted */
+    lgw_reg_cache_setconf(LGW_REG_CACHE_VERIFY);
+    lgw_reg_w(LGW_GPIO_MODE, 0x15);
+    lgw_reg_cache_stats(&hit0, &miss0, &mismatch0);
+    lgw_sim_stats_reset();
+    lgw_reg_r(LGW_GPIO_MODE, &val);
+    lgw_sim_stats(&stats);
+    lgw_reg_cache_stats(&hit, &miss, &mismatch);
+    if ((val != 0x15) || (stats.nb_msg == 0) || (hit != (hit0 + 1)) || (mismatch != 0)) {
+        printf("ERROR: cache verify: read 0x%02X, %u SPI messages, %u hit, %u mismatch\n", val, stats.nb_msg, hit - hit0, mismatch);
+        ++nb_err;
+    }
+    lgw_spi_w(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, GPIO_MODE_ADDR, 0x0A);
+    lgw_reg_r(LGW_GPIO_MODE, &val);
+    lgw_reg_r(LGW_GPIO_MODE, &val); /* the copy was refreshed by the first read */
+    lgw_reg_cache_stats(&hit, &miss, &mismatch);
+    if ((val != 0x0A) || (mismatch != 1)) {
+        printf("ERROR: cache verify: read 0x%02X instead of 0x0A, %u mismatch instead of 1\n", val, mismatch);
+        ++nb_err;
+    }
+
+    /* soft reset: registers back to unknown, the next read goes to the chip and gets the default value */
+    lgw_reg_cache_setconf(LGW_REG_CACHE_ON);
+    lgw_reg_w(LGW_GPIO_MODE, 0x15);
+    lgw_soft_reset();
+    lgw_reg_cache_stats(&hit0, &miss0, &mismatch0);
+    lgw_reg_r(LGW_GPIO_MODE, &val);
+    lgw_reg_cache_stats(&hit, &miss, &mismatch);
+    if ((val != 0) || (hit != hit0) || (miss != (miss0 + 1))) {
+        printf("ERROR: soft reset: read 0x%02X, %u hit, %u miss\n", val, hit - hit0, miss - miss0);
+        ++nb_err;
+    }
+
+    /* register file handed over to the MCUs and taken back: the MCUs may have changed anything */
+    lgw_reg_w(LGW_GPIO_MODE, 0x15);
+    lgw_reg_w(LGW_EMERGENCY_FORCE_HOST_CTRL, 0);
+    lgw_spi_w(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, GPIO_MODE_ADDR, 0x0A);
+    lgw_reg_w(LGW_EMERGENCY_FORCE_HOST_CTRL, 1);
+    lgw_reg_cache_stats(&hit0, &miss0, &mismatch0);
+    lgw_reg_r(LGW_GPIO_MODE, &val);
+    lgw_reg_cache_stats(&hit, &miss, &mismatch);
+    if ((val != 0x0A) || (hit != hit0) || (miss != (miss0 + 1))) {
+        printf("ERROR: host control handover: read 0x%02X, %u hit, %u miss\n", val, hit - hit0, miss - miss0);
+        ++nb_err;
+    }
+
+    lgw_reg_cache_setconf(LGW_REG_CACHE_OFF);
+    lgw_disconnect();
+    printf("Register cache: %d error(s)\n", nb_err);
+    return (nb_err == 0) ? 0 : -1;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+    struct lgw_sim_conf_s simconf;
+    struct lgw_sim_stats_s stats;
+    struct lgw_conf_board_s boardconf;
+    struct lgw_conf_rxrf_s rfconf;
+    struct lgw_conf_rxif_s ifconf;
+    struct lgw_pkt_rx_s rxpkt[LGW_PKT_FIFO_SIZE];
+    struct lgw_pkt_tx_s txpkt;
+    struct lgw_conf_start_s startconf;
+    struct lgw_start_timing_s timing, timing_fast;
+    struct timespec t;
+    uint32_t seq_next = 0;
+    int nb_err = 0;
+    int nb_pkt = 0;
+    int i, n;
+
+    printf("Beginning of test for the SX1301 simulator\n");
+
+    /* no bus cost, no packet generator */
+    memset(&simconf, 0, sizeof simconf);
+    simconf.rx_size = PAYLOAD_SIZE;
+    lgw_sim_setconf(&simconf);
+
+    /* board, radios and LoRa multi-SF channels */
+    memset(&boardconf, 0, sizeof boardconf);
+    boardconf.lorawan_public = true;
+    boardconf.clksrc = 1;
+    lgw_board_setconf(boardconf);
+    memset(&rfconf, 0, sizeof rfconf);
+    rfconf.enable = true;
+    rfconf.type = LGW_RADIO_TYPE_SX1257;
+    rfconf.freq_hz = 867500000;
+    rfconf.tx_enable = true;
+    lgw_rxrf_setconf(0, rfconf);
+    rfconf.freq_hz = 868500000;
+    rfconf.tx_enable = false;
+    lgw_rxrf_setconf(1, rfconf);
+    memset(&ifconf, 0, sizeof ifconf);
+    ifconf.enable = true;
+    ifconf.datarate = DR_LORA_MULTI;
+    for (i = 0; i < 8; ++i) {
+        ifconf.rf_chain = i / 4;
+        ifconf.freq_hz = -300000 + 200000 * (i % 4);
+        lgw_rxif_setconf(i, ifconf);
+    }
+
+    if (lgw_start() != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to start the concentrator on the simulator\n");
+        return EXIT_FAILURE;
+    }
+    lgw_start_timing(&timing);
+    print_timing("Start", &timing);
+
+    /* --- RX INTEGRITY TEST --- */
+
+    fill_fifo(0);
+    n = lgw_receive(LGW_PKT_FIFO_SIZE, rxpkt);
+    for (i = 0; i < n; ++i) {
+        if ((pkt_seq(&rxpkt[i]) != (uint32_t)i) || (rxpkt[i].size != PAYLOAD_SIZE) || (rxpkt[i].if_chain != i % 8) ||
+            (rxpkt[i].status != STAT_CRC_OK) || (rxpkt[i].datarate != (uint32_t)(DR_LORA_SF7 << (i % 6)))) {
+            printf("ERROR: packet %d corrupted (seq %u, size %u, if_chain %u, status 0x%02X, datarate 0x%02X)\n", i,
+                   pkt_seq(&rxpkt[i]), rxpkt[i].size, rxpkt[i].if_chain, rxpkt[i].status, rxpkt[i].datarate);
+            ++nb_err;
+        }
+    }
+    if (n != LGW_PKT_FIFO_SIZE) {
+        printf("ERROR: %d packets received instead of %d\n", n, LGW_PKT_FIFO_SIZE);
+        ++nb_err;
+    }
+    if (lgw_receive(LGW_PKT_FIFO_SIZE, rxpkt) != 0) {
+        printf("ERROR: RX FIFO not empty after drain\n");
+        ++nb_err;
+    }
+    printf("RX integrity: %d packets received, %d error(s)\n", n, nb_err);
+
+    /* --- INSTRUMENTATION TEST --- */
+
+    lgw_perf_snapshot(&perf_old);
+    fill_fifo(0);
+    lgw_sim_stats_reset();
+    n = lgw_receive(LGW_PKT_FIFO_SIZE, rxpkt);
+    lgw_sim_stats(&stats);
+    lgw_perf_snapshot(&perf_new);
+    lgw_perf_diff(&perf_old, &perf_new, &perf_new);
+    printf("Instrumentation: %llu lgw_receive call(s), %llu packets, %llu SPI messages, %llu SPI bytes, %llu page switch(es)\n",
+           (unsigned long long)perf_new.probe[LGW_PERF_RECEIVE].nb_call, (unsigned long long)perf_new.counter[LGW_PERF_RX_PKT],
+           (unsigned long long)perf_new.probe[LGW_PERF_SPI].nb_call, (unsigned long long)perf_new.counter[LGW_PERF_SPI_BYTES],
+           (unsigned long long)perf_new.counter[LGW_PERF_PAGE_SWITCH]);
+    if ((perf_new.probe[LGW_PERF_RECEIVE].nb_call != 1) || (perf_new.counter[LGW_PERF_RX_PKT] != (uint64_t)n) ||
+        (perf_new.probe[LGW_PERF_SPI].nb_call != stats.nb_msg) || (perf_new.counter[LGW_PERF_SPI_BYTES] != stats.nb_byte)) {
+        printf("ERROR: instrumentation does not match the simulator counters (%u messages, %u bytes)\n", stats.nb_msg, stats.nb_byte);
+        ++nb_err;
+    }
+
+    /* --- RX PACKET POOL TEST --- */
+
+    if (pool_test() != 0) {
+        ++nb_err;
+    }
+
+    /* --- RX DRAIN BENCHMARK --- */
+
+    if (bench_drain("RX drain, no bus cost") != 0) {
+        ++nb_err;
+    }
+    simconf.msg_ns = BUS_MSG_NS;
+    simconf.byte_ns = BUS_BYTE_NS;
+    lgw_sim_setconf(&simconf);
+    if (bench_drain("RX drain, modeled 8 MHz bus") != 0) {
+        ++nb_err;
+    }
+
+    /* --- PACKET GENERATOR TEST --- */
+
+    simconf.msg_ns = 0;
+    simconf.byte_ns = 0;
+    simconf.rx_rate = GEN_RATE;
+    lgw_sim_setconf(&simconf);
+    lgw_sim_stats_reset();
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    while (elapsed_us(&t) < (GEN_TIME_MS * 1000)) {
+        n = lgw_receive(LGW_PKT_FIFO_SIZE, rxpkt);
+        for (i = 0; i < n; ++i) {
+            if ((nb_pkt > 0) && (pkt_seq(&rxpkt[i]) != seq_next)) {
+                printf("ERROR: generated packet %u received instead of %u\n", pkt_seq(&rxpkt[i]), seq_next);
+                ++nb_err;
+            }
+            seq_next = pkt_seq(&rxpkt[i]) + 1;
+            ++nb_pkt;
+        }
+    }
+    simconf.rx_rate = 0.0;
+    lgw_sim_setconf(&simconf);
+    lgw_sim_stats(&stats);
+    printf("Generator: %d packets received in %d ms at %.0f pkt/s, %u generated, %u lost\n", nb_pkt, GEN_TIME_MS, GEN_RATE,
+           stats.nb_rx_gen, stats.nb_rx_overflow);
+    if ((nb_pkt == 0) || (stats.nb_rx_overflow != 0)) {
+        ++nb_err;
+    }
+
+    /* --- TX TEST --- */
+
+    memset(&txpkt, 0, sizeof txpkt);
+    txpkt.freq_hz = 867500000;
+    txpkt.tx_mode = IMMEDIATE;
+    txpkt.rf_power = 14;
+    txpkt.modulation = MOD_LORA;
+    txpkt.bandwidth = BW_125KHZ;
+    txpkt.datarate = DR_LORA_SF9;
+    txpkt.coderate = CR_LORA_4_5;
+    txpkt.size = 20;
+    txpkt.preamble = 8;
+    lgw_sim_stats_reset();
+    if (lgw_send(txpkt) != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to send packet\n");
+        ++nb_err;
+    }
+    lgw_sim_stats(&stats);
+    printf("TX: %u trigger(s)\n", stats.nb_tx);
+    if (stats.nb_tx != 1) {
+        ++nb_err;
+    }
+
+    /* --- TX BENCHMARK --- */
+
+    if (bench_tx(&txpkt) != 0) {
+        ++nb_err;
+    }
+
+    /* --- RX/TX INTERLEAVING TEST --- */
+
+    if (lock_test(&txpkt) != 0) {
+        ++nb_err;
+    }
+
+    /* --- TX SCHEDULER QUEUE TEST --- */
+
+    if (txq_test(&txpkt) != 0) {
+        ++nb_err;
+    }
+
+    lgw_stop();
+
+    /* --- MULTI-CONTEXT TEST --- */
+
+    if (ctx_test() != 0) {
+        ++nb_err;
+    }
+
+    /* --- FAST START TEST --- */
+
+    memset(&startconf, 0, sizeof startconf);
+    startconf.fast = true;
+    lgw_start_setconf(startconf);
+    if (lgw_start() != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to fast start the concentrator\n");
+        ++nb_err;
+    } else {
+        lgw_start_timing(&timing_fast);
+        print_timing("Fast start", &timing_fast);
+        if (timing_fast.total >= timing.total) {
+            printf("ERROR: fast start not faster\n");
+            ++nb_err;
+        }
+        fill_fifo(0);
+        if (lgw_receive(LGW_PKT_FIFO_SIZE, rxpkt) != LGW_PKT_FIFO_SIZE) {
+            printf("ERROR: no reception after fast start\n");
+            ++nb_err;
+        }
+        lgw_stop();
+    }
+
+    /* --- FIRMWARE LOAD TEST --- */
+
+    if (fw_load_test() != 0) {
+        ++nb_err;
+    }
+
+    /* --- CALIBRATION CACHE TEST --- */
+
+    if (cal_cache_test() != 0) {
+        ++nb_err;
+    }
+
+    /* --- REGISTER CACHE TEST --- */
+
+    if (reg_cache_test() != 0) {
+        ++nb_err;
+    }
+
+    printf("End of test for the SX1301 simulator, %d error(s)\n", nb_err);
+
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,314 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Minimum test program for the timestamp <-> time conversions of loragw_gps
+    Checks properties of the fixed point conversions on random references and
+    values: rounding to the nearest ns (or us) against an exact computation,
+    round trips, monotony and continuity across the counter wrap, then
+    measures their speed against the former floating point conversions.
+    No concentrator nor GPS receiver is needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_* rand */
+#include <string.h>     /* memset */
+#include <math.h>       /* modf fabsl */
+#include <time.h>       /* clock_gettime */
+
+#include "loragw_gps.h"
+#include "test_loragw_util.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NB_REF          2000    /* random references */
+#define NB_VAL          1000    /* random values per reference */
+#define MAX_ROUND       0.502   /* rounding to the nearest, plus the error of the fixed point ratios */
+#define BENCH_SIZE      1024
+#define BENCH_NB_LOOP   2000
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static int nb_err = 0;
+static int nb_check = 0;
+
+static uint32_t bench_cnt[BENCH_SIZE];
+static struct timespec bench_time[BENCH_SIZE];
+static struct lgw_tref_pub_s pub;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* former floating point counter -> time conversion, with the same interface, for the benchmark */
+__attribute__((noipa)) static void old_cnt2utc(struct tref ref, uint32_t count_us, struct timespec *utc) {
+    double delta_sec;
+    double intpart, fractpart;
+    long tmp;
+
+    delta_sec = (double)(count_us - ref.count_us) / (1E6 * ref.xtal_err);
+    fractpart = modf (delta_sec , &intpart);
+    tmp = ref.utc.tv_nsec + (long)(fractpart * 1E9);
+    if (tmp < (long)1E9) {
+        utc->tv_sec = ref.utc.tv_sec + (time_t)intpart;
+        utc->tv_nsec = tmp;
+    } else {
+        utc->tv_sec = ref.utc.tv_sec + (time_t)intpart + 1;
+        utc->tv_nsec = tmp - (long)1E9;
+    }
+}
+
+/* former floating point time -> counter conversion, with the same interface, for the benchmark */
+__attribute__((noipa)) static uint32_t old_utc2cnt(struct tref ref, struct timespec utc) {
+    double delta_sec;
+
+    delta_sec = (double)(utc.tv_sec - ref.utc.tv_sec);
+    delta_sec += 1E-9 * (double)(utc.tv_nsec - ref.utc.tv_nsec);
+    return ref.count_us + (uint32_t)(delta_sec * 1E6 * ref.xtal_err);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint32_t rand32(void) {
+    return ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+}
+
+/* random valid reference, the limits of the clock error included */
+static void ref_rand(struct tref *ref) {
+    ref->systime = 1;
+    ref->count_us = rand32();
+    ref->utc.tv_sec = 1000000000 + rand32() % 1000000000;
+    ref->utc.tv_nsec = (rand() % 8 == 0) ? 999999999 * (rand() % 2) : (long)(rand32() % 1000000000);
+    ref->gps.tv_sec = ref->utc.tv_sec - 315964800 + 18;
+    ref->gps.tv_nsec = rand32() % 1000000000;
+    switch (rand() % 8) {
+        case 0: ref->xtal_err = 0.99999; break;
+        case 1: ref->xtal_err = 1.00001; break;
+        case 2: ref->xtal_err = 1.0; break;
+        default: ref->xtal_err = 0.99999 + 0.00002 * ((double)rand() / RAND_MAX);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int64_t diff_ns(const struct timespec *a, const struct timespec *b) {
+    return (int64_t)(a->tv_sec - b->tv_sec) * 1000000000 + (a->tv_nsec - b->tv_nsec);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* check the conversions of the counter value ref->count_us + delta_cnt */
+static void check_cnt(const struct tref *ref, int32_t delta_cnt) {
+    uint32_t cnt = ref->count_us + (uint32_t)delta_cnt;
+    struct timespec utc, gps;
+    uint32_t back;
+    long double exact;
+
+    ++nb_check;
+    lgw_cnt2utc(*ref, cnt, &utc);
+    lgw_cnt2gps(*ref, cnt, &gps);
+    CHECK((utc.tv_nsec >= 0) && (utc.tv_nsec < 1000000000) && (gps.tv_nsec >= 0) && (gps.tv_nsec < 1000000000),
+          "%u converted to a denormalized time\n", cnt);
+
+    /* nearest nanosecond */
+    exact = (long double)delta_cnt * 1000.0L / (long double)ref->xtal_err;
+    CHECK(fabsl((long double)diff_ns(&utc, &ref->utc) - exact) <= MAX_ROUND, "%d us (xtal_err %.9f) converted to %lld ns instead of %.3Lf\n",
+          delta_cnt, ref->xtal_err, (long long)diff_ns(&utc, &ref->utc), exact);
+    CHECK(diff_ns(&utc, &ref->utc) == diff_ns(&gps, &ref->gps), "UTC and GPS conversions of %d us differ\n", delta_cnt);
+
+    /* round trips are exact, a nanosecond error is far below half a microsecond */
+    lgw_utc2cnt(*ref, utc, &back);
+    CHECK(back == cnt, "UTC round trip of %u gives %u\n", cnt, back);
+    lgw_gps2cnt(*ref, gps, &back);
+    CHECK(back == cnt, "GPS round trip of %u gives %u\n", cnt, back);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* check the conversions of the time ref->utc + delta_ns */
+static void check_time(const struct tref *ref, int64_t delta_ns) {
+    struct timespec utc, back;
+    uint32_t cnt;
+    long double exact;
+
+    ++nb_check;
+    utc.tv_sec = ref->utc.tv_sec + delta_ns / 1000000000;
+    utc.tv_nsec = ref->utc.tv_nsec + delta_ns % 1000000000;
+    if (utc.tv_nsec < 0) {
+        utc.tv_sec -= 1;
+        utc.tv_nsec += 1000000000;
+    } else if (utc.tv_nsec >= 1000000000) {
+        utc.tv_sec += 1;
+        utc.tv_nsec -= 1000000000;
+    }
+    lgw_utc2cnt(*ref, utc, &cnt);
+
+    /* nearest microsecond */
+    exact = (long double)delta_ns * (long double)ref->xtal_err / 1000.0L;
+    CHECK(fabsl((long double)(int32_t)(cnt - ref->count_us) - exact) <= MAX_ROUND, "%lld ns (xtal_err %.9f) converted to %d us instead of %.3Lf\n",
+          (long long)delta_ns, ref->xtal_err, (int32_t)(cnt - ref->count_us), exact);
+
+    /* round trip within half a microsecond */
+    lgw_cnt2utc(*ref, cnt, &back);
+    CHECK(llabs(diff_ns(&back, &utc)) <= 501, "round trip of %lld ns is %lld ns off\n", (long long)delta_ns, (long long)diff_ns(&back, &utc));
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+    static const int32_t edge[] = {0, 1, -1, 999, 1000, 1000000, -1000000, INT32_MAX, INT32_MIN, INT32_MAX - 1, INT32_MIN + 1};
+    struct tref ref, ref_sync;
+    struct timespec t, t_prev, start, stop;
+    uint32_t cnt, cnt_sync;
+    int64_t d;
+    int i, j, k;
+    double t_old, t_new, t_batch;
+
+    printf("Beginning of test for the timestamp <-> time conversions\n");
+
+    memset(&ref, 0, sizeof ref);
+
+    /* rounding and round trips */
+    srand(1);
+    for (i = 0; i < NB_REF; ++i) {
+        ref_rand(&ref);
+        for (j = 0; j < (int)ARRAY_SIZE(edge); ++j) {
+            check_cnt(&ref, edge[j]);
+        }
+        for (j = 0; j < NB_VAL; ++j) {
+            check_cnt(&ref, (int32_t)rand32());
+            d = (((int64_t)rand32() << 10) ^ rand32()) % 2147000000000; /* counter range */
+            check_time(&ref, (rand() % 2) ? d : -d);
+        }
+    }
+    printf("Rounding and round trips: %d values checked, %d error(s)\n", nb_check, nb_err);
+
+    /* monotony and continuity across the counter wrap, reference just before it */
+    k = nb_err;
+    ref_rand(&ref);
+    ref.count_us = 0xFFFFFFFF - 500000;
+    ref.xtal_err = 1.000007;
+    lgw_cnt2utc(ref, ref.count_us - 1000000, &t_prev);
+    for (cnt = ref.count_us - 999999; cnt != ref.count_us + 1000001; ++cnt) {
+        lgw_cnt2utc(ref, cnt, &t);
+        d = diff_ns(&t, &t_prev);
+        CHECK((d == 999) || (d == 1000), "%u and %u converted %lld ns apart\n", cnt - 1, cnt, (long long)d);
+        t_prev = t;
+    }
+    printf("Counter wrap: 2000000 successive values checked, %d error(s)\n", nb_err - k);
+
+    /* invalid references */
+    ref.xtal_err = 1.0001;
+    CHECK(lgw_cnt2utc(ref, 0, &t) == LGW_GPS_ERROR, "conversion with an out of range clock error\n");
+    ref.xtal_err = 1.0;
+    ref.systime = 0;
+    CHECK(lgw_utc2cnt(ref, t, &cnt) == LGW_GPS_ERROR, "conversion before the first synchronization\n");
+
+    /* cached ratios, the reference read back from lgw_tref_get carries them */
+    k = nb_err;
+    ref_rand(&ref);
+    ref.xtal_err = 1.000003;
+    lgw_tref_init(&pub);
+    lgw_tref_set(&pub, &ref);
+    lgw_tref_get(&pub, &ref_sync);
+    CHECK((ref_sync.cnt2ns != 0) && (ref_sync.ns2cnt != 0), "ratios not cached in the published reference\n");
+    for (i = 0; i < BENCH_SIZE; ++i) {
+        bench_cnt[i] = ref.count_us + rand32() % 1000000000;
+        lgw_cnt2utc(ref, bench_cnt[i], &t);
+        lgw_cnt2utc(ref_sync, bench_cnt[i], &t_prev);
+        CHECK(diff_ns(&t, &t_prev) == 0, "%u converted differently with the cached ratios\n", bench_cnt[i]);
+        lgw_utc2cnt(ref, t, &cnt);
+        lgw_utc2cnt(ref_sync, t, &cnt_sync);
+        CHECK(cnt == cnt_sync, "%u converted back differently with the cached ratios\n", bench_cnt[i]);
+    }
+    ref_sync.xtal_err = 1.000004; /* modified by hand, the cache must be ignored */
+    ref.xtal_err = 1.000004;
+    lgw_cnt2utc(ref, bench_cnt[0], &t);
+    lgw_cnt2utc(ref_sync, bench_cnt[0], &t_prev);
+    CHECK(diff_ns(&t, &t_prev) == 0, "stale cached ratios used\n");
+    ref.xtal_err = 1.000003;
+    printf("Cached ratios: %d values checked, %d error(s)\n", BENCH_SIZE, nb_err - k);
+
+    /* speed, lgw_cnt2utc and lgw_utc2cnt with a reference from lgw_gps_sync or lgw_tref_get */
+    lgw_tref_get(&pub, &ref_sync);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (k = 0; k < BENCH_NB_LOOP; ++k) {
+        for (i = 0; i < BENCH_SIZE; ++i) {
+            old_cnt2utc(ref, bench_cnt[i], &bench_time[i]);
+        }
+        sink += (uint32_t)bench_time[k % BENCH_SIZE].tv_nsec;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    t_old = elapsed_ns(&start, &stop) / ((double)BENCH_NB_LOOP * BENCH_SIZE);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (k = 0; k < BENCH_NB_LOOP; ++k) {
+        for (i = 0; i < BENCH_SIZE; ++i) {
+            lgw_cnt2utc(ref_sync, bench_cnt[i], &bench_time[i]);
+        }
+        sink += (uint32_t)bench_time[k % BENCH_SIZE].tv_nsec;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    t_new = elapsed_ns(&start, &stop) / ((double)BENCH_NB_LOOP * BENCH_SIZE);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (k = 0; k < BENCH_NB_LOOP; ++k) {
+        lgw_tref_cnt2utc(&pub, bench_cnt, bench_time, BENCH_SIZE);
+        sink += (uint32_t)bench_time[k % BENCH_SIZE].tv_nsec;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    t_batch = elapsed_ns(&start, &stop) / ((double)BENCH_NB_LOOP * BENCH_SIZE);
+    printf("Counter -> UTC: %.1f ns floating point, %.1f ns lgw_cnt2utc, %.1f ns lgw_tref_cnt2utc\n", t_old, t_new, t_batch);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (k = 0; k < BENCH_NB_LOOP; ++k) {
+        for (i = 0; i < BENCH_SIZE; ++i) {
+            bench_cnt[i] = old_utc2cnt(ref, bench_time[i]);
+        }
+        sink += bench_cnt[k % BENCH_SIZE];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    t_old = elapsed_ns(&start, &stop) / ((double)BENCH_NB_LOOP * BENCH_SIZE);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (k = 0; k < BENCH_NB_LOOP; ++k) {
+        for (i = 0; i < BENCH_SIZE; ++i) {
+            lgw_utc2cnt(ref_sync, bench_time[i], &bench_cnt[i]);
+        }
+        sink += bench_cnt[k % BENCH_SIZE];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    t_new = elapsed_ns(&start, &stop) / ((double)BENCH_NB_LOOP * BENCH_SIZE);
+    printf("UTC -> counter: %.1f ns floating point, %.1f ns lgw_utc2cnt\n", t_old, t_new);
+
+    printf("End of test for the timestamp <-> time conversions, %d error(s)\n", nb_err);
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
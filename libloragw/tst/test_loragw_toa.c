@@ -0,0 +1,259 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Minimum test program for the time on air computation of the HAL
+    Checks the integer lgw_time_on_air and lgw_time_on_air_us against the
+    floating point formula lgw_time_on_air used to evaluate, for all the LoRa
+    TX parameters and a range of FSK parameters, then measures their speed.
+    No concentrator is needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_* */
+#include <string.h>     /* memset */
+#include <math.h>       /* pow ceil llround */
+#include <time.h>       /* clock_gettime */
+
+#include "loragw_hal.h"
+#include "test_loragw_util.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define FSK_SYNC_WORD_SIZE  3       /* HAL default */
+#define BENCH_NB_PKT        1024    /* packets in the benchmark set */
+#define BENCH_NB_LOOP       2000    /* passes over the benchmark set */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* Reference: time on air in milliseconds, as lgw_time_on_air used to compute it (Tpacket_us receives the unrounded duration) */
+/* Only the bandwidths the concentrator can transmit are handled */
+static uint32_t ref_time_on_air(struct lgw_pkt_tx_s *packet, double *Tpacket_us) {
+    uint8_t SF, H, DE;
+    uint16_t BW;
+    uint32_t payloadSymbNb, Tpacket;
+    double Tsym, Tpreamble, Tpayload, Tfsk;
+
+    if (packet->modulation == MOD_LORA) {
+        switch (packet->bandwidth) {
+            case BW_125KHZ: BW = 125; break;
+            case BW_250KHZ: BW = 250; break;
+            case BW_500KHZ: BW = 500; break;
+            default: return 0;
+        }
+        switch (packet->datarate) {
+            case DR_LORA_SF7: SF = 7; break;
+            case DR_LORA_SF8: SF = 8; break;
+            case DR_LORA_SF9: SF = 9; break;
+            case DR_LORA_SF10: SF = 10; break;
+            case DR_LORA_SF11: SF = 11; break;
+            case DR_LORA_SF12: SF = 12; break;
+            default: return 0;
+        }
+
+        Tsym = pow(2, SF) / BW;
+        Tpreamble = ((double)(packet->preamble) + 4.25) * Tsym;
+        H = (packet->no_header==false) ? 0 : 1;
+        DE = (SF >= 11) ? 1 : 0;
+        payloadSymbNb = 8 + (ceil((double)(8*packet->size - 4*SF + 28 + 16 - 20*H) / (double)(4*(SF - 2*DE))) * (packet->coderate + 4));
+        Tpayload = payloadSymbNb * Tsym;
+        *Tpacket_us = (Tpreamble + Tpayload) * 1E3;
+        Tpacket = Tpreamble + Tpayload;
+    } else if (packet->modulation == MOD_FSK) {
+        Tfsk = (8 * (double)(packet->preamble + FSK_SYNC_WORD_SIZE + 1 + packet->size + ((packet->no_crc == true) ? 0 : 2)) / (double)packet->datarate) * 1E3;
+        *Tpacket_us = Tfsk * 1E3;
+        Tpacket = (uint32_t)Tfsk + 1;
+    } else {
+        Tpacket = 0;
+    }
+
+    return Tpacket;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+    const uint8_t bw_list[] = {BW_125KHZ, BW_250KHZ, BW_500KHZ};
+    const uint32_t sf_list[] = {DR_LORA_SF7, DR_LORA_SF8, DR_LORA_SF9, DR_LORA_SF10, DR_LORA_SF11, DR_LORA_SF12};
+    const uint8_t cr_list[] = {CR_LORA_4_5, CR_LORA_4_6, CR_LORA_4_7, CR_LORA_4_8};
+    const uint16_t preamble_list[] = {6, 8, 10, 12, 16, 32, 100, 1000, 65535};
+    const uint32_t fsk_dr_list[] = {DR_FSK_MIN, 1200, 4800, 9600, 19200, 38400, 50000, 57600, 100000, 115200, 200000, DR_FSK_MAX};
+    static struct lgw_pkt_tx_s bench_pkt[BENCH_NB_PKT];
+    static uint32_t bench_toa[BENCH_NB_PKT];
+    struct lgw_pkt_tx_s pkt;
+    struct timespec start, stop;
+    double Tpacket_us, t_ref, t_ms, t_us, t_batch;
+    uint32_t ms, us, ref;
+    unsigned nb_check = 0, nb_err = 0, nb_edge = 0;
+    unsigned b, s, c, p, h, sz, d, i, n;
+
+    printf("Beginning of test for the time on air computation\n");
+
+    /* LoRa, every TX parameter */
+    memset(&pkt, 0, sizeof pkt);
+    pkt.modulation = MOD_LORA;
+    for (b = 0; b < ARRAY_SIZE(bw_list); ++b) {
+        pkt.bandwidth = bw_list[b];
+        for (s = 0; s < ARRAY_SIZE(sf_list); ++s) {
+            pkt.datarate = sf_list[s];
+            for (c = 0; c < ARRAY_SIZE(cr_list); ++c) {
+                pkt.coderate = cr_list[c];
+                for (p = 0; p < ARRAY_SIZE(preamble_list); ++p) {
+                    pkt.preamble = preamble_list[p];
+                    for (h = 0; h < 2; ++h) {
+                        pkt.no_header = (h == 1);
+                        for (sz = 0; sz < 256; ++sz) {
+                            pkt.size = sz;
+                            ref = ref_time_on_air(&pkt, &Tpacket_us);
+                            ms = lgw_time_on_air(&pkt);
+                            us = lgw_time_on_air_us(&pkt);
+                            ++nb_check;
+                            if ((us != (uint32_t)llround(Tpacket_us)) || (ms != us / 1000)) {
+                                if (nb_err < 10) {
+                                    printf("ERROR: bw %u dr 0x%02X cr %u preamble %u no_header %u size %u: %u us %u ms instead of %.3f us\n", pkt.bandwidth, pkt.datarate, pkt.coderate, pkt.preamble, h, sz, us, ms, Tpacket_us);
+                                }
+                                ++nb_err;
+                            } else if (ms != ref) {
+                                /* floating point truncation of a duration that is an exact number of milliseconds */
+                                if ((us % 1000 != 0) || (ms != ref + 1)) {
+                                    if (nb_err < 10) {
+                                        printf("ERROR: bw %u dr 0x%02X cr %u preamble %u no_header %u size %u: %u ms instead of %u ms\n", pkt.bandwidth, pkt.datarate, pkt.coderate, pkt.preamble, h, sz, ms, ref);
+                                    }
+                                    ++nb_err;
+                                } else {
+                                    ++nb_edge;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /* FSK, every datarate and payload size, with and without CRC */
+    memset(&pkt, 0, sizeof pkt);
+    pkt.modulation = MOD_FSK;
+    for (d = 0; d < ARRAY_SIZE(fsk_dr_list); ++d) {
+        pkt.datarate = fsk_dr_list[d];
+        for (p = 0; p < ARRAY_SIZE(preamble_list); ++p) {
+            pkt.preamble = preamble_list[p];
+            for (h = 0; h < 2; ++h) {
+                pkt.no_crc = (h == 1);
+                for (sz = 0; sz < 256; ++sz) {
+                    pkt.size = sz;
+                    ref = ref_time_on_air(&pkt, &Tpacket_us);
+                    ms = lgw_time_on_air(&pkt);
+                    us = lgw_time_on_air_us(&pkt);
+                    ++nb_check;
+                    if ((us != (uint32_t)ceil(Tpacket_us - 1E-6)) || ((ms != ref) && ((us % 1000 != 0) || (ms != ref + 1)))) {
+                        if (nb_err < 10) {
+                            printf("ERROR: FSK dr %u preamble %u no_crc %u size %u: %u us %u ms instead of %.3f us %u ms\n", pkt.datarate, pkt.preamble, h, sz, us, ms, Tpacket_us, ref);
+                        }
+                        ++nb_err;
+                    } else if (ms != ref) {
+                        ++nb_edge;
+                    }
+                }
+            }
+        }
+    }
+
+    /* invalid parameters */
+    memset(&pkt, 0, sizeof pkt);
+    pkt.modulation = MOD_LORA;
+    pkt.bandwidth = BW_UNDEFINED;
+    pkt.datarate = DR_LORA_SF7;
+    nb_check += 3;
+    nb_err += (lgw_time_on_air_us(&pkt) != 0) ? 1 : 0;
+    pkt.modulation = MOD_FSK;
+    pkt.datarate = 0;
+    nb_err += (lgw_time_on_air_us(&pkt) != 0) ? 1 : 0;
+    nb_err += (lgw_time_on_air_batch(NULL, 1, bench_toa) != LGW_HAL_ERROR) ? 1 : 0;
+
+    printf("%u values checked, %u mismatch(es), %u exact millisecond(s) the float formula truncated down\n", nb_check, nb_err, nb_edge);
+
+    /* benchmark on a mix of LoRa and FSK packets */
+    for (i = 0; i < BENCH_NB_PKT; ++i) {
+        memset(&bench_pkt[i], 0, sizeof bench_pkt[i]);
+        if (i % 8 == 7) {
+            bench_pkt[i].modulation = MOD_FSK;
+            bench_pkt[i].datarate = 50000;
+        } else {
+            bench_pkt[i].modulation = MOD_LORA;
+            bench_pkt[i].bandwidth = bw_list[i % ARRAY_SIZE(bw_list)];
+            bench_pkt[i].datarate = sf_list[i % ARRAY_SIZE(sf_list)];
+            bench_pkt[i].coderate = cr_list[i % ARRAY_SIZE(cr_list)];
+        }
+        bench_pkt[i].preamble = 8;
+        bench_pkt[i].size = (i * 37) % 256;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (n = 0; n < BENCH_NB_LOOP; ++n) {
+        for (i = 0; i < BENCH_NB_PKT; ++i) {
+            sink += ref_time_on_air(&bench_pkt[i], &Tpacket_us);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    t_ref = elapsed_ns(&start, &stop) / ((double)BENCH_NB_LOOP * BENCH_NB_PKT);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (n = 0; n < BENCH_NB_LOOP; ++n) {
+        for (i = 0; i < BENCH_NB_PKT; ++i) {
+            sink += lgw_time_on_air(&bench_pkt[i]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    t_ms = elapsed_ns(&start, &stop) / ((double)BENCH_NB_LOOP * BENCH_NB_PKT);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (n = 0; n < BENCH_NB_LOOP; ++n) {
+        for (i = 0; i < BENCH_NB_PKT; ++i) {
+            sink += lgw_time_on_air_us(&bench_pkt[i]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    t_us = elapsed_ns(&start, &stop) / ((double)BENCH_NB_LOOP * BENCH_NB_PKT);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (n = 0; n < BENCH_NB_LOOP; ++n) {
+        lgw_time_on_air_batch(bench_pkt, BENCH_NB_PKT, bench_toa);
+        sink += bench_toa[n % BENCH_NB_PKT];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    t_batch = elapsed_ns(&start, &stop) / ((double)BENCH_NB_LOOP * BENCH_NB_PKT);
+    printf("Time per packet: %.1f ns floating point, %.1f ns lgw_time_on_air, %.1f ns lgw_time_on_air_us, %.1f ns lgw_time_on_air_batch\n", t_ref, t_ms, t_us, t_batch);
+
+    printf("End of test for the time on air computation\n");
+
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
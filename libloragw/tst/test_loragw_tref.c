@@ -0,0 +1,279 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Minimum test program for the published time reference of loragw_gps
+    Checks that the array conversions give the same results as lgw_cnt2utc and
+    lgw_cnt2gps, that readers always get a consistent reference while the
+    writer publishes new ones, then compares the cost of a conversion with a
+    mutex-protected reference.
+    No concentrator nor GPS receiver is needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_* rand */
+#include <string.h>     /* memcmp */
+#include <time.h>       /* clock_gettime */
+#include <pthread.h>
+
+#include "loragw_gps.h"
+#include "test_loragw_util.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define NB_VAL          1000    /* values per conversion check */
+#define NB_REF          1000    /* random references checked */
+#define NB_READER       3
+#define NB_PUBLISH      1000000 /* references published while the readers check them */
+#define BATCH_SIZE      16      /* packets fetched by one lgw_receive call */
+#define BENCH_NB_LOOP   200000
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static struct lgw_tref_pub_s pub;
+static struct tref mx_ref;
+static pthread_mutex_t mx_tref = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t cnt[NB_VAL];
+static struct timespec res[NB_VAL];
+
+static volatile bool writer_done = false;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* reference number n, every field derived from n so that a mix of two references is detected */
+static void ref_make(uint32_t n, struct tref *ref) {
+    ref->systime = 1000 + n;
+    ref->count_us = n * 1000003;
+    ref->utc.tv_sec = 1500000000 + n;
+    ref->utc.tv_nsec = (n * 7919) % 1000000000;
+    ref->gps.tv_sec = 1500000000 - 315964800 + 18 + n;
+    ref->gps.tv_nsec = ref->utc.tv_nsec;
+    ref->xtal_err = 1.0 + (double)((int)(n % 199) - 99) * 1E-7;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static bool ref_consistent(const struct tref *ref) {
+    struct tref x;
+    uint32_t n = (uint32_t)(ref->utc.tv_sec - 1500000000);
+
+    ref_make(n, &x);
+    return (ref->systime == x.systime) && (ref->count_us == x.count_us) && (ref->utc.tv_nsec == x.utc.tv_nsec) &&
+           (ref->gps.tv_sec == x.gps.tv_sec) && (ref->gps.tv_nsec == x.gps.tv_nsec) && (ref->xtal_err == x.xtal_err);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void *writer(void *arg) {
+    struct tref ref;
+    uint32_t n;
+
+    (void)arg;
+    for (n = 1; n <= NB_PUBLISH; ++n) {
+        ref_make(n, &ref);
+        lgw_tref_set(&pub, &ref);
+    }
+    writer_done = true;
+    return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* check every copy of the reference until the writer is done, return the number of inconsistent copies */
+static void *reader(void *arg) {
+    struct tref ref;
+    struct timespec utc[BATCH_SIZE];
+    uint32_t nb_bad = 0, last = 0, n;
+
+    (void)arg;
+    while (!writer_done) {
+        lgw_tref_get(&pub, &ref);
+        n = (uint32_t)(ref.utc.tv_sec - 1500000000);
+        if (!ref_consistent(&ref) || (n < last)) {
+            ++nb_bad;
+        }
+        last = n;
+        lgw_tref_cnt2utc(&pub, cnt, utc, BATCH_SIZE);
+    }
+    return (void *)(uintptr_t)nb_bad;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+    pthread_t thread[NB_READER + 1];
+    struct tref ref, ref2;
+    struct timespec t, start, stop;
+    struct timespec utc, gps;
+    void *ret;
+    uint32_t nb_bad = 0;
+    int nb_err = 0;
+    int i, j, k;
+    double t_mx, t_one, t_batch;
+
+    printf("Beginning of test for the published time reference\n");
+
+    /* a new reference is invalid */
+    lgw_tref_init(&pub);
+    cnt[0] = 0;
+    if ((lgw_tref_cnt2utc(&pub, cnt, res, 1) != LGW_GPS_ERROR) || (lgw_tref_cnt2gps(&pub, cnt, res, 1) != LGW_GPS_ERROR)) {
+        printf("ERROR: conversion accepted before the first synchronization\n");
+        ++nb_err;
+    }
+
+    /* array conversions against the single value conversions */
+    srand(1);
+    for (i = 0; i < NB_REF; ++i) {
+        ref_make((uint32_t)rand(), &ref);
+        ref.count_us = (uint32_t)rand() * 2 + (uint32_t)(rand() % 2);
+        lgw_tref_set(&pub, &ref);
+        lgw_tref_get(&pub, &ref2);
+        if ((ref2.cnt2ns == 0) || (ref2.ns2cnt == 0) || (ref2.xtal_err_cached != ref.xtal_err)) {
+            printf("ERROR: reference %d read back without its ratios\n", i);
+            ++nb_err;
+        }
+        ref.cnt2ns = ref2.cnt2ns; /* cached by lgw_tref_set, the other fields are copied as is */
+        ref.ns2cnt = ref2.ns2cnt;
+        ref.xtal_err_cached = ref2.xtal_err_cached;
+        if (memcmp(&ref, &ref2, sizeof ref) != 0) {
+            printf("ERROR: reference %d not read back\n", i);
+            ++nb_err;
+        }
+        for (j = 0; j < NB_VAL; ++j) {
+            cnt[j] = ref.count_us + (uint32_t)rand() * 2 + (uint32_t)(rand() % 2); /* counter wraps included */
+        }
+        for (k = 0; k < 2; ++k) {
+            if (k == 0) {
+                lgw_tref_cnt2utc(&pub, cnt, res, NB_VAL);
+            } else {
+                lgw_tref_cnt2gps(&pub, cnt, res, NB_VAL);
+            }
+            for (j = 0; j < NB_VAL; ++j) {
+                if (k == 0) {
+                    lgw_cnt2utc(ref, cnt[j], &t);
+                } else {
+                    lgw_cnt2gps(ref, cnt[j], &t);
+                }
+                CHECK((t.tv_sec == res[j].tv_sec) && (t.tv_nsec == res[j].tv_nsec), "%u converted to %lld.%09ld instead of %lld.%09ld\n",
+                      cnt[j], (long long)res[j].tv_sec, res[j].tv_nsec, (long long)t.tv_sec, t.tv_nsec);
+            }
+        }
+    }
+    printf("Array conversions: %d references x %d values checked, %d error(s)\n", NB_REF, NB_VAL, nb_err);
+
+    /* synchronization: one second of counter per second of time is accepted, an aberrant pair is not published */
+    lgw_tref_init(&pub);
+    utc.tv_sec = 1500000000;
+    utc.tv_nsec = 0;
+    gps.tv_sec = utc.tv_sec - 315964800 + 18;
+    gps.tv_nsec = 0;
+    for (k = 0; k < 3; ++k) { /* aberrant against the empty reference, the third one resets it */
+        if (lgw_tref_sync(&pub, 4294000000u, utc, gps) == LGW_GPS_SUCCESS) {
+            break;
+        }
+    }
+    utc.tv_sec += 1;
+    gps.tv_sec += 1;
+    k = lgw_tref_sync(&pub, 4294000000u + 1000005, utc, gps); /* +5 ppm, across the counter wrap */
+    lgw_tref_get(&pub, &ref);
+    if ((k != LGW_GPS_SUCCESS) || (ref.count_us != 4294000000u + 1000005) || (ref.utc.tv_sec != utc.tv_sec) || (ref.xtal_err < 1.000004) || (ref.xtal_err > 1.000006)) {
+        printf("ERROR: synchronization not published\n");
+        ++nb_err;
+    }
+    utc.tv_sec += 1;
+    gps.tv_sec += 1;
+    k = lgw_tref_sync(&pub, ref.count_us + 1100000, utc, gps); /* +10% */
+    lgw_tref_get(&pub, &ref2);
+    if ((k != LGW_GPS_ERROR) || (ref2.count_us != ref.count_us) || (ref2.utc.tv_sec != ref.utc.tv_sec) || (ref2.utc.tv_nsec != ref.utc.tv_nsec) ||
+        (ref2.xtal_err != ref.xtal_err) || (ref2.drift.nb_aberrant != 1)) {
+        printf("ERROR: aberrant synchronization published\n");
+        ++nb_err;
+    }
+
+    /* readers checking the reference while it is published as fast as possible */
+    ref_make(0, &ref);
+    lgw_tref_set(&pub, &ref);
+    for (j = 0; j < BATCH_SIZE; ++j) {
+        cnt[j] = (uint32_t)j * 1000;
+    }
+    for (i = 0; i < NB_READER; ++i) {
+        pthread_create(&thread[i], NULL, reader, NULL);
+    }
+    pthread_create(&thread[NB_READER], NULL, writer, NULL);
+    for (i = 0; i <= NB_READER; ++i) {
+        pthread_join(thread[i], &ret);
+        nb_bad += (uint32_t)(uintptr_t)ret;
+    }
+    lgw_tref_get(&pub, &ref);
+    if ((nb_bad != 0) || (ref.utc.tv_sec != 1500000000 + NB_PUBLISH)) {
+        printf("ERROR: %u inconsistent reference copies\n", nb_bad);
+        ++nb_err;
+    }
+    printf("Concurrency: %d references published while %d threads read them, %u inconsistent copies\n", NB_PUBLISH, NB_READER, nb_bad);
+
+    /* cost of converting the timestamps of a batch of packets */
+    ref_make(1, &ref);
+    lgw_tref_set(&pub, &ref);
+    mx_ref = ref;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < BENCH_NB_LOOP; ++i) {
+        for (j = 0; j < BATCH_SIZE; ++j) {
+            pthread_mutex_lock(&mx_tref);
+            lgw_cnt2utc(mx_ref, cnt[j], &res[j]);
+            pthread_mutex_unlock(&mx_tref);
+        }
+        sink += (uint32_t)res[i % BATCH_SIZE].tv_nsec;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    t_mx = elapsed_ns(&start, &stop) / ((double)BENCH_NB_LOOP * BATCH_SIZE);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < BENCH_NB_LOOP; ++i) {
+        for (j = 0; j < BATCH_SIZE; ++j) {
+            lgw_tref_get(&pub, &ref);
+            lgw_cnt2utc(ref, cnt[j], &res[j]);
+        }
+        sink += (uint32_t)res[i % BATCH_SIZE].tv_nsec;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    t_one = elapsed_ns(&start, &stop) / ((double)BENCH_NB_LOOP * BATCH_SIZE);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < BENCH_NB_LOOP; ++i) {
+        lgw_tref_cnt2utc(&pub, cnt, res, BATCH_SIZE);
+        sink += (uint32_t)res[i % BATCH_SIZE].tv_nsec;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    t_batch = elapsed_ns(&start, &stop) / ((double)BENCH_NB_LOOP * BATCH_SIZE);
+    printf("Time per timestamp: %.1f ns with a mutex, %.1f ns with lgw_tref_get, %.1f ns by arrays of %d\n", t_mx, t_one, t_batch, BATCH_SIZE);
+
+    printf("End of test for the published time reference, %d error(s)\n", nb_err);
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
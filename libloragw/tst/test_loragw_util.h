@@ -0,0 +1,48 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Helpers shared by the test programs: error counting and timing of the
+    benchmark loops.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _TEST_LORAGW_UTIL_H
+#define _TEST_LORAGW_UTIL_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdio.h>      /* printf */
+#include <time.h>       /* struct timespec */
+
+/* -------------------------------------------------------------------------- */
+/* --- MACROS --------------------------------------------------------------- */
+
+/* count a failed check in the nb_err variable of the caller, only the first 10 are printed */
+#define CHECK(cond, args...)    if (!(cond)) { if (nb_err < 10) { printf("ERROR: " args); } ++nb_err; }
+
+/* -------------------------------------------------------------------------- */
+/* --- VARIABLES ------------------------------------------------------------ */
+
+static volatile uint32_t sink; /* keep the benchmark loops from being optimized out */
+
+/* -------------------------------------------------------------------------- */
+/* --- FUNCTIONS ------------------------------------------------------------ */
+
+static inline double elapsed_ns(struct timespec *start, struct timespec *stop) {
+    return (stop->tv_sec - start->tv_sec) * 1E9 + (stop->tv_nsec - start->tv_nsec);
+}
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
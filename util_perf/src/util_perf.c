@@ -0,0 +1,226 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Display the libloragw instrumentation counters exported by a running
+    application (see lgw_perf_export_start)
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf */
+
+#include <signal.h>     /* sigaction */
+#include <unistd.h>     /* getopt usleep */
+#include <stdlib.h>     /* atoi EXIT_* */
+
+#include "loragw_perf.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define MSG(args...)    fprintf(stderr, args) /* message that is destined to the user */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define DEFAULT_PERF_FILE   "/tmp/loragw_perf.bin"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
+
+/* signal handling variables */
+struct sigaction sigact; /* SIGQUIT&SIGINT&SIGTERM signal handling */
+static int exit_sig = 0; /* 1 -> application terminates */
+
+static const char *probe_name[LGW_PERF_PROBE_NB] = {"lgw_receive", "lgw_send", "lgw_reg_r", "lgw_reg_w", "lgw_reg_rb", "lgw_reg_wb", "spi message"};
+
+/* snapshots are too large for the stack */
+static struct lgw_perf_snapshot_s snap_old, snap_new, snap_diff;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static void sig_handler(int sigio);
+
+void usage (void);
+
+static void print_probe(const char *name, const struct lgw_perf_probe_s *p, double duration_s);
+
+static void print_snapshot(const struct lgw_perf_snapshot_s *s, double duration_s, bool per_thread);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static void sig_handler(int sigio) {
+    if ((sigio == SIGQUIT) || (sigio == SIGINT) || (sigio == SIGTERM)) {
+        exit_sig = 1;
+    }
+}
+
+/* describe command line options */
+void usage(void) {
+    MSG( "Available options:\n");
+    MSG( " -h print this help\n");
+    MSG( " -f <path> file exported by the application (default %s)\n", DEFAULT_PERF_FILE);
+    MSG( " -i <int> display the activity every <int> seconds, instead of the totals once\n");
+    MSG( " -t display the counters of each thread\n");
+}
+
+/* one line per probe: calls, rate, latency distribution in microseconds */
+static void print_probe(const char *name, const struct lgw_perf_probe_s *p, double duration_s) {
+    if (p->nb_call == 0) {
+        return;
+    }
+    printf("  %-14s %10llu", name, (unsigned long long)p->nb_call);
+    if (duration_s > 0.0) {
+        printf(" %9.1f/s", p->nb_call / duration_s);
+    }
+    printf(" | mean %9.1f | p50 %9.1f | p90 %9.1f | p99 %9.1f | max %9.1f us\n", (double)p->total_ns / p->nb_call / 1000.0,
+           lgw_perf_percentile(p, 50.0) / 1000.0, lgw_perf_percentile(p, 90.0) / 1000.0, lgw_perf_percentile(p, 99.0) / 1000.0,
+           p->max_ns / 1000.0);
+}
+
+/* duration_s is the length of the interval, 0 for totals */
+static void print_snapshot(const struct lgw_perf_snapshot_s *s, double duration_s, bool per_thread) {
+    uint32_t i;
+    int j;
+
+    for (j = 0; j < LGW_PERF_PROBE_NB; ++j) {
+        print_probe(probe_name[j], &s->probe[j], duration_s);
+    }
+    printf("  SPI: %llu bytes", (unsigned long long)s->counter[LGW_PERF_SPI_BYTES]);
+    if (duration_s > 0.0) {
+        printf(" (%.1f kB/s)", s->counter[LGW_PERF_SPI_BYTES] / duration_s / 1000.0);
+    }
+    printf(", %llu page switches | RX %llu packets | TX %llu packets", (unsigned long long)s->counter[LGW_PERF_PAGE_SWITCH],
+           (unsigned long long)s->counter[LGW_PERF_RX_PKT], (unsigned long long)s->counter[LGW_PERF_TX_PKT]);
+    if (s->nb_lost > 0) {
+        printf(" | %u measures lost (too many threads)", s->nb_lost);
+    }
+    printf("\n");
+
+    if (!per_thread) {
+        return;
+    }
+    for (i = 0; i < s->nb_thread; ++i) {
+        if (s->thread[i].tid != 0) {
+            printf(" thread %d (%s):\n", s->thread[i].tid, s->thread[i].name);
+        } else {
+            printf(" exited thread(s) (%s):\n", s->thread[i].name);
+        }
+        for (j = 0; j < LGW_PERF_PROBE_NB; ++j) {
+            print_probe(probe_name[j], &s->thread[i].probe[j], duration_s);
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i;
+
+    /* application option */
+    const char *path = DEFAULT_PERF_FILE;
+    int interval_s = 0;
+    bool per_thread = false;
+
+    /* parse command line options */
+    while ((i = getopt (argc, argv, "hf:i:t")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+
+            case 'f':
+                path = optarg;
+                break;
+
+            case 'i':
+                interval_s = atoi(optarg);
+                if (interval_s <= 0) {
+                    MSG("ERROR: invalid interval\n");
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 't':
+                per_thread = true;
+                break;
+
+            default:
+                MSG("ERROR: argument parsing use -h option for help\n");
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    /* configure signal handling */
+    sigemptyset(&sigact.sa_mask);
+    sigact.sa_flags = 0;
+    sigact.sa_handler = sig_handler;
+    sigaction(SIGQUIT, &sigact, NULL);
+    sigaction(SIGINT, &sigact, NULL);
+    sigaction(SIGTERM, &sigact, NULL);
+
+    if (lgw_perf_import(path, &snap_new) != LGW_PERF_SUCCESS) {
+        MSG("ERROR: failed to read %s, is the application exporting its counters with the same library version?\n", path);
+        return EXIT_FAILURE;
+    }
+    if (interval_s == 0) {
+        printf("Totals, %u thread(s):\n", snap_new.nb_thread);
+        print_snapshot(&snap_new, 0.0, per_thread);
+        return EXIT_SUCCESS;
+    }
+
+    /* the file is replaced atomically by the application, read it at each interval */
+    while (exit_sig == 0) {
+        snap_old = snap_new;
+        sleep(interval_s);
+        if (exit_sig != 0) {
+            break;
+        }
+        if (lgw_perf_import(path, &snap_new) != LGW_PERF_SUCCESS) {
+            MSG("ERROR: failed to read %s\n", path);
+            return EXIT_FAILURE;
+        }
+        if (snap_new.time_ns <= snap_old.time_ns) {
+            printf("No new counters exported in the last %d s\n", interval_s);
+            continue;
+        }
+        if (snap_new.probe[LGW_PERF_SPI].nb_call < snap_old.probe[LGW_PERF_SPI].nb_call) {
+            printf("Application restarted, totals:\n");
+            print_snapshot(&snap_new, 0.0, per_thread);
+            continue;
+        }
+        lgw_perf_diff(&snap_old, &snap_new, &snap_diff);
+        printf("Last %.1f s:\n", snap_diff.time_ns / 1E9);
+        print_snapshot(&snap_diff, snap_diff.time_ns / 1E9, per_thread);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
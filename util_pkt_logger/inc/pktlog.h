@@ -0,0 +1,135 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Binary packet log format of util_pkt_logger, and CSV formatting shared by
+    the logger and by the pktlog2csv converter.
+
+    A log file is a sequence of records, each one prefixed by its length:
+      - 2 bytes: length of the rest of the record (little endian)
+      - 1 byte: record type
+      - record body
+    The file starts with a header record (magic, version, gateway ID); packet
+    records follow. Files can be appended to or concatenated: every header
+    record sets the gateway ID of the packet records that follow it.
+    All the fields are little endian, floats are stored as IEEE 754 singles.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _PKTLOG_H
+#define _PKTLOG_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdio.h>      /* FILE */
+#include <time.h>       /* struct timespec */
+
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define PKTLOG_SUCCESS      0
+#define PKTLOG_ERROR        -1
+#define PKTLOG_EOF          1
+
+#define PKTLOG_MAGIC        "LGWPKTLG"  /* 8 characters, no terminating null in the file */
+#define PKTLOG_VERSION      1
+
+#define PKTLOG_REC_HEADER   1   /* magic, version, gateway ID */
+#define PKTLOG_REC_PKT      2   /* timestamp and lgw_pkt_rx_s fields */
+
+#define PKTLOG_TIME_HOST    0   /* timestamp read from the host clock when the packets were fetched */
+#define PKTLOG_TIME_GPS     1   /* timestamp derived from the GPS time reference */
+
+#define PKTLOG_REC_MAX      320 /* largest record, length prefix included */
+#define PKTLOG_CSV_TS_SIZE  30  /* CSV timestamp, terminating null included */
+#define PKTLOG_CSV_LINE_MAX 1024
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct pktlog_rec_s
+@brief Record decoded by pktlog_read
+*/
+struct pktlog_rec_s {
+    uint8_t             type;       /*!> PKTLOG_REC_HEADER or PKTLOG_REC_PKT */
+    uint8_t             version;    /*!> format version (header) */
+    uint64_t            gw_id;      /*!> gateway ID (header) */
+    uint8_t             time_src;   /*!> PKTLOG_TIME_HOST or PKTLOG_TIME_GPS (packet) */
+    struct timespec     utc;        /*!> UTC time of the packet (packet) */
+    struct lgw_pkt_rx_s pkt;        /*!> packet metadata and payload (packet) */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Encode a header record
+@param buf buffer of at least PKTLOG_REC_MAX bytes
+@param gw_id gateway ID
+@return number of bytes to write
+*/
+int pktlog_put_header(uint8_t *buf, uint64_t gw_id);
+
+/**
+@brief Encode a packet record
+@param buf buffer of at least PKTLOG_REC_MAX bytes
+@param time_src origin of the timestamp, PKTLOG_TIME_HOST or PKTLOG_TIME_GPS
+@param utc UTC time of the packet
+@param pkt received packet
+@return number of bytes to write
+*/
+int pktlog_put_pkt(uint8_t *buf, uint8_t time_src, const struct timespec *utc, const struct lgw_pkt_rx_s *pkt);
+
+/**
+@brief Read and decode the next record of a log file
+@param f file opened for reading
+@param rec pointer to the structure that will receive the record
+@return PKTLOG_SUCCESS, PKTLOG_EOF at the end of the file, PKTLOG_ERROR if the record is truncated or invalid
+
+Records of an unknown type are skipped.
+*/
+int pktlog_read(FILE *f, struct pktlog_rec_s *rec);
+
+/**
+@brief Format the header line of a CSV log file
+@param buf buffer of at least PKTLOG_CSV_LINE_MAX bytes
+@return length of the line, newline included
+*/
+int pktlog_csv_header(char *buf);
+
+/**
+@brief Format a UTC time as written in the CSV log files
+@param buf buffer of at least PKTLOG_CSV_TS_SIZE bytes
+@param utc UTC time
+@return length of the string
+
+The format is ISO 8601 with milliseconds, eg. 2013-10-09 17:23:45.123Z
+*/
+int pktlog_csv_timestamp(char *buf, const struct timespec *utc);
+
+/**
+@brief Format a packet as a line of a CSV log file
+@param buf buffer of at least PKTLOG_CSV_LINE_MAX bytes
+@param gw_id gateway ID
+@param timestamp UTC time formatted by pktlog_csv_timestamp
+@param pkt received packet
+@return length of the line, newline included
+*/
+int pktlog_csv_line(char *buf, uint64_t gw_id, const char *timestamp, const struct lgw_pkt_rx_s *pkt);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
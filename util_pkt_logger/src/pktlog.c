@@ -0,0 +1,313 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Binary packet log records and CSV formatting (see pktlog.h)
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdio.h>      /* fread snprintf */
+#include <string.h>     /* memcpy memcmp strlen */
+#include <time.h>       /* gmtime_r */
+
+#include "pktlog.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define HEADER_LEN      18  /* type, magic, version, gateway ID */
+#define PKT_FIXED_LEN   52  /* type, timestamp and metadata, payload excluded */
+
+static const char hex_digit[16] = "0123456789ABCDEF";
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static uint8_t *put_u16(uint8_t *b, uint16_t v) {
+    b[0] = (uint8_t)v;
+    b[1] = (uint8_t)(v >> 8);
+    return b + 2;
+}
+
+static uint8_t *put_u32(uint8_t *b, uint32_t v) {
+    b[0] = (uint8_t)v;
+    b[1] = (uint8_t)(v >> 8);
+    b[2] = (uint8_t)(v >> 16);
+    b[3] = (uint8_t)(v >> 24);
+    return b + 4;
+}
+
+static uint8_t *put_u64(uint8_t *b, uint64_t v) {
+    b = put_u32(b, (uint32_t)v);
+    return put_u32(b, (uint32_t)(v >> 32));
+}
+
+static uint8_t *put_float(uint8_t *b, float f) {
+    uint32_t v;
+    memcpy(&v, &f, sizeof v);
+    return put_u32(b, v);
+}
+
+static uint16_t get_u16(const uint8_t *b) {
+    return (uint16_t)(b[0] | (b[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *b) {
+    return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static uint64_t get_u64(const uint8_t *b) {
+    return (uint64_t)get_u32(b) | ((uint64_t)get_u32(b + 4) << 32);
+}
+
+static float get_float(const uint8_t *b) {
+    uint32_t v = get_u32(b);
+    float f;
+    memcpy(&f, &v, sizeof f);
+    return f;
+}
+
+/* copy a string without its terminating null, return the end of the copy */
+static char *put_str(char *s, const char *str) {
+    size_t len = strlen(str);
+    memcpy(s, str, len);
+    return s + len;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int pktlog_put_header(uint8_t *buf, uint64_t gw_id) {
+    uint8_t *b = buf;
+
+    b = put_u16(b, HEADER_LEN);
+    *b++ = PKTLOG_REC_HEADER;
+    memcpy(b, PKTLOG_MAGIC, 8);
+    b += 8;
+    *b++ = PKTLOG_VERSION;
+    b = put_u64(b, gw_id);
+    return (int)(b - buf);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int pktlog_put_pkt(uint8_t *buf, uint8_t time_src, const struct timespec *utc, const struct lgw_pkt_rx_s *pkt) {
+    uint8_t *b = buf;
+    uint16_t size;
+
+    size = (pkt->size <= sizeof pkt->payload) ? pkt->size : sizeof pkt->payload;
+    b = put_u16(b, PKT_FIXED_LEN + size);
+    *b++ = PKTLOG_REC_PKT;
+    *b++ = time_src;
+    b = put_u64(b, (uint64_t)(int64_t)utc->tv_sec);
+    b = put_u32(b, (uint32_t)utc->tv_nsec);
+    b = put_u32(b, pkt->freq_hz);
+    *b++ = pkt->if_chain;
+    *b++ = pkt->status;
+    b = put_u32(b, pkt->count_us);
+    *b++ = pkt->rf_chain;
+    *b++ = pkt->modulation;
+    *b++ = pkt->bandwidth;
+    b = put_u32(b, pkt->datarate);
+    *b++ = pkt->coderate;
+    b = put_float(b, pkt->rssi);
+    b = put_float(b, pkt->snr);
+    b = put_float(b, pkt->snr_min);
+    b = put_float(b, pkt->snr_max);
+    b = put_u16(b, pkt->crc);
+    b = put_u16(b, size);
+    memcpy(b, pkt->payload, size);
+    b += size;
+    return (int)(b - buf);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int pktlog_read(FILE *f, struct pktlog_rec_s *rec) {
+    uint8_t buf[PKTLOG_REC_MAX];
+    const uint8_t *b;
+    size_t n;
+    uint16_t len;
+
+    while (1) {
+        n = fread(buf, 1, 2, f);
+        if (n == 0) {
+            return PKTLOG_EOF;
+        } else if (n < 2) {
+            return PKTLOG_ERROR;
+        }
+        len = get_u16(buf);
+        if ((len == 0) || (len > PKTLOG_REC_MAX - 2)) {
+            return PKTLOG_ERROR;
+        }
+        if (fread(buf, 1, len, f) != len) {
+            return PKTLOG_ERROR; /* truncated, eg. power loss while writing */
+        }
+        rec->type = buf[0];
+        b = buf + 1;
+        switch (rec->type) {
+            case PKTLOG_REC_HEADER:
+                if ((len < HEADER_LEN) || (memcmp(b, PKTLOG_MAGIC, 8) != 0)) {
+                    return PKTLOG_ERROR;
+                }
+                rec->version = b[8];
+                rec->gw_id = get_u64(b + 9);
+                return PKTLOG_SUCCESS;
+
+            case PKTLOG_REC_PKT:
+                if ((len < PKT_FIXED_LEN) || (get_u16(buf + PKT_FIXED_LEN - 2) > sizeof rec->pkt.payload) ||
+                    (len != PKT_FIXED_LEN + get_u16(buf + PKT_FIXED_LEN - 2))) {
+                    return PKTLOG_ERROR; /* payload larger than the packet structure can hold */
+                }
+                rec->time_src = b[0];
+                rec->utc.tv_sec = (time_t)(int64_t)get_u64(b + 1);
+                rec->utc.tv_nsec = (long)get_u32(b + 9);
+                b += 13;
+                rec->pkt.freq_hz = get_u32(b);
+                rec->pkt.if_chain = b[4];
+                rec->pkt.status = b[5];
+                rec->pkt.count_us = get_u32(b + 6);
+                rec->pkt.rf_chain = b[10];
+                rec->pkt.modulation = b[11];
+                rec->pkt.bandwidth = b[12];
+                rec->pkt.datarate = get_u32(b + 13);
+                rec->pkt.coderate = b[17];
+                rec->pkt.rssi = get_float(b + 18);
+                rec->pkt.snr = get_float(b + 22);
+                rec->pkt.snr_min = get_float(b + 26);
+                rec->pkt.snr_max = get_float(b + 30);
+                rec->pkt.crc = get_u16(b + 34);
+                rec->pkt.size = get_u16(b + 36);
+                memcpy(rec->pkt.payload, b + 38, rec->pkt.size);
+                return PKTLOG_SUCCESS;
+
+            default:
+                break; /* written by a later version, skip it */
+        }
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int pktlog_csv_header(char *buf) {
+    char *s;
+
+    s = put_str(buf, "\"gateway ID\",\"node MAC\",\"UTC timestamp\",\"us count\",\"frequency\",\"RF chain\",\"RX chain\",\"status\",\"size\",\"modulation\",\"bandwidth\",\"datarate\",\"coderate\",\"RSSI\",\"SNR\",\"payload\"\n");
+    *s = '\0';
+    return (int)(s - buf);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int pktlog_csv_timestamp(char *buf, const struct timespec *utc) {
+    struct tm x;
+
+    gmtime_r(&(utc->tv_sec), &x);
+    return snprintf(buf, PKTLOG_CSV_TS_SIZE, "%04i-%02i-%02i %02i:%02i:%02i.%03liZ", (x.tm_year)+1900, (x.tm_mon)+1, x.tm_mday, x.tm_hour, x.tm_min, x.tm_sec, (utc->tv_nsec)/1000000); /* ISO 8601 format */
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int pktlog_csv_line(char *buf, uint64_t gw_id, const char *timestamp, const struct lgw_pkt_rx_s *pkt) {
+    char *s = buf;
+    int j;
+
+    /* gateway ID, node MAC address (TODO: need to parse payload), UTC timestamp, internal clock, RX frequency, RF chain and RX modem/IF chain */
+    s += sprintf(s, "\"%08X%08X\",\"\",\"%s\",%10u,%10u,%u,%2d,", (uint32_t)(gw_id >> 32), (uint32_t)(gw_id & 0xFFFFFFFF), timestamp, pkt->count_us, pkt->freq_hz, (unsigned)pkt->rf_chain, (int)pkt->if_chain);
+
+    /* status */
+    switch(pkt->status) {
+        case STAT_CRC_OK:       s = put_str(s, "\"CRC_OK\" ,"); break;
+        case STAT_CRC_BAD:      s = put_str(s, "\"CRC_BAD\","); break;
+        case STAT_NO_CRC:       s = put_str(s, "\"NO_CRC\" ,"); break;
+        case STAT_UNDEFINED:    s = put_str(s, "\"UNDEF\"  ,"); break;
+        default:                s = put_str(s, "\"ERR\"    ,");
+    }
+
+    /* payload size */
+    s += sprintf(s, "%3u,", (unsigned)pkt->size);
+
+    /* modulation */
+    switch(pkt->modulation) {
+        case MOD_LORA:  s = put_str(s, "\"LORA\","); break;
+        case MOD_FSK:   s = put_str(s, "\"FSK\" ,"); break;
+        default:        s = put_str(s, "\"ERR\" ,");
+    }
+
+    /* bandwidth */
+    switch(pkt->bandwidth) {
+        case BW_500KHZ:     s = put_str(s, "500000,"); break;
+        case BW_250KHZ:     s = put_str(s, "250000,"); break;
+        case BW_125KHZ:     s = put_str(s, "125000,"); break;
+        case BW_62K5HZ:     s = put_str(s, "62500 ,"); break;
+        case BW_31K2HZ:     s = put_str(s, "31200 ,"); break;
+        case BW_15K6HZ:     s = put_str(s, "15600 ,"); break;
+        case BW_7K8HZ:      s = put_str(s, "7800  ,"); break;
+        case BW_UNDEFINED:  s = put_str(s, "0     ,"); break;
+        default:            s = put_str(s, "-1    ,");
+    }
+
+    /* datarate */
+    if (pkt->modulation == MOD_LORA) {
+        switch (pkt->datarate) {
+            case DR_LORA_SF7:   s = put_str(s, "\"SF7\"   ,"); break;
+            case DR_LORA_SF8:   s = put_str(s, "\"SF8\"   ,"); break;
+            case DR_LORA_SF9:   s = put_str(s, "\"SF9\"   ,"); break;
+            case DR_LORA_SF10:  s = put_str(s, "\"SF10\"  ,"); break;
+            case DR_LORA_SF11:  s = put_str(s, "\"SF11\"  ,"); break;
+            case DR_LORA_SF12:  s = put_str(s, "\"SF12\"  ,"); break;
+            default:            s = put_str(s, "\"ERR\"   ,");
+        }
+    } else if (pkt->modulation == MOD_FSK) {
+        s += sprintf(s, "\"%6u\",", pkt->datarate);
+    } else {
+        s = put_str(s, "\"ERR\"   ,");
+    }
+
+    /* coderate */
+    switch (pkt->coderate) {
+        case CR_LORA_4_5:   s = put_str(s, "\"4/5\","); break;
+        case CR_LORA_4_6:   s = put_str(s, "\"2/3\","); break;
+        case CR_LORA_4_7:   s = put_str(s, "\"4/7\","); break;
+        case CR_LORA_4_8:   s = put_str(s, "\"1/2\","); break;
+        case CR_UNDEFINED:  s = put_str(s, "\"\"   ,"); break;
+        default:            s = put_str(s, "\"ERR\",");
+    }
+
+    /* packet RSSI and average SNR */
+    s += sprintf(s, "%+.0f,%+5.1f,", pkt->rssi, pkt->snr);
+
+    /* hex-encoded payload (bundled in 32-bit words) */
+    *s++ = '"';
+    for (j = 0; (j < pkt->size) && (j < (int)sizeof pkt->payload); ++j) {
+        if ((j > 0) && (j%4 == 0)) *s++ = '-';
+        *s++ = hex_digit[pkt->payload[j] >> 4];
+        *s++ = hex_digit[pkt->payload[j] & 0x0F];
+    }
+
+    /* end of line */
+    s = put_str(s, "\"\n");
+    *s = '\0';
+    return (int)(s - buf);
+}
+
+/* --- EOF ------------------------------------------------------------------ */
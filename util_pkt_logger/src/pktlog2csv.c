@@ -0,0 +1,190 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Convert the binary log files of util_pkt_logger to the CSV format
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf fopen fwrite */
+
+#include <string.h>     /* strlen strcmp strcpy */
+#include <unistd.h>     /* getopt */
+#include <stdlib.h>     /* EXIT_* */
+
+#include "pktlog.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define MSG(args...)    fprintf(stderr, "pktlog2csv: " args) /* message that is destined to the user */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
+
+static struct pktlog_rec_s rec;
+static char line[PKTLOG_CSV_LINE_MAX];
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+void usage (void);
+
+static int convert(const char *in_name, FILE *out);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* describe command line options */
+void usage(void) {
+    printf("Usage: pktlog2csv [-s] <log file>...\n");
+    printf("Each pktlog_*.bin file is converted to the .csv file util_pkt_logger would have written\n");
+    printf("Available options:\n");
+    printf(" -h print this help\n");
+    printf(" -s write the CSV lines to the standard output instead\n");
+}
+
+/* write the CSV lines of a binary log file, return the number of packets or -1 */
+static int convert(const char *in_name, FILE *out) {
+    FILE *in;
+    int i, nb_pkt = 0;
+    bool header = false;
+    uint64_t gw_id = 0;
+    struct timespec last_utc = {-1, 0};
+    char timestamp[PKTLOG_CSV_TS_SIZE];
+
+    in = fopen(in_name, "rb");
+    if (in == NULL) {
+        MSG("ERROR: impossible to open %s\n", in_name);
+        return -1;
+    }
+
+    while ((i = pktlog_read(in, &rec)) == PKTLOG_SUCCESS) {
+        if (rec.type == PKTLOG_REC_HEADER) {
+            if (rec.version > PKTLOG_VERSION) {
+                MSG("ERROR: %s was written with format version %u, only version %u and older are supported\n", in_name, rec.version, PKTLOG_VERSION);
+                fclose(in);
+                return -1;
+            }
+            /* the logger writes the CSV header each time it opens a file */
+            header = true;
+            gw_id = rec.gw_id;
+            fwrite(line, 1, pktlog_csv_header(line), out);
+        } else if (header == false) {
+            MSG("ERROR: %s is not a packet log file\n", in_name);
+            fclose(in);
+            return -1;
+        } else {
+            /* packets fetched together share their timestamp */
+            if ((rec.utc.tv_sec != last_utc.tv_sec) || (rec.utc.tv_nsec != last_utc.tv_nsec)) {
+                last_utc = rec.utc;
+                pktlog_csv_timestamp(timestamp, &rec.utc);
+            }
+            fwrite(line, 1, pktlog_csv_line(line, gw_id, timestamp, &rec.pkt), out);
+            ++nb_pkt;
+        }
+    }
+    if (i == PKTLOG_ERROR) {
+        if (header == false) {
+            MSG("ERROR: %s is not a packet log file\n", in_name);
+            fclose(in);
+            return -1;
+        }
+        MSG("WARNING: %s ends with a truncated or invalid record, the rest of the file is ignored\n", in_name);
+    }
+
+    fclose(in);
+    return nb_pkt;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    int i, nb_pkt;
+    bool to_stdout = false;
+    int status = EXIT_SUCCESS;
+    FILE *out;
+    char out_name[256];
+    size_t len;
+
+    /* parse command line options */
+    while ((i = getopt (argc, argv, "hs")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+
+            case 's':
+                to_stdout = true;
+                break;
+
+            default:
+                MSG("ERROR: argument parsing use -h option for help\n");
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    for (i = optind; i < argc; ++i) {
+        if (to_stdout) {
+            if (convert(argv[i], stdout) < 0) {
+                status = EXIT_FAILURE;
+            }
+            continue;
+        }
+
+        /* pktlog_<ID>_<date>.bin -> pktlog_<ID>_<date>.csv */
+        len = strlen(argv[i]);
+        if ((len < 4) || (len >= sizeof out_name) || (strcmp(argv[i] + len - 4, ".bin") != 0)) {
+            MSG("ERROR: %s does not end with .bin, use -s to convert it\n", argv[i]);
+            status = EXIT_FAILURE;
+            continue;
+        }
+        strcpy(out_name, argv[i]);
+        strcpy(out_name + len - 4, ".csv");
+        out = fopen(out_name, "w");
+        if (out == NULL) {
+            MSG("ERROR: impossible to create %s\n", out_name);
+            status = EXIT_FAILURE;
+            continue;
+        }
+        nb_pkt = convert(argv[i], out);
+        fclose(out);
+        if (nb_pkt < 0) {
+            remove(out_name);
+            status = EXIT_FAILURE;
+        } else {
+            MSG("INFO: %s written, %d packet(s)\n", out_name, nb_pkt);
+        }
+    }
+
+    return status;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
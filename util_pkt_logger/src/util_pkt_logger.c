@@ -35,8 +35,11 @@ Maintainer: Sylvain Miermont
 #include <stdlib.h>     /* atoi */
 
 #include "parson.h"
+#include "pktlog.h"
 #include "loragw_hal.h"
 #include "loragw_reg.h"
+#include "loragw_rxq.h"
+#include "loragw_perf.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -44,6 +47,11 @@ Maintainer: Sylvain Miermont
 #define ARRAY_SIZE(a)   (sizeof(a) / sizeof((a)[0]))
 #define MSG(args...)    fprintf(stdout,"loragw_pkt_logger: " args) /* message that is destined to the user */
 
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define LOG_BUF_SIZE    65536   /* log file buffer, written to the card when full or flushed */
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
 
@@ -61,6 +69,9 @@ time_t now_time;
 time_t log_start_time;
 FILE * log_file = NULL;
 char log_file_name[64];
+bool log_csv = false; /* write CSV lines instead of binary records */
+static uint8_t log_rec[PKTLOG_REC_MAX]; /* binary record being written */
+static char log_line[PKTLOG_CSV_LINE_MAX]; /* CSV line being written */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
@@ -348,15 +359,23 @@ void open_log(void) {
     strftime(iso_date,ARRAY_SIZE(iso_date),"%Y%m%d_%H_%M_%S",gmtime(&now_time)); /* format yyyymmddThhmmssZ */
     log_start_time = now_time; /* keep track of when the log was started, for log rotation */
 
-    sprintf(log_file_name, "pktlog_%s_%s.csv", lgwm_str, iso_date);
+    sprintf(log_file_name, "pktlog_%s_%s.%s", lgwm_str, iso_date, log_csv ? "csv" : "bin");
     log_file = fopen(log_file_name, "a"); /* create log file, append if file already exist */
     if (log_file == NULL) {
         MSG("ERROR: impossible to create log file %s\n", log_file_name);
         exit(EXIT_FAILURE);
     }
+    setvbuf(log_file, NULL, _IOFBF, LOG_BUF_SIZE); /* the main loop flushes it periodically */
 
-    i = fprintf(log_file, "\"gateway ID\",\"node MAC\",\"UTC timestamp\",\"us count\",\"frequency\",\"RF chain\",\"RX chain\",\"status\",\"size\",\"modulation\",\"bandwidth\",\"datarate\",\"coderate\",\"RSSI\",\"SNR\",\"payload\"\n");
-    if (i < 0) {
+    /* CSV header line or binary header record, written at once so the file is always readable */
+    if (log_csv) {
+        i = pktlog_csv_header(log_line);
+        i = fwrite(log_line, 1, i, log_file);
+    } else {
+        i = pktlog_put_header(log_rec, lgwm);
+        i = fwrite(log_rec, 1, i, log_file);
+    }
+    if ((i <= 0) || (fflush(log_file) != 0)) {
         MSG("ERROR: impossible to write to log file %s\n", log_file_name);
         exit(EXIT_FAILURE);
     }
@@ -371,6 +390,11 @@ void usage(void) {
     printf( "Available options:\n");
     printf( " -h print this help\n");
     printf( " -r <int> rotate log file every N seconds (-1 disable log rotation)\n");
+    printf( " -q fetch packets through the background RX acquisition thread\n");
+    printf( " -p <path> export the libloragw instrumentation counters to a file every second (see util_perf)\n");
+    printf( " -c write CSV log files instead of binary ones (see pktlog2csv)\n");
+    printf( " -f <int> write the log file to disk every N seconds (default 1, 0 after each packet fetch)\n");
+    printf( " -v print the received packets and the radio status on the console\n");
 }
 
 /* -------------------------------------------------------------------------- */
@@ -478,6 +502,10 @@ int main(int argc, char **argv)
     int log_rotate_interval = 3600; /* by default, rotation every hour */
     int time_check = 0; /* variable used to limit the number of calls to time() function */
     unsigned long pkt_in_log = 0; /* count the number of packet written in each log file */
+    int log_flush_interval = 1; /* by default, log file written to disk every second */
+    time_t log_flush_time = 0; /* last time the log file was written to disk */
+    bool log_dirty = false; /* packets buffered but not written to disk yet */
+    bool verbose = false;
 
     /* configuration file related */
     const char global_conf_fname[] = "global_conf.json"; /* contain global (typ. network-wide) configuration */
@@ -488,14 +516,16 @@ int main(int argc, char **argv)
     struct lgw_pkt_rx_s rxpkt[LGW_PKT_FIFO_SIZE]; /* array containing up to 16 inbound packets metadata */
     struct lgw_pkt_rx_s *p; /* pointer on a RX packet */
     int nb_pkt;
+    bool use_rxq = false; /* fetch packets from the RX acquisition thread ring instead of polling */
+    struct lgw_rxq_stats_s rxq_stats;
+    const char *perf_path = NULL; /* instrumentation export file */
 
     /* local timestamp variables until we get accurate GPS time */
     struct timespec fetch_time;
-    char fetch_timestamp[30];
-    struct tm * x;
+    char fetch_timestamp[PKTLOG_CSV_TS_SIZE];
 
     /* parse command line options */
-    while ((i = getopt (argc, argv, "hr:")) != -1) {
+    while ((i = getopt (argc, argv, "hqr:p:cf:v")) != -1) {
         switch (i) {
             case 'h':
                 usage();
@@ -510,6 +540,30 @@ int main(int argc, char **argv)
                 }
                 break;
 
+            case 'q':
+                use_rxq = true;
+                break;
+
+            case 'p':
+                perf_path = optarg;
+                break;
+
+            case 'c':
+                log_csv = true;
+                break;
+
+            case 'f':
+                log_flush_interval = atoi(optarg);
+                if (log_flush_interval < 0) {
+                    MSG( "ERROR: Invalid argument for -f option\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'v':
+                verbose = true;
+                break;
+
             default:
                 MSG("ERROR: argument parsing use -h option for help\n");
                 usage();
@@ -551,6 +605,16 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
 
+    /* instrumentation counters, readable by util_perf while the logger runs */
+    if (perf_path != NULL) {
+        if (lgw_perf_export_start(perf_path, 1000) == LGW_PERF_SUCCESS) {
+            MSG("INFO: instrumentation counters exported to %s\n", perf_path);
+        } else {
+            MSG("WARNING: failed to export the instrumentation counters to %s\n", perf_path);
+            perf_path = NULL;
+        }
+    }
+
     /* starting the concentrator */
     i = lgw_start();
     if (i == LGW_HAL_SUCCESS) {
@@ -559,6 +623,16 @@ int main(int argc, char **argv)
         MSG("ERROR: failed to start the concentrator\n");
         return EXIT_FAILURE;
     }
+    if (use_rxq) {
+        i = lgw_rxq_start(NULL);
+        if (i == LGW_RXQ_SUCCESS) {
+            MSG("INFO: RX acquisition thread started\n");
+        } else {
+            MSG("ERROR: failed to start the RX acquisition thread\n");
+            lgw_stop();
+            return EXIT_FAILURE;
+        }
+    }
 
     /* transform the MAC address into a string */
     sprintf(lgwm_str, "%08X%08X", (uint32_t)(lgwm >> 32), (uint32_t)(lgwm & 0xFFFFFFFF));
@@ -570,127 +644,55 @@ int main(int argc, char **argv)
     /* main loop */
     while ((quit_sig != 1) && (exit_sig != 1)) {
         /* fetch packets */
-        nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
-        MSG("lgw rx %d\n", nb_pkt);
-        if(lgw_check() == 0){
-            MSG("Radio OK\n");
+        if (use_rxq) {
+            nb_pkt = lgw_rxq_wait(ARRAY_SIZE(rxpkt), rxpkt, 100); /* wake up regularly to check signals and log rotation */
+        } else {
+            nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+        }
+        if (verbose) {
+            MSG("lgw rx %d\n", nb_pkt);
+            if(lgw_check() == 0){
+                MSG("Radio OK\n");
+            }
         }
         if (nb_pkt == LGW_HAL_ERROR) {
             MSG("ERROR: failed packet fetch, exiting\n");
             return EXIT_FAILURE;
-        } else if (nb_pkt == 0) {
+        } else if ((nb_pkt == 0) && (use_rxq == false)) {
             clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
-        } else {
+        } else if (nb_pkt > 0) {
             /* local timestamp generation until we get accurate GPS time */
             clock_gettime(CLOCK_REALTIME, &fetch_time);
-            x = gmtime(&(fetch_time.tv_sec));
-            sprintf(fetch_timestamp,"%04i-%02i-%02i %02i:%02i:%02i.%03liZ",(x->tm_year)+1900,(x->tm_mon)+1,x->tm_mday,x->tm_hour,x->tm_min,x->tm_sec,(fetch_time.tv_nsec)/1000000); /* ISO 8601 format */
+            if (log_csv) {
+                pktlog_csv_timestamp(fetch_timestamp, &fetch_time);
+            }
         }
 
-        /* log packets */
+        /* log packets, the stream buffers them */
         for (i=0; i < nb_pkt; ++i) {
             p = &rxpkt[i];
-
-            /* writing gateway ID */
-            fprintf(log_file, "\"%08X%08X\",", (uint32_t)(lgwm >> 32), (uint32_t)(lgwm & 0xFFFFFFFF));
-
-            /* writing node MAC address */
-            fputs("\"\",", log_file); // TODO: need to parse payload
-
-            /* writing UTC timestamp*/
-            fprintf(log_file, "\"%s\",", fetch_timestamp);
-            // TODO: replace with GPS time when available
-
-            /* writing internal clock */
-            fprintf(log_file, "%10u,", p->count_us);
-
-            /* writing RX frequency */
-            fprintf(log_file, "%10u,", p->freq_hz);
-
-            /* writing RF chain */
-            fprintf(log_file, "%u,", p->rf_chain);
-
-            /* writing RX modem/IF chain */
-            fprintf(log_file, "%2d,", p->if_chain);
-
-            /* writing status */
-            switch(p->status) {
-                case STAT_CRC_OK:       fputs("\"CRC_OK\" ,", log_file); break;
-                case STAT_CRC_BAD:      fputs("\"CRC_BAD\",", log_file); break;
-                case STAT_NO_CRC:       fputs("\"NO_CRC\" ,", log_file); break;
-                case STAT_UNDEFINED:    fputs("\"UNDEF\"  ,", log_file); break;
-                default:                fputs("\"ERR\"    ,", log_file);
-            }
-
-            /* writing payload size */
-            fprintf(log_file, "%3u,", p->size);
-
-            /* writing modulation */
-            switch(p->modulation) {
-                case MOD_LORA:  fputs("\"LORA\",", log_file); break;
-                case MOD_FSK:   fputs("\"FSK\" ,", log_file); break;
-                default:        fputs("\"ERR\" ,", log_file);
-            }
-
-            /* writing bandwidth */
-            switch(p->bandwidth) {
-                case BW_500KHZ:     fputs("500000,", log_file); break;
-                case BW_250KHZ:     fputs("250000,", log_file); break;
-                case BW_125KHZ:     fputs("125000,", log_file); break;
-                case BW_62K5HZ:     fputs("62500 ,", log_file); break;
-                case BW_31K2HZ:     fputs("31200 ,", log_file); break;
-                case BW_15K6HZ:     fputs("15600 ,", log_file); break;
-                case BW_7K8HZ:      fputs("7800  ,", log_file); break;
-                case BW_UNDEFINED:  fputs("0     ,", log_file); break;
-                default:            fputs("-1    ,", log_file);
-            }
-
-            /* writing datarate */
-            if (p->modulation == MOD_LORA) {
-                switch (p->datarate) {
-                    case DR_LORA_SF7:   fputs("\"SF7\"   ,", log_file); break;
-                    case DR_LORA_SF8:   fputs("\"SF8\"   ,", log_file); break;
-                    case DR_LORA_SF9:   fputs("\"SF9\"   ,", log_file); break;
-                    case DR_LORA_SF10:  fputs("\"SF10\"  ,", log_file); break;
-                    case DR_LORA_SF11:  fputs("\"SF11\"  ,", log_file); break;
-                    case DR_LORA_SF12:  fputs("\"SF12\"  ,", log_file); break;
-                    default:            fputs("\"ERR\"   ,", log_file);
-                }
-            } else if (p->modulation == MOD_FSK) {
-                fprintf(log_file, "\"%6u\",", p->datarate);
+            if (log_csv) {
+                j = pktlog_csv_line(log_line, lgwm, fetch_timestamp, p);
+                fwrite(log_line, 1, j, log_file);
             } else {
-                fputs("\"ERR\"   ,", log_file);
+                j = pktlog_put_pkt(log_rec, PKTLOG_TIME_HOST, &fetch_time, p);
+                fwrite(log_rec, 1, j, log_file);
             }
+            ++pkt_in_log;
 
-            /* writing coderate */
-            switch (p->coderate) {
-                case CR_LORA_4_5:   fputs("\"4/5\",", log_file); break;
-                case CR_LORA_4_6:   fputs("\"2/3\",", log_file); break;
-                case CR_LORA_4_7:   fputs("\"4/7\",", log_file); break;
-                case CR_LORA_4_8:   fputs("\"1/2\",", log_file); break;
-                case CR_UNDEFINED:  fputs("\"\"   ,", log_file); break;
-                default:            fputs("\"ERR\",", log_file);
+            if (verbose) {
+                log_pkt(p);
             }
+        }
 
-            /* writing packet RSSI */
-            fprintf(log_file, "%+.0f,", p->rssi);
-
-            /* writing packet average SNR */
-            fprintf(log_file, "%+5.1f,", p->snr);
-
-            /* writing hex-encoded payload (bundled in 32-bit words) */
-            fputs("\"", log_file);
-            for (j = 0; j < p->size; ++j) {
-                if ((j > 0) && (j%4 == 0)) fputs("-", log_file);
-                fprintf(log_file, "%02X", p->payload[j]);
+        /* write the buffered packets to disk once per flush interval */
+        if (nb_pkt > 0) {
+            log_dirty = true;
+            if (difftime(fetch_time.tv_sec, log_flush_time) >= log_flush_interval) {
+                fflush(log_file);
+                log_flush_time = fetch_time.tv_sec;
+                log_dirty = false;
             }
-
-            /* end of log file line */
-            fputs("\"\n", log_file);
-            fflush(log_file);
-            ++pkt_in_log;
-
-            log_pkt(p);
         }
 
         /* check time and rotate log file if necessary */
@@ -698,8 +700,14 @@ int main(int argc, char **argv)
         if (time_check >= 8) {
             time_check = 0;
             time(&now_time);
+            if (log_dirty && (difftime(now_time, log_flush_time) >= log_flush_interval)) {
+                fflush(log_file);
+                log_flush_time = now_time;
+                log_dirty = false;
+            }
             if (difftime(now_time, log_start_time) > log_rotate_interval) {
                 fclose(log_file);
+                log_dirty = false;
                 MSG("INFO: log file %s closed, %lu packet(s) recorded\n", log_file_name, pkt_in_log);
                 pkt_in_log = 0;
                 open_log();
@@ -709,6 +717,11 @@ int main(int argc, char **argv)
 
     if (exit_sig == 1) {
         /* clean up before leaving */
+        if (use_rxq) {
+            lgw_rxq_stats(&rxq_stats);
+            lgw_rxq_stop();
+            MSG("INFO: RX acquisition thread stopped, %u packet(s) fetched, %u dropped (ring full)\n", rxq_stats.nb_pkt, rxq_stats.nb_overflow);
+        }
         i = lgw_stop();
         if (i == LGW_HAL_SUCCESS) {
             MSG("INFO: concentrator stopped successfully\n");
@@ -717,6 +730,11 @@ int main(int argc, char **argv)
         }
         fclose(log_file);
         MSG("INFO: log file %s closed, %lu packet(s) recorded\n", log_file_name, pkt_in_log);
+        if (perf_path != NULL) {
+            lgw_perf_export_stop();
+        }
+    } else {
+        fflush(log_file); /* do not lose the buffered packets */
     }
 
     MSG("INFO: Exiting packet logger program\n");
@@ -0,0 +1,150 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Minimum test program for the binary packet log records
+    Writes records to a temporary file and reads them back, then checks that
+    corrupted records are rejected.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdio.h>      /* printf tmpfile */
+#include <stdlib.h>     /* EXIT_* */
+#include <string.h>     /* memset memcmp */
+
+#include "loragw_hal.h"
+#include "pktlog.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define GW_ID       0xAA555A0000000101ULL
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* write a buffer to a new temporary file, rewound for reading */
+static FILE *log_file(const uint8_t *buf, int n) {
+    FILE *f;
+
+    f = tmpfile();
+    if (f == NULL) {
+        return NULL;
+    }
+    fwrite(buf, 1, n, f);
+    rewind(f);
+    return f;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+    static uint8_t buf[4 * PKTLOG_REC_MAX];
+    struct lgw_pkt_rx_s pkt;
+    struct pktlog_rec_s rec;
+    struct timespec utc = {1381339425, 123456000};
+    FILE *f;
+    int nb_err = 0;
+    int n, len, i;
+
+    printf("Beginning of test for pktlog.c\n");
+
+    memset(&pkt, 0, sizeof pkt);
+    pkt.freq_hz = 868100000;
+    pkt.if_chain = 2;
+    pkt.status = STAT_CRC_OK;
+    pkt.count_us = 0xDEADBEEF;
+    pkt.modulation = MOD_LORA;
+    pkt.bandwidth = BW_125KHZ;
+    pkt.datarate = DR_LORA_SF7;
+    pkt.coderate = CR_LORA_4_5;
+    pkt.rssi = -42.5;
+    pkt.snr = 9.25;
+    pkt.crc = 0x1234;
+    pkt.size = sizeof pkt.payload;
+    for (i = 0; i < pkt.size; ++i) {
+        pkt.payload[i] = (uint8_t)i;
+    }
+
+    /* header and largest packet, read back */
+    n = pktlog_put_header(buf, GW_ID);
+    n += pktlog_put_pkt(buf + n, PKTLOG_TIME_GPS, &utc, &pkt);
+    f = log_file(buf, n);
+    if (f == NULL) {
+        printf("ERROR: failed to create temporary file\n");
+        return EXIT_FAILURE;
+    }
+    if ((pktlog_read(f, &rec) != PKTLOG_SUCCESS) || (rec.type != PKTLOG_REC_HEADER) || (rec.gw_id != GW_ID)) {
+        printf("ERROR: header record not read back\n");
+        ++nb_err;
+    }
+    if ((pktlog_read(f, &rec) != PKTLOG_SUCCESS) || (rec.type != PKTLOG_REC_PKT) || (rec.time_src != PKTLOG_TIME_GPS) ||
+        (rec.utc.tv_sec != utc.tv_sec) || (rec.utc.tv_nsec != utc.tv_nsec) || (rec.pkt.count_us != pkt.count_us) ||
+        (rec.pkt.rssi != pkt.rssi) || (rec.pkt.size != pkt.size) || (memcmp(rec.pkt.payload, pkt.payload, pkt.size) != 0)) {
+        printf("ERROR: packet record not read back\n");
+        ++nb_err;
+    }
+    if (pktlog_read(f, &rec) != PKTLOG_EOF) {
+        printf("ERROR: end of file not detected\n");
+        ++nb_err;
+    }
+    fclose(f);
+
+    /* packet whose payload size is larger than lgw_pkt_rx_s can hold, but still fits in a record */
+    pkt.size = 0;
+    n = pktlog_put_pkt(buf, PKTLOG_TIME_HOST, &utc, &pkt); /* size field is in the last 2 bytes */
+    len = (PKTLOG_REC_MAX - 2) - (n - 2);
+    buf[0] = (uint8_t)(n - 2 + len);
+    buf[1] = (uint8_t)((n - 2 + len) >> 8);
+    buf[n - 2] = (uint8_t)len;
+    buf[n - 1] = (uint8_t)(len >> 8);
+    memset(buf + n, 0x55, len);
+    f = log_file(buf, n + len);
+    if (f == NULL) {
+        printf("ERROR: failed to create temporary file\n");
+        return EXIT_FAILURE;
+    }
+    if (pktlog_read(f, &rec) != PKTLOG_ERROR) {
+        printf("ERROR: packet record with a %d-byte payload accepted\n", len);
+        ++nb_err;
+    }
+    fclose(f);
+
+    /* truncated record */
+    n = pktlog_put_header(buf, GW_ID);
+    f = log_file(buf, n - 1);
+    if ((f != NULL) && (pktlog_read(f, &rec) != PKTLOG_ERROR)) {
+        printf("ERROR: truncated record accepted\n");
+        ++nb_err;
+    }
+    if (f != NULL) {
+        fclose(f);
+    }
+
+    printf("End of test for pktlog.c, %d error(s)\n", nb_err);
+
+    return (nb_err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
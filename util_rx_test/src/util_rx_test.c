@@ -33,10 +33,12 @@ Maintainer: Sylvain Miermont
 #include <time.h>		/* time clock_gettime strftime gmtime clock_nanosleep*/
 #include <unistd.h>		/* getopt access */
 #include <stdlib.h>		/* atoi */
+#include <poll.h>		/* poll */
 
 #include "parson.h"
 #include "loragw_hal.h"
 #include "loragw_reg.h"
+#include "loragw_rxev.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -430,6 +432,8 @@ void usage(void) {
 	printf( "Available options:\n");
 	printf( " -h print this help\n");
 	printf( " -c configuration file\n");
+	printf( " -e wake up on RX events instead of polling every 3 ms\n");
+	printf( " -g <int> host GPIO wired to the concentrator RX interrupt (implies -e)\n");
 }
 
 /* -------------------------------------------------------------------------- */
@@ -450,8 +454,13 @@ int main(int argc, char **argv)
 	struct lgw_pkt_rx_s *p; /* pointer on a RX packet */
 	int nb_pkt;
 
+	/* RX event notification */
+	bool use_rxev = false;
+	struct lgw_conf_rxev_s rxevconf = {LGW_RXEV_GPIO_NONE, NULL, LGW_RXEV_POLL_DEFAULT};
+	struct pollfd pfd;
+
 	/* parse command line options */
-	while ((i = getopt (argc, argv, "hc:")) != -1) {
+	while ((i = getopt (argc, argv, "hc:eg:")) != -1) {
 		switch (i) {
 			case 'h':
 				usage();
@@ -463,6 +472,15 @@ int main(int argc, char **argv)
 				conf_fname = buf;
 				break;
 
+			case 'e':
+				use_rxev = true;
+				break;
+
+			case 'g':
+				rxevconf.gpio = atoi(optarg);
+				use_rxev = true;
+				break;
+
 			default:
 				MSG("ERROR: argument parsing use -h option for help\n");
 				usage();
@@ -502,6 +520,15 @@ int main(int argc, char **argv)
 		MSG("ERROR: failed to start the concentrator\n");
 		return EXIT_FAILURE;
 	}
+	if (use_rxev) {
+		pfd.fd = lgw_rxev_start(&rxevconf);
+		pfd.events = POLLIN;
+		if (pfd.fd == LGW_RXEV_ERROR) {
+			MSG("ERROR: failed to start RX event notification\n");
+			lgw_stop();
+			return EXIT_FAILURE;
+		}
+	}
 
 	if(loramac_flag){
 		printf("LORAMAC MODE\n");
@@ -521,6 +548,9 @@ int main(int argc, char **argv)
 		if (nb_pkt == LGW_HAL_ERROR) {
 			MSG("ERROR: failed packet fetch, exiting\n");
 			return EXIT_FAILURE;
+		} else if ((nb_pkt == 0) && use_rxev) {
+			poll(&pfd, 1, 100); /* wait for packets, wake up regularly to check signals */
+			lgw_rxev_ack();
 		} else if (nb_pkt == 0) {
 			clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
 		} else {
@@ -589,6 +619,9 @@ int main(int argc, char **argv)
 
 	if (exit_sig == 1) {
 		/* clean up before leaving */
+		if (use_rxev) {
+			lgw_rxev_stop();
+		}
 		i = lgw_stop();
 		if (i == LGW_HAL_SUCCESS) {
 			MSG("INFO: concentrator stopped successfully\n");
@@ -31,8 +31,11 @@ Maintainer: Sylvain Miermont
 #include <signal.h>     /* sigaction */
 #include <unistd.h>     /* getopt access */
 #include <stdlib.h>     /* rand */
+#include <string.h>     /* strcmp */
+#include <time.h>       /* clock_gettime */
 
 #include "loragw_reg.h"
+#include "loragw_spi.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -47,6 +50,8 @@ Maintainer: Sylvain Miermont
 #define READS_WHEN_ERROR        16 /* number of times a read is repeated if there is a read error */
 #define BUFF_SIZE               1024 /* maximum number of bytes that we can write in sx1301 RX data buffer */
 #define DEFAULT_TX_NOTCH_FREQ   129E3
+#define BENCH_REG_OPS           10000 /* number of register R/W pairs per delay policy in benchmark mode */
+#define DEFAULT_SPI_DELAY_NS    8000
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
@@ -63,6 +68,8 @@ static void sig_handler(int sigio);
 
 void usage (void);
 
+static double bench_reg_ops(int nb_ops);
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
@@ -78,7 +85,27 @@ static void sig_handler(int sigio) {
 void usage(void) {
     MSG( "Available options:\n");
     MSG( " -h print this help\n");
-    MSG( " -t <int> specify which test you want to run (1-4)\n");
+    MSG( " -t <int> specify which test you want to run (1-5)\n");
+    MSG( " -d <none|busy|sleep> SPI inter-transaction delay policy for tests 1-4\n");
+    MSG( " -n <int> SPI inter-transaction delay in nanoseconds (default %d)\n", DEFAULT_SPI_DELAY_NS);
+}
+
+/* run nb_ops register writes and reads, return the number of register operations per second */
+static double bench_reg_ops(int nb_ops) {
+    int i;
+    int32_t read_value;
+    struct timespec start, end;
+    double elapsed;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i=0; i<nb_ops; ++i) {
+        lgw_reg_w(LGW_IMPLICIT_PAYLOAD_LENGHT, i & 0xFF);
+        lgw_reg_r(LGW_IMPLICIT_PAYLOAD_LENGHT, &read_value);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1E9;
+
+    return (2.0 * nb_ops) / elapsed;
 }
 
 /* -------------------------------------------------------------------------- */
@@ -94,6 +121,10 @@ int main(int argc, char **argv)
     int cycle_number = 0;
     int repeats_per_cycle = 1000;
     bool error = false;
+    uint8_t spi_delay_mode = LGW_SPI_DELAY_BUSYWAIT;
+    uint32_t spi_delay_ns = DEFAULT_SPI_DELAY_NS;
+    const char *policy_name[] = {"none", "busy-wait", "sleep"};
+    double ops_per_sec;
 
     /* in/out variables */
     int32_t test_value;
@@ -106,7 +137,7 @@ int main(int argc, char **argv)
     uint8_t read_buff[BUFF_SIZE];
 
     /* parse command line options */
-    while ((i = getopt (argc, argv, "ht:")) != -1) {
+    while ((i = getopt (argc, argv, "ht:d:n:")) != -1) {
         switch (i) {
             case 'h':
                 usage();
@@ -115,7 +146,7 @@ int main(int argc, char **argv)
 
             case 't':
                 i = sscanf(optarg, "%i", &xi);
-                if ((i != 1) || (xi < 1) || (xi > 4)) {
+                if ((i != 1) || (xi < 1) || (xi > 5)) {
                     MSG("ERROR: invalid test number\n");
                     return EXIT_FAILURE;
                 } else {
@@ -123,6 +154,29 @@ int main(int argc, char **argv)
                 }
                 break;
 
+            case 'd':
+                if (strcmp(optarg, "none") == 0) {
+                    spi_delay_mode = LGW_SPI_DELAY_NONE;
+                } else if (strcmp(optarg, "busy") == 0) {
+                    spi_delay_mode = LGW_SPI_DELAY_BUSYWAIT;
+                } else if (strcmp(optarg, "sleep") == 0) {
+                    spi_delay_mode = LGW_SPI_DELAY_SLEEP;
+                } else {
+                    MSG("ERROR: invalid SPI delay policy\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'n':
+                i = sscanf(optarg, "%i", &xi);
+                if ((i != 1) || (xi < 0)) {
+                    MSG("ERROR: invalid SPI delay\n");
+                    return EXIT_FAILURE;
+                } else {
+                    spi_delay_ns = (uint32_t)xi;
+                }
+                break;
+
             default:
                 MSG("ERROR: argument parsing use -h option for help\n");
                 usage();
@@ -145,6 +199,7 @@ int main(int argc, char **argv)
         MSG("ERROR: lgw_connect() did not return SUCCESS");
         return EXIT_FAILURE;
     }
+    lgw_spi_set_delay(spi_delay_mode, spi_delay_ns);
 
     if (test_number == 1) {
         /* single 8b register R/W stress test */
@@ -272,6 +327,13 @@ int main(int argc, char **argv)
                 ++cycle_number;
             }
         }
+    } else if (test_number == 5) {
+        /* register access throughput under each SPI delay policy */
+        for (i=LGW_SPI_DELAY_NONE; i<=LGW_SPI_DELAY_SLEEP; ++i) {
+            lgw_spi_set_delay((uint8_t)i, spi_delay_ns);
+            ops_per_sec = bench_reg_ops(BENCH_REG_OPS);
+            printf("SPI delay policy %-9s (%u ns): %8.0f register ops/s, %7.2f us/op\n", policy_name[i], spi_delay_ns, ops_per_sec, 1E6 / ops_per_sec);
+        }
     } else {
         MSG("ERROR: invalid test number");
         usage();